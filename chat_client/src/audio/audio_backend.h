@@ -0,0 +1,38 @@
+#pragma once
+
+#include "audio_engine.h"
+
+#include <vector>
+
+// A driver for AudioEngine. Each backend owns a clock (a sound card, a timer,
+// a file) and calls AudioEngine::process_block once per buffer from its own
+// thread with mono float input and interleaved stereo float output.
+class AudioBackend {
+public:
+    explicit AudioBackend(AudioEngine& engine) : engine_(engine) {}
+    virtual ~AudioBackend() = default;
+
+    AudioBackend(const AudioBackend&) = delete;
+    AudioBackend& operator=(const AudioBackend&) = delete;
+
+    virtual bool initialize() = 0;
+    virtual std::vector<AudioEngine::AudioDevice> get_devices() = 0;
+    virtual bool open(const AudioEngine::StreamConfig& config) = 0;
+    virtual bool start() = 0;
+    // Stops and closes the stream opened by open()
+    virtual void close() = 0;
+    virtual bool is_active() const = 0;
+    // Fills everything but the engine-level callback count
+    virtual void get_stats(AudioEngine::Stats& stats) const = 0;
+    virtual std::vector<AudioEngine::HostApi> get_host_apis() const { return {}; }
+    // Brings get_devices() up to date with the host's devices; false if it
+    // cannot while the stream runs. Backends whose devices never change
+    // have nothing to do.
+    virtual bool rescan() { return true; }
+    // Moves a running stream to config's device without a gap; false, with
+    // the stream left as it was, if the backend or device cannot
+    virtual bool switch_stream(const AudioEngine::StreamConfig& /*config*/) { return false; }
+
+protected:
+    AudioEngine& engine_;
+};
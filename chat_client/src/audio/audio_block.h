@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// Fixed-size block of captured audio handed from the real-time callback to
+// consumer threads. Callbacks larger than kMaxFrames are split across
+// several consecutive blocks.
+//
+// Consumers gated on voice activity (AudioEngine::set_capture_gating) get
+// only speech: each talk spurt starts with a segment_start block, and the
+// silence after it is reported by dtx blocks that carry no samples.
+struct AudioBlock {
+    static constexpr unsigned kMaxFrames = 1024;
+
+    uint64_t sequence = 0;      // Monotonic per consumer, gaps mean overruns
+    unsigned frames = 0;        // Valid mono frames in samples[]
+    unsigned sample_rate = 0;
+    float input_level = 0.0f;   // RMS of the whole callback the block came from
+    float output_level = 0.0f;  // RMS of the output played alongside the block
+    bool speech = true;         // Inside a talk spurt, hangover and pre-roll included
+    bool segment_start = false; // First block after a gap in a gated stream
+    bool dtx = false;           // Silence event: frames is 0, nothing follows until
+                                // the next segment_start
+    float comfort_noise_level = 0.0f; // dtx: RMS of the background to synthesise
+    float samples[kMaxFrames];
+};
@@ -0,0 +1,360 @@
+#include "audio_codec.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef HAVE_OPUS
+#include <opus.h>
+#endif
+
+namespace {
+
+struct Preset {
+    const char* name;
+    unsigned bitrate;
+    unsigned sample_rate;
+    bool dtx;
+    bool fec;
+};
+
+// quality_presets.audio in config/device_streams.yaml
+constexpr Preset kPresets[] = {
+    { "low", 64000, 16000, true, true },
+    { "medium", 96000, 44100, true, true },
+    { "high", 128000, 48000, true, false },
+};
+
+#ifndef HAVE_OPUS
+
+// IMA ADPCM. Each block starts with the predictor and step index it was
+// encoded from, so every packet decodes on its own.
+constexpr int kStepSizes[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97,
+    107, 118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871,
+    5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767
+};
+constexpr int kIndexSteps[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+constexpr unsigned kRates[] = { 48000, 32000, 24000, 16000, 12000, 8000 };
+constexpr size_t kBlockHeader = 3;  // Predictor (int16) and step index
+constexpr uint8_t kHasFec = 0x01;
+
+struct AdpcmState {
+    int predictor = 0;
+    int index = 0;
+};
+
+size_t block_bytes(size_t samples) {
+    return kBlockHeader + (samples + 1) / 2;
+}
+
+// Packet: a flags byte, the frame's block, then with kHasFec the previous
+// frame's block at half the rate
+size_t packet_bytes(size_t samples, bool fec) {
+    return 1 + block_bytes(samples) + (fec ? block_bytes(samples / 2) : 0);
+}
+
+// The highest rate within both the bitrate and the settings' rate
+unsigned adpcm_rate(const CodecSettings& settings) {
+    for (unsigned rate : kRates) {
+        size_t samples = rate * settings.frame_ms / 1000;
+        uint64_t bits_per_second = uint64_t(packet_bytes(samples, settings.fec)) * 8 * 1000 / settings.frame_ms;
+        if (rate <= settings.sample_rate && bits_per_second <= settings.bitrate) {
+            return rate;
+        }
+    }
+    return kRates[sizeof(kRates) / sizeof(kRates[0]) - 1];
+}
+
+int16_t to_pcm16(float sample) {
+    float scaled = std::max(-1.0f, std::min(1.0f, sample)) * 32767.0f;
+    return static_cast<int16_t>(std::lrint(scaled));
+}
+
+int decode_nibble(AdpcmState& state, int nibble) {
+    int step = kStepSizes[state.index];
+    int diff = step >> 3;
+    if (nibble & 4) diff += step;
+    if (nibble & 2) diff += step >> 1;
+    if (nibble & 1) diff += step >> 2;
+    state.predictor += (nibble & 8) ? -diff : diff;
+    state.predictor = std::max(-32768, std::min(32767, state.predictor));
+    state.index = std::max(0, std::min(88, state.index + kIndexSteps[nibble & 7]));
+    return state.predictor;
+}
+
+int encode_sample(AdpcmState& state, int sample) {
+    int step = kStepSizes[state.index];
+    int diff = sample - state.predictor;
+    int nibble = 0;
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+    if (diff >= step) { nibble |= 4; diff -= step; }
+    if (diff >= step >> 1) { nibble |= 2; diff -= step >> 1; }
+    if (diff >= step >> 2) { nibble |= 1; }
+    // Track exactly what the decoder will reconstruct
+    decode_nibble(state, nibble);
+    return nibble;
+}
+
+uint8_t* encode_block(AdpcmState& state, const int16_t* samples, size_t count, uint8_t* out) {
+    uint16_t predictor = static_cast<uint16_t>(static_cast<int16_t>(state.predictor));
+    *out++ = static_cast<uint8_t>(predictor);
+    *out++ = static_cast<uint8_t>(predictor >> 8);
+    *out++ = static_cast<uint8_t>(state.index);
+    for (size_t i = 0; i < count; i += 2) {
+        int low = encode_sample(state, samples[i]);
+        int high = i + 1 < count ? encode_sample(state, samples[i + 1]) : 0;
+        *out++ = static_cast<uint8_t>(low | high << 4);
+    }
+    return out;
+}
+
+// False if the header is out of range
+bool decode_block(const uint8_t* in, size_t count, float* out) {
+    AdpcmState state;
+    state.predictor = static_cast<int16_t>(static_cast<uint16_t>(in[0] | in[1] << 8));
+    state.index = in[2];
+    if (state.index > 88) {
+        return false;
+    }
+    in += kBlockHeader;
+    for (size_t i = 0; i < count; i += 2) {
+        uint8_t byte = *in++;
+        out[i] = decode_nibble(state, byte & 0x0f) * (1.0f / 32768.0f);
+        if (i + 1 < count) {
+            out[i + 1] = decode_nibble(state, byte >> 4) * (1.0f / 32768.0f);
+        }
+    }
+    return true;
+}
+
+class AdpcmEncoder final : public AudioEncoder {
+public:
+    explicit AdpcmEncoder(const CodecSettings& settings)
+        : AudioEncoder(settings.frame_ms), rate_(adpcm_rate(settings)), fec_(settings.fec),
+          pcm_(frame_samples()), previous_(frame_samples() / 2) {}
+
+    const char* name() const override { return "adpcm"; }
+    unsigned sample_rate() const override { return rate_; }
+
+    size_t encode(const float* pcm, uint8_t* out, size_t capacity) override {
+        size_t samples = frame_samples();
+        size_t bytes = packet_bytes(samples, fec_ && have_previous_);
+        if (capacity < bytes) {
+            return 0;
+        }
+        for (size_t i = 0; i < samples; ++i) {
+            pcm_[i] = to_pcm16(pcm[i]);
+        }
+        uint8_t* end = out + 1;
+        *out = 0;
+        end = encode_block(state_, pcm_.data(), samples, end);
+        if (fec_) {
+            if (have_previous_) {
+                *out |= kHasFec;
+                end = encode_block(fec_state_, previous_.data(), previous_.size(), end);
+            }
+            // Halved by averaging pairs, for the next packet to carry
+            for (size_t i = 0; i < previous_.size(); ++i) {
+                previous_[i] = static_cast<int16_t>((pcm_[2 * i] + pcm_[2 * i + 1]) / 2);
+            }
+            have_previous_ = true;
+        }
+        return static_cast<size_t>(end - out);
+    }
+
+private:
+    unsigned rate_;
+    bool fec_;
+    AdpcmState state_;
+    AdpcmState fec_state_;
+    std::vector<int16_t> pcm_;
+    std::vector<int16_t> previous_;
+    bool have_previous_ = false;
+};
+
+class AdpcmDecoder final : public AudioDecoder {
+public:
+    explicit AdpcmDecoder(const CodecSettings& settings)
+        : AudioDecoder(settings.frame_ms), rate_(adpcm_rate(settings)), last_(frame_samples()),
+          half_(frame_samples() / 2) {}
+
+    unsigned sample_rate() const override { return rate_; }
+
+    size_t decode(const uint8_t* packet, size_t size, float* pcm) override {
+        size_t samples = frame_samples();
+        if (!packet) {
+            return conceal(pcm);
+        }
+        if (size < 1 || size != packet_bytes(samples, (packet[0] & kHasFec) != 0)
+            || !decode_block(packet + 1, samples, pcm)) {
+            return 0;
+        }
+        remember(pcm);
+        return samples;
+    }
+
+    size_t decode_fec(const uint8_t* packet, size_t size, float* pcm) override {
+        size_t samples = frame_samples();
+        if (!packet || size < 1 || !(packet[0] & kHasFec) || size != packet_bytes(samples, true)
+            || !decode_block(packet + 1 + block_bytes(samples), half_.size(), half_.data())) {
+            return conceal(pcm);
+        }
+        // Back to the full rate by linear interpolation
+        for (size_t i = 0; i < half_.size(); ++i) {
+            float next = i + 1 < half_.size() ? half_[i + 1] : half_[i];
+            pcm[2 * i] = half_[i];
+            pcm[2 * i + 1] = 0.5f * (half_[i] + next);
+        }
+        remember(pcm);
+        return samples;
+    }
+
+private:
+    // The last good frame again, halved in level for each frame lost in a
+    // row, so a long gap fades out
+    size_t conceal(float* pcm) {
+        concealed_gain_ *= 0.5f;
+        for (size_t i = 0; i < last_.size(); ++i) {
+            pcm[i] = last_[i] * concealed_gain_;
+        }
+        return last_.size();
+    }
+
+    void remember(const float* pcm) {
+        std::copy(pcm, pcm + last_.size(), last_.begin());
+        concealed_gain_ = 1.0f;
+    }
+
+    unsigned rate_;
+    std::vector<float> last_;
+    std::vector<float> half_;
+    float concealed_gain_ = 1.0f;
+};
+
+#else // HAVE_OPUS
+
+constexpr unsigned kOpusRates[] = { 8000, 12000, 16000, 24000, 48000 };
+
+// Opus takes only some rates; anything else is resampled up to the next
+unsigned opus_rate(unsigned rate) {
+    for (unsigned supported : kOpusRates) {
+        if (supported >= rate) {
+            return supported;
+        }
+    }
+    return 48000;
+}
+
+class OpusAudioEncoder final : public AudioEncoder {
+public:
+    OpusAudioEncoder(const CodecSettings& settings, ::OpusEncoder* encoder, unsigned rate)
+        : AudioEncoder(settings.frame_ms), encoder_(encoder), rate_(rate) {}
+    ~OpusAudioEncoder() override { opus_encoder_destroy(encoder_); }
+
+    const char* name() const override { return "opus"; }
+    unsigned sample_rate() const override { return rate_; }
+
+    size_t encode(const float* pcm, uint8_t* out, size_t capacity) override {
+        opus_int32 bytes = opus_encode_float(encoder_, pcm, static_cast<int>(frame_samples()), out,
+                                             static_cast<opus_int32>(std::min(capacity, kMaxPacketBytes)));
+        return bytes > 0 ? static_cast<size_t>(bytes) : 0;
+    }
+
+private:
+    ::OpusEncoder* encoder_;
+    unsigned rate_;
+};
+
+class OpusAudioDecoder final : public AudioDecoder {
+public:
+    OpusAudioDecoder(const CodecSettings& settings, ::OpusDecoder* decoder, unsigned rate)
+        : AudioDecoder(settings.frame_ms), decoder_(decoder), rate_(rate) {}
+    ~OpusAudioDecoder() override { opus_decoder_destroy(decoder_); }
+
+    unsigned sample_rate() const override { return rate_; }
+
+    size_t decode(const uint8_t* packet, size_t size, float* pcm) override {
+        return run(packet, size, pcm, 0);
+    }
+
+    size_t decode_fec(const uint8_t* packet, size_t size, float* pcm) override {
+        return run(packet, size, pcm, 1);
+    }
+
+private:
+    size_t run(const uint8_t* packet, size_t size, float* pcm, int fec) {
+        int samples = opus_decode_float(decoder_, packet, packet ? static_cast<opus_int32>(size) : 0, pcm,
+                                        static_cast<int>(frame_samples()), fec);
+        return samples > 0 ? static_cast<size_t>(samples) : 0;
+    }
+
+    ::OpusDecoder* decoder_;
+    unsigned rate_;
+};
+
+#endif // HAVE_OPUS
+
+} // namespace
+
+bool CodecSettings::preset(const std::string& name, CodecSettings& settings) {
+    for (const Preset& preset : kPresets) {
+        if (name == preset.name) {
+            settings.bitrate = preset.bitrate;
+            settings.sample_rate = preset.sample_rate;
+            settings.dtx = preset.dtx;
+            settings.fec = preset.fec;
+            return true;
+        }
+    }
+    return false;
+}
+
+std::unique_ptr<AudioEncoder> make_audio_encoder(const CodecSettings& settings) {
+    if (settings.frame_ms == 0 || settings.bitrate == 0) {
+        return nullptr;
+    }
+#ifdef HAVE_OPUS
+    unsigned rate = opus_rate(settings.sample_rate);
+    int error = OPUS_OK;
+    ::OpusEncoder* encoder = opus_encoder_create(static_cast<opus_int32>(rate), 1, OPUS_APPLICATION_VOIP, &error);
+    if (error != OPUS_OK) {
+        std::cerr << "Cannot create Opus encoder: " << opus_strerror(error) << std::endl;
+        return nullptr;
+    }
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(static_cast<opus_int32>(settings.bitrate)));
+    opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(settings.fec ? 1 : 0));
+    opus_encoder_ctl(encoder, OPUS_SET_PACKET_LOSS_PERC(static_cast<opus_int32>(settings.expected_loss_percent)));
+    // Silence is dropped by the pipeline, which also reports it to peers
+    opus_encoder_ctl(encoder, OPUS_SET_DTX(0));
+    return std::make_unique<OpusAudioEncoder>(settings, encoder, rate);
+#else
+    return std::make_unique<AdpcmEncoder>(settings);
+#endif
+}
+
+std::unique_ptr<AudioDecoder> make_audio_decoder(const CodecSettings& settings) {
+    if (settings.frame_ms == 0 || settings.bitrate == 0) {
+        return nullptr;
+    }
+#ifdef HAVE_OPUS
+    unsigned rate = opus_rate(settings.sample_rate);
+    int error = OPUS_OK;
+    ::OpusDecoder* decoder = opus_decoder_create(static_cast<opus_int32>(rate), 1, &error);
+    if (error != OPUS_OK) {
+        std::cerr << "Cannot create Opus decoder: " << opus_strerror(error) << std::endl;
+        return nullptr;
+    }
+    return std::make_unique<OpusAudioDecoder>(settings, decoder, rate);
+#else
+    return std::make_unique<AdpcmDecoder>(settings);
+#endif
+}
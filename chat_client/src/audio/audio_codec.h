@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Speech codec for sending captured audio over the network, one fixed
+// length frame per packet.
+//
+// Built with HAVE_OPUS this is libopus. Without it, frames are IMA ADPCM
+// (4 bits a sample) at the highest sample rate the bitrate allows, with
+// the previous frame repeated at half that rate when FEC is on, so one
+// lost packet can be rebuilt from the next.
+//
+// Both keep all of their state from construction on; encode() and
+// decode() never allocate.
+struct CodecSettings {
+    unsigned sample_rate = 48000;  // Of the PCM passed in and out
+    unsigned bitrate = 96000;      // Bits per second, FEC included
+    unsigned frame_ms = 20;
+    bool dtx = true;               // Silence is not sent (see AudioEncodePipeline)
+    bool fec = true;               // Forward error correction for single losses
+    unsigned expected_loss_percent = 5;
+
+    // The audio presets of quality_presets in config/device_streams.yaml:
+    // "low", "medium" and "high". False for any other name.
+    static bool preset(const std::string& name, CodecSettings& settings);
+};
+
+class AudioEncoder {
+public:
+    virtual ~AudioEncoder() = default;
+
+    // Codec name as advertised to peers ("opus", "adpcm")
+    virtual const char* name() const = 0;
+    // Rate of the PCM the encoder takes, which the capture side should be
+    // resampled to; the settings' rate for Opus, lower for ADPCM
+    virtual unsigned sample_rate() const = 0;
+    unsigned frame_samples() const { return sample_rate() * frame_ms_ / 1000; }
+
+    // Encodes one frame of frame_samples() samples into out; the packet
+    // size, or 0 on error
+    virtual size_t encode(const float* pcm, uint8_t* out, size_t capacity) = 0;
+
+    // Largest packet encode() writes
+    static constexpr size_t kMaxPacketBytes = 1500;
+
+protected:
+    explicit AudioEncoder(unsigned frame_ms) : frame_ms_(frame_ms) {}
+
+private:
+    unsigned frame_ms_;
+};
+
+class AudioDecoder {
+public:
+    virtual ~AudioDecoder() = default;
+
+    virtual unsigned sample_rate() const = 0;
+    unsigned frame_samples() const { return sample_rate() * frame_ms_ / 1000; }
+
+    // Decodes a packet into frame_samples() samples of pcm; the samples
+    // written, or 0 if the packet is corrupt. A null packet conceals a
+    // lost frame from the ones before it.
+    virtual size_t decode(const uint8_t* packet, size_t size, float* pcm) = 0;
+    // Rebuilds the frame before packet, which was lost, from the packet's
+    // FEC data, or conceals it when there is none
+    virtual size_t decode_fec(const uint8_t* packet, size_t size, float* pcm) = 0;
+
+protected:
+    explicit AudioDecoder(unsigned frame_ms) : frame_ms_(frame_ms) {}
+
+private:
+    unsigned frame_ms_;
+};
+
+// Null if the codec cannot be set up with these settings
+std::unique_ptr<AudioEncoder> make_audio_encoder(const CodecSettings& settings);
+// For packets from an encoder made with the same settings
+std::unique_ptr<AudioDecoder> make_audio_decoder(const CodecSettings& settings);
@@ -1,185 +1,722 @@
 #include "audio_engine.h"
-#include <portaudio.h>
+#include "capture_consumer.h"
+#include "portaudio_backend.h"
+#include "clocked_backend.h"
+#include "file_backend.h"
+#include "../dsp/dsp_kernels.h"
+#include "../dsp/resampler.h"
+#include "../dsp/voice_processor.h"
+#include "../utils/rt_alloc_trap.h"
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <iterator>
 #include <cstring> // Add for memset
 #include <iostream>
+#include <thread>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+// Interval between dtx blocks while the gate is closed
+constexpr unsigned int kSilenceEventMs = 500;
+
+// Whether a scan found anything new, rates included
+bool same_devices(const std::vector<AudioEngine::AudioDevice>& a,
+                  const std::vector<AudioEngine::AudioDevice>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+                      [](const AudioEngine::AudioDevice& x, const AudioEngine::AudioDevice& y) {
+                          return x.id == y.id && x.name == y.name && x.max_input_channels == y.max_input_channels
+                              && x.max_output_channels == y.max_output_channels && x.sample_rates == y.sample_rates
+                              && x.is_default == y.is_default && x.native_sample_rate == y.native_sample_rate;
+                      });
+}
+
+} // namespace
+
+// Resamples captured input for every consumer of an audience that asked
+// for `rate`
+struct AudioEngine::RateConverter {
+    RateConverter(unsigned int target_rate, unsigned int consumers)
+        : rate(target_rate), audience(consumers) {}
+    
+    // Called with the stream closed whenever the device rate may have changed
+    void configure(unsigned int device_rate) {
+        frames = 0;
+        idle = false;
+        if (device_rate == rate) {
+            resampler.reset(); // Consumers get the device's blocks directly
+            return;
+        }
+        if (resampler && resampler->input_rate() == device_rate) {
+            resampler->reset();
+            return;
+        }
+        resampler = std::make_unique<Resampler>(device_rate, rate, Resampler::Quality::POLYPHASE,
+                                                AudioBlock::kMaxFrames);
+        output.assign(resampler->max_output_frames(AudioBlock::kMaxFrames), 0.0f);
+    }
+    
+    unsigned int rate;
+    unsigned int audience;
+    std::unique_ptr<Resampler> resampler;
+    std::vector<float> output;
+    size_t frames = 0;  // Converted frames for the current piece of input
+    bool idle = false;  // Skipped while gated; restarts from a clean history
+};
 
 AudioEngine::AudioEngine()
-    : stream_(nullptr), current_backend_(Backend::PULSEAUDIO), initialized(false) {
+    : current_backend_(Backend::PULSEAUDIO), sample_rate_(44100), low_latency_(false),
+      dsp_(&dsp_kernels()),
+      voice_(std::make_unique<VoiceProcessor>(AudioBlock::kMaxFrames)),
+      capture_(AudioBlock::kMaxFrames),
+      played_(AudioBlock::kMaxFrames) {
 }
 
 AudioEngine::~AudioEngine() {
     stop_stream();
-    Pa_Terminate();
+    backend_.reset();
+    if (level_consumer_) {
+        remove_capture_consumer(level_consumer_.get());
+    }
+    delete graph_.exchange(nullptr);
+    for (auto& slot : rate_converters_) {
+        delete slot.exchange(nullptr);
+    }
 }
 
 bool AudioEngine::initialize() {
-    PaError err = Pa_Initialize();
-    if (err != paNoError) {
-        std::cerr << "PortAudio initialization error: " << Pa_GetErrorText(err) << std::endl;
+    std::lock_guard<std::mutex> control(control_mutex_);
+    close_stream();
+    
+    {
+        std::lock_guard<std::mutex> lock(devices_mutex_);
+        devices_.clear();
+        devices_cached_ = false;
+    }
+    backend_ = std::make_unique<PortAudioBackend>(*this);
+    if (!backend_->initialize()) {
+        backend_.reset();
         return false;
     }
     
-    current_backend_ = detect_best_backend();
+    current_backend_ = get_stats().backend;
     return true;
 }
 
-AudioEngine::Backend AudioEngine::detect_best_backend() {
-    // In a real implementation, we would detect available backends
-    // based on available host APIs. For now, default to PulseAudio
-    // as it's widely available on Linux.
-    return Backend::PULSEAUDIO;
+bool AudioEngine::initialize(Backend backend) {
+    return initialize(backend, BackendOptions());
+}
+
+bool AudioEngine::initialize(Backend backend, const BackendOptions& options) {
+    std::lock_guard<std::mutex> control(control_mutex_);
+    close_stream();
+    
+    {
+        std::lock_guard<std::mutex> lock(devices_mutex_);
+        devices_.clear();
+        devices_cached_ = false;
+    }
+    switch (backend) {
+        case Backend::NULL_DEVICE:
+            backend_ = std::make_unique<NullBackend>(*this, options);
+            break;
+        case Backend::WAV_FILE:
+            backend_ = std::make_unique<FileBackend>(*this, options);
+            break;
+        default:
+            backend_ = std::make_unique<PortAudioBackend>(*this, backend);
+            break;
+    }
+    
+    if (!backend_->initialize()) {
+        backend_.reset();
+        return false;
+    }
+    
+    // A sound card backend falls back to the best available host API
+    current_backend_ = get_stats().backend;
+    return true;
+}
+
+std::vector<AudioEngine::HostApi> AudioEngine::get_host_apis() const {
+    if (!backend_) {
+        return {};
+    }
+    return backend_->get_host_apis();
 }
 
 std::vector<AudioEngine::AudioDevice> AudioEngine::get_devices() {
-    std::vector<AudioDevice> devices;
-    
-    int num_devices = Pa_GetDeviceCount();
-    if (num_devices < 0) {
-        std::cerr << "PortAudio error: " << Pa_GetErrorText(num_devices) << std::endl;
-        return devices;
-    }
-    
-    const PaDeviceInfo* device_info;
-    for (int i = 0; i < num_devices; ++i) {
-        device_info = Pa_GetDeviceInfo(i);
-        if (device_info) {
-            AudioDevice device;
-            device.id = i;
-            device.name = device_info->name;
-            device.max_input_channels = device_info->maxInputChannels;
-            device.max_output_channels = device_info->maxOutputChannels;
-            
-            // Add common sample rates
-            if (device_info->maxInputChannels > 0 || device_info->maxOutputChannels > 0) {
-                device.sample_rates = { 8000, 16000, 22050, 44100, 48000 };
-            }
-            
-            device.is_default = (i == Pa_GetDefaultInputDevice() || 
-                               i == Pa_GetDefaultOutputDevice());
-            
-            devices.push_back(device);
+    {
+        std::lock_guard<std::mutex> lock(devices_mutex_);
+        if (devices_cached_ || !backend_) {
+            return devices_;
         }
     }
-    
-    return devices;
+    refresh_devices(false);
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    return devices_;
+}
+
+AudioEngine::DeviceScan AudioEngine::refresh_devices(bool rescan_host) {
+    // Probing opens devices, which the host may not do beside another open
+    std::lock_guard<std::mutex> control(control_mutex_);
+    if (!backend_) {
+        return DeviceScan::UNCHANGED;
+    }
+    if (rescan_host && !backend_->rescan()) {
+        return DeviceScan::DEFERRED;
+    }
+    std::vector<AudioDevice> devices = backend_->get_devices();
+    std::lock_guard<std::mutex> lock(devices_mutex_);
+    bool changed = devices_cached_ && !same_devices(devices, devices_);
+    devices_ = std::move(devices);
+    devices_cached_ = true;
+    return changed ? DeviceScan::CHANGED : DeviceScan::UNCHANGED;
 }
 
 bool AudioEngine::open_device(int device_id, unsigned int sample_rate) {
-    stop_stream(); // Close any existing stream
-    
-    PaStreamParameters input_params = {};
-    input_params.device = device_id;
-    input_params.channelCount = 1; // Mono input
-    input_params.sampleFormat = paFloat32;
-    input_params.suggestedLatency = Pa_GetDeviceInfo(device_id)->defaultLowInputLatency;
-    input_params.hostApiSpecificStreamInfo = nullptr;
-    
-    PaStreamParameters output_params = {};
-    output_params.device = device_id;
-    output_params.channelCount = 2; // Stereo output
-    output_params.sampleFormat = paFloat32;
-    output_params.suggestedLatency = Pa_GetDeviceInfo(device_id)->defaultLowOutputLatency;
-    output_params.hostApiSpecificStreamInfo = nullptr;
-    
-    PaError err = Pa_OpenStream(
-        &stream_,
-        &input_params,
-        &output_params,
-        sample_rate,
-        256, // Frames per buffer
-        paClipOff,
-        [](const void* input_buffer, void* output_buffer,
-           unsigned long frames_per_buffer,
-           const PaStreamCallbackTimeInfo* time_info,
-           PaStreamCallbackFlags status_flags,
-           void* user_data) -> int {
-            return static_cast<AudioEngine*>(user_data)->pa_audio_callback(
-                input_buffer, output_buffer, frames_per_buffer, time_info, status_flags);
-        },
-        this
-    );
-    
-    if (err != paNoError) {
-        std::cerr << "Failed to open audio stream: " << Pa_GetErrorText(err) << std::endl;
-        stream_ = nullptr;
+    std::lock_guard<std::mutex> control(control_mutex_);
+    return open_stream(device_id, sample_rate);
+}
+
+bool AudioEngine::open_stream(int device_id, unsigned int sample_rate) {
+    if (!backend_) {
+        std::cerr << "Audio engine not initialized" << std::endl;
         return false;
     }
     
+    StreamConfig config;
+    config.device_id = device_id;
+    config.sample_rate = sample_rate;
+    config.low_latency = low_latency_;
+    blocks_at_open_ = blocks_done_.load();
+    if (!backend_->open(config)) {
+        return false;
+    }
+    
+    Stats stats = get_stats();
+    sample_rate_ = stats.sample_rate ? stats.sample_rate : sample_rate;
+    current_backend_ = stats.backend; // The device decides the host API
+    voice_->configure(sample_rate_);
+    input_meter_.configure(sample_rate_);
+    output_meter_.configure(sample_rate_);
+    
+    gate_open_ = true;
+    hangover_frames_ = static_cast<uint64_t>(sample_rate_) * hangover_ms_.load() / 1000;
+    hangover_left_ = 0;
+    silence_event_frames_ = static_cast<uint64_t>(sample_rate_) * kSilenceEventMs / 1000;
+    frames_since_event_ = 0;
+    preroll_.assign(static_cast<size_t>(sample_rate_) * kMaxPrerollMs / 1000, 0.0f);
+    preroll_capacity_ = std::min(preroll_.size(), static_cast<size_t>(sample_rate_) * preroll_ms_.load() / 1000);
+    preroll_write_ = 0;
+    preroll_filled_ = 0;
+    
+    std::lock_guard<std::mutex> lock(consumers_mutex_);
+    for (auto& slot : rate_converters_) {
+        if (RateConverter* converter = slot.load()) {
+            converter->configure(sample_rate_);
+        }
+    }
     return true;
 }
 
-void AudioEngine::start_stream() {
-    if (stream_) {
-        PaError err = Pa_StartStream(stream_);
-        if (err != paNoError) {
-            std::cerr << "Failed to start audio stream: " << Pa_GetErrorText(err) << std::endl;
+bool AudioEngine::switch_device(int device_id) {
+    std::lock_guard<std::mutex> control(control_mutex_);
+    if (!backend_) {
+        std::cerr << "Audio engine not initialized" << std::endl;
+        return false;
+    }
+    // The consumers, and whatever feeds the playback, run at this rate
+    const unsigned int rate = sample_rate_;
+    if (!backend_->is_active()) {
+        return open_stream(device_id, rate);
+    }
+    
+    StreamConfig config;
+    config.device_id = device_id;
+    config.sample_rate = rate;
+    config.low_latency = low_latency_;
+    if (backend_->switch_stream(config)) {
+        current_backend_ = get_stats().backend;
+        return true;
+    }
+    // Not beside the running stream: reopen, at the same rate, or go back
+    const int previous = get_stats().device_id;
+    close_stream();
+    if (open_stream(device_id, rate)) {
+        backend_->start();
+        return true;
+    }
+    std::cerr << "Audio device " << device_id << " cannot run at " << rate << " Hz" << std::endl;
+    if (previous >= 0 && open_stream(previous, rate)) {
+        backend_->start();
+    }
+    return false;
+}
+
+AudioEngine::Stats AudioEngine::get_stats() const {
+    Stats stats;
+    stats.backend = current_backend_;
+    if (backend_) {
+        backend_->get_stats(stats);
+    }
+    stats.callbacks = blocks_done_.load(std::memory_order_relaxed) - blocks_at_open_;
+    for (const auto& slot : rate_converters_) {
+        RateConverter* converter = slot.load();
+        if (converter && converter->resampler) {
+            ++stats.rate_converters;
         }
     }
+    return stats;
+}
+
+void AudioEngine::start_stream() {
+    std::lock_guard<std::mutex> control(control_mutex_);
+    if (backend_) {
+        backend_->start();
+    }
 }
 
 void AudioEngine::stop_stream() {
-    if (stream_) {
-        if (Pa_IsStreamActive(stream_) == 1) {
-            Pa_StopStream(stream_);
-        }
-        Pa_CloseStream(stream_);
-        stream_ = nullptr;
+    std::lock_guard<std::mutex> control(control_mutex_);
+    close_stream();
+}
+
+void AudioEngine::close_stream() {
+    if (backend_) {
+        backend_->close();
     }
+    reclaim_retired_graphs();
 }
 
-void AudioEngine::set_audio_callback(AudioCallback callback) {
-    audio_callback_ = std::move(callback);
+bool AudioEngine::is_stream_active() const {
+    return backend_ && backend_->is_active();
+}
+
+void AudioEngine::set_processor_graph(std::unique_ptr<ProcessorGraph> graph) {
+    ProcessorGraph* previous = graph_.exchange(graph.release());
+    if (previous) {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        retired_graphs_.push_back({ std::unique_ptr<ProcessorGraph>(previous), blocks_started_.load() });
+    }
+    reclaim_retired_graphs();
+}
+
+void AudioEngine::set_playback_source(AudioProcessor* source) {
+    playback_.store(source);
+    wait_for_blocks_in_flight();
+}
+
+void AudioEngine::reclaim_retired_graphs() {
+    // A graph swapped out when N blocks had started can only be in use by
+    // one of those N blocks
+    std::vector<RetiredGraph> reclaimable;
+    {
+        std::lock_guard<std::mutex> lock(retired_mutex_);
+        uint64_t done = blocks_done_.load();
+        auto first = std::partition(retired_graphs_.begin(), retired_graphs_.end(),
+                                    [done](const RetiredGraph& retired) { return done < retired.retired_at; });
+        std::move(first, retired_graphs_.end(), std::back_inserter(reclaimable));
+        retired_graphs_.erase(first, retired_graphs_.end());
+    }
+    // Destroyed outside the lock; processors may own arbitrary state
 }
 
 void AudioEngine::set_level_callback(LevelCallback callback) {
+    if (level_consumer_) {
+        remove_capture_consumer(level_consumer_.get());
+        level_consumer_.reset();
+    }
+    
     level_callback_ = std::move(callback);
+    if (!level_callback_) {
+        return;
+    }
+    
+    // Deliver levels from a consumer thread so the callback may block
+    level_consumer_ = std::make_unique<CaptureConsumer>(
+        "levels",
+        [callback = level_callback_](const AudioBlock& block) {
+            callback(block.input_level, block.output_level);
+        });
+    level_consumer_->start();
+    add_consumer(level_consumer_.get(), 0, UNGATED);
+}
+
+bool AudioEngine::add_capture_consumer(CaptureConsumer* consumer, unsigned int sample_rate) {
+    return add_consumer(consumer, sample_rate, GATED);
+}
+
+bool AudioEngine::add_playback_consumer(CaptureConsumer* consumer, unsigned int sample_rate) {
+    return add_consumer(consumer, sample_rate, PLAYBACK);
+}
+
+bool AudioEngine::add_monitor_consumer(CaptureConsumer* consumer, unsigned int sample_rate) {
+    return add_consumer(consumer, sample_rate, UNGATED);
+}
+
+bool AudioEngine::add_consumer(CaptureConsumer* consumer, unsigned int sample_rate, Audience audience) {
+    // The converter starts at the device rate, which an open may be changing
+    std::lock_guard<std::mutex> control(control_mutex_);
+    std::lock_guard<std::mutex> lock(consumers_mutex_);
+    
+    auto free_slot = std::find_if(capture_consumers_.begin(), capture_consumers_.end(),
+                                  [](const std::atomic<CaptureConsumer*>& slot) { return !slot.load(); });
+    if (free_slot == capture_consumers_.end()) {
+        std::cerr << "Too many capture consumers, ignoring '" << consumer->name() << "'" << std::endl;
+        return false;
+    }
+    size_t index = free_slot - capture_consumers_.begin();
+    
+    // Share the conversion with any consumer already at this rate. Gated and
+    // ungated consumers never share, as a gated conversion skips silence.
+    RateConverter* converter = nullptr;
+    if (sample_rate) {
+        for (auto& slot : rate_converters_) {
+            RateConverter* existing = slot.load();
+            if (existing && existing->rate == sample_rate && existing->audience == audience) {
+                converter = existing;
+                break;
+            }
+        }
+        if (!converter) {
+            converter = new RateConverter(sample_rate, audience);
+            converter->configure(sample_rate_);
+            for (auto& slot : rate_converters_) {
+                if (!slot.load()) {
+                    slot.store(converter);
+                    break;
+                }
+            }
+        }
+    }
+    
+    consumer_converters_[index] = converter;
+    consumer_audiences_[index] = audience;
+    if (audience == PLAYBACK) {
+        playback_consumers_.fetch_add(1);
+    }
+    free_slot->store(consumer);
+    return true;
 }
 
-int AudioEngine::pa_audio_callback(const void* input, void* output,
-                                 unsigned long frames_per_buffer,
-                                 const PaStreamCallbackTimeInfo* time_info,
-                                 PaStreamCallbackFlags status_flags) {
-    auto* engine = static_cast<AudioEngine*>(this);
+void AudioEngine::remove_capture_consumer(CaptureConsumer* consumer) {
+    std::lock_guard<std::mutex> lock(consumers_mutex_);
+    
+    for (size_t i = 0; i < kMaxCaptureConsumers; ++i) {
+        if (capture_consumers_[i].load() == consumer) {
+            capture_consumers_[i].store(nullptr);
+            if (consumer_audiences_[i] == PLAYBACK) {
+                playback_consumers_.fetch_sub(1);
+            }
+        }
+    }
+    
+    // Retire converters no remaining consumer uses
+    std::vector<RateConverter*> unused;
+    for (auto& slot : rate_converters_) {
+        RateConverter* converter = slot.load();
+        if (!converter) {
+            continue;
+        }
+        bool in_use = false;
+        for (size_t i = 0; i < kMaxCaptureConsumers; ++i) {
+            in_use = in_use || (capture_consumers_[i].load() && consumer_converters_[i] == converter);
+        }
+        if (!in_use) {
+            slot.store(nullptr);
+            unused.push_back(converter);
+        }
+    }
     
-    const float* input_buffer = static_cast<const float*>(input);
-    float* output_buffer = static_cast<float*>(output);
+    // Wait for any block that may still hold the old pointers
+    wait_for_blocks_in_flight();
+    for (RateConverter* converter : unused) {
+        delete converter;
+    }
+}
+
+void AudioEngine::set_capture_gating(const GatingOptions& options) {
+    hangover_ms_.store(options.hangover_ms);
+    preroll_ms_.store(std::min(options.preroll_ms, kMaxPrerollMs));
+    if (options.enabled) {
+        voice_->set_enabled(VoiceProcessor::Stage::VOICE_ACTIVITY, true);
+    }
+    gating_enabled_.store(options.enabled);
+}
+
+AudioEngine::GatingOptions AudioEngine::capture_gating() const {
+    GatingOptions options;
+    options.enabled = gating_enabled_.load();
+    options.hangover_ms = hangover_ms_.load();
+    options.preroll_ms = preroll_ms_.load();
+    return options;
+}
+
+AudioEngine::GatingStats AudioEngine::get_gating_stats() const {
+    GatingStats stats;
+    stats.speech_frames = gate_counters_.speech_frames.load(std::memory_order_relaxed);
+    stats.silence_frames = gate_counters_.silence_frames.load(std::memory_order_relaxed);
+    stats.segments = gate_counters_.segments.load(std::memory_order_relaxed);
+    stats.silence_events = gate_counters_.silence_events.load(std::memory_order_relaxed);
+    uint64_t gated_frames = stats.speech_frames + stats.silence_frames;
+    if (gated_frames) {
+        stats.silence_fraction = static_cast<double>(stats.silence_frames) / gated_frames;
+    }
+    
+    // What the fan-out costs per frame while speaking is what silence saved
+    uint64_t fan_out_frames = gate_counters_.fan_out_frames.load(std::memory_order_relaxed);
+    if (fan_out_frames) {
+        double ns_per_frame = static_cast<double>(gate_counters_.fan_out_ns.load(std::memory_order_relaxed))
+                            / fan_out_frames;
+        stats.engine_cpu_saved = stats.silence_frames * ns_per_frame * 1e-9;
+    }
+    
+    // Likewise each gated consumer's handler, at the consumer's own rate
+    std::lock_guard<std::mutex> lock(consumers_mutex_);
+    for (size_t i = 0; i < kMaxCaptureConsumers; ++i) {
+        CaptureConsumer* consumer = capture_consumers_[i].load();
+        if (!consumer || consumer_audiences_[i] != GATED) {
+            continue;
+        }
+        uint64_t withheld = consumer->withheld_frames();
+        stats.bytes_saved += withheld * sizeof(float);
+        if (uint64_t handled = consumer->handled_frames()) {
+            stats.consumer_cpu_saved += withheld * (static_cast<double>(consumer->handler_ns()) / handled) * 1e-9;
+        }
+    }
+    return stats;
+}
+
+void AudioEngine::wait_for_blocks_in_flight() {
+    uint64_t started = blocks_started_.load();
+    while (blocks_done_.load() < started) {
+        std::this_thread::yield();
+    }
+}
+
+void AudioEngine::process_block(const float* input_buffer, float* output_buffer,
+                                unsigned long frames_per_buffer) {
+    RtAllocScope rt_scope;
+    uint64_t block = blocks_started_.fetch_add(1);
     
     // Clear output buffer
     memset(output_buffer, 0, sizeof(float) * frames_per_buffer * 2); // Stereo output
     
-    // Calculate input level (RMS)
-    float sum = 0.0f;
-    for (unsigned long i = 0; i < frames_per_buffer; ++i) {
-        sum += input_buffer[i] * input_buffer[i];
+    // Input level: the block's RMS for the consumers, peak and RMS for
+    // the meter
+    float input_sum_squares = dsp_->sum_squares(input_buffer, frames_per_buffer);
+    float input_level = frames_per_buffer
+        ? std::sqrt(input_sum_squares / static_cast<float>(frames_per_buffer)) : 0.0f;
+    input_meter_.add(dsp_->peak(input_buffer, frames_per_buffer), input_sum_squares,
+                     static_cast<unsigned int>(frames_per_buffer));
+    
+    const ProcessorGraph* graph = graph_.load();
+    AudioProcessor* playback = playback_.load();
+    const float input_gain = input_muted_.load(std::memory_order_relaxed)
+        ? 0.0f : input_gain_.load(std::memory_order_relaxed);
+    const float volume = output_muted_.load(std::memory_order_relaxed)
+        ? 0.0f : output_volume_.load(std::memory_order_relaxed);
+    
+    // Voice processing, the graph and the consumer fan-out run in pieces no
+    // larger than an AudioBlock, so the processed capture and converted
+    // output always fit their buffers
+    for (unsigned long offset = 0; offset < frames_per_buffer; offset += AudioBlock::kMaxFrames) {
+        unsigned int piece = static_cast<unsigned int>(
+            std::min<unsigned long>(AudioBlock::kMaxFrames, frames_per_buffer - offset));
+        const float* samples = input_buffer + offset;
+        float* output = output_buffer + 2 * offset;
+        
+        if (voice_->process(samples, capture_.data(), piece)) {
+            samples = capture_.data();
+        }
+        if (input_gain != 1.0f) {
+            dsp_->gain(samples, capture_.data(), piece, input_gain);
+            samples = capture_.data();
+        }
+        
+        if (graph && !graph->empty()) {
+            graph->process(samples, output, piece);
+        } else {
+            // Simple passthrough if no callback
+            dsp_->mono_to_stereo(samples, output, piece, 1.0f);
+        }
+        if (playback) {
+            playback->process(samples, output, piece);
+        }
+        if (volume != 1.0f) {
+            dsp_->gain(output, output, 2 * piece, volume);
+        }
+        // What is played now is the echo canceller's reference
+        voice_->set_reference(output, piece);
+        float output_level = dsp_stereo_rms(*dsp_, output, piece);
+        if (playback_consumers_.load(std::memory_order_relaxed)) {
+            for (unsigned int i = 0; i < piece; ++i) {
+                played_[i] = 0.5f * (output[2 * i] + output[2 * i + 1]);
+            }
+            fan_out(played_.data(), piece, PLAYBACK, input_level, output_level, true, false);
+        }
+        
+        // Hand the captured block to consumers; they run on their own threads.
+        // Ungated ones get every piece, gated ones only talk spurts.
+        const bool was_open = gate_open_;
+        const bool gating = update_gate(piece);
+        fan_out(samples, piece, UNGATED, input_level, output_level, gate_open_, false);
+        if (gate_open_) {
+            deliver_speech(samples, piece, input_level, output_level, gating, !was_open);
+        } else {
+            withhold_silence(samples, piece, was_open);
+        }
     }
-    float rms = sqrtf(sum / frames_per_buffer);
-    engine->input_level_.store(rms);
     
-    // Call user callback if set
-    if (engine->audio_callback_) {
-        engine->audio_callback_(input_buffer, output_buffer, frames_per_buffer);
+    // Output level: peak of either channel, RMS of the mono mix
+    output_meter_.add(dsp_->peak(output_buffer, 2 * frames_per_buffer),
+                      dsp_->stereo_mid_sum_squares(output_buffer, frames_per_buffer),
+                      static_cast<unsigned int>(frames_per_buffer));
+    
+    blocks_done_.store(block + 1);
+}
+
+void AudioEngine::fan_out(const float* samples, unsigned int frames, unsigned int audience,
+                          float input_level, float output_level, bool speech, bool segment_start) {
+    for (auto& slot : rate_converters_) {
+        RateConverter* converter = slot.load();
+        if (!converter || !converter->resampler || !(converter->audience & audience)) {
+            continue;
+        }
+        if (converter->idle) {
+            // History from before the gap would smear into the new spurt
+            converter->resampler->reset();
+            converter->idle = false;
+        }
+        converter->frames = converter->resampler->process(samples, frames, converter->output.data());
+    }
+    
+    for (size_t i = 0; i < kMaxCaptureConsumers; ++i) {
+        CaptureConsumer* consumer = capture_consumers_[i].load();
+        if (!consumer || !(consumer_audiences_[i] & audience)) {
+            continue;
+        }
+        RateConverter* converter = consumer_converters_[i];
+        if (converter && converter->resampler) {
+            if (converter->frames) {
+                consumer->publish(converter->output.data(), static_cast<unsigned>(converter->frames),
+                                  converter->rate, input_level, output_level, speech, segment_start);
+            }
+        } else {
+            consumer->publish(samples, frames, sample_rate_, input_level, output_level, speech, segment_start);
+        }
+    }
+}
+
+bool AudioEngine::update_gate(unsigned int frames) {
+    if (!gating_enabled_.load(std::memory_order_relaxed)
+        || !voice_->enabled(VoiceProcessor::Stage::VOICE_ACTIVITY)) {
+        // Without a detector everything is speech
+        gate_open_ = true;
+        return false;
+    }
+    // Durations set since the last block; the ring was sized at open
+    hangover_frames_ = static_cast<uint64_t>(sample_rate_) * hangover_ms_.load(std::memory_order_relaxed) / 1000;
+    hangover_left_ = std::min(hangover_left_, hangover_frames_);
+    size_t preroll = std::min(preroll_.size(),
+                              static_cast<size_t>(sample_rate_) * preroll_ms_.load(std::memory_order_relaxed) / 1000);
+    if (preroll != preroll_capacity_) {
+        preroll_capacity_ = preroll;
+        preroll_write_ = 0;
+        preroll_filled_ = 0;
+    }
+    if (voice_->speech_detected()) {
+        gate_open_ = true;
+        hangover_left_ = hangover_frames_;
+    } else if (hangover_left_ > frames) {
+        hangover_left_ -= frames;
     } else {
-        // Simple passthrough if no callback
-        for (unsigned long i = 0; i < frames_per_buffer; ++i) {
-            output_buffer[i*2] = input_buffer[i]; // Left channel
-            output_buffer[i*2+1] = input_buffer[i]; // Right channel
+        hangover_left_ = 0;
+        gate_open_ = false;
+    }
+    return true;
+}
+
+void AudioEngine::deliver_speech(const float* samples, unsigned int frames, float input_level,
+                                 float output_level, bool gating, bool opened) {
+    auto start = Clock::now();
+    uint64_t delivered = frames;
+    bool first = opened;
+    if (opened) {
+        // The pre-roll goes out first, oldest frames first
+        size_t capacity = preroll_capacity_;
+        size_t read = capacity ? (preroll_write_ + capacity - preroll_filled_) % capacity : 0;
+        while (preroll_filled_ > 0) {
+            size_t chunk = std::min({ preroll_filled_, capacity - read, size_t(AudioBlock::kMaxFrames) });
+            fan_out(preroll_.data() + read, static_cast<unsigned int>(chunk), GATED,
+                    input_level, output_level, true, first);
+            first = false;
+            read = (read + chunk) % capacity;
+            preroll_filled_ -= chunk;
+            delivered += chunk;
+        }
+        if (gating) {
+            gate_counters_.segments.fetch_add(1, std::memory_order_relaxed);
         }
     }
+    fan_out(samples, frames, GATED, input_level, output_level, true, first);
     
-    // Calculate output level
-    sum = 0.0f;
-    for (unsigned long i = 0; i < frames_per_buffer * 2; i += 2) {
-        float avg = (output_buffer[i] + output_buffer[i+1]) * 0.5f;
-        sum += avg * avg;
+    if (gating) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        gate_counters_.speech_frames.fetch_add(delivered, std::memory_order_relaxed);
+        gate_counters_.fan_out_ns.fetch_add(static_cast<uint64_t>(elapsed), std::memory_order_relaxed);
+        gate_counters_.fan_out_frames.fetch_add(delivered, std::memory_order_relaxed);
     }
-    rms = sqrtf(sum / frames_per_buffer);
-    engine->output_level_.store(rms);
+}
+
+void AudioEngine::withhold_silence(const float* samples, unsigned int frames, bool closed) {
+    // Frames are withheld for good once newer silence pushes them out of
+    // the pre-roll
+    const size_t capacity = preroll_capacity_;
+    const size_t total = preroll_filled_ + frames;
+    const unsigned int evicted = static_cast<unsigned int>(total > capacity ? total - capacity : 0);
+    gate_counters_.silence_frames.fetch_add(evicted, std::memory_order_relaxed);
     
-    // Call level callback if set
-    if (engine->level_callback_) {
-        engine->level_callback_(engine->input_level_.load(), engine->output_level_.load());
+    frames_since_event_ += frames;
+    const bool event = closed || frames_since_event_ >= silence_event_frames_;
+    if (event) {
+        frames_since_event_ = 0;
+        gate_counters_.silence_events.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    for (size_t i = 0; i < kMaxCaptureConsumers; ++i) {
+        CaptureConsumer* consumer = capture_consumers_[i].load();
+        if (!consumer || consumer_audiences_[i] != GATED) {
+            continue;
+        }
+        RateConverter* converter = consumer_converters_[i];
+        unsigned int rate = converter && converter->resampler ? converter->rate : sample_rate_;
+        if (event) {
+            consumer->publish_silence(rate, voice_->noise_level());
+        }
+        consumer->withhold(static_cast<unsigned int>(static_cast<uint64_t>(evicted) * rate / sample_rate_));
+    }
+    for (auto& slot : rate_converters_) {
+        RateConverter* converter = slot.load();
+        if (converter && converter->audience == GATED) {
+            converter->idle = true;
+        }
     }
     
-    return paContinue;
+    // Keep the latest silence for the next spurt's pre-roll
+    if (capacity == 0) {
+        return;
+    }
+    if (frames >= capacity) {
+        samples += frames - capacity;
+        frames = static_cast<unsigned int>(capacity);
+    }
+    size_t first = std::min<size_t>(frames, capacity - preroll_write_);
+    std::memcpy(preroll_.data() + preroll_write_, samples, sizeof(float) * first);
+    std::memcpy(preroll_.data(), samples + first, sizeof(float) * (frames - first));
+    preroll_write_ = (preroll_write_ + frames) % capacity;
+    preroll_filled_ = std::min(capacity, total);
 }
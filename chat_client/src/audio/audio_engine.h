@@ -1,57 +1,339 @@
 #pragma once
 
+#include <array>
 #include <memory>
 #include <vector>
 #include <functional>
 #include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <string>
+#include <type_traits>
+#include <utility>
 
-// Forward declare PortAudio types to avoid dependency in header
-typedef void PaStream;
+#include "level_meter.h"
+#include "processor_graph.h"
+
+class AudioBackend;
+class CaptureConsumer;
+class VoiceProcessor;
+struct DspKernels;
 
 class AudioEngine {
 public:
-    enum class Backend { PIPEWIRE, PULSEAUDIO, ALSA, JACK };
+    // PIPEWIRE..JACK are sound card host APIs driven through PortAudio;
+    // NULL_DEVICE and WAV_FILE run without hardware.
+    enum class Backend { PIPEWIRE, PULSEAUDIO, ALSA, JACK, NULL_DEVICE, WAV_FILE };
+    
+    struct BackendOptions {
+        // REALTIME paces callbacks to wall-clock time, FREERUN runs them
+        // back to back. Ignored by sound card backends.
+        enum class Pacing { REALTIME, FREERUN };
+        Pacing pacing = Pacing::REALTIME;
+        std::string input_path;    // WAV_FILE: WAV or .raw/.f32 input, empty for silence
+        std::string output_path;   // WAV_FILE: stereo output file, empty to discard
+        bool loop_input = false;
+        uint64_t max_frames = 0;   // Stop after this many frames (0 = no limit)
+    };
+    
+    struct StreamConfig {
+        int device_id = 0;         // -1 selects the best ranked host API's device
+        unsigned int sample_rate = 44100;
+        unsigned int frames_per_buffer = 256;
+        // Negotiate the smallest stable buffer instead of frames_per_buffer,
+        // stepping up automatically after repeated xruns
+        bool low_latency = false;
+    };
+    
+    // A sound card host API found by PortAudio, ranked by latency
+    struct HostApi {
+        Backend backend;
+        std::string name;              // PortAudio host API name
+        int device_id;                 // Device used when this API is selected
+        double round_trip_latency;     // Seconds, negotiated for a probe stream; < 0 if unusable
+    };
+    
+    struct Stats {
+        Backend backend = Backend::NULL_DEVICE;
+        std::string host_api;
+        std::string device_name;
+        int device_id = -1;            // Of the open stream, as in get_devices()
+        unsigned int sample_rate = 0;
+        unsigned int frames_per_buffer = 0;
+        double input_latency = 0.0;    // Seconds, as reported by the host
+        double output_latency = 0.0;
+        bool low_latency = false;
+        uint64_t callbacks = 0;
+        uint64_t xruns = 0;
+        uint64_t buffer_fallbacks = 0; // Low-latency profile step-ups after xruns
+        unsigned int rate_converters = 0; // Capture rates being resampled
+    };
+    
+    struct GatingOptions {
+        bool enabled = false;
+        unsigned int hangover_ms = 300; // Speech is held this long after the detector drops
+        unsigned int preroll_ms = 150;  // Audio from before the detector fired, sent ahead of a spurt
+    };
+    // Longest pre-roll; open_device() sets aside this much so that a longer
+    // one can be set while streaming
+    static constexpr unsigned int kMaxPrerollMs = 1000;
+    
+    // Frames are device-rate frames; the CPU figures are estimates from the
+    // measured cost of the work done during speech
+    struct GatingStats {
+        uint64_t speech_frames = 0;     // Delivered to gated consumers, pre-roll included
+        uint64_t silence_frames = 0;    // Withheld from them for good
+        uint64_t segments = 0;          // Talk spurts started
+        uint64_t silence_events = 0;    // Rounds of dtx blocks sent instead
+        uint64_t bytes_saved = 0;       // Of samples not copied to the current gated consumers
+        double silence_fraction = 0.0;  // Of the gated time
+        double engine_cpu_saved = 0.0;  // Seconds of audio-thread fan-out skipped
+        double consumer_cpu_saved = 0.0; // Seconds of consumer handler time skipped
+    };
     
     struct AudioDevice {
         int id;
         std::string name;
         int max_input_channels;
         int max_output_channels;
-        std::vector<int> sample_rates;
+        std::vector<int> sample_rates;   // Rates the device accepts, as probed
         bool is_default;
+        int native_sample_rate = 0;      // Used when open_device() gets rate 0
     };
     
+    enum class DeviceScan { UNCHANGED, CHANGED, DEFERRED };
+    
+    // Accepted by set_audio_callback() like any other callable; lambdas are
+    // stored by their own type rather than through std::function.
     using AudioCallback = std::function<void(const float* input, float* output, 
                                            unsigned int frames)>;
     using LevelCallback = std::function<void(float input_level, float output_level)>;
     
+    static constexpr size_t kMaxCaptureConsumers = 8;
+    
     AudioEngine();
     ~AudioEngine();
     
+    // Sound card I/O through PortAudio on the lowest latency host API.
+    // Passing a sound card Backend prefers that host API when present.
     bool initialize();
+    bool initialize(Backend backend);
+    bool initialize(Backend backend, const BackendOptions& options);
+    Backend get_backend() const { return current_backend_; }
+    // The device table, enumerated and probed on the first call and cached;
+    // refresh_devices() brings it up to date
     std::vector<AudioDevice> get_devices();
-    bool open_device(int device_id, unsigned int sample_rate = 44100);
-    void set_audio_callback(AudioCallback callback);
+    // Enumerates and probes the devices again, which takes a while, so off
+    // the UI thread (see DeviceMonitor). rescan_host also re-reads the
+    // host's device list, to find devices plugged in or removed; with a
+    // sound card that waits until the stream is stopped (DEFERRED).
+    DeviceScan refresh_devices(bool rescan_host);
+    // Sound card host APIs, best first; empty for the null and file backends
+    std::vector<HostApi> get_host_apis() const;
+    // sample_rate 0 runs the device at its native rate
+    bool open_device(int device_id, unsigned int sample_rate = 0);
+    // Moves to another device at the current rate, which the consumers and
+    // the playback source were set up for. A running stream keeps playing
+    // while the new device opens beside it, then crossfades across; if the
+    // two cannot be open at once the stream is reopened, which drops a few
+    // buffers. A device that cannot run at the rate is refused and the old
+    // one reopened. Blocks while the device opens, so off the UI thread.
+    bool switch_device(int device_id);
+    unsigned int get_sample_rate() const { return sample_rate_; }
+    // Applies from the next open_device()
+    void set_low_latency_profile(bool enabled) { low_latency_ = enabled; }
+    bool low_latency_profile() const { return low_latency_; }
+    Stats get_stats() const;
+    
+    // Replaces the processing graph without stopping the stream. The swap is
+    // a single atomic pointer exchange; the previous graph is destroyed on a
+    // later call from a non-audio thread once the audio thread can no longer
+    // be using it. An empty or null graph passes the input through.
+    void set_processor_graph(std::unique_ptr<ProcessorGraph> graph);
+    // Shorthand for a graph with a single processor. Objects the callback
+    // refers to must outlive the graph, which may be retired lazily; hold
+    // them by shared_ptr.
+    template<typename F>
+    void set_audio_callback(F&& callback) {
+        set_processor_graph(single_processor_graph(std::forward<F>(callback)));
+    }
+    void set_audio_callback(std::nullptr_t) { set_processor_graph(nullptr); }
+    // Far-end audio (see JitterBuffer), added to the output after the
+    // processing graph so the echo canceller has it as its reference. Not
+    // owned; runs on the audio thread. Once this returns the previous
+    // source is no longer in use.
+    void set_playback_source(AudioProcessor* source);
+    // Input gain and output volume, applied by the engine so they reach
+    // every path: the gain to the capture ahead of the graph and the
+    // consumers (a call's encoder among them), the volume to the graph's
+    // output with the playback source mixed in. Muted is a gain of 0; the
+    // input meter still reads the raw input. Any thread, from the next
+    // callback.
+    void set_input_gain(float gain) { input_gain_.store(gain, std::memory_order_relaxed); }
+    void set_input_muted(bool muted) { input_muted_.store(muted, std::memory_order_relaxed); }
+    void set_output_volume(float volume) { output_volume_.store(volume, std::memory_order_relaxed); }
+    void set_output_muted(bool muted) { output_muted_.store(muted, std::memory_order_relaxed); }
+    // The level callback runs on a metering consumer thread, never on the
+    // real-time audio thread.
     void set_level_callback(LevelCallback callback);
     void start_stream();
     void stop_stream();
+    // False once stopped or when a file/limited stream has run to its end
+    bool is_stream_active() const;
     
-    float get_input_level() const { return input_level_.load(); }
-    float get_output_level() const { return output_level_.load(); }
+    // Captured input is copied into each registered consumer's ring from the
+    // audio callback. The engine does not own the consumer; remove it before
+    // destroying it.
+    //
+    // A consumer that asks for a sample_rate gets its blocks resampled to
+    // that rate on the audio thread (polyphase, see Resampler). Consumers
+    // asking for the same rate share one conversion; 0 means the device rate.
+    bool add_capture_consumer(CaptureConsumer* consumer, unsigned int sample_rate = 0);
+    void remove_capture_consumer(CaptureConsumer* consumer);
+    // Likewise for what is played: the output mixed down to mono, after the
+    // playback source, for consumers that record or stream it. Never gated;
+    // shares the consumer slots and is removed with remove_capture_consumer().
+    bool add_playback_consumer(CaptureConsumer* consumer, unsigned int sample_rate = 0);
+    // A capture consumer that is never gated, for displays that show the
+    // input whether anyone is talking or not. Removed likewise.
+    bool add_monitor_consumer(CaptureConsumer* consumer, unsigned int sample_rate = 0);
+    
+    // Voice-activity gating of the capture consumers. While enabled, blocks
+    // are marked speech or silence from the voice activity detector, which
+    // is switched on with it, held open for the hangover after speech ends.
+    // Capture consumers then receive only talk spurts, each starting with up
+    // to preroll_ms of the audio before it, and in the silence between them
+    // dtx blocks with a comfort noise level, at its start and twice a second.
+    // Nothing is resampled or copied for them meanwhile. The engine's own
+    // level metering stays ungated. Takes effect at the next callback; a
+    // changed pre-roll starts out empty, and is cut to kMaxPrerollMs.
+    void set_capture_gating(const GatingOptions& options);
+    GatingOptions capture_gating() const;
+    GatingStats get_gating_stats() const;
+    
+    // Echo cancellation, noise suppression, gain control and voice activity
+    // detection for the captured input, ahead of the processing graph and
+    // the capture consumers. Stages are toggled on it directly, from any
+    // thread; it is reconfigured for the device rate on open_device().
+    VoiceProcessor& voice_processor() { return *voice_; }
+    
+    // One callback's worth of processing: levels, voice processing, user
+    // callback, gating, consumer fan-out. Called on the real-time thread by
+    // the active backend, and directly by benchmarks; from one thread at a
+    // time.
+    // Never allocates or locks. Callbacks longer than AudioBlock::kMaxFrames
+    // are processed in pieces of that size.
+    void process_block(const float* input, float* output, unsigned long frames);
+    
+    // Peak and RMS of the raw input and of what is played, over every
+    // frame; take() them from one thread, usually the UI
+    LevelMeter& input_meter() { return input_meter_; }
+    LevelMeter& output_meter() { return output_meter_; }
     
 private:
-    PaStream* stream_;
+    struct RateConverter;
+    
+    // Which consumers a piece of capture goes to
+    enum Audience : unsigned { UNGATED = 1, GATED = 2, PLAYBACK = 4 };
+    
+    struct GateCounters {
+        std::atomic<uint64_t> speech_frames{0};
+        std::atomic<uint64_t> silence_frames{0};
+        std::atomic<uint64_t> segments{0};
+        std::atomic<uint64_t> silence_events{0};
+        std::atomic<uint64_t> fan_out_ns{0};     // Gated fan-out time during speech
+        std::atomic<uint64_t> fan_out_frames{0}; // and the frames it covered
+    };
+    
+    struct RetiredGraph {
+        std::unique_ptr<ProcessorGraph> graph;
+        uint64_t retired_at; // blocks_started_ when it was swapped out
+    };
+    
+    template<typename F>
+    static std::unique_ptr<ProcessorGraph> single_processor_graph(F&& callback) {
+        if constexpr (std::is_same<std::decay_t<F>, AudioCallback>::value) {
+            if (!callback) {
+                return nullptr;
+            }
+        }
+        auto graph = std::make_unique<ProcessorGraph>();
+        graph->add(std::forward<F>(callback));
+        return graph;
+    }
+    
+    bool add_consumer(CaptureConsumer* consumer, unsigned int sample_rate, Audience audience);
+    void reclaim_retired_graphs();
+    // Under control_mutex_
+    bool open_stream(int device_id, unsigned int sample_rate);
+    void close_stream();
+    // Waits until every block that started before the call has finished
+    void wait_for_blocks_in_flight();
+    
+    // Audio thread
+    void fan_out(const float* samples, unsigned int frames, unsigned int audience,
+                 float input_level, float output_level, bool speech, bool segment_start);
+    // Advances the gate over a piece; returns whether gating is in effect
+    bool update_gate(unsigned int frames);
+    void deliver_speech(const float* samples, unsigned int frames, float input_level,
+                        float output_level, bool gating, bool opened);
+    void withhold_silence(const float* samples, unsigned int frames, bool closed);
+    
+    std::unique_ptr<AudioBackend> backend_;
     Backend current_backend_;
-    AudioCallback audio_callback_;
+    // Held by whatever opens, starts, stops, switches or probes the device,
+    // or adds a consumer, so that the UI and device monitor threads take
+    // turns. Before consumers_mutex_; never on the audio thread.
+    std::mutex control_mutex_;
+    mutable std::mutex devices_mutex_;
+    std::vector<AudioDevice> devices_;
+    bool devices_cached_ = false;
+    unsigned int sample_rate_;
+    bool low_latency_;
+    const DspKernels* dsp_;
+    std::unique_ptr<VoiceProcessor> voice_;
+    std::vector<float> capture_;  // Voice-processed input, one AudioBlock's worth
+    std::vector<float> played_;   // Mono mix of the output, likewise
+    std::atomic<ProcessorGraph*> graph_{nullptr};
+    std::atomic<AudioProcessor*> playback_{nullptr};
+    std::atomic<float> input_gain_{1.0f};
+    std::atomic<bool> input_muted_{false};
+    std::atomic<float> output_volume_{1.0f};
+    std::atomic<bool> output_muted_{false};
+    std::mutex retired_mutex_;
+    std::vector<RetiredGraph> retired_graphs_;
     LevelCallback level_callback_;
-    std::atomic<float> input_level_{0.0f};
-    std::atomic<float> output_level_{0.0f};
-    
-    Backend detect_best_backend();
-    static int pa_audio_callback(const void* input, void* output,
-                               unsigned long frames_per_buffer,
-                               const void* time_info,
-                               unsigned long status_flags,
-                               void* user_data);
+    std::unique_ptr<CaptureConsumer> level_consumer_;
+    // Slot management is serialised by consumers_mutex_; the audio thread
+    // only loads the atomics. A consumer slot's converter is set before the
+    // consumer is published.
+    mutable std::mutex consumers_mutex_;
+    std::array<std::atomic<CaptureConsumer*>, kMaxCaptureConsumers> capture_consumers_{};
+    std::array<RateConverter*, kMaxCaptureConsumers> consumer_converters_{};
+    std::array<unsigned int, kMaxCaptureConsumers> consumer_audiences_{};
+    std::array<std::atomic<RateConverter*>, kMaxCaptureConsumers> rate_converters_{};
+    std::atomic<unsigned int> playback_consumers_{0};  // The output is mixed down only for them
+    // The audio thread bumps blocks_started_ before reading graph_, playback_
+    // or the consumer slots and publishes blocks_done_ after its last use of them
+    std::atomic<uint64_t> blocks_started_{0};
+    std::atomic<uint64_t> blocks_done_{0};
+    uint64_t blocks_at_open_ = 0;
+    
+    std::atomic<bool> gating_enabled_{false};
+    std::atomic<unsigned int> hangover_ms_{GatingOptions().hangover_ms};
+    std::atomic<unsigned int> preroll_ms_{GatingOptions().preroll_ms};
+    GateCounters gate_counters_;
+    // Gate state, sized by open_device() and otherwise audio thread only
+    bool gate_open_ = true;
+    uint64_t hangover_frames_ = 0;
+    uint64_t hangover_left_ = 0;
+    uint64_t silence_event_frames_ = 0;
+    uint64_t frames_since_event_ = 0;
+    std::vector<float> preroll_;  // Ring of the latest silence, kMaxPrerollMs long
+    size_t preroll_capacity_ = 0; // Of it in use, as preroll_ms_ asks
+    size_t preroll_write_ = 0;
+    size_t preroll_filled_ = 0;
+    
+    LevelMeter input_meter_;
+    LevelMeter output_meter_;
 };
@@ -0,0 +1,127 @@
+#include "capture_consumer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+CaptureConsumer::CaptureConsumer(std::string name, Handler handler, size_t capacity_blocks)
+    : name_(std::move(name)), handler_(std::move(handler)), ring_(capacity_blocks) {
+    sem_init(&wakeup_, 0, 0);
+}
+
+CaptureConsumer::~CaptureConsumer() {
+    stop();
+    sem_destroy(&wakeup_);
+}
+
+void CaptureConsumer::start() {
+    if (running_.exchange(true)) {
+        return;
+    }
+    thread_ = std::thread(&CaptureConsumer::run, this);
+}
+
+void CaptureConsumer::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+    sem_post(&wakeup_);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+bool CaptureConsumer::publish(const float* samples, unsigned frames, unsigned sample_rate,
+                              float input_level, float output_level,
+                              bool speech, bool segment_start) {
+    bool ok = true;
+    unsigned offset = 0;
+    do {
+        unsigned chunk = std::min(frames - offset, AudioBlock::kMaxFrames);
+        uint64_t sequence = next_sequence_++;
+        AudioBlock* block = ring_.write_slot();
+        if (!block) {
+            overruns_.fetch_add(1, std::memory_order_relaxed);
+            ok = false;
+        } else {
+            block->sequence = sequence;
+            block->frames = chunk;
+            block->sample_rate = sample_rate;
+            block->input_level = input_level;
+            block->output_level = output_level;
+            block->speech = speech;
+            block->segment_start = segment_start && offset == 0;
+            block->dtx = false;
+            block->comfort_noise_level = 0.0f;
+            if (samples) {
+                std::memcpy(block->samples, samples + offset, sizeof(float) * chunk);
+            } else {
+                std::memset(block->samples, 0, sizeof(float) * chunk);
+            }
+            ring_.publish();
+            published_.fetch_add(1, std::memory_order_relaxed);
+        }
+        offset += chunk;
+    } while (offset < frames);
+
+    // sem_post is a single atomic increment unless the consumer is sleeping
+    sem_post(&wakeup_);
+    return ok;
+}
+
+bool CaptureConsumer::publish_silence(unsigned sample_rate, float comfort_noise_level) {
+    uint64_t sequence = next_sequence_++;
+    AudioBlock* block = ring_.write_slot();
+    if (!block) {
+        overruns_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    // Header only; samples[] is left as it was
+    block->sequence = sequence;
+    block->frames = 0;
+    block->sample_rate = sample_rate;
+    block->input_level = 0.0f;
+    block->output_level = 0.0f;
+    block->speech = false;
+    block->segment_start = false;
+    block->dtx = true;
+    block->comfort_noise_level = comfort_noise_level;
+    ring_.publish();
+    published_.fetch_add(1, std::memory_order_relaxed);
+    sem_post(&wakeup_);
+    return true;
+}
+
+void CaptureConsumer::run() {
+    while (running_.load(std::memory_order_acquire)) {
+        timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 100 * 1000 * 1000;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (sem_timedwait(&wakeup_, &deadline) != 0 && errno != ETIMEDOUT && errno != EINTR) {
+            break;
+        }
+        drain();
+    }
+    drain();
+}
+
+void CaptureConsumer::drain() {
+    while (const AudioBlock* block = ring_.read_slot()) {
+        if (handler_) {
+            auto start = std::chrono::steady_clock::now();
+            handler_(*block);
+            handler_ns_.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - start).count()),
+                                  std::memory_order_relaxed);
+            handled_frames_.fetch_add(block->frames, std::memory_order_relaxed);
+        }
+        ring_.release();
+        delivered_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
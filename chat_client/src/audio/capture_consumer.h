@@ -0,0 +1,66 @@
+#pragma once
+
+#include "audio_block.h"
+#include "../utils/spsc_ring_buffer.h"
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <semaphore.h>
+
+// A consumer of captured audio (network send, STT, recording, metering...).
+//
+// The real-time callback only copies samples into this consumer's ring via
+// publish(); the handler runs on the consumer's own thread. When the ring is
+// full the block is dropped and counted as an overrun rather than blocking
+// the audio thread.
+class CaptureConsumer {
+public:
+    using Handler = std::function<void(const AudioBlock& block)>;
+
+    CaptureConsumer(std::string name, Handler handler, size_t capacity_blocks = 64);
+    ~CaptureConsumer();
+
+    CaptureConsumer(const CaptureConsumer&) = delete;
+    CaptureConsumer& operator=(const CaptureConsumer&) = delete;
+
+    void start();
+    void stop();
+
+    // Producer side, called from the real-time thread only.
+    bool publish(const float* samples, unsigned frames, unsigned sample_rate,
+                 float input_level, float output_level,
+                 bool speech = true, bool segment_start = false);
+    // A dtx block: the stream is silent until the next segment_start
+    bool publish_silence(unsigned sample_rate, float comfort_noise_level);
+    // Counts frames a gated stream did not deliver; no ring traffic
+    void withhold(unsigned frames) { withheld_frames_.fetch_add(frames, std::memory_order_relaxed); }
+
+    const std::string& name() const { return name_; }
+    uint64_t published() const { return published_.load(std::memory_order_relaxed); }
+    uint64_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+    uint64_t delivered() const { return delivered_.load(std::memory_order_relaxed); }
+    // Frames handed to the handler and the time it spent on them
+    uint64_t handled_frames() const { return handled_frames_.load(std::memory_order_relaxed); }
+    uint64_t handler_ns() const { return handler_ns_.load(std::memory_order_relaxed); }
+    uint64_t withheld_frames() const { return withheld_frames_.load(std::memory_order_relaxed); }
+
+private:
+    void run();
+    void drain();
+
+    std::string name_;
+    Handler handler_;
+    SpscRingBuffer<AudioBlock> ring_;
+    sem_t wakeup_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+    uint64_t next_sequence_ = 0;
+    std::atomic<uint64_t> published_{0};
+    std::atomic<uint64_t> overruns_{0};
+    std::atomic<uint64_t> delivered_{0};
+    std::atomic<uint64_t> handled_frames_{0};
+    std::atomic<uint64_t> handler_ns_{0};
+    std::atomic<uint64_t> withheld_frames_{0};
+};
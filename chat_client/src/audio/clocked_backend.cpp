@@ -0,0 +1,155 @@
+#include "clocked_backend.h"
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
+namespace {
+
+constexpr long kNanosPerSecond = 1000000000L;
+
+void advance(timespec& t, long nanos) {
+    t.tv_nsec += nanos;
+    while (t.tv_nsec >= kNanosPerSecond) {
+        t.tv_nsec -= kNanosPerSecond;
+        ++t.tv_sec;
+    }
+}
+
+bool later_than(const timespec& a, const timespec& b) {
+    return a.tv_sec > b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec > b.tv_nsec);
+}
+
+} // namespace
+
+ClockedBackend::ClockedBackend(AudioEngine& engine, const AudioEngine::BackendOptions& options)
+    : AudioBackend(engine), options_(options), opened_(false) {
+}
+
+ClockedBackend::~ClockedBackend() {
+    close();
+}
+
+bool ClockedBackend::open(const AudioEngine::StreamConfig& config) {
+    close();
+
+    config_ = config;
+    input_.assign(config.frames_per_buffer, 0.0f);
+    output_.assign(config.frames_per_buffer * 2, 0.0f);
+    frames_processed_.store(0);
+    late_buffers_.store(0);
+    opened_ = on_open();
+    if (config_.sample_rate == 0) {
+        config_.sample_rate = kNativeSampleRate;
+    }
+    return opened_;
+}
+
+bool ClockedBackend::start() {
+    if (!opened_ || running_.load()) {
+        return false;
+    }
+    if (thread_.joinable()) {
+        thread_.join(); // Previous run ended on its own
+    }
+
+    running_.store(true);
+    active_.store(true, std::memory_order_release);
+    thread_ = std::thread(&ClockedBackend::run, this);
+    return true;
+}
+
+void ClockedBackend::close() {
+    running_.store(false);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (opened_) {
+        on_close();
+        opened_ = false;
+    }
+}
+
+void ClockedBackend::get_stats(AudioEngine::Stats& stats) const {
+    stats.sample_rate = config_.sample_rate;
+    stats.frames_per_buffer = config_.frames_per_buffer;
+    if (config_.sample_rate) {
+        double period = static_cast<double>(config_.frames_per_buffer) / config_.sample_rate;
+        stats.input_latency = period;
+        stats.output_latency = period;
+        stats.device_id = 0;  // Its one device
+    }
+    stats.xruns = late_buffers();
+}
+
+void ClockedBackend::run() {
+    const unsigned int frames = config_.frames_per_buffer;
+    const long period_ns = static_cast<long>(1e9 * frames / config_.sample_rate);
+    const bool paced = options_.pacing == AudioEngine::BackendOptions::Pacing::REALTIME;
+
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (running_.load(std::memory_order_relaxed)) {
+        unsigned int count = frames;
+        if (options_.max_frames) {
+            uint64_t remaining = options_.max_frames - frames_processed();
+            if (remaining == 0) {
+                break;
+            }
+            count = static_cast<unsigned int>(std::min<uint64_t>(remaining, frames));
+        }
+
+        if (!fill_input(input_.data(), count)) {
+            break;
+        }
+        engine_.process_block(input_.data(), output_.data(), count);
+        consume_output(output_.data(), count);
+        frames_processed_.fetch_add(count, std::memory_order_relaxed);
+
+        if (paced) {
+            advance(next, period_ns);
+            timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            timespec late_threshold = next;
+            advance(late_threshold, period_ns);
+            if (later_than(now, late_threshold)) {
+                // Too far behind to catch up without a burst; resync instead
+                late_buffers_.fetch_add(1, std::memory_order_relaxed);
+                next = now;
+            } else {
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr) != 0 &&
+                       running_.load(std::memory_order_relaxed)) {
+                }
+            }
+        }
+    }
+
+    running_.store(false);
+    active_.store(false, std::memory_order_release);
+}
+
+NullBackend::~NullBackend() {
+    close();
+}
+
+std::vector<AudioEngine::AudioDevice> NullBackend::get_devices() {
+    AudioEngine::AudioDevice device;
+    device.id = 0;
+    device.name = "Null device";
+    device.max_input_channels = 1;
+    device.max_output_channels = 2;
+    device.sample_rates = { 8000, 16000, 22050, 44100, 48000 };
+    device.is_default = true;
+    return { device };
+}
+
+void NullBackend::get_stats(AudioEngine::Stats& stats) const {
+    ClockedBackend::get_stats(stats);
+    stats.backend = AudioEngine::Backend::NULL_DEVICE;
+    stats.device_name = "Null device";
+}
+
+bool NullBackend::fill_input(float* input, unsigned int frames) {
+    std::memset(input, 0, sizeof(float) * frames);
+    return true;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "audio_backend.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Base for backends without a sound card. A thread calls process_block once
+// per buffer, either paced to wall-clock time with an absolute
+// CLOCK_MONOTONIC timer or as fast as the engine can go (FREERUN), which is
+// what soak tests and benchmarks want.
+//
+// The thread calls the subclass, so a subclass's destructor must close()
+// before its members go; by the time ~ClockedBackend runs they are gone.
+class ClockedBackend : public AudioBackend {
+public:
+    // Used when the stream is opened with sample rate 0
+    static constexpr unsigned int kNativeSampleRate = 48000;
+
+    ClockedBackend(AudioEngine& engine, const AudioEngine::BackendOptions& options);
+    ~ClockedBackend() override;
+
+    bool initialize() override { return true; }
+    bool open(const AudioEngine::StreamConfig& config) override;
+    bool start() override;
+    void close() override;
+    bool is_active() const override { return active_.load(std::memory_order_acquire); }
+    // Late buffers count as xruns; latency is one buffer period each way
+    void get_stats(AudioEngine::Stats& stats) const override;
+
+    uint64_t frames_processed() const { return frames_processed_.load(std::memory_order_relaxed); }
+    // Buffers that started more than one buffer period late (REALTIME only)
+    uint64_t late_buffers() const { return late_buffers_.load(std::memory_order_relaxed); }
+
+protected:
+    // Fill the mono input buffer; return false at end of input.
+    virtual bool fill_input(float* input, unsigned int frames) = 0;
+    virtual void consume_output(const float* output, unsigned int frames) = 0;
+    // May set config_.sample_rate when it was opened with 0
+    virtual bool on_open() { return true; }
+    virtual void on_close() {}
+
+    AudioEngine::BackendOptions options_;
+    AudioEngine::StreamConfig config_;
+
+private:
+    void run();
+
+    std::vector<float> input_;
+    std::vector<float> output_;
+    std::thread thread_;
+    bool opened_;
+    std::atomic<bool> running_{false};
+    std::atomic<bool> active_{false};
+    std::atomic<uint64_t> frames_processed_{0};
+    std::atomic<uint64_t> late_buffers_{0};
+};
+
+// Silent input, discarded output.
+class NullBackend : public ClockedBackend {
+public:
+    using ClockedBackend::ClockedBackend;
+    ~NullBackend() override;
+
+    std::vector<AudioEngine::AudioDevice> get_devices() override;
+    void get_stats(AudioEngine::Stats& stats) const override;
+
+protected:
+    bool fill_input(float* input, unsigned int frames) override;
+    void consume_output(const float*, unsigned int) override {}
+};
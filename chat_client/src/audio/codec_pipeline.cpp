@@ -0,0 +1,156 @@
+#include "codec_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+AudioEncodePipeline::AudioEncodePipeline(const CodecSettings& settings, Sink sink, size_t capacity_blocks)
+    : settings_(settings), encoder_(make_audio_encoder(settings)), sink_(std::move(sink)) {
+    if (!encoder_) {
+        return;
+    }
+    frame_.resize(encoder_->frame_samples());
+    // A block fills at most this many frames, plus a comfort noise frame
+    size_t batch_capacity = AudioBlock::kMaxFrames / frame_.size() + 2;
+    packets_.resize(batch_capacity * AudioEncoder::kMaxPacketBytes);
+    batch_.resize(batch_capacity);
+    consumer_ = std::make_unique<CaptureConsumer>(
+        "codec", [this](const AudioBlock& block) { process(block); }, capacity_blocks);
+}
+
+AudioEncodePipeline::~AudioEncodePipeline() {
+    stop();
+}
+
+const char* AudioEncodePipeline::codec_name() const {
+    return encoder_ ? encoder_->name() : "";
+}
+
+unsigned AudioEncodePipeline::sample_rate() const {
+    return encoder_ ? encoder_->sample_rate() : 0;
+}
+
+unsigned AudioEncodePipeline::frame_samples() const {
+    return encoder_ ? encoder_->frame_samples() : 0;
+}
+
+void AudioEncodePipeline::start() {
+    if (consumer_) {
+        consumer_->start();
+    }
+}
+
+void AudioEncodePipeline::stop() {
+    if (consumer_) {
+        consumer_->stop();
+    }
+}
+
+void AudioEncodePipeline::process(const AudioBlock& block) {
+    if (!encoder_) {
+        return;
+    }
+    if (block.dtx) {
+        // The talk spurt's tail goes out padded with silence
+        if (filled_ > 0) {
+            std::fill(frame_.begin() + static_cast<std::ptrdiff_t>(filled_), frame_.end(), 0.0f);
+            filled_ = frame_.size();
+            finish_frame();
+        }
+        // The engine repeats these through the silence, refreshing the
+        // receiver's comfort noise
+        emit_comfort_noise(block.comfort_noise_level);
+        flush_batch();
+        return;
+    }
+    if (block.segment_start) {
+        silent_ = true;
+    }
+
+    unsigned offset = 0;
+    while (offset < block.frames) {
+        size_t take = std::min<size_t>(block.frames - offset, frame_.size() - filled_);
+        const float* in = block.samples + offset;
+        float* out = frame_.data() + filled_;
+        for (size_t i = 0; i < take; ++i) {
+            out[i] = in[i];
+            frame_energy_ += double(in[i]) * in[i];
+        }
+        filled_ += take;
+        offset += static_cast<unsigned>(take);
+        if (filled_ == frame_.size()) {
+            finish_frame();
+        }
+    }
+    flush_batch();
+}
+
+void AudioEncodePipeline::finish_frame() {
+    size_t samples = frame_.size();
+    float level = static_cast<float>(std::sqrt(frame_energy_ / samples));
+    filled_ = 0;
+    frame_energy_ = 0.0;
+
+    if (settings_.dtx && level < kSilenceLevel) {
+        skipped_frames_.fetch_add(1, std::memory_order_relaxed);
+        if (!silent_ || ++silent_frames_ >= kComfortNoiseFrames) {
+            emit_comfort_noise(level);
+        }
+        timestamp_ += static_cast<uint32_t>(samples);
+        return;
+    }
+
+    uint8_t* packet = packets_.data() + batch_size_ * AudioEncoder::kMaxPacketBytes;
+    auto start = std::chrono::steady_clock::now();
+    size_t size = encoder_->encode(frame_.data(), packet, AudioEncoder::kMaxPacketBytes);
+    encode_ns_.fetch_add(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::steady_clock::now() - start).count()),
+                         std::memory_order_relaxed);
+    if (size == 0) {
+        encode_errors_.fetch_add(1, std::memory_order_relaxed);
+        timestamp_ += static_cast<uint32_t>(samples);
+        return;
+    }
+
+    EncodedFrame& frame = batch_[batch_size_++];
+    frame = EncodedFrame();
+    frame.sequence = sequence_++;
+    frame.timestamp = timestamp_;
+    frame.data = packet;
+    frame.size = size;
+    frame.segment_start = silent_;
+    silent_ = false;
+    timestamp_ += static_cast<uint32_t>(samples);
+    frames_.fetch_add(1, std::memory_order_relaxed);
+    bytes_.fetch_add(size, std::memory_order_relaxed);
+}
+
+void AudioEncodePipeline::emit_comfort_noise(float level) {
+    EncodedFrame& frame = batch_[batch_size_++];
+    frame = EncodedFrame();
+    frame.sequence = sequence_++;
+    frame.timestamp = timestamp_;
+    frame.dtx = true;
+    frame.comfort_noise_level = level;
+    silent_ = true;
+    silent_frames_ = 0;
+    dtx_frames_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioEncodePipeline::flush_batch() {
+    if (batch_size_ > 0 && sink_) {
+        sink_(batch_.data(), batch_size_);
+    }
+    batch_size_ = 0;
+}
+
+AudioEncodePipeline::Stats AudioEncodePipeline::get_stats() const {
+    Stats stats;
+    stats.frames = frames_.load(std::memory_order_relaxed);
+    stats.dtx_frames = dtx_frames_.load(std::memory_order_relaxed);
+    stats.skipped_frames = skipped_frames_.load(std::memory_order_relaxed);
+    stats.bytes = bytes_.load(std::memory_order_relaxed);
+    stats.encode_errors = encode_errors_.load(std::memory_order_relaxed);
+    stats.encode_ns = encode_ns_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include "audio_codec.h"
+#include "capture_consumer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// One encoded frame as handed to the network side
+struct EncodedFrame {
+    uint64_t sequence = 0;       // Frames encoded, DTX frames included
+    uint32_t timestamp = 0;      // First sample, in samples at the codec rate
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+    bool segment_start = false;  // First frame after silence
+    // Comfort noise in place of audio: no data, sent as silence starts and
+    // every kComfortNoiseFrames frames while it lasts
+    bool dtx = false;
+    float comfort_noise_level = 0.0f;
+};
+
+// Captured audio to encoded frames, on a capture consumer thread.
+//
+// Register consumer() with the engine at sample_rate(), so the engine
+// resamples to the codec rate. Blocks are cut into frames of frame_ms
+// (20 ms by default), each encoded as it fills, and the frames from one
+// block are passed to the sink together. The frame buffer, packets and
+// batch are allocated up front, so nothing is allocated per frame.
+//
+// With DTX on, frames below kSilenceLevel are not encoded. The first sends
+// a comfort noise frame instead, repeated every kComfortNoiseFrames frames
+// while the silence lasts. Under capture gating each of the engine's dtx
+// blocks, sent as a talk spurt ends and every 500 ms after, becomes a
+// comfort noise frame, whatever the DTX setting.
+class AudioEncodePipeline {
+public:
+    using Sink = std::function<void(const EncodedFrame* frames, size_t count)>;
+
+    static constexpr unsigned kComfortNoiseFrames = 20;  // 400 ms at 20 ms
+    static constexpr float kSilenceLevel = 0.0005f;       // RMS, about -66 dBFS
+
+    struct Stats {
+        uint64_t frames = 0;          // Encoded and sent
+        uint64_t dtx_frames = 0;      // Comfort noise frames sent
+        uint64_t skipped_frames = 0;  // Silent frames not sent
+        uint64_t bytes = 0;           // Of encoded audio
+        uint64_t encode_errors = 0;
+        uint64_t encode_ns = 0;       // Time spent in the encoder
+    };
+
+    // valid() is false if the codec cannot be set up
+    AudioEncodePipeline(const CodecSettings& settings, Sink sink, size_t capacity_blocks = 64);
+    ~AudioEncodePipeline();
+
+    AudioEncodePipeline(const AudioEncodePipeline&) = delete;
+    AudioEncodePipeline& operator=(const AudioEncodePipeline&) = delete;
+
+    bool valid() const { return encoder_ != nullptr; }
+    const char* codec_name() const;
+    unsigned sample_rate() const;
+    unsigned frame_samples() const;
+
+    CaptureConsumer* consumer() { return consumer_.get(); }
+    void start();
+    void stop();
+
+    // Runs a block through framing and the encoder, as the consumer thread
+    // does; for driving the pipeline without one
+    void process(const AudioBlock& block);
+
+    Stats get_stats() const;
+
+private:
+    void finish_frame();
+    void emit_comfort_noise(float level);
+    void flush_batch();
+
+    CodecSettings settings_;
+    std::unique_ptr<AudioEncoder> encoder_;
+    Sink sink_;
+    std::unique_ptr<CaptureConsumer> consumer_;
+
+    std::vector<float> frame_;
+    size_t filled_ = 0;
+    double frame_energy_ = 0.0;
+    // Packets of the current batch, one slot per frame a block can yield
+    std::vector<uint8_t> packets_;
+    std::vector<EncodedFrame> batch_;
+    size_t batch_size_ = 0;
+
+    uint64_t sequence_ = 0;
+    uint32_t timestamp_ = 0;
+    bool silent_ = true;          // Not sending audio; the next audio starts a segment
+    unsigned silent_frames_ = 0;  // Since the last comfort noise frame
+
+    std::atomic<uint64_t> frames_{0};
+    std::atomic<uint64_t> dtx_frames_{0};
+    std::atomic<uint64_t> skipped_frames_{0};
+    std::atomic<uint64_t> bytes_{0};
+    std::atomic<uint64_t> encode_errors_{0};
+    std::atomic<uint64_t> encode_ns_{0};
+};
@@ -0,0 +1,209 @@
+#include "device_monitor.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+} // namespace
+
+DeviceMonitor::DeviceMonitor(AudioEngine& engine, Notify notify)
+    : DeviceMonitor(engine, std::move(notify), Options()) {}
+
+DeviceMonitor::DeviceMonitor(AudioEngine& engine, Notify notify, Options options)
+    : engine_(engine), notify_(std::move(notify)), options_(std::move(options)) {}
+
+DeviceMonitor::~DeviceMonitor() {
+    stop();
+}
+
+bool DeviceMonitor::start() {
+    if (thread_.joinable()) {
+        return true;
+    }
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        std::cerr << "Device monitor setup failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    // Without the directory, or inotify, scan on a timer instead
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0
+        && inotify_add_watch(inotify_fd, options_.watch_path.c_str(), IN_CREATE | IN_DELETE) < 0) {
+        std::cerr << "Cannot watch " << options_.watch_path << " for devices, polling instead: "
+                  << std::strerror(errno) << std::endl;
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    stopping_ = false;
+    thread_ = std::thread(&DeviceMonitor::run, this, inotify_fd);
+    return true;
+}
+
+void DeviceMonitor::stop() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    stopping_ = true;
+    wake();
+    thread_.join();
+    close(wake_fd_);
+    wake_fd_ = -1;
+}
+
+void DeviceMonitor::wake() {
+    uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) != static_cast<ssize_t>(sizeof(one))) {
+        std::cerr << "Device monitor wakeup failed: " << std::strerror(errno) << std::endl;
+    }
+}
+
+void DeviceMonitor::request_scan() {
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        scan_requested_ = true;
+    }
+    if (thread_.joinable()) {
+        wake();
+    }
+}
+
+void DeviceMonitor::request_switch(int device_id) {
+    {
+        std::lock_guard<std::mutex> lock(requests_mutex_);
+        switch_request_ = device_id;
+    }
+    if (thread_.joinable()) {
+        wake();
+    }
+}
+
+void DeviceMonitor::run(int inotify_fd) {
+    pollfd fds[2] = { { wake_fd_, POLLIN, 0 }, { inotify_fd, POLLIN, 0 } };
+    const nfds_t watched = inotify_fd >= 0 ? 2 : 1;
+    alignas(inotify_event) char buffer[4096];
+    bool pending = false;
+    bool deferred = false;
+    Clock::time_point due;
+    std::string cards = inotify_fd < 0 ? read_cards() : std::string();
+
+    while (!stopping_) {
+        int timeout = -1;
+        if (pending) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count();
+            timeout = static_cast<int>(std::max<decltype(left)>(left, 0));
+        } else if (deferred || inotify_fd < 0) {
+            timeout = options_.poll_ms;
+        }
+        int count = poll(fds, watched, timeout);
+        if (count < 0 && errno != EINTR) {
+            std::cerr << "Device monitor failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (stopping_) {
+            break;
+        }
+        if (count > 0 && (fds[0].revents & POLLIN)) {
+            uint64_t wakeups;
+            if (read(wake_fd_, &wakeups, sizeof(wakeups)) < 0 && errno != EAGAIN) {
+                std::cerr << "Device monitor wakeup failed: " << std::strerror(errno) << std::endl;
+            }
+        }
+        if (count > 0 && watched > 1 && (fds[1].revents & POLLIN)) {
+            // Every entry counts: card nodes come and go under their own names
+            while (read(inotify_fd, buffer, sizeof(buffer)) > 0) {
+                pending = true;
+                due = Clock::now() + std::chrono::milliseconds(options_.settle_ms);
+            }
+        }
+
+        int switch_to_device;
+        bool requested;
+        {
+            std::lock_guard<std::mutex> lock(requests_mutex_);
+            switch_to_device = switch_request_;
+            switch_request_ = -1;
+            requested = scan_requested_;
+            scan_requested_ = false;
+        }
+        if (switch_to_device >= 0) {
+            switch_to(switch_to_device);
+        }
+
+        bool settled = pending && Clock::now() >= due;
+        bool retry = count == 0 && !pending && deferred;
+        bool polled = false;
+        if (count == 0 && !pending && inotify_fd < 0) {
+            polls_.fetch_add(1, std::memory_order_relaxed);
+            std::string now = read_cards();
+            polled = now != cards;
+            cards = std::move(now);
+        }
+        if (requested || settled || retry || polled) {
+            pending = false;
+            deferred = !scan();
+        }
+    }
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
+}
+
+bool DeviceMonitor::scan() {
+    AudioEngine::DeviceScan result = engine_.refresh_devices(true);
+    if (result == AudioEngine::DeviceScan::DEFERRED) {
+        deferred_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    scans_.fetch_add(1, std::memory_order_relaxed);
+    if (result == AudioEngine::DeviceScan::CHANGED) {
+        changes_.fetch_add(1, std::memory_order_relaxed);
+        Event event;
+        event.kind = Event::Kind::DEVICES_CHANGED;
+        event.devices = engine_.get_devices();
+        event.open_device = engine_.get_stats().device_id;
+        notify_(event);
+    }
+    return true;
+}
+
+void DeviceMonitor::switch_to(int device_id) {
+    bool switched = engine_.switch_device(device_id);
+    (switched ? switches_ : failed_switches_).fetch_add(1, std::memory_order_relaxed);
+    Event event;
+    event.kind = switched ? Event::Kind::SWITCHED : Event::Kind::SWITCH_FAILED;
+    event.devices = engine_.get_devices();
+    event.open_device = engine_.get_stats().device_id;
+    event.requested_device = device_id;
+    notify_(event);
+}
+
+// Empty if unreadable, in which case polling finds nothing
+std::string DeviceMonitor::read_cards() const {
+    std::ifstream file(options_.cards_path);
+    std::ostringstream text;
+    text << file.rdbuf();
+    return text.str();
+}
+
+DeviceMonitor::Stats DeviceMonitor::get_stats() const {
+    Stats stats;
+    stats.polls = polls_.load(std::memory_order_relaxed);
+    stats.scans = scans_.load(std::memory_order_relaxed);
+    stats.deferred = deferred_.load(std::memory_order_relaxed);
+    stats.changes = changes_.load(std::memory_order_relaxed);
+    stats.switches = switches_.load(std::memory_order_relaxed);
+    stats.failed_switches = failed_switches_.load(std::memory_order_relaxed);
+    return stats;
+}
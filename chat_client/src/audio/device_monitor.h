@@ -0,0 +1,98 @@
+#pragma once
+
+#include "audio_engine.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Keeps the engine's device table current and switches devices, on a
+// thread of its own, so that neither blocks the UI thread.
+//
+// Devices plugged in or removed show up as entries created or deleted
+// under watch_path (inotify); the table is scanned again settle_ms after
+// the last of them. Without the directory it reads cards_path every
+// poll_ms instead and scans only when that changed: a scan re-initializes
+// the sound card host and probes every device, which the stream's
+// controls wait for. A scan the backend defers, because the sound card
+// cannot be re-read while it streams, is retried every poll_ms until it
+// goes through.
+//
+// Events are delivered to notify on the monitor's thread; hand them to the
+// UI thread from there (Fl::awake).
+class DeviceMonitor {
+public:
+    struct Options {
+        std::string watch_path = "/dev/snd";
+        int settle_ms = 300;           // ALSA creates a card's nodes one by one
+        int poll_ms = 2000;
+        std::string cards_path = "/proc/asound/cards";   // Lists the cards present
+    };
+
+    struct Event {
+        enum class Kind { DEVICES_CHANGED, SWITCHED, SWITCH_FAILED };
+        Kind kind;
+        std::vector<AudioEngine::AudioDevice> devices;   // The table as of the event
+        int open_device = -1;          // As in AudioEngine::Stats::device_id
+        int requested_device = -1;     // Of a switch
+    };
+    using Notify = std::function<void(const Event& event)>;
+
+    struct Stats {
+        uint64_t polls = 0;            // cards_path read without watch_path
+        uint64_t scans = 0;            // Table enumerated again
+        uint64_t deferred = 0;         // Scans put off while the stream ran
+        uint64_t changes = 0;          // Scans that found the table changed
+        uint64_t switches = 0;
+        uint64_t failed_switches = 0;
+    };
+
+    DeviceMonitor(AudioEngine& engine, Notify notify);
+    DeviceMonitor(AudioEngine& engine, Notify notify, Options options);
+    // Stops the thread
+    ~DeviceMonitor();
+
+    DeviceMonitor(const DeviceMonitor&) = delete;
+    DeviceMonitor& operator=(const DeviceMonitor&) = delete;
+
+    // After the engine is initialized
+    bool start();
+    // Waits for a scan or switch in progress to finish
+    void stop();
+
+    // Any thread; return at once
+    void request_scan();
+    void request_switch(int device_id);
+
+    Stats get_stats() const;
+
+private:
+    void wake();
+    void run(int inotify_fd);
+    bool scan();
+    std::string read_cards() const;
+    void switch_to(int device_id);
+
+    AudioEngine& engine_;
+    Notify notify_;
+    Options options_;
+
+    std::thread thread_;
+    int wake_fd_ = -1;
+    std::atomic<bool> stopping_{false};
+
+    std::mutex requests_mutex_;
+    int switch_request_ = -1;      // A newer request replaces one not yet started
+    bool scan_requested_ = false;
+
+    std::atomic<uint64_t> polls_{0};
+    std::atomic<uint64_t> scans_{0};
+    std::atomic<uint64_t> deferred_{0};
+    std::atomic<uint64_t> changes_{0};
+    std::atomic<uint64_t> switches_{0};
+    std::atomic<uint64_t> failed_switches_{0};
+};
@@ -0,0 +1,91 @@
+#include "file_backend.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+FileBackend::~FileBackend() {
+    close();
+}
+
+std::vector<AudioEngine::AudioDevice> FileBackend::get_devices() {
+    AudioEngine::AudioDevice device;
+    device.id = 0;
+    device.name = "File: " + (options_.input_path.empty() ? std::string("(silence)") : options_.input_path);
+    device.max_input_channels = 1;
+    device.max_output_channels = 2;
+    device.sample_rates = { 8000, 16000, 22050, 44100, 48000 };
+    device.is_default = true;
+    device.native_sample_rate = input_file_.sample_rate ? static_cast<int>(input_file_.sample_rate)
+                                                        : static_cast<int>(kNativeSampleRate);
+    return { device };
+}
+
+void FileBackend::get_stats(AudioEngine::Stats& stats) const {
+    ClockedBackend::get_stats(stats);
+    stats.backend = AudioEngine::Backend::WAV_FILE;
+    stats.device_name = options_.input_path.empty() ? "(silence)" : options_.input_path;
+}
+
+bool FileBackend::on_open() {
+    read_position_ = 0;
+    input_file_ = WavData();
+
+    if (!options_.input_path.empty()) {
+        unsigned int raw_rate = config_.sample_rate ? config_.sample_rate : kNativeSampleRate;
+        if (!read_wav_mono(options_.input_path, input_file_, raw_rate)) {
+            return false;
+        }
+        if (config_.sample_rate == 0) {
+            config_.sample_rate = input_file_.sample_rate; // Run at the file's rate
+        }
+        if (input_file_.sample_rate != config_.sample_rate) {
+            std::cerr << "Warning: " << options_.input_path << " is " << input_file_.sample_rate
+                      << " Hz, stream runs at " << config_.sample_rate << " Hz" << std::endl;
+        }
+    }
+
+    if (config_.sample_rate == 0) {
+        config_.sample_rate = kNativeSampleRate;
+    }
+    if (!options_.output_path.empty() &&
+        !writer_.open(options_.output_path, config_.sample_rate, 2)) {
+        return false;
+    }
+    return true;
+}
+
+void FileBackend::on_close() {
+    writer_.close();
+}
+
+bool FileBackend::fill_input(float* input, unsigned int frames) {
+    const std::vector<float>& samples = input_file_.samples;
+    if (options_.input_path.empty()) {
+        std::memset(input, 0, sizeof(float) * frames);
+        return true;
+    }
+    if (read_position_ >= samples.size() && (!options_.loop_input || samples.empty())) {
+        return false;
+    }
+
+    // A short final buffer is padded with silence
+    unsigned int filled = 0;
+    while (filled < frames) {
+        if (read_position_ >= samples.size()) {
+            if (!options_.loop_input || samples.empty()) {
+                std::memset(input + filled, 0, sizeof(float) * (frames - filled));
+                break;
+            }
+            read_position_ = 0;
+        }
+        size_t chunk = std::min<size_t>(frames - filled, samples.size() - read_position_);
+        std::memcpy(input + filled, samples.data() + read_position_, sizeof(float) * chunk);
+        filled += static_cast<unsigned int>(chunk);
+        read_position_ += chunk;
+    }
+    return true;
+}
+
+void FileBackend::consume_output(const float* output, unsigned int frames) {
+    writer_.write(output, frames);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "clocked_backend.h"
+#include "wav_file.h"
+
+// Reads input from a WAV/raw file and writes the stereo output to another.
+// With no input path the input is silent; with no output path the output is
+// discarded. The stream ends when the input runs out unless loop_input is set.
+class FileBackend : public ClockedBackend {
+public:
+    using ClockedBackend::ClockedBackend;
+    // Stops the thread and finishes the output file
+    ~FileBackend() override;
+
+    std::vector<AudioEngine::AudioDevice> get_devices() override;
+    void get_stats(AudioEngine::Stats& stats) const override;
+
+protected:
+    bool fill_input(float* input, unsigned int frames) override;
+    void consume_output(const float* output, unsigned int frames) override;
+    bool on_open() override;
+    void on_close() override;
+
+private:
+    WavData input_file_;
+    size_t read_position_ = 0;
+    WavWriter writer_;
+};
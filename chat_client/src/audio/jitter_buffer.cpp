@@ -0,0 +1,382 @@
+#include "jitter_buffer.h"
+#include "audio_block.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// Depth smoothing per frame, and the stretch per second of depth error
+constexpr double kDepthSmoothing = 0.05;
+constexpr double kStretchGain = 0.5;
+// Concealing longer than this mid-speech falls silent until the stream
+// comes back, rebuffering then
+constexpr unsigned kMaxConcealMs = 100;
+
+int16_t sequence_delta(uint16_t a, uint16_t b) {
+    return static_cast<int16_t>(a - b);
+}
+
+int32_t timestamp_delta(uint32_t a, uint32_t b) {
+    return static_cast<int32_t>(a - b);
+}
+
+} // namespace
+
+JitterBuffer::JitterBuffer(const CodecSettings& settings, unsigned output_rate)
+    : JitterBuffer(settings, output_rate, Options()) {
+}
+
+JitterBuffer::JitterBuffer(const CodecSettings& settings, unsigned output_rate, const Options& options)
+    : options_(options), decoder_(make_audio_decoder(settings)), output_rate_(output_rate),
+      queue_(options.queue_packets), window_(kWindow), mono_(AudioBlock::kMaxFrames) {
+    if (!decoder_ || output_rate_ == 0) {
+        decoder_.reset();
+        return;
+    }
+    rate_ = decoder_->sample_rate();
+    frame_ = decoder_->frame_samples();
+    pcm_.assign(frame_ + 1, 0.0f);
+    position_ = frame_;
+    target_ = static_cast<int32_t>(uint64_t(options_.min_delay_ms) * rate_ / 1000);
+}
+
+bool JitterBuffer::push(const RtpHeader& header, const uint8_t* payload, size_t size) {
+    return push(header, payload, size, Clock::now());
+}
+
+bool JitterBuffer::push(const RtpHeader& header, const uint8_t* payload, size_t size, Clock::time_point arrival) {
+    bool comfort_noise = header.payload_type == RtpPacketizer::kComfortNoisePayloadType;
+    if (!decoder_ || (!comfort_noise && header.payload_type != RtpPacketizer::kAudioPayloadType)
+        || size > AudioEncoder::kMaxPacketBytes || (comfort_noise && size < 1)) {
+        return false;
+    }
+    packets_.fetch_add(1, std::memory_order_relaxed);
+
+    // Loss from the sequence numbers, per RFC 3550 A.3
+    int64_t arrival_units = std::chrono::duration_cast<std::chrono::microseconds>(
+        arrival.time_since_epoch()).count() * rate_ / 1000000;
+    if (!have_transit_ || header.ssrc != push_ssrc_) {
+        lost_before_ = lost_.load(std::memory_order_relaxed);
+        have_transit_ = true;
+        push_ssrc_ = header.ssrc;
+        base_sequence_ = extended_max_ = header.sequence;
+        stream_packets_ = 0;
+        jitter_ = 0.0;
+    } else {
+        // Interarrival jitter, per RFC 3550 A.8
+        double transit_change = double(arrival_units - last_arrival_)
+                                - timestamp_delta(header.timestamp, last_timestamp_);
+        jitter_ += (std::fabs(transit_change) - jitter_) / 16.0;
+    }
+    last_arrival_ = arrival_units;
+    last_timestamp_ = header.timestamp;
+    int64_t extended = extended_max_ + sequence_delta(header.sequence, static_cast<uint16_t>(extended_max_));
+    extended_max_ = std::max(extended_max_, extended);
+    base_sequence_ = std::min(base_sequence_, extended);
+    ++stream_packets_;
+    int64_t missing = extended_max_ - base_sequence_ + 1 - static_cast<int64_t>(stream_packets_);
+    lost_.store(lost_before_ + static_cast<uint64_t>(std::max<int64_t>(missing, 0)), std::memory_order_relaxed);
+    jitter_ms_.store(static_cast<float>(jitter_ * 1000.0 / rate_), std::memory_order_relaxed);
+
+    Packet* packet = queue_.write_slot();
+    if (!packet) {
+        overflows_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    packet->ssrc = header.ssrc;
+    packet->timestamp = header.timestamp;
+    packet->sequence = header.sequence;
+    packet->marker = header.marker;
+    packet->comfort_noise = comfort_noise;
+    packet->size = static_cast<uint16_t>(size);
+    std::memcpy(packet->data, payload, size);
+    queue_.publish();
+    return true;
+}
+
+void JitterBuffer::pull(float* out, unsigned int frames) {
+    if (!decoder_) {
+        std::fill(out, out + frames, 0.0f);
+        return;
+    }
+    while (const Packet* packet = queue_.read_slot()) {
+        accept(*packet);
+        queue_.release();
+    }
+    if (!started_) {
+        std::fill(out, out + frames, 0.0f);
+        return;
+    }
+
+    double frame_ms = 1000.0 * frame_ / rate_;
+    double target_ms = std::clamp(frame_ms + options_.jitter_factor * jitter_ms_.load(std::memory_order_relaxed),
+                                  double(options_.min_delay_ms), double(options_.max_delay_ms));
+    target_ = static_cast<int32_t>(target_ms * rate_ / 1000.0);
+
+    double step = double(rate_) / output_rate_;
+    for (unsigned int i = 0; i < frames; ++i) {
+        while (position_ >= frame_) {
+            position_ -= frame_;
+            next_frame();
+        }
+        size_t index = static_cast<size_t>(position_);
+        float fraction = static_cast<float>(position_ - index);
+        out[i] = pcm_[index] + (pcm_[index + 1] - pcm_[index]) * fraction;
+        position_ += step * (1.0 + stretch_);
+    }
+}
+
+void JitterBuffer::process(const float*, float* output, unsigned int frames) {
+    for (unsigned int offset = 0; offset < frames;) {
+        unsigned int piece = std::min<unsigned int>(frames - offset, static_cast<unsigned int>(mono_.size()));
+        pull(mono_.data(), piece);
+        float* stereo = output + 2 * offset;
+        for (unsigned int i = 0; i < piece; ++i) {
+            stereo[2 * i] += mono_[i];
+            stereo[2 * i + 1] += mono_[i];
+        }
+        offset += piece;
+    }
+}
+
+void JitterBuffer::accept(const Packet& packet) {
+    if (!started_ || packet.ssrc != ssrc_) {
+        restart(packet);
+    }
+    int delta = sequence_delta(packet.sequence, next_sequence_);
+    if (delta < 0) {
+        late_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    if (delta >= static_cast<int>(kWindow)) {
+        // Too far ahead to be reordering: the sender restarted or skipped
+        restart(packet);
+    }
+
+    Packet& held = window_[packet.sequence % kWindow];
+    if (held.filled) {
+        // Anything else in the slot would be a window away
+        duplicates_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    held.ssrc = packet.ssrc;
+    held.timestamp = packet.timestamp;
+    held.sequence = packet.sequence;
+    held.marker = packet.marker;
+    held.comfort_noise = packet.comfort_noise;
+    held.size = packet.size;
+    std::memcpy(held.data, packet.data, packet.size);
+    held.filled = true;
+
+    if (sequence_delta(packet.sequence, newest_sequence_) > 0) {
+        newest_sequence_ = packet.sequence;
+    }
+    uint32_t end = packet.timestamp + (packet.comfort_noise ? 0 : frame_);
+    if (timestamp_delta(end, end_timestamp_) > 0) {
+        end_timestamp_ = end;
+    }
+}
+
+void JitterBuffer::restart(const Packet& packet) {
+    if (started_) {
+        resyncs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    for (Packet& held : window_) {
+        held.filled = false;
+    }
+    started_ = true;
+    buffering_ = true;
+    silent_ = true;
+    ssrc_ = packet.ssrc;
+    next_sequence_ = newest_sequence_ = packet.sequence;
+    play_timestamp_ = end_timestamp_ = packet.timestamp;
+    missing_frames_ = 0;
+    noise_level_ = 0.0f;
+    smoothed_depth_ = target_;
+    stretch_ = 0.0;
+    std::fill(pcm_.begin(), pcm_.end(), 0.0f);
+    position_ = frame_;
+}
+
+JitterBuffer::Packet* JitterBuffer::slot(uint16_t sequence) {
+    Packet& held = window_[sequence % kWindow];
+    return held.filled && held.sequence == sequence ? &held : nullptr;
+}
+
+JitterBuffer::Packet* JitterBuffer::next_buffered() {
+    for (uint16_t sequence = next_sequence_ + 1; sequence_delta(newest_sequence_, sequence) >= 0; ++sequence) {
+        if (Packet* packet = slot(sequence)) {
+            return packet;
+        }
+    }
+    return nullptr;
+}
+
+int32_t JitterBuffer::depth() const {
+    return timestamp_delta(end_timestamp_, play_timestamp_);
+}
+
+void JitterBuffer::next_frame() {
+    pcm_[0] = pcm_[frame_];
+    depth_ms_.store(static_cast<float>(std::max(depth(), 0) * 1000.0 / rate_), std::memory_order_relaxed);
+    target_ms_.store(static_cast<float>(target_ * 1000.0 / rate_), std::memory_order_relaxed);
+
+    if (buffering_) {
+        if (depth() < target_) {
+            std::fill(pcm_.begin() + 1, pcm_.end(), 0.0f);
+            return;
+        }
+        buffering_ = false;
+    }
+
+    int32_t max_delay = static_cast<int32_t>(uint64_t(options_.max_delay_ms) * rate_ / 1000);
+    for (;;) {
+        Packet* packet = slot(next_sequence_);
+        if (!packet) {
+            Packet* later = next_buffered();
+            if (!later) {
+                if (silent_) {
+                    comfort_noise();
+                    play_timestamp_ += frame_;
+                } else {
+                    conceal(true);
+                }
+                return;
+            }
+            if (silent_ && (later->marker || later->comfort_noise)) {
+                // Lost comfort noise; nothing to play for it
+                next_sequence_ = later->sequence;
+                continue;
+            }
+            if (!silent_) {
+                // Missing mid-speech: rebuild it from the next packet if
+                // that follows on, else conceal it
+                bool follows = sequence_delta(later->sequence, next_sequence_) == 1 && !later->comfort_noise
+                               && timestamp_delta(later->timestamp, play_timestamp_) == static_cast<int32_t>(frame_);
+                if (follows && decoder_->decode_fec(later->data, later->size, pcm_.data() + 1) == frame_) {
+                    recovered_.fetch_add(1, std::memory_order_relaxed);
+                    missing_frames_ = 0;
+                } else {
+                    conceal(false);
+                }
+                ++next_sequence_;
+                play_timestamp_ += frame_;
+                update_stretch(depth() + static_cast<int32_t>(frame_));
+                return;
+            }
+            // The first frames of a spurt missing: wait for them until
+            // their time, judged from the later packet
+            int32_t ahead = timestamp_delta(later->timestamp, play_timestamp_)
+                            - sequence_delta(later->sequence, next_sequence_) * static_cast<int32_t>(frame_);
+            if (ahead > 0) {
+                comfort_noise();
+                play_timestamp_ += std::min<int32_t>(ahead, frame_);
+                return;
+            }
+            silent_ = false;
+            continue;
+        }
+
+        if (packet->comfort_noise) {
+            noise_level_ = comfort_noise_level(packet->data[0]);
+            silent_ = true;
+            packet->filled = false;
+            ++next_sequence_;
+            continue;
+        }
+
+        int32_t ahead = timestamp_delta(packet->timestamp, play_timestamp_);
+        if (silent_ || ahead > 0) {
+            // Between spurts: hold or skip silence until the next one is
+            // the target delay behind the newest audio
+            silent_ = true;
+            if (ahead < 0) {
+                play_timestamp_ = packet->timestamp;
+                ahead = 0;
+            }
+            int32_t excess = depth() - target_;
+            if (excess < 0) {
+                comfort_noise();
+                return;
+            }
+            int32_t skip = std::min(ahead, excess);
+            play_timestamp_ += skip;
+            ahead -= skip;
+            if (ahead > 0) {
+                comfort_noise();
+                play_timestamp_ += std::min<int32_t>(ahead, frame_);
+                return;
+            }
+            silent_ = false;
+        } else if (ahead < 0) {
+            play_timestamp_ = packet->timestamp;
+        }
+
+        int32_t buffered = depth();
+        packet->filled = false;
+        ++next_sequence_;
+        play_timestamp_ += frame_;
+        if (buffered - static_cast<int32_t>(frame_) > max_delay) {
+            discarded_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if (decoder_->decode(packet->data, packet->size, pcm_.data() + 1) == frame_) {
+            missing_frames_ = 0;
+        } else {
+            conceal(false);
+        }
+        update_stretch(buffered);
+        return;
+    }
+}
+
+void JitterBuffer::conceal(bool underrun) {
+    decoder_->decode(nullptr, 0, pcm_.data() + 1);
+    concealed_.fetch_add(1, std::memory_order_relaxed);
+    if (underrun) {
+        underruns_.fetch_add(1, std::memory_order_relaxed);
+        if (uint64_t(++missing_frames_) * frame_ * 1000 >= uint64_t(kMaxConcealMs) * rate_) {
+            silent_ = true;
+            noise_level_ = 0.0f;
+        }
+    }
+}
+
+void JitterBuffer::comfort_noise() {
+    // Uniform white noise with the packet's RMS
+    float amplitude = noise_level_ * 1.7320508f;
+    float* out = pcm_.data() + 1;
+    for (uint32_t i = 0; i < frame_; ++i) {
+        noise_seed_ = noise_seed_ * 1664525u + 1013904223u;
+        out[i] = amplitude * (static_cast<int32_t>(noise_seed_) * (1.0f / 2147483648.0f));
+    }
+}
+
+void JitterBuffer::update_stretch(int32_t depth) {
+    smoothed_depth_ += kDepthSmoothing * (depth - smoothed_depth_);
+    double error = (smoothed_depth_ - target_) / rate_;
+    stretch_ = std::clamp(kStretchGain * error, -options_.max_stretch, options_.max_stretch);
+    stretch_out_.store(static_cast<float>(stretch_), std::memory_order_relaxed);
+}
+
+JitterBuffer::Stats JitterBuffer::get_stats() const {
+    Stats stats;
+    stats.packets = packets_.load(std::memory_order_relaxed);
+    stats.lost = lost_.load(std::memory_order_relaxed);
+    stats.late = late_.load(std::memory_order_relaxed);
+    stats.duplicates = duplicates_.load(std::memory_order_relaxed);
+    stats.overflows = overflows_.load(std::memory_order_relaxed);
+    stats.recovered = recovered_.load(std::memory_order_relaxed);
+    stats.concealed = concealed_.load(std::memory_order_relaxed);
+    stats.underruns = underruns_.load(std::memory_order_relaxed);
+    stats.discarded = discarded_.load(std::memory_order_relaxed);
+    stats.resyncs = resyncs_.load(std::memory_order_relaxed);
+    stats.jitter_ms = jitter_ms_.load(std::memory_order_relaxed);
+    stats.depth_ms = depth_ms_.load(std::memory_order_relaxed);
+    stats.target_ms = target_ms_.load(std::memory_order_relaxed);
+    stats.stretch = stretch_out_.load(std::memory_order_relaxed);
+    return stats;
+}
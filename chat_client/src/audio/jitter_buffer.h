@@ -0,0 +1,173 @@
+#pragma once
+
+#include "audio_codec.h"
+#include "processor_graph.h"
+#include "../network/rtp.h"
+#include "../utils/spsc_ring_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Receive side of a voice stream: RTP packets in from the network thread,
+// decoded audio out at the device rate on the audio thread.
+//
+// push() hands each packet to the audio thread through a wait-free ring
+// and keeps the interarrival jitter (RFC 3550) and loss counts. The audio
+// thread reorders packets by sequence number and plays each frame when
+// its time comes, about target delay behind the newest audio received. A
+// frame missing at its time is rebuilt from the next packet's FEC when
+// that is here, else concealed by the decoder; one that turns up later is
+// counted late and dropped. Comfort noise packets are played as noise at
+// their level until the next talk spurt.
+//
+// The target delay is one frame plus jitter_factor times the jitter,
+// within min_delay_ms and max_delay_ms. The buffer reaches it by stretching
+// or skipping the silence between talk spurts, and during speech by
+// playing up to max_stretch faster or slower, which also absorbs drift
+// between the sender's clock and the sound card's. Running dry mid-speech
+// conceals and holds playout, so the delay grows by what was missing.
+//
+// Nothing is allocated after construction; pull() and process() are safe
+// on the audio thread, push() on one network thread.
+class JitterBuffer : public AudioProcessor {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr size_t kWindow = 64;  // Packets held for reordering
+
+    struct Options {
+        // Lower bound on the target delay. A frame's worth is the least
+        // that works; lower it towards that on quiet networks for less
+        // mouth-to-ear latency.
+        unsigned min_delay_ms = 40;
+        unsigned max_delay_ms = 300;
+        // Jitter multiples to buffer for; lower trades late packets for
+        // latency
+        double jitter_factor = 3.0;
+        // Largest playout rate correction, as a fraction of real time
+        double max_stretch = 0.01;
+        size_t queue_packets = 64;  // Between push() and the audio thread
+    };
+
+    struct Stats {
+        uint64_t packets = 0;     // Received
+        uint64_t lost = 0;        // Sent but never received, from the sequence numbers
+        uint64_t late = 0;        // Received after their time to play, or from behind the window
+        uint64_t duplicates = 0;
+        uint64_t overflows = 0;   // Dropped because the audio thread fell behind
+        uint64_t recovered = 0;   // Missing frames rebuilt from FEC
+        uint64_t concealed = 0;   // Missing frames concealed
+        uint64_t underruns = 0;   // Concealed frames with nothing buffered at all
+        uint64_t discarded = 0;   // Frames skipped to get back under max_delay_ms
+        uint64_t resyncs = 0;     // Restarts on a new stream or a sequence jump
+        float jitter_ms = 0.0f;
+        float depth_ms = 0.0f;    // Audio buffered ahead of playout
+        float target_ms = 0.0f;
+        float stretch = 0.0f;     // Playout rate correction; 0.01 plays 1% fast
+    };
+
+    // Decodes packets from an encoder made with the same settings; plays at
+    // output_rate. valid() is false if the codec cannot be set up.
+    JitterBuffer(const CodecSettings& settings, unsigned output_rate);
+    JitterBuffer(const CodecSettings& settings, unsigned output_rate, const Options& options);
+
+    JitterBuffer(const JitterBuffer&) = delete;
+    JitterBuffer& operator=(const JitterBuffer&) = delete;
+
+    bool valid() const { return decoder_ != nullptr; }
+    unsigned sample_rate() const { return rate_; }  // Of the RTP timestamps
+    unsigned output_rate() const { return output_rate_; }
+
+    // Network thread. False if the packet was dropped on the way in.
+    bool push(const RtpHeader& header, const uint8_t* payload, size_t size);
+    bool push(const RtpHeader& header, const uint8_t* payload, size_t size, Clock::time_point arrival);
+
+    // Audio thread: the next frames of mono playout
+    void pull(float* out, unsigned int frames);
+    // Audio thread: adds the playout to both channels of output, as the
+    // engine's playback source
+    void process(const float* input, float* output, unsigned int frames) override;
+
+    Stats get_stats() const;
+
+private:
+    struct Packet {
+        uint32_t ssrc = 0;
+        uint32_t timestamp = 0;
+        uint16_t sequence = 0;
+        bool marker = false;
+        bool comfort_noise = false;
+        bool filled = false;  // In the window: waiting to play
+        uint16_t size = 0;
+        uint8_t data[AudioEncoder::kMaxPacketBytes];
+    };
+
+    // Audio thread
+    void accept(const Packet& packet);
+    void restart(const Packet& packet);
+    Packet* slot(uint16_t sequence);
+    Packet* next_buffered();
+    void next_frame();
+    bool decode(Packet* packet);
+    void conceal(bool underrun);
+    void comfort_noise();
+    void update_stretch(int32_t depth);
+    int32_t depth() const;
+
+    Options options_;
+    std::unique_ptr<AudioDecoder> decoder_;
+    unsigned rate_ = 0;
+    unsigned output_rate_;
+    uint32_t frame_ = 0;  // Samples per packet
+    SpscRingBuffer<Packet> queue_;
+
+    // Network thread
+    bool have_transit_ = false;
+    uint32_t push_ssrc_ = 0;
+    int64_t last_arrival_ = 0;     // In timestamp units
+    uint32_t last_timestamp_ = 0;
+    double jitter_ = 0.0;          // In timestamp units
+    int64_t base_sequence_ = 0;    // Extended over wraps
+    int64_t extended_max_ = 0;
+    uint64_t stream_packets_ = 0;
+    uint64_t lost_before_ = 0;  // From earlier streams
+
+    // Audio thread
+    std::vector<Packet> window_;
+    bool started_ = false;
+    bool buffering_ = true;  // Waiting for the target delay before playing
+    bool silent_ = true;     // Between talk spurts
+    uint32_t ssrc_ = 0;
+    uint16_t next_sequence_ = 0;
+    uint16_t newest_sequence_ = 0;
+    uint32_t play_timestamp_ = 0;  // Of the next frame to play
+    uint32_t end_timestamp_ = 0;   // End of the newest audio received
+    int32_t target_ = 0;           // In timestamp units
+    unsigned missing_frames_ = 0;  // Concealed in a row
+    float noise_level_ = 0.0f;
+    uint32_t noise_seed_ = 22222;
+    double smoothed_depth_ = 0.0;
+    double stretch_ = 0.0;
+    std::vector<float> pcm_;  // The previous frame's last sample, then the current frame
+    double position_ = 0.0;   // Playout position in the current frame
+    std::vector<float> mono_; // process() scratch
+
+    std::atomic<uint64_t> packets_{0};
+    std::atomic<uint64_t> lost_{0};
+    std::atomic<uint64_t> late_{0};
+    std::atomic<uint64_t> duplicates_{0};
+    std::atomic<uint64_t> overflows_{0};
+    std::atomic<uint64_t> recovered_{0};
+    std::atomic<uint64_t> concealed_{0};
+    std::atomic<uint64_t> underruns_{0};
+    std::atomic<uint64_t> discarded_{0};
+    std::atomic<uint64_t> resyncs_{0};
+    std::atomic<float> jitter_ms_{0.0f};
+    std::atomic<float> depth_ms_{0.0f};
+    std::atomic<float> target_ms_{0.0f};
+    std::atomic<float> stretch_out_{0.0f};
+};
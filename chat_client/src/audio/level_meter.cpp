@@ -0,0 +1,82 @@
+#include "level_meter.h"
+
+#include <algorithm>
+#include <cmath>
+
+void LevelMeter::configure(unsigned int sample_rate) {
+    hold_frames_ = static_cast<uint64_t>(sample_rate) * kHoldMs / 1000;
+    decay_per_frame_ = sample_rate ? std::pow(10.0, -kHoldDecayDb / 20.0 / sample_rate) : 1.0;
+    hold_ = 0.0f;
+    hold_left_ = 0;
+    hold_published_.store(hold_, std::memory_order_relaxed);
+}
+
+void LevelMeter::add(float peak, float sum_squares, unsigned int frames) {
+    uint32_t requested = requested_.load(std::memory_order_acquire);
+    if (requested != generation_) {
+        uint32_t sequence = sequence_.load(std::memory_order_relaxed);
+        sequence_.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        published_generation_.store(requested, std::memory_order_relaxed);
+        closed_peak_.store(window_.peak, std::memory_order_relaxed);
+        closed_sum_squares_.store(window_.sum_squares, std::memory_order_relaxed);
+        closed_frames_.store(window_.frames, std::memory_order_relaxed);
+        sequence_.store(sequence + 2, std::memory_order_release);
+        window_ = Window();
+        generation_ = requested;
+    }
+    window_.peak = std::max(window_.peak, peak);
+    window_.sum_squares += sum_squares;
+    window_.frames += frames;
+
+    if (peak >= hold_) {
+        hold_ = peak;
+        hold_left_ = hold_frames_;
+    } else if (hold_left_ > frames) {
+        hold_left_ -= frames;
+    } else {
+        hold_left_ = 0;
+        hold_ = static_cast<float>(hold_ * std::pow(decay_per_frame_, frames));
+    }
+    hold_published_.store(hold_, std::memory_order_relaxed);
+}
+
+LevelMeter::Reading LevelMeter::take() {
+    uint32_t generation;
+    Window closed;
+    for (;;) {
+        uint32_t sequence = sequence_.load(std::memory_order_acquire);
+        generation = published_generation_.load(std::memory_order_relaxed);
+        closed.peak = closed_peak_.load(std::memory_order_relaxed);
+        closed.sum_squares = closed_sum_squares_.load(std::memory_order_relaxed);
+        closed.frames = closed_frames_.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!(sequence & 1) && sequence_.load(std::memory_order_relaxed) == sequence) {
+            break;
+        }
+    }
+
+    Reading reading;
+    reading.peak_hold = hold_published_.load(std::memory_order_relaxed);
+    // Until the audio thread opens the window asked for last time, the one
+    // before it is still open
+    if (generation != read_generation_) {
+        return reading;
+    }
+    read_generation_ = generation + 1;
+    requested_.store(read_generation_, std::memory_order_release);
+
+    if (closed.frames) {
+        reading.frames = closed.frames;
+        reading.peak = closed.peak;
+        reading.rms = static_cast<float>(std::sqrt(closed.sum_squares / static_cast<double>(closed.frames)));
+    }
+    return reading;
+}
+
+float LevelMeter::to_db(float level) {
+    if (level <= 0.0f) {
+        return kFloorDb;
+    }
+    return std::max(kFloorDb, 20.0f * std::log10(level));
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Peak, RMS and peak-hold of one signal, measured by the audio thread over
+// every frame and read by the UI at whatever rate it redraws.
+//
+// The audio thread adds each block's peak and sum of squares to an open
+// window. Each take() asks for the window to be closed, which the audio
+// thread does at its next block, and returns the one closed since the take()
+// before. Closed windows are published through a seqlock: a sequence number
+// that is odd while the fields change, around plain relaxed atomics. The
+// reader retries if the number moved, so the audio thread never waits on it.
+//
+// Every block lands in exactly one reading, however far apart the reads
+// are, and each reading's peak is exact. The price is that a reading is one
+// read behind: it ends at the first block after the previous take().
+class LevelMeter {
+public:
+    // The hold keeps the highest peak this long, then falls at kHoldDecayDb
+    // a second
+    static constexpr unsigned int kHoldMs = 1500;
+    static constexpr float kHoldDecayDb = 20.0f;
+    // Below this, levels read as silence
+    static constexpr float kFloorDb = -60.0f;
+
+    struct Reading {
+        float peak = 0.0f;       // Largest |sample| in the window
+        float rms = 0.0f;        // Over the same frames
+        float peak_hold = 0.0f;  // As of the latest block
+        uint64_t frames = 0;     // In the window; none while stopped
+    };
+
+    LevelMeter() = default;
+    LevelMeter(const LevelMeter&) = delete;
+    LevelMeter& operator=(const LevelMeter&) = delete;
+
+    // Sizes the hold for the rate and drops it. Call with the stream stopped.
+    void configure(unsigned int sample_rate);
+
+    // Audio thread. A block of frames with its largest |sample| and sum of
+    // squares. Never blocks.
+    void add(float peak, float sum_squares, unsigned int frames);
+
+    // One reader thread, usually the UI. The window closed since the last
+    // take(), and asks for the next.
+    Reading take();
+
+    // 20 log10(level), clamped to kFloorDb
+    static float to_db(float level);
+
+private:
+    // Audio thread only
+    struct Window {
+        float peak = 0.0f;
+        double sum_squares = 0.0;
+        uint64_t frames = 0;
+    };
+    uint32_t generation_ = 0;
+    Window window_;
+    float hold_ = 0.0f;
+    uint64_t hold_left_ = 0;
+    uint64_t hold_frames_ = 0;
+    double decay_per_frame_ = 1.0;
+
+    // Published: the last window closed, and the generation opened after
+    // it, under sequence_
+    std::atomic<uint32_t> sequence_{0};
+    std::atomic<uint32_t> published_generation_{0};
+    std::atomic<float> closed_peak_{0.0f};
+    std::atomic<double> closed_sum_squares_{0.0};
+    std::atomic<uint64_t> closed_frames_{0};
+    std::atomic<float> hold_published_{0.0f};
+
+    // The generation the reader wants open next
+    std::atomic<uint32_t> requested_{0};
+    // Reader only
+    uint32_t read_generation_ = 0;
+};
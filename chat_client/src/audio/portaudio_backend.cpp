@@ -0,0 +1,717 @@
+#include "portaudio_backend.h"
+#include <portaudio.h>
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+namespace {
+
+constexpr unsigned long kXrunFlags =
+    paInputUnderflow | paInputOverflow | paOutputUnderflow | paOutputOverflow;
+
+// Low-latency negotiation: the first callbacks after a start may report
+// priming underruns, so xruns are only counted after a warm-up.
+constexpr auto kSettleWarmup = std::chrono::milliseconds(50);
+constexpr auto kSettleTime = std::chrono::milliseconds(200);
+constexpr auto kSuperviseInterval = std::chrono::milliseconds(1000);
+constexpr auto kSupervisePoll = std::chrono::milliseconds(50);
+constexpr uint64_t kMaxXrunsPerInterval = 3;
+// A switch forces the handover if the old stream stops calling back
+constexpr auto kHandoverTimeout = std::chrono::milliseconds(500);
+constexpr auto kHandoverPoll = std::chrono::milliseconds(1);
+
+// Rates tried in get_devices(), with the device's own; it offers those the
+// host accepts
+constexpr int kStandardSampleRates[] = { 8000, 16000, 22050, 32000, 44100, 48000, 88200, 96000 };
+
+bool contains_nocase(const char* text, const char* needle) {
+    std::string haystack(text ? text : "");
+    std::transform(haystack.begin(), haystack.end(), haystack.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return haystack.find(needle) != std::string::npos;
+}
+
+// PipeWire and PulseAudio are reached through ALSA plugin devices named
+// after them; newer PortAudio builds also have a native PulseAudio host API.
+AudioEngine::Backend classify(const PaHostApiInfo* host_api, const PaDeviceInfo* device) {
+    if (host_api->type == paJACK) {
+        return AudioEngine::Backend::JACK;
+    }
+    if (contains_nocase(host_api->name, "pulse")) {
+        return AudioEngine::Backend::PULSEAUDIO;
+    }
+    if (device && contains_nocase(device->name, "pipewire")) {
+        return AudioEngine::Backend::PIPEWIRE;
+    }
+    if (device && contains_nocase(device->name, "pulse")) {
+        return AudioEngine::Backend::PULSEAUDIO;
+    }
+    return AudioEngine::Backend::ALSA;
+}
+
+void fill_parameters(PaStreamParameters& params, int device_id, int channels, double latency) {
+    params = {};
+    params.device = device_id;
+    params.channelCount = channels;
+    params.sampleFormat = paFloat32;
+    params.suggestedLatency = latency;
+    params.hostApiSpecificStreamInfo = nullptr;
+}
+
+} // namespace
+
+PortAudioBackend::PortAudioBackend(AudioEngine& engine)
+    : AudioBackend(engine), initialized_(false), has_preference_(false),
+      preferred_(AudioEngine::Backend::ALSA), selected_(AudioEngine::Backend::ALSA) {
+}
+
+PortAudioBackend::PortAudioBackend(AudioEngine& engine, AudioEngine::Backend preferred)
+    : PortAudioBackend(engine) {
+    has_preference_ = true;
+    preferred_ = preferred;
+}
+
+PortAudioBackend::~PortAudioBackend() {
+    close();
+    if (initialized_) {
+        Pa_Terminate();
+    }
+}
+
+bool PortAudioBackend::initialize() {
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+        std::cerr << "PortAudio initialization error: " << Pa_GetErrorText(err) << std::endl;
+        return false;
+    }
+    initialized_ = true;
+
+    rank_host_apis();
+
+    auto usable = [](const AudioEngine::HostApi& api) { return api.round_trip_latency >= 0.0; };
+    auto chosen = std::find_if(host_apis_.begin(), host_apis_.end(),
+                               [this, &usable](const AudioEngine::HostApi& api) {
+                                   return has_preference_ && api.backend == preferred_ && usable(api);
+                               });
+    if (chosen == host_apis_.end()) {
+        chosen = std::find_if(host_apis_.begin(), host_apis_.end(), usable);
+        if (has_preference_ && chosen != host_apis_.end()) {
+            std::cerr << "Requested audio host API not available, using " << chosen->name << std::endl;
+        }
+    }
+
+    if (chosen != host_apis_.end()) {
+        selected_ = chosen->backend;
+    } else {
+        std::cerr << "Warning: no usable audio host API found" << std::endl;
+    }
+    return true;
+}
+
+void PortAudioBackend::rank_host_apis() {
+    host_apis_.clear();
+
+    auto add = [this](AudioEngine::Backend backend, const char* name, int device_id) {
+        if (device_id == paNoDevice) {
+            return;
+        }
+        for (const auto& api : host_apis_) {
+            if (api.backend == backend) {
+                return;
+            }
+        }
+        AudioEngine::HostApi api;
+        api.backend = backend;
+        api.name = name;
+        api.device_id = device_id;
+        api.round_trip_latency = probe_round_trip_latency(device_id);
+        host_apis_.push_back(api);
+    };
+
+    PaHostApiIndex count = Pa_GetHostApiCount();
+    for (PaHostApiIndex i = 0; i < count; ++i) {
+        const PaHostApiInfo* host_api = Pa_GetHostApiInfo(i);
+        if (!host_api) {
+            continue;
+        }
+        if (host_api->type == paALSA) {
+            for (int d = 0; d < host_api->deviceCount; ++d) {
+                PaDeviceIndex device_id = Pa_HostApiDeviceIndexToDeviceIndex(i, d);
+                const PaDeviceInfo* device = Pa_GetDeviceInfo(device_id);
+                if (!device || device->maxOutputChannels == 0) {
+                    continue;
+                }
+                AudioEngine::Backend backend = classify(host_api, device);
+                if (backend != AudioEngine::Backend::ALSA) {
+                    add(backend, host_api->name, device_id);
+                }
+            }
+            add(AudioEngine::Backend::ALSA, host_api->name, host_api->defaultOutputDevice);
+        } else if (host_api->type == paJACK || contains_nocase(host_api->name, "pulse")) {
+            add(classify(host_api, nullptr), host_api->name, host_api->defaultOutputDevice);
+        }
+    }
+
+    // Lowest latency first, host APIs that failed to open last
+    std::stable_sort(host_apis_.begin(), host_apis_.end(),
+                     [](const AudioEngine::HostApi& a, const AudioEngine::HostApi& b) {
+                         if ((a.round_trip_latency < 0.0) != (b.round_trip_latency < 0.0)) {
+                             return b.round_trip_latency < 0.0;
+                         }
+                         return a.round_trip_latency < b.round_trip_latency;
+                     });
+}
+
+// Opens (without starting) a low-latency duplex stream and reads back the
+// latency the host actually granted, which is usually well above the
+// device's advertised defaults for sound servers. Output-only devices count
+// their output latency twice so they do not outrank duplex ones.
+double PortAudioBackend::probe_round_trip_latency(int device_id) {
+    const PaDeviceInfo* device = Pa_GetDeviceInfo(device_id);
+    if (!device || device->maxOutputChannels == 0) {
+        return -1.0;
+    }
+
+    bool duplex = device->maxInputChannels > 0;
+    PaStreamParameters input_params;
+    PaStreamParameters output_params;
+    fill_parameters(input_params, device_id, 1, device->defaultLowInputLatency);
+    fill_parameters(output_params, device_id, std::min(device->maxOutputChannels, 2),
+                    device->defaultLowOutputLatency);
+
+    PaStream* probe = nullptr;
+    PaError err = Pa_OpenStream(&probe, duplex ? &input_params : nullptr, &output_params,
+                                device->defaultSampleRate, paFramesPerBufferUnspecified,
+                                paClipOff, nullptr, nullptr);
+    if (err != paNoError) {
+        return -1.0;
+    }
+
+    double latency = -1.0;
+    const PaStreamInfo* info = Pa_GetStreamInfo(probe);
+    if (info) {
+        latency = (duplex ? info->inputLatency : info->outputLatency) + info->outputLatency;
+    }
+    Pa_CloseStream(probe);
+    return latency;
+}
+
+AudioEngine::Backend PortAudioBackend::backend_for_device(int device_id) const {
+    const PaDeviceInfo* device = Pa_GetDeviceInfo(device_id);
+    const PaHostApiInfo* host_api = device ? Pa_GetHostApiInfo(device->hostApi) : nullptr;
+    if (!host_api) {
+        return selected_;
+    }
+    return classify(host_api, device);
+}
+
+std::vector<AudioEngine::AudioDevice> PortAudioBackend::get_devices() {
+    std::vector<AudioEngine::AudioDevice> devices;
+
+    int num_devices = Pa_GetDeviceCount();
+    if (num_devices < 0) {
+        std::cerr << "PortAudio error: " << Pa_GetErrorText(num_devices) << std::endl;
+        return devices;
+    }
+
+    const PaDeviceInfo* device_info;
+    for (int i = 0; i < num_devices; ++i) {
+        device_info = Pa_GetDeviceInfo(i);
+        if (device_info) {
+            AudioEngine::AudioDevice device;
+            device.id = i;
+            device.name = device_info->name;
+            device.max_input_channels = device_info->maxInputChannels;
+            device.max_output_channels = device_info->maxOutputChannels;
+
+            device.native_sample_rate = static_cast<int>(device_info->defaultSampleRate);
+
+            // Ask the host which rates the device really accepts in the
+            // layout the engine opens it with
+            PaStreamParameters input_params;
+            PaStreamParameters output_params;
+            fill_parameters(input_params, i, std::min(device_info->maxInputChannels, 1),
+                            device_info->defaultLowInputLatency);
+            fill_parameters(output_params, i, std::min(device_info->maxOutputChannels, 2),
+                            device_info->defaultLowOutputLatency);
+            std::vector<int> rates(std::begin(kStandardSampleRates), std::end(kStandardSampleRates));
+            if (device.native_sample_rate > 0 &&
+                std::find(rates.begin(), rates.end(), device.native_sample_rate) == rates.end()) {
+                rates.insert(std::upper_bound(rates.begin(), rates.end(), device.native_sample_rate),
+                             device.native_sample_rate);
+            }
+            for (int rate : rates) {
+                if (device_info->maxInputChannels == 0 && device_info->maxOutputChannels == 0) {
+                    break;
+                }
+                PaError supported = Pa_IsFormatSupported(
+                    device_info->maxInputChannels > 0 ? &input_params : nullptr,
+                    device_info->maxOutputChannels > 0 ? &output_params : nullptr, rate);
+                if (supported == paFormatIsSupported) {
+                    device.sample_rates.push_back(rate);
+                }
+            }
+
+            device.is_default = (i == Pa_GetDefaultInputDevice() ||
+                               i == Pa_GetDefaultOutputDevice());
+
+            devices.push_back(device);
+        }
+    }
+
+    return devices;
+}
+
+bool PortAudioBackend::prepare(Stream& stream, const AudioEngine::StreamConfig& config) {
+    stream.backend = this;
+    stream.config = config;
+    if (stream.config.device_id < 0) {
+        stream.config.device_id = Pa_GetDefaultOutputDevice();
+        for (const auto& api : host_apis_) {
+            if (api.backend == selected_) {
+                stream.config.device_id = api.device_id;
+                break;
+            }
+        }
+    }
+
+    const PaDeviceInfo* device_info = Pa_GetDeviceInfo(stream.config.device_id);
+    if (!device_info) {
+        std::cerr << "Invalid audio device: " << stream.config.device_id << std::endl;
+        return false;
+    }
+    if (stream.config.sample_rate == 0) {
+        stream.config.sample_rate = static_cast<unsigned int>(device_info->defaultSampleRate);
+    }
+
+    // The engine works in mono in, stereo out; other layouts are adapted in
+    // the callback.
+    stream.input_channels = std::min(device_info->maxInputChannels, 1);
+    stream.output_channels = std::min(device_info->maxOutputChannels, 2);
+    if (stream.output_channels == 0) {
+        std::cerr << "Audio device has no outputs: " << device_info->name << std::endl;
+        return false;
+    }
+
+    size_t scratch_frames = std::max<size_t>(stream.config.frames_per_buffer,
+                                             std::end(kLowLatencyFrames)[-1]);
+    stream.silent_input.assign(scratch_frames, 0.0f);
+    stream.stereo_scratch.assign(scratch_frames * 2, 0.0f);
+    stream.host_backend = backend_for_device(stream.config.device_id);
+    stream.handover.channels = static_cast<unsigned int>(stream.output_channels);
+    stream.handover.fade_frames = std::max(1u, stream.config.sample_rate * kCrossfadeMs / 1000);
+    return true;
+}
+
+bool PortAudioBackend::open(const AudioEngine::StreamConfig& config) {
+    std::lock_guard<std::mutex> switching(switch_mutex_);
+    close_current(); // Close any existing stream
+
+    auto stream = std::make_unique<Stream>();
+    low_latency_ = config.low_latency;
+    if (!prepare(*stream, config)) {
+        return false;
+    }
+    xruns_.store(0);
+    fallbacks_.store(0);
+
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    bool opened = config.low_latency ? settle_low_latency(*stream)
+                                     : open_stream(*stream, stream->config.frames_per_buffer);
+    if (!opened) {
+        return false;
+    }
+    stream_ = std::move(stream);
+    handover_.set_owner(&stream_->handover);
+    return true;
+}
+
+bool PortAudioBackend::open_stream(Stream& stream, unsigned int frames_per_buffer) {
+    const PaDeviceInfo* device_info = Pa_GetDeviceInfo(stream.config.device_id);
+    if (!device_info) {
+        return false;
+    }
+
+    // The low-latency profile asks the host for two buffers of latency
+    double buffer_time = static_cast<double>(frames_per_buffer) / stream.config.sample_rate;
+    double input_latency = stream.config.low_latency ? 2.0 * buffer_time : device_info->defaultLowInputLatency;
+    double output_latency = stream.config.low_latency ? 2.0 * buffer_time : device_info->defaultLowOutputLatency;
+
+    PaStreamParameters input_params;
+    PaStreamParameters output_params;
+    fill_parameters(input_params, stream.config.device_id, stream.input_channels, input_latency);
+    fill_parameters(output_params, stream.config.device_id, stream.output_channels, output_latency);
+
+    PaError err = Pa_OpenStream(
+        &stream.handle,
+        stream.input_channels > 0 ? &input_params : nullptr,
+        &output_params,
+        stream.config.sample_rate,
+        frames_per_buffer,
+        paClipOff,
+        pa_audio_callback,
+        &stream
+    );
+
+    if (err != paNoError) {
+        std::cerr << "Failed to open audio stream: " << Pa_GetErrorText(err) << std::endl;
+        stream.handle = nullptr;
+        return false;
+    }
+
+    stream.frames_per_buffer = frames_per_buffer;
+    const PaStreamInfo* info = Pa_GetStreamInfo(stream.handle);
+    stream.input_latency = info ? info->inputLatency : 0.0;
+    stream.output_latency = info ? info->outputLatency : 0.0;
+    return true;
+}
+
+void PortAudioBackend::close_stream(Stream& stream) {
+    if (stream.handle) {
+        if (Pa_IsStreamActive(stream.handle) == 1) {
+            Pa_StopStream(stream.handle);
+        }
+        Pa_CloseStream(stream.handle);
+        stream.handle = nullptr;
+    }
+}
+
+// Tries each buffer size from the smallest up, running the stream briefly
+// with silent output, and keeps the first that produces no xruns. Called
+// with stream_mutex_ held.
+bool PortAudioBackend::settle_low_latency(Stream& stream) {
+    probing_.store(true);
+    for (unsigned int frames : kLowLatencyFrames) {
+        if (!open_stream(stream, frames)) {
+            continue;
+        }
+        if (Pa_StartStream(stream.handle) == paNoError) {
+            std::this_thread::sleep_for(kSettleWarmup);
+            uint64_t before = xruns_.load();
+            std::this_thread::sleep_for(kSettleTime);
+            bool stable = xruns_.load() == before;
+            Pa_StopStream(stream.handle);
+            if (stable) {
+                probing_.store(false);
+                xruns_.store(0);
+                return true;
+            }
+        }
+        close_stream(stream);
+    }
+    probing_.store(false);
+    xruns_.store(0);
+
+    std::cerr << "No stable low-latency buffer size, using " << stream.config.frames_per_buffer
+              << " frames" << std::endl;
+    return open_stream(stream, stream.config.frames_per_buffer);
+}
+
+bool PortAudioBackend::start() {
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        if (!stream_) {
+            return false;
+        }
+
+        PaError err = Pa_StartStream(stream_->handle);
+        if (err != paNoError) {
+            std::cerr << "Failed to start audio stream: " << Pa_GetErrorText(err) << std::endl;
+            return false;
+        }
+    }
+
+    if (low_latency_ && !supervisor_.joinable()) {
+        supervising_.store(true);
+        supervisor_ = std::thread(&PortAudioBackend::supervise, this);
+    }
+    return true;
+}
+
+// Steps up to the next buffer size when xruns keep occurring. Runs off the
+// real-time thread; reopening drops a few buffers of audio.
+void PortAudioBackend::supervise() {
+    uint64_t last_xruns = xruns_.load();
+    auto window_start = std::chrono::steady_clock::now();
+
+    while (supervising_.load()) {
+        std::this_thread::sleep_for(kSupervisePoll);
+        if (std::chrono::steady_clock::now() - window_start < kSuperviseInterval) {
+            continue;
+        }
+        window_start = std::chrono::steady_clock::now();
+
+        uint64_t xruns = xruns_.load();
+        uint64_t recent = xruns - last_xruns;
+        last_xruns = xruns;
+        if (recent < kMaxXrunsPerInterval) {
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        if (!stream_) {
+            continue;
+        }
+        const unsigned int* next = std::upper_bound(std::begin(kLowLatencyFrames),
+                                                    std::end(kLowLatencyFrames), stream_->frames_per_buffer);
+        if (next == std::end(kLowLatencyFrames)) {
+            continue; // Already at the largest size
+        }
+
+        unsigned int previous = stream_->frames_per_buffer;
+        close_stream(*stream_);
+        if (!open_stream(*stream_, *next) || Pa_StartStream(stream_->handle) != paNoError) {
+            std::cerr << "Failed to reopen audio stream at " << *next << " frames" << std::endl;
+            close_stream(*stream_);
+            supervising_.store(false);
+            return;
+        }
+        fallbacks_.fetch_add(1);
+        std::cerr << recent << " audio xruns at " << previous << " frames, increased buffer to "
+                  << *next << " frames" << std::endl;
+    }
+}
+
+void PortAudioBackend::stop_supervisor() {
+    supervising_.store(false);
+    if (supervisor_.joinable()) {
+        supervisor_.join();
+    }
+}
+
+void PortAudioBackend::close() {
+    std::lock_guard<std::mutex> switching(switch_mutex_);
+    close_current();
+}
+
+void PortAudioBackend::close_current() {
+    stop_supervisor();
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    if (stream_) {
+        close_stream(*stream_);
+        stream_.reset();
+    }
+    handover_.set_owner(nullptr);
+}
+
+bool PortAudioBackend::is_active() const {
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    return stream_ && stream_->handle && Pa_IsStreamActive(stream_->handle) == 1;
+}
+
+// The new stream runs at the old one's rate and buffer size, so nothing
+// the engine was configured for changes; a device that cannot is refused.
+//
+// Only switch_mutex_ is held while the new stream opens and takes over;
+// nothing else replaces or closes stream_ meanwhile, so it is used without
+// stream_mutex_, which is taken only to read it and to publish the new one.
+bool PortAudioBackend::switch_stream(const AudioEngine::StreamConfig& config) {
+    std::unique_lock<std::mutex> switching(switch_mutex_);
+    // The supervisor reopens streams under the lock; it restarts below
+    stop_supervisor();
+    auto resume_supervisor = [this] {
+        if (low_latency_) {
+            supervising_.store(true);
+            supervisor_ = std::thread(&PortAudioBackend::supervise, this);
+        }
+    };
+
+    AudioEngine::StreamConfig next_config = config;
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        if (!stream_ || !stream_->handle || Pa_IsStreamActive(stream_->handle) != 1) {
+            return false;
+        }
+        next_config.sample_rate = stream_->config.sample_rate;
+        next_config.frames_per_buffer = stream_->frames_per_buffer;
+        next_config.low_latency = stream_->config.low_latency;
+    }
+
+    auto next = std::make_unique<Stream>();
+    bool ready = prepare(*next, next_config);
+    if (ready) {
+        const PaDeviceInfo* device_info = Pa_GetDeviceInfo(next->config.device_id);
+        PaStreamParameters input_params;
+        PaStreamParameters output_params;
+        fill_parameters(input_params, next->config.device_id, next->input_channels,
+                        device_info->defaultLowInputLatency);
+        fill_parameters(output_params, next->config.device_id, next->output_channels,
+                        device_info->defaultLowOutputLatency);
+        ready = Pa_IsFormatSupported(next->input_channels > 0 ? &input_params : nullptr, &output_params,
+                                     next->config.sample_rate) == paFormatIsSupported;
+    }
+    // Silent until the old stream starts the crossfade
+    ready = ready && open_stream(*next, next_config.frames_per_buffer);
+    if (ready && Pa_StartStream(next->handle) != paNoError) {
+        close_stream(*next);
+        ready = false;
+    }
+    if (!ready) {
+        resume_supervisor();
+        return false;
+    }
+
+    handover_.begin(next->handover, std::end(kLowLatencyFrames)[-1]);
+    auto deadline = std::chrono::steady_clock::now() + kHandoverTimeout;
+    while (!handover_.handed_over(next->handover) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(kHandoverPoll);
+    }
+    // The old stream has stopped calling back, as when its device is
+    // unplugged; once it is stopped it cannot, so the engine is free
+    if (!handover_.handed_over(next->handover)) {
+        Pa_AbortStream(stream_->handle);
+        handover_.force(next->handover);
+    }
+    handover_.end();
+    std::unique_ptr<Stream> previous;
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        previous = std::move(stream_);
+        stream_ = std::move(next);
+    }
+    // No longer reachable from the stats, and silent since the handover
+    close_stream(*previous);
+
+    resume_supervisor();
+    return true;
+}
+
+// Only while no stream runs: Pa_Terminate closes every stream. An open,
+// stopped stream is closed and reopened on its device, found again by
+// name, as the indices change.
+bool PortAudioBackend::rescan() {
+    std::lock_guard<std::mutex> switching(switch_mutex_);
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    if (stream_ && stream_->handle && Pa_IsStreamActive(stream_->handle) == 1) {
+        return false;
+    }
+
+    std::unique_ptr<Stream> previous = std::move(stream_);
+    std::string previous_name;
+    if (previous) {
+        if (const PaDeviceInfo* device_info = Pa_GetDeviceInfo(previous->config.device_id)) {
+            previous_name = device_info->name;
+        }
+        close_stream(*previous);
+        handover_.set_owner(nullptr);
+    }
+
+    if (initialized_) {
+        Pa_Terminate();
+        initialized_ = false;
+    }
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+        std::cerr << "PortAudio initialization error: " << Pa_GetErrorText(err) << std::endl;
+        return true;
+    }
+    initialized_ = true;
+    rank_host_apis();
+
+    if (previous_name.empty()) {
+        return true;
+    }
+    for (int i = 0; i < Pa_GetDeviceCount(); ++i) {
+        const PaDeviceInfo* device_info = Pa_GetDeviceInfo(i);
+        if (!device_info || previous_name != device_info->name) {
+            continue;
+        }
+        auto stream = std::make_unique<Stream>();
+        AudioEngine::StreamConfig config = previous->config;
+        config.device_id = i;
+        config.low_latency = false;  // Back at the buffer size it had settled on
+        config.frames_per_buffer = previous->frames_per_buffer;
+        if (prepare(*stream, config) && open_stream(*stream, config.frames_per_buffer)) {
+            stream->config.low_latency = previous->config.low_latency;
+            stream_ = std::move(stream);
+            handover_.set_owner(&stream_->handover);
+        }
+        break;
+    }
+    if (!stream_) {
+        std::cerr << "Audio device gone: " << previous_name << std::endl;
+    }
+    return true;
+}
+
+void PortAudioBackend::get_stats(AudioEngine::Stats& stats) const {
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+
+    stats.backend = stream_ ? stream_->host_backend : selected_;
+    for (const auto& api : host_apis_) {
+        if (api.backend == stats.backend) {
+            stats.host_api = api.name;
+            break;
+        }
+    }
+    stats.low_latency = low_latency_;
+    stats.xruns = xruns_.load(std::memory_order_relaxed);
+    stats.buffer_fallbacks = fallbacks_.load(std::memory_order_relaxed);
+
+    if (stream_ && stream_->handle) {
+        const PaDeviceInfo* device_info = Pa_GetDeviceInfo(stream_->config.device_id);
+        const PaHostApiInfo* host_api = device_info ? Pa_GetHostApiInfo(device_info->hostApi) : nullptr;
+        if (device_info) {
+            stats.device_name = device_info->name;
+        }
+        if (host_api) {
+            stats.host_api = host_api->name;
+        }
+        stats.device_id = stream_->config.device_id;
+        stats.sample_rate = stream_->config.sample_rate;
+        stats.frames_per_buffer = stream_->frames_per_buffer;
+        stats.input_latency = stream_->input_latency;
+        stats.output_latency = stream_->output_latency;
+    }
+}
+
+int PortAudioBackend::pa_audio_callback(const void* input, void* output,
+                                        unsigned long frames_per_buffer,
+                                        const PaStreamCallbackTimeInfo* /*time_info*/,
+                                        unsigned long status_flags,
+                                        void* user_data) {
+    auto* stream = static_cast<Stream*>(user_data);
+    return stream->backend->process(*stream, static_cast<const float*>(input), static_cast<float*>(output),
+                                    frames_per_buffer, status_flags);
+}
+
+int PortAudioBackend::process(Stream& stream, const float* input, float* output, unsigned long frames,
+                              unsigned long status_flags) {
+    if (status_flags & kXrunFlags) {
+        xruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (probing_.load(std::memory_order_relaxed)) {
+        std::memset(output, 0, sizeof(float) * frames * static_cast<unsigned long>(stream.output_channels));
+        return paContinue;
+    }
+    handover_.process(stream.handover, output, frames, [&](unsigned long offset, unsigned long count) {
+        render(stream, input ? input + offset * static_cast<unsigned long>(stream.input_channels) : nullptr,
+               output + offset * static_cast<unsigned long>(stream.output_channels), count);
+    });
+    return paContinue;
+}
+
+void PortAudioBackend::render(Stream& stream, const float* input, float* output, unsigned long frames) {
+    if (input && stream.input_channels == 1 && stream.output_channels == 2) {
+        engine_.process_block(input, output, frames);
+        return;
+    }
+
+    // Output-only devices get silent input; mono outputs get a downmix
+    for (unsigned long done = 0; done < frames;) {
+        unsigned long count = std::min<unsigned long>(frames - done, stream.silent_input.size());
+        const float* block_input = input ? input + done : stream.silent_input.data();
+        float* stereo = stream.output_channels == 2 ? output + 2 * done : stream.stereo_scratch.data();
+        engine_.process_block(block_input, stereo, count);
+        if (stream.output_channels == 1) {
+            for (unsigned long i = 0; i < count; ++i) {
+                output[done + i] = 0.5f * (stereo[2 * i] + stereo[2 * i + 1]);
+            }
+        }
+        done += count;
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "audio_backend.h"
+#include "stream_handover.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Forward declare PortAudio types to avoid dependency in header
+typedef void PaStream;
+struct PaStreamCallbackTimeInfo;
+
+// Sound card I/O through PortAudio.
+//
+// initialize() enumerates the PortAudio host APIs, maps them onto
+// AudioEngine::Backend (PipeWire and PulseAudio appear as ALSA plugin
+// devices, or as their own host API in newer PortAudio builds) and ranks
+// them by the round-trip latency the host negotiates for a probe stream.
+//
+// With the low-latency profile, open() walks up kLowLatencyFrames until a
+// buffer size runs without xruns, and a supervisor thread steps up to the
+// next size if xruns keep occurring while the stream runs.
+//
+// switch_stream() moves a running stream to another device without a
+// gap. The new stream starts beside the old, and for kCrossfadeMs both
+// play: the old fades out while the new fades in the same audio. Then the
+// old hands the engine over (StreamHandover). Only one stream's callback
+// drives the engine at a time.
+//
+// PortAudio reads the device list once, at Pa_Initialize; rescan()
+// re-initializes it to see devices plugged in or removed since.
+class PortAudioBackend : public AudioBackend {
+public:
+    static constexpr unsigned int kLowLatencyFrames[] = { 32, 64, 128, 256, 512, 1024 };
+    static constexpr unsigned int kCrossfadeMs = 20;
+
+    explicit PortAudioBackend(AudioEngine& engine);
+    PortAudioBackend(AudioEngine& engine, AudioEngine::Backend preferred);
+    ~PortAudioBackend() override;
+
+    bool initialize() override;
+    std::vector<AudioEngine::AudioDevice> get_devices() override;
+    bool open(const AudioEngine::StreamConfig& config) override;
+    bool start() override;
+    void close() override;
+    bool is_active() const override;
+    void get_stats(AudioEngine::Stats& stats) const override;
+    std::vector<AudioEngine::HostApi> get_host_apis() const override { return host_apis_; }
+    bool rescan() override;
+    bool switch_stream(const AudioEngine::StreamConfig& config) override;
+
+private:
+    // One device's stream. There are two only while switch_stream() runs.
+    struct Stream {
+        PortAudioBackend* backend = nullptr;
+        PaStream* handle = nullptr;
+        AudioEngine::StreamConfig config;
+        AudioEngine::Backend host_backend = AudioEngine::Backend::ALSA;
+        unsigned int frames_per_buffer = 0;
+        int input_channels = 0;
+        int output_channels = 0;
+        double input_latency = 0.0;
+        double output_latency = 0.0;
+        // Adapts devices that are not mono-in/stereo-out to the engine's layout
+        std::vector<float> silent_input;
+        std::vector<float> stereo_scratch;
+        StreamHandover::Slot handover;
+    };
+
+    void rank_host_apis();
+    double probe_round_trip_latency(int device_id);
+    AudioEngine::Backend backend_for_device(int device_id) const;
+
+    // Resolves the device and rate and sizes the stream for its layout
+    bool prepare(Stream& stream, const AudioEngine::StreamConfig& config);
+    bool open_stream(Stream& stream, unsigned int frames_per_buffer);
+    void close_stream(Stream& stream);
+    bool settle_low_latency(Stream& stream);
+    // close() with switch_mutex_ held
+    void close_current();
+    void supervise();
+    void stop_supervisor();
+
+    static int pa_audio_callback(const void* input, void* output,
+                                 unsigned long frames_per_buffer,
+                                 const PaStreamCallbackTimeInfo* time_info,
+                                 unsigned long status_flags,
+                                 void* user_data);
+    int process(Stream& stream, const float* input, float* output, unsigned long frames,
+                unsigned long status_flags);
+    void render(Stream& stream, const float* input, float* output, unsigned long frames);
+
+    bool initialized_;
+    bool has_preference_;
+    AudioEngine::Backend preferred_;
+    AudioEngine::Backend selected_;
+    std::vector<AudioEngine::HostApi> host_apis_;
+
+    // Held by open(), close(), rescan() and a whole switch, whose handover
+    // waits with stream_mutex_ released; taken before stream_mutex_
+    std::mutex switch_mutex_;
+    // Guards stream_ against the supervisor reopening it, a switch
+    // replacing it and a rescan; held only briefly by a switch, so the
+    // stats and is_active() do not wait out its handover
+    mutable std::mutex stream_mutex_;
+    std::unique_ptr<Stream> stream_;
+    bool low_latency_ = false;  // Of the last open()
+    // Whose callback drives the engine: stream_'s, or during a switch the
+    // one taking over
+    StreamHandover handover_;
+
+    std::atomic<bool> probing_{false};
+    std::atomic<uint64_t> xruns_{0};
+    std::atomic<uint64_t> fallbacks_{0};
+
+    std::thread supervisor_;
+    std::atomic<bool> supervising_{false};
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// One stage of real-time processing. input is the mono capture buffer;
+// output is the interleaved stereo buffer as left by the previous stages
+// (zeroed for the first). process() runs on the audio thread and must not
+// allocate, lock or block.
+class AudioProcessor {
+public:
+    virtual ~AudioProcessor() = default;
+    virtual void process(const float* input, float* output, unsigned int frames) = 0;
+};
+
+// Wraps any callable with the process() signature. The callable's type is
+// erased once, when the node is built; each call is a single virtual
+// dispatch with no std::function in between.
+template<typename F>
+class FunctionProcessor final : public AudioProcessor {
+public:
+    explicit FunctionProcessor(F function) : function_(std::move(function)) {}
+
+    void process(const float* input, float* output, unsigned int frames) override {
+        function_(input, output, frames);
+    }
+
+private:
+    F function_;
+};
+
+template<typename F>
+std::unique_ptr<AudioProcessor> make_processor(F&& function) {
+    return std::make_unique<FunctionProcessor<std::decay_t<F>>>(std::forward<F>(function));
+}
+
+// An ordered chain of processors. Built off the audio thread, then handed
+// to AudioEngine::set_processor_graph(), after which it is never modified;
+// the engine swaps whole graphs rather than editing a live one.
+class ProcessorGraph {
+public:
+    ProcessorGraph& add(std::unique_ptr<AudioProcessor> processor) {
+        nodes_.push_back(std::move(processor));
+        return *this;
+    }
+
+    template<typename F,
+             typename = std::enable_if_t<!std::is_convertible<F, std::unique_ptr<AudioProcessor>>::value>>
+    ProcessorGraph& add(F&& function) {
+        return add(make_processor(std::forward<F>(function)));
+    }
+
+    bool empty() const { return nodes_.empty(); }
+    size_t size() const { return nodes_.size(); }
+
+    void process(const float* input, float* output, unsigned int frames) const {
+        for (const auto& node : nodes_) {
+            node->process(input, output, frames);
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<AudioProcessor>> nodes_;
+};
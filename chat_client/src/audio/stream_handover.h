@@ -0,0 +1,140 @@
+#pragma once
+
+#include "../utils/spsc_ring_buffer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// Hands the engine from one output stream to another with an overlap.
+//
+// Only the owner's callback renders, so the engine still runs on one
+// thread at a time. Once a handover begins, the owner keeps rendering
+// for fade_frames more frames. It fades them out of its own output and
+// passes each one, unfaded, to the next stream. The next stream plays
+// them, fading in, from its own callback. Both play the same frames with
+// gains that add up to one: a crossfade. The owner then hands over at
+// the end of its callback. The next stream plays out what it was passed
+// and renders from there, with no frame skipped or repeated.
+//
+// process() is wait-free and allocates nothing; begin() allocates the
+// overlap ring, so call it off the audio thread.
+class StreamHandover {
+public:
+    struct Frame {
+        float left;
+        float right;
+    };
+
+    // One stream's side, owned by the backend and passed to every call
+    struct Slot {
+        unsigned int channels = 2;     // Of its output, 1 or 2
+        unsigned long fade_frames = 1;
+        // Callback thread only
+        unsigned long fade_in_left = 0;
+        unsigned long fade_out_left = 0;
+        bool fading_out = false;
+        // Frames the old owner rendered for this one, as it takes over
+        std::unique_ptr<SpscRingBuffer<Frame>> overlap;
+    };
+
+    // No handover in progress
+    void set_owner(Slot* slot) { owner_.store(slot, std::memory_order_release); }
+    Slot* owner() const { return owner_.load(std::memory_order_acquire); }
+
+    // next is, or is about to be, called back alongside the owner; room
+    // for max_buffer frames of the two streams' buffers besides the fade
+    void begin(Slot& next, unsigned long max_buffer) {
+        next.overlap = std::make_unique<SpscRingBuffer<Frame>>(next.fade_frames + 4 * max_buffer);
+        next.fade_in_left = next.fade_frames;
+        handover_.store(&next, std::memory_order_release);
+    }
+    bool handed_over(const Slot& next) const { return owner() == &next; }
+    // The owner has stopped calling back, for good
+    void force(Slot& next) { owner_.store(&next, std::memory_order_release); }
+    // After the handover, before the old slot goes
+    void end() { handover_.store(nullptr, std::memory_order_release); }
+
+    // From slot's callback. render(offset, count) renders frames
+    // [offset, offset + count) of this callback into output.
+    template <typename Render>
+    void process(Slot& slot, float* output, unsigned long frames, Render&& render) {
+        if (owner_.load(std::memory_order_acquire) != &slot) {
+            unsigned long played = 0;
+            if (handover_.load(std::memory_order_acquire) == &slot) {
+                played = play_overlap(slot, output, frames);
+            }
+            std::fill(output + played * slot.channels, output + frames * slot.channels, 0.0f);
+            return;
+        }
+
+        // Just took over: what the old owner rendered comes first
+        unsigned long done = slot.overlap ? play_overlap(slot, output, frames) : 0;
+        if (done < frames) {
+            render(done, frames - done);
+            fade_in(slot, output, done, frames);
+        }
+
+        Slot* next = handover_.load(std::memory_order_acquire);
+        if (!next || next == &slot) {
+            return;
+        }
+        if (!slot.fading_out) {
+            slot.fading_out = true;
+            slot.fade_out_left = slot.fade_frames;
+        }
+        for (unsigned long i = 0; i < frames; ++i) {
+            float* frame = output + i * slot.channels;
+            if (Frame* passed = next->overlap->write_slot()) {
+                passed->left = frame[0];
+                passed->right = frame[slot.channels - 1];
+                next->overlap->publish();
+            }
+            float gain = static_cast<float>(slot.fade_out_left) / slot.fade_frames;
+            for (unsigned int c = 0; c < slot.channels; ++c) {
+                frame[c] *= gain;
+            }
+            if (slot.fade_out_left) {
+                --slot.fade_out_left;
+            }
+        }
+        if (!slot.fade_out_left) {
+            // After this callback's last use of the engine
+            owner_.store(next, std::memory_order_release);
+        }
+    }
+
+private:
+    static void fade_in(Slot& slot, float* output, unsigned long from, unsigned long to) {
+        for (unsigned long i = from; i < to && slot.fade_in_left; ++i, --slot.fade_in_left) {
+            float gain = 1.0f - static_cast<float>(slot.fade_in_left) / slot.fade_frames;
+            for (unsigned int c = 0; c < slot.channels; ++c) {
+                output[i * slot.channels + c] *= gain;
+            }
+        }
+    }
+
+    // Returns the frames played
+    static unsigned long play_overlap(Slot& slot, float* output, unsigned long frames) {
+        unsigned long played = 0;
+        for (; played < frames; ++played) {
+            const Frame* frame = slot.overlap->read_slot();
+            if (!frame) {
+                break;
+            }
+            float* out = output + played * slot.channels;
+            if (slot.channels == 2) {
+                out[0] = frame->left;
+                out[1] = frame->right;
+            } else {
+                out[0] = 0.5f * (frame->left + frame->right);
+            }
+            slot.overlap->release();
+        }
+        fade_in(slot, output, 0, played);
+        return played;
+    }
+
+    std::atomic<Slot*> owner_{nullptr};
+    std::atomic<Slot*> handover_{nullptr};
+};
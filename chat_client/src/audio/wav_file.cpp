@@ -0,0 +1,189 @@
+#include "wav_file.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+
+constexpr uint16_t kFormatPcm = 1;
+constexpr uint16_t kFormatFloat = 3;
+constexpr uint16_t kFormatExtensible = 0xFFFE;
+
+bool is_raw_path(const std::string& path) {
+    auto ends_with = [&path](const char* suffix) {
+        size_t n = std::strlen(suffix);
+        return path.size() >= n && path.compare(path.size() - n, n, suffix) == 0;
+    };
+    return ends_with(".raw") || ends_with(".f32");
+}
+
+uint16_t le16(const unsigned char* p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+uint32_t le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+void put16(unsigned char* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; }
+void put32(unsigned char* p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+
+float decode_sample(const unsigned char* p, uint16_t format, uint16_t bits) {
+    if (format == kFormatFloat && bits == 32) {
+        float v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    switch (bits) {
+        case 16: return static_cast<int16_t>(le16(p)) / 32768.0f;
+        case 24: {
+            int32_t v = static_cast<int32_t>((p[0] << 8) | (p[1] << 16) | (p[2] << 24)) >> 8;
+            return v / 8388608.0f;
+        }
+        case 32: return static_cast<int32_t>(le32(p)) / 2147483648.0f;
+    }
+    return 0.0f;
+}
+
+} // namespace
+
+bool read_wav_mono(const std::string& path, WavData& out, unsigned int raw_sample_rate) {
+    std::FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Failed to open audio file: " << path << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> bytes;
+    unsigned char chunk[65536];
+    size_t n;
+    while ((n = std::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        bytes.insert(bytes.end(), chunk, chunk + n);
+    }
+    std::fclose(file);
+
+    out.samples.clear();
+    if (is_raw_path(path)) {
+        out.sample_rate = raw_sample_rate;
+        out.samples.resize(bytes.size() / sizeof(float));
+        std::memcpy(out.samples.data(), bytes.data(), out.samples.size() * sizeof(float));
+        return true;
+    }
+
+    if (bytes.size() < 12 || std::memcmp(bytes.data(), "RIFF", 4) != 0 ||
+        std::memcmp(bytes.data() + 8, "WAVE", 4) != 0) {
+        std::cerr << "Not a WAV file: " << path << std::endl;
+        return false;
+    }
+
+    uint16_t format = 0, channels = 0, bits = 0;
+    const unsigned char* data = nullptr;
+    size_t data_size = 0;
+    size_t pos = 12;
+    while (pos + 8 <= bytes.size()) {
+        const unsigned char* header = bytes.data() + pos;
+        uint32_t size = le32(header + 4);
+        size_t body = pos + 8;
+        size_t available = bytes.size() - body;
+        if (std::memcmp(header, "fmt ", 4) == 0 && size >= 16 && available >= 16) {
+            format = le16(header + 8);
+            channels = le16(header + 10);
+            out.sample_rate = le32(header + 12);
+            bits = le16(header + 22);
+            if (format == kFormatExtensible && size >= 26 && available >= 26) {
+                format = le16(header + 32); // First two bytes of the sub-format GUID
+            }
+        } else if (std::memcmp(header, "data", 4) == 0) {
+            data = header + 8;
+            data_size = std::min<size_t>(size, available);
+            break;
+        }
+        pos = body + size + (size & 1);
+    }
+
+    if (!data || channels == 0 || (format != kFormatPcm && format != kFormatFloat) ||
+        (bits != 16 && bits != 24 && bits != 32)) {
+        std::cerr << "Unsupported WAV format in " << path << std::endl;
+        return false;
+    }
+
+    size_t frame_bytes = static_cast<size_t>(channels) * (bits / 8);
+    size_t frames = data_size / frame_bytes;
+    out.samples.resize(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        float sum = 0.0f;
+        for (uint16_t c = 0; c < channels; ++c) {
+            sum += decode_sample(data + i * frame_bytes + c * (bits / 8), format, bits);
+        }
+        out.samples[i] = sum / channels;
+    }
+    return true;
+}
+
+WavWriter::WavWriter()
+    : file_(nullptr), raw_(false), channels_(0), frames_written_(0) {
+}
+
+WavWriter::~WavWriter() {
+    close();
+}
+
+bool WavWriter::open(const std::string& path, unsigned int sample_rate, unsigned int channels) {
+    close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) {
+        std::cerr << "Failed to create audio file: " << path << std::endl;
+        return false;
+    }
+
+    raw_ = is_raw_path(path);
+    channels_ = channels;
+    frames_written_ = 0;
+    if (raw_) {
+        return true;
+    }
+
+    unsigned char header[44] = {};
+    std::memcpy(header, "RIFF", 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    put32(header + 16, 16);
+    put16(header + 20, kFormatFloat);
+    put16(header + 22, static_cast<uint16_t>(channels));
+    put32(header + 24, sample_rate);
+    put32(header + 28, sample_rate * channels * sizeof(float));
+    put16(header + 32, static_cast<uint16_t>(channels * sizeof(float)));
+    put16(header + 34, 32);
+    std::memcpy(header + 36, "data", 4);
+    return std::fwrite(header, 1, sizeof(header), file_) == sizeof(header);
+}
+
+bool WavWriter::write(const float* interleaved, size_t frames) {
+    if (!file_) {
+        return false;
+    }
+    size_t count = frames * channels_;
+    if (std::fwrite(interleaved, sizeof(float), count, file_) != count) {
+        return false;
+    }
+    frames_written_ += frames;
+    return true;
+}
+
+void WavWriter::close() {
+    if (!file_) {
+        return;
+    }
+    if (!raw_) {
+        uint32_t data_bytes = static_cast<uint32_t>(frames_written_ * channels_ * sizeof(float));
+        unsigned char size[4];
+        put32(size, 36 + data_bytes);
+        std::fseek(file_, 4, SEEK_SET);
+        std::fwrite(size, 1, 4, file_);
+        put32(size, data_bytes);
+        std::fseek(file_, 40, SEEK_SET);
+        std::fwrite(size, 1, 4, file_);
+    }
+    std::fclose(file_);
+    file_ = nullptr;
+}
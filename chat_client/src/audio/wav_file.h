@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Minimal RIFF/WAVE support for the file backend and tests.
+//
+// Reading accepts 16/24/32-bit PCM and 32-bit float in any channel count,
+// down-mixed to mono float. Writing produces 32-bit float WAV. A path ending
+// in ".raw" or ".f32" is treated as headerless native-endian float32 instead.
+struct WavData {
+    unsigned int sample_rate = 0;
+    std::vector<float> samples; // Mono
+};
+
+bool read_wav_mono(const std::string& path, WavData& out, unsigned int raw_sample_rate = 48000);
+
+class WavWriter {
+public:
+    WavWriter();
+    ~WavWriter();
+
+    WavWriter(const WavWriter&) = delete;
+    WavWriter& operator=(const WavWriter&) = delete;
+
+    bool open(const std::string& path, unsigned int sample_rate, unsigned int channels);
+    bool write(const float* interleaved, size_t frames);
+    // Patches the header sizes; also done by the destructor
+    void close();
+
+private:
+    std::FILE* file_;
+    bool raw_;
+    unsigned int channels_;
+    uint64_t frames_written_;
+};
@@ -0,0 +1,226 @@
+#include "waveform_pyramid.h"
+#include "../dsp/dsp_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace {
+
+constexpr float kScale = 32767.0f;
+
+// Rounded outwards, so the envelope never shrinks
+int16_t quantize_min(float x) {
+    return static_cast<int16_t>(std::floor(std::clamp(x, -1.0f, 1.0f) * kScale));
+}
+
+int16_t quantize_max(float x) {
+    return static_cast<int16_t>(std::ceil(std::clamp(x, -1.0f, 1.0f) * kScale));
+}
+
+} // namespace
+
+WaveformPyramid::WaveformPyramid() : WaveformPyramid(Options()) {}
+
+WaveformPyramid::WaveformPyramid(const Options& options)
+    : options_(options), dsp_(&dsp_kernels()) {
+    const double max_frames = options_.max_seconds * options_.sample_rate;
+    for (size_t level = 0; level < kLevels; ++level) {
+        double entries = std::ceil(max_frames / static_cast<double>(bucket_frames(level)));
+        levels_[level].max_entries = std::max<size_t>(1, static_cast<size_t>(entries));
+    }
+    size_t raw_frames = static_cast<size_t>(options_.raw_seconds * options_.sample_rate);
+    raw_.assign(std::max<size_t>(raw_frames, kBaseFrames * kFanOut), 0.0f);
+}
+
+uint64_t WaveformPyramid::bucket_frames(size_t level) {
+    uint64_t frames = kBaseFrames;
+    for (size_t i = 0; i < level; ++i) {
+        frames *= kFanOut;
+    }
+    return frames;
+}
+
+void WaveformPyramid::append(const float* samples, size_t frames) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    append_raw(samples, frames);
+
+    size_t offset = 0;
+    while (offset < frames) {
+        size_t chunk = std::min<size_t>(frames - offset, kBaseFrames - base_fill_);
+        float lo, hi;
+        dsp_->min_max(samples + offset, chunk, &lo, &hi);
+        if (base_fill_ == 0) {
+            base_min_ = lo;
+            base_max_ = hi;
+        } else {
+            base_min_ = std::min(base_min_, lo);
+            base_max_ = std::max(base_max_, hi);
+        }
+        base_fill_ += static_cast<unsigned int>(chunk);
+        offset += chunk;
+        if (base_fill_ == kBaseFrames) {
+            push(0, Entry{ quantize_min(base_min_), quantize_max(base_max_) });
+            base_fill_ = 0;
+        }
+    }
+    total_frames_ += frames;
+}
+
+void WaveformPyramid::push(size_t level, Entry entry) {
+    Level& current = levels_[level];
+    current.entries.push_back(entry);
+    if (current.entries.size() > current.max_entries) {
+        current.entries.pop_front();
+        ++current.first_index;
+    }
+    if (level + 1 == kLevels) {
+        return;
+    }
+
+    Level& up = levels_[level + 1];
+    if (up.partial_count == 0) {
+        up.partial = entry;
+    } else {
+        up.partial.min = std::min(up.partial.min, entry.min);
+        up.partial.max = std::max(up.partial.max, entry.max);
+    }
+    if (++up.partial_count == kFanOut) {
+        up.partial_count = 0;
+        push(level + 1, up.partial);
+    }
+}
+
+void WaveformPyramid::append_raw(const float* samples, size_t frames) {
+    const size_t capacity = raw_.size();
+    if (frames >= capacity) {
+        std::memcpy(raw_.data(), samples + frames - capacity, sizeof(float) * capacity);
+        raw_write_ = 0;
+        return;
+    }
+    size_t first = std::min(frames, capacity - raw_write_);
+    std::memcpy(raw_.data() + raw_write_, samples, sizeof(float) * first);
+    std::memcpy(raw_.data(), samples + first, sizeof(float) * (frames - first));
+    raw_write_ = (raw_write_ + frames) % capacity;
+}
+
+void WaveformPyramid::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (Level& level : levels_) {
+        level.entries.clear();
+        level.first_index = 0;
+        level.partial_count = 0;
+    }
+    total_frames_ = 0;
+    base_fill_ = 0;
+    raw_write_ = 0;
+}
+
+uint64_t WaveformPyramid::total_frames() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return total_frames_;
+}
+
+uint64_t WaveformPyramid::first_frame() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return levels_[0].first_index * kBaseFrames;
+}
+
+size_t WaveformPyramid::memory_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t entries = 0;
+    for (const Level& level : levels_) {
+        entries += level.entries.size();
+    }
+    return entries * sizeof(Entry) + raw_.size() * sizeof(float);
+}
+
+size_t WaveformPyramid::envelope(int64_t first, double frames_per_pixel, Column* columns,
+                                 size_t count) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const double fpp = std::max(frames_per_pixel, 1.0);
+    // The coarsest level with entries no wider than a column: each column
+    // then reads at most kFanOut of them, plus one at either end
+    size_t level = 0;
+    while (level + 1 < kLevels && static_cast<double>(bucket_frames(level + 1)) <= fpp) {
+        ++level;
+    }
+    const int64_t oldest = static_cast<int64_t>(levels_[0].first_index * kBaseFrames);
+    const int64_t newest = static_cast<int64_t>(total_frames_);
+    const int64_t raw_start = newest - static_cast<int64_t>(std::min<uint64_t>(total_frames_, raw_.size()));
+
+    size_t reads = 0;
+    for (size_t i = 0; i < count; ++i) {
+        int64_t begin = first + static_cast<int64_t>(std::floor(static_cast<double>(i) * fpp));
+        int64_t end = first + static_cast<int64_t>(std::floor(static_cast<double>(i + 1) * fpp));
+        end = std::max(end, begin + 1);
+        begin = std::max(begin, oldest);
+        end = std::min(end, newest);
+
+        Column& column = columns[i];
+        column = Column();
+        if (begin >= end) {
+            continue;
+        }
+        float lo = std::numeric_limits<float>::max();
+        float hi = std::numeric_limits<float>::lowest();
+        if (fpp < kBaseFrames && begin >= raw_start) {
+            reads += span_raw(static_cast<uint64_t>(begin), static_cast<uint64_t>(end), &lo, &hi);
+        } else {
+            reads += span(static_cast<uint64_t>(begin), static_cast<uint64_t>(end), level, &lo, &hi);
+        }
+        if (lo <= hi) {
+            column.min = lo;
+            column.max = hi;
+            column.valid = true;
+        }
+    }
+    return reads;
+}
+
+size_t WaveformPyramid::span(uint64_t begin, uint64_t end, size_t level, float* lo, float* hi) const {
+    const Level& current = levels_[level];
+    const uint64_t bucket = bucket_frames(level);
+    const uint64_t committed = current.first_index + current.entries.size();
+    const uint64_t first = std::max(begin / bucket, current.first_index);
+    const uint64_t last = std::min((end + bucket - 1) / bucket, committed);
+
+    size_t reads = 0;
+    for (uint64_t index = first; index < last; ++index) {
+        const Entry& entry = current.entries[index - current.first_index];
+        *lo = std::min(*lo, entry.min / kScale);
+        *hi = std::max(*hi, entry.max / kScale);
+        ++reads;
+    }
+    // The newest frames are not merged into this level yet; fewer than
+    // kFanOut entries of the level below, or kBaseFrames raw frames, cover them
+    const uint64_t covered = committed * bucket;
+    if (end > covered) {
+        uint64_t from = std::max(begin, covered);
+        reads += level ? span(from, end, level - 1, lo, hi) : span_raw(from, end, lo, hi);
+    }
+    return reads;
+}
+
+size_t WaveformPyramid::span_raw(uint64_t begin, uint64_t end, float* lo, float* hi) const {
+    const size_t capacity = raw_.size();
+    begin = std::max(begin, total_frames_ - std::min<uint64_t>(total_frames_, capacity));
+    if (begin >= end) {
+        return 0;
+    }
+    // raw_write_ is where frame total_frames_ will go
+    size_t start = (raw_write_ + capacity - static_cast<size_t>(total_frames_ - begin)) % capacity;
+    size_t frames = static_cast<size_t>(end - begin);
+    size_t first = std::min(frames, capacity - start);
+    float piece_lo, piece_hi;
+    dsp_->min_max(raw_.data() + start, first, &piece_lo, &piece_hi);
+    *lo = std::min(*lo, piece_lo);
+    *hi = std::max(*hi, piece_hi);
+    if (first < frames) {
+        dsp_->min_max(raw_.data(), frames - first, &piece_lo, &piece_hi);
+        *lo = std::min(*lo, piece_lo);
+        *hi = std::max(*hi, piece_hi);
+    }
+    return frames;
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct DspKernels;
+
+// Min/max envelope of a long mono signal at several resolutions, so that
+// drawing any stretch of it reads a handful of entries per pixel however
+// many frames the stretch covers.
+//
+// Level 0 holds one entry per kBaseFrames frames and each level above
+// merges kFanOut entries of the one below. The newest raw_seconds of
+// samples are kept as well, for views closer than kBaseFrames a pixel.
+// Entries are two 16-bit values, so an hour at 16 kHz costs 3.6 MB at level
+// 0 and a third as much again over the levels above; entries older than
+// max_seconds are dropped.
+//
+// append() runs on one thread and envelope() on another, each holding a
+// mutex for its own duration. Neither belongs on the audio thread; feed it
+// from a CaptureConsumer.
+class WaveformPyramid {
+public:
+    static constexpr unsigned int kBaseFrames = 64;
+    static constexpr unsigned int kFanOut = 4;
+    static constexpr size_t kLevels = 10;
+
+    struct Options {
+        unsigned int sample_rate = 16000;
+        double max_seconds = 4 * 3600.0;
+        double raw_seconds = 30.0;
+    };
+
+    // What one pixel column covers; not valid where nothing is retained
+    struct Column {
+        float min = 0.0f;
+        float max = 0.0f;
+        bool valid = false;
+    };
+
+    WaveformPyramid();
+    explicit WaveformPyramid(const Options& options);
+
+    WaveformPyramid(const WaveformPyramid&) = delete;
+    WaveformPyramid& operator=(const WaveformPyramid&) = delete;
+
+    void append(const float* samples, size_t frames);
+    // Forgets everything and starts again at frame 0
+    void clear();
+
+    unsigned int sample_rate() const { return options_.sample_rate; }
+    // Frames appended since construction or clear()
+    uint64_t total_frames() const;
+    // Oldest frame still retained
+    uint64_t first_frame() const;
+    // Entries and raw samples held
+    size_t memory_bytes() const;
+
+    // columns[i] = envelope of frames [first + i * fpp, first + (i + 1) * fpp)
+    // for frames_per_pixel >= 1, rounded out to whole entries of the level
+    // read. Returns the entries and raw samples read, for benchmarks: a few
+    // per column, whatever frames_per_pixel is.
+    size_t envelope(int64_t first, double frames_per_pixel, Column* columns, size_t count) const;
+
+private:
+    struct Entry {
+        int16_t min;
+        int16_t max;
+    };
+    struct Level {
+        std::deque<Entry> entries;
+        uint64_t first_index = 0;  // Of entries.front()
+        size_t max_entries = 0;
+        Entry partial{};           // Entries of the level below not yet merged in
+        unsigned int partial_count = 0;
+    };
+
+    static uint64_t bucket_frames(size_t level);
+    void push(size_t level, Entry entry);
+    void append_raw(const float* samples, size_t frames);
+    // Envelope of [begin, end) from the given level down, accumulated into
+    // lo/hi; returns entries and samples read
+    size_t span(uint64_t begin, uint64_t end, size_t level, float* lo, float* hi) const;
+    size_t span_raw(uint64_t begin, uint64_t end, float* lo, float* hi) const;
+
+    Options options_;
+    const DspKernels* dsp_;
+    mutable std::mutex mutex_;
+    Level levels_[kLevels];
+    uint64_t total_frames_ = 0;
+    float base_min_ = 0.0f;        // Of the base entry being filled
+    float base_max_ = 0.0f;
+    unsigned int base_fill_ = 0;
+    std::vector<float> raw_;       // Ring of the newest frames
+    size_t raw_write_ = 0;
+};
@@ -1,23 +1,474 @@
 #include "application.h"
 #include "../audio/audio_engine.h"
+#include "../audio/codec_pipeline.h"
+#include "../audio/device_monitor.h"
+#include "../audio/jitter_buffer.h"
 #include "../gui/main_window.h"
-#include "config_manager.h"
+#include "config_store.h"
+#include "message_inbox.h"
+#include "history_store.h"
+#include "search_index.h"
+#include "startup_trace.h"
 #include "../network/protocol_manager.h"
+#include "../dsp/voice_processor.h"
+#include "../gui/chat_window.h"
 
 #include <FL/Fl.H>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <future>
 #include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 class Application::Impl {
 public:
     int argc;
     char** argv;
-    std::unique_ptr<ConfigManager> config_manager;
+    // Phases of startup from construction; --startup-trace=FILE writes them
+    // as a Chrome trace, and --exit-after-startup quits once they are done
+    StartupTrace startup;
+    std::string startup_trace_path;
+    bool exit_after_startup = false;
+    // data/config/default.json and config/device_streams.yaml, reloaded
+    // as they change. The UI thread reads them through config_reader.
+    ConfigStore config_store;
+    std::unique_ptr<ConfigStore::Reader> config_reader;
+    // What a reload changed that the UI thread has still to redo
+    static constexpr unsigned kVoiceChanged = 1;
+    static constexpr unsigned kGatingChanged = 2;
+    static constexpr unsigned kRtspChanged = 4;
+    static constexpr unsigned kHlsChanged = 8;
+    std::atomic<unsigned> config_changes{0};
     std::unique_ptr<AudioEngine> audio_engine;
+    // Initializes the sound card and opens the default device while the
+    // window comes up; its results are the UI thread's once it has joined
+    std::thread audio_startup;
+    bool audio_ok = false;
+    std::vector<AudioEngine::AudioDevice> audio_devices;
+    int audio_device = -1;
+    // Rescans the devices on hotplug and switches them, off the UI thread;
+    // what it reports waits in device_events for the UI thread
+    std::unique_ptr<DeviceMonitor> device_monitor;
+    std::mutex device_events_mutex;
+    std::vector<DeviceMonitor::Event> device_events;
     std::unique_ptr<MainWindow> main_window;
+    // Declared first so the protocol thread is stopped before they go,
+    // and the index before the store that feeds it
+    std::unique_ptr<SearchIndex> search_index;
+    std::unique_ptr<HistoryStore> history_store;
+    std::thread index_catch_up;
+    std::atomic<bool> cancel_catch_up{false};
+    std::unique_ptr<MessageInbox> inbox;
+    uint64_t reported_drops = 0;
     std::unique_ptr<ProtocolManager> protocol_manager;
+    // Voice: captured speech out through the codec pipeline, the far end's
+    // in through the jitter buffer to the engine's playback
+    std::unique_ptr<AudioEncodePipeline> voice_pipeline;
+    std::unique_ptr<JitterBuffer> jitter_buffer;
+    // The device streams' encoders, owned by the protocol manager's
+    // servers. An input device's stream takes the capture, an output
+    // device's what is played.
+    struct DeviceStream {
+        AudioEncodePipeline* pipeline;
+        bool playback;
+    };
+    std::vector<DeviceStream> rtsp_streams;
+    std::vector<DeviceStream> hls_streams;
+    
+    bool start_voice(const ConfigManager& config) {
+        CodecSettings settings;
+        CodecSettings::preset(config.get_string("voice.quality", "medium"), settings);
+        JitterBuffer::Options options;
+        options.min_delay_ms = static_cast<unsigned>(config.get_int("voice.min_delay_ms", options.min_delay_ms));
+        options.max_delay_ms = static_cast<unsigned>(config.get_int("voice.max_delay_ms", options.max_delay_ms));
+        options.jitter_factor = config.get_float("voice.jitter_factor", float(options.jitter_factor));
+        jitter_buffer = std::make_unique<JitterBuffer>(settings, audio_engine->get_sample_rate(), options);
+        ProtocolManager* protocol = protocol_manager.get();
+        voice_pipeline = std::make_unique<AudioEncodePipeline>(
+            settings, [protocol](const EncodedFrame* frames, size_t count) { protocol->send_voice(frames, count); });
+        if (!jitter_buffer->valid() || !voice_pipeline->valid()) {
+            std::cerr << "Voice codec not available" << std::endl;
+            jitter_buffer.reset();
+            voice_pipeline.reset();
+            return false;
+        }
+        
+        JitterBuffer* jitter = jitter_buffer.get();
+        if (!protocol->open_voice(
+                static_cast<uint16_t>(config.get_int("voice.local_port", 5004)),
+                config.get_string("voice.remote_host", "127.0.0.1"),
+                static_cast<uint16_t>(config.get_int("voice.remote_port", 5004)),
+                [jitter](const RtpHeader& header, const uint8_t* payload, size_t size) {
+                    jitter->push(header, payload, size);
+                })) {
+            jitter_buffer.reset();
+            voice_pipeline.reset();
+            return false;
+        }
+        audio_engine->set_playback_source(jitter);
+        voice_pipeline->start();
+        audio_engine->add_capture_consumer(voice_pipeline->consumer(), voice_pipeline->sample_rate());
+        return true;
+    }
+    
+    void stop_voice() {
+        if (voice_pipeline) {
+            audio_engine->remove_capture_consumer(voice_pipeline->consumer());
+            voice_pipeline->stop();
+        }
+        protocol_manager->close_voice();
+        if (jitter_buffer) {
+            audio_engine->set_playback_source(nullptr);
+        }
+        voice_pipeline.reset();
+        jitter_buffer.reset();
+    }
+    
+    // A device stream's codec: the high audio preset, at the entry's
+    // bitrate if it gives one
+    static CodecSettings stream_codec(const DeviceStreamsConfig& streams, const DeviceProtocolConfig& protocol) {
+        const AudioPresetConfig& preset = streams.quality_presets.audio.high;
+        CodecSettings settings;
+        settings.sample_rate = preset.sample_rate;
+        settings.bitrate = protocol.bitrate ? protocol.bitrate : preset.bitrate;
+        settings.dtx = preset.dtx;
+        settings.fec = preset.fec;
+        return settings;
+    }
+    
+    void attach_streams(const std::vector<AudioEncodePipeline*>& pipelines, const std::vector<bool>& playback,
+                        std::vector<DeviceStream>& streams) {
+        for (size_t i = 0; i < pipelines.size(); ++i) {
+            AudioEncodePipeline* pipeline = pipelines[i];
+            if (playback[i]) {
+                audio_engine->add_playback_consumer(pipeline->consumer(), pipeline->sample_rate());
+            } else {
+                audio_engine->add_capture_consumer(pipeline->consumer(), pipeline->sample_rate());
+            }
+            streams.push_back({ pipeline, playback[i] });
+        }
+    }
+    
+    void detach_streams(std::vector<DeviceStream>& streams) {
+        for (const DeviceStream& stream : streams) {
+            audio_engine->remove_capture_consumer(stream.pipeline->consumer());
+        }
+        streams.clear();
+    }
+    
+    // The audio devices' rtsp entries, served in process: each stream is
+    // encoded once however many clients watch
+    bool start_streaming(const DeviceStreamsConfig& streams) {
+        std::vector<RtspMount> mounts;
+        std::vector<bool> playback;
+        for (const DeviceConfig& device : streams.audio_devices) {
+            if (const DeviceProtocolConfig* rtsp = device.enabled_protocol(StreamProtocol::RTSP)) {
+                RtspMount mount;
+                mount.path = streams.stream_path(device, *rtsp);
+                mount.port = streams.stream_port(*rtsp);
+                mount.codec = stream_codec(streams, *rtsp);
+                mounts.push_back(mount);
+                playback.push_back(device.type == DeviceDirection::OUTPUT);
+            }
+        }
+        if (mounts.empty()) {
+            return true;
+        }
+        
+        std::vector<AudioEncodePipeline*> pipelines;
+        if (!protocol_manager->open_rtsp(streams.server.host, mounts, pipelines)) {
+            return false;
+        }
+        attach_streams(pipelines, playback, rtsp_streams);
+        return true;
+    }
+    
+    void stop_streaming() {
+        detach_streams(rtsp_streams);
+        protocol_manager->close_rtsp();
+    }
+    
+    // The audio devices' hls entries, for players that only speak HTTP,
+    // all on the protocol's http_port
+    bool start_hls(const DeviceStreamsConfig& streams) {
+        const HlsProtocolConfig& hls = streams.protocols.hls;
+        HlsSettings settings;
+        settings.segment_ms = hls.segment_duration * 1000;
+        settings.playlist_size = hls.playlist_size;
+        std::vector<HlsMount> mounts;
+        std::vector<bool> playback;
+        for (const DeviceConfig& device : streams.audio_devices) {
+            if (const DeviceProtocolConfig* entry = device.enabled_protocol(StreamProtocol::HLS)) {
+                mounts.push_back({ streams.stream_path(device, *entry), stream_codec(streams, *entry) });
+                playback.push_back(device.type == DeviceDirection::OUTPUT);
+            }
+        }
+        if (mounts.empty()) {
+            return true;
+        }
+        
+        std::vector<AudioEncodePipeline*> pipelines;
+        if (!protocol_manager->open_hls(streams.server.host, hls.http_port, settings, mounts, pipelines)) {
+            return false;
+        }
+        attach_streams(pipelines, playback, hls_streams);
+        return true;
+    }
+    
+    void stop_hls() {
+        detach_streams(hls_streams);
+        protocol_manager->close_hls();
+    }
+    
+    // The stage flags are atomics, so any thread may switch them
+    void apply_voice_stages(const ConfigManager& config) {
+        using Stage = VoiceProcessor::Stage;
+        VoiceProcessor& voice = audio_engine->voice_processor();
+        voice.set_enabled(Stage::ECHO_CANCELLATION, config.get_bool("audio.enable_echo_cancellation"));
+        voice.set_enabled(Stage::NOISE_SUPPRESSION, config.get_bool("audio.enable_noise_suppression"));
+        voice.set_enabled(Stage::GAIN_CONTROL, config.get_bool("audio.enable_auto_gain_control"));
+        voice.set_enabled(Stage::VOICE_ACTIVITY, config.get_bool("audio.enable_voice_activity_detection"));
+    }
+    
+    // The startup thread before the device opens, then the UI thread
+    void apply_gating(const ConfigManager& config) {
+        AudioEngine::GatingOptions gating;
+        gating.enabled = config.get_bool("audio.enable_capture_gating");
+        gating.hangover_ms = config.get_int("audio.gating_hangover_ms", gating.hangover_ms);
+        gating.preroll_ms = config.get_int("audio.gating_preroll_ms", gating.preroll_ms);
+        audio_engine->set_capture_gating(gating);
+    }
+    
+    // Settings changed while running. The voice stages switch on the
+    // watcher thread; voice, gating and the device streams are redone on
+    // the UI thread from the snapshot current by then.
+    void watch_config() {
+        config_store.subscribe({ "audio.enable_echo_cancellation", "audio.enable_noise_suppression",
+                                 "audio.enable_auto_gain_control", "audio.enable_voice_activity_detection" },
+                               [this](const ConfigSnapshot& config, const std::vector<std::string>&) {
+                                   apply_voice_stages(config.settings);
+                               });
+        auto flag = [this](unsigned change) {
+            return [this, change](const ConfigSnapshot&, const std::vector<std::string>&) {
+                if (config_changes.fetch_or(change) == 0) {
+                    Fl::awake(apply_config_changes, this);
+                }
+            };
+        };
+        config_store.subscribe({ "voice" }, flag(kVoiceChanged));
+        config_store.subscribe({ "audio.enable_capture_gating", "audio.gating_hangover_ms",
+                                 "audio.gating_preroll_ms" }, flag(kGatingChanged));
+        const std::string streams = ConfigStore::kStreamsPrefix;
+        config_store.subscribe({ streams + ".server.host", streams + ".audio_devices",
+                                 streams + ".quality_presets.audio", streams + ".protocols.rtsp" },
+                               flag(kRtspChanged));
+        config_store.subscribe({ streams + ".server.host", streams + ".audio_devices",
+                                 streams + ".quality_presets.audio", streams + ".protocols.hls" },
+                               flag(kHlsChanged));
+        if (!config_store.watch()) {
+            std::cerr << "Warning: Configuration changes will need a restart" << std::endl;
+        }
+    }
+    
+    static void apply_config_changes(void* data) {
+        Impl* impl = static_cast<Impl*>(data);
+        unsigned changes = impl->config_changes.exchange(0);
+        ConfigStore::Snapshot config = impl->config_reader->read();
+        if (changes & kVoiceChanged) {
+            impl->stop_voice();
+            if (config->settings.get_bool("voice.enabled") && !impl->start_voice(config->settings)) {
+                std::cerr << "Warning: Voice is off" << std::endl;
+            }
+        }
+        if (changes & kGatingChanged) {
+            impl->apply_gating(config->settings);
+        }
+        if (changes & kRtspChanged) {
+            impl->stop_streaming();
+            if (config->streams.protocols.rtsp.enabled && !impl->start_streaming(config->streams)) {
+                std::cerr << "Warning: RTSP streams are off" << std::endl;
+            }
+        }
+        if (changes & kHlsChanged) {
+            impl->stop_hls();
+            if (config->streams.protocols.hls.enabled && !impl->start_hls(config->streams)) {
+                std::cerr << "Warning: HLS streams are off" << std::endl;
+            }
+        }
+        std::cout << "Configuration version " << config->version << " applied" << std::endl;
+    }
+    
+    // UI thread: shows a batch from the inbox, then any messages dropped
+    // since the last batch
+    void show_messages(std::vector<ChatMessage>& batch) {
+        ChatWindow* chat = main_window->chat_window();
+        chat->add_messages(batch.data(), batch.size());
+        uint64_t dropped = inbox->get_stats().dropped;
+        if (dropped != reported_drops) {
+            chat->add_message("System", std::to_string(dropped - reported_drops)
+                              + " incoming messages dropped (inbox full)");
+            reported_drops = dropped;
+        }
+    }
+    
+    // After the startup thread's enumeration, which it leaves cached
+    void start_device_monitor() {
+        device_monitor = std::make_unique<DeviceMonitor>(*audio_engine, [this](const DeviceMonitor::Event& event) {
+            std::lock_guard<std::mutex> lock(device_events_mutex);
+            device_events.push_back(event);
+            if (device_events.size() == 1) {
+                Fl::awake(show_device_events, this);
+            }
+        });
+        DeviceMonitor* monitor = device_monitor.get();
+        main_window->on_device_selected([monitor](int device_id) { monitor->request_switch(device_id); });
+        if (!device_monitor->start()) {
+            std::cerr << "Warning: Audio devices plugged in will need a restart" << std::endl;
+        }
+    }
+    
+    static std::string device_name(const std::vector<AudioEngine::AudioDevice>& devices, int id) {
+        for (const auto& device : devices) {
+            if (device.id == id) {
+                return device.name;
+            }
+        }
+        return "device " + std::to_string(id);
+    }
+    
+    // UI thread: the selector follows the table, and the chat says what happened
+    static void show_device_events(void* data) {
+        Impl* impl = static_cast<Impl*>(data);
+        std::vector<DeviceMonitor::Event> events;
+        {
+            std::lock_guard<std::mutex> lock(impl->device_events_mutex);
+            events.swap(impl->device_events);
+        }
+        ChatWindow* chat = impl->main_window->chat_window();
+        for (const DeviceMonitor::Event& event : events) {
+            impl->main_window->set_devices(event.devices, event.open_device);
+            switch (event.kind) {
+                case DeviceMonitor::Event::Kind::DEVICES_CHANGED:
+                    chat->add_message("System", "Audio devices changed");
+                    break;
+                case DeviceMonitor::Event::Kind::SWITCHED:
+                    chat->add_message("System", "Audio switched to "
+                                      + device_name(event.devices, event.requested_device));
+                    break;
+                case DeviceMonitor::Event::Kind::SWITCH_FAILED:
+                    chat->add_message("System", "Could not switch audio to "
+                                      + device_name(event.devices, event.requested_device));
+                    break;
+            }
+        }
+    }
+    
+    // Startup thread. Pa_Initialize and the host API probes, then the
+    // devices; opening one waits for the settings, which pick the latency.
+    void start_audio(std::shared_future<bool> config_loaded) {
+        {
+            StartupTrace::Phase phase(startup, "audio.initialize");
+            audio_ok = audio_engine->initialize();
+        }
+        if (audio_ok) {
+            StartupTrace::Phase phase(startup, "audio.devices");
+            audio_devices = audio_engine->get_devices();
+        }
+        if (audio_ok && config_loaded.get()) {
+            std::unique_ptr<ConfigStore::Reader> reader = config_store.make_reader();
+            ConfigStore::Snapshot config = reader->read();
+            audio_engine->set_low_latency_profile(config->settings.get_bool("audio.low_latency"));
+            // Before the device opens, which sizes the hangover and pre-roll
+            apply_gating(config->settings);
+            
+            StartupTrace::Phase phase(startup, "audio.open");
+            const AudioEngine::AudioDevice* chosen = nullptr;
+            for (const auto& device : audio_devices) {
+                if (device.max_input_channels > 0 && device.max_output_channels > 0 &&
+                    (!chosen || (device.is_default && !chosen->is_default))) {
+                    chosen = &device;
+                }
+            }
+            if (chosen && audio_engine->open_device(chosen->id)) {
+                audio_device = chosen->id;
+            }
+        }
+        Fl::awake(audio_ready, this);
+    }
+    
+    // UI thread, from the event loop, so initialize() has finished: what
+    // needs the engine starts now
+    static void audio_ready(void* data) {
+        Impl* impl = static_cast<Impl*>(data);
+        impl->audio_startup.join();
+        if (!impl->audio_ok) {
+            std::cerr << "Failed to initialize audio engine" << std::endl;
+            impl->main_window->chat_window()->add_message("System", "Audio is unavailable");
+        }
+        impl->main_window->attach_audio(impl->audio_ok ? impl->audio_engine.get() : nullptr,
+                                        impl->audio_devices, impl->audio_device);
+        
+        if (impl->audio_ok) {
+            impl->start_device_monitor();
+            ConfigStore::Snapshot config = impl->config_reader->read();
+            if (config->settings.get_bool("voice.enabled") && !impl->start_voice(config->settings)) {
+                std::cerr << "Warning: Voice is off" << std::endl;
+            }
+            if (config->streams.protocols.rtsp.enabled && !impl->start_streaming(config->streams)) {
+                std::cerr << "Warning: RTSP streams are off" << std::endl;
+            }
+            if (config->streams.protocols.hls.enabled && !impl->start_hls(config->streams)) {
+                std::cerr << "Warning: HLS streams are off" << std::endl;
+            }
+        }
+        // Reloads redo voice and the streams, so only from here on
+        impl->watch_config();
+        impl->startup.mark("audio_ready");
+        impl->startup_step_done();
+    }
+    
+    // UI thread, after the first frame and again once audio is ready
+    void startup_step_done() {
+        int64_t first_frame = startup.time_of("first_frame");
+        int64_t audio = startup.time_of("audio_ready");
+        if (first_frame < 0 || audio < 0) {
+            return;
+        }
+        std::cout << "Startup: first frame after " << first_frame / 1000.0 << " ms, audio ready after "
+                  << audio / 1000.0 << " ms" << std::endl;
+        if (!startup_trace_path.empty() && !startup.write_chrome_json(startup_trace_path)) {
+            std::cerr << "Warning: Could not write the startup trace to " << startup_trace_path << std::endl;
+        }
+        if (exit_after_startup) {
+            // Not from inside the window's draw()
+            Fl::add_timeout(0.0, [](void* data) { static_cast<Impl*>(data)->main_window->hide(); }, this);
+        }
+    }
     
     Impl(int argc_, char** argv_) 
-        : argc(argc_), argv(argv_) {}
+        : argc(argc_), argv(argv_) {
+        const std::string trace_option = "--startup-trace=";
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg.compare(0, trace_option.size(), trace_option) == 0) {
+                startup_trace_path = arg.substr(trace_option.size());
+            } else if (arg == "--exit-after-startup") {
+                exit_after_startup = true;
+            }
+        }
+    }
+    
+    ~Impl() {
+        // Before the engine and the settings it reads
+        if (audio_startup.joinable()) {
+            audio_startup.join();
+        }
+    }
 };
 
 Application::Application(int argc, char** argv) 
@@ -27,39 +478,136 @@ Application::Application(int argc, char** argv)
 Application::~Application() = default;
 
 bool Application::initialize() {
-    // Initialize FLTK
-    Fl::scheme("gtk+");
-    Fl::visual(FL_DOUBLE | FL_RGB);
-    
-    // Create config manager
-    pImpl->config_manager = std::make_unique<ConfigManager>();
-    if (!pImpl->config_manager->load_config("config/default.json")) {
-        std::cerr << "Failed to load configuration" << std::endl;
-        return false;
+    Impl* impl = pImpl.get();
+    {
+        StartupTrace::Phase phase(impl->startup, "fltk");
+        Fl::scheme("gtk+");
+        Fl::visual(FL_DOUBLE | FL_RGB);
+        // Enables Fl::awake() from the network and startup threads
+        Fl::lock();
     }
     
-    // Initialize audio engine
+    // The independent phases run side by side: parsing the settings, the
+    // sound card, which can take hundreds of milliseconds, and the window,
+    // which shows without waiting for either
+    
+    // Load the settings, data/config/default.json run from the data
+    // directory or the one above it, and the device streams they name
+    const char* settings_path = std::ifstream("config/default.json").good() ? "config/default.json"
+                                                                             : "data/config/default.json";
+    std::shared_future<bool> config_loaded = std::async(std::launch::async, [impl, settings_path] {
+        StartupTrace::Phase phase(impl->startup, "config");
+        return impl->config_store.load(settings_path, "config/device_streams.yaml");
+    }).share();
+    
     pImpl->audio_engine = std::make_unique<AudioEngine>();
-    if (!pImpl->audio_engine->initialize()) {
-        std::cerr << "Failed to initialize audio engine" << std::endl;
-        return false;
+    pImpl->audio_startup = std::thread([impl, config_loaded] { impl->start_audio(config_loaded); });
+    
+    {
+        StartupTrace::Phase phase(impl->startup, "window");
+        pImpl->main_window = std::make_unique<MainWindow>("Audio-Visual Chat Client", 800, 600);
+        pImpl->main_window->on_first_frame([impl] {
+            impl->startup.mark("first_frame");
+            impl->startup_step_done();
+        });
+        pImpl->main_window->show();
     }
     
-    // Create and show main window
-    pImpl->main_window = std::make_unique<MainWindow>(
-        "Audio-Visual Chat Client", 
-        800, 600, 
-        pImpl->audio_engine.get()
-    );
-    pImpl->main_window->show();
+    {
+        StartupTrace::Phase phase(impl->startup, "config.wait");
+        if (!config_loaded.get()) {
+            std::cerr << "Failed to load configuration" << std::endl;
+            return false;
+        }
+    }
+    pImpl->config_reader = pImpl->config_store.make_reader();
+    ConfigStore::Snapshot config = pImpl->config_reader->read();
+    const ConfigManager& settings = config->settings;
     
-    // Initialize protocol manager
+    // Initial voice processing; the audio controls, and settings reloads,
+    // toggle it from here on. Gating is set just before the device opens.
+    pImpl->apply_voice_stages(settings);
+    
+    // Connecting runs beside opening the history; what would otherwise wait
+    // on the network is the protocol thread's
     pImpl->protocol_manager = std::make_unique<ProtocolManager>();
-    if (!pImpl->protocol_manager->initialize(pImpl->config_manager.get())) {
-        std::cerr << "Warning: Failed to initialize communication protocols" << std::endl;
-        // Continue anyway, user might configure it later
+    std::future<bool> protocol_started = std::async(std::launch::async, [impl] {
+        StartupTrace::Phase phase(impl->startup, "protocol");
+        std::unique_ptr<ConfigStore::Reader> reader = impl->config_store.make_reader();
+        ConfigStore::Snapshot config = reader->read();
+        return impl->protocol_manager->initialize(&config->settings);
+    });
+    
+    std::string channel = settings.get_string("chat.default_channel", "lobby");
+    
+    // Persistent history: mapped, not parsed, so opening is quick whatever
+    // its size; expiry runs on the store's writer thread
+    {
+        StartupTrace::Phase phase(impl->startup, "history");
+        pImpl->history_store = std::make_unique<HistoryStore>();
+        if (pImpl->history_store->open(settings.get_string("chat.history_dir", "history"))) {
+            HistoryStore::CompactionPolicy policy;
+            policy.max_age_ms = int64_t(settings.get_int("chat.history_max_age_days", 90)) * 86400000;
+            policy.max_bytes = uint64_t(settings.get_int("chat.history_max_mb", 256)) << 20;
+            int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            pImpl->history_store->compact_async(policy, now_ms);
+            
+            ChatWindow* chat = pImpl->main_window->chat_window();
+            chat->restore_history(*pImpl->history_store,
+                                  static_cast<size_t>(settings.get_int("chat.restore_messages", 2000)));
+            chat->set_history_store(pImpl->history_store.get(), channel);
+            
+            // The search index lives in memory: new records are indexed as
+            // they are logged, while a thread indexes those already on disk
+            HistoryStore* store = pImpl->history_store.get();
+            pImpl->search_index = std::make_unique<SearchIndex>(store->first_seq());
+            SearchIndex* index = pImpl->search_index.get();
+            store->set_append_listener([index](const HistoryStore::Record& record) {
+                index->add(record.seq, record.time_ms, record.channel, record.body);
+            });
+            pImpl->index_catch_up = std::thread([impl, index, store] {
+                index->catch_up(*store, impl->cancel_catch_up);
+            });
+            chat->set_search_index(index);
+        } else {
+            pImpl->history_store.reset();
+            std::cerr << "Warning: Chat history will not be saved" << std::endl;
+        }
+    }
+    
+    {
+        StartupTrace::Phase phase(impl->startup, "protocol.wait");
+        if (!protocol_started.get()) {
+            std::cerr << "Warning: Failed to initialize communication protocols" << std::endl;
+            // Continue anyway, user might configure it later
+        }
+    }
+    if (pImpl->history_store) {
+        pImpl->protocol_manager->set_history_store(pImpl->history_store.get());
     }
     
+    // Incoming messages reach the chat window in batches on the UI thread
+    pImpl->inbox = std::make_unique<MessageInbox>(
+        static_cast<size_t>(settings.get_int("chat.inbox_capacity", 8192)),
+        [impl](std::vector<ChatMessage>& batch) { impl->show_messages(batch); },
+        [](void (*handler)(void*), void* data) { return Fl::awake(handler, data) == 0; });
+    pImpl->protocol_manager->register_message_callback(
+        [impl](const std::string& channel, const std::string& text) {
+            ChatMessage message;
+            message.sender = channel;
+            message.text = text;
+            message.time = std::time(nullptr);
+            impl->inbox->post(std::move(message));
+        });
+    
+    pImpl->main_window->chat_window()->set_on_send_callback(
+        [impl, channel](const std::string& text) {
+            impl->main_window->chat_window()->add_message("", text, true);
+            impl->protocol_manager->send_message(channel, text);
+        });
+    
+    // Voice, gating and the device streams follow in Impl::audio_ready
     return true;
 }
 
@@ -69,11 +617,36 @@ int Application::run() {
 }
 
 void Application::shutdown() {
+    // Closed before audio was ready
+    if (pImpl->audio_startup.joinable()) {
+        pImpl->audio_startup.join();
+    }
+    // No reloads from here on
+    pImpl->config_store.stop_watching();
+    // Nor device switches
+    if (pImpl->device_monitor) {
+        pImpl->device_monitor->stop();
+    }
+    
     if (pImpl->audio_engine) {
         pImpl->audio_engine->stop_stream();
     }
     
     if (pImpl->protocol_manager) {
+        pImpl->stop_voice();
+        pImpl->stop_streaming();
+        pImpl->stop_hls();
         pImpl->protocol_manager->shutdown();
     }
+    
+    if (pImpl->index_catch_up.joinable()) {
+        pImpl->cancel_catch_up = true;
+        pImpl->index_catch_up.join();
+    }
+    
+    // After the protocol thread, the last writer, has stopped
+    if (pImpl->history_store) {
+        pImpl->history_store->set_append_listener(nullptr);
+        pImpl->history_store->close();
+    }
 }
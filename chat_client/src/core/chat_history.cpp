@@ -0,0 +1,213 @@
+#include "chat_history.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <unistd.h>
+
+ChatHistory::ChatHistory() : ChatHistory(Options()) {
+}
+
+ChatHistory::ChatHistory(const Options& options) : options_(options) {
+    options_.chunk_messages = std::max<size_t>(options_.chunk_messages, 1);
+    options_.window_chunks = std::max<size_t>(options_.window_chunks, 2);
+}
+
+ChatHistory::~ChatHistory() {
+    if (page_file_) {
+        std::fclose(page_file_);
+    }
+}
+
+void ChatHistory::attach(Display* display) {
+    display_ = display;
+    if (chunks_.empty()) {
+        window_first_ = window_last_ = 0;
+        return;
+    }
+    window_last_ = chunks_.size() - 1;
+    window_first_ = chunks_.size() > options_.window_chunks ? chunks_.size() - options_.window_chunks : 0;
+    if (display_) {
+        for (size_t i = window_first_; i <= window_last_; ++i) {
+            display_->append(chunk_text(i));
+        }
+    }
+}
+
+bool ChatHistory::live() const {
+    return chunks_.empty() || window_last_ == chunks_.size() - 1;
+}
+
+void ChatHistory::append(std::string_view text) {
+    if (chunks_.empty() || chunks_.back().messages == options_.chunk_messages) {
+        bool was_live = live();
+        if (!chunks_.empty()) {
+            seal_tail();
+        }
+        Chunk chunk;
+        chunk.first_message = message_count_;
+        // Sized like the last chunk, so a burst does not regrow it a
+        // dozen times on its way to full
+        if (!chunks_.empty()) {
+            chunk.text.reserve(chunks_.back().bytes + chunks_.back().bytes / 8);
+        }
+        chunks_.push_back(std::move(chunk));
+        if (was_live) {
+            window_last_ = chunks_.size() - 1;
+            if (window_last_ - window_first_ + 1 > options_.window_chunks) {
+                trim_window_front();
+            }
+        }
+    }
+
+    Chunk& tail = chunks_.back();
+    uint32_t lines = static_cast<uint32_t>(std::count(text.begin(), text.end(), '\n'));
+    tail.text.append(text.data(), text.size());
+    tail.bytes += text.size();
+    tail.messages += 1;
+    tail.lines += lines;
+    message_count_ += 1;
+    line_count_ += lines;
+    resident_bytes_ += text.size();
+
+    if (display_ && live()) {
+        display_->append(text);
+    }
+}
+
+void ChatHistory::seal_tail() {
+    chunks_.back().text.shrink_to_fit();
+    ++resident_sealed_;
+    while (resident_sealed_ > options_.resident_chunks && !page_file_failed_) {
+        page_out_oldest();
+    }
+}
+
+void ChatHistory::page_out_oldest() {
+    if (!page_file_) {
+        page_file_ = std::tmpfile();
+        if (!page_file_) {
+            std::cerr << "Cannot create chat history page file: " << std::strerror(errno)
+                      << "; keeping history in memory" << std::endl;
+            page_file_failed_ = true;
+            return;
+        }
+    }
+
+    Chunk& chunk = chunks_[oldest_resident_];
+    const char* data = chunk.text.data();
+    size_t remaining = chunk.text.size();
+    while (remaining > 0) {
+        ssize_t written = ::pwrite(fileno(page_file_), data, remaining,
+                                   static_cast<off_t>(page_file_size_ + (chunk.text.size() - remaining)));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            std::cerr << "Chat history page-out failed: " << std::strerror(errno)
+                      << "; keeping history in memory" << std::endl;
+            page_file_failed_ = true;
+            return;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+
+    chunk.page_offset = page_file_size_;
+    page_file_size_ += chunk.bytes;
+    resident_bytes_ -= chunk.bytes;
+    std::string().swap(chunk.text);
+    chunk.resident = false;
+    ++oldest_resident_;
+    --resident_sealed_;
+}
+
+std::string ChatHistory::chunk_text(size_t index) {
+    const Chunk& chunk = chunks_[index];
+    if (chunk.resident) {
+        return chunk.text;
+    }
+
+    std::string text(chunk.bytes, '\0');
+    size_t done = 0;
+    while (done < text.size()) {
+        ssize_t got = ::pread(fileno(page_file_), &text[done], text.size() - done,
+                              static_cast<off_t>(chunk.page_offset + done));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            std::cerr << "Chat history page-in failed: " << std::strerror(errno) << std::endl;
+            text.resize(done);
+            break;
+        }
+        done += static_cast<size_t>(got);
+    }
+    ++page_ins_;
+    return text;
+}
+
+void ChatHistory::trim_window_front() {
+    if (display_) {
+        display_->remove_front(chunks_[window_first_].bytes);
+    }
+    ++window_first_;
+}
+
+void ChatHistory::trim_window_back() {
+    if (display_) {
+        display_->remove_back(chunks_[window_last_].bytes);
+    }
+    --window_last_;
+}
+
+bool ChatHistory::page_back() {
+    if (!display_ || chunks_.empty() || window_first_ == 0) {
+        return false;
+    }
+    display_->prepend(chunk_text(window_first_ - 1));
+    --window_first_;
+    if (window_last_ - window_first_ + 1 > options_.window_chunks) {
+        trim_window_back();
+    }
+    return true;
+}
+
+bool ChatHistory::page_forward() {
+    if (!display_ || live()) {
+        return false;
+    }
+    display_->append(chunk_text(window_last_ + 1));
+    ++window_last_;
+    if (window_last_ - window_first_ + 1 > options_.window_chunks) {
+        trim_window_front();
+    }
+    return true;
+}
+
+void ChatHistory::jump_to_latest() {
+    if (!display_ || live()) {
+        return;
+    }
+    size_t shown = 0;
+    for (size_t i = window_first_; i <= window_last_; ++i) {
+        shown += chunks_[i].bytes;
+    }
+    display_->remove_front(shown);
+    attach(display_);
+}
+
+ChatHistory::Stats ChatHistory::get_stats() const {
+    Stats stats;
+    stats.messages = message_count_;
+    stats.lines = line_count_;
+    stats.chunks = chunks_.size();
+    stats.paged_out_chunks = oldest_resident_;
+    stats.resident_chunks = chunks_.size() - oldest_resident_;
+    stats.resident_bytes = resident_bytes_;
+    stats.page_ins = page_ins_;
+    stats.window_first = window_first_;
+    stats.window_last = window_last_;
+    return stats;
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Chunked store of formatted chat lines, plus the window of it that the
+// chat display holds.
+//
+// Messages are appended to the tail chunk. A full chunk is sealed, and
+// once more than resident_chunks sealed chunks are in memory the oldest is
+// paged out to an unlinked temporary file and read back only when the
+// user scrolls back to it. Appending never looks at earlier messages, so
+// it costs the same at the millionth message as at the first.
+//
+// The display never holds more than window_chunks chunks. The store drives
+// it through Display: while the window includes the tail ("live"), appends
+// are passed straight on and the oldest chunk is trimmed off the front as
+// the window fills; page_back() and page_forward() slide the window a
+// chunk at a time.
+class ChatHistory {
+public:
+    struct Options {
+        size_t chunk_messages = 256;
+        size_t resident_chunks = 64;  // Sealed chunks kept in memory
+        size_t window_chunks = 8;     // Chunks shown at once
+    };
+
+    // The text widget. Sizes are in bytes of chunk text.
+    class Display {
+    public:
+        virtual ~Display() = default;
+        virtual void append(std::string_view text) = 0;
+        virtual void prepend(std::string_view text) = 0;
+        virtual void remove_front(size_t bytes) = 0;
+        virtual void remove_back(size_t bytes) = 0;
+    };
+
+    struct Stats {
+        uint64_t messages = 0;
+        uint64_t lines = 0;
+        size_t chunks = 0;
+        size_t resident_chunks = 0;  // Including the tail
+        size_t paged_out_chunks = 0;
+        size_t resident_bytes = 0;   // Chunk text held in memory
+        uint64_t page_ins = 0;       // Chunks read back from the page file
+        size_t window_first = 0;     // Chunks shown, first and last
+        size_t window_last = 0;
+    };
+
+    ChatHistory();
+    explicit ChatHistory(const Options& options);
+    ~ChatHistory();
+
+    ChatHistory(const ChatHistory&) = delete;
+    ChatHistory& operator=(const ChatHistory&) = delete;
+
+    // The display starts empty and follows the tail from here on
+    void attach(Display* display);
+
+    // One formatted message, ending in a newline
+    void append(std::string_view text);
+
+    // Slide the window one chunk towards older or newer messages; false at
+    // either end. Paging forward onto the tail makes the window live again.
+    bool page_back();
+    bool page_forward();
+    // Reloads the window with the newest chunks
+    void jump_to_latest();
+
+    bool live() const;
+    bool at_oldest() const { return window_first_ == 0; }
+    uint64_t message_count() const { return message_count_; }
+    uint64_t line_count() const { return line_count_; }
+    size_t chunk_count() const { return chunks_.size(); }
+
+    // Text of a chunk, read back from the page file if it was paged out
+    std::string chunk_text(size_t index);
+
+    Stats get_stats() const;
+
+private:
+    struct Chunk {
+        uint64_t first_message = 0;
+        uint32_t messages = 0;
+        uint32_t lines = 0;
+        size_t bytes = 0;
+        std::string text;          // Empty once paged out
+        bool resident = true;
+        uint64_t page_offset = 0;  // Where the text is in the page file
+    };
+
+    void seal_tail();
+    void page_out_oldest();
+    void trim_window_front();
+    void trim_window_back();
+
+    Options options_;
+    std::vector<Chunk> chunks_;
+    uint64_t message_count_ = 0;
+    uint64_t line_count_ = 0;
+    size_t resident_sealed_ = 0;
+    size_t oldest_resident_ = 0;  // First sealed chunk still in memory
+    size_t resident_bytes_ = 0;
+    uint64_t page_ins_ = 0;
+
+    std::FILE* page_file_ = nullptr;
+    uint64_t page_file_size_ = 0;
+    bool page_file_failed_ = false;
+
+    Display* display_ = nullptr;
+    size_t window_first_ = 0;
+    size_t window_last_ = 0;
+};
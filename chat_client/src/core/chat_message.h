@@ -0,0 +1,13 @@
+#pragma once
+
+#include <ctime>
+#include <string>
+
+// One line of chat as shown in the chat window. The time is taken when
+// the message arrives, not when the UI gets round to displaying it.
+struct ChatMessage {
+    std::string sender;
+    std::string text;
+    bool is_self = false;
+    std::time_t time = 0;
+};
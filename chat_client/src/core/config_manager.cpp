@@ -1,8 +1,171 @@
 #include "config_manager.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 
+namespace {
+
+// A JSON settings file flattened into dotted keys: {"audio": {"buffer_size":
+// 256}} sets audio.buffer_size=256. Strings are stored unescaped, numbers
+// and booleans as written, arrays as their JSON text; nulls are left out.
+class JsonSettings {
+public:
+    JsonSettings(const std::string& text, std::unordered_map<std::string, std::string>& values)
+        : text_(text), values_(values) {}
+
+    bool parse() {
+        skip_space();
+        if (peek() != '{' || !object("")) {
+            return false;
+        }
+        skip_space();
+        return at_ == text_.size();
+    }
+
+    size_t offset() const { return at_; }
+
+private:
+    char peek() const { return at_ < text_.size() ? text_[at_] : '\0'; }
+
+    void skip_space() {
+        while (at_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[at_]))) {
+            ++at_;
+        }
+    }
+
+    bool object(const std::string& prefix) {
+        ++at_;
+        skip_space();
+        if (peek() == '}') {
+            ++at_;
+            return true;
+        }
+        for (;;) {
+            std::string key;
+            skip_space();
+            if (!string(key)) {
+                return false;
+            }
+            skip_space();
+            if (peek() != ':') {
+                return false;
+            }
+            ++at_;
+            skip_space();
+            if (!value(prefix.empty() ? key : prefix + "." + key)) {
+                return false;
+            }
+            skip_space();
+            char next = peek();
+            ++at_;
+            if (next == '}') {
+                return true;
+            }
+            if (next != ',') {
+                return false;
+            }
+        }
+    }
+
+    bool value(const std::string& key) {
+        if (peek() == '{') {
+            return object(key);
+        }
+        if (peek() == '"') {
+            return string(values_[key]);
+        }
+        size_t start = at_;
+        if (peek() == '[') {
+            // Kept whole; nested strings may hold brackets
+            int depth = 0;
+            do {
+                if (peek() == '"') {
+                    std::string ignored;
+                    if (!string(ignored)) {
+                        return false;
+                    }
+                    continue;
+                }
+                depth += peek() == '[' ? 1 : peek() == ']' ? -1 : 0;
+                ++at_;
+            } while (depth > 0 && at_ < text_.size());
+            if (depth != 0) {
+                return false;
+            }
+        } else {
+            while (at_ < text_.size() && std::strchr(",}] \t\r\n", text_[at_]) == nullptr) {
+                ++at_;
+            }
+            if (at_ == start) {
+                return false;
+            }
+        }
+        std::string raw = text_.substr(start, at_ - start);
+        if (raw != "null") {
+            values_[key] = std::move(raw);
+        }
+        return true;
+    }
+
+    bool string(std::string& out) {
+        if (peek() != '"') {
+            return false;
+        }
+        out.clear();
+        for (++at_; at_ < text_.size(); ++at_) {
+            char c = text_[at_];
+            if (c == '"') {
+                ++at_;
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (++at_ == text_.size()) {
+                return false;
+            }
+            switch (text_[at_]) {
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': {
+                if (at_ + 4 >= text_.size()) {
+                    return false;
+                }
+                unsigned code = static_cast<unsigned>(std::strtoul(text_.substr(at_ + 1, 4).c_str(), nullptr, 16));
+                at_ += 4;
+                // UTF-8; surrogate pairs are not joined
+                if (code < 0x80) {
+                    out += static_cast<char>(code);
+                } else if (code < 0x800) {
+                    out += static_cast<char>(0xC0 | code >> 6);
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                } else {
+                    out += static_cast<char>(0xE0 | code >> 12);
+                    out += static_cast<char>(0x80 | (code >> 6 & 0x3F));
+                    out += static_cast<char>(0x80 | (code & 0x3F));
+                }
+                break;
+            }
+            default: out += text_[at_]; break;
+            }
+        }
+        return false;
+    }
+
+    const std::string& text_;
+    std::unordered_map<std::string, std::string>& values_;
+    size_t at_ = 0;
+};
+
+} // namespace
+
 ConfigManager::ConfigManager() = default;
 ConfigManager::~ConfigManager() = default;
 
@@ -14,8 +177,23 @@ bool ConfigManager::load_config(const std::string& file_path) {
     }
 
     config_values_.clear();
+    std::ostringstream contents;
+    contents << file.rdbuf();
+    const std::string text = contents.str();
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first != std::string::npos && text[first] == '{') {
+        JsonSettings json(text, config_values_);
+        if (!json.parse()) {
+            std::cerr << "Invalid JSON in " << file_path << " at offset " << json.offset() << std::endl;
+            config_values_.clear();
+            return false;
+        }
+        return true;
+    }
+
+    std::istringstream lines(text);
     std::string line;
-    while (std::getline(file, line)) {
+    while (std::getline(lines, line)) {
         // Skip comments and empty lines
         if (line.empty() || line[0] == '#') continue;
         
@@ -8,6 +8,8 @@ public:
     ConfigManager();
     ~ConfigManager();
 
+    // Reads key=value lines, or a JSON object whose nested keys are joined
+    // with dots ("audio.buffer_size"), as in data/config/default.json
     bool load_config(const std::string& file_path);
     bool save_config(const std::string& file_path);
     
@@ -21,6 +23,9 @@ public:
     void set_float(const std::string& key, float value);
     void set_string(const std::string& key, const std::string& value);
 
+    // Every setting, as text
+    const std::unordered_map<std::string, std::string>& values() const { return config_values_; }
+
 private:
     std::unordered_map<std::string, std::string> config_values_;
 };
@@ -0,0 +1,416 @@
+#include "config_schema.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr int kPending = -1;  // A node whose first line has not been read
+
+// A mapping or sequence being filled, innermost last
+struct Frame {
+    int indent;         // Column of its lines, or kPending
+    int parent_indent;  // Column of the key or "- " that opened it
+    bool keyed;         // Opened by a key, so a sequence may share its column
+    void* object;
+    const ConfigSchema* schema;
+    size_t items;       // Of a sequence, so far
+};
+
+bool is_space(char c) {
+    return c == ' ' || c == '\t';
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && is_space(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && is_space(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+bool is_item(std::string_view content) {
+    return content[0] == '-' && (content.size() == 1 || content[1] == ' ');
+}
+
+// The first c outside quotes, preceded by a space or the start if
+// space_before and followed by a space or the end if space_after; npos if
+// none. A quote only opens a scalar where one can start.
+size_t find_unquoted(std::string_view text, char c, bool space_before, bool space_after) {
+    char quote = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+        char at = text[i];
+        if (quote) {
+            if (at == '\\' && quote == '"') {
+                ++i;
+            } else if (at == quote) {
+                quote = 0;
+            }
+        } else if ((at == '"' || at == '\'') && (i == 0 || is_space(text[i - 1]) || text[i - 1] == '['
+                                                  || text[i - 1] == ',')) {
+            quote = at;
+        } else if (at == c && (!space_before || i == 0 || is_space(text[i - 1]))
+                   && (!space_after || i + 1 == text.size() || is_space(text[i + 1]))) {
+            return i;
+        }
+    }
+    return std::string_view::npos;
+}
+
+// A line's content without its comment
+std::string_view strip_comment(std::string_view content) {
+    return trim(content.substr(0, find_unquoted(content, '#', true, false)));
+}
+
+class Parser {
+public:
+    Parser(std::string& error, std::vector<std::string>* unknown_keys)
+        : error_(error), unknown_keys_(unknown_keys) {}
+
+    bool parse(std::string_view text, void* object, const ConfigSchema& schema) {
+        frames_.push_back({ kPending, -1, false, object, &schema, 0 });
+        while (!text.empty()) {
+            size_t end = text.find('\n');
+            std::string_view line = text.substr(0, end);
+            text.remove_prefix(end == std::string_view::npos ? text.size() : end + 1);
+            ++line_number_;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            size_t indent = line.find_first_not_of(' ');
+            if (indent == std::string_view::npos) {
+                continue;
+            }
+            if (line[indent] == '\t') {
+                return fail("tabs are not allowed in indentation");
+            }
+            std::string_view content = strip_comment(line.substr(indent));
+            if (content.empty() || content == "---") {
+                continue;
+            }
+            if (content == "...") {
+                break;
+            }
+            if (!parse_line(static_cast<int>(indent), content)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    bool parse_line(int indent, std::string_view content) {
+        bool item = is_item(content);
+        if (skipping_) {
+            if (indent > skip_indent_ || (item && indent == skip_indent_)) {
+                return true;
+            }
+            skipping_ = false;
+        }
+
+        // A node takes its first line if it is deeper than the key, or a
+        // sequence item in the key's column; otherwise the key had nothing
+        // under it and its defaults stand
+        Frame& open = frames_.back();
+        if (open.indent == kPending) {
+            if (indent > open.parent_indent
+                || (item && open.keyed && indent == open.parent_indent
+                    && open.schema->kind == ConfigSchema::Kind::SEQUENCE)) {
+                open.indent = indent;
+            } else {
+                frames_.pop_back();
+            }
+        }
+        // Closes the nodes the line is not in. A sequence in its key's
+        // column ends at the next key there.
+        while (frames_.size() > 1) {
+            const Frame& frame = frames_.back();
+            if (frame.indent < indent || (frame.indent == indent && (item || frame.indent != frame.parent_indent))) {
+                break;
+            }
+            frames_.pop_back();
+        }
+
+        const Frame& frame = frames_.back();
+        if (frame.indent != indent) {
+            return fail("indentation does not match any open block");
+        }
+        switch (frame.schema->kind) {
+        case ConfigSchema::Kind::MAPPING:
+            if (item) {
+                return fail("expected a key, not a sequence item");
+            }
+            return parse_entry(indent, content);
+        case ConfigSchema::Kind::SEQUENCE:
+            if (!item) {
+                return fail("expected a \"- \" sequence item");
+            }
+            return parse_item(indent, content);
+        case ConfigSchema::Kind::SCALAR:
+            break;
+        }
+        return fail(std::string("expected ") + frame.schema->type_name + " on its key's line");
+    }
+
+    // "key: value" or "key:" in the innermost mapping
+    bool parse_entry(int indent, std::string_view content) {
+        size_t colon = find_unquoted(content, ':', false, true);
+        if (colon == std::string_view::npos) {
+            return fail("expected \"key: value\"");
+        }
+        std::string_view key = trim(content.substr(0, colon));
+        if (key.size() >= 2 && (key.front() == '"' || key.front() == '\'') && key.back() == key.front()) {
+            key = key.substr(1, key.size() - 2);
+        }
+        std::string_view value = trim(content.substr(colon + 1));
+
+        const Frame& frame = frames_.back();
+        const ConfigField* field = frame.schema->find(key);
+        if (!field) {
+            if (unknown_keys_) {
+                unknown_keys_->push_back("line " + std::to_string(line_number_) + ": " + std::string(key));
+            }
+            if (value.empty()) {
+                skipping_ = true;
+                skip_indent_ = indent;
+            }
+            return true;
+        }
+        void* member = field->member(frame.object);
+        if (value.empty()) {
+            frames_.push_back({ kPending, indent, true, member, field->schema, 0 });
+            return true;
+        }
+        return parse_value(member, *field->schema, value);
+    }
+
+    // "- value", "- key: value" or "-" in the innermost sequence
+    bool parse_item(int indent, std::string_view content) {
+        Frame& frame = frames_.back();
+        if (frame.items == 0) {
+            frame.schema->clear(frame.object);
+        }
+        void* item = frame.schema->item(frame.object, frame.items++);
+        if (!item) {
+            return fail("more items than the sequence holds");
+        }
+        const ConfigSchema& schema = *frame.schema->item_schema;
+        std::string_view rest = content.substr(1);
+        size_t gap = rest.find_first_not_of(' ');
+        if (gap == std::string_view::npos) {
+            frames_.push_back({ kPending, indent, false, item, &schema, 0 });
+            return true;
+        }
+        rest.remove_prefix(gap);
+        if (is_item(rest)) {
+            return fail("nested sequences on one line are not supported");
+        }
+        if (schema.kind == ConfigSchema::Kind::MAPPING && rest[0] != '[' && rest[0] != '{'
+            && find_unquoted(rest, ':', false, true) != std::string_view::npos) {
+            // The item's first key; the rest line up under it
+            int column = indent + 1 + static_cast<int>(gap);
+            frames_.push_back({ column, indent, false, item, &schema, 0 });
+            return parse_entry(column, rest);
+        }
+        return parse_value(item, schema, rest);
+    }
+
+    // A value on its key's or item's line
+    bool parse_value(void* object, const ConfigSchema& schema, std::string_view text) {
+        if (text == "~" || text == "null") {
+            return true;
+        }
+        switch (text[0]) {
+        case '[':
+            if (schema.kind != ConfigSchema::Kind::SEQUENCE) {
+                return mismatch(schema, text);
+            }
+            return parse_flow(object, schema, text);
+        case '{':
+            return fail("flow mappings are not supported");
+        case '&':
+        case '*':
+        case '!':
+        case '|':
+        case '>':
+            return fail("anchors, aliases, tags and block scalars are not supported");
+        }
+        if (schema.kind != ConfigSchema::Kind::SCALAR) {
+            return mismatch(schema, text);
+        }
+        std::string_view value;
+        if (!unquote(text, value)) {
+            return false;
+        }
+        return schema.parse(object, value) || mismatch(schema, text);
+    }
+
+    // "[a, b, c]", of scalars
+    bool parse_flow(void* object, const ConfigSchema& schema, std::string_view text) {
+        if (text.back() != ']') {
+            return fail("expected ']' at the end of the line");
+        }
+        const ConfigSchema& item_schema = *schema.item_schema;
+        if (item_schema.kind != ConfigSchema::Kind::SCALAR) {
+            return fail(std::string("expected a block sequence of ") + item_schema.type_name);
+        }
+        schema.clear(object);
+        std::string_view rest = trim(text.substr(1, text.size() - 2));
+        for (size_t index = 0; !rest.empty(); ++index) {
+            size_t comma = find_unquoted(rest, ',', false, false);
+            std::string_view entry = trim(rest.substr(0, comma));
+            if (entry.empty() || entry[0] == '[') {
+                return fail(entry.empty() ? "empty item in a flow sequence" : "nested flow sequences are not supported");
+            }
+            void* item = schema.item(object, index);
+            if (!item) {
+                return fail("more items than the sequence holds");
+            }
+            if (!parse_value(item, item_schema, entry)) {
+                return false;
+            }
+            rest.remove_prefix(comma == std::string_view::npos ? rest.size() : comma + 1);
+        }
+        return true;
+    }
+
+    // A scalar's text without its quotes. Unescaped, it is a view of the
+    // document; with escapes, of scratch_ until the next scalar.
+    bool unquote(std::string_view text, std::string_view& value) {
+        char quote = text[0];
+        if (quote != '"' && quote != '\'') {
+            value = text;
+            return true;
+        }
+        if (text.size() < 2 || text.back() != quote) {
+            return fail("unterminated quoted scalar");
+        }
+        std::string_view body = text.substr(1, text.size() - 2);
+        size_t special = quote == '"' ? body.find_first_of("\"\\") : body.find('\'');
+        if (special == std::string_view::npos) {
+            value = body;
+            return true;
+        }
+        scratch_.assign(body.data(), special);
+        for (size_t i = special; i < body.size(); ++i) {
+            char c = body[i];
+            if (c == '\'' && quote == '\'') {
+                if (i + 1 == body.size() || body[++i] != '\'') {
+                    return fail("unescaped quote in a single-quoted scalar");
+                }
+            } else if (c == '"' && quote == '"') {
+                return fail("unescaped quote in a double-quoted scalar");
+            } else if (c == '\\' && quote == '"') {
+                if (++i == body.size()) {
+                    return fail("unterminated escape");
+                }
+                switch (body[i]) {
+                case 'n': c = '\n'; break;
+                case 't': c = '\t'; break;
+                case '0': c = '\0'; break;
+                case '\\':
+                case '"':
+                case '/':
+                    c = body[i];
+                    break;
+                default:
+                    return fail(std::string("unknown escape \\") + body[i]);
+                }
+            }
+            scratch_ += c;
+        }
+        value = scratch_;
+        return true;
+    }
+
+    bool mismatch(const ConfigSchema& schema, std::string_view text) {
+        return fail(std::string("expected ") + schema.type_name + ", got " + std::string(text));
+    }
+
+    bool fail(const std::string& message) {
+        error_ = "line " + std::to_string(line_number_) + ": " + message;
+        return false;
+    }
+
+    std::string& error_;
+    std::vector<std::string>* unknown_keys_;
+    std::vector<Frame> frames_;
+    std::string scratch_;
+    size_t line_number_ = 0;
+    // Under an unknown key: lines deeper than it, or items in its column
+    bool skipping_ = false;
+    int skip_indent_ = 0;
+};
+
+} // namespace
+
+const ConfigField* ConfigSchema::find(std::string_view name) const {
+    const ConfigField* end = fields + field_count;
+    const ConfigField* field = std::lower_bound(
+        fields, end, name, [](const ConfigField& entry, std::string_view key) { return entry.name < key; });
+    return field != end && field->name == name ? field : nullptr;
+}
+
+bool parse_config_bool(void* object, std::string_view text) {
+    constexpr std::string_view kTrue[] = { "true", "True", "TRUE", "yes", "Yes", "on", "On" };
+    constexpr std::string_view kFalse[] = { "false", "False", "FALSE", "no", "No", "off", "Off" };
+    bool& value = *static_cast<bool*>(object);
+    if (std::find(std::begin(kTrue), std::end(kTrue), text) != std::end(kTrue)) {
+        value = true;
+        return true;
+    }
+    if (std::find(std::begin(kFalse), std::end(kFalse), text) != std::end(kFalse)) {
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+bool parse_config_string(void* object, std::string_view text) {
+    static_cast<std::string*>(object)->assign(text.data(), text.size());
+    return true;
+}
+
+bool parse_config(std::string_view text, void* object, const ConfigSchema& schema, std::string& error,
+                  std::vector<std::string>* unknown_keys) {
+    Parser parser(error, unknown_keys);
+    return parser.parse(text, object, schema);
+}
+
+void diff_config(const void* before, const void* after, const ConfigSchema& schema, const std::string& prefix,
+                 std::vector<std::string>& changed) {
+    // The accessors take mutable objects but only mutate a sequence asked
+    // for an item past its end
+    void* old_object = const_cast<void*>(before);
+    void* new_object = const_cast<void*>(after);
+    auto path = [&prefix](std::string_view name) {
+        return prefix.empty() ? std::string(name) : prefix + '.' + std::string(name);
+    };
+    switch (schema.kind) {
+    case ConfigSchema::Kind::SCALAR:
+        if (!schema.equal(before, after)) {
+            changed.push_back(prefix);
+        }
+        break;
+    case ConfigSchema::Kind::MAPPING:
+        for (size_t i = 0; i < schema.field_count; ++i) {
+            const ConfigField& field = schema.fields[i];
+            diff_config(field.member(old_object), field.member(new_object), *field.schema, path(field.name),
+                        changed);
+        }
+        break;
+    case ConfigSchema::Kind::SEQUENCE: {
+        size_t count = schema.size(before);
+        if (count != schema.size(after)) {
+            changed.push_back(prefix);
+            break;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            diff_config(schema.item(old_object, i), schema.item(new_object, i), *schema.item_schema,
+                        path(std::to_string(i)), changed);
+        }
+        break;
+    }
+    }
+}
@@ -0,0 +1,199 @@
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Typed configuration: a YAML document parsed in one pass straight into
+// C++ structs, with no document tree or string map in between. After
+// loading, settings are plain fields; nothing is looked up by name or
+// converted from text again.
+//
+// A struct is bound by specializing ConfigType for it with a constexpr
+// table of its keys, sorted by name:
+//
+//     template <> struct ConfigType<HlsProtocolConfig> {
+//         static constexpr ConfigField fields[] = {
+//             config_field<&HlsProtocolConfig::http_port>("http_port"),
+//             config_field<&HlsProtocolConfig::segment_duration>("segment_duration"),
+//         };
+//         static constexpr ConfigSchema schema = config_mapping(fields);
+//     };
+//
+// config_field() takes each member's schema from its type, so a member of
+// a type with no ConfigType does not compile, and config_mapping() refuses
+// a table out of order or with a key twice at compile time.
+//
+// The parser takes the block style the config files use: nested mappings,
+// "- " sequences (of scalars or mappings), flow sequences of scalars
+// ("[8554, 8654]"), plain, single- and double-quoted scalars and comments.
+// Anchors, tags, flow mappings and multi-line scalars are rejected.
+
+struct ConfigField;
+
+// How one node of a document binds to an object
+struct ConfigSchema {
+    enum class Kind { SCALAR, MAPPING, SEQUENCE };
+
+    Kind kind;
+    const char* type_name;  // For errors: "an integer", "a mapping"
+    // SCALAR: parses text into the object; false if it is not valid
+    bool (*parse)(void* object, std::string_view text);
+    bool (*equal)(const void* a, const void* b);
+    // MAPPING: the keys, sorted by name
+    const ConfigField* fields;
+    size_t field_count;
+    // SEQUENCE: empties the object, then gives the object for each item in
+    // turn, null once it holds no more. Items below size() are returned as
+    // they are.
+    void (*clear)(void* object);
+    void* (*item)(void* object, size_t index);
+    size_t (*size)(const void* object);
+    const ConfigSchema* item_schema;
+
+    // The key's field, or null
+    const ConfigField* find(std::string_view name) const;
+};
+
+struct ConfigField {
+    std::string_view name;
+    const ConfigSchema* schema;
+    void* (*member)(void* object);
+};
+
+// Specialized with a static constexpr ConfigSchema schema for every type a
+// document can hold
+template <typename T>
+struct ConfigType;
+
+template <typename T>
+bool config_equal(const void* a, const void* b) {
+    return *static_cast<const T*>(a) == *static_cast<const T*>(b);
+}
+
+template <typename T>
+constexpr ConfigSchema config_scalar(const char* type_name, bool (*parse)(void*, std::string_view)) {
+    return { ConfigSchema::Kind::SCALAR, type_name, parse, &config_equal<T>, nullptr, 0, nullptr, nullptr, nullptr,
+             nullptr };
+}
+
+constexpr ConfigSchema config_sequence(const char* type_name, void (*clear)(void*), void* (*item)(void*, size_t),
+                                       size_t (*size)(const void*), const ConfigSchema* item_schema) {
+    return { ConfigSchema::Kind::SEQUENCE, type_name, nullptr, nullptr, nullptr, 0, clear, item, size, item_schema };
+}
+
+template <size_t N>
+constexpr ConfigSchema config_mapping(const ConfigField (&fields)[N]) {
+    for (size_t i = 1; i < N; ++i) {
+        if (!(fields[i - 1].name < fields[i].name)) {
+            // Not a constant expression, so the table does not compile
+            throw "config fields must be sorted by name, each once";
+        }
+    }
+    return { ConfigSchema::Kind::MAPPING, "a mapping", nullptr, nullptr, fields, N, nullptr, nullptr, nullptr, nullptr };
+}
+
+// A pointer to member's type, and the member of an object
+template <auto Member>
+struct ConfigMember;
+
+template <typename S, typename T, T S::*Member>
+struct ConfigMember<Member> {
+    using Type = T;
+    static void* get(void* object) { return &(static_cast<S*>(object)->*Member); }
+};
+
+template <typename T>
+bool parse_config_integer(void* object, std::string_view text) {
+    // Widest of its signedness, so out of range is seen rather than wrapped
+    using Wide = std::conditional_t<std::numeric_limits<T>::is_signed, long long, unsigned long long>;
+    Wide value = 0;
+    const char* end = text.data() + text.size();
+    auto [at, error] = std::from_chars(text.data(), end, value);
+    if (error != std::errc() || at != end || value < Wide(std::numeric_limits<T>::min())
+        || value > Wide(std::numeric_limits<T>::max())) {
+        return false;
+    }
+    *static_cast<T*>(object) = static_cast<T>(value);
+    return true;
+}
+
+bool parse_config_bool(void* object, std::string_view text);
+bool parse_config_string(void* object, std::string_view text);
+
+// A table entry binding the key name to member
+template <auto Member>
+constexpr ConfigField config_field(std::string_view name) {
+    using Traits = ConfigMember<Member>;
+    return { name, &ConfigType<typename Traits::Type>::schema, &Traits::get };
+}
+
+template <>
+struct ConfigType<bool> {
+    static constexpr ConfigSchema schema = config_scalar<bool>("a boolean", &parse_config_bool);
+};
+
+template <>
+struct ConfigType<uint16_t> {
+    static constexpr ConfigSchema schema = config_scalar<uint16_t>("a port number", &parse_config_integer<uint16_t>);
+};
+
+template <>
+struct ConfigType<unsigned> {
+    static constexpr ConfigSchema schema = config_scalar<unsigned>("an unsigned integer",
+                                                                   &parse_config_integer<unsigned>);
+};
+
+template <>
+struct ConfigType<int> {
+    static constexpr ConfigSchema schema = config_scalar<int>("an integer", &parse_config_integer<int>);
+};
+
+template <>
+struct ConfigType<std::string> {
+    static constexpr ConfigSchema schema = config_scalar<std::string>("a string", &parse_config_string);
+};
+
+template <typename T>
+struct ConfigType<std::vector<T>> {
+    static void clear(void* object) { static_cast<std::vector<T>*>(object)->clear(); }
+    static void* item(void* object, size_t index) {
+        auto& items = *static_cast<std::vector<T>*>(object);
+        if (index == items.size()) {
+            items.emplace_back();
+        }
+        return &items[index];
+    }
+    static size_t size(const void* object) { return static_cast<const std::vector<T>*>(object)->size(); }
+    static constexpr ConfigSchema schema = config_sequence("a sequence", &clear, &item, &size,
+                                                           &ConfigType<T>::schema);
+};
+
+// Parses text into object. On failure error holds the line and reason, and
+// object may be partly filled. Keys that are not in a table are skipped,
+// with what they held, and listed in unknown_keys as "line N: key".
+bool parse_config(std::string_view text, void* object, const ConfigSchema& schema, std::string& error,
+                  std::vector<std::string>* unknown_keys = nullptr);
+
+template <typename T>
+bool parse_config(std::string_view text, T& object, std::string& error,
+                  std::vector<std::string>* unknown_keys = nullptr) {
+    return parse_config(text, &object, ConfigType<T>::schema, error, unknown_keys);
+}
+
+// Appends to changed the dotted path of each scalar that differs between
+// before and after, under prefix ("protocols.hls.playlist_size",
+// "audio_devices.0.protocols.1.port"). A sequence that changed length is
+// listed as a whole.
+void diff_config(const void* before, const void* after, const ConfigSchema& schema, const std::string& prefix,
+                 std::vector<std::string>& changed);
+
+template <typename T>
+void diff_config(const T& before, const T& after, const std::string& prefix, std::vector<std::string>& changed) {
+    diff_config(&before, &after, ConfigType<T>::schema, prefix, changed);
+}
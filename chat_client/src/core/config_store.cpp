@@ -0,0 +1,331 @@
+#include "config_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+namespace {
+
+// While old snapshots wait on a reader, the watcher looks again this often
+constexpr int kReclaimRetryMs = 100;
+
+using Clock = std::chrono::steady_clock;
+
+// "a.b" is at or under "a" and "a.b", not under "a.bc"
+bool under(const std::string& key, const std::string& prefix) {
+    return key.compare(0, prefix.size(), prefix) == 0
+        && (key.size() == prefix.size() || key[prefix.size()] == '.');
+}
+
+// The directory to watch for a file, and the name to look for in it
+std::pair<std::string, std::string> split_path(const std::string& path) {
+    size_t slash = path.rfind('/');
+    if (slash == std::string::npos) {
+        return { ".", path };
+    }
+    return { slash == 0 ? "/" : path.substr(0, slash), path.substr(slash + 1) };
+}
+
+} // namespace
+
+ConfigStore::Snapshot::~Snapshot() {
+    if (reader_) {
+        reader_->release();
+    }
+}
+
+ConfigStore::Reader::~Reader() {
+    std::lock_guard<std::mutex> lock(store_.slots_mutex_);
+    store_.slots_[slot_].entered.store(0, std::memory_order_release);
+    store_.slot_taken_[slot_] = false;
+}
+
+ConfigStore::Snapshot ConfigStore::Reader::read() {
+    // The slot is set before the pointer is loaded, both seq_cst, so a
+    // writer that swaps the pointer afterwards sees the slot and keeps
+    // whatever was loaded
+    if (depth_++ == 0) {
+        store_.slots_[slot_].entered.store(store_.epoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    }
+    return Snapshot(this, store_.current_.load(std::memory_order_seq_cst));
+}
+
+void ConfigStore::Reader::release() {
+    if (--depth_ == 0) {
+        store_.slots_[slot_].entered.store(0, std::memory_order_release);
+    }
+}
+
+ConfigStore::ConfigStore() = default;
+
+ConfigStore::~ConfigStore() {
+    stop_watching();
+    delete current_.load();
+}
+
+std::unique_ptr<ConfigStore::Reader> ConfigStore::make_reader() {
+    std::lock_guard<std::mutex> lock(slots_mutex_);
+    for (size_t i = 0; i < kMaxReaders; ++i) {
+        if (!slot_taken_[i]) {
+            slot_taken_[i] = true;
+            return std::unique_ptr<Reader>(new Reader(*this, i));
+        }
+    }
+    std::cerr << "Config readers exhausted (" << kMaxReaders << ")" << std::endl;
+    return nullptr;
+}
+
+bool ConfigStore::load_snapshot(ConfigSnapshot& snapshot, bool streams_required) const {
+    if (!snapshot.settings.load_config(settings_path_)) {
+        return false;
+    }
+    if (DeviceStreamsConfig::load(streams_path_, snapshot.streams)) {
+        snapshot.streams_loaded = true;
+        return true;
+    }
+    snapshot.streams = DeviceStreamsConfig();
+    return !streams_required;
+}
+
+bool ConfigStore::load(const std::string& settings_path, const std::string& streams_path) {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    settings_path_ = settings_path;
+    auto snapshot = std::make_unique<ConfigSnapshot>();
+    if (!snapshot->settings.load_config(settings_path_)) {
+        return false;
+    }
+    streams_path_ = snapshot->settings.get_string("streams.config", streams_path);
+    snapshot->streams_loaded = DeviceStreamsConfig::load(streams_path_, snapshot->streams);
+    if (!snapshot->streams_loaded) {
+        // No devices, so nothing is streamed until the file is fixed
+        std::cerr << "Warning: Device streams are off" << std::endl;
+        snapshot->streams = DeviceStreamsConfig();
+    }
+    snapshot->version = version_.load(std::memory_order_relaxed) + 1;
+    publish(std::move(snapshot));
+    return true;
+}
+
+bool ConfigStore::reload() {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    // Only reloads swap the pointer, and they hold the lock
+    const ConfigSnapshot* current = current_.load(std::memory_order_acquire);
+    if (!current) {
+        return false;
+    }
+    auto snapshot = std::make_unique<ConfigSnapshot>();
+    if (!load_snapshot(*snapshot, current->streams_loaded)) {
+        failed_.fetch_add(1, std::memory_order_relaxed);
+        std::cerr << "Configuration reload failed; keeping version " << current->version << std::endl;
+        return false;
+    }
+    std::vector<std::string> changed = changed_keys(*current, *snapshot);
+    if (changed.empty()) {
+        unchanged_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    snapshot->version = current->version + 1;
+    const ConfigSnapshot& published = *snapshot;
+    publish(std::move(snapshot));
+    reloads_.fetch_add(1, std::memory_order_relaxed);
+    // Still current: nothing else publishes while the lock is held
+    notify(published, changed);
+    return true;
+}
+
+void ConfigStore::publish(std::unique_ptr<ConfigSnapshot> snapshot) {
+    version_.store(snapshot->version, std::memory_order_relaxed);
+    const ConfigSnapshot* old = current_.exchange(snapshot.release(), std::memory_order_seq_cst);
+    if (old) {
+        // Readers that enter from here on get the new snapshot; those that
+        // entered before the epoch moved may hold the old one
+        uint64_t retired_at = epoch_.fetch_add(1, std::memory_order_seq_cst) + 1;
+        retired_.emplace_back(retired_at, std::unique_ptr<const ConfigSnapshot>(old));
+    }
+    reclaim();
+}
+
+void ConfigStore::reclaim() {
+    uint64_t oldest = std::numeric_limits<uint64_t>::max();
+    for (const ReaderSlot& slot : slots_) {
+        uint64_t entered = slot.entered.load(std::memory_order_seq_cst);
+        if (entered) {
+            oldest = std::min(oldest, entered);
+        }
+    }
+    size_t before = retired_.size();
+    retired_.erase(std::remove_if(retired_.begin(), retired_.end(),
+                                  [oldest](const auto& retired) { return retired.first <= oldest; }),
+                   retired_.end());
+    freed_.fetch_add(before - retired_.size(), std::memory_order_relaxed);
+    held_.store(retired_.size(), std::memory_order_relaxed);
+}
+
+bool ConfigStore::retired_empty() {
+    std::lock_guard<std::mutex> lock(reload_mutex_);
+    reclaim();
+    return retired_.empty();
+}
+
+std::vector<std::string> ConfigStore::changed_keys(const ConfigSnapshot& before, const ConfigSnapshot& after) {
+    std::vector<std::string> changed;
+    const auto& old_values = before.settings.values();
+    const auto& new_values = after.settings.values();
+    for (const auto& [key, value] : new_values) {
+        auto it = old_values.find(key);
+        if (it == old_values.end() || it->second != value) {
+            changed.push_back(key);
+        }
+    }
+    for (const auto& entry : old_values) {
+        if (!new_values.count(entry.first)) {
+            changed.push_back(entry.first);
+        }
+    }
+    std::sort(changed.begin(), changed.end());
+    DeviceStreamsConfig::diff(before.streams, after.streams, kStreamsPrefix, changed);
+    return changed;
+}
+
+uint64_t ConfigStore::subscribe(std::vector<std::string> prefixes, Listener listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    uint64_t id = next_subscription_++;
+    subscriptions_.push_back({ id, std::move(prefixes), std::move(listener) });
+    return id;
+}
+
+void ConfigStore::unsubscribe(uint64_t id) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    subscriptions_.erase(std::remove_if(subscriptions_.begin(), subscriptions_.end(),
+                                        [id](const Subscription& entry) { return entry.id == id; }),
+                         subscriptions_.end());
+}
+
+void ConfigStore::notify(const ConfigSnapshot& snapshot, const std::vector<std::string>& changed) {
+    std::lock_guard<std::mutex> lock(listeners_mutex_);
+    std::vector<std::string> matched;
+    for (const Subscription& subscription : subscriptions_) {
+        matched.clear();
+        for (const std::string& key : changed) {
+            // A whole sequence that changed length covers every key in it
+            bool wanted = std::any_of(subscription.prefixes.begin(), subscription.prefixes.end(),
+                                      [&key](const std::string& prefix) {
+                                          return prefix.empty() || under(key, prefix) || under(prefix, key);
+                                      });
+            if (wanted) {
+                matched.push_back(key);
+            }
+        }
+        if (!matched.empty()) {
+            subscription.listener(snapshot, matched);
+        }
+    }
+}
+
+bool ConfigStore::watch() {
+    if (watcher_.joinable()) {
+        return true;
+    }
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (inotify_fd < 0 || stop_fd_ < 0) {
+        std::cerr << "Config watch setup failed: " << std::strerror(errno) << std::endl;
+        if (inotify_fd >= 0) {
+            close(inotify_fd);
+        }
+        if (stop_fd_ >= 0) {
+            close(stop_fd_);
+            stop_fd_ = -1;
+        }
+        return false;
+    }
+    // The directories, not the files: an editor that saves by renaming a
+    // new file over the old leaves a watch on the file itself behind
+    for (const std::string* path : { &settings_path_, &streams_path_ }) {
+        std::string directory = split_path(*path).first;
+        if (inotify_add_watch(inotify_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+            std::cerr << "Cannot watch " << directory << ": " << std::strerror(errno) << std::endl;
+        }
+    }
+    watcher_ = std::thread(&ConfigStore::watch_loop, this, inotify_fd);
+    return true;
+}
+
+void ConfigStore::stop_watching() {
+    if (!watcher_.joinable()) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(stop_fd_, &one, sizeof(one)) != static_cast<ssize_t>(sizeof(one))) {
+        std::cerr << "Config watch wakeup failed: " << std::strerror(errno) << std::endl;
+    }
+    watcher_.join();
+    close(stop_fd_);
+    stop_fd_ = -1;
+}
+
+void ConfigStore::watch_loop(int inotify_fd) {
+    const std::string settings_name = split_path(settings_path_).second;
+    const std::string streams_name = split_path(streams_path_).second;
+    pollfd fds[2] = { { inotify_fd, POLLIN, 0 }, { stop_fd_, POLLIN, 0 } };
+    alignas(inotify_event) char buffer[4096];
+    bool pending = false;
+    Clock::time_point due;
+
+    for (;;) {
+        int timeout = -1;
+        if (pending) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(due - Clock::now()).count();
+            timeout = static_cast<int>(std::max<decltype(left)>(left, 0));
+        } else if (!retired_empty()) {
+            timeout = kReclaimRetryMs;
+        }
+        int count = poll(fds, 2, timeout);
+        if (count < 0 && errno != EINTR) {
+            std::cerr << "Config watch failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        if (count > 0 && fds[1].revents) {
+            break;
+        }
+        if (count > 0 && (fds[0].revents & POLLIN)) {
+            ssize_t length;
+            while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+                for (ssize_t at = 0; at < length;) {
+                    const auto* event = reinterpret_cast<const inotify_event*>(buffer + at);
+                    at += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+                    // Events were lost: look at the files anyway
+                    bool ours = (event->mask & IN_Q_OVERFLOW)
+                        || (event->len && (settings_name == event->name || streams_name == event->name));
+                    if (ours) {
+                        pending = true;
+                        due = Clock::now() + std::chrono::milliseconds(kSettleMs);
+                    }
+                }
+            }
+        }
+        if (pending && Clock::now() >= due) {
+            pending = false;
+            reload();
+        }
+    }
+    close(inotify_fd);
+}
+
+ConfigStore::Stats ConfigStore::get_stats() const {
+    Stats stats;
+    stats.version = version_.load(std::memory_order_relaxed);
+    stats.reloads = reloads_.load(std::memory_order_relaxed);
+    stats.unchanged = unchanged_.load(std::memory_order_relaxed);
+    stats.failed = failed_.load(std::memory_order_relaxed);
+    stats.freed = freed_.load(std::memory_order_relaxed);
+    stats.held = held_.load(std::memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include "config_manager.h"
+#include "device_streams.h"
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Everything configured, as of one load. Never changed once published.
+struct ConfigSnapshot {
+    uint64_t version = 0;          // 1 for the first load, then one more each reload that changed something
+    ConfigManager settings;        // data/config/default.json
+    DeviceStreamsConfig streams;   // config/device_streams.yaml
+    bool streams_loaded = false;   // False if that file was missing or invalid: no devices
+};
+
+// The current configuration, reloaded while running when its files change.
+//
+// Snapshots are published RCU-style. A reload parses the files, off the
+// threads that read them, into a new snapshot, swaps it in behind an
+// atomic pointer and retires the old one, which is freed once no reader
+// can still hold it. Each thread that reads takes a Reader once; read()
+// is then two atomic stores and two loads, and never waits, locks or
+// allocates, so the audio callback and the network loop may read settings
+// as they go. What read() returns stays valid, and unchanged, until the
+// Snapshot it returned goes.
+//
+// Listeners hear, after each reload, which keys changed: dotted paths into
+// default.json as ConfigManager keys them ("audio.enable_noise_suppression"),
+// and into device_streams.yaml under "device_streams." (see diff_config).
+// A listener is only called when a key it asked for changed.
+class ConfigStore {
+public:
+    static constexpr size_t kMaxReaders = 32;
+    // Writes to the files closer together than this make one reload
+    static constexpr int kSettleMs = 50;
+    // Prefix of the device streams' keys
+    static constexpr const char* kStreamsPrefix = "device_streams";
+
+    // The snapshot and its keys that changed, each under one of the
+    // listener's prefixes or above it
+    using Listener = std::function<void(const ConfigSnapshot& snapshot, const std::vector<std::string>& changed)>;
+
+    struct Stats {
+        uint64_t version = 0;
+        uint64_t reloads = 0;          // Published a new snapshot
+        uint64_t unchanged = 0;        // Files rewritten as they were
+        uint64_t failed = 0;           // Files unreadable or invalid; the snapshot was kept
+        uint64_t freed = 0;            // Old snapshots freed so far
+        uint64_t held = 0;             // Old snapshots a reader may still hold
+    };
+
+    class Reader;
+
+    // The current snapshot as of read(), held while this lives. Move-only;
+    // belongs to the thread of the Reader that made it.
+    class Snapshot {
+    public:
+        Snapshot(Snapshot&& other) noexcept
+            : reader_(std::exchange(other.reader_, nullptr)), snapshot_(other.snapshot_) {}
+        Snapshot& operator=(Snapshot&&) = delete;
+        ~Snapshot();
+
+        const ConfigSnapshot& operator*() const { return *snapshot_; }
+        const ConfigSnapshot* operator->() const { return snapshot_; }
+
+    private:
+        friend class Reader;
+        Snapshot(Reader* reader, const ConfigSnapshot* snapshot) : reader_(reader), snapshot_(snapshot) {}
+
+        Reader* reader_;
+        const ConfigSnapshot* snapshot_;
+    };
+
+    // One thread's access to the snapshots. Snapshots may be nested; they
+    // all stay valid until the outermost goes.
+    class Reader {
+    public:
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // Wait-free. After the store's load().
+        Snapshot read();
+
+    private:
+        friend class ConfigStore;
+        Reader(ConfigStore& store, size_t slot) : store_(store), slot_(slot) {}
+        void release();
+
+        ConfigStore& store_;
+        size_t slot_;
+        unsigned depth_ = 0;
+    };
+
+    ConfigStore();
+    // Stops watching. Every Reader must be gone.
+    ~ConfigStore();
+
+    ConfigStore(const ConfigStore&) = delete;
+    ConfigStore& operator=(const ConfigStore&) = delete;
+
+    // Loads the settings and the device streams file they name under
+    // streams.config, else streams_path, and publishes the first snapshot.
+    // False if the settings do not load; a missing or invalid streams file
+    // leaves no devices.
+    bool load(const std::string& settings_path, const std::string& streams_path);
+    // Loads both files again now, on the calling thread, and publishes
+    // them if anything changed. False, keeping the current snapshot, if
+    // either fails to load: a half-written file never replaces a good one.
+    bool reload();
+
+    // Reloads on a thread of its own whenever either file is written or
+    // replaced (inotify), kSettleMs after the last change. After load().
+    bool watch();
+    void stop_watching();
+
+    // Any thread. Null once kMaxReaders are taken.
+    std::unique_ptr<Reader> make_reader();
+
+    // Calls listener on the reloading thread after each reload that
+    // changes a key at or under any of prefixes ("" for every key). A
+    // listener must not subscribe or unsubscribe. Returns the id for
+    // unsubscribe(), after which the listener is not running and is not
+    // called again.
+    uint64_t subscribe(std::vector<std::string> prefixes, Listener listener);
+    void unsubscribe(uint64_t id);
+
+    Stats get_stats() const;
+
+    // The keys that differ between two snapshots, settings first
+    static std::vector<std::string> changed_keys(const ConfigSnapshot& before, const ConfigSnapshot& after);
+
+private:
+    struct Subscription {
+        uint64_t id;
+        std::vector<std::string> prefixes;
+        Listener listener;
+    };
+
+    bool load_snapshot(ConfigSnapshot& snapshot, bool streams_required) const;
+    void publish(std::unique_ptr<ConfigSnapshot> snapshot);
+    void notify(const ConfigSnapshot& snapshot, const std::vector<std::string>& changed);
+    void reclaim();
+    bool retired_empty();
+    void watch_loop(int inotify_fd);
+
+    std::string settings_path_;
+    std::string streams_path_;
+
+    // Reader side: the current snapshot, and the epoch each reader entered
+    // at, 0 for none. A snapshot retired at epoch E is freed once every
+    // reader is idle or entered at E or later.
+    std::atomic<const ConfigSnapshot*> current_{nullptr};
+    std::atomic<uint64_t> epoch_{1};
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> entered{0};
+    };
+    std::array<ReaderSlot, kMaxReaders> slots_;
+    std::mutex slots_mutex_;
+    std::array<bool, kMaxReaders> slot_taken_{};
+
+    // Writer side: one reload at a time, so the listeners see versions in order
+    std::mutex reload_mutex_;
+    std::vector<std::pair<uint64_t, std::unique_ptr<const ConfigSnapshot>>> retired_;
+    std::mutex listeners_mutex_;
+    std::vector<Subscription> subscriptions_;
+    uint64_t next_subscription_ = 1;
+
+    std::thread watcher_;
+    int stop_fd_ = -1;
+
+    std::atomic<uint64_t> version_{0};
+    std::atomic<uint64_t> reloads_{0};
+    std::atomic<uint64_t> unchanged_{0};
+    std::atomic<uint64_t> failed_{0};
+    std::atomic<uint64_t> freed_{0};
+    std::atomic<uint64_t> held_{0};
+};
@@ -0,0 +1,351 @@
+#include "device_streams.h"
+#include "config_schema.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+namespace {
+
+constexpr std::pair<std::string_view, StreamProtocol> kProtocolNames[] = {
+    { "rtsp", StreamProtocol::RTSP },
+    { "webrtc", StreamProtocol::WEBRTC },
+    { "hls", StreamProtocol::HLS },
+    { "podcast", StreamProtocol::PODCAST },
+};
+
+constexpr std::pair<std::string_view, DeviceDirection> kDirectionNames[] = {
+    { "input", DeviceDirection::INPUT },
+    { "output", DeviceDirection::OUTPUT },
+};
+
+template <typename E, size_t N>
+bool parse_name(const std::pair<std::string_view, E> (&names)[N], void* object, std::string_view text) {
+    for (const auto& [name, value] : names) {
+        if (text == name) {
+            *static_cast<E*>(object) = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+// The key tables. Each lists its struct's keys in name order; the
+// shipped file's keys are all here.
+
+template <>
+struct ConfigType<StreamProtocol> {
+    static bool parse(void* object, std::string_view text) { return parse_name(kProtocolNames, object, text); }
+    static constexpr ConfigSchema schema = config_scalar<StreamProtocol>("rtsp, webrtc, hls or podcast", &parse);
+};
+
+template <>
+struct ConfigType<DeviceDirection> {
+    static bool parse(void* object, std::string_view text) { return parse_name(kDirectionNames, object, text); }
+    static constexpr ConfigSchema schema = config_scalar<DeviceDirection>("input or output", &parse);
+};
+
+template <>
+struct ConfigType<PortRange> {
+    static void clear(void* object) { *static_cast<PortRange*>(object) = PortRange(); }
+    static void* item(void* object, size_t index) {
+        PortRange& range = *static_cast<PortRange*>(object);
+        return index == 0 ? &range.first : index == 1 ? &range.last : nullptr;
+    }
+    static size_t size(const void*) { return 2; }
+    static constexpr ConfigSchema schema = config_sequence("a port range", &clear, &item, &size,
+                                                           &ConfigType<uint16_t>::schema);
+};
+
+template <>
+struct ConfigType<ServerConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&ServerConfig::discovery_enabled>("discovery_enabled"),
+        config_field<&ServerConfig::host>("host"),
+        config_field<&ServerConfig::web_admin_port>("web_admin_port"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<RtspProtocolConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&RtspProtocolConfig::config_file>("config_file"),
+        config_field<&RtspProtocolConfig::default_port_range>("default_port_range"),
+        config_field<&RtspProtocolConfig::enabled>("enabled"),
+        config_field<&RtspProtocolConfig::latency>("latency"),
+        config_field<&RtspProtocolConfig::path_format>("path_format"),
+        config_field<&RtspProtocolConfig::server_binary>("server_binary"),
+        config_field<&RtspProtocolConfig::transport>("transport"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<IceServerConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&IceServerConfig::urls>("urls"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<WebrtcProtocolConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&WebrtcProtocolConfig::default_port_range>("default_port_range"),
+        config_field<&WebrtcProtocolConfig::enabled>("enabled"),
+        config_field<&WebrtcProtocolConfig::ice_servers>("ice_servers"),
+        config_field<&WebrtcProtocolConfig::latency>("latency"),
+        config_field<&WebrtcProtocolConfig::path_format>("path_format"),
+        config_field<&WebrtcProtocolConfig::signaling_port>("signaling_port"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<HlsProtocolConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&HlsProtocolConfig::default_port_range>("default_port_range"),
+        config_field<&HlsProtocolConfig::enabled>("enabled"),
+        config_field<&HlsProtocolConfig::http_port>("http_port"),
+        config_field<&HlsProtocolConfig::latency>("latency"),
+        config_field<&HlsProtocolConfig::path_format>("path_format"),
+        config_field<&HlsProtocolConfig::playlist_size>("playlist_size"),
+        config_field<&HlsProtocolConfig::segment_duration>("segment_duration"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<PodcastProtocolConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&PodcastProtocolConfig::bitrate>("bitrate"),
+        config_field<&PodcastProtocolConfig::default_port>("default_port"),
+        config_field<&PodcastProtocolConfig::enabled>("enabled"),
+        config_field<&PodcastProtocolConfig::format>("format"),
+        config_field<&PodcastProtocolConfig::http_port>("http_port"),
+        config_field<&PodcastProtocolConfig::path_format>("path_format"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<ProtocolsConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&ProtocolsConfig::hls>("hls"),
+        config_field<&ProtocolsConfig::podcast>("podcast"),
+        config_field<&ProtocolsConfig::rtsp>("rtsp"),
+        config_field<&ProtocolsConfig::webrtc>("webrtc"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<DeviceProtocolConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&DeviceProtocolConfig::bitrate>("bitrate"),
+        config_field<&DeviceProtocolConfig::codec>("codec"),
+        config_field<&DeviceProtocolConfig::enabled>("enabled"),
+        config_field<&DeviceProtocolConfig::framerate>("framerate"),
+        config_field<&DeviceProtocolConfig::path>("path"),
+        config_field<&DeviceProtocolConfig::port>("port"),
+        config_field<&DeviceProtocolConfig::resolution>("resolution"),
+        config_field<&DeviceProtocolConfig::type>("type"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<DeviceConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&DeviceConfig::id>("id"),
+        config_field<&DeviceConfig::name>("name"),
+        config_field<&DeviceConfig::protocols>("protocols"),
+        config_field<&DeviceConfig::system_id>("system_id"),
+        config_field<&DeviceConfig::type>("type"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<AudioPresetConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&AudioPresetConfig::bitrate>("bitrate"),
+        config_field<&AudioPresetConfig::codec>("codec"),
+        config_field<&AudioPresetConfig::dtx>("dtx"),
+        config_field<&AudioPresetConfig::fec>("fec"),
+        config_field<&AudioPresetConfig::sample_rate>("sample_rate"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<VideoPresetConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&VideoPresetConfig::bitrate>("bitrate"),
+        config_field<&VideoPresetConfig::codec>("codec"),
+        config_field<&VideoPresetConfig::framerate>("framerate"),
+        config_field<&VideoPresetConfig::resolution>("resolution"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<AudioPresetsConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&AudioPresetsConfig::high>("high"),
+        config_field<&AudioPresetsConfig::low>("low"),
+        config_field<&AudioPresetsConfig::medium>("medium"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<VideoPresetsConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&VideoPresetsConfig::high>("high"),
+        config_field<&VideoPresetsConfig::low>("low"),
+        config_field<&VideoPresetsConfig::medium>("medium"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<QualityPresetsConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&QualityPresetsConfig::audio>("audio"),
+        config_field<&QualityPresetsConfig::video>("video"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<RecordingConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&RecordingConfig::enabled>("enabled"),
+        config_field<&RecordingConfig::formats>("formats"),
+        config_field<&RecordingConfig::storage_path>("storage_path"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<StreamingPlatformConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&StreamingPlatformConfig::enabled>("enabled"),
+        config_field<&StreamingPlatformConfig::name>("name"),
+        config_field<&StreamingPlatformConfig::rtmp_url>("rtmp_url"),
+        config_field<&StreamingPlatformConfig::stream_key>("stream_key"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<IntegrationsConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&IntegrationsConfig::recording>("recording"),
+        config_field<&IntegrationsConfig::streaming_platforms>("streaming_platforms"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+template <>
+struct ConfigType<DeviceStreamsConfig> {
+    static constexpr ConfigField fields[] = {
+        config_field<&DeviceStreamsConfig::audio_devices>("audio_devices"),
+        config_field<&DeviceStreamsConfig::integrations>("integrations"),
+        config_field<&DeviceStreamsConfig::protocols>("protocols"),
+        config_field<&DeviceStreamsConfig::quality_presets>("quality_presets"),
+        config_field<&DeviceStreamsConfig::server>("server"),
+        config_field<&DeviceStreamsConfig::video_devices>("video_devices"),
+    };
+    static constexpr ConfigSchema schema = config_mapping(fields);
+};
+
+const DeviceProtocolConfig* DeviceConfig::enabled_protocol(StreamProtocol protocol) const {
+    for (const DeviceProtocolConfig& entry : protocols) {
+        if (entry.type == protocol) {
+            return entry.enabled ? &entry : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+const AudioPresetConfig* AudioPresetsConfig::find(std::string_view name) const {
+    if (name == "low") {
+        return &low;
+    }
+    if (name == "medium") {
+        return &medium;
+    }
+    if (name == "high") {
+        return &high;
+    }
+    return nullptr;
+}
+
+std::string DeviceStreamsConfig::stream_path(const DeviceConfig& device, const DeviceProtocolConfig& protocol) const {
+    if (!protocol.path.empty()) {
+        return protocol.path;
+    }
+    const std::string* format = nullptr;
+    switch (protocol.type) {
+    case StreamProtocol::RTSP: format = &protocols.rtsp.path_format; break;
+    case StreamProtocol::WEBRTC: format = &protocols.webrtc.path_format; break;
+    case StreamProtocol::HLS: format = &protocols.hls.path_format; break;
+    case StreamProtocol::PODCAST: format = &protocols.podcast.path_format; break;
+    }
+    std::string path = *format;
+    const std::string placeholder = "{device_id}";
+    for (size_t at = path.find(placeholder); at != std::string::npos; at = path.find(placeholder, at)) {
+        path.replace(at, placeholder.size(), device.id);
+        at += device.id.size();
+    }
+    return path;
+}
+
+uint16_t DeviceStreamsConfig::stream_port(const DeviceProtocolConfig& protocol) const {
+    if (protocol.port) {
+        return protocol.port;
+    }
+    switch (protocol.type) {
+    case StreamProtocol::RTSP: return protocols.rtsp.default_port_range.first;
+    case StreamProtocol::WEBRTC: return protocols.webrtc.default_port_range.first;
+    case StreamProtocol::HLS: return protocols.hls.default_port_range.first;
+    case StreamProtocol::PODCAST: return protocols.podcast.default_port;
+    }
+    return 0;
+}
+
+bool DeviceStreamsConfig::parse(std::string_view text, DeviceStreamsConfig& config, std::string& error,
+                                std::vector<std::string>* unknown_keys) {
+    return parse_config(text, config, error, unknown_keys);
+}
+
+void DeviceStreamsConfig::diff(const DeviceStreamsConfig& before, const DeviceStreamsConfig& after,
+                               const std::string& prefix, std::vector<std::string>& changed) {
+    diff_config(before, after, prefix, changed);
+}
+
+bool DeviceStreamsConfig::load(const std::string& path, DeviceStreamsConfig& config) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        std::cerr << "Failed to open device streams config: " << path << std::endl;
+        return false;
+    }
+    std::ostringstream text;
+    text << file.rdbuf();
+    std::string error;
+    std::vector<std::string> unknown_keys;
+    if (!parse(text.str(), config, error, &unknown_keys)) {
+        std::cerr << path << ": " << error << std::endl;
+        return false;
+    }
+    for (const std::string& key : unknown_keys) {
+        std::cerr << path << ": unknown key ignored at " << key << std::endl;
+    }
+    return true;
+}
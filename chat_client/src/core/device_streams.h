@@ -0,0 +1,179 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// config/device_streams.yaml as typed settings: which devices are
+// streamed, over which protocols, and the quality presets. Parsed at
+// startup and on each change to the file (see config_schema.h for the key
+// tables, config_store.h for reloading); the servers are set up from these
+// fields directly. Defaults are those of the shipped file.
+
+enum class StreamProtocol { RTSP, WEBRTC, HLS, PODCAST };
+enum class DeviceDirection { INPUT, OUTPUT };
+
+// "[first, last]"
+struct PortRange {
+    uint16_t first = 0;
+    uint16_t last = 0;
+};
+
+struct ServerConfig {
+    std::string host = "0.0.0.0";
+    uint16_t web_admin_port = 8080;
+    bool discovery_enabled = true;
+};
+
+struct RtspProtocolConfig {
+    bool enabled = true;
+    PortRange default_port_range{ 8554, 8654 };
+    std::vector<std::string> transport{ "tcp", "udp" };
+    std::string latency = "low";
+    std::string path_format = "/stream/{device_id}";
+    // For an external server; the built-in one needs neither
+    std::string server_binary;
+    std::string config_file;
+};
+
+struct IceServerConfig {
+    std::vector<std::string> urls;
+};
+
+struct WebrtcProtocolConfig {
+    bool enabled = true;
+    PortRange default_port_range{ 8700, 8800 };
+    std::vector<IceServerConfig> ice_servers;
+    std::string latency = "very_low";
+    std::string path_format = "/webrtc/{device_id}";
+    uint16_t signaling_port = 8833;
+};
+
+struct HlsProtocolConfig {
+    bool enabled = true;
+    PortRange default_port_range{ 8900, 9000 };
+    unsigned segment_duration = 4;  // Seconds
+    unsigned playlist_size = 5;
+    std::string latency = "high";
+    std::string path_format = "/hls/{device_id}/index.m3u8";
+    uint16_t http_port = 8080;
+};
+
+struct PodcastProtocolConfig {
+    bool enabled = false;
+    uint16_t default_port = 9080;
+    std::string format = "mp3";
+    unsigned bitrate = 128;  // kbit/s
+    std::string path_format = "/podcast/{device_id}.xml";
+    uint16_t http_port = 8080;
+};
+
+struct ProtocolsConfig {
+    RtspProtocolConfig rtsp;
+    WebrtcProtocolConfig webrtc;
+    HlsProtocolConfig hls;
+    PodcastProtocolConfig podcast;
+};
+
+// One protocol a device is streamed over
+struct DeviceProtocolConfig {
+    StreamProtocol type = StreamProtocol::RTSP;
+    uint16_t port = 0;        // 0: the first of the protocol's range
+    std::string path;         // Empty: the protocol's path_format
+    bool enabled = false;
+    std::string codec;
+    unsigned bitrate = 0;     // 0: the preset's
+    std::string resolution;   // Video
+    unsigned framerate = 0;
+};
+
+struct DeviceConfig {
+    std::string id;
+    std::string name;
+    DeviceDirection type = DeviceDirection::INPUT;
+    std::string system_id = "default";
+    std::vector<DeviceProtocolConfig> protocols;
+
+    // The device's entry for protocol if it is there and enabled, else null
+    const DeviceProtocolConfig* enabled_protocol(StreamProtocol protocol) const;
+};
+
+struct AudioPresetConfig {
+    std::string codec = "opus";
+    unsigned bitrate = 96000;
+    unsigned sample_rate = 48000;
+    bool dtx = true;
+    bool fec = true;
+};
+
+struct VideoPresetConfig {
+    std::string codec = "h264";
+    std::string resolution = "720p";
+    unsigned framerate = 30;
+    unsigned bitrate = 1500000;
+};
+
+struct AudioPresetsConfig {
+    AudioPresetConfig low{ "opus", 64000, 16000, true, true };
+    AudioPresetConfig medium{ "opus", 96000, 44100, true, true };
+    AudioPresetConfig high{ "opus", 128000, 48000, true, false };
+
+    // "low", "medium" or "high"; null for any other name
+    const AudioPresetConfig* find(std::string_view name) const;
+};
+
+struct VideoPresetsConfig {
+    VideoPresetConfig low{ "h264", "480p", 15, 500000 };
+    VideoPresetConfig medium{ "h264", "720p", 30, 1500000 };
+    VideoPresetConfig high{ "h264", "1080p", 30, 3000000 };
+};
+
+struct QualityPresetsConfig {
+    AudioPresetsConfig audio;
+    VideoPresetsConfig video;
+};
+
+struct RecordingConfig {
+    bool enabled = false;
+    std::string storage_path;
+    std::vector<std::string> formats;
+};
+
+struct StreamingPlatformConfig {
+    std::string name;
+    bool enabled = false;
+    std::string rtmp_url;
+    std::string stream_key;  // As written: "${YOUTUBE_STREAM_KEY}" is not expanded
+};
+
+struct IntegrationsConfig {
+    RecordingConfig recording;
+    std::vector<StreamingPlatformConfig> streaming_platforms;
+};
+
+struct DeviceStreamsConfig {
+    ServerConfig server;
+    ProtocolsConfig protocols;
+    std::vector<DeviceConfig> audio_devices;
+    std::vector<DeviceConfig> video_devices;
+    QualityPresetsConfig quality_presets;
+    IntegrationsConfig integrations;
+
+    // Where a device's stream is served: its entry's path, else the
+    // protocol's path_format with {device_id} filled in
+    std::string stream_path(const DeviceConfig& device, const DeviceProtocolConfig& protocol) const;
+    // The entry's port, else the first of its protocol's range
+    uint16_t stream_port(const DeviceProtocolConfig& protocol) const;
+
+    // Parses the file's text into config, which keeps its defaults for
+    // anything the text leaves out. False with the line and reason in error.
+    static bool parse(std::string_view text, DeviceStreamsConfig& config, std::string& error,
+                      std::vector<std::string>* unknown_keys = nullptr);
+    // Reads and parses the file at path, reporting problems on std::cerr
+    static bool load(const std::string& path, DeviceStreamsConfig& config);
+    // Appends the dotted path of each setting that differs, under prefix
+    // ("<prefix>.protocols.hls.playlist_size"); see diff_config
+    static void diff(const DeviceStreamsConfig& before, const DeviceStreamsConfig& after, const std::string& prefix,
+                     std::vector<std::string>& changed);
+};
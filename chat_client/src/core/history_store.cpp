@@ -0,0 +1,806 @@
+#include "history_store.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+// On-disk record header, followed by sender, channel and body bytes and
+// zero padding to a multiple of 8
+struct RecordHeader {
+    uint32_t size;      // Whole record; 0 marks the end of the log
+    uint32_t checksum;  // FNV-1a of the record from seq on
+    uint64_t seq;
+    int64_t time_ms;
+    uint32_t flags;
+    uint16_t sender_length;
+    uint16_t channel_length;
+    uint32_t body_length;
+    uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 40, "record header layout");
+
+constexpr size_t kChecksumStart = offsetof(RecordHeader, seq);
+constexpr size_t kMaxNameLength = 255;
+constexpr const char* kSegmentSuffix = ".seg";
+constexpr const char* kIndexSuffix = ".idx";
+constexpr const char* kTempSuffix = ".tmp";
+
+size_t align8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+uint32_t fnv1a(const char* data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+std::string segment_name(uint64_t first_seq) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(first_seq));
+    return name;
+}
+
+// The record at offset, or null if it is not a whole, intact record with
+// the expected sequence number
+const RecordHeader* valid_record(const char* base, size_t limit, size_t offset, uint64_t seq) {
+    if (offset + sizeof(RecordHeader) > limit) {
+        return nullptr;
+    }
+    const auto* header = reinterpret_cast<const RecordHeader*>(base + offset);
+    size_t payload = size_t(header->sender_length) + header->channel_length + header->body_length;
+    if (header->size == 0 || header->size % 8 != 0 || header->size > limit - offset
+        || header->seq != seq || align8(sizeof(RecordHeader) + payload) != header->size) {
+        return nullptr;
+    }
+    if (fnv1a(base + offset + kChecksumStart, header->size - kChecksumStart) != header->checksum) {
+        return nullptr;
+    }
+    return header;
+}
+
+HistoryStore::Record view(const RecordHeader* header) {
+    const char* payload = reinterpret_cast<const char*>(header + 1);
+    HistoryStore::Record record;
+    record.seq = header->seq;
+    record.time_ms = header->time_ms;
+    record.flags = header->flags;
+    record.sender = std::string_view(payload, header->sender_length);
+    record.channel = std::string_view(payload + header->sender_length, header->channel_length);
+    record.body = std::string_view(payload + header->sender_length + header->channel_length,
+                                   header->body_length);
+    return record;
+}
+
+bool write_all(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t written = ::write(fd, bytes, size);
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        bytes += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+} // namespace
+
+struct HistoryStore::IndexEntry {
+    uint64_t seq;
+    int64_t time_ms;
+    uint64_t offset;
+};
+
+struct HistoryStore::Segment {
+    uint64_t first_seq = 0;
+    std::string path;
+    std::string index_path;
+    int fd = -1;
+    int index_fd = -1;
+    char* base = nullptr;
+    size_t capacity = 0;              // Mapped length
+    std::atomic<size_t> used{0};      // Bytes of committed records
+    std::atomic<uint64_t> count{0};   // Committed records
+    std::atomic<int64_t> first_time_ms{0};
+    std::atomic<int64_t> last_time_ms{0};
+    std::vector<IndexEntry> index;    // Changed under segments_mutex_
+    bool active = false;              // The one being appended to
+
+    uint64_t end_seq() const { return first_seq + count.load(std::memory_order_acquire); }
+};
+
+HistoryStore::HistoryStore() = default;
+
+HistoryStore::~HistoryStore() {
+    close();
+}
+
+bool HistoryStore::open(const std::string& directory) {
+    return open(directory, Options());
+}
+
+bool HistoryStore::open(const std::string& directory, const Options& options) {
+    close();
+    options_ = options;
+    options_.segment_bytes = std::max(options_.segment_bytes, size_t(4096));
+    options_.index_interval = std::max(options_.index_interval, size_t(1));
+    directory_ = directory;
+
+    if (::mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+        std::cerr << "Cannot create history directory " << directory << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    DIR* dir = ::opendir(directory.c_str());
+    if (!dir) {
+        std::cerr << "Cannot open history directory " << directory << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    std::vector<uint64_t> found;
+    while (dirent* entry = ::readdir(dir)) {
+        std::string name = entry->d_name;
+        size_t temp_length = std::strlen(kTempSuffix);
+        if (name.size() > temp_length && name.compare(name.size() - temp_length, temp_length, kTempSuffix) == 0) {
+            ::unlink((directory_ + "/" + name).c_str()); // Left by an interrupted compaction
+            continue;
+        }
+        if (name.size() == 16 + std::strlen(kSegmentSuffix)
+            && name.compare(16, std::string::npos, kSegmentSuffix) == 0) {
+            std::string digits = name.substr(0, 16);
+            char* end = nullptr;
+            uint64_t first_seq = std::strtoull(digits.c_str(), &end, 16);
+            if (end && *end == '\0' && first_seq > 0) {
+                found.push_back(first_seq);
+            }
+        }
+    }
+    ::closedir(dir);
+    std::sort(found.begin(), found.end());
+
+    recovered_bytes_ = 0;
+    for (size_t i = 0; i < found.size(); ++i) {
+        std::string path = directory_ + "/" + segment_name(found[i]) + kSegmentSuffix;
+        if (!load_segment(path, found[i], i + 1 == found.size())) {
+            for (auto& segment : segments_) {
+                unmap(*segment, false);
+            }
+            segments_.clear();
+            return false;
+        }
+    }
+
+    next_seq_ = segments_.empty() ? 1 : segments_.back()->end_seq();
+    if (segments_.empty() && !start_segment(next_seq_)) {
+        return false;
+    }
+
+    queue_ = std::make_unique<MpscQueue<Pending>>(options_.queue_capacity);
+    stopping_ = false;
+    compaction_requested_ = false;
+    open_ = true;
+    writer_ = std::thread(&HistoryStore::writer_loop, this);
+    return true;
+}
+
+bool HistoryStore::load_segment(const std::string& path, uint64_t first_seq, bool last) {
+    auto segment = std::make_unique<Segment>();
+    segment->first_seq = first_seq;
+    segment->path = path;
+    segment->index_path = path.substr(0, path.size() - std::strlen(kSegmentSuffix)) + kIndexSuffix;
+
+    segment->fd = ::open(path.c_str(), O_RDWR | O_CLOEXEC);
+    struct stat info {};
+    if (segment->fd < 0 || ::fstat(segment->fd, &info) != 0) {
+        std::cerr << "Cannot open history segment " << path << ": " << std::strerror(errno) << std::endl;
+        unmap(*segment, false);
+        return false;
+    }
+    size_t size = static_cast<size_t>(info.st_size);
+    // The segment being appended to was trimmed on close; give it its
+    // room back
+    if (last && size < options_.segment_bytes) {
+        if (::ftruncate(segment->fd, static_cast<off_t>(options_.segment_bytes)) == 0) {
+            size = options_.segment_bytes;
+        }
+    }
+    if (size == 0) {
+        unmap(*segment, true);
+        return true;
+    }
+    void* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot map history segment " << path << ": " << std::strerror(errno) << std::endl;
+        unmap(*segment, false);
+        return false;
+    }
+    segment->base = static_cast<char*>(base);
+    segment->capacity = size;
+    segment->active = last;
+
+    // Trust the index only as far as it points at intact records
+    segment->index_fd = ::open(segment->index_path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (segment->index_fd >= 0) {
+        IndexEntry entry;
+        uint64_t previous_offset = 0;
+        while (::read(segment->index_fd, &entry, sizeof(entry)) == static_cast<ssize_t>(sizeof(entry))) {
+            bool in_order = segment->index.empty() || entry.offset > previous_offset;
+            bool aligned = (entry.seq - first_seq) % options_.index_interval == 0;
+            if (!in_order || !aligned || !valid_record(segment->base, size, entry.offset, entry.seq)) {
+                break;
+            }
+            segment->index.push_back(entry);
+            previous_offset = entry.offset;
+        }
+        if (::ftruncate(segment->index_fd, static_cast<off_t>(segment->index.size() * sizeof(IndexEntry))) != 0
+            || ::lseek(segment->index_fd, 0, SEEK_END) < 0) {
+            segment->index.clear();
+        }
+    }
+    if (!segment->index.empty()) {
+        segment->count = segment->index.back().seq - first_seq;
+        segment->used = segment->index.back().offset;
+        segment->last_time_ms = segment->index.back().time_ms;
+    }
+    if (const RecordHeader* first = valid_record(segment->base, size, 0, first_seq)) {
+        segment->first_time_ms = first->time_ms;
+    }
+    scan_tail(*segment);
+
+    // An empty leftover from an interrupted compaction or a crash before
+    // the first record
+    if (segment->count == 0 && !last) {
+        unmap(*segment, true);
+        return true;
+    }
+    if (!segments_.empty() && first_seq < segments_.back()->end_seq()) {
+        std::cerr << "History segment " << path << " overlaps the one before; ignoring it" << std::endl;
+        unmap(*segment, false);
+        return true;
+    }
+    segments_.push_back(std::move(segment));
+    return true;
+}
+
+void HistoryStore::scan_tail(Segment& segment) {
+    size_t offset = segment.used;
+    uint64_t seq = segment.first_seq + segment.count;
+    while (const RecordHeader* header = valid_record(segment.base, segment.capacity, offset, seq)) {
+        if ((seq - segment.first_seq) % options_.index_interval == 0
+            && (segment.index.empty() || segment.index.back().seq < seq)) {
+            write_index_entry(segment, IndexEntry{ seq, header->time_ms, offset });
+        }
+        segment.last_time_ms = header->time_ms;
+        offset += header->size;
+        ++seq;
+    }
+    segment.used = offset;
+    segment.count = seq - segment.first_seq;
+
+    // Whatever follows is a torn write or garbage; clear its header so the
+    // next append starts from a clean end of log
+    if (offset + sizeof(RecordHeader) <= segment.capacity) {
+        auto* header = reinterpret_cast<RecordHeader*>(segment.base + offset);
+        if (header->size != 0) {
+            recovered_bytes_ += std::min<size_t>(header->size, segment.capacity - offset);
+            std::memset(header, 0, sizeof(RecordHeader));
+        }
+    }
+}
+
+bool HistoryStore::start_segment(uint64_t first_seq) {
+    auto segment = std::make_unique<Segment>();
+    segment->first_seq = first_seq;
+    std::string stem = directory_ + "/" + segment_name(first_seq);
+    segment->path = stem + kSegmentSuffix;
+    segment->index_path = stem + kIndexSuffix;
+
+    segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (segment->fd < 0 || ::ftruncate(segment->fd, static_cast<off_t>(options_.segment_bytes)) != 0) {
+        std::cerr << "Cannot create history segment " << segment->path << ": " << std::strerror(errno) << std::endl;
+        unmap(*segment, true);
+        return false;
+    }
+    void* base = ::mmap(nullptr, options_.segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0);
+    if (base == MAP_FAILED) {
+        std::cerr << "Cannot map history segment " << segment->path << ": " << std::strerror(errno) << std::endl;
+        unmap(*segment, true);
+        return false;
+    }
+    segment->base = static_cast<char*>(base);
+    segment->capacity = options_.segment_bytes;
+    segment->index_fd = ::open(segment->index_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    segment->active = true;
+
+    std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+    segments_.push_back(std::move(segment));
+    return true;
+}
+
+void HistoryStore::seal_segment(Segment& segment) {
+    segment.active = false;
+    ::msync(segment.base, segment.capacity, MS_ASYNC);
+    // The mapping stays as it is; only the unused tail of the file goes
+    if (::ftruncate(segment.fd, static_cast<off_t>(segment.used.load())) != 0) {
+        std::cerr << "Cannot trim history segment " << segment.path << ": " << std::strerror(errno) << std::endl;
+    }
+}
+
+bool HistoryStore::write_index_entry(Segment& segment, const IndexEntry& entry) {
+    {
+        std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+        segment.index.push_back(entry);
+    }
+    return segment.index_fd >= 0 && write_all(segment.index_fd, &entry, sizeof(entry));
+}
+
+void HistoryStore::unmap(Segment& segment, bool remove_files) {
+    if (segment.base) {
+        ::munmap(segment.base, segment.capacity);
+        segment.base = nullptr;
+    }
+    if (segment.fd >= 0) {
+        ::close(segment.fd);
+        segment.fd = -1;
+    }
+    if (segment.index_fd >= 0) {
+        ::close(segment.index_fd);
+        segment.index_fd = -1;
+    }
+    if (remove_files) {
+        ::unlink(segment.path.c_str());
+        ::unlink(segment.index_path.c_str());
+    }
+}
+
+void HistoryStore::close() {
+    open_ = false;
+    if (writer_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex_);
+            stopping_ = true;
+        }
+        wake_.notify_one();
+        writer_.join();
+    }
+
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+    for (auto& segment : segments_) {
+        if (segment->active) {
+            ::msync(segment->base, segment->capacity, MS_SYNC);
+            if (::ftruncate(segment->fd, static_cast<off_t>(segment->used.load())) != 0) {
+                std::cerr << "Cannot trim history segment " << segment->path << std::endl;
+            }
+        }
+        unmap(*segment, false);
+    }
+    segments_.clear();
+    queue_.reset();
+    open_ = false;
+}
+
+uint64_t HistoryStore::append(int64_t time_ms, uint32_t flags, std::string_view sender,
+                              std::string_view channel, std::string_view body) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    if (segments_.empty()) {
+        return 0;
+    }
+    sender = sender.substr(0, kMaxNameLength);
+    channel = channel.substr(0, kMaxNameLength);
+    // A body too long for an empty segment is cut to fit
+    size_t room = options_.segment_bytes - sizeof(RecordHeader) - sender.size() - channel.size() - 8;
+    body = body.substr(0, std::min<size_t>(room, UINT32_MAX));
+    size_t size = align8(sizeof(RecordHeader) + sender.size() + channel.size() + body.size());
+
+    Segment* segment = segments_.back().get();
+    size_t offset = segment->used.load(std::memory_order_relaxed);
+    if (offset + size > segment->capacity) {
+        seal_segment(*segment);
+        if (!start_segment(next_seq_.load())) {
+            return 0;
+        }
+        segment = segments_.back().get();
+        offset = 0;
+    }
+
+    // The log's clock never runs backwards, so time lookups can bisect
+    uint64_t seq = next_seq_.load(std::memory_order_relaxed);
+    uint64_t count = segment->count.load(std::memory_order_relaxed);
+    if (count > 0) {
+        time_ms = std::max(time_ms, segment->last_time_ms.load(std::memory_order_relaxed));
+    } else if (segments_.size() > 1) {
+        time_ms = std::max(time_ms, segments_[segments_.size() - 2]->last_time_ms.load(std::memory_order_relaxed));
+    }
+
+    char* record = segment->base + offset;
+    RecordHeader header{};
+    header.size = static_cast<uint32_t>(size);
+    header.seq = seq;
+    header.time_ms = time_ms;
+    header.flags = flags;
+    header.sender_length = static_cast<uint16_t>(sender.size());
+    header.channel_length = static_cast<uint16_t>(channel.size());
+    header.body_length = static_cast<uint32_t>(body.size());
+    char* payload = record + sizeof(RecordHeader);
+    std::memcpy(payload, sender.data(), sender.size());
+    payload += sender.size();
+    std::memcpy(payload, channel.data(), channel.size());
+    payload += channel.size();
+    std::memcpy(payload, body.data(), body.size());
+    payload += body.size();
+    std::memset(payload, 0, static_cast<size_t>(record + size - payload));
+    std::memcpy(record, &header, sizeof(header));
+    header.checksum = fnv1a(record + kChecksumStart, size - kChecksumStart);
+    std::memcpy(record + offsetof(RecordHeader, checksum), &header.checksum, sizeof(header.checksum));
+
+    if (count % options_.index_interval == 0) {
+        write_index_entry(*segment, IndexEntry{ seq, time_ms, offset });
+    }
+    if (count == 0) {
+        segment->first_time_ms.store(time_ms, std::memory_order_relaxed);
+    }
+    segment->last_time_ms.store(time_ms, std::memory_order_relaxed);
+    // Published last: readers only look below used
+    segment->count.store(count + 1, std::memory_order_release);
+    segment->used.store(offset + size, std::memory_order_release);
+    next_seq_.store(seq + 1, std::memory_order_release);
+    if (append_listener_) {
+        append_listener_(view(reinterpret_cast<const RecordHeader*>(record)));
+    }
+    return seq;
+}
+
+void HistoryStore::set_append_listener(std::function<void(const Record&)> listener) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    append_listener_ = std::move(listener);
+}
+
+bool HistoryStore::append_async(int64_t time_ms, uint32_t flags, std::string sender,
+                                std::string channel, std::string body) {
+    if (!open_.load(std::memory_order_acquire)) {
+        return false;
+    }
+    Pending pending;
+    pending.time_ms = time_ms;
+    pending.flags = flags;
+    pending.sender = std::move(sender);
+    pending.channel = std::move(channel);
+    pending.body = std::move(body);
+    if (!queue_->try_push(std::move(pending))) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    queued_.fetch_add(1, std::memory_order_relaxed);
+    // Only the first record since the writer last woke needs to wake it
+    if (!wake_pending_.exchange(true)) {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        wake_.notify_one();
+    }
+    return true;
+}
+
+void HistoryStore::writer_loop() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (true) {
+        wake_.wait(lock, [this] { return stopping_ || compaction_requested_ || wake_pending_.load(); });
+        bool stop = stopping_;
+        bool compact_now = compaction_requested_;
+        compaction_requested_ = false;
+        CompactionPolicy policy = compaction_policy_;
+        int64_t now_ms = compaction_now_ms_;
+        lock.unlock();
+
+        // Cleared before draining: a record queued from here on is either
+        // drained below or wakes us again
+        wake_pending_.store(false);
+        Pending pending;
+        while (queue_->try_pop(pending)) {
+            append(pending.time_ms, pending.flags, pending.sender, pending.channel, pending.body);
+            written_.fetch_add(1, std::memory_order_release);
+        }
+        if (compact_now) {
+            compact(policy, now_ms);
+        }
+
+        lock.lock();
+        flushed_.notify_all();
+        if (stop) {
+            return;
+        }
+    }
+}
+
+void HistoryStore::flush() {
+    if (!open_) {
+        return;
+    }
+    uint64_t target = queued_.load();
+    {
+        std::unique_lock<std::mutex> lock(wake_mutex_);
+        wake_pending_.store(true);
+        wake_.notify_one();
+        flushed_.wait(lock, [this, target] { return written_.load(std::memory_order_acquire) >= target; });
+    }
+
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    if (!segments_.empty()) {
+        Segment& segment = *segments_.back();
+        ::msync(segment.base, segment.capacity, MS_SYNC);
+        if (segment.index_fd >= 0) {
+            ::fdatasync(segment.index_fd);
+        }
+    }
+}
+
+const HistoryStore::Segment* HistoryStore::find_segment(uint64_t seq) const {
+    auto it = std::upper_bound(segments_.begin(), segments_.end(), seq,
+                               [](uint64_t value, const std::unique_ptr<Segment>& segment) {
+                                   return value < segment->first_seq;
+                               });
+    if (it == segments_.begin()) {
+        return nullptr;
+    }
+    const Segment* segment = std::prev(it)->get();
+    return seq < segment->end_seq() ? segment : nullptr;
+}
+
+size_t HistoryStore::read(uint64_t from_seq, size_t max, const std::function<bool(const Record&)>& fn) const {
+    std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+    if (segments_.empty() || max == 0) {
+        return 0;
+    }
+    from_seq = std::max(from_seq, segments_.front()->first_seq);
+    const Segment* segment = find_segment(from_seq);
+    if (!segment) {
+        return 0;
+    }
+
+    // Nearest index entry at or before from_seq, then walk
+    auto entry = std::upper_bound(segment->index.begin(), segment->index.end(), from_seq,
+                                  [](uint64_t value, const IndexEntry& e) { return value < e.seq; });
+    size_t offset = 0;
+    uint64_t seq = segment->first_seq;
+    if (entry != segment->index.begin()) {
+        offset = std::prev(entry)->offset;
+        seq = std::prev(entry)->seq;
+    }
+
+    size_t visited = 0;
+    size_t segment_index = static_cast<size_t>(
+        std::find_if(segments_.begin(), segments_.end(),
+                     [segment](const std::unique_ptr<Segment>& s) { return s.get() == segment; })
+        - segments_.begin());
+    while (visited < max) {
+        size_t used = segment->used.load(std::memory_order_acquire);
+        if (offset >= used) {
+            if (++segment_index == segments_.size()) {
+                break;
+            }
+            segment = segments_[segment_index].get();
+            offset = 0;
+            seq = segment->first_seq;
+            continue;
+        }
+        const auto* header = reinterpret_cast<const RecordHeader*>(segment->base + offset);
+        offset += header->size;
+        if (seq++ < from_seq) {
+            continue;
+        }
+        ++visited;
+        if (!fn(view(header))) {
+            break;
+        }
+    }
+    return visited;
+}
+
+uint64_t HistoryStore::seq_at_time(int64_t time_ms) const {
+    std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+    for (const auto& segment : segments_) {
+        if (segment->count.load(std::memory_order_acquire) == 0
+            || segment->last_time_ms.load(std::memory_order_relaxed) < time_ms) {
+            continue;
+        }
+        // Last index entry before the time, then walk to the first record
+        // at or after it
+        auto entry = std::lower_bound(segment->index.begin(), segment->index.end(), time_ms,
+                                      [](const IndexEntry& e, int64_t value) { return e.time_ms < value; });
+        size_t offset = 0;
+        uint64_t seq = segment->first_seq;
+        if (entry != segment->index.begin()) {
+            offset = std::prev(entry)->offset;
+            seq = std::prev(entry)->seq;
+        }
+        size_t used = segment->used.load(std::memory_order_acquire);
+        while (offset < used) {
+            const auto* header = reinterpret_cast<const RecordHeader*>(segment->base + offset);
+            if (header->time_ms >= time_ms) {
+                return seq;
+            }
+            offset += header->size;
+            ++seq;
+        }
+    }
+    return next_seq_.load(std::memory_order_acquire);
+}
+
+uint64_t HistoryStore::first_seq() const {
+    std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+    return segments_.empty() ? next_seq_.load() : segments_.front()->first_seq;
+}
+
+uint64_t HistoryStore::next_seq() const {
+    return next_seq_.load(std::memory_order_acquire);
+}
+
+HistoryStore::CompactionResult HistoryStore::compact(const CompactionPolicy& policy, int64_t now_ms) {
+    CompactionResult result;
+    std::lock_guard<std::mutex> write_lock(write_mutex_);
+    int64_t cutoff = policy.max_age_ms > 0 ? now_ms - policy.max_age_ms : INT64_MIN;
+
+    uint64_t total_bytes = 0;
+    for (const auto& segment : segments_) {
+        total_bytes += segment->used.load();
+    }
+
+    // Whole sealed segments, oldest first
+    while (segments_.size() > 1) {
+        Segment& oldest = *segments_.front();
+        bool expired = oldest.last_time_ms.load() < cutoff;
+        bool over_budget = policy.max_bytes > 0 && total_bytes > policy.max_bytes;
+        if (!expired && !over_budget) {
+            break;
+        }
+        std::unique_ptr<Segment> removed;
+        {
+            std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+            removed = std::move(segments_.front());
+            segments_.erase(segments_.begin());
+        }
+        total_bytes -= removed->used.load();
+        result.segments_removed += 1;
+        result.records_removed += removed->count.load();
+        result.bytes_reclaimed += removed->used.load();
+        unmap(*removed, true);
+    }
+
+    // The oldest remaining segment may straddle the cutoff
+    if (segments_.size() > 1 && segments_.front()->first_time_ms.load() < cutoff) {
+        rewrite_segment(0, cutoff, result);
+    }
+    return result;
+}
+
+bool HistoryStore::rewrite_segment(size_t index, int64_t cutoff_ms, CompactionResult& result) {
+    const Segment& old_segment = *segments_[index];
+    size_t used = old_segment.used.load();
+    size_t offset = 0;
+    uint64_t seq = old_segment.first_seq;
+    int64_t first_time = 0;
+    while (offset < used) {
+        const auto* header = reinterpret_cast<const RecordHeader*>(old_segment.base + offset);
+        if (header->time_ms >= cutoff_ms) {
+            first_time = header->time_ms;
+            break;
+        }
+        offset += header->size;
+        ++seq;
+    }
+    if (offset == 0 || offset >= used) {
+        return false; // Nothing expired, or the whole segment is; left for the next pass
+    }
+
+    // Records carry their own sequence numbers and checksums, so the kept
+    // ones are copied as they are into a segment named after the first
+    auto segment = std::make_unique<Segment>();
+    segment->first_seq = seq;
+    std::string stem = directory_ + "/" + segment_name(seq);
+    segment->path = stem + kSegmentSuffix;
+    segment->index_path = stem + kIndexSuffix;
+    std::string temp_path = segment->path + kTempSuffix;
+    std::string temp_index_path = segment->index_path + kTempSuffix;
+
+    size_t kept = used - offset;
+    int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    int index_fd = ::open(temp_index_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    bool ok = fd >= 0 && index_fd >= 0 && write_all(fd, old_segment.base + offset, kept);
+
+    size_t new_offset = 0;
+    for (uint64_t s = seq; ok && new_offset < kept; ++s) {
+        const auto* header = reinterpret_cast<const RecordHeader*>(old_segment.base + offset + new_offset);
+        if ((s - seq) % options_.index_interval == 0) {
+            IndexEntry entry{ s, header->time_ms, new_offset };
+            segment->index.push_back(entry);
+            ok = write_all(index_fd, &entry, sizeof(entry));
+        }
+        segment->last_time_ms = header->time_ms;
+        new_offset += header->size;
+    }
+    ok = ok && ::fsync(fd) == 0 && ::fsync(index_fd) == 0;
+    void* base = ok ? ::mmap(nullptr, kept, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (base == MAP_FAILED || ::rename(temp_path.c_str(), segment->path.c_str()) != 0
+        || ::rename(temp_index_path.c_str(), segment->index_path.c_str()) != 0) {
+        std::cerr << "History compaction of " << old_segment.path << " failed: " << std::strerror(errno) << std::endl;
+        if (base != MAP_FAILED) {
+            ::munmap(base, kept);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        if (index_fd >= 0) {
+            ::close(index_fd);
+        }
+        ::unlink(temp_path.c_str());
+        ::unlink(temp_index_path.c_str());
+        return false;
+    }
+    segment->fd = fd;
+    segment->index_fd = index_fd;
+    segment->base = static_cast<char*>(base);
+    segment->capacity = kept;
+    segment->used = kept;
+    segment->count = old_segment.end_seq() - seq;
+    segment->first_time_ms = first_time;
+
+    std::unique_ptr<Segment> replaced;
+    {
+        std::unique_lock<std::shared_mutex> lock(segments_mutex_);
+        replaced = std::move(segments_[index]);
+        segments_[index] = std::move(segment);
+    }
+    result.segments_rewritten += 1;
+    result.records_removed += seq - replaced->first_seq;
+    result.bytes_reclaimed += offset;
+    unmap(*replaced, true);
+    return true;
+}
+
+void HistoryStore::compact_async(const CompactionPolicy& policy, int64_t now_ms) {
+    if (!open_) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex_);
+        compaction_requested_ = true;
+        compaction_policy_ = policy;
+        compaction_now_ms_ = now_ms;
+    }
+    wake_.notify_one();
+}
+
+HistoryStore::Stats HistoryStore::get_stats() const {
+    Stats stats;
+    {
+        std::shared_lock<std::shared_mutex> lock(segments_mutex_);
+        stats.segments = segments_.size();
+        stats.first_seq = segments_.empty() ? next_seq_.load() : segments_.front()->first_seq;
+        for (const auto& segment : segments_) {
+            stats.records += segment->count.load(std::memory_order_acquire);
+            stats.bytes += segment->used.load(std::memory_order_acquire);
+            stats.index_entries += segment->index.size();
+        }
+    }
+    stats.next_seq = next_seq_.load(std::memory_order_acquire);
+    stats.queued = queued_.load(std::memory_order_relaxed);
+    stats.written = written_.load(std::memory_order_acquire);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.recovered_bytes = recovered_bytes_;
+    return stats;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include "../utils/mpsc_queue.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Persistent chat log: an append-only sequence of records in memory-mapped
+// segment files.
+//
+// Each segment (<first seq>.seg) is preallocated and mapped; records are
+// written straight into the mapping and get consecutive sequence numbers.
+// Every index_interval records a (seq, time, offset) entry is added to a
+// sparse index, kept in memory and appended to <first seq>.idx, so opening
+// the store maps the segments and reads the small index files instead of
+// parsing the log; only the records after the last index entry are scanned
+// to find the end. A record torn by a crash fails its checksum and marks
+// the end of the log.
+//
+// read() hands out views into the mappings, so rendering scroll-back
+// copies nothing. append_async() queues a record for the store's writer
+// thread and returns at once; it never blocks on disk and is safe from any
+// thread, including the UI and network threads.
+class HistoryStore {
+public:
+    enum Flags : uint32_t {
+        SELF = 1  // Sent by this user
+    };
+
+    // A stored message. The views point into the mapped segment and are
+    // valid only during the read() callback that received them.
+    struct Record {
+        uint64_t seq = 0;
+        int64_t time_ms = 0;
+        uint32_t flags = 0;
+        std::string_view sender;
+        std::string_view channel;
+        std::string_view body;
+    };
+
+    struct Options {
+        size_t segment_bytes = 8 << 20;
+        size_t index_interval = 64;      // Records per sparse index entry
+        size_t queue_capacity = 16384;   // Records waiting for the writer
+    };
+
+    struct CompactionPolicy {
+        int64_t max_age_ms = 0;  // Drop records older than this; 0 keeps all
+        uint64_t max_bytes = 0;  // Drop the oldest segments beyond this; 0 for no limit
+    };
+
+    struct CompactionResult {
+        size_t segments_removed = 0;
+        size_t segments_rewritten = 0;
+        uint64_t records_removed = 0;
+        uint64_t bytes_reclaimed = 0;
+    };
+
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t first_seq = 0;
+        uint64_t next_seq = 0;
+        size_t segments = 0;
+        uint64_t bytes = 0;            // Record bytes in all segments
+        size_t index_entries = 0;
+        uint64_t queued = 0;           // Accepted by append_async()
+        uint64_t written = 0;          // Written by the writer thread
+        uint64_t dropped = 0;          // Rejected because the queue was full
+        uint64_t recovered_bytes = 0;  // Torn or corrupt tail skipped at open
+    };
+
+    HistoryStore();
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    // Creates the directory if needed, maps the existing segments and
+    // starts the writer thread
+    bool open(const std::string& directory);
+    bool open(const std::string& directory, const Options& options);
+    // Writes what is queued, syncs and unmaps
+    void close();
+    bool is_open() const { return open_.load(); }
+
+    // Writes a record now, from whichever thread calls it. Returns its
+    // sequence number, or 0 on failure.
+    uint64_t append(int64_t time_ms, uint32_t flags, std::string_view sender,
+                    std::string_view channel, std::string_view body);
+    // Queues a record for the writer thread; false, counted as a drop, when
+    // the queue is full. Must not race with close().
+    bool append_async(int64_t time_ms, uint32_t flags, std::string sender,
+                      std::string channel, std::string body);
+    // Waits until everything queued so far is written, then syncs to disk
+    void flush();
+    // Called with each record just written, in sequence order, on the
+    // writing thread while appends are held off; must be quick
+    void set_append_listener(std::function<void(const Record&)> listener);
+
+    // Calls fn for up to max records from from_seq on, in order, until it
+    // returns false. Returns the number of records visited.
+    size_t read(uint64_t from_seq, size_t max, const std::function<bool(const Record&)>& fn) const;
+    // Sequence number of the first record at or after time_ms
+    uint64_t seq_at_time(int64_t time_ms) const;
+    uint64_t first_seq() const;
+    uint64_t next_seq() const;
+
+    // Drops whole segments outside the policy and rewrites the oldest
+    // remaining one without its expired records. The segment being
+    // written is never touched. Runs on the calling thread.
+    CompactionResult compact(const CompactionPolicy& policy, int64_t now_ms);
+    // Runs compact() on the writer thread
+    void compact_async(const CompactionPolicy& policy, int64_t now_ms);
+
+    Stats get_stats() const;
+
+private:
+    struct Segment;
+    struct IndexEntry;
+    struct Pending {
+        int64_t time_ms = 0;
+        uint32_t flags = 0;
+        std::string sender;
+        std::string channel;
+        std::string body;
+    };
+
+    bool load_segment(const std::string& path, uint64_t first_seq, bool last);
+    bool start_segment(uint64_t first_seq);
+    void seal_segment(Segment& segment);
+    bool write_index_entry(Segment& segment, const IndexEntry& entry);
+    void scan_tail(Segment& segment);
+    const Segment* find_segment(uint64_t seq) const;
+    bool rewrite_segment(size_t index, int64_t cutoff_ms, CompactionResult& result);
+    void unmap(Segment& segment, bool remove_files);
+    void writer_loop();
+
+    Options options_;
+    std::string directory_;
+    std::atomic<bool> open_{false};
+
+    // Shared by readers; exclusive to change the segment list or an index
+    mutable std::shared_mutex segments_mutex_;
+    std::vector<std::unique_ptr<Segment>> segments_;
+    // One appender or compaction at a time
+    std::mutex write_mutex_;
+    std::atomic<uint64_t> next_seq_{1};
+    uint64_t recovered_bytes_ = 0;
+    std::function<void(const Record&)> append_listener_;
+
+    // Writer thread
+    std::unique_ptr<MpscQueue<Pending>> queue_;
+    std::thread writer_;
+    std::mutex wake_mutex_;
+    std::condition_variable wake_;
+    std::condition_variable flushed_;
+    std::atomic<bool> wake_pending_{false};
+    bool stopping_ = false;
+    bool compaction_requested_ = false;
+    CompactionPolicy compaction_policy_;
+    int64_t compaction_now_ms_ = 0;
+    std::atomic<uint64_t> queued_{0};
+    std::atomic<uint64_t> written_{0};
+    std::atomic<uint64_t> dropped_{0};
+};
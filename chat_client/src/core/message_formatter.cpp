@@ -0,0 +1,68 @@
+#include "message_formatter.h"
+
+#include <cstring>
+
+namespace {
+
+constexpr size_t kPrefixLength = 11;  // "[HH:MM:SS] "
+constexpr size_t kInitialScratch = 256;
+constexpr std::string_view kSelf = "You";
+
+void put_two_digits(char* out, int value) {
+    out[0] = static_cast<char>('0' + value / 10);
+    out[1] = static_cast<char>('0' + value % 10);
+}
+
+} // namespace
+
+MessageFormatter::MessageFormatter() {
+    std::memcpy(prefix_, "[00:00:00] ", kPrefixLength + 1);
+    scratch_.reserve(kInitialScratch);
+}
+
+std::string_view MessageFormatter::format(std::time_t time, std::string_view sender, std::string_view text,
+                                          bool is_self) {
+    if (!prefix_valid_ || time != prefix_time_) {
+        update_prefix(time);
+    }
+    if (is_self) {
+        sender = kSelf;
+    }
+
+    // resize() keeps the capacity, so once grown this never allocates
+    size_t length = kPrefixLength + sender.size() + 2 + text.size() + 1;
+    scratch_.resize(length);
+    char* out = &scratch_[0];
+    std::memcpy(out, prefix_, kPrefixLength);
+    out += kPrefixLength;
+    std::memcpy(out, sender.data(), sender.size());
+    out += sender.size();
+    *out++ = ':';
+    *out++ = ' ';
+    std::memcpy(out, text.data(), text.size());
+    out += text.size();
+    *out = '\n';
+    return std::string_view(scratch_.data(), length);
+}
+
+void MessageFormatter::reserve(size_t bytes) {
+    scratch_.reserve(bytes);
+}
+
+void MessageFormatter::update_prefix(std::time_t time) {
+    prefix_time_ = time;
+    prefix_valid_ = true;
+    // Zone offsets change on whole minutes, so the rest of a minute is
+    // just its seconds
+    if (minute_valid_ && time >= minute_start_ && time - minute_start_ < 60) {
+        put_two_digits(prefix_ + 7, static_cast<int>(time - minute_start_));
+        return;
+    }
+    std::tm tm{};
+    localtime_r(&time, &tm);
+    minute_start_ = time - tm.tm_sec;
+    minute_valid_ = true;
+    put_two_digits(prefix_ + 1, tm.tm_hour);
+    put_two_digits(prefix_ + 4, tm.tm_min);
+    put_two_digits(prefix_ + 7, tm.tm_sec);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstddef>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+// Formats chat lines as "[HH:MM:SS] sender: text\n" without allocating
+// once warmed up.
+//
+// The line is written into a scratch buffer that is reused from call to
+// call and only grows, so after the longest message so far nothing is
+// allocated. The "[HH:MM:SS] " prefix is cached by second, and within the
+// cached minute only the seconds are rewritten, so localtime() runs once
+// a minute rather than once a message.
+//
+// Not thread-safe; each thread formats with its own.
+class MessageFormatter {
+public:
+    MessageFormatter();
+
+    // The formatted line, valid until the next call. Messages the user
+    // sent show "You" as the sender.
+    std::string_view format(std::time_t time, std::string_view sender, std::string_view text, bool is_self);
+
+    // Grows the scratch buffer so lines up to bytes long never allocate
+    void reserve(size_t bytes);
+
+private:
+    void update_prefix(std::time_t time);
+
+    std::string scratch_;
+    char prefix_[16];  // "[HH:MM:SS] "
+    std::time_t prefix_time_ = 0;
+    bool prefix_valid_ = false;
+    std::time_t minute_start_ = 0;  // Where localtime() last found a minute starting
+    bool minute_valid_ = false;
+};
@@ -0,0 +1,93 @@
+#include "message_inbox.h"
+
+#include <algorithm>
+
+namespace {
+
+// Largest batch handed to the sink in one go; a longer backlog is split
+// over several drains so the UI thread keeps handling input in between
+constexpr size_t kMaxBatch = 4096;
+
+} // namespace
+
+MessageInbox::MessageInbox(size_t capacity, Sink sink, Wake wake)
+    : queue_(capacity), sink_(std::move(sink)), wake_(std::move(wake)) {
+    batch_.reserve(std::min(queue_.capacity(), kMaxBatch));
+}
+
+bool MessageInbox::post(ChatMessage message) {
+    if (!queue_.try_push(std::move(message))) {
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    posted_.fetch_add(1, std::memory_order_relaxed);
+
+    size_t depth = queue_.size();
+    size_t high_water = high_water_.load(std::memory_order_relaxed);
+    while (depth > high_water
+           && !high_water_.compare_exchange_weak(high_water, depth, std::memory_order_relaxed)) {
+    }
+
+    request_drain();
+    return true;
+}
+
+void MessageInbox::request_drain() {
+    // Only the first message since the last drain started schedules one;
+    // that drain will pick up everything queued behind it
+    if (drain_pending_.exchange(true)) {
+        return;
+    }
+    wakes_.fetch_add(1, std::memory_order_relaxed);
+    if (!wake_ || !wake_(&MessageInbox::drain_callback, this)) {
+        // Let the next post try again rather than strand the queue
+        drain_pending_.store(false);
+    }
+}
+
+void MessageInbox::drain_callback(void* inbox) {
+    static_cast<MessageInbox*>(inbox)->drain();
+}
+
+size_t MessageInbox::drain() {
+    // Cleared before popping: a message posted from here on either is
+    // popped below or schedules another drain
+    drain_pending_.store(false);
+
+    ChatMessage message;
+    while (batch_.size() < kMaxBatch && queue_.try_pop(message)) {
+        batch_.push_back(std::move(message));
+    }
+    if (batch_.size() == kMaxBatch && !queue_.empty()) {
+        request_drain();
+    }
+
+    size_t count = batch_.size();
+    if (count > 0) {
+        if (sink_) {
+            sink_(batch_);
+        }
+        batch_.clear();
+        drains_.fetch_add(1, std::memory_order_relaxed);
+        // Released last: once delivered counts a batch, the sink is done with it
+        delivered_.fetch_add(count, std::memory_order_release);
+    }
+    return count;
+}
+
+MessageInbox::Stats MessageInbox::get_stats() const {
+    Stats stats;
+    stats.posted = posted_.load(std::memory_order_relaxed);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+    stats.delivered = delivered_.load(std::memory_order_acquire);
+    stats.drains = drains_.load(std::memory_order_relaxed);
+    stats.wakes = wakes_.load(std::memory_order_relaxed);
+    stats.depth = queue_.size();
+    stats.high_water = high_water_.load(std::memory_order_relaxed);
+    stats.capacity = queue_.capacity();
+    return stats;
+}
+
+float MessageInbox::pressure() const {
+    return static_cast<float>(queue_.size()) / static_cast<float>(queue_.capacity());
+}
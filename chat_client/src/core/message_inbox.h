@@ -0,0 +1,71 @@
+#pragma once
+
+#include "chat_message.h"
+#include "../utils/mpsc_queue.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Hands chat messages from network threads to the UI thread.
+//
+// post() is lock-free and may be called from any number of threads. The
+// first post after a drain asks the UI thread to drain (through Fl::awake
+// in the application); later posts see that a drain is already pending and
+// only enqueue. drain() then hands everything queued to the sink as one
+// batch, so a burst of N messages costs one buffer append and one redraw
+// rather than N. When the queue is full post() drops the message and
+// counts it, so a flood cannot stall the network thread or grow memory.
+class MessageInbox {
+public:
+    // Runs on the UI thread with the messages in arrival order per producer
+    using Sink = std::function<void(std::vector<ChatMessage>& batch)>;
+    // Arranges for handler(data) to run on the UI thread; false if it
+    // could not be scheduled
+    using Wake = std::function<bool(void (*handler)(void*), void* data)>;
+
+    struct Stats {
+        uint64_t posted = 0;     // Accepted by post()
+        uint64_t dropped = 0;    // Rejected because the queue was full
+        uint64_t delivered = 0;  // Handed to the sink
+        uint64_t drains = 0;     // Non-empty batches handed to the sink
+        uint64_t wakes = 0;      // Drain requests made
+        size_t depth = 0;        // Queued now
+        size_t high_water = 0;   // Deepest the queue has been
+        size_t capacity = 0;
+    };
+
+    MessageInbox(size_t capacity, Sink sink, Wake wake);
+
+    MessageInbox(const MessageInbox&) = delete;
+    MessageInbox& operator=(const MessageInbox&) = delete;
+
+    // Any thread. Returns false, and counts a drop, when the queue is full.
+    bool post(ChatMessage message);
+
+    // UI thread. Returns the number of messages delivered.
+    size_t drain();
+
+    Stats get_stats() const;
+    // Fraction of the queue in use, for back-pressure decisions upstream
+    float pressure() const;
+
+private:
+    static void drain_callback(void* inbox);
+    void request_drain();
+
+    MpscQueue<ChatMessage> queue_;
+    Sink sink_;
+    Wake wake_;
+    std::vector<ChatMessage> batch_;  // UI thread only; reused between drains
+
+    std::atomic<bool> drain_pending_{false};
+    std::atomic<uint64_t> posted_{0};
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<uint64_t> delivered_{0};
+    std::atomic<uint64_t> drains_{0};
+    std::atomic<uint64_t> wakes_{0};
+    std::atomic<size_t> high_water_{0};
+};
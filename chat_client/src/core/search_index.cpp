@@ -0,0 +1,707 @@
+#include "search_index.h"
+#include "history_store.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+#include <mutex>
+
+namespace {
+
+constexpr uint32_t kBlockDocs = 128;
+constexpr size_t kMaxTermLength = 32;
+// Shorter prefixes match too many words to join quickly and are taken
+// as whole words
+constexpr size_t kMinPrefixLength = 3;
+// A prefix matching more words than this is expanded to the most
+// frequent of them, which hold nearly all of its matches
+constexpr size_t kMaxPrefixTerms = 128;
+// Messages of a prefix's words merged at a time, and the bounds on the
+// window of messages that takes; windows start at the smallest
+constexpr uint64_t kWindowDocs = 1024;
+constexpr uint64_t kMinWindow = 4096;
+constexpr uint64_t kMaxWindow = 1 << 20;
+constexpr size_t kCatchUpBatch = 4096;
+constexpr uint32_t kNoDoc = UINT32_MAX;
+// Channel terms start with a byte no word can contain
+constexpr char kChannelMark = '\x01';
+
+bool is_word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c >= 0x80;
+}
+
+char fold(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+// Lowercased and cut to kMaxTermLength, the form words are indexed in
+void normalize(std::string_view word, std::string& out) {
+    word = word.substr(0, kMaxTermLength);
+    out.resize(word.size());
+    std::transform(word.begin(), word.end(), out.begin(), fold);
+}
+
+// Calls fn with each word of text, normalized into token
+template <typename Fn>
+void for_each_word(std::string_view text, std::string& token, Fn&& fn) {
+    size_t i = 0;
+    while (i < text.size()) {
+        if (!is_word_byte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < text.size() && is_word_byte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+        normalize(text.substr(start, i - start), token);
+        fn(token);
+    }
+}
+
+void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value) | 0x80);
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t get_varint(const uint8_t*& in) {
+    uint64_t value = 0;
+    int shift = 0;
+    uint8_t byte;
+    do {
+        byte = *in++;
+        value |= uint64_t(byte & 0x7f) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+    return value;
+}
+
+// Milliseconds at local midnight starting YYYY-MM-DD, or false
+bool parse_date(std::string_view text, int64_t& ms) {
+    std::string date(text);
+    std::tm tm{};
+    char extra;
+    if (std::sscanf(date.c_str(), "%d-%d-%d%c", &tm.tm_year, &tm.tm_mon, &tm.tm_mday, &extra) != 3) {
+        return false;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    std::time_t time = std::mktime(&tm);
+    if (time == static_cast<std::time_t>(-1)) {
+        return false;
+    }
+    ms = static_cast<int64_t>(time) * 1000;
+    return true;
+}
+
+} // namespace
+
+// One word's postings. Each block holds up to kBlockDocs messages: per
+// message, varint(delta from the previous message << 1 | single
+// occurrence), the occurrence count if not 1, then varint position
+// deltas. The first delta in a block is from the block's first message.
+struct SearchIndex::Postings {
+    struct Block {
+        uint32_t first_doc;
+        uint32_t last_doc;
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    std::vector<uint8_t> bytes;
+    std::vector<Block> blocks;
+    uint32_t docs = 0;
+
+    void add(uint32_t doc, const uint32_t* positions, size_t count) {
+        uint32_t delta = 0;
+        if (blocks.empty() || blocks.back().count == kBlockDocs) {
+            blocks.push_back(Block{ doc, doc, static_cast<uint32_t>(bytes.size()), 0 });
+        } else {
+            delta = doc - blocks.back().last_doc;
+        }
+        Block& block = blocks.back();
+        block.last_doc = doc;
+        ++block.count;
+        ++docs;
+        put_varint(bytes, uint64_t(delta) << 1 | (count == 1 ? 1 : 0));
+        if (count != 1) {
+            put_varint(bytes, count);
+        }
+        uint32_t previous = 0;
+        for (size_t i = 0; i < count; ++i) {
+            put_varint(bytes, positions[i] - previous);
+            previous = positions[i];
+        }
+    }
+};
+
+// Walks matching messages from the newest back. Targets passed to seek()
+// never increase.
+class SearchIndex::Cursor {
+public:
+    virtual ~Cursor() = default;
+    // The newest matching message at or before target, or kNoDoc
+    virtual uint32_t seek(uint32_t target) = 0;
+    // Roughly how many messages it can match; the rarest clause leads
+    virtual uint64_t cost() const = 0;
+
+    // The newest message at or before target that every cursor matches,
+    // or kNoDoc. Each cursor in turn seeks to the current candidate; one
+    // that lands earlier makes that the candidate, until all agree.
+    static uint32_t join(const std::vector<Cursor*>& cursors, uint32_t target) {
+        uint32_t doc = target;
+        size_t agreed = 0;
+        size_t i = 0;
+        while (agreed < cursors.size()) {
+            uint32_t found = cursors[i]->seek(doc);
+            if (found == kNoDoc) {
+                return kNoDoc;
+            }
+            if (found == doc) {
+                ++agreed;
+            } else {
+                doc = found;
+                agreed = 1;
+            }
+            i = (i + 1) % cursors.size();
+        }
+        return doc;
+    }
+};
+
+class SearchIndex::TermCursor final : public Cursor {
+public:
+    explicit TermCursor(const Postings& postings) : postings_(postings) {}
+
+    uint32_t seek(uint32_t target) override {
+        const auto& blocks = postings_.blocks;
+        bool in_block = block_ < blocks.size() && blocks[block_].first_doc <= target
+            && (block_ + 1 == blocks.size() || blocks[block_ + 1].first_doc > target);
+        if (!in_block) {
+            // Targets only go back, so gallop back from the current block
+            // before searching the rest
+            auto end = blocks.end();
+            auto begin = blocks.begin();
+            if (block_ < blocks.size() && blocks[block_].first_doc > target) {
+                end = blocks.begin() + block_;
+                size_t step = 1;
+                while (static_cast<size_t>(end - begin) > step && (end - step)->first_doc > target) {
+                    end -= step;
+                    step *= 2;
+                }
+                if (static_cast<size_t>(end - begin) > step) {
+                    begin = end - step;
+                }
+            }
+            auto next = std::upper_bound(begin, end, target,
+                                         [](uint32_t value, const Postings::Block& b) { return value < b.first_doc; });
+            if (next == blocks.begin()) {
+                return kNoDoc;
+            }
+            block_ = static_cast<size_t>(next - blocks.begin()) - 1;
+            decoded_ = false;
+            scanned_ = false;
+        }
+        // At or past the block's last message the skip entry is the answer,
+        // and most seeks into rare words' blocks end here
+        if (target >= blocks[block_].last_doc) {
+            return current_ = blocks[block_].last_doc;
+        }
+        // A block landed in once, as when a rare clause leads, is scanned
+        // only up to the target; one walked through is decoded
+        if (!decoded_ && !scanned_) {
+            scanned_ = true;
+            return current_ = scan(target);
+        }
+        decode();
+        while (docs_[index_] > target) {
+            --index_;
+        }
+        return current_ = docs_[index_];
+    }
+
+    uint64_t cost() const override { return postings_.docs; }
+
+    // Positions of the word in the message seek() last returned
+    const uint32_t* positions_begin() {
+        decode();
+        return positions_.data() + position_starts_[index_];
+    }
+    const uint32_t* positions_end() {
+        decode();
+        return positions_.data() + position_starts_[index_ + 1];
+    }
+
+private:
+    // The last message in the block at or before target
+    uint32_t scan(uint32_t target) const {
+        const Postings::Block& b = postings_.blocks[block_];
+        const uint8_t* in = postings_.bytes.data() + b.offset;
+        uint32_t doc = b.first_doc;
+        uint32_t found = doc;
+        for (uint32_t i = 0; i < b.count; ++i) {
+            uint64_t value = get_varint(in);
+            doc += static_cast<uint32_t>(value >> 1);
+            if (doc > target) {
+                break;
+            }
+            found = doc;
+            for (uint64_t count = (value & 1) ? 1 : get_varint(in); count > 0; --count) {
+                get_varint(in);
+            }
+        }
+        return found;
+    }
+
+    // Decodes the block and points at current_ in it
+    void decode() {
+        if (decoded_) {
+            return;
+        }
+        decoded_ = true;
+        const Postings::Block& b = postings_.blocks[block_];
+        const uint8_t* in = postings_.bytes.data() + b.offset;
+        docs_.clear();
+        position_starts_.clear();
+        positions_.clear();
+        uint32_t doc = b.first_doc;
+        for (uint32_t i = 0; i < b.count; ++i) {
+            uint64_t value = get_varint(in);
+            doc += static_cast<uint32_t>(value >> 1);
+            uint64_t count = (value & 1) ? 1 : get_varint(in);
+            docs_.push_back(doc);
+            position_starts_.push_back(static_cast<uint32_t>(positions_.size()));
+            uint32_t position = 0;
+            for (uint64_t j = 0; j < count; ++j) {
+                position += static_cast<uint32_t>(get_varint(in));
+                positions_.push_back(position);
+            }
+        }
+        position_starts_.push_back(static_cast<uint32_t>(positions_.size()));
+        index_ = static_cast<size_t>(std::upper_bound(docs_.begin(), docs_.end(), current_) - docs_.begin()) - 1;
+    }
+
+    const Postings& postings_;
+    size_t block_ = SIZE_MAX;
+    bool decoded_ = false;
+    bool scanned_ = false;
+    uint32_t current_ = kNoDoc;  // What seek() last returned
+    size_t index_ = 0;           // Of current_ in a decoded block
+    std::vector<uint32_t> docs_;
+    std::vector<uint32_t> position_starts_;
+    std::vector<uint32_t> positions_;
+};
+
+// Messages with the words next to each other, in order
+class SearchIndex::PhraseCursor : public Cursor {
+public:
+    explicit PhraseCursor(std::vector<std::unique_ptr<TermCursor>> words) : words_(std::move(words)) {
+        for (const auto& word : words_) {
+            joined_.push_back(word.get());
+        }
+        // Joined rarest first; positions are still checked in phrase order
+        std::sort(joined_.begin(), joined_.end(),
+                  [](const Cursor* a, const Cursor* b) { return a->cost() < b->cost(); });
+    }
+
+    uint32_t seek(uint32_t target) override {
+        for (;;) {
+            uint32_t doc = join(joined_, target);
+            if (doc == kNoDoc || adjacent()) {
+                return doc;
+            }
+            if (doc == 0) {
+                return kNoDoc;
+            }
+            target = doc - 1;
+        }
+    }
+
+    uint64_t cost() const override { return joined_.front()->cost(); }
+
+private:
+    bool adjacent() const {
+        TermCursor& first = *words_.front();
+        for (const uint32_t* p = first.positions_begin(); p != first.positions_end(); ++p) {
+            bool found = true;
+            for (size_t i = 1; i < words_.size() && found; ++i) {
+                found = std::binary_search(words_[i]->positions_begin(), words_[i]->positions_end(),
+                                           *p + static_cast<uint32_t>(i));
+            }
+            if (found) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<TermCursor>> words_;
+    std::vector<Cursor*> joined_;
+};
+
+// Messages with any of the words a prefix expands to. The words are
+// merged a window of messages at a time into a bitmap, so that checking
+// a message another clause leads with costs a bit test rather than a
+// seek in every word. Windows grow to hold about kWindowDocs of the
+// words' messages; the first is small, for when the prefix leads.
+class SearchIndex::PrefixCursor : public Cursor {
+public:
+    PrefixCursor(std::vector<const Postings*> words, uint32_t messages) {
+        uint64_t total = 0;
+        for (const Postings* postings : words) {
+            words_.push_back(Word{ postings, postings->blocks.size(), {}, 0 });
+            total += postings->docs;
+        }
+        cost_ = total;
+        uint64_t window = total ? uint64_t(kWindowDocs) * messages / total : kMaxWindow;
+        window = std::min<uint64_t>(std::max<uint64_t>(window, kMinWindow), kMaxWindow);
+        bits_.resize((window + 63) / 64);
+        words_in_window_ = kMinWindow / 64;
+    }
+
+    uint32_t seek(uint32_t target) override {
+        for (;;) {
+            if (!filled_ || target < lo_) {
+                fill(target);
+            }
+            // The newest set bit at or before target
+            uint32_t offset = target - lo_;
+            size_t i = offset / 64;
+            uint64_t word = bits_[i] & (~uint64_t(0) >> (63 - offset % 64));
+            for (;;) {
+                if (word) {
+                    return lo_ + static_cast<uint32_t>(i * 64 + 63 - __builtin_clzll(word));
+                }
+                if (i == 0) {
+                    break;
+                }
+                word = bits_[--i];
+            }
+            if (lo_ == 0) {
+                return kNoDoc;
+            }
+            target = lo_ - 1;
+        }
+    }
+
+    uint64_t cost() const override { return cost_; }
+
+private:
+    // Read back to front: docs[0, left) of the block last decoded, then
+    // blocks [0, block)
+    struct Word {
+        const Postings* postings;
+        size_t block;
+        std::vector<uint32_t> docs;
+        size_t left = 0;
+    };
+
+    // Sets the bits of the window ending at hi
+    void fill(uint32_t hi) {
+        const uint32_t size = static_cast<uint32_t>(words_in_window_ * 64);
+        filled_ = true;
+        hi_ = hi;
+        lo_ = hi >= size - 1 ? hi - (size - 1) : 0;
+        std::fill(bits_.begin(), bits_.begin() + words_in_window_, 0);
+        words_in_window_ = std::min(2 * words_in_window_, bits_.size());
+        for (Word& word : words_) {
+            const auto& blocks = word.postings->blocks;
+            while (word.left > 0 && word.docs[word.left - 1] > hi_) {
+                --word.left;
+            }
+            if (word.left == 0) {
+                // Blocks past the window are skipped undecoded
+                word.block = static_cast<size_t>(
+                    std::upper_bound(blocks.begin(), blocks.begin() + word.block, hi_,
+                                     [](uint32_t value, const Postings::Block& b) { return value < b.first_doc; })
+                    - blocks.begin());
+            }
+            for (;;) {
+                for (; word.left > 0 && word.docs[word.left - 1] >= lo_; --word.left) {
+                    uint32_t offset = word.docs[word.left - 1] - lo_;
+                    bits_[offset / 64] |= uint64_t(1) << (offset % 64);
+                }
+                if (word.left > 0 || word.block == 0 || blocks[word.block - 1].last_doc < lo_) {
+                    break;
+                }
+                decode(*word.postings, blocks[--word.block], word.docs);
+                word.left = word.docs.size();
+                while (word.left > 0 && word.docs[word.left - 1] > hi_) {
+                    --word.left;
+                }
+            }
+        }
+    }
+
+    // The block's messages, without their positions
+    static void decode(const Postings& postings, const Postings::Block& block, std::vector<uint32_t>& docs) {
+        docs.clear();
+        const uint8_t* in = postings.bytes.data() + block.offset;
+        uint32_t doc = block.first_doc;
+        for (uint32_t i = 0; i < block.count; ++i) {
+            uint64_t value = get_varint(in);
+            doc += static_cast<uint32_t>(value >> 1);
+            docs.push_back(doc);
+            for (uint64_t count = (value & 1) ? 1 : get_varint(in); count > 0; --count) {
+                get_varint(in);
+            }
+        }
+    }
+
+    std::vector<Word> words_;
+    uint64_t cost_ = 0;
+    std::vector<uint64_t> bits_;  // Bit i is message lo_ + i
+    size_t words_in_window_;       // Of bits_, in the next window
+    bool filled_ = false;
+    uint32_t lo_ = 0;
+    uint32_t hi_ = 0;
+};
+
+SearchIndex::SearchIndex(uint64_t first_seq) : first_seq_(first_seq) {}
+
+SearchIndex::~SearchIndex() = default;
+
+bool SearchIndex::add(uint64_t seq, int64_t time_ms, std::string_view channel, std::string_view text) {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (seq != first_seq_ + times_.size()) {
+        ++ignored_;
+        return false;
+    }
+    add_locked(time_ms, channel, text);
+    return true;
+}
+
+void SearchIndex::add_locked(int64_t time_ms, std::string_view channel, std::string_view text) {
+    uint32_t doc = static_cast<uint32_t>(times_.size());
+    times_.push_back(times_.empty() ? time_ms : std::max(time_ms, times_.back()));
+
+    occurrences_.clear();
+    uint32_t position = 0;
+    for_each_word(text, token_, [this, &position](const std::string& word) {
+        occurrences_.emplace_back(term_id(word), position++);
+    });
+    // Grouped by word, positions ascending
+    std::sort(occurrences_.begin(), occurrences_.end());
+    for (size_t i = 0; i < occurrences_.size();) {
+        uint32_t term = occurrences_[i].first;
+        positions_.clear();
+        for (; i < occurrences_.size() && occurrences_[i].first == term; ++i) {
+            positions_.push_back(occurrences_[i].second);
+        }
+        postings_[term].add(doc, positions_.data(), positions_.size());
+        ++posting_count_;
+    }
+
+    token_.assign(1, kChannelMark);
+    token_.append(channel.data(), channel.size());
+    uint32_t zero = 0;
+    postings_[term_id(token_)].add(doc, &zero, 1);
+}
+
+void SearchIndex::catch_up(const HistoryStore& store, const std::atomic<bool>& cancel) {
+    while (!cancel.load()) {
+        uint64_t from = next_seq();
+        if (from >= store.next_seq()) {
+            break;
+        }
+        size_t visited = store.read(from, kCatchUpBatch, [this, &cancel](const HistoryStore::Record& record) {
+            std::unique_lock<std::shared_mutex> lock(mutex_);
+            uint64_t next = first_seq_ + times_.size();
+            if (record.seq < next) {
+                return true;  // Added meanwhile by the listener
+            }
+            // Records compacted away before they were indexed are left as
+            // empty slots, so message numbers still follow the log
+            int64_t filler = times_.empty() ? record.time_ms : times_.back();
+            times_.resize(times_.size() + (record.seq - next), filler);
+            add_locked(record.time_ms, record.channel, record.body);
+            return !cancel.load(std::memory_order_relaxed);
+        });
+        if (visited == 0) {
+            break;
+        }
+    }
+}
+
+uint32_t SearchIndex::term_id(const std::string& term) {
+    auto it = term_ids_.find(term);
+    if (it != term_ids_.end()) {
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(postings_.size());
+    it = term_ids_.emplace(term, id).first;
+    sorted_terms_.emplace(it->first, id);
+    postings_.emplace_back();
+    return id;
+}
+
+const SearchIndex::Postings* SearchIndex::find(std::string_view term) const {
+    auto it = term_ids_.find(std::string(term));
+    return it == term_ids_.end() ? nullptr : &postings_[it->second];
+}
+
+std::unique_ptr<SearchIndex::Cursor> SearchIndex::prefix_cursor(std::string_view prefix) const {
+    std::vector<const Postings*> matches;
+    for (auto it = sorted_terms_.lower_bound(prefix);
+         it != sorted_terms_.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+        matches.push_back(&postings_[it->second]);
+    }
+    if (matches.empty()) {
+        return nullptr;
+    }
+    if (matches.size() == 1) {
+        return std::make_unique<TermCursor>(*matches.front());
+    }
+    if (matches.size() > kMaxPrefixTerms) {
+        std::nth_element(matches.begin(), matches.begin() + kMaxPrefixTerms, matches.end(),
+                         [](const Postings* a, const Postings* b) { return a->docs > b->docs; });
+        matches.resize(kMaxPrefixTerms);
+    }
+    return std::make_unique<PrefixCursor>(std::move(matches), static_cast<uint32_t>(times_.size()));
+}
+
+std::vector<SearchIndex::Hit> SearchIndex::search(const Query& query) const {
+    std::vector<Hit> hits;
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    if (query.limit == 0 || times_.empty()) {
+        return hits;
+    }
+
+    // Times never decrease, so the time range is a range of messages
+    auto lo = std::lower_bound(times_.begin(), times_.end(), query.from_ms);
+    auto hi = std::lower_bound(lo, times_.end(), query.to_ms);
+    if (lo == hi) {
+        return hits;
+    }
+
+    // One cursor per clause; a clause nothing matches matches no message
+    std::vector<std::unique_ptr<Cursor>> clauses;
+    std::string token;
+    std::string_view text = query.text;
+    size_t i = 0;
+    while (i < text.size()) {
+        if (text[i] == '"') {
+            size_t end = std::min(text.find('"', i + 1), text.size());
+            std::vector<std::unique_ptr<TermCursor>> words;
+            bool unknown = false;
+            for_each_word(text.substr(i + 1, end - i - 1), token, [&](const std::string& word) {
+                const Postings* postings = find(word);
+                unknown = unknown || !postings;
+                if (postings) {
+                    words.push_back(std::make_unique<TermCursor>(*postings));
+                }
+            });
+            if (unknown) {
+                return hits;
+            }
+            if (words.size() == 1) {
+                clauses.push_back(std::move(words.front()));
+            } else if (!words.empty()) {
+                clauses.push_back(std::make_unique<PhraseCursor>(std::move(words)));
+            }
+            i = end + 1;
+            continue;
+        }
+        if (!is_word_byte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < text.size() && is_word_byte(static_cast<unsigned char>(text[i]))) {
+            ++i;
+        }
+        normalize(text.substr(start, i - start), token);
+        if (i < text.size() && text[i] == '*' && token.size() >= kMinPrefixLength) {
+            std::unique_ptr<Cursor> cursor = prefix_cursor(token);
+            if (!cursor) {
+                return hits;
+            }
+            clauses.push_back(std::move(cursor));
+        } else {
+            const Postings* postings = find(token);
+            if (!postings) {
+                return hits;
+            }
+            clauses.push_back(std::make_unique<TermCursor>(*postings));
+        }
+    }
+    if (!query.channel.empty()) {
+        const Postings* postings = find(std::string(1, kChannelMark) + query.channel);
+        if (!postings) {
+            return hits;
+        }
+        clauses.push_back(std::make_unique<TermCursor>(*postings));
+    }
+    if (clauses.empty()) {
+        return hits;
+    }
+
+    std::vector<Cursor*> cursors;
+    for (const auto& clause : clauses) {
+        cursors.push_back(clause.get());
+    }
+    std::sort(cursors.begin(), cursors.end(), [](const Cursor* a, const Cursor* b) { return a->cost() < b->cost(); });
+
+    uint32_t first = static_cast<uint32_t>(lo - times_.begin());
+    uint32_t target = static_cast<uint32_t>(hi - times_.begin()) - 1;
+    while (hits.size() < query.limit) {
+        uint32_t doc = Cursor::join(cursors, target);
+        if (doc == kNoDoc || doc < first) {
+            break;
+        }
+        hits.push_back(Hit{ first_seq_ + doc, times_[doc] });
+        if (doc == 0) {
+            break;
+        }
+        target = doc - 1;
+    }
+    return hits;
+}
+
+SearchIndex::Query SearchIndex::parse(std::string_view text) {
+    Query query;
+    size_t i = 0;
+    while (i < text.size()) {
+        size_t end = std::min(text.find(' ', i), text.size());
+        std::string_view word = text.substr(i, end - i);
+        int64_t ms = 0;
+        if (word.compare(0, 3, "in:") == 0 && word.size() > 3) {
+            query.channel = std::string(word.substr(3));
+        } else if (word.compare(0, 6, "after:") == 0 && parse_date(word.substr(6), ms)) {
+            query.from_ms = ms;
+        } else if (word.compare(0, 7, "before:") == 0 && parse_date(word.substr(7), ms)) {
+            query.to_ms = ms;
+        } else if (!word.empty()) {
+            if (!query.text.empty()) {
+                query.text += ' ';
+            }
+            query.text.append(word.data(), word.size());
+        }
+        i = end + 1;
+    }
+    return query;
+}
+
+uint64_t SearchIndex::next_seq() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return first_seq_ + times_.size();
+}
+
+SearchIndex::Stats SearchIndex::get_stats() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    Stats stats;
+    stats.messages = times_.size();
+    stats.first_seq = first_seq_;
+    stats.next_seq = first_seq_ + times_.size();
+    stats.terms = postings_.size();
+    stats.postings = posting_count_;
+    for (const Postings& postings : postings_) {
+        stats.posting_bytes += postings.bytes.size() + postings.blocks.size() * sizeof(Postings::Block);
+    }
+    stats.ignored = ignored_;
+    return stats;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+class HistoryStore;
+
+// Full-text index over the chat log: an inverted index from words to the
+// messages that contain them, updated as each message is logged.
+//
+// Messages are identified by their HistoryStore sequence number and must
+// be added in sequence order. Each word's postings are kept in blocks of
+// 128 messages, delta and varint encoded with the word's positions in
+// each message, plus a skip entry per block, so a query decodes only the
+// blocks it lands in. The channel of each message is indexed as a term of
+// its own, so channel filters join like words do.
+//
+// Queries walk the postings from the newest message back and stop at the
+// limit, so a screenful of results costs the same however large the
+// history is.
+//
+// add() and search() may be called from different threads.
+class SearchIndex {
+public:
+    struct Query {
+        // Words, all of which must appear; "quoted words" must appear
+        // together in that order; word* matches any word it starts, for
+        // words of three letters or more, expanded to the 128 most
+        // frequent such words
+        std::string text;
+        std::string channel;            // Empty for all channels
+        int64_t from_ms = INT64_MIN;    // Inclusive
+        int64_t to_ms = INT64_MAX;      // Exclusive
+        size_t limit = 100;
+    };
+
+    struct Hit {
+        uint64_t seq = 0;
+        int64_t time_ms = 0;
+    };
+
+    struct Stats {
+        uint64_t messages = 0;
+        uint64_t first_seq = 0;
+        uint64_t next_seq = 0;
+        size_t terms = 0;
+        uint64_t postings = 0;        // (word, message) pairs
+        uint64_t posting_bytes = 0;   // Encoded postings and skip entries
+        uint64_t ignored = 0;         // Adds out of sequence order
+    };
+
+    // Indexes messages from first_seq on
+    explicit SearchIndex(uint64_t first_seq = 1);
+    ~SearchIndex();
+
+    SearchIndex(const SearchIndex&) = delete;
+    SearchIndex& operator=(const SearchIndex&) = delete;
+
+    // Indexes the message with sequence number next_seq(); any other is
+    // ignored and false returned
+    bool add(uint64_t seq, int64_t time_ms, std::string_view channel, std::string_view text);
+    // Adds the store's records from next_seq() on until it has them all,
+    // or cancel is set. Records appended meanwhile are picked up too, so
+    // it can run alongside an append listener feeding add().
+    void catch_up(const HistoryStore& store, const std::atomic<bool>& cancel);
+
+    // Matching messages, newest first
+    std::vector<Hit> search(const Query& query) const;
+    // A query from what the user typed. Besides the query text it takes
+    // in:<channel>, after:<YYYY-MM-DD> and before:<YYYY-MM-DD>, in local
+    // time.
+    static Query parse(std::string_view text);
+
+    uint64_t next_seq() const;
+    Stats get_stats() const;
+
+private:
+    struct Postings;
+    class Cursor;
+    class TermCursor;
+    class PhraseCursor;
+    class PrefixCursor;
+
+    void add_locked(int64_t time_ms, std::string_view channel, std::string_view text);
+    uint32_t term_id(const std::string& term);
+    const Postings* find(std::string_view term) const;
+    std::unique_ptr<Cursor> prefix_cursor(std::string_view prefix) const;
+
+    mutable std::shared_mutex mutex_;
+    uint64_t first_seq_;
+    std::vector<int64_t> times_;  // Per message, never decreasing
+    std::unordered_map<std::string, uint32_t> term_ids_;
+    // Views of term_ids_ keys, whose nodes do not move, for prefix lookups
+    std::map<std::string_view, uint32_t> sorted_terms_;
+    std::vector<Postings> postings_;
+    uint64_t posting_count_ = 0;
+    uint64_t ignored_ = 0;
+
+    // Reused by add()
+    std::string token_;
+    std::vector<std::pair<uint32_t, uint32_t>> occurrences_;  // (term, position)
+    std::vector<uint32_t> positions_;
+};
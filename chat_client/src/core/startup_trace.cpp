@@ -0,0 +1,129 @@
+#include "startup_trace.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+namespace {
+
+// Phase names are ours, but keep the output valid whatever they hold
+void append_json_string(std::ostringstream& out, const std::string& text) {
+    out << '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out << ' ';
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+} // namespace
+
+StartupTrace::Phase::Phase(StartupTrace& trace, const char* name)
+    : trace_(trace), name_(name), begin_(Clock::now()) {}
+
+StartupTrace::Phase::~Phase() {
+    trace_.record(name_, begin_, Clock::now());
+}
+
+StartupTrace::StartupTrace()
+    : StartupTrace(Clock::now()) {}
+
+StartupTrace::StartupTrace(Clock::time_point origin)
+    : origin_(origin) {}
+
+int64_t StartupTrace::since_origin(Clock::time_point time) const {
+    return std::chrono::duration_cast<std::chrono::microseconds>(time - origin_).count();
+}
+
+uint32_t StartupTrace::thread_number(std::thread::id id) {
+    auto found = std::find(threads_.begin(), threads_.end(), id);
+    if (found == threads_.end()) {
+        threads_.push_back(id);
+        return static_cast<uint32_t>(threads_.size());
+    }
+    return static_cast<uint32_t>(found - threads_.begin()) + 1;
+}
+
+void StartupTrace::record(const std::string& name, Clock::time_point begin, Clock::time_point end) {
+    Event event;
+    event.name = name;
+    event.begin_us = since_origin(begin);
+    event.end_us = std::max(event.begin_us, since_origin(end));
+    std::lock_guard<std::mutex> lock(mutex_);
+    event.thread = thread_number(std::this_thread::get_id());
+    events_.push_back(std::move(event));
+}
+
+void StartupTrace::mark(const std::string& name) {
+    Event event;
+    event.name = name;
+    event.begin_us = event.end_us = since_origin(Clock::now());
+    event.mark = true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    event.thread = thread_number(std::this_thread::get_id());
+    events_.push_back(std::move(event));
+}
+
+int64_t StartupTrace::time_of(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const Event& event : events_) {
+        if (event.name == name) {
+            return event.end_us;
+        }
+    }
+    return -1;
+}
+
+std::vector<StartupTrace::Event> StartupTrace::events() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return events_;
+}
+
+std::string StartupTrace::chrome_json() const {
+    std::vector<Event> events = this->events();
+    uint32_t threads = 0;
+    for (const Event& event : events) {
+        threads = std::max(threads, event.thread);
+    }
+
+    std::vector<std::string> lines;
+    for (uint32_t thread = 1; thread <= threads; ++thread) {
+        std::ostringstream line;
+        line << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+             << ",\"args\":{\"name\":\"" << (thread == 1 ? "main" : "startup " + std::to_string(thread))
+             << "\"}}";
+        lines.push_back(line.str());
+    }
+    for (const Event& event : events) {
+        std::ostringstream line;
+        line << "{\"name\":";
+        append_json_string(line, event.name);
+        line << ",\"cat\":\"startup\",\"ph\":\"" << (event.mark ? "i" : "X") << "\",\"ts\":" << event.begin_us;
+        if (event.mark) {
+            line << ",\"s\":\"p\"";
+        } else {
+            line << ",\"dur\":" << event.end_us - event.begin_us;
+        }
+        line << ",\"pid\":1,\"tid\":" << event.thread << "}";
+        lines.push_back(line.str());
+    }
+
+    std::ostringstream out;
+    out << "{\"traceEvents\":[\n";
+    for (size_t i = 0; i < lines.size(); ++i) {
+        out << lines[i] << (i + 1 < lines.size() ? ",\n" : "\n");
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+    return out.str();
+}
+
+bool StartupTrace::write_chrome_json(const std::string& path) const {
+    std::ofstream file(path);
+    file << chrome_json();
+    return static_cast<bool>(file);
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Timestamps of the phases of startup, from any thread, for the Chrome
+// trace viewer (chrome://tracing, Perfetto) or a one-line summary.
+//
+// Times are from the trace's origin, normally when the application is
+// constructed. A phase is timed by a Phase on the stack of the thread that
+// runs it; a mark records an instant, such as the first frame drawn.
+// Recording takes a lock, which is fine for the dozen or so events of a
+// startup and not meant for anything hotter.
+class StartupTrace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        std::string name;
+        uint32_t thread = 0;   // 1 for the first thread to record, and so on
+        int64_t begin_us = 0;  // From the origin
+        int64_t end_us = 0;    // The same as begin_us for a mark
+        bool mark = false;
+    };
+
+    // Times the enclosing scope
+    class Phase {
+    public:
+        Phase(StartupTrace& trace, const char* name);
+        ~Phase();
+
+        Phase(const Phase&) = delete;
+        Phase& operator=(const Phase&) = delete;
+
+    private:
+        StartupTrace& trace_;
+        const char* name_;
+        Clock::time_point begin_;
+    };
+
+    StartupTrace();
+    explicit StartupTrace(Clock::time_point origin);
+
+    StartupTrace(const StartupTrace&) = delete;
+    StartupTrace& operator=(const StartupTrace&) = delete;
+
+    void record(const std::string& name, Clock::time_point begin, Clock::time_point end);
+    void mark(const std::string& name);
+
+    // When the first event of that name ended, in microseconds from the
+    // origin; -1 if there is none yet
+    int64_t time_of(const std::string& name) const;
+
+    std::vector<Event> events() const;
+
+    // {"traceEvents":[...]}, one event a line, with the threads named
+    std::string chrome_json() const;
+    bool write_chrome_json(const std::string& path) const;
+
+private:
+    uint32_t thread_number(std::thread::id id);  // Under mutex_
+    int64_t since_origin(Clock::time_point time) const;
+
+    const Clock::time_point origin_;
+    mutable std::mutex mutex_;
+    std::vector<Event> events_;
+    std::vector<std::thread::id> threads_;
+};
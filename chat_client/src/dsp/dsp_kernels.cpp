@@ -0,0 +1,126 @@
+#include "dsp_kernels.h"
+
+#include <algorithm>
+
+namespace {
+
+float scalar_sum_squares(const float* x, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += x[i] * x[i];
+    }
+    return sum;
+}
+
+float scalar_stereo_mid_sum_squares(const float* stereo, size_t frames) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < frames; ++i) {
+        float mid = (stereo[2 * i] + stereo[2 * i + 1]) * 0.5f;
+        sum += mid * mid;
+    }
+    return sum;
+}
+
+float scalar_peak(const float* x, size_t n) {
+    float peak = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        peak = std::max(peak, std::fabs(x[i]));
+    }
+    return peak;
+}
+
+void scalar_gain(const float* in, float* out, size_t n, float gain) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+void scalar_mono_to_stereo(const float* in, float* out, size_t frames, float gain) {
+    for (size_t i = 0; i < frames; ++i) {
+        float sample = in[i] * gain;
+        out[2 * i] = sample;
+        out[2 * i + 1] = sample;
+    }
+}
+
+void scalar_mix(const float* in, float* inout, size_t n, float gain) {
+    for (size_t i = 0; i < n; ++i) {
+        inout[i] += in[i] * gain;
+    }
+}
+
+float scalar_dot(const float* a, const float* b, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void scalar_min_max(const float* x, size_t n, float* min, float* max) {
+    float lo = n ? x[0] : 0.0f;
+    float hi = lo;
+    for (size_t i = 1; i < n; ++i) {
+        lo = std::min(lo, x[i]);
+        hi = std::max(hi, x[i]);
+    }
+    *min = lo;
+    *max = hi;
+}
+
+void scalar_power_spectrum(const float* re, const float* im, float* out, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = re[i] * re[i] + im[i] * im[i];
+    }
+}
+
+void scalar_butterflies(float* a_re, float* a_im, float* b_re, float* b_im,
+                        const float* w_re, const float* w_im, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+        float vr = b_re[i] * w_re[i] - b_im[i] * w_im[i];
+        float vi = b_re[i] * w_im[i] + b_im[i] * w_re[i];
+        b_re[i] = a_re[i] - vr;
+        b_im[i] = a_im[i] - vi;
+        a_re[i] += vr;
+        a_im[i] += vi;
+    }
+}
+
+const DspKernels kScalarKernels = {
+    DspKernels::Isa::SCALAR,
+    "scalar",
+    scalar_sum_squares,
+    scalar_stereo_mid_sum_squares,
+    scalar_peak,
+    scalar_gain,
+    scalar_mono_to_stereo,
+    scalar_mix,
+    scalar_dot,
+    scalar_min_max,
+    scalar_power_spectrum,
+    scalar_butterflies,
+};
+
+const DspKernels* select_kernels() {
+    if (const DspKernels* k = dsp_kernels_avx2()) return k;
+    if (const DspKernels* k = dsp_kernels_neon()) return k;
+    if (const DspKernels* k = dsp_kernels_sse2()) return k;
+    return &kScalarKernels;
+}
+
+} // namespace
+
+const DspKernels& dsp_kernels() {
+    static const DspKernels* selected = select_kernels();
+    return *selected;
+}
+
+const DspKernels* dsp_kernels_for(DspKernels::Isa isa) {
+    switch (isa) {
+        case DspKernels::Isa::SCALAR: return &kScalarKernels;
+        case DspKernels::Isa::SSE2:   return dsp_kernels_sse2();
+        case DspKernels::Isa::AVX2:   return dsp_kernels_avx2();
+        case DspKernels::Isa::NEON:   return dsp_kernels_neon();
+    }
+    return nullptr;
+}
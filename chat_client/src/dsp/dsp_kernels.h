@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+// Vectorised DSP kernels for the audio hot path.
+//
+// Every kernel has a scalar reference implementation plus SSE2/AVX2 (built
+// when USE_SSE2/USE_AVX are defined) and NEON (ARM_NEON) variants. The best
+// table for the running CPU is picked once at startup; all buffers may be
+// unaligned. Results match the scalar reference up to summation order in
+// the reductions (and multiply-add contraction on NEON).
+struct DspKernels {
+    enum class Isa { SCALAR, SSE2, AVX2, NEON };
+
+    Isa isa;
+    const char* name;
+
+    // Sum of x[i]^2
+    float (*sum_squares)(const float* x, size_t n);
+    // Sum of ((l + r) / 2)^2 over interleaved stereo frames
+    float (*stereo_mid_sum_squares)(const float* stereo, size_t frames);
+    // Largest |x[i]|, 0 for none
+    float (*peak)(const float* x, size_t n);
+    // out[i] = in[i] * gain (in and out may alias)
+    void (*gain)(const float* in, float* out, size_t n, float gain);
+    // out[2i] = out[2i+1] = in[i] * gain
+    void (*mono_to_stereo)(const float* in, float* out, size_t frames, float gain);
+    // inout[i] += in[i] * gain
+    void (*mix)(const float* in, float* inout, size_t n, float gain);
+    // Sum of a[i] * b[i]; the FIR inner loop of the resampler
+    float (*dot)(const float* a, const float* b, size_t n);
+    // Smallest and largest x[i], both 0 for none
+    void (*min_max)(const float* x, size_t n, float* min, float* max);
+    // out[i] = re[i]^2 + im[i]^2, the power of each FFT bin
+    void (*power_spectrum)(const float* re, const float* im, float* out, size_t n);
+    // One radix-2 FFT stage on split complex data, n butterflies: with
+    // v = b[i] * w[i], b[i] = a[i] - v and a[i] += v
+    void (*butterflies)(float* a_re, float* a_im, float* b_re, float* b_im,
+                        const float* w_re, const float* w_im, size_t n);
+};
+
+// Kernels selected for this CPU by runtime dispatch.
+const DspKernels& dsp_kernels();
+
+// A specific implementation, or nullptr if it was not built or the CPU lacks
+// the instructions. Used by tests and benchmarks.
+const DspKernels* dsp_kernels_for(DspKernels::Isa isa);
+
+inline float dsp_rms(const DspKernels& k, const float* x, size_t n) {
+    return n ? std::sqrt(k.sum_squares(x, n) / static_cast<float>(n)) : 0.0f;
+}
+
+inline float dsp_stereo_rms(const DspKernels& k, const float* stereo, size_t frames) {
+    return frames ? std::sqrt(k.stereo_mid_sum_squares(stereo, frames) / static_cast<float>(frames)) : 0.0f;
+}
+
+// Per-ISA tables, defined in the matching translation unit.
+const DspKernels* dsp_kernels_sse2();
+const DspKernels* dsp_kernels_avx2();
+const DspKernels* dsp_kernels_neon();
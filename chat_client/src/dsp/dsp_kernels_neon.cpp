@@ -0,0 +1,215 @@
+#include "dsp_kernels.h"
+
+#if defined(ARM_NEON) && defined(__aarch64__)
+
+#include <algorithm>
+#include <arm_neon.h>
+
+namespace {
+
+float neon_sum_squares(const float* x, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f);
+    float32x4_t acc3 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        float32x4_t a = vld1q_f32(x + i);
+        float32x4_t b = vld1q_f32(x + i + 4);
+        float32x4_t c = vld1q_f32(x + i + 8);
+        float32x4_t d = vld1q_f32(x + i + 12);
+        acc0 = vmlaq_f32(acc0, a, a);
+        acc1 = vmlaq_f32(acc1, b, b);
+        acc2 = vmlaq_f32(acc2, c, c);
+        acc3 = vmlaq_f32(acc3, d, d);
+    }
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t a = vld1q_f32(x + i);
+        acc0 = vmlaq_f32(acc0, a, a);
+    }
+    float sum = vaddvq_f32(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+    for (; i < n; ++i) {
+        sum += x[i] * x[i];
+    }
+    return sum;
+}
+
+float neon_stereo_mid_sum_squares(const float* stereo, size_t frames) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        float32x4x2_t a = vld2q_f32(stereo + 2 * i);
+        float32x4x2_t b = vld2q_f32(stereo + 2 * i + 8);
+        float32x4_t mid0 = vmulq_n_f32(vaddq_f32(a.val[0], a.val[1]), 0.5f);
+        float32x4_t mid1 = vmulq_n_f32(vaddq_f32(b.val[0], b.val[1]), 0.5f);
+        acc0 = vmlaq_f32(acc0, mid0, mid0);
+        acc1 = vmlaq_f32(acc1, mid1, mid1);
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < frames; ++i) {
+        float mid = (stereo[2 * i] + stereo[2 * i + 1]) * 0.5f;
+        sum += mid * mid;
+    }
+    return sum;
+}
+
+float neon_peak(const float* x, size_t n) {
+    float32x4_t peak0 = vdupq_n_f32(0.0f);
+    float32x4_t peak1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        peak0 = vmaxq_f32(peak0, vabsq_f32(vld1q_f32(x + i)));
+        peak1 = vmaxq_f32(peak1, vabsq_f32(vld1q_f32(x + i + 4)));
+    }
+    float peak = vmaxvq_f32(vmaxq_f32(peak0, peak1));
+    for (; i < n; ++i) {
+        peak = std::max(peak, std::fabs(x[i]));
+    }
+    return peak;
+}
+
+void neon_gain(const float* in, float* out, size_t n, float gain) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        vst1q_f32(out + i, vmulq_n_f32(vld1q_f32(in + i), gain));
+        vst1q_f32(out + i + 4, vmulq_n_f32(vld1q_f32(in + i + 4), gain));
+    }
+    for (; i < n; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+void neon_mono_to_stereo(const float* in, float* out, size_t frames, float gain) {
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        float32x4_t v = vmulq_n_f32(vld1q_f32(in + i), gain);
+        float32x4x2_t pair = { { v, v } };
+        vst2q_f32(out + 2 * i, pair);
+    }
+    for (; i < frames; ++i) {
+        float sample = in[i] * gain;
+        out[2 * i] = sample;
+        out[2 * i + 1] = sample;
+    }
+}
+
+void neon_mix(const float* in, float* inout, size_t n, float gain) {
+    const float32x4_t g = vdupq_n_f32(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        vst1q_f32(inout + i, vmlaq_f32(vld1q_f32(inout + i), vld1q_f32(in + i), g));
+    }
+    for (; i < n; ++i) {
+        inout[i] += in[i] * gain;
+    }
+}
+
+float neon_dot(const float* a, const float* b, size_t n) {
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+    float sum = vaddvq_f32(vaddq_f32(acc0, acc1));
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void neon_min_max(const float* x, size_t n, float* min, float* max) {
+    if (n == 0) {
+        *min = *max = 0.0f;
+        return;
+    }
+    float32x4_t lo0 = vdupq_n_f32(x[0]);
+    float32x4_t hi0 = lo0;
+    float32x4_t lo1 = lo0;
+    float32x4_t hi1 = lo0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        float32x4_t a = vld1q_f32(x + i);
+        float32x4_t b = vld1q_f32(x + i + 4);
+        lo0 = vminq_f32(lo0, a);
+        hi0 = vmaxq_f32(hi0, a);
+        lo1 = vminq_f32(lo1, b);
+        hi1 = vmaxq_f32(hi1, b);
+    }
+    float lo = vminvq_f32(vminq_f32(lo0, lo1));
+    float hi = vmaxvq_f32(vmaxq_f32(hi0, hi1));
+    for (; i < n; ++i) {
+        lo = std::min(lo, x[i]);
+        hi = std::max(hi, x[i]);
+    }
+    *min = lo;
+    *max = hi;
+}
+
+void neon_power_spectrum(const float* re, const float* im, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t r = vld1q_f32(re + i);
+        float32x4_t m = vld1q_f32(im + i);
+        vst1q_f32(out + i, vmlaq_f32(vmulq_f32(r, r), m, m));
+    }
+    for (; i < n; ++i) {
+        out[i] = re[i] * re[i] + im[i] * im[i];
+    }
+}
+
+void neon_butterflies(float* a_re, float* a_im, float* b_re, float* b_im,
+                      const float* w_re, const float* w_im, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t br = vld1q_f32(b_re + i);
+        float32x4_t bi = vld1q_f32(b_im + i);
+        float32x4_t wr = vld1q_f32(w_re + i);
+        float32x4_t wi = vld1q_f32(w_im + i);
+        float32x4_t vr = vmlsq_f32(vmulq_f32(br, wr), bi, wi);
+        float32x4_t vi = vmlaq_f32(vmulq_f32(br, wi), bi, wr);
+        float32x4_t ar = vld1q_f32(a_re + i);
+        float32x4_t ai = vld1q_f32(a_im + i);
+        vst1q_f32(b_re + i, vsubq_f32(ar, vr));
+        vst1q_f32(b_im + i, vsubq_f32(ai, vi));
+        vst1q_f32(a_re + i, vaddq_f32(ar, vr));
+        vst1q_f32(a_im + i, vaddq_f32(ai, vi));
+    }
+    for (; i < n; ++i) {
+        float vr = b_re[i] * w_re[i] - b_im[i] * w_im[i];
+        float vi = b_re[i] * w_im[i] + b_im[i] * w_re[i];
+        b_re[i] = a_re[i] - vr;
+        b_im[i] = a_im[i] - vi;
+        a_re[i] += vr;
+        a_im[i] += vi;
+    }
+}
+
+const DspKernels kNeonKernels = {
+    DspKernels::Isa::NEON,
+    "neon",
+    neon_sum_squares,
+    neon_stereo_mid_sum_squares,
+    neon_peak,
+    neon_gain,
+    neon_mono_to_stereo,
+    neon_mix,
+    neon_dot,
+    neon_min_max,
+    neon_power_spectrum,
+    neon_butterflies,
+};
+
+} // namespace
+
+const DspKernels* dsp_kernels_neon() {
+    return &kNeonKernels;
+}
+
+#else
+
+const DspKernels* dsp_kernels_neon() { return nullptr; }
+
+#endif
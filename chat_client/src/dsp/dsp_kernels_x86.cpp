@@ -0,0 +1,514 @@
+#include "dsp_kernels.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(USE_SSE2) || defined(USE_AVX))
+
+#include <algorithm>
+#include <immintrin.h>
+
+// The AVX2 functions are compiled with a target attribute so the rest of the
+// binary keeps the baseline -march and only runs them after a CPUID check.
+#define DSP_TARGET_AVX2 __attribute__((target("avx2")))
+
+namespace {
+
+// Tail loops are kept separate from the vector bodies so that the
+// element-wise kernels stay bit-exact with the scalar reference.
+inline float tail_sum_squares(const float* x, size_t i, size_t n, float sum) {
+    for (; i < n; ++i) {
+        sum += x[i] * x[i];
+    }
+    return sum;
+}
+
+inline float tail_stereo_mid(const float* stereo, size_t i, size_t frames, float sum) {
+    for (; i < frames; ++i) {
+        float mid = (stereo[2 * i] + stereo[2 * i + 1]) * 0.5f;
+        sum += mid * mid;
+    }
+    return sum;
+}
+
+inline float tail_peak(const float* x, size_t i, size_t n, float peak) {
+    for (; i < n; ++i) {
+        peak = std::max(peak, std::fabs(x[i]));
+    }
+    return peak;
+}
+
+inline void tail_min_max(const float* x, size_t i, size_t n, float* min, float* max) {
+    for (; i < n; ++i) {
+        *min = std::min(*min, x[i]);
+        *max = std::max(*max, x[i]);
+    }
+}
+
+inline void tail_butterflies(float* a_re, float* a_im, float* b_re, float* b_im,
+                             const float* w_re, const float* w_im, size_t i, size_t n) {
+    for (; i < n; ++i) {
+        float vr = b_re[i] * w_re[i] - b_im[i] * w_im[i];
+        float vi = b_re[i] * w_im[i] + b_im[i] * w_re[i];
+        b_re[i] = a_re[i] - vr;
+        b_im[i] = a_im[i] - vi;
+        a_re[i] += vr;
+        a_im[i] += vi;
+    }
+}
+
+inline float hmin128(__m128 v) {
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_min_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+inline float hmax128(__m128 v) {
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+    return _mm_cvtss_f32(v);
+}
+
+inline float hsum128(__m128 v) {
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+#ifdef USE_SSE2
+
+float sse2_sum_squares(const float* x, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    __m128 acc2 = _mm_setzero_ps();
+    __m128 acc3 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128 a = _mm_loadu_ps(x + i);
+        __m128 b = _mm_loadu_ps(x + i + 4);
+        __m128 c = _mm_loadu_ps(x + i + 8);
+        __m128 d = _mm_loadu_ps(x + i + 12);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(a, a));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(b, b));
+        acc2 = _mm_add_ps(acc2, _mm_mul_ps(c, c));
+        acc3 = _mm_add_ps(acc3, _mm_mul_ps(d, d));
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(x + i);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(a, a));
+    }
+    __m128 acc = _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3));
+    return tail_sum_squares(x, i, n, hsum128(acc));
+}
+
+float sse2_stereo_mid_sum_squares(const float* stereo, size_t frames) {
+    const __m128 half = _mm_set1_ps(0.5f);
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m128 a = _mm_loadu_ps(stereo + 2 * i);
+        __m128 b = _mm_loadu_ps(stereo + 2 * i + 4);
+        __m128 c = _mm_loadu_ps(stereo + 2 * i + 8);
+        __m128 d = _mm_loadu_ps(stereo + 2 * i + 12);
+        __m128 mid0 = _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                                            _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), half);
+        __m128 mid1 = _mm_mul_ps(_mm_add_ps(_mm_shuffle_ps(c, d, _MM_SHUFFLE(2, 0, 2, 0)),
+                                            _mm_shuffle_ps(c, d, _MM_SHUFFLE(3, 1, 3, 1))), half);
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(mid0, mid0));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(mid1, mid1));
+    }
+    return tail_stereo_mid(stereo, i, frames, hsum128(_mm_add_ps(acc0, acc1)));
+}
+
+float sse2_peak(const float* x, size_t n) {
+    // |x| by clearing the sign bit
+    const __m128 magnitude = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 peak0 = _mm_setzero_ps();
+    __m128 peak1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        peak0 = _mm_max_ps(peak0, _mm_and_ps(_mm_loadu_ps(x + i), magnitude));
+        peak1 = _mm_max_ps(peak1, _mm_and_ps(_mm_loadu_ps(x + i + 4), magnitude));
+    }
+    return tail_peak(x, i, n, hmax128(_mm_max_ps(peak0, peak1)));
+}
+
+void sse2_gain(const float* in, float* out, size_t n, float gain) {
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), g);
+        _mm_storeu_ps(out + i, a);
+        _mm_storeu_ps(out + i + 4, b);
+    }
+    for (; i < n; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+void sse2_mono_to_stereo(const float* in, float* out, size_t frames, float gain) {
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 v = _mm_mul_ps(_mm_loadu_ps(in + i), g);
+        _mm_storeu_ps(out + 2 * i, _mm_unpacklo_ps(v, v));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_unpackhi_ps(v, v));
+    }
+    for (; i < frames; ++i) {
+        float sample = in[i] * gain;
+        out[2 * i] = sample;
+        out[2 * i + 1] = sample;
+    }
+}
+
+void sse2_mix(const float* in, float* inout, size_t n, float gain) {
+    const __m128 g = _mm_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v = _mm_add_ps(_mm_loadu_ps(inout + i), _mm_mul_ps(_mm_loadu_ps(in + i), g));
+        _mm_storeu_ps(inout + i, v);
+    }
+    for (; i < n; ++i) {
+        inout[i] += in[i] * gain;
+    }
+}
+
+float sse2_dot(const float* a, const float* b, size_t n) {
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float sum = hsum128(_mm_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+void sse2_min_max(const float* x, size_t n, float* min, float* max) {
+    if (n == 0) {
+        *min = *max = 0.0f;
+        return;
+    }
+    __m128 lo0 = _mm_set1_ps(x[0]);
+    __m128 hi0 = lo0;
+    __m128 lo1 = lo0;
+    __m128 hi1 = lo0;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_loadu_ps(x + i);
+        __m128 b = _mm_loadu_ps(x + i + 4);
+        lo0 = _mm_min_ps(lo0, a);
+        hi0 = _mm_max_ps(hi0, a);
+        lo1 = _mm_min_ps(lo1, b);
+        hi1 = _mm_max_ps(hi1, b);
+    }
+    *min = hmin128(_mm_min_ps(lo0, lo1));
+    *max = hmax128(_mm_max_ps(hi0, hi1));
+    tail_min_max(x, i, n, min, max);
+}
+
+void sse2_power_spectrum(const float* re, const float* im, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 r = _mm_loadu_ps(re + i);
+        __m128 m = _mm_loadu_ps(im + i);
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(r, r), _mm_mul_ps(m, m)));
+    }
+    for (; i < n; ++i) {
+        out[i] = re[i] * re[i] + im[i] * im[i];
+    }
+}
+
+void sse2_butterflies(float* a_re, float* a_im, float* b_re, float* b_im,
+                      const float* w_re, const float* w_im, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 br = _mm_loadu_ps(b_re + i);
+        __m128 bi = _mm_loadu_ps(b_im + i);
+        __m128 wr = _mm_loadu_ps(w_re + i);
+        __m128 wi = _mm_loadu_ps(w_im + i);
+        __m128 vr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+        __m128 vi = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+        __m128 ar = _mm_loadu_ps(a_re + i);
+        __m128 ai = _mm_loadu_ps(a_im + i);
+        _mm_storeu_ps(b_re + i, _mm_sub_ps(ar, vr));
+        _mm_storeu_ps(b_im + i, _mm_sub_ps(ai, vi));
+        _mm_storeu_ps(a_re + i, _mm_add_ps(ar, vr));
+        _mm_storeu_ps(a_im + i, _mm_add_ps(ai, vi));
+    }
+    tail_butterflies(a_re, a_im, b_re, b_im, w_re, w_im, i, n);
+}
+
+const DspKernels kSse2Kernels = {
+    DspKernels::Isa::SSE2,
+    "sse2",
+    sse2_sum_squares,
+    sse2_stereo_mid_sum_squares,
+    sse2_peak,
+    sse2_gain,
+    sse2_mono_to_stereo,
+    sse2_mix,
+    sse2_dot,
+    sse2_min_max,
+    sse2_power_spectrum,
+    sse2_butterflies,
+};
+
+#endif // USE_SSE2
+
+#ifdef USE_AVX
+
+DSP_TARGET_AVX2 inline float hsum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    return hsum128(_mm_add_ps(lo, hi));
+}
+
+DSP_TARGET_AVX2 float avx2_sum_squares(const float* x, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps();
+    __m256 acc3 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256 a = _mm256_loadu_ps(x + i);
+        __m256 b = _mm256_loadu_ps(x + i + 8);
+        __m256 c = _mm256_loadu_ps(x + i + 16);
+        __m256 d = _mm256_loadu_ps(x + i + 24);
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(a, a));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(b, b));
+        acc2 = _mm256_add_ps(acc2, _mm256_mul_ps(c, c));
+        acc3 = _mm256_add_ps(acc3, _mm256_mul_ps(d, d));
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(x + i);
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(a, a));
+    }
+    __m256 acc = _mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3));
+    return tail_sum_squares(x, i, n, hsum256(acc));
+}
+
+DSP_TARGET_AVX2 float avx2_stereo_mid_sum_squares(const float* stereo, size_t frames) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= frames; i += 16) {
+        __m256 a = _mm256_loadu_ps(stereo + 2 * i);
+        __m256 b = _mm256_loadu_ps(stereo + 2 * i + 8);
+        __m256 c = _mm256_loadu_ps(stereo + 2 * i + 16);
+        __m256 d = _mm256_loadu_ps(stereo + 2 * i + 24);
+        // Lane order is scrambled by the in-lane shuffles, which does not
+        // matter for a sum.
+        __m256 mid0 = _mm256_mul_ps(_mm256_add_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                  _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1))), half);
+        __m256 mid1 = _mm256_mul_ps(_mm256_add_ps(_mm256_shuffle_ps(c, d, _MM_SHUFFLE(2, 0, 2, 0)),
+                                                  _mm256_shuffle_ps(c, d, _MM_SHUFFLE(3, 1, 3, 1))), half);
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(mid0, mid0));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(mid1, mid1));
+    }
+    return tail_stereo_mid(stereo, i, frames, hsum256(_mm256_add_ps(acc0, acc1)));
+}
+
+DSP_TARGET_AVX2 float avx2_peak(const float* x, size_t n) {
+    const __m256 magnitude = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+    __m256 peak0 = _mm256_setzero_ps();
+    __m256 peak1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        peak0 = _mm256_max_ps(peak0, _mm256_and_ps(_mm256_loadu_ps(x + i), magnitude));
+        peak1 = _mm256_max_ps(peak1, _mm256_and_ps(_mm256_loadu_ps(x + i + 8), magnitude));
+    }
+    for (; i + 8 <= n; i += 8) {
+        peak0 = _mm256_max_ps(peak0, _mm256_and_ps(_mm256_loadu_ps(x + i), magnitude));
+    }
+    __m256 peak = _mm256_max_ps(peak0, peak1);
+    __m128 half = _mm_max_ps(_mm256_castps256_ps128(peak), _mm256_extractf128_ps(peak, 1));
+    return tail_peak(x, i, n, hmax128(half));
+}
+
+DSP_TARGET_AVX2 void avx2_gain(const float* in, float* out, size_t n, float gain) {
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_mul_ps(_mm256_loadu_ps(in + i), g);
+        __m256 b = _mm256_mul_ps(_mm256_loadu_ps(in + i + 8), g);
+        _mm256_storeu_ps(out + i, a);
+        _mm256_storeu_ps(out + i + 8, b);
+    }
+    for (; i < n; ++i) {
+        out[i] = in[i] * gain;
+    }
+}
+
+DSP_TARGET_AVX2 void avx2_mono_to_stereo(const float* in, float* out, size_t frames, float gain) {
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_loadu_ps(in + i), g);
+        __m256 lo = _mm256_unpacklo_ps(v, v);  // a a b b | e e f f
+        __m256 hi = _mm256_unpackhi_ps(v, v);  // c c d d | g g h h
+        _mm256_storeu_ps(out + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(out + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    for (; i < frames; ++i) {
+        float sample = in[i] * gain;
+        out[2 * i] = sample;
+        out[2 * i + 1] = sample;
+    }
+}
+
+DSP_TARGET_AVX2 void avx2_mix(const float* in, float* inout, size_t n, float gain) {
+    const __m256 g = _mm256_set1_ps(gain);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_add_ps(_mm256_loadu_ps(inout + i), _mm256_mul_ps(_mm256_loadu_ps(in + i), g));
+        _mm256_storeu_ps(inout + i, v);
+    }
+    for (; i < n; ++i) {
+        inout[i] += in[i] * gain;
+    }
+}
+
+DSP_TARGET_AVX2 float avx2_dot(const float* a, const float* b, size_t n) {
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    float sum = hsum256(_mm256_add_ps(acc0, acc1));
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+DSP_TARGET_AVX2 void avx2_min_max(const float* x, size_t n, float* min, float* max) {
+    if (n == 0) {
+        *min = *max = 0.0f;
+        return;
+    }
+    __m256 lo0 = _mm256_set1_ps(x[0]);
+    __m256 hi0 = lo0;
+    __m256 lo1 = lo0;
+    __m256 hi1 = lo0;
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 a = _mm256_loadu_ps(x + i);
+        __m256 b = _mm256_loadu_ps(x + i + 8);
+        lo0 = _mm256_min_ps(lo0, a);
+        hi0 = _mm256_max_ps(hi0, a);
+        lo1 = _mm256_min_ps(lo1, b);
+        hi1 = _mm256_max_ps(hi1, b);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(x + i);
+        lo0 = _mm256_min_ps(lo0, a);
+        hi0 = _mm256_max_ps(hi0, a);
+    }
+    __m256 lo = _mm256_min_ps(lo0, lo1);
+    __m256 hi = _mm256_max_ps(hi0, hi1);
+    *min = hmin128(_mm_min_ps(_mm256_castps256_ps128(lo), _mm256_extractf128_ps(lo, 1)));
+    *max = hmax128(_mm_max_ps(_mm256_castps256_ps128(hi), _mm256_extractf128_ps(hi, 1)));
+    tail_min_max(x, i, n, min, max);
+}
+
+DSP_TARGET_AVX2 void avx2_power_spectrum(const float* re, const float* im, float* out, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 r = _mm256_loadu_ps(re + i);
+        __m256 m = _mm256_loadu_ps(im + i);
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_mul_ps(r, r), _mm256_mul_ps(m, m)));
+    }
+    for (; i < n; ++i) {
+        out[i] = re[i] * re[i] + im[i] * im[i];
+    }
+}
+
+DSP_TARGET_AVX2 void avx2_butterflies(float* a_re, float* a_im, float* b_re, float* b_im,
+                                      const float* w_re, const float* w_im, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 br = _mm256_loadu_ps(b_re + i);
+        __m256 bi = _mm256_loadu_ps(b_im + i);
+        __m256 wr = _mm256_loadu_ps(w_re + i);
+        __m256 wi = _mm256_loadu_ps(w_im + i);
+        __m256 vr = _mm256_sub_ps(_mm256_mul_ps(br, wr), _mm256_mul_ps(bi, wi));
+        __m256 vi = _mm256_add_ps(_mm256_mul_ps(br, wi), _mm256_mul_ps(bi, wr));
+        __m256 ar = _mm256_loadu_ps(a_re + i);
+        __m256 ai = _mm256_loadu_ps(a_im + i);
+        _mm256_storeu_ps(b_re + i, _mm256_sub_ps(ar, vr));
+        _mm256_storeu_ps(b_im + i, _mm256_sub_ps(ai, vi));
+        _mm256_storeu_ps(a_re + i, _mm256_add_ps(ar, vr));
+        _mm256_storeu_ps(a_im + i, _mm256_add_ps(ai, vi));
+    }
+    // The FFT's span-4 stage, and any other remainder of 4
+    for (; i + 4 <= n; i += 4) {
+        __m128 br = _mm_loadu_ps(b_re + i);
+        __m128 bi = _mm_loadu_ps(b_im + i);
+        __m128 wr = _mm_loadu_ps(w_re + i);
+        __m128 wi = _mm_loadu_ps(w_im + i);
+        __m128 vr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+        __m128 vi = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+        __m128 ar = _mm_loadu_ps(a_re + i);
+        __m128 ai = _mm_loadu_ps(a_im + i);
+        _mm_storeu_ps(b_re + i, _mm_sub_ps(ar, vr));
+        _mm_storeu_ps(b_im + i, _mm_sub_ps(ai, vi));
+        _mm_storeu_ps(a_re + i, _mm_add_ps(ar, vr));
+        _mm_storeu_ps(a_im + i, _mm_add_ps(ai, vi));
+    }
+    tail_butterflies(a_re, a_im, b_re, b_im, w_re, w_im, i, n);
+}
+
+const DspKernels kAvx2Kernels = {
+    DspKernels::Isa::AVX2,
+    "avx2",
+    avx2_sum_squares,
+    avx2_stereo_mid_sum_squares,
+    avx2_peak,
+    avx2_gain,
+    avx2_mono_to_stereo,
+    avx2_mix,
+    avx2_dot,
+    avx2_min_max,
+    avx2_power_spectrum,
+    avx2_butterflies,
+};
+
+#endif // USE_AVX
+
+} // namespace
+
+const DspKernels* dsp_kernels_sse2() {
+#ifdef USE_SSE2
+    return &kSse2Kernels;
+#else
+    return nullptr;
+#endif
+}
+
+const DspKernels* dsp_kernels_avx2() {
+#ifdef USE_AVX
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+#else // not x86 or SIMD disabled
+
+const DspKernels* dsp_kernels_sse2() { return nullptr; }
+const DspKernels* dsp_kernels_avx2() { return nullptr; }
+
+#endif
@@ -0,0 +1,151 @@
+#include "echo_canceller.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+// NLMS step; larger converges faster but leaves more misadjustment
+constexpr float kStepSize = 1.0f;
+// Per-bin power smoothing per block
+constexpr float kPowerSmoothing = 0.9f;
+// Weight of the residual error power in the step normalisation. Higher
+// protects the filter better during double talk but slows convergence.
+constexpr float kDoubleTalkWeight = 4.0f;
+// Far-end blocks quieter than this (mean square) do not drive adaptation
+constexpr float kFarActivity = 1e-7f;
+// Relative to the FFT size; keeps quiet bins from blowing up the step
+constexpr float kRegularisation = 1e-6f;
+// ERLE smoothing per block while the far end is active
+constexpr float kErleSmoothing = 0.98f;
+
+float mean_square(const float* x, size_t n) {
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        sum += x[i] * x[i];
+    }
+    return sum / static_cast<float>(n);
+}
+
+} // namespace
+
+EchoCanceller::EchoCanceller(size_t block, size_t partitions)
+    : fft_(2 * block), block_(block), bins_(block + 1), partitions_(std::max<size_t>(partitions, 1)),
+      far_frame_(2 * block), far_re_(partitions_ * bins_), far_im_(partitions_ * bins_),
+      weight_re_(partitions_ * bins_), weight_im_(partitions_ * bins_),
+      far_power_(bins_), error_power_(bins_), error_re_(bins_), error_im_(bins_),
+      time_(2 * block), spectrum_re_(bins_), spectrum_im_(bins_) {
+    reset();
+}
+
+void EchoCanceller::reset() {
+    std::fill(far_frame_.begin(), far_frame_.end(), 0.0f);
+    std::fill(far_re_.begin(), far_re_.end(), 0.0f);
+    std::fill(far_im_.begin(), far_im_.end(), 0.0f);
+    std::fill(weight_re_.begin(), weight_re_.end(), 0.0f);
+    std::fill(weight_im_.begin(), weight_im_.end(), 0.0f);
+    std::fill(far_power_.begin(), far_power_.end(), 0.0f);
+    std::fill(error_power_.begin(), error_power_.end(), 0.0f);
+    newest_ = 0;
+    next_constrained_ = 0;
+    near_energy_ = 0.0f;
+    error_energy_ = 0.0f;
+}
+
+float EchoCanceller::erle_db() const {
+    if (error_energy_ <= 0.0f || near_energy_ <= 0.0f) {
+        return 0.0f;
+    }
+    return 10.0f * std::log10(near_energy_ / error_energy_);
+}
+
+void EchoCanceller::process(const float* near, const float* far, float* out) {
+    // Far spectrum of the last two blocks, newest first in the ring
+    std::memmove(far_frame_.data(), far_frame_.data() + block_, sizeof(float) * block_);
+    std::memcpy(far_frame_.data() + block_, far, sizeof(float) * block_);
+    newest_ = (newest_ + partitions_ - 1) % partitions_;
+    float* x_re = &far_re_[newest_ * bins_];
+    float* x_im = &far_im_[newest_ * bins_];
+    fft_.forward(far_frame_.data(), x_re, x_im);
+    for (size_t f = 0; f < bins_; ++f) {
+        float power = x_re[f] * x_re[f] + x_im[f] * x_im[f];
+        far_power_[f] = kPowerSmoothing * far_power_[f] + (1.0f - kPowerSmoothing) * power;
+    }
+
+    // Echo estimate: sum over partitions of weight x delayed far spectrum
+    std::fill(spectrum_re_.begin(), spectrum_re_.end(), 0.0f);
+    std::fill(spectrum_im_.begin(), spectrum_im_.end(), 0.0f);
+    for (size_t p = 0; p < partitions_; ++p) {
+        const size_t row = ((newest_ + p) % partitions_) * bins_;
+        const float* w_re = &weight_re_[p * bins_];
+        const float* w_im = &weight_im_[p * bins_];
+        const float* d_re = &far_re_[row];
+        const float* d_im = &far_im_[row];
+        for (size_t f = 0; f < bins_; ++f) {
+            spectrum_re_[f] += w_re[f] * d_re[f] - w_im[f] * d_im[f];
+            spectrum_im_[f] += w_re[f] * d_im[f] + w_im[f] * d_re[f];
+        }
+    }
+    fft_.inverse(spectrum_re_.data(), spectrum_im_.data(), time_.data());
+
+    // Overlap-save: only the second half is a valid linear convolution
+    const float* echo = time_.data() + block_;
+    float near_power = mean_square(near, block_);
+    for (size_t i = 0; i < block_; ++i) {
+        out[i] = near[i] - echo[i];
+    }
+    float error_power = mean_square(out, block_);
+
+    std::fill(time_.begin(), time_.begin() + block_, 0.0f);
+    std::memcpy(time_.data() + block_, out, sizeof(float) * block_);
+    fft_.forward(time_.data(), error_re_.data(), error_im_.data());
+    for (size_t f = 0; f < bins_; ++f) {
+        float power = error_re_[f] * error_re_[f] + error_im_[f] * error_im_[f];
+        error_power_[f] = kPowerSmoothing * error_power_[f] + (1.0f - kPowerSmoothing) * power;
+    }
+
+    if (mean_square(far, block_) > kFarActivity) {
+        near_energy_ = kErleSmoothing * near_energy_ + (1.0f - kErleSmoothing) * near_power;
+        error_energy_ = kErleSmoothing * error_energy_ + (1.0f - kErleSmoothing) * error_power;
+        adapt();
+    }
+}
+
+void EchoCanceller::adapt() {
+    // Normalised step per bin: the error power term shrinks it during
+    // double talk, when the error is mostly near-end speech. The step is
+    // shared between the partitions, which all adapt at once.
+    const float regularisation = kRegularisation * static_cast<float>(2 * block_);
+    const float step_size = kStepSize / static_cast<float>(partitions_);
+    for (size_t f = 0; f < bins_; ++f) {
+        float step = step_size / (far_power_[f] + kDoubleTalkWeight * error_power_[f] + regularisation);
+        spectrum_re_[f] = error_re_[f] * step;
+        spectrum_im_[f] = error_im_[f] * step;
+    }
+
+    // W_p += step * E * conj(X_p)
+    for (size_t p = 0; p < partitions_; ++p) {
+        const size_t row = ((newest_ + p) % partitions_) * bins_;
+        float* w_re = &weight_re_[p * bins_];
+        float* w_im = &weight_im_[p * bins_];
+        const float* d_re = &far_re_[row];
+        const float* d_im = &far_im_[row];
+        for (size_t f = 0; f < bins_; ++f) {
+            w_re[f] += spectrum_re_[f] * d_re[f] + spectrum_im_[f] * d_im[f];
+            w_im[f] += spectrum_im_[f] * d_re[f] - spectrum_re_[f] * d_im[f];
+        }
+    }
+
+    constrain(next_constrained_);
+    next_constrained_ = (next_constrained_ + 1) % partitions_;
+}
+
+// Zero the acausal half of one partition's impulse response, which the
+// unconstrained update lets grow through circular convolution
+void EchoCanceller::constrain(size_t partition) {
+    float* w_re = &weight_re_[partition * bins_];
+    float* w_im = &weight_im_[partition * bins_];
+    fft_.inverse(w_re, w_im, time_.data());
+    std::fill(time_.begin() + block_, time_.end(), 0.0f);
+    fft_.forward(time_.data(), w_re, w_im);
+}
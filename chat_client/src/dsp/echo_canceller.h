@@ -0,0 +1,65 @@
+#pragma once
+
+#include "fft.h"
+#include <cstddef>
+#include <vector>
+
+// Acoustic echo canceller: a partitioned-block frequency-domain NLMS
+// adaptive filter (overlap-save, one block per partition).
+//
+// Each call takes one block of microphone ("near") samples and the far-end
+// reference that was sent to the speaker, and removes the estimate of that
+// reference's echo from the microphone block. The filter models
+// block * partitions samples of echo path; the reference is expected to
+// lead its echo, as playback always does.
+//
+// The step size is normalised per bin by the far-end power plus the
+// residual error power, so adaptation slows by itself while the near end
+// talks over the echo. Gradients are constrained to the causal half one
+// partition per block, round-robin, which keeps the cost at three FFTs
+// per block plus two per-bin passes over the partitions.
+class EchoCanceller {
+public:
+    EchoCanceller(size_t block, size_t partitions);
+
+    EchoCanceller(const EchoCanceller&) = delete;
+    EchoCanceller& operator=(const EchoCanceller&) = delete;
+
+    // near, far and out hold block() samples; out may alias near
+    void process(const float* near, const float* far, float* out);
+
+    // Forget the echo path and all history
+    void reset();
+
+    size_t block() const { return block_; }
+    size_t partitions() const { return partitions_; }
+    // Smoothed echo return loss enhancement over recent far-end activity
+    float erle_db() const;
+
+private:
+    void adapt();
+    void constrain(size_t partition);
+
+    RealFft fft_;
+    size_t block_;
+    size_t bins_;
+    size_t partitions_;
+
+    std::vector<float> far_frame_;       // Previous and current far blocks
+    std::vector<float> far_re_;          // partitions_ x bins_, ring of far spectra
+    std::vector<float> far_im_;
+    size_t newest_ = 0;                  // Ring row of the current far spectrum
+    std::vector<float> weight_re_;       // partitions_ x bins_, filter partitions
+    std::vector<float> weight_im_;
+    std::vector<float> far_power_;       // Smoothed per-bin powers
+    std::vector<float> error_power_;
+    std::vector<float> error_re_;
+    std::vector<float> error_im_;
+    std::vector<float> time_;            // 2 * block_ scratch
+    std::vector<float> spectrum_re_;     // bins_ scratch
+    std::vector<float> spectrum_im_;
+    size_t next_constrained_ = 0;
+
+    float near_energy_ = 0.0f;           // Smoothed, while the far end is active
+    float error_energy_ = 0.0f;
+};
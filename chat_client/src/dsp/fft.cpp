@@ -0,0 +1,126 @@
+#include "fft.h"
+#include "dsp_kernels.h"
+
+#include <cmath>
+#include <utility>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+// Narrower stages run inline: a call per group of butterflies would cost
+// more than the group
+constexpr size_t kMinKernelSpan = 4;
+
+} // namespace
+
+RealFft::RealFft(size_t size)
+    : dsp_(&dsp_kernels()), size_(size), half_(size / 2),
+      bit_reverse_(half_), stage_re_(half_ - 1), stage_im_(half_ - 1), stage_conj_im_(half_ - 1),
+      split_re_(half_ + 1), split_im_(half_ + 1), work_re_(half_), work_im_(half_) {
+    size_t bits = 0;
+    while ((size_t(1) << bits) < half_) {
+        ++bits;
+    }
+    for (size_t i = 0; i < half_; ++i) {
+        size_t reversed = 0;
+        for (size_t b = 0; b < bits; ++b) {
+            reversed |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        bit_reverse_[i] = reversed;
+    }
+    for (size_t span = 1; span < half_; span <<= 1) {
+        for (size_t j = 0; j < span; ++j) {
+            // Rounded from the same angle as the full half_-point table
+            // would be, so every stage agrees with it
+            const size_t k = j * (half_ / (2 * span));
+            stage_re_[span - 1 + j] = static_cast<float>(std::cos(2.0 * kPi * k / half_));
+            stage_im_[span - 1 + j] = static_cast<float>(-std::sin(2.0 * kPi * k / half_));
+            stage_conj_im_[span - 1 + j] = -stage_im_[span - 1 + j];
+        }
+    }
+    for (size_t k = 0; k <= half_; ++k) {
+        split_re_[k] = static_cast<float>(std::cos(2.0 * kPi * k / size_));
+        split_im_[k] = static_cast<float>(-std::sin(2.0 * kPi * k / size_));
+    }
+}
+
+void RealFft::transform(bool inverse) {
+    float* re = work_re_.data();
+    float* im = work_im_.data();
+    for (size_t i = 0; i < half_; ++i) {
+        size_t j = bit_reverse_[i];
+        if (i < j) {
+            std::swap(re[i], re[j]);
+            std::swap(im[i], im[j]);
+        }
+    }
+
+    for (size_t span = 1; span < half_; span <<= 1) {
+        const float* w_re = &stage_re_[span - 1];
+        const float* w_im = inverse ? &stage_conj_im_[span - 1] : &stage_im_[span - 1];
+        if (span >= kMinKernelSpan) {
+            for (size_t start = 0; start < half_; start += 2 * span) {
+                dsp_->butterflies(re + start, im + start, re + start + span, im + start + span, w_re, w_im, span);
+            }
+            continue;
+        }
+        for (size_t start = 0; start < half_; start += 2 * span) {
+            for (size_t j = 0; j < span; ++j) {
+                float wr = w_re[j];
+                float wi = w_im[j];
+                size_t a = start + j;
+                size_t b = a + span;
+                float vr = re[b] * wr - im[b] * wi;
+                float vi = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - vr;
+                im[b] = im[a] - vi;
+                re[a] += vr;
+                im[a] += vi;
+            }
+        }
+    }
+}
+
+void RealFft::forward(const float* time, float* re, float* im) {
+    // Even samples in the real part, odd samples in the imaginary part
+    for (size_t n = 0; n < half_; ++n) {
+        work_re_[n] = time[2 * n];
+        work_im_[n] = time[2 * n + 1];
+    }
+    transform(false);
+
+    // Separate the spectra of the even and odd samples and combine them
+    for (size_t k = 0; k <= half_; ++k) {
+        size_t a = k == half_ ? 0 : k;
+        size_t b = k == 0 ? 0 : half_ - k;
+        float even_re = 0.5f * (work_re_[a] + work_re_[b]);
+        float even_im = 0.5f * (work_im_[a] - work_im_[b]);
+        float odd_re = 0.5f * (work_im_[a] + work_im_[b]);
+        float odd_im = -0.5f * (work_re_[a] - work_re_[b]);
+        re[k] = even_re + split_re_[k] * odd_re - split_im_[k] * odd_im;
+        im[k] = even_im + split_re_[k] * odd_im + split_im_[k] * odd_re;
+    }
+}
+
+void RealFft::inverse(const float* re, const float* im, float* time) {
+    for (size_t k = 0; k < half_; ++k) {
+        size_t b = half_ - k;
+        float even_re = 0.5f * (re[k] + re[b]);
+        float even_im = 0.5f * (im[k] - im[b]);
+        float diff_re = 0.5f * (re[k] - re[b]);
+        float diff_im = 0.5f * (im[k] + im[b]);
+        // Undo the odd samples' twiddle with its conjugate
+        float odd_re = diff_re * split_re_[k] + diff_im * split_im_[k];
+        float odd_im = diff_im * split_re_[k] - diff_re * split_im_[k];
+        work_re_[k] = even_re - odd_im;
+        work_im_[k] = even_im + odd_re;
+    }
+    transform(true);
+
+    const float scale = 1.0f / static_cast<float>(half_);
+    for (size_t n = 0; n < half_; ++n) {
+        time[2 * n] = work_re_[n] * scale;
+        time[2 * n + 1] = work_im_[n] * scale;
+    }
+}
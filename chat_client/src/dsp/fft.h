@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct DspKernels;
+
+// Real-input FFT of a fixed power-of-two size (at least 4).
+//
+// Spectra are size() / 2 + 1 bins held as separate real and imaginary
+// arrays, so per-bin loops over them vectorise. The transform runs as a
+// half-size complex FFT with precomputed twiddles, its wider stages through
+// the vectorised butterflies of DspKernels; forward() and inverse() never
+// allocate, but share scratch space, so one RealFft must not be used from
+// two threads at once.
+class RealFft {
+public:
+    explicit RealFft(size_t size);
+
+    size_t size() const { return size_; }
+    size_t bins() const { return half_ + 1; }
+
+    // time[size()] -> re[bins()], im[bins()], unscaled
+    void forward(const float* time, float* re, float* im);
+    // re[bins()], im[bins()] -> time[size()], scaled so that
+    // inverse(forward(x)) == x
+    void inverse(const float* re, const float* im, float* time);
+
+private:
+    // In-place complex FFT of length half_ over work_re_/work_im_
+    void transform(bool inverse);
+
+    const DspKernels* dsp_;
+    size_t size_;
+    size_t half_;
+    std::vector<size_t> bit_reverse_;
+    // Each stage's twiddles in the order its butterflies use them: for a
+    // span s, e^(-2 pi i j / 2s), j < s, from index s - 1
+    std::vector<float> stage_re_;
+    std::vector<float> stage_im_;
+    std::vector<float> stage_conj_im_;  // Negated, for the inverse
+    std::vector<float> split_re_;    // e^(-2 pi i k / size_), k <= half_
+    std::vector<float> split_im_;
+    std::vector<float> work_re_;
+    std::vector<float> work_im_;
+};
@@ -0,0 +1,59 @@
+#include "gain_control.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float kTargetDbfs = -20.0f;      // RMS of speech
+constexpr float kMaxGainDb = 24.0f;
+constexpr float kMinGainDb = -12.0f;
+constexpr float kLevelSeconds = 0.3f;
+constexpr float kRiseDbPerSecond = 12.0f;  // Slow up, so noise is not chased
+constexpr float kFallDbPerSecond = 40.0f;  // Faster down, for sudden loud talkers
+constexpr float kCeiling = 0.9f;           // Peak limit, about -1 dBFS
+
+} // namespace
+
+GainControl::GainControl(float blocks_per_second)
+    : level_smoothing_(std::exp(-1.0f / (kLevelSeconds * blocks_per_second))),
+      max_rise_db_(kRiseDbPerSecond / blocks_per_second),
+      max_fall_db_(kFallDbPerSecond / blocks_per_second) {
+}
+
+void GainControl::reset() {
+    level_ = 0.0f;
+    gain_db_ = 0.0f;
+    applied_ = 1.0f;
+}
+
+void GainControl::process(float* samples, size_t frames, bool speech) {
+    if (frames == 0) {
+        return;
+    }
+    float peak = 0.0f;
+    float sum = 0.0f;
+    for (size_t i = 0; i < frames; ++i) {
+        peak = std::max(peak, std::fabs(samples[i]));
+        sum += samples[i] * samples[i];
+    }
+
+    if (speech && sum > 0.0f) {
+        float mean_square = sum / static_cast<float>(frames);
+        level_ = level_ > 0.0f ? level_smoothing_ * level_ + (1.0f - level_smoothing_) * mean_square
+                               : mean_square;
+        float wanted = std::clamp(kTargetDbfs - 10.0f * std::log10(level_), kMinGainDb, kMaxGainDb);
+        gain_db_ += std::clamp(wanted - gain_db_, -max_fall_db_, max_rise_db_);
+    }
+
+    float target = std::pow(10.0f, gain_db_ / 20.0f);
+    if (peak * target > kCeiling) {
+        target = kCeiling / peak;
+    }
+    // The limiter must also hold at the start of the ramp
+    float start = std::min(applied_, peak > 0.0f ? kCeiling / peak : applied_);
+    float step = (target - start) / static_cast<float>(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        samples[i] *= start + step * static_cast<float>(i + 1);
+    }
+    applied_ = target;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+// Automatic gain control for the capture path.
+//
+// Tracks the level of speech (blocks the caller flags as speech) and
+// steers the gain so it lands on a fixed target. The gain moves at a
+// limited slew rate and is held through pauses so background noise is not
+// pumped up between words. A peak limiter caps each block below full
+// scale; gain changes ramp across the block to avoid zipper noise.
+class GainControl {
+public:
+    explicit GainControl(float blocks_per_second);
+
+    // Applies the gain in place; speech selects blocks that steer it
+    void process(float* samples, size_t frames, bool speech);
+
+    float gain_db() const { return gain_db_; }
+    void reset();
+
+private:
+    float level_smoothing_;      // Per-block speech level smoothing
+    float max_rise_db_;          // Per-block slew limits
+    float max_fall_db_;
+    float level_ = 0.0f;         // Smoothed speech mean square, 0 until speech
+    float gain_db_ = 0.0f;       // Steered gain
+    float applied_ = 1.0f;       // Linear gain at the end of the last block
+};
@@ -0,0 +1,62 @@
+#include "noise_suppressor.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// Power smoothing per frame before minimum tracking
+constexpr float kPowerSmoothing = 0.7f;
+// How fast the noise floor may rise to follow louder noise
+constexpr float kNoiseRiseDbPerSecond = 6.0f;
+// The tracked minimum sits below the mean noise power; scale it back up
+constexpr float kNoiseBias = 2.0f;
+// Frames at startup whose smoothed power seeds the estimate
+constexpr float kStartupSeconds = 0.05f;
+// Decision-directed a priori SNR smoothing
+constexpr float kPriorSmoothing = 0.98f;
+// Bins quieter than this are treated as silence rather than divided by
+constexpr float kMinNoise = 1e-12f;
+
+} // namespace
+
+NoiseSuppressor::NoiseSuppressor(size_t bins, float frames_per_second)
+    : bins_(bins),
+      rise_(std::pow(10.0f, kNoiseRiseDbPerSecond / 10.0f / frames_per_second)),
+      startup_frames_(std::max<size_t>(1, static_cast<size_t>(kStartupSeconds * frames_per_second))),
+      smoothed_(bins), noise_(bins), previous_snr_(bins) {
+    reset();
+}
+
+void NoiseSuppressor::reset() {
+    frames_ = 0;
+    std::fill(smoothed_.begin(), smoothed_.end(), 0.0f);
+    std::fill(noise_.begin(), noise_.end(), 0.0f);
+    std::fill(previous_snr_.begin(), previous_snr_.end(), 0.0f);
+}
+
+void NoiseSuppressor::update_noise(const float* power) {
+    const bool startup = frames_ < startup_frames_;
+    for (size_t f = 0; f < bins_; ++f) {
+        smoothed_[f] = frames_ == 0 ? power[f]
+                                    : kPowerSmoothing * smoothed_[f] + (1.0f - kPowerSmoothing) * power[f];
+        float floor = smoothed_[f] * kNoiseBias;
+        if (startup || floor < noise_[f]) {
+            noise_[f] = floor;
+        } else {
+            noise_[f] = std::min(noise_[f] * rise_ + kMinNoise, floor);
+        }
+    }
+    ++frames_;
+}
+
+void NoiseSuppressor::compute_gains(const float* power, float* gains) {
+    for (size_t f = 0; f < bins_; ++f) {
+        float noise = std::max(noise_[f], kMinNoise);
+        float posterior = power[f] / noise;
+        float prior = kPriorSmoothing * previous_snr_[f]
+                    + (1.0f - kPriorSmoothing) * std::max(posterior - 1.0f, 0.0f);
+        float gain = std::max(prior / (1.0f + prior), kGainFloor);
+        gains[f] = gain;
+        previous_snr_[f] = gain * gain * posterior;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Spectral noise suppressor working on the power spectra of an STFT.
+//
+// The noise floor of each bin follows the minimum of the smoothed power,
+// dropping to it at once and rising only slowly, so speech does not leak
+// into the estimate. Gains are Wiener gains from a decision-directed
+// a priori SNR, floored to keep the residual noise natural instead of
+// "musical". The noise estimate is also what the voice activity detector
+// measures speech against.
+class NoiseSuppressor {
+public:
+    // Gain left on noise-only bins, about -20 dB
+    static constexpr float kGainFloor = 0.1f;
+
+    // frames_per_second is the STFT hop rate, used for the time constants
+    NoiseSuppressor(size_t bins, float frames_per_second);
+
+    // Folds one frame's power spectrum into the noise estimate
+    void update_noise(const float* power);
+    // Per-bin gains in [floor, 1] for a frame whose noise was just updated
+    void compute_gains(const float* power, float* gains);
+
+    // Current per-bin noise power estimate
+    const float* noise() const { return noise_.data(); }
+    void reset();
+
+private:
+    size_t bins_;
+    float rise_;                  // Per-frame growth of the noise floor
+    size_t frames_ = 0;
+    size_t startup_frames_;       // Initial frames taken as noise outright
+    std::vector<float> smoothed_;
+    std::vector<float> noise_;
+    std::vector<float> previous_snr_; // Clean power / noise of the previous frame
+};
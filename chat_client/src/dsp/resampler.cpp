@@ -0,0 +1,143 @@
+#include "resampler.h"
+#include "dsp_kernels.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+// Kaiser window shape; about 70 dB of stopband attenuation
+constexpr double kKaiserBeta = 7.0;
+// Cutoff as a fraction of the lower Nyquist rate. The transition band of a
+// 32-tap filter is wide, so the -6 dB point sits below Nyquist to keep the
+// stopband clear of aliases.
+constexpr double kRolloff = 0.87;
+constexpr double kPi = 3.14159265358979323846;
+
+// Zeroth-order modified Bessel function of the first kind
+double bessel_i0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+double sinc(double x) {
+    return x == 0.0 ? 1.0 : std::sin(kPi * x) / (kPi * x);
+}
+
+} // namespace
+
+Resampler::Resampler(unsigned int input_rate, unsigned int output_rate,
+                     Quality quality, size_t max_input_frames)
+    : dsp_(dsp_kernels()), input_rate_(input_rate), output_rate_(output_rate),
+      quality_(quality), max_input_frames_(std::max<size_t>(max_input_frames, 1)) {
+    unsigned int divisor = std::gcd(input_rate, output_rate);
+    phases_ = output_rate / divisor;
+    step_ = input_rate / divisor;
+    taps_ = quality == Quality::LINEAR ? 2 : kTaps;
+    cutoff_ = std::min(1.0, static_cast<double>(output_rate) / input_rate) * kRolloff;
+
+    table_phases_ = std::min(phases_, kMaxPhases);
+    if (quality == Quality::POLYPHASE) {
+        table_.resize(table_phases_ * taps_);
+        for (size_t p = 0; p < table_phases_; ++p) {
+            sinc_coefficients(static_cast<double>(p) / table_phases_, &table_[p * taps_]);
+        }
+    } else if (quality == Quality::SINC) {
+        coefficients_.resize(taps_);
+    }
+
+    history_.resize(taps_ + max_input_frames_);
+    reset();
+}
+
+void Resampler::reset() {
+    // Centre the first output's filter on input sample 0
+    count_ = taps_ / 2 - 1;
+    std::fill(history_.begin(), history_.begin() + count_, 0.0f);
+    index_ = 0;
+    phase_ = 0;
+}
+
+size_t Resampler::max_output_frames(size_t input_frames) const {
+    return (input_frames * phases_ + step_ - 1) / step_ + 1;
+}
+
+// Coefficients for an output at fraction (0..1) past the centre tap, in
+// history order, normalised to unity DC gain.
+void Resampler::sinc_coefficients(double fraction, float* coefficients) const {
+    const double half = static_cast<double>(taps_ / 2);
+    const double window_norm = bessel_i0(kKaiserBeta);
+    double sum = 0.0;
+    for (size_t t = 0; t < taps_; ++t) {
+        double distance = (half - 1.0 + fraction) - static_cast<double>(t);
+        double x = std::min(1.0, std::fabs(distance) / half);
+        double window = bessel_i0(kKaiserBeta * std::sqrt(1.0 - x * x)) / window_norm;
+        double value = cutoff_ * sinc(cutoff_ * distance) * window;
+        coefficients[t] = static_cast<float>(value);
+        sum += value;
+    }
+    const float scale = static_cast<float>(1.0 / sum);
+    for (size_t t = 0; t < taps_; ++t) {
+        coefficients[t] *= scale;
+    }
+}
+
+size_t Resampler::process(const float* input, size_t frames, float* output) {
+    size_t produced = 0;
+    while (frames > 0) {
+        size_t chunk = std::min(frames, max_input_frames_);
+        produced += process_chunk(input, chunk, output + produced);
+        input += chunk;
+        frames -= chunk;
+    }
+    return produced;
+}
+
+size_t Resampler::process_chunk(const float* input, size_t frames, float* output) {
+    std::memcpy(history_.data() + count_, input, sizeof(float) * frames);
+    count_ += frames;
+
+    size_t produced = 0;
+    const float* history = history_.data();
+    while (index_ + taps_ <= count_) {
+        const float* window = history + index_;
+        switch (quality_) {
+            case Quality::LINEAR: {
+                float fraction = static_cast<float>(phase_) / static_cast<float>(phases_);
+                output[produced] = window[0] + (window[1] - window[0]) * fraction;
+                break;
+            }
+            case Quality::SINC:
+                sinc_coefficients(static_cast<double>(phase_) / phases_, coefficients_.data());
+                output[produced] = dsp_.dot(window, coefficients_.data(), taps_);
+                break;
+            case Quality::POLYPHASE: {
+                size_t row = phase_ * table_phases_ / phases_;
+                output[produced] = dsp_.dot(window, &table_[row * taps_], taps_);
+                break;
+            }
+        }
+        ++produced;
+
+        phase_ += step_;
+        index_ += phase_ / phases_;
+        phase_ %= phases_;
+    }
+
+    // Keep only what the next window still needs; a large step may already
+    // point past the end of the buffer
+    size_t consumed = std::min(index_, count_);
+    std::memmove(history_.data(), history_.data() + consumed, sizeof(float) * (count_ - consumed));
+    count_ -= consumed;
+    index_ -= consumed;
+    return produced;
+}
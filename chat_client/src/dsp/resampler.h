@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct DspKernels;
+
+// Streaming mono sample-rate converter.
+//
+// Output sample k lies at input time k * input_rate / output_rate, tracked
+// exactly as a rational step, so there is no drift over long streams. The
+// three modes trade quality for speed:
+//
+//   LINEAR     two-point interpolation; cheap, aliases and dulls the top end
+//   SINC       Kaiser-windowed sinc, coefficients computed for every output
+//              sample (reference quality, slow)
+//   POLYPHASE  the same filter precomputed for every phase of the rational
+//              ratio; each output is one SIMD dot product
+//
+// The low-pass cutoff follows the lower of the two Nyquist rates, so
+// downsampling is anti-aliased. The sinc modes delay the signal by
+// kTaps / 2 input samples; LINEAR by none.
+//
+// process() never allocates once constructed, so it may run on the audio
+// thread.
+class Resampler {
+public:
+    enum class Quality { LINEAR, SINC, POLYPHASE };
+
+    static constexpr size_t kTaps = 32;
+    // Ratios with more phases than this use the nearest of kMaxPhases
+    static constexpr size_t kMaxPhases = 1024;
+
+    Resampler(unsigned int input_rate, unsigned int output_rate,
+              Quality quality = Quality::POLYPHASE, size_t max_input_frames = 4096);
+
+    Resampler(const Resampler&) = delete;
+    Resampler& operator=(const Resampler&) = delete;
+
+    // Converts frames of input and writes the output that became available;
+    // returns how many output frames were written, at most
+    // max_output_frames(frames). Input longer than max_input_frames() is
+    // handled in pieces.
+    size_t process(const float* input, size_t frames, float* output);
+
+    size_t max_output_frames(size_t input_frames) const;
+    size_t max_input_frames() const { return max_input_frames_; }
+
+    // Forget all history, as if freshly constructed
+    void reset();
+
+    unsigned int input_rate() const { return input_rate_; }
+    unsigned int output_rate() const { return output_rate_; }
+    Quality quality() const { return quality_; }
+
+private:
+    size_t process_chunk(const float* input, size_t frames, float* output);
+    void sinc_coefficients(double fraction, float* coefficients) const;
+
+    const DspKernels& dsp_;
+    unsigned int input_rate_;
+    unsigned int output_rate_;
+    Quality quality_;
+    size_t max_input_frames_;
+
+    // Output step in input samples is step_ / phases_ (reduced ratio)
+    size_t phases_;
+    size_t step_;
+    size_t taps_;
+    double cutoff_;         // Relative to the input Nyquist rate
+    size_t table_phases_;
+    std::vector<float> table_; // table_phases_ x taps_, POLYPHASE only
+    std::vector<float> coefficients_; // Scratch for SINC
+
+    std::vector<float> history_;
+    size_t count_;          // Valid samples in history_
+    size_t index_;          // First input sample of the next output's window
+    size_t phase_;          // Fractional position of the next output, in 1/phases_
+};
@@ -0,0 +1,96 @@
+#include "spectrogram.h"
+#include "dsp_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+} // namespace
+
+Spectrogram::Spectrogram() : Spectrogram(Options()) {}
+
+Spectrogram::Spectrogram(const Options& options)
+    : options_(options), dsp_(&dsp_kernels()), fft_(options.fft_size),
+      window_(options.fft_size), history_(2 * options.fft_size, 0.0f), frame_(options.fft_size),
+      re_(fft_.bins()), im_(fft_.bins()), power_(fft_.bins()), column_(fft_.bins()),
+      ring_(options.history_columns * fft_.bins(), 0) {
+    options_.hop = std::max<size_t>(options_.hop, 1);
+    double window_sum = 0.0;
+    for (size_t n = 0; n < options_.fft_size; ++n) {
+        window_[n] = static_cast<float>(0.5 - 0.5 * std::cos(2.0 * kPi * n / options_.fft_size));
+        window_sum += window_[n];
+    }
+    // A sine of amplitude 1 puts sum(window) / 2 in its bin
+    double peak = window_sum / 2.0;
+    power_scale_ = static_cast<float>(1.0 / (peak * peak));
+}
+
+void Spectrogram::push(const float* samples, size_t frames) {
+    const size_t size = options_.fft_size;
+    while (frames) {
+        // Up to the next hop, and never past the end of the ring
+        size_t chunk = std::min({ frames, options_.hop - since_hop_, size - history_write_ });
+        std::memcpy(history_.data() + history_write_, samples, sizeof(float) * chunk);
+        std::memcpy(history_.data() + history_write_ + size, samples, sizeof(float) * chunk);
+        history_write_ = (history_write_ + chunk) % size;
+        since_hop_ += chunk;
+        samples += chunk;
+        frames -= chunk;
+        if (since_hop_ == options_.hop) {
+            since_hop_ = 0;
+            analyse();
+        }
+    }
+}
+
+void Spectrogram::analyse() {
+    // Oldest sample first
+    const float* history = history_.data() + history_write_;
+    for (size_t n = 0; n < options_.fft_size; ++n) {
+        frame_[n] = history[n] * window_[n];
+    }
+    fft_.forward(frame_.data(), re_.data(), im_.data());
+    dsp_->power_spectrum(re_.data(), im_.data(), power_.data(), power_.size());
+
+    const float to_level = 255.0f / -kFloorDb;
+    for (size_t k = 0; k < power_.size(); ++k) {
+        float db = 10.0f * std::log10(power_[k] * power_scale_ + 1e-20f);
+        column_[k] = static_cast<uint8_t>(std::clamp((db - kFloorDb) * to_level, 0.0f, 255.0f));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    size_t slot = static_cast<size_t>(columns_ % options_.history_columns);
+    std::memcpy(ring_.data() + slot * column_.size(), column_.data(), column_.size());
+    ++columns_;
+}
+
+void Spectrogram::clear() {
+    std::fill(history_.begin(), history_.end(), 0.0f);
+    history_write_ = 0;
+    since_hop_ = 0;
+    std::lock_guard<std::mutex> lock(mutex_);
+    columns_ = 0;
+}
+
+uint64_t Spectrogram::columns() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return columns_;
+}
+
+size_t Spectrogram::read_columns(uint64_t first, size_t count, uint8_t* out) const {
+    const size_t bins = column_.size();
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t oldest = columns_ - std::min<uint64_t>(columns_, options_.history_columns);
+    uint64_t begin = std::max(first, oldest);
+    uint64_t end = std::min(first + count, columns_);
+    size_t copied = 0;
+    for (uint64_t index = begin; index < end; ++index, ++copied) {
+        size_t slot = static_cast<size_t>(index % options_.history_columns);
+        std::memcpy(out + copied * bins, ring_.data() + slot * bins, bins);
+    }
+    return copied;
+}
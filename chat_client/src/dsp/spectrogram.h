@@ -0,0 +1,74 @@
+#pragma once
+
+#include "fft.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+struct DspKernels;
+
+// Short-time spectrum of a mono signal, computed as the samples arrive.
+//
+// Every hop samples, the latest fft_size are Hann-windowed and transformed,
+// so each column costs one FFT however long the display has been running.
+// A column holds each bin's power in dB relative to a full-scale sine,
+// quantised to 0..255 over [kFloorDb, 0]. The newest history_columns
+// columns are kept in a ring.
+//
+// push() runs on one thread; columns() and read_columns() may be called from
+// another, which shares only the ring, under a mutex held while a column is
+// copied in or out.
+class Spectrogram {
+public:
+    static constexpr float kFloorDb = -100.0f;
+
+    struct Options {
+        size_t fft_size = 512;        // Power of two
+        size_t hop = 160;             // 10 ms at 16 kHz
+        size_t history_columns = 2048;
+    };
+
+    Spectrogram();
+    explicit Spectrogram(const Options& options);
+
+    Spectrogram(const Spectrogram&) = delete;
+    Spectrogram& operator=(const Spectrogram&) = delete;
+
+    void push(const float* samples, size_t frames);
+    // Drops the samples and columns; the column count starts again at 0
+    void clear();
+
+    size_t bins() const { return fft_.bins(); }
+    size_t hop() const { return options_.hop; }
+    // Columns produced since construction or clear()
+    uint64_t columns() const;
+    // Copies columns [first, first + count) into out, bins() bytes each.
+    // Returns how many were still held; those before the ring are skipped,
+    // so the copy starts at the oldest held when first is older.
+    size_t read_columns(uint64_t first, size_t count, uint8_t* out) const;
+
+private:
+    void analyse();
+
+    Options options_;
+    const DspKernels* dsp_;
+    RealFft fft_;
+    std::vector<float> window_;
+    // Ring of the latest fft_size samples, written twice, fft_size apart,
+    // so the frame is contiguous wherever the ring starts
+    std::vector<float> history_;
+    size_t history_write_ = 0;
+    size_t since_hop_ = 0;
+    std::vector<float> frame_;
+    std::vector<float> re_;
+    std::vector<float> im_;
+    std::vector<float> power_;
+    std::vector<uint8_t> column_;
+    float power_scale_;             // Makes a full-scale sine's peak bin 1
+
+    mutable std::mutex mutex_;
+    std::vector<uint8_t> ring_;     // history_columns columns of bins() bytes
+    uint64_t columns_ = 0;
+};
@@ -0,0 +1,57 @@
+#include "voice_activity_detector.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float kLowHz = 300.0f;
+constexpr float kHighHz = 4000.0f;
+// Band power over the noise floor needed to count as speech (about 5 dB)
+constexpr float kMinSnr = 3.0f;
+// Share of the power above the noise floor that must fall in the speech
+// band. Clicks, taps and hiss spread theirs over the whole spectrum.
+constexpr float kMinBandShare = 0.5f;
+// Absolute floor, mean square per sample (-70 dBFS)
+constexpr float kMinLevel = 1e-7f;
+// Time constant of the decision smoothing
+constexpr float kSmoothingSeconds = 0.02f;
+constexpr float kMinNoise = 1e-12f;
+
+} // namespace
+
+VoiceActivityDetector::VoiceActivityDetector(unsigned int sample_rate, size_t fft_size,
+                                             float frames_per_second)
+    : fft_size_(static_cast<float>(fft_size)),
+      smoothing_(std::exp(-1.0f / (kSmoothingSeconds * frames_per_second))) {
+    const float bin_hz = static_cast<float>(sample_rate) / fft_size_;
+    const size_t top = fft_size / 2;
+    bins_ = top + 1;
+    first_bin_ = std::clamp<size_t>(static_cast<size_t>(std::ceil(kLowHz / bin_hz)), 1, top);
+    last_bin_ = std::clamp<size_t>(static_cast<size_t>(kHighHz / bin_hz), first_bin_, top);
+}
+
+bool VoiceActivityDetector::process(const float* power, const float* noise) {
+    float band_power = 0.0f;
+    float band_noise = 0.0f;
+    float band_excess = 0.0f;
+    float total_excess = 0.0f;
+    for (size_t f = 0; f < bins_; ++f) {
+        float excess = std::max(power[f] - noise[f], 0.0f);
+        total_excess += excess;
+        if (f >= first_bin_ && f <= last_bin_) {
+            band_power += power[f];
+            band_noise += noise[f];
+            band_excess += excess;
+        }
+    }
+    const float count = static_cast<float>(last_bin_ - first_bin_ + 1);
+    // Parseval: a windowed bin's power is about fft_size / 2 times the
+    // mean square of the samples, and the band holds count of them
+    float level = band_power / (count * fft_size_ * 0.5f);
+
+    bool voiced = band_power > kMinSnr * std::max(band_noise, kMinNoise)
+               && band_excess > kMinBandShare * total_excess
+               && level > kMinLevel;
+    probability_ = smoothing_ * probability_ + (1.0f - smoothing_) * (voiced ? 1.0f : 0.0f);
+    return speech();
+}
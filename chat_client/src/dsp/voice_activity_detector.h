@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// Energy and spectral-shape voice activity detector.
+//
+// Each STFT frame is scored on the speech band (300 Hz - 4 kHz): its power
+// must stand above the tracked noise floor, and most of the power above
+// that floor must lie in the band, as it does for voice. Broadband bursts
+// such as clicks, keyboard taps or hiss spread across the whole spectrum
+// and are rejected. The per-frame decisions are smoothed into a
+// probability, and speech is reported while it is above one half.
+class VoiceActivityDetector {
+public:
+    VoiceActivityDetector(unsigned int sample_rate, size_t fft_size, float frames_per_second);
+
+    // Scores one frame against the noise estimate and returns speech()
+    bool process(const float* power, const float* noise);
+
+    bool speech() const { return probability_ > 0.5f; }
+    float probability() const { return probability_; }
+    void reset() { probability_ = 0.0f; }
+
+private:
+    size_t bins_;
+    size_t first_bin_;
+    size_t last_bin_;         // Inclusive
+    float fft_size_;
+    float smoothing_;         // Per-frame probability smoothing
+    float probability_ = 0.0f;
+};
@@ -0,0 +1,260 @@
+#include "voice_processor.h"
+#include "echo_canceller.h"
+#include "fft.h"
+#include "gain_control.h"
+#include "noise_suppressor.h"
+#include "voice_activity_detector.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr double kPi = 3.14159265358979323846;
+// Hops are the largest power of two no longer than this
+constexpr double kMaxHopSeconds = 0.0025;
+constexpr size_t kMinHop = 16;
+// Without the detector, the gain control steers on blocks above this
+// mean square (-50 dBFS)
+constexpr float kGainControlGate = 1e-5f;
+
+uint64_t elapsed_ns(Clock::time_point start) {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+}
+
+} // namespace
+
+VoiceProcessor::VoiceProcessor(size_t max_frames)
+    : max_frames_(max_frames), reference_(max_frames) {
+    configure(48000);
+}
+
+VoiceProcessor::~VoiceProcessor() = default;
+
+void VoiceProcessor::configure(unsigned int sample_rate) {
+    sample_rate_ = sample_rate;
+    hop_ = kMinHop;
+    while (hop_ * 2 <= sample_rate * kMaxHopSeconds) {
+        hop_ *= 2;
+    }
+    const size_t fft_size = 2 * hop_;
+    const size_t bins = hop_ + 1;
+    const float hops_per_second = static_cast<float>(sample_rate) / static_cast<float>(hop_);
+    const size_t tail = static_cast<size_t>(sample_rate) * kEchoTailMs / 1000;
+
+    fft_ = std::make_unique<RealFft>(fft_size);
+    echo_canceller_ = std::make_unique<EchoCanceller>(hop_, (tail + hop_ - 1) / hop_);
+    noise_suppressor_ = std::make_unique<NoiseSuppressor>(bins, hops_per_second);
+    voice_activity_ = std::make_unique<VoiceActivityDetector>(sample_rate, fft_size, hops_per_second);
+    gain_control_ = std::make_unique<GainControl>(hops_per_second);
+
+    near_hop_.assign(hop_, 0.0f);
+    far_hop_.assign(hop_, 0.0f);
+    out_hop_.assign(hop_, 0.0f);
+    frame_.assign(fft_size, 0.0f);
+    windowed_.assign(fft_size, 0.0f);
+    overlap_.assign(hop_, 0.0f);
+    spectrum_re_.assign(bins, 0.0f);
+    spectrum_im_.assign(bins, 0.0f);
+    power_.assign(bins, 0.0f);
+    gains_.assign(bins, 1.0f);
+    window_.resize(fft_size);
+    for (size_t n = 0; n < fft_size; ++n) {
+        window_[n] = static_cast<float>(std::sqrt(0.5 - 0.5 * std::cos(2.0 * kPi * n / fft_size)));
+    }
+
+    running_ = false;
+    reset_stage_stats();
+}
+
+void VoiceProcessor::set_enabled(Stage stage, bool enabled) {
+    enabled_[static_cast<size_t>(stage)].store(enabled, std::memory_order_relaxed);
+}
+
+bool VoiceProcessor::enabled(Stage stage) const {
+    return enabled_[static_cast<size_t>(stage)].load(std::memory_order_relaxed);
+}
+
+bool VoiceProcessor::active() const {
+    return std::any_of(enabled_.begin(), enabled_.end(),
+                       [](const std::atomic<bool>& flag) { return flag.load(std::memory_order_relaxed); });
+}
+
+void VoiceProcessor::reset_state() {
+    echo_canceller_->reset();
+    noise_suppressor_->reset();
+    voice_activity_->reset();
+    gain_control_->reset();
+    filled_ = 0;
+    std::fill(out_hop_.begin(), out_hop_.end(), 0.0f);
+    std::fill(frame_.begin(), frame_.end(), 0.0f);
+    std::fill(overlap_.begin(), overlap_.end(), 0.0f);
+    reference_frames_ = 0;
+    speech_.store(false, std::memory_order_relaxed);
+    noise_level_.store(0.0f, std::memory_order_relaxed);
+}
+
+bool VoiceProcessor::process(const float* capture, float* output, size_t frames) {
+    if (!active()) {
+        running_ = false;
+        return false;
+    }
+    if (!running_) {
+        // Start clean rather than from whatever was left when last stopped
+        reset_state();
+        running_ = true;
+    }
+
+    size_t done = 0;
+    while (done < frames) {
+        size_t count = std::min(frames - done, hop_ - filled_);
+        std::memcpy(output + done, out_hop_.data() + filled_, sizeof(float) * count);
+        std::memcpy(near_hop_.data() + filled_, capture + done, sizeof(float) * count);
+        for (size_t i = 0; i < count; ++i) {
+            size_t at = done + i;
+            far_hop_[filled_ + i] = at < reference_frames_ ? reference_[at] : 0.0f;
+        }
+        filled_ += count;
+        done += count;
+        if (filled_ == hop_) {
+            process_hop();
+            filled_ = 0;
+        }
+    }
+    return true;
+}
+
+void VoiceProcessor::set_reference(const float* stereo, size_t frames) {
+    if (!running_) {
+        return;
+    }
+    reference_frames_ = std::min(frames, max_frames_);
+    for (size_t i = 0; i < reference_frames_; ++i) {
+        reference_[i] = 0.5f * (stereo[2 * i] + stereo[2 * i + 1]);
+    }
+}
+
+void VoiceProcessor::process_hop() {
+    const bool cancel_echo = enabled(Stage::ECHO_CANCELLATION);
+    const bool suppress_noise = enabled(Stage::NOISE_SUPPRESSION);
+    const bool control_gain = enabled(Stage::GAIN_CONTROL);
+    const bool detect_voice = enabled(Stage::VOICE_ACTIVITY);
+
+    if (cancel_echo) {
+        auto start = Clock::now();
+        echo_canceller_->process(near_hop_.data(), far_hop_.data(), near_hop_.data());
+        record(Stage::ECHO_CANCELLATION, elapsed_ns(start));
+        erle_db_.store(echo_canceller_->erle_db(), std::memory_order_relaxed);
+    }
+
+    // frame_ holds the previous hop and this one
+    std::memmove(frame_.data(), frame_.data() + hop_, sizeof(float) * hop_);
+    std::memcpy(frame_.data() + hop_, near_hop_.data(), sizeof(float) * hop_);
+
+    bool speech = false;
+    if (suppress_noise || detect_voice) {
+        // Analysis is charged to the suppressor when it runs, else the detector
+        auto start = Clock::now();
+        const size_t fft_size = 2 * hop_;
+        for (size_t n = 0; n < fft_size; ++n) {
+            windowed_[n] = frame_[n] * window_[n];
+        }
+        fft_->forward(windowed_.data(), spectrum_re_.data(), spectrum_im_.data());
+        for (size_t f = 0; f <= hop_; ++f) {
+            power_[f] = spectrum_re_[f] * spectrum_re_[f] + spectrum_im_[f] * spectrum_im_[f];
+        }
+        noise_suppressor_->update_noise(power_.data());
+        // The one-sided bins of a Hann-weighted frame sum to fft_size^2 / 4
+        // times the mean square; suppression leaves the floor gain of it
+        float noise_power = 0.0f;
+        for (size_t f = 0; f <= hop_; ++f) {
+            noise_power += noise_suppressor_->noise()[f];
+        }
+        float residual = suppress_noise ? NoiseSuppressor::kGainFloor : 1.0f;
+        noise_level_.store(residual * std::sqrt(4.0f * noise_power / static_cast<float>(fft_size * fft_size)),
+                           std::memory_order_relaxed);
+        uint64_t analysis_ns = elapsed_ns(start);
+
+        if (detect_voice) {
+            start = Clock::now();
+            speech = voice_activity_->process(power_.data(), noise_suppressor_->noise());
+            record(Stage::VOICE_ACTIVITY, elapsed_ns(start) + (suppress_noise ? 0 : analysis_ns));
+        }
+
+        if (suppress_noise) {
+            start = Clock::now();
+            noise_suppressor_->compute_gains(power_.data(), gains_.data());
+            for (size_t f = 0; f <= hop_; ++f) {
+                spectrum_re_[f] *= gains_[f];
+                spectrum_im_[f] *= gains_[f];
+            }
+            fft_->inverse(spectrum_re_.data(), spectrum_im_.data(), windowed_.data());
+            for (size_t n = 0; n < hop_; ++n) {
+                out_hop_[n] = overlap_[n] + windowed_[n] * window_[n];
+                overlap_[n] = windowed_[hop_ + n] * window_[hop_ + n];
+            }
+            record(Stage::NOISE_SUPPRESSION, elapsed_ns(start) + analysis_ns);
+        }
+    }
+
+    if (!suppress_noise) {
+        // What synthesis with unity gains would produce, so the suppressor
+        // can be switched on without a glitch
+        for (size_t n = 0; n < hop_; ++n) {
+            out_hop_[n] = frame_[n];
+            overlap_[n] = frame_[hop_ + n] * window_[hop_ + n] * window_[hop_ + n];
+        }
+    }
+
+    if (!detect_voice) {
+        float sum = 0.0f;
+        for (float sample : out_hop_) {
+            sum += sample * sample;
+        }
+        speech = sum > kGainControlGate * static_cast<float>(hop_);
+    }
+
+    if (control_gain) {
+        auto start = Clock::now();
+        gain_control_->process(out_hop_.data(), hop_, speech);
+        record(Stage::GAIN_CONTROL, elapsed_ns(start));
+        gain_db_.store(gain_control_->gain_db(), std::memory_order_relaxed);
+    }
+
+    speech_.store(detect_voice && speech, std::memory_order_relaxed);
+}
+
+void VoiceProcessor::record(Stage stage, uint64_t elapsed) {
+    StageCounters& counters = counters_[static_cast<size_t>(stage)];
+    counters.hops.fetch_add(1, std::memory_order_relaxed);
+    counters.total_ns.fetch_add(elapsed, std::memory_order_relaxed);
+    if (elapsed > counters.max_ns.load(std::memory_order_relaxed)) {
+        counters.max_ns.store(elapsed, std::memory_order_relaxed);
+    }
+}
+
+VoiceProcessor::StageStats VoiceProcessor::stage_stats(Stage stage) const {
+    const StageCounters& counters = counters_[static_cast<size_t>(stage)];
+    StageStats stats;
+    stats.hops = counters.hops.load(std::memory_order_relaxed);
+    if (stats.hops == 0) {
+        return stats;
+    }
+    stats.mean_us = counters.total_ns.load(std::memory_order_relaxed) / 1000.0 / stats.hops;
+    stats.max_us = counters.max_ns.load(std::memory_order_relaxed) / 1000.0;
+    double hop_us = 1e6 * static_cast<double>(hop_) / sample_rate_;
+    stats.load = stats.mean_us / hop_us;
+    return stats;
+}
+
+void VoiceProcessor::reset_stage_stats() {
+    for (auto& counters : counters_) {
+        counters.hops.store(0, std::memory_order_relaxed);
+        counters.total_ns.store(0, std::memory_order_relaxed);
+        counters.max_ns.store(0, std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class RealFft;
+class EchoCanceller;
+class NoiseSuppressor;
+class VoiceActivityDetector;
+class GainControl;
+
+// Capture-side voice processing: echo cancellation, noise suppression,
+// automatic gain control and voice activity detection, in that order.
+//
+// Audio is processed in hops of at most 2.5 ms (64 frames at 44.1/48 kHz).
+// The noise suppressor's STFT uses two-hop frames with a square-root Hann
+// window at 50% overlap, which reconstructs exactly when no gain is
+// applied. The chain delays the capture signal by latency_frames(), at
+// most 5 ms, whichever stages are enabled, so stages can be toggled
+// without the stream jumping. With every stage off, process() does
+// nothing and the capture passes straight through.
+//
+// Stages are switched with set_enabled() from any thread; the audio thread
+// picks the change up at the next hop. Each stage counts the time it
+// spends, readable with stage_stats() while running.
+class VoiceProcessor {
+public:
+    enum class Stage { ECHO_CANCELLATION, NOISE_SUPPRESSION, GAIN_CONTROL, VOICE_ACTIVITY };
+    static constexpr size_t kStageCount = 4;
+
+    // Echo path length the canceller models
+    static constexpr unsigned int kEchoTailMs = 128;
+
+    struct StageStats {
+        uint64_t hops = 0;       // Hops processed with the stage enabled
+        double mean_us = 0.0;
+        double max_us = 0.0;
+        double load = 0.0;       // Mean time as a fraction of a hop's duration
+    };
+
+    // max_frames bounds the frames of a single process()/set_reference() call
+    explicit VoiceProcessor(size_t max_frames);
+    ~VoiceProcessor();
+
+    VoiceProcessor(const VoiceProcessor&) = delete;
+    VoiceProcessor& operator=(const VoiceProcessor&) = delete;
+
+    // Sizes every stage for the rate and resets them. Allocates; call with
+    // the stream stopped.
+    void configure(unsigned int sample_rate);
+
+    void set_enabled(Stage stage, bool enabled);
+    bool enabled(Stage stage) const;
+    // True if any stage is enabled
+    bool active() const;
+
+    // Audio thread. Writes the processed capture to output and returns true,
+    // or returns false without touching output when no stage is enabled.
+    // The echo canceller's reference is the set_reference() of the call
+    // before, so pair each process() with a set_reference() of the block
+    // that was played.
+    bool process(const float* capture, float* output, size_t frames);
+    // Audio thread. Interleaved stereo being sent to the speakers
+    void set_reference(const float* stereo, size_t frames);
+
+    // Latest decision of the voice activity detector; false while disabled
+    bool speech_detected() const { return speech_.load(std::memory_order_relaxed); }
+    float echo_return_loss_enhancement_db() const { return erle_db_.load(std::memory_order_relaxed); }
+    float gain_db() const { return gain_db_.load(std::memory_order_relaxed); }
+    // RMS of the background noise left in the output, from the noise
+    // estimate; 0 until suppression or detection has run
+    float noise_level() const { return noise_level_.load(std::memory_order_relaxed); }
+
+    StageStats stage_stats(Stage stage) const;
+    void reset_stage_stats();
+
+    unsigned int sample_rate() const { return sample_rate_; }
+    size_t hop() const { return hop_; }
+    size_t latency_frames() const { return 2 * hop_; }
+
+private:
+    struct StageCounters {
+        std::atomic<uint64_t> hops{0};
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+    };
+
+    void reset_state();
+    void process_hop();
+    void record(Stage stage, uint64_t elapsed_ns);
+
+    size_t max_frames_;
+    unsigned int sample_rate_ = 0;
+    size_t hop_ = 0;
+    std::array<std::atomic<bool>, kStageCount> enabled_{};
+    std::array<StageCounters, kStageCount> counters_;
+
+    std::unique_ptr<RealFft> fft_;
+    std::unique_ptr<EchoCanceller> echo_canceller_;
+    std::unique_ptr<NoiseSuppressor> noise_suppressor_;
+    std::unique_ptr<VoiceActivityDetector> voice_activity_;
+    std::unique_ptr<GainControl> gain_control_;
+
+    // Audio thread state
+    bool running_ = false;
+    size_t filled_ = 0;                  // Frames of the current hop collected
+    std::vector<float> near_hop_;        // Capture collected for the next hop
+    std::vector<float> far_hop_;         // Matching reference
+    std::vector<float> out_hop_;         // Processed hop being played out
+    std::vector<float> frame_;           // Previous and current hop, echo cancelled
+    std::vector<float> window_;          // Square-root Hann, 2 * hop_
+    std::vector<float> windowed_;
+    std::vector<float> overlap_;         // Second half of the last synthesis frame
+    std::vector<float> spectrum_re_;
+    std::vector<float> spectrum_im_;
+    std::vector<float> power_;
+    std::vector<float> gains_;
+    std::vector<float> reference_;       // Mono mix of the last set_reference()
+    size_t reference_frames_ = 0;
+
+    std::atomic<bool> speech_{false};
+    std::atomic<float> erle_db_{0.0f};
+    std::atomic<float> gain_db_{0.0f};
+    std::atomic<float> noise_level_{0.0f};
+};
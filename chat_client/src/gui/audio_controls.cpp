@@ -1,5 +1,6 @@
 #include "audio_controls.h"
 #include "../audio/audio_engine.h"
+#include "../dsp/voice_processor.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Box.H>
@@ -8,6 +9,10 @@
 #include <FL/Fl_Round_Button.H>
 #include <FL/Fl_Group.H>
 
+#include <array>
+#include <cstdio>
+#include <memory>
+
 class AudioControls::Impl {
 public:
     AudioEngine* audio_engine;
@@ -15,42 +20,85 @@ public:
     Fl_Value_Slider* gain_slider;
     Fl_Check_Button* mute_input_checkbox;
     Fl_Check_Button* mute_output_checkbox;
-    Fl_Round_Button* echo_cancellation_checkbox;
-    
-    float output_volume = 1.0f;
-    float input_gain = 1.0f;
-    bool mute_input = false;
-    bool mute_output = false;
-    bool echo_cancellation = false;
-    
+    Fl_Box* processing_load;
+    
+    // Callback data for the processing stage checkboxes
+    struct StageToggle {
+        Impl* impl;
+        VoiceProcessor::Stage stage;
+        Fl_Check_Button* checkbox;
+    };
+    std::array<StageToggle, VoiceProcessor::kStageCount> stage_toggles{};
+    
+    // The engine applies these to the monitored input, the far end and
+    // what is sent alike
     static void volume_changed_cb(Fl_Widget* w, void* user_data) {
         auto* self = static_cast<Impl*>(user_data);
         auto* slider = static_cast<Fl_Value_Slider*>(w);
-        self->output_volume = static_cast<float>(slider->value());
+        self->audio_engine->set_output_volume(static_cast<float>(slider->value()));
     }
     
     static void gain_changed_cb(Fl_Widget* w, void* user_data) {
         auto* self = static_cast<Impl*>(user_data);
         auto* slider = static_cast<Fl_Value_Slider*>(w);
-        self->input_gain = static_cast<float>(slider->value());
+        self->audio_engine->set_input_gain(static_cast<float>(slider->value()));
     }
     
     static void mute_input_cb(Fl_Widget* w, void* user_data) {
         auto* self = static_cast<Impl*>(user_data);
         auto* checkbox = static_cast<Fl_Check_Button*>(w);
-        self->mute_input = checkbox->value() == 1;
+        self->audio_engine->set_input_muted(checkbox->value() == 1);
     }
     
     static void mute_output_cb(Fl_Widget* w, void* user_data) {
         auto* self = static_cast<Impl*>(user_data);
         auto* checkbox = static_cast<Fl_Check_Button*>(w);
-        self->mute_output = checkbox->value() == 1;
+        self->audio_engine->set_output_muted(checkbox->value() == 1);
     }
     
-    static void echo_cancellation_cb(Fl_Widget* w, void* user_data) {
-        auto* self = static_cast<Impl*>(user_data);
+    // The stage flags are atomics the audio thread reads at its next hop
+    static void stage_toggled_cb(Fl_Widget* w, void* user_data) {
+        auto* toggle = static_cast<StageToggle*>(user_data);
         auto* checkbox = static_cast<Fl_Check_Button*>(w);
-        self->echo_cancellation = checkbox->value() == 1;
+        toggle->impl->audio_engine->voice_processor().set_enabled(toggle->stage, checkbox->value() == 1);
+    }
+    
+    Fl_Check_Button* add_stage_checkbox(int x, int y, const char* label, VoiceProcessor::Stage stage) {
+        StageToggle& toggle = stage_toggles[static_cast<size_t>(stage)];
+        auto* checkbox = new Fl_Check_Button(x, y, 200, 25, label);
+        toggle = { this, stage, checkbox };
+        checkbox->value(audio_engine->voice_processor().enabled(stage) ? 1 : 0);
+        checkbox->callback(stage_toggled_cb, &toggle);
+        return checkbox;
+    }
+    
+    // Per-stage CPU load, as a share of real time. The checkboxes follow
+    // stages switched elsewhere, as by a settings reload.
+    static void load_timer_cb(void* user_data) {
+        auto* self = static_cast<Impl*>(user_data);
+        const VoiceProcessor& voice = self->audio_engine->voice_processor();
+        for (const StageToggle& toggle : self->stage_toggles) {
+            if (toggle.checkbox && (toggle.checkbox->value() == 1) != voice.enabled(toggle.stage)) {
+                toggle.checkbox->value(voice.enabled(toggle.stage) ? 1 : 0);
+            }
+        }
+        auto load = [&voice](VoiceProcessor::Stage stage) {
+            return 100.0 * voice.stage_stats(stage).load;
+        };
+        char gating[32] = "";
+        if (self->audio_engine->capture_gating().enabled) {
+            std::snprintf(gating, sizeof(gating), "  gated %.0f%% silent",
+                          100.0 * self->audio_engine->get_gating_stats().silence_fraction);
+        }
+        char text[160];
+        std::snprintf(text, sizeof(text), "CPU  AEC %.1f%%  NS %.1f%%  AGC %.1f%%  VAD %.1f%%%s%s",
+                      load(VoiceProcessor::Stage::ECHO_CANCELLATION),
+                      load(VoiceProcessor::Stage::NOISE_SUPPRESSION),
+                      load(VoiceProcessor::Stage::GAIN_CONTROL),
+                      load(VoiceProcessor::Stage::VOICE_ACTIVITY),
+                      voice.speech_detected() ? "  [voice]" : "", gating);
+        self->processing_load->copy_label(text);
+        Fl::repeat_timeout(0.5, load_timer_cb, user_data);
     }
 };
 
@@ -95,32 +143,22 @@ AudioControls::AudioControls(int x, int y, int w, int h, AudioEngine* audio_engi
     processing_group->align(FL_ALIGN_TOP_LEFT);
     processing_group->begin();
     
-    pImpl->echo_cancellation_checkbox = new Fl_Check_Button(x + 10, y + 130, 200, 25, "Echo Cancellation");
-    pImpl->echo_cancellation_checkbox->callback(Impl::echo_cancellation_cb, pImpl.get());
+    using Stage = VoiceProcessor::Stage;
+    pImpl->add_stage_checkbox(x + 10, y + 130, "Echo Cancellation", Stage::ECHO_CANCELLATION);
+    pImpl->add_stage_checkbox(x + 10, y + 160, "Noise Suppression", Stage::NOISE_SUPPRESSION);
+    pImpl->add_stage_checkbox(x + 200, y + 130, "Auto Gain Control", Stage::GAIN_CONTROL);
+    pImpl->add_stage_checkbox(x + 200, y + 160, "Voice Activity Detection", Stage::VOICE_ACTIVITY);
     
-    new Fl_Check_Button(x + 10, y + 160, 200, 25, "Noise Suppression");
-    new Fl_Check_Button(x + 200, y + 130, 200, 25, "Auto Gain Control");
-    new Fl_Check_Button(x + 200, y + 160, 200, 25, "Voice Activity Detection");
+    pImpl->processing_load = new Fl_Box(x + 10, y + 185, w - 20, 20);
+    pImpl->processing_load->align(FL_ALIGN_INSIDE | FL_ALIGN_LEFT);
     
     processing_group->end();
     
     end();
     
-    // Set audio callback that applies these settings
-    audio_engine->set_audio_callback([this](const float* input, float* output, unsigned int frames) {
-        bool mute_in = pImpl->mute_input;
-        bool mute_out = pImpl->mute_output;
-        float gain = pImpl->input_gain;
-        float volume = pImpl->output_volume;
-        
-        for (unsigned int i = 0; i < frames; ++i) {
-            // Process input with gain and mute
-            float in_sample = mute_in ? 0.0f : input[i] * gain;
-            
-            // Simple passthrough to both channels with volume control
-            output[i*2] = output[i*2+1] = mute_out ? 0.0f : in_sample * volume;
-        }
-    });
+    Fl::add_timeout(0.5, Impl::load_timer_cb, pImpl.get());
 }
 
-AudioControls::~AudioControls() = default;
+AudioControls::~AudioControls() {
+    Fl::remove_timeout(Impl::load_timer_cb, pImpl.get());
+}
@@ -1,4 +1,8 @@
 #include "chat_window.h"
+#include "../core/chat_history.h"
+#include "../core/history_store.h"
+#include "../core/message_formatter.h"
+#include "../core/search_index.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Text_Display.H>
@@ -7,14 +11,124 @@
 #include <FL/Fl_Button.H>
 #include <FL/fl_draw.H>
 #include <functional>
-#include <sstream>
-#include <iomanip>
+#include <cctype>
 #include <ctime>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMaxSearchResults = 200;
+constexpr size_t kMinTypedPrefix = 3;
+
+// Searches as the user types: a last word of three letters or more that
+// is not inside quotes also matches the words it starts
+void complete_last_word(std::string& text) {
+    size_t quotes = 0;
+    for (char c : text) {
+        quotes += c == '"';
+    }
+    size_t length = 0;
+    while (length < text.size()) {
+        unsigned char c = static_cast<unsigned char>(text[text.size() - 1 - length]);
+        if (!std::isalnum(c) && c < 0x80) {
+            break;
+        }
+        ++length;
+    }
+    if (quotes % 2 == 0 && length >= kMinTypedPrefix) {
+        text += '*';
+    }
+}
+
+// Text display that reports where it is scrolled to. Every scroll, from
+// the wheel, keys or scrollbar, ends in a redraw, so draw() is the one
+// place to notice the view reaching either end of the loaded window.
+class ChatDisplay : public Fl_Text_Display {
+public:
+    ChatDisplay(int x, int y, int w, int h) : Fl_Text_Display(x, y, w, h) {}
+
+    std::function<void()> on_drawn;
+
+    int top_line() const { return mTopLineNum; }
+    int total_lines() const { return mNBufferLines; }
+    bool at_end() const { return mTopLineNum + mNVisibleLines > mNBufferLines; }
+    // FLTK clamps the line to the last full page
+    void scroll_to_end() { scroll(mNBufferLines + 1, 0); }
+
+    void draw() override {
+        Fl_Text_Display::draw();
+        if (on_drawn) {
+            on_drawn();
+        }
+    }
+};
+
+// The window of history the display holds. Appends are collected and
+// written with flush(), so a batch of messages is one buffer modification.
+class BufferWindow : public ChatHistory::Display {
+public:
+    BufferWindow(Fl_Text_Buffer* buffer, ChatDisplay* display) : buffer_(buffer), display_(display) {}
+
+    void append(std::string_view text) override {
+        pending_.append(text.data(), text.size());
+    }
+
+    void prepend(std::string_view text) override {
+        flush();
+        int before = display_->total_lines();
+        buffer_->insert(0, std::string(text).c_str());
+        prepended_lines_ += display_->total_lines() - before;
+    }
+
+    void remove_front(size_t bytes) override {
+        flush();
+        buffer_->remove(0, static_cast<int>(bytes));
+    }
+
+    void remove_back(size_t bytes) override {
+        flush();
+        int length = buffer_->length();
+        buffer_->remove(length - static_cast<int>(bytes), length);
+    }
+
+    void flush() {
+        if (!pending_.empty()) {
+            buffer_->append(pending_.c_str());
+            pending_.clear();
+        }
+    }
+
+    // Display lines added above the view by prepend() since the last call
+    int take_prepended_lines() {
+        int lines = prepended_lines_;
+        prepended_lines_ = 0;
+        return lines;
+    }
+
+private:
+    Fl_Text_Buffer* buffer_;
+    ChatDisplay* display_;
+    std::string pending_;
+    int prepended_lines_ = 0;
+};
+
+} // namespace
 
 class ChatWindow::Impl {
 public:
-    Fl_Text_Display* message_display;
+    ChatDisplay* message_display;
     Fl_Text_Buffer* message_buffer;
+    ChatHistory history;
+    std::unique_ptr<BufferWindow> window;
+    bool page_pending = false;
+    MessageFormatter formatter;
+    HistoryStore* store = nullptr;
+    std::string store_channel;
+    const SearchIndex* search_index = nullptr;
+    Fl_Input* search_field;
+    Fl_Text_Buffer* results_buffer;  // Shown instead while searching
+    bool searching = false;
     Fl_Input* input_field;
     Fl_Button* send_button;
     
@@ -24,6 +138,11 @@ public:
         auto* self = static_cast<Impl*>(user_data);
         std::string message = self->input_field->value();
         if (!message.empty()) {
+            // Sending brings the conversation back
+            if (self->searching) {
+                self->search_field->value("");
+                self->end_search();
+            }
             if (self->on_send_callback) {
                 self->on_send_callback(message);
             }
@@ -40,6 +159,111 @@ public:
             send_cb(w, user_data);
         }
     }
+    
+    static void search_cb(Fl_Widget* w, void* user_data) {
+        auto* self = static_cast<Impl*>(user_data);
+        self->search(static_cast<Fl_Input*>(w)->value());
+    }
+
+    // Lists the matching messages, newest first, in place of the
+    // conversation; an empty search brings it back
+    void search(const std::string& typed) {
+        SearchIndex::Query query = SearchIndex::parse(typed);
+        if (!search_index || !store || (query.text.empty() && query.channel.empty())) {
+            end_search();
+            return;
+        }
+        complete_last_word(query.text);
+        query.limit = kMaxSearchResults;
+        std::vector<SearchIndex::Hit> hits = search_index->search(query);
+
+        std::string results;
+        for (const SearchIndex::Hit& hit : hits) {
+            store->read(hit.seq, 1, [this, &results](const HistoryStore::Record& record) {
+                results += formatter.format(static_cast<std::time_t>(record.time_ms / 1000), record.sender,
+                                            record.body, (record.flags & HistoryStore::SELF) != 0);
+                return false;
+            });
+        }
+        if (hits.empty()) {
+            results = "No messages found\n";
+        }
+        results_buffer->text(results.c_str());
+        if (!searching) {
+            searching = true;
+            message_display->buffer(results_buffer);
+        }
+        message_display->scroll(1, 0);
+    }
+
+    void end_search() {
+        if (searching) {
+            searching = false;
+            message_display->buffer(message_buffer);
+            message_display->scroll_to_end();
+        }
+    }
+
+    // Whether to scroll to the end after the batch
+    bool begin_batch(bool any_self) {
+        if (any_self) {
+            // Sending brings the newest messages back into view
+            history.jump_to_latest();
+            return true;
+        }
+        return message_display->at_end();
+    }
+
+    void add(std::time_t time, std::string_view sender, std::string_view text, bool is_self) {
+        history.append(formatter.format(time, sender, text, is_self));
+        // Received messages are logged by the protocol side; what the user
+        // sends is logged here, by the writer thread
+        if (is_self && store) {
+            store->append_async(static_cast<int64_t>(time) * 1000, HistoryStore::SELF, "You", store_channel,
+                                std::string(text));
+        }
+    }
+
+    void end_batch(bool follow) {
+        window->flush();
+        // The display keeps its own line count up to date as the buffer
+        // changes, so following the end no longer counts the whole buffer
+        if (follow) {
+            message_display->scroll_to_end();
+        }
+    }
+
+    // Loads the neighbouring chunk once the view reaches the top of the
+    // window, or its bottom while newer messages are paged out
+    void check_edges() {
+        if (page_pending || searching) {
+            return;
+        }
+        bool want_older = message_display->top_line() <= 1 && !history.at_oldest();
+        bool want_newer = message_display->at_end() && !history.live();
+        if (want_older || want_newer) {
+            page_pending = true;
+            Fl::add_timeout(0.0, page_cb, this);
+        }
+    }
+    
+    // Not run from draw(): the buffer must not change while drawing
+    static void page_cb(void* user_data) {
+        auto* self = static_cast<Impl*>(user_data);
+        self->page_pending = false;
+        ChatDisplay* display = self->message_display;
+        if (display->top_line() <= 1 && !self->history.at_oldest()) {
+            // Keep the line that was at the top in place
+            int top = display->top_line();
+            self->history.page_back();
+            self->window->flush();
+            display->scroll(top + self->window->take_prepended_lines(), 0);
+        } else if (display->at_end() && !self->history.live()) {
+            // Lines trimmed above the view shift it up by themselves
+            self->history.page_forward();
+            self->window->flush();
+        }
+    }
 };
 
 ChatWindow::ChatWindow(int x, int y, int w, int h)
@@ -48,14 +272,25 @@ ChatWindow::ChatWindow(int x, int y, int w, int h)
     
     begin();
     
+    // Search field, filtering as the user types
+    pImpl->search_field = new Fl_Input(x + 60, y + 5, w - 65, 25, "Search:");
+    pImpl->search_field->callback(Impl::search_cb, pImpl.get());
+    pImpl->search_field->when(FL_WHEN_CHANGED);
+    pImpl->search_field->deactivate();
+    pImpl->results_buffer = new Fl_Text_Buffer();
+    
     // Message display area
     pImpl->message_buffer = new Fl_Text_Buffer();
-    pImpl->message_display = new Fl_Text_Display(x, y, w, h - 40);
+    pImpl->message_display = new ChatDisplay(x, y + 35, w, h - 75);
     pImpl->message_display->buffer(pImpl->message_buffer);
     pImpl->message_display->wrap_mode(Fl_Text_Display::WRAP_AT_BOUNDS, 0);
     pImpl->message_display->textfont(FL_HELVETICA);
     pImpl->message_display->textsize(14);
     pImpl->message_display->textcolor(FL_BLACK);
+    pImpl->window = std::make_unique<BufferWindow>(pImpl->message_buffer, pImpl->message_display);
+    pImpl->history.attach(pImpl->window.get());
+    Impl* impl = pImpl.get();
+    pImpl->message_display->on_drawn = [impl] { impl->check_edges(); };
     
     // Input field and send button
     pImpl->input_field = new Fl_Input(x, y + h - 35, w - 100, 30);
@@ -72,32 +307,65 @@ ChatWindow::ChatWindow(int x, int y, int w, int h)
 }
 
 ChatWindow::~ChatWindow() {
+    Fl::remove_timeout(Impl::page_cb, pImpl.get());
     delete pImpl->message_buffer;
+    delete pImpl->results_buffer;
 }
 
 void ChatWindow::add_message(const std::string& sender, const std::string& message, bool is_self) {
-    // Get current time
-    auto now = std::time(nullptr);
-    auto tm = *std::localtime(&now);
-    std::ostringstream time_str;
-    time_str << std::put_time(&tm, "[%H:%M:%S] ");
-    
-    // Format message
-    std::string formatted_message;
-    if (is_self) {
-        formatted_message = time_str.str() + "You: " + message + "\n";
+    // Formatted straight from the arguments, with nothing copied on the way
+    bool follow = pImpl->begin_batch(is_self);
+    pImpl->add(std::time(nullptr), sender, message, is_self);
+    pImpl->end_batch(follow);
+}
+
+void ChatWindow::add_messages(const ChatMessage* messages, size_t count) {
+    if (count == 0) {
+        return;
+    }
+
+    bool any_self = false;
+    for (size_t i = 0; i < count && !any_self; ++i) {
+        any_self = messages[i].is_self;
+    }
+    // The history passes live messages on to the window, which writes the
+    // whole batch to the buffer in one append
+    bool follow = pImpl->begin_batch(any_self);
+    for (size_t i = 0; i < count; ++i) {
+        const ChatMessage& message = messages[i];
+        pImpl->add(message.time, message.sender, message.text, message.is_self);
+    }
+    pImpl->end_batch(follow);
+}
+
+void ChatWindow::set_history_store(HistoryStore* store, const std::string& channel) {
+    pImpl->store = store;
+    pImpl->store_channel = channel;
+}
+
+void ChatWindow::restore_history(const HistoryStore& store, size_t count) {
+    uint64_t next = store.next_seq();
+    uint64_t from = next > count ? next - count : 0;
+    Impl* impl = pImpl.get();
+    // The records are read in place from the mapped log
+    store.read(from, count, [impl](const HistoryStore::Record& record) {
+        impl->history.append(impl->formatter.format(static_cast<std::time_t>(record.time_ms / 1000), record.sender,
+                                                    record.body, (record.flags & HistoryStore::SELF) != 0));
+        return true;
+    });
+    pImpl->window->flush();
+    pImpl->message_display->scroll_to_end();
+}
+
+void ChatWindow::set_search_index(const SearchIndex* index) {
+    pImpl->search_index = index;
+    if (index) {
+        pImpl->search_field->activate();
     } else {
-        formatted_message = time_str.str() + sender + ": " + message + "\n";
+        pImpl->search_field->value("");
+        pImpl->end_search();
+        pImpl->search_field->deactivate();
     }
-    
-    // Add to buffer
-    pImpl->message_buffer->append(formatted_message.c_str());
-    
-    // Scroll to end
-    pImpl->message_display->scroll(
-        pImpl->message_buffer->count_lines(0, pImpl->message_buffer->length()),
-        0
-    );
 }
 
 void ChatWindow::set_on_send_callback(std::function<void(const std::string&)> callback) {
@@ -1,7 +1,15 @@
 #pragma once
 
+#include "../core/chat_message.h"
+
 #include <FL/Fl_Group.H>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include <string>
+
+class HistoryStore;
+class SearchIndex;
 
 class ChatWindow : public Fl_Group {
 public:
@@ -9,8 +17,17 @@ public:
     virtual ~ChatWindow();
     
     void add_message(const std::string& sender, const std::string& message, bool is_self = false);
+    // Appends a batch with one buffer update, one scroll and one redraw
+    void add_messages(const ChatMessage* messages, size_t count);
     void set_on_send_callback(std::function<void(const std::string&)> callback);
 
+    // Messages the user sends are logged to the store under channel
+    void set_history_store(HistoryStore* store, const std::string& channel);
+    // Shows the last count stored messages, oldest first
+    void restore_history(const HistoryStore& store, size_t count);
+    // Enables the search field; hits are read back from the history store
+    void set_search_index(const SearchIndex* index);
+
 private:
     class Impl;
     std::unique_ptr<Impl> pImpl;
@@ -0,0 +1,75 @@
+#include "level_meter_widget.h"
+
+#include <FL/fl_draw.H>
+
+#include <algorithm>
+#include <cmath>
+
+LevelMeterWidget::LevelMeterWidget(int x, int y, int w, int h, const char* label)
+    : Fl_Widget(x, y, w, h, label) {
+    color(FL_BACKGROUND_COLOR);
+    selection_color(FL_GREEN);
+}
+
+void LevelMeterWidget::set_reading(const LevelMeter::Reading& reading) {
+    float rms_db = LevelMeter::kFloorDb;
+    float peak_db = LevelMeter::kFloorDb;
+    if (reading.frames) {
+        rms_db = LevelMeter::to_db(reading.rms);
+        peak_db = LevelMeter::to_db(reading.peak);
+    }
+    // The hold is kept by the audio thread and outlives a stopped stream
+    float hold_db = reading.frames ? LevelMeter::to_db(reading.peak_hold) : LevelMeter::kFloorDb;
+
+    if (std::fabs(rms_db - rms_db_) < kRedrawDb &&
+        std::fabs(peak_db - peak_db_) < kRedrawDb &&
+        std::fabs(hold_db - hold_db_) < kRedrawDb) {
+        return;
+    }
+    rms_db_ = rms_db;
+    peak_db_ = peak_db;
+    hold_db_ = hold_db;
+    redraw();
+}
+
+int LevelMeterWidget::db_to_x(float db) const {
+    float fraction = (std::min(db, 0.0f) - LevelMeter::kFloorDb) / -LevelMeter::kFloorDb;
+    return x() + static_cast<int>(std::lround(fraction * static_cast<float>(w())));
+}
+
+void LevelMeterWidget::draw() {
+    fl_color(color());
+    fl_rectf(x(), y(), w(), h());
+
+    // Zones up to the level, so the bar turns at the same place every time
+    auto draw_bar = [this](float db, int top, int height) {
+        const int end = db_to_x(db);
+        const int warn = db_to_x(kWarnDb);
+        const int hot = db_to_x(kHotDb);
+        fl_color(selection_color());
+        fl_rectf(x(), top, std::min(end, warn) - x(), height);
+        if (end > warn) {
+            fl_color(FL_YELLOW);
+            fl_rectf(warn, top, std::min(end, hot) - warn, height);
+        }
+        if (end > hot) {
+            fl_color(FL_RED);
+            fl_rectf(hot, top, end - hot, height);
+        }
+    };
+    // Peak as a strip along the bottom, RMS above it
+    const int strip = std::max(2, h() / 4);
+    draw_bar(peak_db_, y() + h() - strip, strip);
+    draw_bar(rms_db_, y(), h() - strip);
+
+    if (hold_db_ > LevelMeter::kFloorDb) {
+        fl_color(hold_db_ > kHotDb ? FL_RED : FL_BLACK);
+        fl_yxline(std::min(db_to_x(hold_db_), x() + w() - 1), y(), y() + h() - 1);
+    }
+
+    // Ticks every 10 dB
+    fl_color(FL_DARK3);
+    for (float db = LevelMeter::kFloorDb + 10.0f; db < 0.0f; db += 10.0f) {
+        fl_yxline(db_to_x(db), y() + h() - 3, y() + h() - 1);
+    }
+}
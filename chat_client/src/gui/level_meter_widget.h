@@ -0,0 +1,33 @@
+#pragma once
+
+#include <FL/Fl_Widget.H>
+
+#include "../audio/level_meter.h"
+
+// Horizontal meter on a dB scale from LevelMeter::kFloorDb to 0 dBFS: a bar
+// for the RMS, a thinner one for the peak and a line at the peak hold.
+// The bar goes from the widget's colour to yellow at kWarnDb and red at
+// kHotDb.
+class LevelMeterWidget : public Fl_Widget {
+public:
+    static constexpr float kWarnDb = -18.0f;
+    static constexpr float kHotDb = -6.0f;
+    // Smaller moves than this are not redrawn
+    static constexpr float kRedrawDb = 0.5f;
+
+    LevelMeterWidget(int x, int y, int w, int h, const char* label = nullptr);
+
+    // Shows a reading; one with no frames reads as silence. Redraws only
+    // if something moved by kRedrawDb or more.
+    void set_reading(const LevelMeter::Reading& reading);
+
+protected:
+    void draw() override;
+
+private:
+    int db_to_x(float db) const;
+
+    float rms_db_ = LevelMeter::kFloorDb;
+    float peak_db_ = LevelMeter::kFloorDb;
+    float hold_db_ = LevelMeter::kFloorDb;
+};
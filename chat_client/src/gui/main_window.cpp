@@ -1,41 +1,84 @@
 #include "main_window.h"
 #include "chat_window.h"
 #include "audio_controls.h"
+#include "level_meter_widget.h"
+#include "spectrogram_widget.h"
+#include "waveform_widget.h"
 #include "../audio/audio_engine.h"
+#include "../audio/capture_consumer.h"
+#include "../audio/waveform_pyramid.h"
+#include "../dsp/spectrogram.h"
 
 #include <FL/Fl.H>
 #include <FL/Fl_Tabs.H>
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Box.H>
 #include <FL/Fl_Button.H>
-#include <FL/Fl_Progress.H>
 #include <FL/Fl_Choice.H>
 #include <FL/fl_draw.H>
 
 class MainWindow::Impl {
 public:
-    AudioEngine* audio_engine;
+    AudioEngine* audio_engine = nullptr;
     Fl_Tabs* tabs;
     ChatWindow* chat_window;
+    Fl_Group* audio_group;
+    Fl_Box* audio_status;  // Until attach_audio()
     AudioControls* audio_controls;
-    Fl_Progress* input_level_meter;
-    Fl_Progress* output_level_meter;
-    Fl_Choice* device_selector;
+    LevelMeterWidget* input_level_meter;
+    LevelMeterWidget* output_level_meter;
+    Fl_Choice* device_selector = nullptr;
+    std::vector<int> device_ids;  // Of the selector's entries
+    std::function<void(int)> device_selected;
     Fl_Button* connect_button;
+    Fl_Group* scope_group;
+    WaveformWidget* waveform;
+    SpectrogramWidget* spectrogram_view;
+    
+    // Fed by the scope consumer's thread, drawn from the UI thread
+    WaveformPyramid waveform_history;
+    Spectrogram spectrogram;
+    std::unique_ptr<CaptureConsumer> scope_consumer;
+    
+    std::function<void()> first_frame;
+    
+    // Each tick takes everything metered since the last, so the rate only
+    // sets how smooth the meters look
+    static constexpr double kMeterInterval = 1.0 / 30.0;
+    // The scope draws only the columns that arrived since the last tick
+    static constexpr double kScopeInterval = 1.0 / 60.0;
     
     static void timer_callback(void* user_data) {
-        auto* window = static_cast<MainWindow*>(user_data);
-        window->update_audio_levels(
-            window->pImpl->audio_engine->get_input_level(),
-            window->pImpl->audio_engine->get_output_level()
-        );
-        Fl::repeat_timeout(0.05, timer_callback, user_data); // 50ms refresh rate
+        auto* self = static_cast<Impl*>(user_data);
+        self->input_level_meter->set_reading(self->audio_engine->input_meter().take());
+        self->output_level_meter->set_reading(self->audio_engine->output_meter().take());
+        Fl::repeat_timeout(kMeterInterval, timer_callback, user_data);
+    }
+    
+    static void scope_timer_callback(void* user_data) {
+        auto* self = static_cast<Impl*>(user_data);
+        // A hidden tab costs nothing; showing it redraws it in full
+        if (self->scope_group->visible_r()) {
+            self->waveform->update();
+            self->spectrogram_view->update();
+        }
+        Fl::repeat_timeout(kScopeInterval, scope_timer_callback, user_data);
     }
     
     static void device_changed_cb(Fl_Widget* w, void* user_data) {
         auto* self = static_cast<Impl*>(user_data);
-        int device_id = self->device_selector->value();
-        self->audio_engine->open_device(device_id);
+        int entry = self->device_selector->value();
+        if (entry < 0 || static_cast<size_t>(entry) >= self->device_ids.size()) {
+            return;
+        }
+        int device_id = self->device_ids[static_cast<size_t>(entry)];
+        if (self->device_selected) {
+            // Until set_devices() says how the switch went
+            self->device_selector->deactivate();
+            self->device_selected(device_id);
+        } else {
+            self->audio_engine->open_device(device_id);
+        }
     }
     
     static void connect_clicked_cb(Fl_Widget* w, void* user_data) {
@@ -52,12 +95,10 @@ public:
     }
 };
 
-MainWindow::MainWindow(const char* title, int width, int height, AudioEngine* audio_engine)
+MainWindow::MainWindow(const char* title, int width, int height)
     : Fl_Double_Window(width, height, title),
       pImpl(std::make_unique<Impl>()) {
     
-    pImpl->audio_engine = audio_engine;
-    
     begin();
     
     // Create tabs layout
@@ -70,8 +111,73 @@ MainWindow::MainWindow(const char* title, int width, int height, AudioEngine* au
     pImpl->chat_window = new ChatWindow(15, 40, width-30, height-100);
     chat_group->end();
     
-    // Audio tab
-    Fl_Group* audio_group = new Fl_Group(10, 35, width-20, height-45, "Audio");
+    // Audio tab, filled in by attach_audio()
+    pImpl->audio_group = new Fl_Group(10, 35, width-20, height-45, "Audio");
+    pImpl->audio_group->begin();
+    pImpl->audio_status = new Fl_Box(width/2-150, height/2-15, 300, 30, "Starting audio...");
+    pImpl->audio_group->end();
+    
+    // Scope tab: the input waveform, scrollable back through its history,
+    // over a scrolling spectrogram
+    pImpl->scope_group = new Fl_Group(10, 35, width-20, height-45, "Scope");
+    pImpl->scope_group->begin();
+    pImpl->waveform = new WaveformWidget(20, 45, width-40, (height-65)/2);
+    pImpl->waveform->tooltip("Wheel to zoom, drag to scroll back, double click for live");
+    pImpl->waveform->set_source(&pImpl->waveform_history);
+    pImpl->spectrogram_view = new SpectrogramWidget(20, 55+(height-65)/2, width-40, height-75-(height-65)/2);
+    pImpl->spectrogram_view->set_source(&pImpl->spectrogram);
+    pImpl->scope_group->end();
+    
+    // Settings tab
+    Fl_Group* settings_group = new Fl_Group(10, 35, width-20, height-45, "Settings");
+    settings_group->begin();
+    new Fl_Box(width/2-100, height/2-15, 200, 30, "Settings Panel (To Be Implemented)");
+    settings_group->end();
+    
+    pImpl->tabs->end();
+    end();
+    
+    // The scope sees all of the input, gated or not, at its own rate, once
+    // there is an engine to feed it
+    Impl* impl = pImpl.get();
+    pImpl->scope_consumer = std::make_unique<CaptureConsumer>(
+        "scope",
+        [impl](const AudioBlock& block) {
+            impl->waveform_history.append(block.samples, block.frames);
+            impl->spectrogram.push(block.samples, block.frames);
+        });
+    pImpl->scope_consumer->start();
+    Fl::add_timeout(Impl::kScopeInterval, Impl::scope_timer_callback, pImpl.get());
+}
+
+MainWindow::~MainWindow() {
+    Fl::remove_timeout(Impl::timer_callback, pImpl.get());
+    Fl::remove_timeout(Impl::scope_timer_callback, pImpl.get());
+    if (pImpl->audio_engine) {
+        pImpl->audio_engine->remove_capture_consumer(pImpl->scope_consumer.get());
+    }
+    pImpl->scope_consumer->stop();
+}
+
+ChatWindow* MainWindow::chat_window() const {
+    return pImpl->chat_window;
+}
+
+void MainWindow::attach_audio(AudioEngine* audio_engine, const std::vector<AudioEngine::AudioDevice>& devices,
+                              int open_device) {
+    if (!audio_engine) {
+        pImpl->audio_status->label("No audio available");
+        pImpl->audio_group->redraw();
+        return;
+    }
+    pImpl->audio_engine = audio_engine;
+    
+    Fl_Group* audio_group = pImpl->audio_group;
+    audio_group->remove(pImpl->audio_status);
+    Fl::delete_widget(pImpl->audio_status);
+    pImpl->audio_status = nullptr;
+    const int width = w();
+    const int height = h();
     audio_group->begin();
     
     // Audio device selector
@@ -85,91 +191,60 @@ MainWindow::MainWindow(const char* title, int width, int height, AudioEngine* au
     
     // Audio level meters
     new Fl_Box(20, 120, 100, 25, "Input Level:");
-    pImpl->input_level_meter = new Fl_Progress(130, 120, width-160, 25);
-    pImpl->input_level_meter->minimum(0.0);
-    pImpl->input_level_meter->maximum(1.0);
-    pImpl->input_level_meter->color(FL_BACKGROUND_COLOR);
+    pImpl->input_level_meter = new LevelMeterWidget(130, 120, width-160, 25);
     pImpl->input_level_meter->selection_color(FL_GREEN);
     
     new Fl_Box(20, 155, 100, 25, "Output Level:");
-    pImpl->output_level_meter = new Fl_Progress(130, 155, width-160, 25);
-    pImpl->output_level_meter->minimum(0.0);
-    pImpl->output_level_meter->maximum(1.0);
-    pImpl->output_level_meter->color(FL_BACKGROUND_COLOR);
+    pImpl->output_level_meter = new LevelMeterWidget(130, 155, width-160, 25);
     pImpl->output_level_meter->selection_color(FL_BLUE);
     
     // Audio controls
     pImpl->audio_controls = new AudioControls(20, 190, width-40, height-230, audio_engine);
     
     audio_group->end();
+    audio_group->redraw();
     
-    // Settings tab
-    Fl_Group* settings_group = new Fl_Group(10, 35, width-20, height-45, "Settings");
-    settings_group->begin();
-    new Fl_Box(width/2-100, height/2-15, 200, 30, "Settings Panel (To Be Implemented)");
-    settings_group->end();
-    
-    pImpl->tabs->end();
-    end();
+    set_devices(devices, open_device);
     
-    // Populate device list
-    auto devices = audio_engine->get_devices();
+    // Levels are taken from the UI timer; widgets must not be touched from
+    // the audio thread
+    Fl::add_timeout(Impl::kMeterInterval, Impl::timer_callback, pImpl.get());
+    audio_engine->add_monitor_consumer(pImpl->scope_consumer.get(), pImpl->waveform_history.sample_rate());
+}
+
+void MainWindow::set_devices(const std::vector<AudioEngine::AudioDevice>& devices, int open_device) {
+    Fl_Choice* selector = pImpl->device_selector;
+    if (!selector) {
+        return;
+    }
+    selector->clear();
+    pImpl->device_ids.clear();
     for (const auto& device : devices) {
         if (device.max_input_channels > 0 && device.max_output_channels > 0) {
-            pImpl->device_selector->add(device.name.c_str(), 0, nullptr, &device.id, 0);
-            if (device.is_default) {
-                pImpl->device_selector->value(pImpl->device_selector->size() - 1);
-            }
-        }
-    }
-    
-    // Set callbacks
-    audio_engine->set_level_callback([this](float input, float output) {
-        update_audio_levels(input, output);
-    });
-    
-    // Start UI update timer
-    Fl::add_timeout(0.05, Impl::timer_callback, this);
-    
-    // Try to open default audio device
-    if (!devices.empty()) {
-        int default_device_id = 0;
-        for (const auto& device : devices) {
-            if (device.is_default && device.max_input_channels > 0 && device.max_output_channels > 0) {
-                default_device_id = device.id;
-                break;
+            selector->add(device.name.c_str(), 0, nullptr);
+            pImpl->device_ids.push_back(device.id);
+            if (device.id == open_device) {
+                selector->value(selector->size() - 1);
             }
         }
-        audio_engine->open_device(default_device_id);
     }
+    selector->activate();
+    selector->redraw();
 }
 
-MainWindow::~MainWindow() {
-    Fl::remove_timeout(Impl::timer_callback, this);
+void MainWindow::on_device_selected(std::function<void(int)> callback) {
+    pImpl->device_selected = std::move(callback);
 }
 
-void MainWindow::update_audio_levels(float input_level, float output_level) {
-    // Scale levels for better visualization (logarithmic scaling)
-    constexpr float scale_factor = 5.0f;
-    float input_scaled = std::min(1.0f, input_level * scale_factor);
-    float output_scaled = std::min(1.0f, output_level * scale_factor);
-    
-    pImpl->input_level_meter->value(input_scaled);
-    pImpl->output_level_meter->value(output_scaled);
-    
-    // Change color based on level
-    if (input_scaled > 0.8f) {
-        pImpl->input_level_meter->selection_color(FL_RED);
-    } else {
-        pImpl->input_level_meter->selection_color(FL_GREEN);
-    }
-    
-    if (output_scaled > 0.8f) {
-        pImpl->output_level_meter->selection_color(FL_RED);
-    } else {
-        pImpl->output_level_meter->selection_color(FL_BLUE);
+void MainWindow::on_first_frame(std::function<void()> callback) {
+    pImpl->first_frame = std::move(callback);
+}
+
+void MainWindow::draw() {
+    Fl_Double_Window::draw();
+    if (pImpl->first_frame) {
+        auto callback = std::move(pImpl->first_frame);
+        pImpl->first_frame = nullptr;
+        callback();
     }
-    
-    pImpl->input_level_meter->redraw();
-    pImpl->output_level_meter->redraw();
 }
@@ -1,16 +1,42 @@
 #pragma once
 
 #include <FL/Fl_Double_Window.H>
+#include <functional>
 #include <memory>
+#include <vector>
 
-class AudioEngine;
+#include "../audio/audio_engine.h"
+
+class ChatWindow;
 
 class MainWindow : public Fl_Double_Window {
 public:
-    MainWindow(const char* title, int width, int height, AudioEngine* audio_engine);
+    // Shows without audio; the Audio tab fills in once attach_audio() is
+    // called, so the window need not wait for the sound card
+    MainWindow(const char* title, int width, int height);
     virtual ~MainWindow();
 
-    void update_audio_levels(float input_level, float output_level);
+    ChatWindow* chat_window() const;
+
+    // UI thread, once. devices are those of the initialized engine and
+    // open_device the one it has open, -1 for none; a null engine leaves
+    // the window without audio.
+    void attach_audio(AudioEngine* audio_engine, const std::vector<AudioEngine::AudioDevice>& devices,
+                      int open_device);
+
+    // UI thread, after attach_audio(). Fills the device selector again, as
+    // after a hotplug or a switch, and lets it be used again.
+    void set_devices(const std::vector<AudioEngine::AudioDevice>& devices, int open_device);
+    // Called with the device picked in the selector, which stays disabled
+    // until the next set_devices(). Without a callback the device is
+    // opened there and then.
+    void on_device_selected(std::function<void(int)> callback);
+
+    // Runs once, after the window is first drawn
+    void on_first_frame(std::function<void()> callback);
+
+protected:
+    void draw() override;
 
 private:
     class Impl;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <FL/Fl.H>
+#include <FL/x.H>
+
+// Offscreen image of a widget that scrolls left a column at a time.
+//
+// New columns are drawn at the write position, which wraps around the
+// buffer; blit() copies the part after it and then the part before it, so
+// the oldest column lands on the left without any pixels being moved.
+// Drawing a frame therefore costs the new columns plus one copy.
+class ScrollBuffer {
+public:
+    ScrollBuffer() = default;
+    ~ScrollBuffer() { release(); }
+
+    ScrollBuffer(const ScrollBuffer&) = delete;
+    ScrollBuffer& operator=(const ScrollBuffer&) = delete;
+
+    // Makes the buffer w x h; true if it had to be created, in which case
+    // everything must be drawn again
+    bool resize(int w, int h) {
+        if (offscreen_ && w == w_ && h == h_) {
+            return false;
+        }
+        release();
+        w_ = w;
+        h_ = h;
+        write_ = 0;
+        offscreen_ = fl_create_offscreen(w, h);
+        return true;
+    }
+
+    Fl_Offscreen offscreen() const { return offscreen_; }
+    int width() const { return w_; }
+    int height() const { return h_; }
+
+    // Buffer x of the i-th column from the write position
+    int column_x(int i) const { return (write_ + i) % w_; }
+    void advance(int columns) { write_ = (write_ + columns) % w_; }
+    // Column 0 goes to the left edge again, after a full redraw
+    void rewind() { write_ = 0; }
+
+    void blit(int x, int y) const {
+        fl_copy_offscreen(x, y, w_ - write_, h_, offscreen_, write_, 0);
+        if (write_) {
+            fl_copy_offscreen(x + w_ - write_, y, write_, h_, offscreen_, 0, 0);
+        }
+    }
+
+private:
+    void release() {
+        if (offscreen_) {
+            fl_delete_offscreen(offscreen_);
+            offscreen_ = 0;
+        }
+    }
+
+    Fl_Offscreen offscreen_ = 0;
+    int w_ = 0;
+    int h_ = 0;
+    int write_ = 0;
+};
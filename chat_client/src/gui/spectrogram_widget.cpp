@@ -0,0 +1,146 @@
+#include "spectrogram_widget.h"
+
+#include <FL/Fl.H>
+#include <FL/fl_draw.H>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+namespace {
+
+// Black through blue, magenta and orange to pale yellow
+struct PaletteStop {
+    float at;
+    float r, g, b;
+};
+constexpr PaletteStop kPalette[] = {
+    { 0.00f,   0.0f,   0.0f,   0.0f },
+    { 0.30f,  20.0f,  10.0f, 120.0f },
+    { 0.55f, 160.0f,  20.0f, 140.0f },
+    { 0.80f, 250.0f, 130.0f,  20.0f },
+    { 1.00f, 255.0f, 250.0f, 190.0f },
+};
+
+} // namespace
+
+SpectrogramWidget::SpectrogramWidget(int x, int y, int w, int h, const char* label)
+    : Fl_Widget(x, y, w, h, label) {
+    color(FL_BLACK);
+    for (size_t level = 0; level < 256; ++level) {
+        float at = static_cast<float>(level) / 255.0f;
+        size_t stop = 1;
+        while (kPalette[stop].at < at) {
+            ++stop;
+        }
+        const PaletteStop& lo = kPalette[stop - 1];
+        const PaletteStop& hi = kPalette[stop];
+        float t = (at - lo.at) / (hi.at - lo.at);
+        palette_[3 * level] = static_cast<unsigned char>(lo.r + (hi.r - lo.r) * t);
+        palette_[3 * level + 1] = static_cast<unsigned char>(lo.g + (hi.g - lo.g) * t);
+        palette_[3 * level + 2] = static_cast<unsigned char>(lo.b + (hi.b - lo.b) * t);
+    }
+}
+
+void SpectrogramWidget::set_source(const Spectrogram* spectrogram) {
+    spectrogram_ = spectrogram;
+    redraw();
+}
+
+void SpectrogramWidget::update() {
+    if (!spectrogram_) {
+        return;
+    }
+    uint64_t columns = spectrogram_->columns();
+    if (columns < drawn_column_) {
+        // Cleared
+        redraw();
+    } else if (columns != drawn_column_) {
+        damage(FL_DAMAGE_USER1);
+    }
+}
+
+void SpectrogramWidget::map_rows() {
+    const size_t bins = spectrogram_ ? spectrogram_->bins() : 1;
+    const size_t rows = static_cast<size_t>(h());
+    row_bins_.resize(rows);
+    for (size_t row = 0; row < rows; ++row) {
+        size_t from_bottom = rows - 1 - row;
+        size_t begin = from_bottom * bins / rows;
+        size_t end = std::max(begin + 1, (from_bottom + 1) * bins / rows);
+        row_bins_[row] = { begin, end };
+    }
+}
+
+void SpectrogramWidget::draw_columns(uint64_t first, int count) {
+    const size_t bins = spectrogram_ ? spectrogram_->bins() : 0;
+    const int height = buffer_.height();
+    levels_.assign(static_cast<size_t>(count) * bins, 0);
+    if (spectrogram_) {
+        // Columns no longer held stay at the floor
+        size_t copied = spectrogram_->read_columns(first, static_cast<size_t>(count), levels_.data());
+        size_t missing = static_cast<size_t>(count) - copied;
+        if (missing && copied) {
+            std::memmove(levels_.data() + missing * bins, levels_.data(), copied * bins);
+            std::fill(levels_.begin(), levels_.begin() + static_cast<ptrdiff_t>(missing * bins), 0);
+        }
+    }
+
+    fl_begin_offscreen(buffer_.offscreen());
+    // One image per run of slots up to the wrap
+    int done = 0;
+    while (done < count) {
+        const int slot = buffer_.column_x(done);
+        const int run = std::min(count - done, buffer_.width() - slot);
+        image_.resize(static_cast<size_t>(run) * height * 3);
+        for (int row = 0; row < height; ++row) {
+            const auto& range = row_bins_[static_cast<size_t>(row)];
+            unsigned char* pixel = image_.data() + static_cast<size_t>(row) * run * 3;
+            for (int i = 0; i < run; ++i, pixel += 3) {
+                const uint8_t* column = levels_.data() + static_cast<size_t>(done + i) * bins;
+                uint8_t level = 0;
+                for (size_t bin = range.first; bin < range.second && bin < bins; ++bin) {
+                    level = std::max(level, column[bin]);
+                }
+                std::memcpy(pixel, &palette_[3 * level], 3);
+            }
+        }
+        fl_draw_image(image_.data(), slot, 0, run, height, 3);
+        done += run;
+    }
+    fl_end_offscreen();
+}
+
+void SpectrogramWidget::draw() {
+    if (w() <= 0 || h() <= 0) {
+        return;
+    }
+    const bool full = buffer_.resize(w(), h()) || (damage() & FL_DAMAGE_ALL) ||
+                      row_bins_.size() != static_cast<size_t>(h());
+    if (full) {
+        map_rows();
+    }
+
+    const uint64_t newest = spectrogram_ ? spectrogram_->columns() : 0;
+    if (full || newest < drawn_column_ || newest - drawn_column_ >= static_cast<uint64_t>(w())) {
+        // The view ends at the newest column; before the first it is blank
+        buffer_.rewind();
+        const uint64_t first = newest - std::min<uint64_t>(newest, static_cast<uint64_t>(w()));
+        const int blank = w() - static_cast<int>(newest - first);
+        if (blank) {
+            fl_begin_offscreen(buffer_.offscreen());
+            fl_color(color());
+            fl_rectf(0, 0, blank, h());
+            fl_end_offscreen();
+            buffer_.advance(blank);
+        }
+        draw_columns(first, w() - blank);
+        buffer_.advance(w() - blank);
+    } else if (newest > drawn_column_) {
+        const int fresh = static_cast<int>(newest - drawn_column_);
+        draw_columns(drawn_column_, fresh);
+        buffer_.advance(fresh);
+    }
+    drawn_column_ = newest;
+    buffer_.blit(x(), y());
+}
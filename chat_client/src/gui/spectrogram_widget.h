@@ -0,0 +1,42 @@
+#pragma once
+
+#include <FL/Fl_Widget.H>
+
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "scroll_buffer.h"
+#include "../dsp/spectrogram.h"
+
+// Scrolling spectrogram of a Spectrogram, one column per hop, low
+// frequencies at the bottom. Each update() draws only the columns that
+// arrived since the last, as one image, and scrolls the rest through a
+// ScrollBuffer.
+class SpectrogramWidget : public Fl_Widget {
+public:
+    SpectrogramWidget(int x, int y, int w, int h, const char* label = nullptr);
+
+    // Not owned; may be fed from another thread
+    void set_source(const Spectrogram* spectrogram);
+
+    // From the UI timer: damages the widget if there are new columns to draw
+    void update();
+
+protected:
+    void draw() override;
+
+private:
+    // Columns [first, first + count) into buffer slots from the write position
+    void draw_columns(uint64_t first, int count);
+    void map_rows();
+
+    const Spectrogram* spectrogram_ = nullptr;
+    ScrollBuffer buffer_;
+    std::array<unsigned char, 256 * 3> palette_{};
+    std::vector<std::pair<size_t, size_t>> row_bins_;  // Bins shown on each row, top first
+    std::vector<uint8_t> levels_;
+    std::vector<unsigned char> image_;
+    uint64_t drawn_column_ = 0;  // One past the newest column in the buffer
+};
@@ -0,0 +1,155 @@
+#include "waveform_widget.h"
+
+#include <FL/Fl.H>
+#include <FL/fl_draw.H>
+
+#include <algorithm>
+#include <cmath>
+
+WaveformWidget::WaveformWidget(int x, int y, int w, int h, const char* label)
+    : Fl_Widget(x, y, w, h, label) {
+    color(FL_BLACK);
+    selection_color(FL_GREEN);
+}
+
+void WaveformWidget::set_source(const WaveformPyramid* pyramid) {
+    pyramid_ = pyramid;
+    seen_frames_ = 0;
+    redraw();
+}
+
+void WaveformWidget::set_frames_per_pixel(double frames_per_pixel) {
+    frames_per_pixel_ = std::clamp(std::exp2(std::round(std::log2(frames_per_pixel))),
+                                   1.0, kMaxFramesPerPixel);
+    redraw();
+}
+
+void WaveformWidget::go_live() {
+    live_ = true;
+    redraw();
+}
+
+int64_t WaveformWidget::newest_column() const {
+    return pyramid_ ? static_cast<int64_t>(pyramid_->total_frames() / frames_per_pixel_) : 0;
+}
+
+void WaveformWidget::update() {
+    if (!pyramid_) {
+        return;
+    }
+    uint64_t frames = pyramid_->total_frames();
+    if (frames < seen_frames_) {
+        // Cleared
+        redraw();
+    } else if (live_ && static_cast<int64_t>(frames / frames_per_pixel_) != drawn_column_) {
+        damage(FL_DAMAGE_USER1);
+    }
+    seen_frames_ = frames;
+}
+
+int WaveformWidget::handle(int event) {
+    switch (event) {
+        case FL_ENTER:
+        case FL_LEAVE:
+            return 1;
+        case FL_MOUSEWHEEL:
+            if (Fl::event_dy()) {
+                zoom(Fl::event_dy() > 0 ? 2.0 : 0.5, Fl::event_x() - x());
+            }
+            return 1;
+        case FL_PUSH:
+            drag_x_ = Fl::event_x();
+            if (Fl::event_clicks()) {
+                go_live();
+            }
+            return 1;
+        case FL_DRAG:
+            if (Fl::event_x() != drag_x_) {
+                pan(drag_x_ - Fl::event_x());
+                drag_x_ = Fl::event_x();
+            }
+            return 1;
+        default:
+            return Fl_Widget::handle(event);
+    }
+}
+
+void WaveformWidget::zoom(double factor, int anchor) {
+    double fpp = std::clamp(frames_per_pixel_ * factor, 1.0, kMaxFramesPerPixel);
+    if (fpp == frames_per_pixel_) {
+        return;
+    }
+    // Keep the frame under the mouse where it is
+    int64_t first = live_ ? newest_column() - w() : first_column_;
+    double anchor_frame = static_cast<double>(first + anchor) * frames_per_pixel_;
+    frames_per_pixel_ = fpp;
+    first_column_ = static_cast<int64_t>(anchor_frame / fpp) - anchor;
+    redraw();
+}
+
+void WaveformWidget::pan(int64_t columns) {
+    if (live_) {
+        first_column_ = newest_column() - w();
+        live_ = false;
+    }
+    first_column_ += columns;
+    if (first_column_ + w() >= newest_column()) {
+        live_ = true;
+    }
+    redraw();
+}
+
+void WaveformWidget::draw_columns(int64_t first, int count) {
+    envelope_.resize(static_cast<size_t>(count));
+    if (pyramid_) {
+        pyramid_->envelope(static_cast<int64_t>(static_cast<double>(first) * frames_per_pixel_),
+                           frames_per_pixel_, envelope_.data(), envelope_.size());
+    } else {
+        std::fill(envelope_.begin(), envelope_.end(), WaveformPyramid::Column());
+    }
+
+    const int height = buffer_.height();
+    const int middle = height / 2;
+    const float scale = static_cast<float>(height - 1) * 0.5f;
+    fl_begin_offscreen(buffer_.offscreen());
+    for (int i = 0; i < count; ++i) {
+        const int column = buffer_.column_x(i);
+        fl_color(color());
+        fl_yxline(column, 0, height - 1);
+        const WaveformPyramid::Column& c = envelope_[static_cast<size_t>(i)];
+        if (c.valid) {
+            fl_color(selection_color());
+            fl_yxline(column, middle - static_cast<int>(std::lround(c.max * scale)),
+                      middle - static_cast<int>(std::lround(c.min * scale)));
+        } else {
+            fl_color(FL_DARK3);
+            fl_point(column, middle);
+        }
+    }
+    fl_end_offscreen();
+}
+
+void WaveformWidget::draw() {
+    if (w() <= 0 || h() <= 0) {
+        return;
+    }
+    const bool full = buffer_.resize(w(), h()) || (damage() & FL_DAMAGE_ALL);
+
+    if (live_) {
+        const int64_t newest = newest_column();
+        const int64_t fresh = newest - drawn_column_;
+        if (full || fresh < 0 || fresh >= w()) {
+            buffer_.rewind();
+            draw_columns(newest - w(), w());
+        } else if (fresh > 0) {
+            draw_columns(drawn_column_, static_cast<int>(fresh));
+            buffer_.advance(static_cast<int>(fresh));
+        }
+        drawn_column_ = newest;
+    } else if (full) {
+        buffer_.rewind();
+        draw_columns(first_column_, w());
+        drawn_column_ = first_column_ + w();
+    }
+    buffer_.blit(x(), y());
+}
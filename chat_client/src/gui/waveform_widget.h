@@ -0,0 +1,58 @@
+#pragma once
+
+#include <FL/Fl_Widget.H>
+
+#include <cstdint>
+#include <vector>
+
+#include "scroll_buffer.h"
+#include "../audio/waveform_pyramid.h"
+
+// Scrolling min/max waveform of a WaveformPyramid.
+//
+// Live, it follows the newest audio and each update() draws only the
+// columns that arrived since the last, scrolling the rest through a
+// ScrollBuffer. The wheel zooms in powers of two, dragging pans back
+// through the retained history, and a double click returns to live. A zoom
+// or pan draws every column again, which reads a few pyramid entries each
+// whatever the zoom.
+class WaveformWidget : public Fl_Widget {
+public:
+    static constexpr double kMaxFramesPerPixel = 1 << 20;
+
+    WaveformWidget(int x, int y, int w, int h, const char* label = nullptr);
+
+    // Not owned; may be fed from another thread
+    void set_source(const WaveformPyramid* pyramid);
+    // Frames a column covers, a power of two
+    void set_frames_per_pixel(double frames_per_pixel);
+    double frames_per_pixel() const { return frames_per_pixel_; }
+    bool live() const { return live_; }
+    void go_live();
+
+    // From the UI timer: damages the widget if there are new columns to draw
+    void update();
+
+    int handle(int event) override;
+
+protected:
+    void draw() override;
+
+private:
+    int64_t newest_column() const;
+    // Columns [first, first + count) of the view into buffer slots from the
+    // write position
+    void draw_columns(int64_t first, int count);
+    void zoom(double factor, int anchor);
+    void pan(int64_t columns);
+
+    const WaveformPyramid* pyramid_ = nullptr;
+    ScrollBuffer buffer_;
+    std::vector<WaveformPyramid::Column> envelope_;
+    double frames_per_pixel_ = 160.0;
+    bool live_ = true;
+    int64_t first_column_ = 0;   // Of the view when not live
+    int64_t drawn_column_ = 0;   // One past the newest column in the buffer
+    uint64_t seen_frames_ = 0;
+    int drag_x_ = 0;
+};
@@ -0,0 +1,174 @@
+#include "event_loop.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kMaxEvents = 64;
+// One turn of the wheel is about a second of 1 ms ticks
+constexpr size_t kTimerSlots = 1024;
+
+} // namespace
+
+EventLoop::EventLoop() : epoch_(Clock::now()), timers_(kTimerSlots) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wakeup_fd_ < 0) {
+        std::cerr << "Event loop setup failed: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = wakeup_fd_;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &event);
+}
+
+EventLoop::~EventLoop() {
+    if (wakeup_fd_ >= 0) {
+        close(wakeup_fd_);
+    }
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+    }
+}
+
+bool EventLoop::in_loop_thread() const {
+    return loop_thread_.load() == std::this_thread::get_id();
+}
+
+uint64_t EventLoop::current_tick() const {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - epoch_).count());
+}
+
+void EventLoop::run() {
+    if (!valid()) {
+        return;
+    }
+    loop_thread_.store(std::this_thread::get_id());
+    timers_.advance(current_tick());
+
+    epoll_event events[kMaxEvents];
+    while (!stopping_.load(std::memory_order_acquire)) {
+        int timeout = -1;
+        if (!timers_.empty()) {
+            uint64_t due = timers_.now() + timers_.ticks_to_next();
+            uint64_t now = current_tick();
+            timeout = due > now ? static_cast<int>(due - now) : 0;
+        }
+
+        int count = epoll_wait(epoll_fd_, events, static_cast<int>(kMaxEvents), timeout);
+        if (count < 0 && errno != EINTR) {
+            std::cerr << "epoll_wait failed: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        wakeups_.fetch_add(1, std::memory_order_relaxed);
+
+        for (int i = 0; i < count; ++i) {
+            int fd = events[i].data.fd;
+            if (fd == wakeup_fd_) {
+                drain_wakeup();
+                continue;
+            }
+            // An earlier handler in this batch may have removed it
+            auto it = handlers_.find(fd);
+            if (it == handlers_.end()) {
+                continue;
+            }
+            std::shared_ptr<IoHandler> handler = it->second;
+            (*handler)(events[i].events);
+        }
+
+        run_posted();
+        timers_.advance(current_tick());
+    }
+    loop_thread_.store(std::thread::id());
+}
+
+void EventLoop::stop() {
+    stopping_.store(true, std::memory_order_release);
+    uint64_t one = 1;
+    if (wakeup_fd_ >= 0) {
+        ssize_t ignored = write(wakeup_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void EventLoop::post(Task task) {
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        // The loop drains everything on each wakeup, so only the first task
+        // since the last drain needs to wake it
+        wake = posted_.empty();
+        posted_.push_back(std::move(task));
+    }
+    if (wake && wakeup_fd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t ignored = write(wakeup_fd_, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+void EventLoop::drain_wakeup() {
+    uint64_t value;
+    while (read(wakeup_fd_, &value, sizeof(value)) > 0) {
+    }
+}
+
+void EventLoop::run_posted() {
+    {
+        std::lock_guard<std::mutex> lock(posted_mutex_);
+        if (posted_.empty()) {
+            return;
+        }
+        running_tasks_.swap(posted_);
+    }
+    for (Task& task : running_tasks_) {
+        task();
+    }
+    tasks_run_.fetch_add(running_tasks_.size(), std::memory_order_relaxed);
+    running_tasks_.clear();
+}
+
+bool EventLoop::add_fd(int fd, uint32_t events, IoHandler handler) {
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+        std::cerr << "epoll_ctl add failed: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    handlers_[fd] = std::make_shared<IoHandler>(std::move(handler));
+    return true;
+}
+
+bool EventLoop::modify_fd(int fd, uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.fd = fd;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0;
+}
+
+void EventLoop::remove_fd(int fd) {
+    if (handlers_.erase(fd)) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    }
+}
+
+EventLoop::TimerId EventLoop::add_timer(unsigned int delay_ms, Task task, unsigned int interval_ms) {
+    // The wheel may lag the clock while the loop is busy, so count from
+    // now, and from the end of the current tick so no timer fires early
+    uint64_t now = current_tick();
+    uint64_t lag = now > timers_.now() ? now - timers_.now() : 0;
+    return timers_.add(lag + delay_ms + 1, std::move(task), interval_ms);
+}
+
+void EventLoop::cancel_timer(TimerId id) {
+    timers_.cancel(id);
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "timer_wheel.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Single-threaded I/O loop: epoll for file descriptors, a timer wheel with
+// a 1 ms tick, and an eventfd that wakes the loop at once for posted tasks
+// and stop().
+//
+// run() dispatches on the calling thread until stop(). post() and stop()
+// may be called from any thread; everything else belongs to the loop
+// thread, or to whoever sets the loop up before run(). Handlers run on the
+// loop thread and may add or remove descriptors and timers, their own
+// included.
+class EventLoop {
+public:
+    using IoHandler = std::function<void(uint32_t events)>; // EPOLLIN, EPOLLOUT...
+    using Task = std::function<void()>;
+    using TimerId = TimerWheel::TimerId;
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // False if epoll or the eventfd could not be created
+    bool valid() const { return epoll_fd_ >= 0 && wakeup_fd_ >= 0; }
+
+    void run();
+    // Any thread. run() returns once the handler it is in, if any, is done.
+    void stop();
+    // Any thread. Runs task on the loop thread in posting order.
+    void post(Task task);
+    bool in_loop_thread() const;
+
+    // The descriptor should be non-blocking; it is not closed by the loop
+    bool add_fd(int fd, uint32_t events, IoHandler handler);
+    bool modify_fd(int fd, uint32_t events);
+    void remove_fd(int fd);
+
+    // Fires after at least delay_ms, within a tick, then every interval_ms
+    // if it is non-zero
+    TimerId add_timer(unsigned int delay_ms, Task task, unsigned int interval_ms = 0);
+    void cancel_timer(TimerId id);
+
+    // Dispatch counters, readable from any thread
+    uint64_t wakeups() const { return wakeups_.load(std::memory_order_relaxed); }
+    uint64_t tasks_run() const { return tasks_run_.load(std::memory_order_relaxed); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    uint64_t current_tick() const;
+    void drain_wakeup();
+    void run_posted();
+
+    int epoll_fd_ = -1;
+    int wakeup_fd_ = -1;
+    std::atomic<bool> stopping_{false}; // Set once; a stopped loop stays stopped
+    std::atomic<std::thread::id> loop_thread_{};
+    Clock::time_point epoch_;
+    TimerWheel timers_;
+    // Held by shared_ptr so a handler survives removing itself
+    std::unordered_map<int, std::shared_ptr<IoHandler>> handlers_;
+
+    std::mutex posted_mutex_;
+    std::vector<Task> posted_;
+    std::vector<Task> running_tasks_;  // Swapped with posted_ each round
+
+    std::atomic<uint64_t> wakeups_{0};
+    std::atomic<uint64_t> tasks_run_{0};
+};
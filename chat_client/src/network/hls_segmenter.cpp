@@ -0,0 +1,366 @@
+#include "hls_segmenter.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr unsigned kOpusTimescale = 48000;  // Opus in ISOBMFF, as RFC 7587
+constexpr unsigned kOpusPreSkip = 312;      // libopus's lookahead at 48 kHz
+constexpr uint32_t kTrackId = 1;
+constexpr size_t kMoofBytes = 96;           // Everything in a moof but trun's sizes
+constexpr size_t kPageBytes = 4096;
+
+// Big-endian fields and boxes, appended to a std::string or byte vector
+
+template <typename Buffer>
+void put(Buffer& buffer, uint64_t value, int bytes) {
+    for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+        buffer.push_back(static_cast<typename Buffer::value_type>((value >> shift) & 0xFF));
+    }
+}
+
+template <typename Buffer>
+void put_type(Buffer& buffer, const char* type) {
+    buffer.insert(buffer.end(), type, type + 4);
+}
+
+template <typename Buffer>
+size_t begin_box(Buffer& buffer, const char* type) {
+    size_t start = buffer.size();
+    put(buffer, 0, 4);
+    put_type(buffer, type);
+    return start;
+}
+
+template <typename Buffer>
+size_t begin_full_box(Buffer& buffer, const char* type, uint8_t version, uint32_t flags) {
+    size_t start = begin_box(buffer, type);
+    put(buffer, uint32_t(version) << 24 | flags, 4);
+    return start;
+}
+
+template <typename Buffer>
+void end_box(Buffer& buffer, size_t start) {
+    uint32_t size = static_cast<uint32_t>(buffer.size() - start);
+    for (int i = 0; i < 4; ++i) {
+        buffer[start + i] = static_cast<typename Buffer::value_type>(size >> (24 - 8 * i));
+    }
+}
+
+template <typename Buffer>
+void put_matrix(Buffer& buffer) {
+    const uint32_t unity[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+    for (uint32_t value : unity) {
+        put(buffer, value, 4);
+    }
+}
+
+} // namespace
+
+HlsSegmenter::HlsSegmenter(const CodecSettings& codec, const HlsSettings& settings)
+    : settings_(settings) {
+    settings_.playlist_size = std::max(1u, settings_.playlist_size);
+    std::unique_ptr<AudioEncoder> encoder = make_audio_encoder(codec);
+    if (!encoder) {
+        return;
+    }
+    codec_name_ = encoder->name();
+    opus_ = codec_name_ == "opus";
+    sample_rate_ = encoder->sample_rate();
+    frame_samples_ = encoder->frame_samples();
+    frame_ms_ = std::max(1u, codec.frame_ms);
+    frame_ticks_ = opus_ ? frame_samples_ * (kOpusTimescale / sample_rate_) : frame_samples_;
+    frames_per_segment_ = std::max(1u, (settings_.segment_ms + frame_ms_ - 1) / frame_ms_);
+
+    // What a missing frame becomes
+    std::vector<float> zeros(frame_samples_, 0.0f);
+    silence_.resize(AudioEncoder::kMaxPacketBytes);
+    silence_.resize(encoder->encode(zeros.data(), silence_.data(), silence_.size()));
+    if (silence_.empty()) {
+        return;
+    }
+
+    const unsigned timescale = opus_ ? kOpusTimescale : sample_rate_;
+    std::string& init = init_;
+    size_t box = begin_box(init, "ftyp");
+    put_type(init, "iso6");
+    put(init, 0, 4);
+    put_type(init, "iso6");
+    put_type(init, "mp41");
+    end_box(init, box);
+
+    size_t moov = begin_box(init, "moov");
+    box = begin_full_box(init, "mvhd", 0, 0);
+    put(init, 0, 8);                  // Creation and modification times
+    put(init, 1000, 4);               // Timescale
+    put(init, 0, 4);                  // Duration: fragmented
+    put(init, 0x00010000, 4);         // Rate
+    put(init, 0x0100, 2);             // Volume
+    put(init, 0, 10);
+    put_matrix(init);
+    put(init, 0, 24);
+    put(init, kTrackId + 1, 4);       // Next track id
+    end_box(init, box);
+
+    size_t trak = begin_box(init, "trak");
+    box = begin_full_box(init, "tkhd", 0, 3);  // Enabled, in movie
+    put(init, 0, 8);
+    put(init, kTrackId, 4);
+    put(init, 0, 4);
+    put(init, 0, 4);                  // Duration
+    put(init, 0, 8);
+    put(init, 0, 4);                  // Layer, alternate group
+    put(init, 0x0100, 2);             // Volume
+    put(init, 0, 2);
+    put_matrix(init);
+    put(init, 0, 8);                  // Width, height
+    end_box(init, box);
+
+    size_t mdia = begin_box(init, "mdia");
+    box = begin_full_box(init, "mdhd", 0, 0);
+    put(init, 0, 8);
+    put(init, timescale, 4);
+    put(init, 0, 4);
+    put(init, 0x55C4, 2);             // "und"
+    put(init, 0, 2);
+    end_box(init, box);
+    box = begin_full_box(init, "hdlr", 0, 0);
+    put(init, 0, 4);
+    put_type(init, "soun");
+    put(init, 0, 12);
+    init.append("SoundHandler", 13);
+    end_box(init, box);
+
+    size_t minf = begin_box(init, "minf");
+    box = begin_full_box(init, "smhd", 0, 0);
+    put(init, 0, 4);
+    end_box(init, box);
+    size_t dinf = begin_box(init, "dinf");
+    size_t dref = begin_full_box(init, "dref", 0, 0);
+    put(init, 1, 4);
+    box = begin_full_box(init, "url ", 0, 1);  // Media in this file
+    end_box(init, box);
+    end_box(init, dref);
+    end_box(init, dinf);
+
+    size_t stbl = begin_box(init, "stbl");
+    size_t stsd = begin_full_box(init, "stsd", 0, 0);
+    put(init, 1, 4);
+    size_t entry = begin_box(init, opus_ ? "Opus" : "xadp");
+    put(init, 0, 6);
+    put(init, 1, 2);                  // Data reference index
+    put(init, 0, 8);
+    put(init, 1, 2);                  // Channels
+    put(init, 16, 2);                 // Sample size
+    put(init, 0, 4);
+    put(init, uint32_t(timescale) << 16, 4);
+    if (opus_) {
+        box = begin_box(init, "dOps");
+        put(init, 0, 1);              // Version
+        put(init, 1, 1);              // Output channels
+        put(init, kOpusPreSkip, 2);
+        put(init, codec.sample_rate, 4);
+        put(init, 0, 2);              // Output gain
+        put(init, 0, 1);              // Mapping family
+        end_box(init, box);
+    }
+    end_box(init, entry);
+    end_box(init, stsd);
+    for (const char* table : { "stts", "stsc", "stco" }) {
+        box = begin_full_box(init, table, 0, 0);
+        put(init, 0, 4);
+        end_box(init, box);
+    }
+    box = begin_full_box(init, "stsz", 0, 0);
+    put(init, 0, 8);
+    end_box(init, box);
+    end_box(init, stbl);
+    end_box(init, minf);
+    end_box(init, mdia);
+    end_box(init, trak);
+
+    size_t mvex = begin_box(init, "mvex");
+    box = begin_full_box(init, "trex", 0, 0);
+    put(init, kTrackId, 4);
+    put(init, 1, 4);                  // Sample description index
+    put(init, 0, 12);
+    end_box(init, box);
+    end_box(init, mvex);
+    end_box(init, moov);
+
+    payload_.reserve(frames_per_segment_ * AudioEncoder::kMaxPacketBytes);
+    sizes_.reserve(frames_per_segment_);
+    moof_.reserve(kMoofBytes + 4 * frames_per_segment_);
+
+    // Sparse: only the pages segments are written to take memory
+    slot_bytes_ = kMoofBytes + 8 + frames_per_segment_ * (4 + AudioEncoder::kMaxPacketBytes);
+    slot_bytes_ = (slot_bytes_ + kPageBytes - 1) / kPageBytes * kPageBytes;
+    slots_.resize(settings_.playlist_size + kSpareSegments);
+    int fd = memfd_create("hls-segments", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(slot_bytes_ * slots_.size())) != 0) {
+        std::cerr << "Cannot create the HLS segment ring: " << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    fd_ = fd;
+}
+
+HlsSegmenter::~HlsSegmenter() {
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+bool HlsSegmenter::add_frame(uint32_t timestamp, const uint8_t* data, size_t size) {
+    if (fd_ < 0) {
+        return false;
+    }
+    bool finished = false;
+    if (started_) {
+        // Frames the encoder did not send
+        int32_t behind = static_cast<int32_t>(timestamp - expected_timestamp_);
+        if (behind > 0) {
+            uint64_t missing = static_cast<uint32_t>(behind) / frame_samples_;
+            if (missing <= frames_per_segment_) {
+                for (uint64_t i = 0; i < missing; ++i) {
+                    append(silence_.data(), silence_.size());
+                    ++frames_filled_;
+                    if (sizes_.size() == frames_per_segment_) {
+                        finish_segment();
+                        finished = true;
+                    }
+                }
+            } else {
+                frames_skipped_ += missing;
+            }
+        }
+    }
+    started_ = true;
+    expected_timestamp_ = timestamp + frame_samples_;
+
+    if (size == 0 || size > AudioEncoder::kMaxPacketBytes) {
+        append(silence_.data(), silence_.size());
+    } else {
+        append(data, size);
+    }
+    if (sizes_.size() == frames_per_segment_) {
+        finish_segment();
+        finished = true;
+    }
+    return finished;
+}
+
+void HlsSegmenter::append(const uint8_t* data, size_t size) {
+    payload_.insert(payload_.end(), data, data + size);
+    sizes_.push_back(static_cast<uint32_t>(size));
+}
+
+void HlsSegmenter::finish_segment() {
+    const uint64_t sequence = next_sequence_;
+    moof_.clear();
+    size_t moof = begin_box(moof_, "moof");
+    size_t box = begin_full_box(moof_, "mfhd", 0, 0);
+    put(moof_, sequence + 1, 4);
+    end_box(moof_, box);
+    size_t traf = begin_box(moof_, "traf");
+    box = begin_full_box(moof_, "tfhd", 0, 0x020008);  // Base is moof, default duration
+    put(moof_, kTrackId, 4);
+    put(moof_, frame_ticks_, 4);
+    end_box(moof_, box);
+    box = begin_full_box(moof_, "tfdt", 1, 0);
+    put(moof_, decode_time_, 8);
+    end_box(moof_, box);
+    size_t trun = begin_full_box(moof_, "trun", 0, 0x000201);  // Data offset, sizes
+    put(moof_, sizes_.size(), 4);
+    size_t data_offset = moof_.size();
+    put(moof_, 0, 4);
+    for (uint32_t size : sizes_) {
+        put(moof_, size, 4);
+    }
+    end_box(moof_, trun);
+    end_box(moof_, traf);
+    end_box(moof_, moof);
+    // The payload follows the mdat header
+    uint32_t offset = static_cast<uint32_t>(moof_.size() + 8);
+    for (int i = 0; i < 4; ++i) {
+        moof_[data_offset + i] = static_cast<uint8_t>(offset >> (24 - 8 * i));
+    }
+    uint8_t mdat[8];
+    uint32_t mdat_size = static_cast<uint32_t>(8 + payload_.size());
+    for (int i = 0; i < 4; ++i) {
+        mdat[i] = static_cast<uint8_t>(mdat_size >> (24 - 8 * i));
+    }
+    std::memcpy(mdat + 4, "mdat", 4);
+
+    Segment& slot = slots_[sequence % slots_.size()];
+    const off_t at = static_cast<off_t>(slot_bytes_ * (sequence % slots_.size()));
+    if (sequence >= slots_.size()) {
+        // Fresh pages, so sends still in flight keep the old segment's
+        fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, at, static_cast<off_t>(slot_bytes_));
+    }
+    iovec parts[3] = {
+        { moof_.data(), moof_.size() },
+        { mdat, sizeof(mdat) },
+        { payload_.data(), payload_.size() },
+    };
+    const size_t total = moof_.size() + sizeof(mdat) + payload_.size();
+    ssize_t written = pwritev(fd_, parts, 3, at);
+    if (written != static_cast<ssize_t>(total)) {
+        std::cerr << "Cannot write HLS segment " << sequence << ": " << std::strerror(errno) << std::endl;
+    }
+    slot.sequence = sequence;
+    slot.offset = at;
+    slot.size = written == static_cast<ssize_t>(total) ? total : 0;
+    slot.frames = static_cast<unsigned>(sizes_.size());
+
+    decode_time_ += uint64_t(frame_ticks_) * sizes_.size();
+    ++next_sequence_;
+    payload_.clear();
+    sizes_.clear();
+}
+
+uint64_t HlsSegmenter::oldest_sequence() const {
+    return next_sequence_ > slots_.size() ? next_sequence_ - slots_.size() : 0;
+}
+
+bool HlsSegmenter::segment(uint64_t sequence, Segment& out) const {
+    if (fd_ < 0 || sequence >= next_sequence_ || sequence < oldest_sequence()) {
+        return false;
+    }
+    out = slots_[sequence % slots_.size()];
+    return out.size > 0;
+}
+
+std::string HlsSegmenter::segment_name(uint64_t sequence) {
+    return "seg" + std::to_string(sequence) + ".m4s";
+}
+
+std::string HlsSegmenter::playlist() const {
+    const unsigned target = (frames_per_segment_ * frame_ms_ + 999) / 1000;
+    const uint64_t first = next_sequence_ > settings_.playlist_size ? next_sequence_ - settings_.playlist_size : 0;
+    std::string text;
+    text += "#EXTM3U\n#EXT-X-VERSION:7\n#EXT-X-TARGETDURATION:";
+    text += std::to_string(target);
+    text += "\n#EXT-X-MEDIA-SEQUENCE:";
+    text += std::to_string(first);
+    text += "\n#EXT-X-INDEPENDENT-SEGMENTS\n#EXT-X-MAP:URI=\"init.mp4\"\n";
+    for (uint64_t sequence = first; sequence < next_sequence_; ++sequence) {
+        const Segment& slot = slots_[sequence % slots_.size()];
+        char duration[32];
+        std::snprintf(duration, sizeof(duration), "#EXTINF:%.3f,\n", slot.frames * frame_ms_ / 1000.0);
+        text += duration;
+        text += segment_name(sequence);
+        text += '\n';
+    }
+    return text;
+}
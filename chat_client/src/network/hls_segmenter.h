@@ -0,0 +1,107 @@
+#pragma once
+
+#include "../audio/audio_codec.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+// The hls protocol settings of config/device_streams.yaml
+struct HlsSettings {
+    unsigned segment_ms = 4000;     // segment_duration
+    unsigned playlist_size = 5;     // Segments listed in the playlist
+};
+
+// Cuts one encoded stream into HLS segments in memory (RFC 8216).
+//
+// Segments are fragmented MP4 (an init segment, then a moof and mdat per
+// segment), the container HLS takes Opus in. ADPCM builds package their
+// frames under a private sample entry, 'xadp', for players running this
+// client, as the RTSP server's X-adpcm does.
+//
+// Finished segments go into a ring of playlist_size + kSpareSegments slots
+// in one memfd, so a server can sendfile() them and memory is bounded
+// whatever the number of readers. The spares keep a segment fetchable for
+// a while after it leaves the playlist, for players holding an older one.
+// Reusing a slot punches its pages out before writing: pages a socket
+// still holds from an earlier sendfile() keep the old segment.
+//
+// Frames missing from the timestamps (DTX, capture gating) are filled with
+// silence so the timeline has no holes; a gap longer than a segment is
+// passed over instead. Not thread-safe.
+class HlsSegmenter {
+public:
+    static constexpr unsigned kSpareSegments = 3;
+
+    struct Segment {
+        uint64_t sequence = 0;  // Media sequence number
+        off_t offset = 0;       // In fd()
+        size_t size = 0;
+        unsigned frames = 0;
+    };
+
+    HlsSegmenter(const CodecSettings& codec, const HlsSettings& settings);
+    ~HlsSegmenter();
+
+    HlsSegmenter(const HlsSegmenter&) = delete;
+    HlsSegmenter& operator=(const HlsSegmenter&) = delete;
+
+    // False if the codec or the ring cannot be set up
+    bool valid() const { return fd_ >= 0; }
+    const char* codec_name() const { return codec_name_.c_str(); }
+    unsigned frame_ms() const { return frame_ms_; }
+    unsigned frames_per_segment() const { return frames_per_segment_; }
+
+    // Appends the frame with this timestamp (at the codec rate); size 0 is
+    // a frame of silence. True if it finished a segment.
+    bool add_frame(uint32_t timestamp, const uint8_t* data, size_t size);
+
+    const std::string& init_segment() const { return init_; }
+    // The current media playlist, segment URIs relative to it
+    std::string playlist() const;
+    static std::string segment_name(uint64_t sequence);
+
+    // Segments [oldest_sequence(), next_sequence()) can be read; the
+    // playlist lists the last playlist_size of them
+    uint64_t next_sequence() const { return next_sequence_; }
+    uint64_t oldest_sequence() const;
+    // False if the segment is not in the ring
+    bool segment(uint64_t sequence, Segment& out) const;
+    int fd() const { return fd_; }
+
+    uint64_t frames_filled() const { return frames_filled_; }    // Silence put in gaps
+    uint64_t frames_skipped() const { return frames_skipped_; }  // Of gaps too long to fill
+
+private:
+    void append(const uint8_t* data, size_t size);
+    void finish_segment();
+
+    HlsSettings settings_;
+    std::string codec_name_;
+    bool opus_ = false;
+    unsigned sample_rate_ = 0;       // Of the codec
+    unsigned frame_samples_ = 0;     // At the codec rate
+    unsigned frame_ticks_ = 0;       // At the track timescale
+    unsigned frame_ms_ = 0;
+    unsigned frames_per_segment_ = 1;
+    std::vector<uint8_t> silence_;   // One encoded frame of it
+    std::string init_;
+
+    int fd_ = -1;
+    size_t slot_bytes_ = 0;
+    std::vector<Segment> slots_;     // Segment n in slot n % slots_.size()
+    uint64_t next_sequence_ = 0;
+    uint64_t decode_time_ = 0;       // Of the segment being built, in ticks
+
+    // The segment being built
+    std::vector<uint8_t> payload_;
+    std::vector<uint32_t> sizes_;
+    std::vector<uint8_t> moof_;
+    bool started_ = false;
+    uint32_t expected_timestamp_ = 0;
+
+    uint64_t frames_filled_ = 0;
+    uint64_t frames_skipped_ = 0;
+};
@@ -0,0 +1,630 @@
+#include "hls_server.h"
+#include "event_loop.h"
+#include "../audio/codec_pipeline.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string_view>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kQueueFrames = 128;  // Between a pipeline and the loop
+constexpr size_t kReadChunk = 4096;
+// Per connection, fixed so the kernel's share of thousands of them stays
+// bounded too; ample for audio segments over any link
+constexpr int kConnectionSendBufferBytes = 128 << 10;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+const char* reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    default: return "Error";
+    }
+}
+
+// Status line and headers for a body of length bytes
+std::string head(int status, const char* type, const char* cache, size_t length) {
+    std::string out = "HTTP/1.1 " + std::to_string(status) + " " + reason(status) + "\r\n";
+    out += "Server: chat_client\r\n";
+    if (type) {
+        out += "Content-Type: ";
+        out += type;
+        out += "\r\n";
+    }
+    if (cache) {
+        out += "Cache-Control: ";
+        out += cache;
+        out += "\r\n";
+    }
+    if (status == 405) {
+        out += "Allow: GET, HEAD\r\n";
+    }
+    out += "Access-Control-Allow-Origin: *\r\n";
+    out += "Content-Length: " + std::to_string(length) + "\r\n\r\n";
+    return out;
+}
+
+bool token_in(std::string_view value, std::string_view token) {
+    size_t begin = 0;
+    while (begin <= value.size()) {
+        size_t end = std::min(value.find(',', begin), value.size());
+        std::string_view item = value.substr(begin, end - begin);
+        while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+            item.remove_prefix(1);
+        }
+        while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+            item.remove_suffix(1);
+        }
+        if (item.size() == token.size() && strncasecmp(item.data(), token.data(), token.size()) == 0) {
+            return true;
+        }
+        begin = end + 1;
+    }
+    return false;
+}
+
+} // namespace
+
+struct HlsServer::Stream {
+    Stream(HlsServer& server, const std::string& path, const CodecSettings& settings, const HlsSettings& hls)
+        : playlist_path(path),
+          directory(path.substr(0, path.rfind('/') + 1)),
+          pipeline(std::make_unique<AudioEncodePipeline>(
+              settings, [&server, this](const EncodedFrame* frames, size_t count) {
+                  server.on_frames(*this, frames, count);
+              })),
+          segmenter(settings, hls),
+          queue(kQueueFrames),
+          segment_heads(hls.playlist_size + HlsSegmenter::kSpareSegments) {}
+
+    std::string playlist_path;
+    std::string directory;  // Of the playlist, with the trailing slash
+    std::unique_ptr<AudioEncodePipeline> pipeline;
+    HlsSegmenter segmenter;
+    SpscRingBuffer<Frame> queue;
+
+    // Loop thread
+    std::shared_ptr<const Response> playlist;
+    std::shared_ptr<const Response> init;
+    // Headers of segment n in slot n % size
+    std::vector<std::shared_ptr<const Response>> segment_heads;
+};
+
+struct HlsServer::Connection {
+    int fd = -1;
+    size_t index = 0;  // In connections_
+    std::string inbox;
+    uint32_t events = EPOLLIN;  // Registered with the loop
+    bool peer_closed = false;  // Sent everything it will; answer, then close
+    Clock::time_point last_active;
+
+    // The response being sent: response->bytes up to size, then the
+    // segment's body if there is one
+    std::shared_ptr<const Response> response;
+    size_t size = 0;
+    size_t sent = 0;
+    Stream* stream = nullptr;
+    uint64_t segment = 0;
+    off_t file_offset = 0;
+    size_t file_left = 0;
+    bool close_after = false;
+};
+
+HlsServer::HlsServer(EventLoop& loop) : HlsServer(loop, HlsSettings()) {}
+
+HlsServer::HlsServer(EventLoop& loop, const HlsSettings& settings)
+    : loop_(loop), settings_(settings) {
+    settings_.playlist_size = std::max(1u, settings_.playlist_size);
+    auto error = [](int status) {
+        auto response = std::make_shared<Response>();
+        response->bytes = head(status, nullptr, nullptr, 0);
+        response->header_size = response->bytes.size();
+        return std::shared_ptr<const Response>(std::move(response));
+    };
+    not_found_ = error(404);
+    bad_request_ = error(400);
+    not_allowed_ = error(405);
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0 || !loop_.add_fd(wakeup_fd_, EPOLLIN, [this](uint32_t) { on_wakeup(); })) {
+        std::cerr << "Cannot create HLS wakeup descriptor: " << std::strerror(errno) << std::endl;
+    }
+}
+
+HlsServer::~HlsServer() {
+    close();
+    // No pipeline may touch the wakeup descriptor once it is gone
+    for (auto& stream : streams_) {
+        stream->pipeline->stop();
+    }
+    if (wakeup_fd_ >= 0) {
+        loop_.remove_fd(wakeup_fd_);
+        ::close(wakeup_fd_);
+    }
+}
+
+AudioEncodePipeline* HlsServer::add_stream(const std::string& path, const CodecSettings& settings) {
+    if (path.empty() || path[0] != '/') {
+        std::cerr << "HLS playlist path " << path << " is not absolute" << std::endl;
+        return nullptr;
+    }
+    for (auto& stream : streams_) {
+        if (stream->playlist_path == path || stream->directory == path.substr(0, path.rfind('/') + 1)) {
+            std::cerr << "HLS path " << path << " is already served" << std::endl;
+            return nullptr;
+        }
+    }
+    auto stream = std::make_unique<Stream>(*this, path, settings, settings_);
+    if (!stream->pipeline->valid() || !stream->segmenter.valid()) {
+        return nullptr;
+    }
+    auto playlist = std::make_shared<Response>();
+    std::string text = stream->segmenter.playlist();
+    playlist->bytes = head(200, "application/vnd.apple.mpegurl", "no-cache", text.size());
+    playlist->header_size = playlist->bytes.size();
+    playlist->bytes += text;
+    stream->playlist = std::move(playlist);
+    auto init = std::make_shared<Response>();
+    const std::string& segment = stream->segmenter.init_segment();
+    init->bytes = head(200, "audio/mp4", "max-age=3600", segment.size());
+    init->header_size = init->bytes.size();
+    init->bytes += segment;
+    stream->init = std::move(init);
+
+    AudioEncodePipeline* pipeline = stream->pipeline.get();
+    streams_.push_back(std::move(stream));
+    pipeline->start();
+    return pipeline;
+}
+
+bool HlsServer::listen(const std::string& host, uint16_t port) {
+    if (listener_ >= 0) {
+        std::cerr << "HLS server is already listening on port " << port_ << std::endl;
+        return false;
+    }
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+    addrinfo* addresses = nullptr;
+    std::string service = std::to_string(port);
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &addresses);
+    if (error != 0) {
+        std::cerr << "Cannot resolve " << host << ": " << gai_strerror(error) << std::endl;
+        return false;
+    }
+    int fd = socket(addresses->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    bool ok = fd >= 0
+        && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0
+        && bind(fd, addresses->ai_addr, addresses->ai_addrlen) == 0
+        && ::listen(fd, SOMAXCONN) == 0;
+    freeaddrinfo(addresses);
+    if (!ok) {
+        std::cerr << "Cannot listen for HLS on " << host << ":" << port << ": "
+                  << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    if (!loop_.add_fd(fd, EPOLLIN, [this](uint32_t) { on_accept(); })) {
+        ::close(fd);
+        return false;
+    }
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    listener_ = fd;
+    port_ = ntohs(address.ss_family == AF_INET ? reinterpret_cast<const sockaddr_in&>(address).sin_port
+                                               : reinterpret_cast<const sockaddr_in6&>(address).sin6_port);
+    timeout_timer_ = loop_.add_timer(1000, [this] { expire_connections(); }, 1000);
+    return true;
+}
+
+void HlsServer::close() {
+    while (!connections_.empty()) {
+        close_connection(*connections_.back());
+    }
+    if (listener_ >= 0) {
+        loop_.remove_fd(listener_);
+        ::close(listener_);
+        listener_ = -1;
+        port_ = 0;
+    }
+    if (timeout_timer_) {
+        loop_.cancel_timer(timeout_timer_);
+        timeout_timer_ = 0;
+    }
+}
+
+void HlsServer::on_frames(Stream& stream, const EncodedFrame* frames, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        Frame* frame = stream.queue.write_slot();
+        if (!frame) {
+            queue_overflows_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        frame->timestamp = frames[i].timestamp;
+        frame->size = frames[i].dtx ? 0 : static_cast<uint16_t>(std::min(frames[i].size, sizeof(frame->data)));
+        std::memcpy(frame->data, frames[i].data, frame->size);
+        frame->queued_ns = now_ns();
+        stream.queue.publish();
+    }
+    if (count > 0 && !wakeup_pending_.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void HlsServer::on_wakeup() {
+    uint64_t count = 0;
+    ssize_t drained = read(wakeup_fd_, &count, sizeof(count));
+    (void)drained;
+    // Cleared before draining, so frames queued from here on wake us again
+    wakeup_pending_.store(false);
+    uint64_t filled = 0;
+    for (auto& stream : streams_) {
+        while (const Frame* frame = stream->queue.read_slot()) {
+            if (stream->segmenter.add_frame(frame->timestamp, frame->data, frame->size)) {
+                publish(*stream, frame->queued_ns);
+            }
+            stream->queue.release();
+        }
+        filled += stream->segmenter.frames_filled();
+    }
+    frames_filled_.store(filled, std::memory_order_relaxed);
+}
+
+void HlsServer::publish(Stream& stream, int64_t queued_ns) {
+    HlsSegmenter& segmenter = stream.segmenter;
+    HlsSegmenter::Segment segment;
+    if (segmenter.segment(segmenter.next_sequence() - 1, segment)) {
+        auto headers = std::make_shared<Response>();
+        headers->bytes = head(200, "audio/mp4", "max-age=3600", segment.size);
+        headers->header_size = headers->bytes.size();
+        stream.segment_heads[segment.sequence % stream.segment_heads.size()] = std::move(headers);
+    }
+    // Clients sending the old playlist keep it until they are done
+    auto playlist = std::make_shared<Response>();
+    std::string text = segmenter.playlist();
+    playlist->bytes = head(200, "application/vnd.apple.mpegurl", "no-cache", text.size());
+    playlist->header_size = playlist->bytes.size();
+    playlist->bytes += text;
+    stream.playlist = std::move(playlist);
+
+    uint64_t latency = static_cast<uint64_t>(std::max<int64_t>(0, now_ns() - queued_ns));
+    segments_published_.fetch_add(1, std::memory_order_relaxed);
+    publish_ns_total_.fetch_add(latency, std::memory_order_relaxed);
+    if (latency > publish_ns_max_.load(std::memory_order_relaxed)) {
+        publish_ns_max_.store(latency, std::memory_order_relaxed);
+    }
+}
+
+void HlsServer::on_accept() {
+    for (;;) {
+        int fd = accept4(listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (connections_.size() >= kMaxConnections) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            ::close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &kConnectionSendBufferBytes, sizeof(kConnectionSendBufferBytes));
+        auto connection = std::make_unique<Connection>();
+        Connection* raw = connection.get();
+        if (!loop_.add_fd(fd, EPOLLIN, [this, raw](uint32_t events) { on_connection_events(*raw, events); })) {
+            ::close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->index = connections_.size();
+        connection->last_active = Clock::now();
+        connections_.push_back(std::move(connection));
+        connection_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void HlsServer::on_connection_events(Connection& connection, uint32_t events) {
+    // Frames before requests: with many clients ready, the wakeup would
+    // otherwise wait its turn behind all of them
+    if (wakeup_pending_.load(std::memory_order_relaxed)) {
+        on_wakeup();
+    }
+    serve(connection, (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0);
+}
+
+bool HlsServer::serve(Connection& connection, bool readable) {
+    if (readable && !connection.peer_closed) {
+        char buffer[kReadChunk];
+        for (;;) {
+            ssize_t received = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (received > 0) {
+                connection.inbox.append(buffer, static_cast<size_t>(received));
+                connection.last_active = Clock::now();
+                if (static_cast<size_t>(received) < sizeof(buffer)) {
+                    break;
+                }
+                continue;
+            }
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received < 0) {
+                close_connection(connection);
+                return false;
+            }
+            connection.peer_closed = true;
+            break;
+        }
+    }
+
+    for (;;) {
+        if (connection.response) {
+            bool closed = false;
+            if (!send_response(connection, closed)) {
+                if (!closed) {
+                    update_interest(connection, true);
+                }
+                return !closed;
+            }
+            if (connection.close_after) {
+                close_connection(connection);
+                return false;
+            }
+        }
+        if (!start_response(connection)) {
+            break;
+        }
+    }
+    if (connection.peer_closed) {
+        close_connection(connection);
+        return false;
+    }
+    update_interest(connection, false);
+    return true;
+}
+
+bool HlsServer::start_response(Connection& connection) {
+    std::string& inbox = connection.inbox;
+    size_t end = inbox.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (inbox.size() <= kMaxRequestBytes) {
+            return false;
+        }
+        end = inbox.size() - 4;  // Refused whole
+    }
+    requests_.fetch_add(1, std::memory_order_relaxed);
+    std::string_view request(inbox.data(), end + 2);
+    size_t line_end = request.find("\r\n");
+    std::string_view line = request.substr(0, line_end);
+    size_t first = line.find(' ');
+    size_t second = first == std::string_view::npos ? first : line.find(' ', first + 1);
+
+    bool bad = end + 4 > kMaxRequestBytes || second == std::string_view::npos;
+    std::string_view method;
+    std::string_view target;
+    std::string_view version;
+    if (!bad) {
+        method = line.substr(0, first);
+        target = line.substr(first + 1, second - first - 1);
+        version = line.substr(second + 1);
+        bad = version.substr(0, 7) != "HTTP/1.";
+    }
+    bool close = version == "HTTP/1.0";
+    for (size_t at = line_end + 2; !bad && at < request.size();) {
+        size_t next = request.find("\r\n", at);
+        std::string_view header = request.substr(at, next - at);
+        size_t colon = header.find(':');
+        if (colon != std::string_view::npos) {
+            std::string_view name = header.substr(0, colon);
+            std::string_view value = header.substr(colon + 1);
+            if (name.size() == 10 && strncasecmp(name.data(), "Connection", 10) == 0) {
+                close = token_in(value, "close") || (close && !token_in(value, "keep-alive"));
+            } else if ((name.size() == 14 && strncasecmp(name.data(), "Content-Length", 14) == 0
+                        && value.find_first_not_of(" \t0") != std::string_view::npos)
+                       || (name.size() == 17 && strncasecmp(name.data(), "Transfer-Encoding", 17) == 0)) {
+                bad = true;  // Nothing here takes a body
+            }
+        }
+        at = next + 2;
+    }
+
+    connection.close_after = close;
+    connection.size = 0;
+    connection.sent = 0;
+    connection.file_left = 0;
+    connection.stream = nullptr;
+    bool head_only = method == "HEAD";
+    if (bad) {
+        bad_requests_.fetch_add(1, std::memory_order_relaxed);
+        connection.response = bad_request_;
+        connection.close_after = true;
+    } else if (method != "GET" && !head_only) {
+        bad_requests_.fetch_add(1, std::memory_order_relaxed);
+        connection.response = not_allowed_;
+    } else {
+        target = target.substr(0, target.find('?'));
+        connection.response = not_found_;
+        for (auto& stream : streams_) {
+            if (target == stream->playlist_path) {
+                playlist_requests_.fetch_add(1, std::memory_order_relaxed);
+                connection.response = stream->playlist;
+                break;
+            }
+            if (target.substr(0, stream->directory.size()) != stream->directory) {
+                continue;
+            }
+            std::string_view name = target.substr(stream->directory.size());
+            if (name == "init.mp4") {
+                segment_requests_.fetch_add(1, std::memory_order_relaxed);
+                connection.response = stream->init;
+                break;
+            }
+            uint64_t sequence = 0;
+            bool numbered = name.size() > 7 && name.substr(0, 3) == "seg" && name.substr(name.size() - 4) == ".m4s";
+            for (size_t i = 3; numbered && i < name.size() - 4; ++i) {
+                numbered = name[i] >= '0' && name[i] <= '9' && sequence < UINT64_MAX / 10;
+                sequence = sequence * 10 + uint64_t(name[i] - '0');
+            }
+            HlsSegmenter::Segment segment;
+            if (numbered && stream->segmenter.segment(sequence, segment)) {
+                segment_requests_.fetch_add(1, std::memory_order_relaxed);
+                connection.response = stream->segment_heads[sequence % stream->segment_heads.size()];
+                if (!head_only) {
+                    connection.stream = stream.get();
+                    connection.segment = sequence;
+                    connection.file_offset = segment.offset;
+                    connection.file_left = segment.size;
+                }
+            }
+            break;
+        }
+        if (connection.response == not_found_) {
+            not_found_count_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    connection.size = head_only ? connection.response->header_size : connection.response->bytes.size();
+    inbox.erase(0, end + 4);
+    return true;
+}
+
+bool HlsServer::send_response(Connection& connection, bool& closed) {
+    const int fd = connection.fd;
+    while (connection.sent < connection.size) {
+        const int more = connection.file_left > 0 ? MSG_MORE : 0;
+        ssize_t sent = ::send(fd, connection.response->bytes.data() + connection.sent,
+                              connection.size - connection.sent, MSG_NOSIGNAL | MSG_DONTWAIT | more);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+            close_connection(connection);
+            closed = true;
+            return false;
+        }
+        connection.sent += static_cast<size_t>(sent);
+        connection.last_active = Clock::now();
+        bytes_sent_.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+    }
+    while (connection.file_left > 0) {
+        // The slot may have been written over since the last call
+        HlsSegmenter& segmenter = connection.stream->segmenter;
+        HlsSegmenter::Segment segment;
+        if (!segmenter.segment(connection.segment, segment)) {
+            evicted_.fetch_add(1, std::memory_order_relaxed);
+            close_connection(connection);
+            closed = true;
+            return false;
+        }
+        ssize_t sent = sendfile(fd, segmenter.fd(), &connection.file_offset, connection.file_left);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return false;
+            }
+        }
+        if (sent <= 0) {
+            close_connection(connection);
+            closed = true;
+            return false;
+        }
+        connection.file_left -= static_cast<size_t>(sent);
+        connection.last_active = Clock::now();
+        bytes_sent_.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+    }
+    connection.response.reset();
+    connection.stream = nullptr;
+    return true;
+}
+
+void HlsServer::update_interest(Connection& connection, bool want_write) {
+    // A peer that has closed its side leaves the descriptor readable for good
+    uint32_t events = 0;
+    if (!connection.peer_closed) {
+        events |= EPOLLIN;
+    }
+    if (want_write) {
+        events |= EPOLLOUT;
+    }
+    if (connection.events != events) {
+        connection.events = events;
+        loop_.modify_fd(connection.fd, events);
+    }
+}
+
+void HlsServer::close_connection(Connection& connection) {
+    loop_.remove_fd(connection.fd);
+    ::close(connection.fd);
+    connection.fd = -1;
+    connection_count_.fetch_sub(1, std::memory_order_relaxed);
+
+    size_t index = connection.index;
+    if (index + 1 != connections_.size()) {
+        std::swap(connections_[index], connections_.back());
+        connections_[index]->index = index;
+    }
+    connections_.pop_back();  // Destroys connection
+}
+
+void HlsServer::expire_connections() {
+    const Clock::time_point now = Clock::now();
+    const auto timeout = std::chrono::seconds(kIdleTimeoutS);
+    // Backwards, as closing swaps the last connection into the gap
+    for (size_t i = connections_.size(); i-- > 0;) {
+        if (now - connections_[i]->last_active > timeout) {
+            timeouts_.fetch_add(1, std::memory_order_relaxed);
+            close_connection(*connections_[i]);
+        }
+    }
+}
+
+HlsServer::Stats HlsServer::get_stats() const {
+    Stats stats;
+    stats.connections = connection_count_.load(std::memory_order_relaxed);
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.playlist_requests = playlist_requests_.load(std::memory_order_relaxed);
+    stats.segment_requests = segment_requests_.load(std::memory_order_relaxed);
+    stats.not_found = not_found_count_.load(std::memory_order_relaxed);
+    stats.bad_requests = bad_requests_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.evicted = evicted_.load(std::memory_order_relaxed);
+    stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+    stats.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+    stats.segments_published = segments_published_.load(std::memory_order_relaxed);
+    stats.frames_filled = frames_filled_.load(std::memory_order_relaxed);
+    stats.queue_overflows = queue_overflows_.load(std::memory_order_relaxed);
+    stats.publish_ns_total = publish_ns_total_.load(std::memory_order_relaxed);
+    stats.publish_ns_max = publish_ns_max_.load(std::memory_order_relaxed);
+    return stats;
+}
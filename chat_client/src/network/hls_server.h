@@ -0,0 +1,160 @@
+#pragma once
+
+#include "hls_segmenter.h"
+#include "../audio/audio_codec.h"
+#include "../utils/spsc_ring_buffer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class AudioEncodePipeline;
+class EventLoop;
+struct EncodedFrame;
+
+// One stream as configured under config/device_streams.yaml's hls entries
+struct HlsMount {
+    std::string path;  // Of the playlist: "/hls/default_mic/index.m3u8"
+    CodecSettings codec;
+};
+
+// In-process HLS origin: segments live audio and serves it over HTTP/1.1,
+// on an EventLoop.
+//
+// Each stream is encoded once, by its own AudioEncodePipeline fed from the
+// engine, and cut into segments by an HlsSegmenter on the loop thread. Its
+// playlist is served at the mount's path, with init.mp4 and the segments
+// beside it. Every response is prepared once and shared: the playlist's
+// when a segment is published, a segment's headers when it is written.
+// Bodies go out without copying, playlists and the init segment with
+// send() from the shared response and segments with sendfile() from the
+// segment ring. A keep-alive connection costs its request bytes and a
+// reference to the response it is sending, so memory is bounded by
+// kMaxConnections whatever the clients do.
+//
+// A client still reading a segment when its slot is reused is dropped,
+// as is a connection idle for kIdleTimeoutS. Requests on a connection are
+// answered in order, one at a time.
+//
+// Everything runs on the loop thread except the pipelines, which hand
+// frames over through a wait-free ring and wake the loop through an
+// eventfd. The loop takes them in before serving any connection, so a
+// segment is published as soon as it is finished however busy the server
+// is. Set the server up before the loop runs or on its thread, and
+// take the streams' consumers out of the engine before destroying it.
+class HlsServer {
+public:
+    static constexpr size_t kMaxConnections = 8192;
+    static constexpr size_t kMaxRequestBytes = 8192;
+    static constexpr unsigned kIdleTimeoutS = 30;
+
+    struct Stats {
+        uint64_t connections = 0;        // Open now
+        uint64_t requests = 0;
+        uint64_t playlist_requests = 0;
+        uint64_t segment_requests = 0;   // Init segment included
+        uint64_t not_found = 0;
+        uint64_t bad_requests = 0;       // Malformed, too large or not GET/HEAD
+        uint64_t rejected = 0;           // Connections refused over kMaxConnections
+        uint64_t evicted = 0;            // Too slow to finish a segment
+        uint64_t timeouts = 0;
+        uint64_t bytes_sent = 0;
+        uint64_t segments_published = 0;
+        uint64_t frames_filled = 0;      // Silence for frames not sent
+        uint64_t queue_overflows = 0;    // Dropped between a pipeline and the loop
+        // From a segment's last frame leaving its pipeline to the segment
+        // being in the playlist
+        uint64_t publish_ns_total = 0;
+        uint64_t publish_ns_max = 0;
+    };
+
+    explicit HlsServer(EventLoop& loop);
+    HlsServer(EventLoop& loop, const HlsSettings& settings);
+    ~HlsServer();
+
+    HlsServer(const HlsServer&) = delete;
+    HlsServer& operator=(const HlsServer&) = delete;
+
+    // Encodes a stream with settings and serves its playlist at path.
+    // Register the returned pipeline's consumer with the engine at its
+    // sample_rate(); null if the codec cannot be set up or the path is taken.
+    AudioEncodePipeline* add_stream(const std::string& path, const CodecSettings& settings);
+    // Accepts connections on host:port (0 picks a free port)
+    bool listen(const std::string& host, uint16_t port);
+    uint16_t port() const { return port_; }
+    // Drops every client and stops listening
+    void close();
+
+    // Any thread
+    Stats get_stats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Frame {
+        uint32_t timestamp = 0;
+        uint16_t size = 0;
+        int64_t queued_ns = 0;  // When the pipeline handed it over
+        uint8_t data[AudioEncoder::kMaxPacketBytes];
+    };
+    // A response prepared once and sent to every client asking for it
+    struct Response {
+        std::string bytes;       // Headers, then the body unless it is a segment's
+        size_t header_size = 0;
+    };
+    struct Stream;
+    struct Connection;
+
+    // Pipeline threads
+    void on_frames(Stream& stream, const EncodedFrame* frames, size_t count);
+
+    // Loop thread
+    void on_wakeup();
+    void publish(Stream& stream, int64_t queued_ns);
+    void on_accept();
+    void on_connection_events(Connection& connection, uint32_t events);
+    // Reads, then answers and sends; false if the connection closed and is gone
+    bool serve(Connection& connection, bool readable);
+    // Takes the request at the front of the inbox and sets up its
+    // response; false if there is no whole request yet
+    bool start_response(Connection& connection);
+    // True once the response is sent; false if the socket is full, or the
+    // connection failed and is gone (closed set)
+    bool send_response(Connection& connection, bool& closed);
+    void update_interest(Connection& connection, bool want_write);
+    void close_connection(Connection& connection);
+    void expire_connections();
+
+    EventLoop& loop_;
+    HlsSettings settings_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    int listener_ = -1;
+    uint16_t port_ = 0;
+    std::vector<std::unique_ptr<Connection>> connections_;
+    int wakeup_fd_ = -1;
+    std::atomic<bool> wakeup_pending_{false};
+    uint64_t timeout_timer_ = 0;
+    std::shared_ptr<const Response> not_found_;
+    std::shared_ptr<const Response> bad_request_;
+    std::shared_ptr<const Response> not_allowed_;
+
+    std::atomic<uint64_t> connection_count_{0};
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> playlist_requests_{0};
+    std::atomic<uint64_t> segment_requests_{0};
+    std::atomic<uint64_t> not_found_count_{0};
+    std::atomic<uint64_t> bad_requests_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> evicted_{0};
+    std::atomic<uint64_t> timeouts_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
+    std::atomic<uint64_t> segments_published_{0};
+    std::atomic<uint64_t> frames_filled_{0};
+    std::atomic<uint64_t> queue_overflows_{0};
+    std::atomic<uint64_t> publish_ns_total_{0};
+    std::atomic<uint64_t> publish_ns_max_{0};
+};
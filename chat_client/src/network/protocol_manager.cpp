@@ -1,32 +1,144 @@
 #include "protocol_manager.h"
+#include "event_loop.h"
+#include "tcp_connection.h"
+#include "rtp_socket.h"
+#include "rtsp_server.h"
+#include "hls_server.h"
 #include "../core/config_manager.h"
+#include "../core/history_store.h"
 
-#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
 #include <string>
 #include <thread>
 #include <atomic>
-#include <chrono>
 #include <functional>
+#include <future>
 #include <iostream>
 
+namespace {
+
+// Demo mode's simulated server message
+constexpr unsigned int kDemoIntervalMs = 10000;
+
+} // namespace
+
 class ProtocolManager::Impl {
 public:
+    struct Channel {
+        uint64_t id = 0;     // Tells a reopened channel from the one it replaced
+        std::unique_ptr<TcpConnection> connection;
+        std::string inbound; // Received bytes not yet ending in a newline
+    };
+    
     std::atomic<bool> running_{false};
-    std::thread message_thread_;
-    std::vector<std::string> pending_messages_;
+    std::unique_ptr<EventLoop> loop_;
+    std::thread loop_thread_;
+    // Loop thread only while running
     std::function<void(const std::string&, const std::string&)> message_callback_;
+    std::unordered_map<std::string, Channel> channels_;
+    uint64_t next_channel_id_ = 1;
+    HistoryStore* history_ = nullptr;  // Loop thread only while running
+    std::unique_ptr<RtpSocket> voice_;  // Loop thread only while running
+    std::atomic<RtpSocket*> voice_sender_{nullptr};
+    std::unique_ptr<RtspServer> rtsp_;  // Loop thread only while running
+    std::atomic<bool> rtsp_open_{false};
+    std::unique_ptr<HlsServer> hls_;  // Loop thread only while running
+    std::atomic<bool> hls_open_{false};
     
-    void message_loop() {
-        while (running_) {
-            // In a real implementation, this would check for messages from various protocols
-            // For demo purposes, just simulate receiving a message every 10 seconds
-            std::this_thread::sleep_for(std::chrono::seconds(10));
-            
-            if (message_callback_ && running_) {
-                // Simulate receiving a message
-                message_callback_("System", "This is a simulated message from the server");
+    // Runs task on the loop thread and waits for what it returns. Not from
+    // the loop thread, where the wait would never end, and failed if the
+    // loop stops and drops the task before it runs.
+    template <typename Result, typename Task>
+    Result call_on_loop(Task task, Result failed) {
+        if (loop_->in_loop_thread()) {
+            return failed;
+        }
+        auto promise = std::make_shared<std::promise<Result>>();
+        std::future<Result> result = promise->get_future();
+        loop_->post([task = std::move(task), promise]() mutable { promise->set_value(task()); });
+        try {
+            return result.get();
+        } catch (const std::future_error&) {
+            return failed;
+        }
+    }
+    
+    // Waits for the loop to run close, or from the loop thread leaves it
+    // to run once the handler there is done with what it closes
+    template <typename Task>
+    void close_on_loop(Task close) {
+        if (loop_->in_loop_thread()) {
+            loop_->post(std::move(close));
+        } else {
+            call_on_loop([close = std::move(close)]() mutable { close(); return true; }, false);
+        }
+    }
+    
+    void deliver(const std::string& channel, const std::string& message) {
+        if (history_) {
+            int64_t now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            history_->append_async(now_ms, 0, channel, channel, message);
+        }
+        if (message_callback_) {
+            message_callback_(channel, message);
+        }
+    }
+    
+    void open_channel(const std::string& name, const std::string& host, uint16_t port) {
+        channels_.erase(name);
+        Channel& channel = channels_[name];
+        channel.id = next_channel_id_++;
+        channel.connection = std::make_unique<TcpConnection>(
+            *loop_,
+            [this, name](const char* data, size_t size) { receive(name, data, size); },
+            [this, name, id = channel.id](bool connected) {
+                if (!connected) {
+                    std::cerr << "Channel '" << name << "' disconnected" << std::endl;
+                    // Not from inside the connection's own handler
+                    loop_->post([this, name, id] {
+                        auto it = channels_.find(name);
+                        if (it != channels_.end() && it->second.id == id) {
+                            channels_.erase(it);
+                        }
+                    });
+                }
+            });
+        if (!channel.connection->connect(host, port)) {
+            channels_.erase(name);
+        }
+    }
+    
+    void receive(const std::string& name, const char* data, size_t size) {
+        auto it = channels_.find(name);
+        if (it == channels_.end()) {
+            return;
+        }
+        std::string& inbound = it->second.inbound;
+        inbound.append(data, size);
+        size_t start = 0;
+        for (size_t end = inbound.find('\n'); end != std::string::npos; end = inbound.find('\n', start)) {
+            size_t length = end - start;
+            if (length > 0 && inbound[end - 1] == '\r') {
+                --length;
             }
+            deliver(name, inbound.substr(start, length));
+            start = end + 1;
         }
+        inbound.erase(0, start);
+    }
+    
+    void send(const std::string& name, const std::string& message) {
+        auto it = channels_.find(name);
+        if (it == channels_.end()) {
+            // Echo message back to user (simulating a response)
+            deliver("Echo", "You said: " + message);
+            return;
+        }
+        std::string line = message + '\n';
+        it->second.connection->send(line.data(), line.size());
     }
 };
 
@@ -38,7 +150,7 @@ ProtocolManager::~ProtocolManager() {
     shutdown();
 }
 
-bool ProtocolManager::initialize(ConfigManager* config_manager) {
+bool ProtocolManager::initialize(const ConfigManager* config_manager) {
     if (!config_manager) {
         return false;
     }
@@ -46,10 +158,20 @@ bool ProtocolManager::initialize(ConfigManager* config_manager) {
     // In a real implementation, we would read config settings and initialize
     // appropriate chat protocol clients based on the configuration
     
-    // Start message processing thread
+    // Start the event loop thread
     if (!pImpl->running_) {
+        pImpl->loop_ = std::make_unique<EventLoop>();
+        if (!pImpl->loop_->valid()) {
+            pImpl->loop_.reset();
+            return false;
+        }
+        Impl* impl = pImpl.get();
+        pImpl->loop_->add_timer(kDemoIntervalMs, [impl] {
+            // Simulate receiving a message
+            impl->deliver("System", "This is a simulated message from the server");
+        }, kDemoIntervalMs);
         pImpl->running_ = true;
-        pImpl->message_thread_ = std::thread(&ProtocolManager::Impl::message_loop, pImpl.get());
+        pImpl->loop_thread_ = std::thread(&EventLoop::run, pImpl->loop_.get());
     }
     
     std::cout << "Protocol Manager initialized. Demo mode active." << std::endl;
@@ -59,30 +181,203 @@ bool ProtocolManager::initialize(ConfigManager* config_manager) {
 void ProtocolManager::shutdown() {
     if (pImpl->running_) {
         pImpl->running_ = false;
+        pImpl->loop_->stop();
         
-        if (pImpl->message_thread_.joinable()) {
-            pImpl->message_thread_.join();
+        if (pImpl->loop_thread_.joinable()) {
+            pImpl->loop_thread_.join();
         }
+        // The loop has stopped, so its state is ours now
+        pImpl->channels_.clear();
+        pImpl->voice_sender_ = nullptr;
+        pImpl->voice_.reset();
+        pImpl->rtsp_open_ = false;
+        pImpl->rtsp_.reset();
+        pImpl->hls_open_ = false;
+        pImpl->hls_.reset();
+        pImpl->loop_.reset();
     }
 }
 
-bool ProtocolManager::send_message(const std::string& channel, const std::string& message) {
+bool ProtocolManager::connect_channel(const std::string& channel, const std::string& host, uint16_t port) {
     if (!pImpl->running_) {
         return false;
     }
-    
-    std::cout << "Sending message to channel '" << channel << "': " << message << std::endl;
-    // In a real implementation, this would send the message via the appropriate protocol
-    
-    // Echo message back to user (simulating a response)
-    if (pImpl->message_callback_) {
-        pImpl->message_callback_("Echo", "You said: " + message);
+    Impl* impl = pImpl.get();
+    pImpl->loop_->post([impl, channel, host, port] { impl->open_channel(channel, host, port); });
+    return true;
+}
+
+void ProtocolManager::disconnect_channel(const std::string& channel) {
+    if (!pImpl->running_) {
+        return;
+    }
+    Impl* impl = pImpl.get();
+    pImpl->loop_->post([impl, channel] { impl->channels_.erase(channel); });
+}
+
+bool ProtocolManager::send_message(const std::string& channel, const std::string& message) {
+    if (!pImpl->running_) {
+        return false;
     }
     
+    Impl* impl = pImpl.get();
+    pImpl->loop_->post([impl, channel, message] { impl->send(channel, message); });
     return true;
 }
 
 void ProtocolManager::register_message_callback(
     std::function<void(const std::string&, const std::string&)> callback) {
-    pImpl->message_callback_ = std::move(callback);
+    if (!pImpl->running_) {
+        pImpl->message_callback_ = std::move(callback);
+        return;
+    }
+    Impl* impl = pImpl.get();
+    pImpl->loop_->post([impl, callback = std::move(callback)]() mutable {
+        impl->message_callback_ = std::move(callback);
+    });
+}
+
+void ProtocolManager::set_history_store(HistoryStore* store) {
+    if (!pImpl->running_) {
+        pImpl->history_ = store;
+        return;
+    }
+    Impl* impl = pImpl.get();
+    pImpl->loop_->post([impl, store] { impl->history_ = store; });
+}
+
+bool ProtocolManager::open_voice(uint16_t local_port, const std::string& remote_host, uint16_t remote_port,
+                                 VoicePacketHandler handler) {
+    if (!pImpl->running_ || pImpl->loop_->in_loop_thread()) {
+        return false;
+    }
+    close_voice();
+    Impl* impl = pImpl.get();
+    return pImpl->call_on_loop([impl, local_port, remote_host, remote_port, handler = std::move(handler)]() mutable {
+        auto socket = std::make_unique<RtpSocket>(*impl->loop_, std::move(handler));
+        bool ok = socket->open("0.0.0.0", local_port) && socket->set_remote(remote_host, remote_port);
+        if (ok) {
+            impl->voice_ = std::move(socket);
+            impl->voice_sender_ = impl->voice_.get();
+        }
+        return ok;
+    }, false);
+}
+
+void ProtocolManager::close_voice() {
+    if (!pImpl->running_ || !pImpl->voice_sender_.exchange(nullptr)) {
+        return;
+    }
+    Impl* impl = pImpl.get();
+    pImpl->close_on_loop([impl] { impl->voice_.reset(); });
+}
+
+void ProtocolManager::send_voice(const EncodedFrame* frames, size_t count) {
+    if (RtpSocket* socket = pImpl->voice_sender_.load()) {
+        socket->send(frames, count);
+    }
+}
+
+bool ProtocolManager::open_rtsp(const std::string& host, const std::vector<RtspMount>& mounts,
+                                std::vector<AudioEncodePipeline*>& pipelines) {
+    pipelines.clear();
+    if (!pImpl->running_ || pImpl->loop_->in_loop_thread()) {
+        return false;
+    }
+    close_rtsp();
+    Impl* impl = pImpl.get();
+    // Filled by the loop only if it runs the task, while this waits
+    std::vector<AudioEncodePipeline*> opened;
+    bool ok = pImpl->call_on_loop([impl, host, mounts, &opened] {
+        auto server = std::make_unique<RtspServer>(*impl->loop_);
+        std::vector<uint16_t> ports;
+        bool ok = true;
+        for (const RtspMount& mount : mounts) {
+            AudioEncodePipeline* pipeline = server->add_stream(mount.path, mount.codec);
+            ok = ok && pipeline;
+            opened.push_back(pipeline);
+            if (std::find(ports.begin(), ports.end(), mount.port) == ports.end()) {
+                ports.push_back(mount.port);
+                ok = ok && server->listen(host, mount.port);
+            }
+        }
+        if (ok) {
+            impl->rtsp_ = std::move(server);
+            impl->rtsp_open_ = true;
+        }
+        return ok;
+    }, false);
+    if (ok) {
+        pipelines = std::move(opened);
+    }
+    return ok;
+}
+
+void ProtocolManager::close_rtsp() {
+    if (!pImpl->running_ || !pImpl->rtsp_open_.exchange(false)) {
+        return;
+    }
+    Impl* impl = pImpl.get();
+    pImpl->close_on_loop([impl] { impl->rtsp_.reset(); });
+}
+
+RtspServer::Stats ProtocolManager::rtsp_stats() const {
+    if (!pImpl->running_ || !pImpl->rtsp_open_) {
+        return RtspServer::Stats();
+    }
+    // Read where the server lives, so close_rtsp() cannot free it meanwhile
+    Impl* impl = pImpl.get();
+    return pImpl->call_on_loop([impl] {
+        return impl->rtsp_ ? impl->rtsp_->get_stats() : RtspServer::Stats();
+    }, RtspServer::Stats());
+}
+
+bool ProtocolManager::open_hls(const std::string& host, uint16_t port, const HlsSettings& settings,
+                               const std::vector<HlsMount>& mounts, std::vector<AudioEncodePipeline*>& pipelines) {
+    pipelines.clear();
+    if (!pImpl->running_ || pImpl->loop_->in_loop_thread()) {
+        return false;
+    }
+    close_hls();
+    Impl* impl = pImpl.get();
+    // As for open_rtsp()
+    std::vector<AudioEncodePipeline*> opened;
+    bool ok = pImpl->call_on_loop([impl, host, port, settings, mounts, &opened] {
+        auto server = std::make_unique<HlsServer>(*impl->loop_, settings);
+        bool ok = true;
+        for (const HlsMount& mount : mounts) {
+            AudioEncodePipeline* pipeline = server->add_stream(mount.path, mount.codec);
+            ok = ok && pipeline;
+            opened.push_back(pipeline);
+        }
+        ok = ok && server->listen(host, port);
+        if (ok) {
+            impl->hls_ = std::move(server);
+            impl->hls_open_ = true;
+        }
+        return ok;
+    }, false);
+    if (ok) {
+        pipelines = std::move(opened);
+    }
+    return ok;
+}
+
+void ProtocolManager::close_hls() {
+    if (!pImpl->running_ || !pImpl->hls_open_.exchange(false)) {
+        return;
+    }
+    Impl* impl = pImpl.get();
+    pImpl->close_on_loop([impl] { impl->hls_.reset(); });
+}
+
+HlsServer::Stats ProtocolManager::hls_stats() const {
+    if (!pImpl->running_ || !pImpl->hls_open_) {
+        return HlsServer::Stats();
+    }
+    // As for rtsp_stats()
+    Impl* impl = pImpl.get();
+    return pImpl->call_on_loop([impl] {
+        return impl->hls_ ? impl->hls_->get_stats() : HlsServer::Stats();
+    }, HlsServer::Stats());
 }
@@ -1,22 +1,81 @@
 #ifndef PROTOCOL_MANAGER_H
 #define PROTOCOL_MANAGER_H
 
+#include "rtsp_server.h"
+#include "hls_server.h"
+
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 #include <functional>  // Add include for std::function
 
+class AudioEncodePipeline;
 class ConfigManager;
+class HistoryStore;
+struct EncodedFrame;
+struct RtpHeader;
 
+// All protocol I/O runs on one event loop thread (see EventLoop): every
+// connection's socket, the timers and the requests posted by the other
+// methods. The message callback is invoked on that thread.
 class ProtocolManager {
 public:
     ProtocolManager();
     ~ProtocolManager();
     
-    bool initialize(ConfigManager* config_manager);
+    bool initialize(const ConfigManager* config_manager);
+    // Returns as soon as the loop thread has finished its current handler
     void shutdown();
     
+    // Opens a newline-delimited text connection for a channel: each line
+    // received is delivered to the message callback as (channel, line), and
+    // send_message() to the channel writes a line. Connects in the
+    // background; returns false only if the manager is not running.
+    bool connect_channel(const std::string& channel, const std::string& host, uint16_t port);
+    void disconnect_channel(const std::string& channel);
+    
+    // Queued for the loop thread; channels without a connection are echoed
+    // back in demo mode
     bool send_message(const std::string& channel, const std::string& message);
     void register_message_callback(std::function<void(const std::string&, const std::string&)> callback);
+    // Every received message is queued to the store's writer thread, so
+    // logging never blocks the loop
+    void set_history_store(HistoryStore* store);
+    
+    // Voice over RTP/UDP (see RtpSocket): packets arriving on local_port
+    // are handed to the handler on the loop thread, and send_voice() frames
+    // go to the remote. Waits for the loop to open the socket, so never
+    // from the loop thread; false if it could not, or the manager is not
+    // running or stops first.
+    using VoicePacketHandler = std::function<void(const RtpHeader&, const uint8_t* payload, size_t size)>;
+    bool open_voice(uint16_t local_port, const std::string& remote_host, uint16_t remote_port,
+                    VoicePacketHandler handler);
+    // Stop whatever calls send_voice() first
+    void close_voice();
+    // From the one thread producing frames, while voice is open
+    void send_voice(const EncodedFrame* frames, size_t count);
+    
+    // Serves the mounts over RTSP (see RtspServer) on host, each mount's
+    // port listened on once. pipelines gets each mount's encoder, in order,
+    // for the caller to feed from the engine. Waits for the loop, so never
+    // from its thread; false if any stream or port could not be set up, or
+    // the manager is not running or stops first.
+    bool open_rtsp(const std::string& host, const std::vector<RtspMount>& mounts,
+                   std::vector<AudioEncodePipeline*>& pipelines);
+    // Take the pipelines' consumers out of the engine first
+    void close_rtsp();
+    // Read on the loop thread and waited for; empty when closed
+    RtspServer::Stats rtsp_stats() const;
+    
+    // Serves the mounts over HLS (see HlsServer) on host:port, cut into
+    // segments as settings say; pipelines as for open_rtsp()
+    bool open_hls(const std::string& host, uint16_t port, const HlsSettings& settings,
+                  const std::vector<HlsMount>& mounts, std::vector<AudioEncodePipeline*>& pipelines);
+    // Take the pipelines' consumers out of the engine first
+    void close_hls();
+    // As for rtsp_stats()
+    HlsServer::Stats hls_stats() const;
 
 private:
     class Impl;
@@ -0,0 +1,123 @@
+#include "rtp.h"
+#include "../audio/codec_pipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+namespace {
+
+constexpr uint8_t kVersion = 2;
+constexpr uint8_t kMaxDbov = 127;
+
+void put16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value >> 8);
+    out[1] = static_cast<uint8_t>(value);
+}
+
+void put32(uint8_t* out, uint32_t value) {
+    put16(out, static_cast<uint16_t>(value >> 16));
+    put16(out + 2, static_cast<uint16_t>(value));
+}
+
+uint16_t get16(const uint8_t* in) {
+    return static_cast<uint16_t>(in[0] << 8 | in[1]);
+}
+
+uint32_t get32(const uint8_t* in) {
+    return uint32_t(get16(in)) << 16 | get16(in + 2);
+}
+
+} // namespace
+
+size_t write_rtp_header(const RtpHeader& header, uint8_t* out, size_t capacity) {
+    if (capacity < RtpHeader::kSize) {
+        return 0;
+    }
+    out[0] = kVersion << 6;
+    out[1] = static_cast<uint8_t>((header.marker ? 0x80 : 0) | (header.payload_type & 0x7f));
+    put16(out + 2, header.sequence);
+    put32(out + 4, header.timestamp);
+    put32(out + 8, header.ssrc);
+    return RtpHeader::kSize;
+}
+
+bool parse_rtp_packet(const uint8_t* data, size_t size, RtpHeader& header,
+                      const uint8_t*& payload, size_t& payload_size) {
+    if (size < RtpHeader::kSize || data[0] >> 6 != kVersion) {
+        return false;
+    }
+    bool padding = data[0] & 0x20;
+    bool extension = data[0] & 0x10;
+    size_t offset = RtpHeader::kSize + 4 * size_t(data[0] & 0x0f);
+    if (extension) {
+        if (offset + 4 > size) {
+            return false;
+        }
+        offset += 4 + 4 * size_t(get16(data + offset + 2));
+    }
+    size_t end = size;
+    if (padding) {
+        if (end == 0 || data[end - 1] == 0 || data[end - 1] > end) {
+            return false;
+        }
+        end -= data[end - 1];
+    }
+    if (offset > end) {
+        return false;
+    }
+
+    header.marker = data[1] & 0x80;
+    header.payload_type = data[1] & 0x7f;
+    header.sequence = get16(data + 2);
+    header.timestamp = get32(data + 4);
+    header.ssrc = get32(data + 8);
+    payload = data + offset;
+    payload_size = end - offset;
+    return true;
+}
+
+uint8_t comfort_noise_dbov(float level) {
+    if (!(level > 0.0f)) {
+        return kMaxDbov;
+    }
+    double dbov = -20.0 * std::log10(level);
+    return static_cast<uint8_t>(std::clamp(std::lround(dbov), 0L, long(kMaxDbov)));
+}
+
+float comfort_noise_level(uint8_t dbov) {
+    if (dbov >= kMaxDbov) {
+        return 0.0f;
+    }
+    return static_cast<float>(std::pow(10.0, -dbov / 20.0));
+}
+
+RtpPacketizer::RtpPacketizer(uint32_t ssrc, uint32_t clock_multiplier)
+    : clock_multiplier_(clock_multiplier ? clock_multiplier : 1) {
+    std::random_device random;
+    ssrc_ = ssrc ? ssrc : (random() | 1);
+    sequence_offset_ = static_cast<uint16_t>(random());
+    timestamp_offset_ = random();
+}
+
+size_t RtpPacketizer::packetize(const EncodedFrame& frame, uint8_t* out, size_t capacity) const {
+    RtpHeader header;
+    header.payload_type = frame.dtx ? kComfortNoisePayloadType : kAudioPayloadType;
+    header.marker = frame.segment_start && !frame.dtx;
+    header.sequence = static_cast<uint16_t>(sequence_offset_ + frame.sequence);
+    header.timestamp = timestamp_offset_ + frame.timestamp * clock_multiplier_;
+    header.ssrc = ssrc_;
+
+    size_t payload = frame.dtx ? 1 : frame.size;
+    if (capacity < RtpHeader::kSize + payload) {
+        return 0;
+    }
+    write_rtp_header(header, out, capacity);
+    if (frame.dtx) {
+        out[RtpHeader::kSize] = comfort_noise_dbov(frame.comfort_noise_level);
+    } else {
+        std::memcpy(out + RtpHeader::kSize, frame.data, frame.size);
+    }
+    return RtpHeader::kSize + payload;
+}
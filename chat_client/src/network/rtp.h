@@ -0,0 +1,62 @@
+#pragma once
+
+#include "../audio/audio_codec.h"
+
+#include <cstddef>
+#include <cstdint>
+
+struct EncodedFrame;
+
+// The fixed RTP header (RFC 3550) of one voice packet. Packets written
+// here never carry CSRCs, extensions or padding; parsing skips them.
+struct RtpHeader {
+    static constexpr size_t kSize = 12;
+
+    uint8_t payload_type = 0;
+    bool marker = false;      // First packet of a talk spurt
+    uint16_t sequence = 0;
+    uint32_t timestamp = 0;   // In samples at the codec rate
+    uint32_t ssrc = 0;
+};
+
+// Writes the header; kSize, or 0 if capacity is too small
+size_t write_rtp_header(const RtpHeader& header, uint8_t* out, size_t capacity);
+// Parses a version 2 packet; payload points into data. False if the packet
+// is malformed.
+bool parse_rtp_packet(const uint8_t* data, size_t size, RtpHeader& header,
+                      const uint8_t*& payload, size_t& payload_size);
+
+// Comfort noise level (RFC 3389): -dBov in 0..127, from and to RMS
+uint8_t comfort_noise_dbov(float level);
+float comfort_noise_level(uint8_t dbov);
+
+// Encoded frames to RTP packets for one outgoing stream.
+//
+// The sequence number and timestamp start at random offsets and follow
+// the frames' own, so a receiver sees timestamp gaps across silence. Audio
+// goes out as kAudioPayloadType with the marker set on the first frame of
+// each talk spurt; comfort noise frames as kComfortNoisePayloadType with a
+// one byte level. Timestamps count codec samples times clock_multiplier,
+// for payload formats with a fixed RTP clock (Opus runs at 48 kHz on the
+// wire whatever the codec rate).
+class RtpPacketizer {
+public:
+    static constexpr uint8_t kAudioPayloadType = 111;       // Dynamic
+    static constexpr uint8_t kComfortNoisePayloadType = 13; // RFC 3389
+    static constexpr size_t kMaxPacketBytes = RtpHeader::kSize + AudioEncoder::kMaxPacketBytes;
+
+    // A zero ssrc picks a random one
+    explicit RtpPacketizer(uint32_t ssrc = 0, uint32_t clock_multiplier = 1);
+
+    uint32_t ssrc() const { return ssrc_; }
+    uint32_t clock_multiplier() const { return clock_multiplier_; }
+
+    // The packet size, or 0 if it does not fit capacity
+    size_t packetize(const EncodedFrame& frame, uint8_t* out, size_t capacity) const;
+
+private:
+    uint32_t ssrc_;
+    uint32_t clock_multiplier_;
+    uint16_t sequence_offset_;
+    uint32_t timestamp_offset_;
+};
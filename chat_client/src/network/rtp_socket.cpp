@@ -0,0 +1,192 @@
+#include "rtp_socket.h"
+#include "event_loop.h"
+#include "../audio/codec_pipeline.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace {
+
+// DSCP EF, expedited forwarding for voice (RFC 4594)
+constexpr int kVoiceTos = 46 << 2;
+
+bool resolve(const std::string& host, uint16_t port, int flags, sockaddr_storage& address, socklen_t& length) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = flags;
+    addrinfo* addresses = nullptr;
+    std::string service = std::to_string(port);
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &addresses);
+    if (error != 0) {
+        std::cerr << "Cannot resolve " << host << ": " << gai_strerror(error) << std::endl;
+        return false;
+    }
+    std::memcpy(&address, addresses->ai_addr, addresses->ai_addrlen);
+    length = addresses->ai_addrlen;
+    freeaddrinfo(addresses);
+    return true;
+}
+
+} // namespace
+
+RtpSocket::RtpSocket(EventLoop& loop, PacketHandler on_packet, uint32_t ssrc)
+    : loop_(loop), on_packet_(std::move(on_packet)), packetizer_(ssrc),
+      send_buffers_(kBatch * RtpPacketizer::kMaxPacketBytes),
+      receive_buffers_(kBatch * RtpPacketizer::kMaxPacketBytes) {
+}
+
+RtpSocket::~RtpSocket() {
+    close();
+}
+
+bool RtpSocket::open(const std::string& host, uint16_t local_port) {
+    close();
+
+    sockaddr_storage address{};
+    socklen_t length = 0;
+    if (!resolve(host, local_port, AI_PASSIVE | AI_NUMERICHOST, address, length)) {
+        return false;
+    }
+    int fd = socket(address.ss_family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        std::cerr << "Cannot create voice socket: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    if (address.ss_family == AF_INET) {
+        setsockopt(fd, IPPROTO_IP, IP_TOS, &kVoiceTos, sizeof(kVoiceTos));
+    } else {
+        setsockopt(fd, IPPROTO_IPV6, IPV6_TCLASS, &kVoiceTos, sizeof(kVoiceTos));
+    }
+    if (bind(fd, reinterpret_cast<sockaddr*>(&address), length) != 0) {
+        std::cerr << "Cannot bind voice socket to " << host << ":" << local_port << ": "
+                  << std::strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    local_port_ = ntohs(address.ss_family == AF_INET ? reinterpret_cast<sockaddr_in&>(address).sin_port
+                                                     : reinterpret_cast<sockaddr_in6&>(address).sin6_port);
+
+    if (!loop_.add_fd(fd, EPOLLIN, [this](uint32_t) { on_readable(); })) {
+        ::close(fd);
+        return false;
+    }
+    fd_ = fd;
+    return true;
+}
+
+void RtpSocket::close() {
+    if (fd_ < 0) {
+        return;
+    }
+    loop_.remove_fd(fd_);
+    ::close(fd_);
+    fd_ = -1;
+    local_port_ = 0;
+}
+
+bool RtpSocket::set_remote(const std::string& host, uint16_t port) {
+    return resolve(host, port, 0, remote_, remote_length_);
+}
+
+void RtpSocket::send(const EncodedFrame* frames, size_t count) {
+    if (fd_ < 0 || remote_length_ == 0) {
+        send_errors_.fetch_add(count, std::memory_order_relaxed);
+        return;
+    }
+    mmsghdr messages[kBatch];
+    iovec vectors[kBatch];
+    while (count > 0) {
+        unsigned batch = 0;
+        size_t bytes = 0;
+        for (; batch < kBatch && count > 0; ++frames, --count) {
+            uint8_t* packet = send_buffers_.data() + batch * RtpPacketizer::kMaxPacketBytes;
+            size_t size = packetizer_.packetize(*frames, packet, RtpPacketizer::kMaxPacketBytes);
+            if (size == 0) {
+                send_errors_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            vectors[batch] = { packet, size };
+            messages[batch] = mmsghdr{};
+            messages[batch].msg_hdr.msg_name = &remote_;
+            messages[batch].msg_hdr.msg_namelen = remote_length_;
+            messages[batch].msg_hdr.msg_iov = &vectors[batch];
+            messages[batch].msg_hdr.msg_iovlen = 1;
+            bytes += size;
+            ++batch;
+        }
+        if (batch == 0) {
+            continue;
+        }
+        int sent = sendmmsg(fd_, messages, batch, 0);
+        if (sent < 0) {
+            sent = 0;
+        }
+        if (static_cast<unsigned>(sent) < batch) {
+            send_errors_.fetch_add(batch - sent, std::memory_order_relaxed);
+            bytes = 0;
+            for (int i = 0; i < sent; ++i) {
+                bytes += vectors[i].iov_len;
+            }
+        }
+        packets_sent_.fetch_add(sent, std::memory_order_relaxed);
+        bytes_sent_.fetch_add(bytes, std::memory_order_relaxed);
+    }
+}
+
+void RtpSocket::on_readable() {
+    mmsghdr messages[kBatch];
+    iovec vectors[kBatch];
+    for (;;) {
+        for (size_t i = 0; i < kBatch; ++i) {
+            vectors[i] = { receive_buffers_.data() + i * RtpPacketizer::kMaxPacketBytes,
+                           RtpPacketizer::kMaxPacketBytes };
+            messages[i] = mmsghdr{};
+            messages[i].msg_hdr.msg_iov = &vectors[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+        int received = recvmmsg(fd_, messages, kBatch, MSG_DONTWAIT, nullptr);
+        if (received <= 0) {
+            return;
+        }
+        for (int i = 0; i < received; ++i) {
+            const uint8_t* data = static_cast<const uint8_t*>(vectors[i].iov_base);
+            size_t size = messages[i].msg_len;
+            RtpHeader header;
+            const uint8_t* payload = nullptr;
+            size_t payload_size = 0;
+            if ((messages[i].msg_hdr.msg_flags & MSG_TRUNC)
+                || !parse_rtp_packet(data, size, header, payload, payload_size)) {
+                malformed_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            packets_received_.fetch_add(1, std::memory_order_relaxed);
+            bytes_received_.fetch_add(size, std::memory_order_relaxed);
+            if (on_packet_) {
+                on_packet_(header, payload, payload_size);
+            }
+        }
+        if (static_cast<size_t>(received) < kBatch) {
+            return;
+        }
+    }
+}
+
+RtpSocket::Stats RtpSocket::get_stats() const {
+    Stats stats;
+    stats.packets_sent = packets_sent_.load(std::memory_order_relaxed);
+    stats.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+    stats.send_errors = send_errors_.load(std::memory_order_relaxed);
+    stats.packets_received = packets_received_.load(std::memory_order_relaxed);
+    stats.bytes_received = bytes_received_.load(std::memory_order_relaxed);
+    stats.malformed = malformed_.load(std::memory_order_relaxed);
+    return stats;
+}
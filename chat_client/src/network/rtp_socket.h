@@ -0,0 +1,81 @@
+#pragma once
+
+#include "rtp.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+class EventLoop;
+struct EncodedFrame;
+
+// A voice stream over UDP: encoded frames out as RTP packets to one peer,
+// and RTP packets in from any. Receiving runs on the loop thread, reading
+// up to kBatch datagrams per system call; the handler gets each valid
+// packet. send() packetizes a batch of frames into buffers made up front
+// and hands them to the kernel in one call, from whichever single thread
+// produces frames (the codec pipeline's sink). Datagrams are fire and
+// forget: ones the kernel will not take are counted and dropped.
+class RtpSocket {
+public:
+    using PacketHandler = std::function<void(const RtpHeader& header, const uint8_t* payload, size_t size)>;
+
+    static constexpr size_t kBatch = 16;
+
+    struct Stats {
+        uint64_t packets_sent = 0;
+        uint64_t bytes_sent = 0;
+        uint64_t send_errors = 0;
+        uint64_t packets_received = 0;
+        uint64_t bytes_received = 0;
+        uint64_t malformed = 0;
+    };
+
+    RtpSocket(EventLoop& loop, PacketHandler on_packet, uint32_t ssrc = 0);
+    ~RtpSocket();
+
+    RtpSocket(const RtpSocket&) = delete;
+    RtpSocket& operator=(const RtpSocket&) = delete;
+
+    // Binds to local_port on host (0 picks a free port) and starts
+    // receiving. Loop thread, or before the loop runs.
+    bool open(const std::string& host, uint16_t local_port);
+    void close();
+    uint16_t local_port() const { return local_port_; }
+
+    // Where send() goes; set before frames start flowing. Host names are
+    // resolved synchronously.
+    bool set_remote(const std::string& host, uint16_t port);
+
+    void send(const EncodedFrame* frames, size_t count);
+
+    uint32_t ssrc() const { return packetizer_.ssrc(); }
+    Stats get_stats() const;
+
+private:
+    void on_readable();
+
+    EventLoop& loop_;
+    PacketHandler on_packet_;
+    RtpPacketizer packetizer_;
+    int fd_ = -1;
+    uint16_t local_port_ = 0;
+    sockaddr_storage remote_{};
+    socklen_t remote_length_ = 0;
+
+    // One packet buffer per batch slot, each way
+    std::vector<uint8_t> send_buffers_;
+    std::vector<uint8_t> receive_buffers_;
+
+    std::atomic<uint64_t> packets_sent_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
+    std::atomic<uint64_t> send_errors_{0};
+    std::atomic<uint64_t> packets_received_{0};
+    std::atomic<uint64_t> bytes_received_{0};
+    std::atomic<uint64_t> malformed_{0};
+};
@@ -0,0 +1,964 @@
+#include "rtsp_server.h"
+#include "event_loop.h"
+#include "../audio/codec_pipeline.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <random>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t kQueuePackets = 64;      // Between a pipeline and the loop
+constexpr size_t kReadChunk = 4096;
+constexpr size_t kWriteBatch = 32;        // Interleaved frames per sendmsg
+constexpr unsigned kMaxMessages = 1024;   // Per sendmmsg, the kernel's UIO_MAXIOV
+constexpr unsigned kOpusClock = 48000;    // RFC 7587
+constexpr int kSendBufferBytes = 4 << 20; // Room for one packet to every UDP subscriber
+// Per connection, so a stalled TCP subscriber's backlog is in the history
+// rather than the kernel: a few seconds of audio at most
+constexpr int kConnectionSendBufferBytes = 64 << 10;
+
+const char* reason(int status) {
+    switch (status) {
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 454: return "Session Not Found";
+    case 455: return "Method Not Valid in This State";
+    case 459: return "Aggregate Operation Not Allowed";
+    case 461: return "Unsupported Transport";
+    case 501: return "Not Implemented";
+    case 505: return "RTSP Version Not Supported";
+    default: return "Error";
+    }
+}
+
+uint16_t port_of(const sockaddr_storage& address) {
+    return ntohs(address.ss_family == AF_INET ? reinterpret_cast<const sockaddr_in&>(address).sin_port
+                                              : reinterpret_cast<const sockaddr_in6&>(address).sin6_port);
+}
+
+void set_port(sockaddr_storage& address, uint16_t port) {
+    if (address.ss_family == AF_INET) {
+        reinterpret_cast<sockaddr_in&>(address).sin_port = htons(port);
+    } else {
+        reinterpret_cast<sockaddr_in6&>(address).sin6_port = htons(port);
+    }
+}
+
+std::string trim(const std::string& text, size_t begin, size_t end) {
+    while (begin < end && (text[begin] == ' ' || text[begin] == '\t')) {
+        ++begin;
+    }
+    while (end > begin && (text[end - 1] == ' ' || text[end - 1] == '\t' || text[end - 1] == '\r')) {
+        --end;
+    }
+    return text.substr(begin, end - begin);
+}
+
+// The path of an rtsp:// URL, or the URL itself if it is already one
+std::string url_path(const std::string& url) {
+    std::string path = url;
+    if (url.size() > 7 && strncasecmp(url.c_str(), "rtsp://", 7) == 0) {
+        size_t slash = url.find('/', 7);
+        path = slash == std::string::npos ? "/" : url.substr(slash);
+    }
+    path = path.substr(0, path.find('?'));
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    return path;
+}
+
+// "a-b" or "a" after name= in a transport spec; false when absent
+bool port_range(const std::string& spec, const char* name, unsigned& first, unsigned& second) {
+    std::string key = std::string(name) + "=";
+    size_t at = 0;
+    while ((at = spec.find(key, at)) != std::string::npos) {
+        if (at == 0 || spec[at - 1] == ';') {
+            int count = std::sscanf(spec.c_str() + at + key.size(), "%u-%u", &first, &second);
+            if (count < 1 || first > 65535) {
+                return false;
+            }
+            if (count < 2) {
+                second = first + 1;
+            }
+            return true;
+        }
+        at += key.size();
+    }
+    return false;
+}
+
+} // namespace
+
+struct RtspServer::Stream {
+    Stream(RtspServer& server, const std::string& mount, const CodecSettings& settings)
+        : path(mount),
+          pipeline(std::make_unique<AudioEncodePipeline>(
+              settings, [&server, this](const EncodedFrame* frames, size_t count) {
+                  server.on_frames(*this, frames, count);
+              })),
+          opus(std::strcmp(pipeline->codec_name(), "opus") == 0),
+          clock_rate(opus ? kOpusClock : std::max(1u, pipeline->sample_rate())),
+          packetizer(0, clock_rate / std::max(1u, pipeline->sample_rate())),
+          frame_ticks(pipeline->frame_samples() * packetizer.clock_multiplier()),
+          queue(kQueuePackets), history(kHistoryPackets) {}
+
+    std::string path;
+    std::unique_ptr<AudioEncodePipeline> pipeline;
+    bool opus;
+    unsigned clock_rate;  // Of the RTP timestamps
+    RtpPacketizer packetizer;
+    uint32_t frame_ticks;
+    SpscRingBuffer<Packet> queue;
+
+    // Loop thread
+    std::vector<Packet> history;  // Packet n in slot n % kHistoryPackets
+    uint64_t published = 0;       // Packets ever put in history
+    RtpHeader newest;             // Of the last packet published
+    std::vector<Connection*> datagram_subscribers;
+    std::vector<Connection*> interleaved_subscribers;
+};
+
+struct RtspServer::Connection {
+    int fd = -1;
+    size_t index = 0;  // In connections_
+    sockaddr_storage peer{};
+    socklen_t peer_length = 0;
+    std::string inbox;
+    // Responses, and the rest of a frame the socket only took part of
+    std::string outbox;
+    size_t outbox_sent = 0;
+    bool want_write = false;
+    Clock::time_point last_request;
+
+    // The session, if one is set up
+    std::string session;
+    Stream* stream = nullptr;
+    bool interleaved = false;
+    uint8_t channel = 0;
+    unsigned client_ports[2] = {};
+    sockaddr_storage destination{};
+    socklen_t destination_length = 0;
+    bool playing = false;
+    uint64_t cursor = 0;  // Next history packet for an interleaved session
+};
+
+struct RtspServer::Request {
+    std::string method;
+    std::string url;
+    std::string version;
+    std::string cseq;
+    std::string session;
+    std::string transport;
+};
+
+RtspServer::RtspServer(EventLoop& loop) : loop_(loop) {
+    std::random_device random;
+    session_base_ = uint64_t(random()) << 32 | random();
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0 || !loop_.add_fd(wakeup_fd_, EPOLLIN, [this](uint32_t) { on_wakeup(); })) {
+        std::cerr << "Cannot create RTSP wakeup descriptor: " << std::strerror(errno) << std::endl;
+    }
+}
+
+RtspServer::~RtspServer() {
+    close();
+    // No pipeline may touch the wakeup descriptor once it is gone
+    for (auto& stream : streams_) {
+        stream->pipeline->stop();
+    }
+    if (wakeup_fd_ >= 0) {
+        loop_.remove_fd(wakeup_fd_);
+        ::close(wakeup_fd_);
+    }
+}
+
+AudioEncodePipeline* RtspServer::add_stream(const std::string& path, const CodecSettings& settings) {
+    std::string mount = url_path(path);
+    for (auto& stream : streams_) {
+        if (stream->path == mount) {
+            std::cerr << "RTSP path " << mount << " is already served" << std::endl;
+            return nullptr;
+        }
+    }
+    auto stream = std::make_unique<Stream>(*this, mount, settings);
+    if (!stream->pipeline->valid()) {
+        return nullptr;
+    }
+    AudioEncodePipeline* pipeline = stream->pipeline.get();
+    streams_.push_back(std::move(stream));
+    pipeline->start();
+    return pipeline;
+}
+
+bool RtspServer::listen(const std::string& host, uint16_t port) {
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST;
+    addrinfo* addresses = nullptr;
+    std::string service = std::to_string(port);
+    int error = getaddrinfo(host.empty() ? nullptr : host.c_str(), service.c_str(), &hints, &addresses);
+    if (error != 0) {
+        std::cerr << "Cannot resolve " << host << ": " << gai_strerror(error) << std::endl;
+        return false;
+    }
+    int family = addresses->ai_family;
+    int fd = socket(family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    bool ok = fd >= 0
+        && setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) == 0
+        && bind(fd, addresses->ai_addr, addresses->ai_addrlen) == 0
+        && ::listen(fd, SOMAXCONN) == 0;
+    freeaddrinfo(addresses);
+    if (!ok) {
+        std::cerr << "Cannot listen for RTSP on " << host << ":" << port << ": "
+                  << std::strerror(errno) << std::endl;
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    if (!loop_.add_fd(fd, EPOLLIN, [this, fd](uint32_t) { on_accept(fd); })) {
+        ::close(fd);
+        return false;
+    }
+    sockaddr_storage address{};
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr*>(&address), &length);
+    listeners_.push_back(fd);
+    ports_.push_back(port_of(address));
+
+    if (rtp_fd_ < 0 && !open_media_sockets(family)) {
+        std::cerr << "RTSP over UDP is unavailable, TCP only" << std::endl;
+    }
+    if (!timeout_timer_) {
+        timeout_timer_ = loop_.add_timer(1000, [this] { expire_sessions(); }, 1000);
+    }
+    return true;
+}
+
+std::vector<uint16_t> RtspServer::ports() const {
+    return ports_;
+}
+
+bool RtspServer::open_media_sockets(int family) {
+    // RTP on an even port and RTCP on the next (RFC 3550), both of the
+    // listener's family so they can reach its clients
+    for (int attempt = 0; attempt < 16; ++attempt) {
+        int rtp = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (rtp < 0) {
+            return false;
+        }
+        sockaddr_storage address{};
+        address.ss_family = static_cast<sa_family_t>(family);
+        socklen_t length = family == AF_INET ? sizeof(sockaddr_in) : sizeof(sockaddr_in6);
+        if (bind(rtp, reinterpret_cast<sockaddr*>(&address), length) != 0) {
+            ::close(rtp);
+            return false;
+        }
+        getsockname(rtp, reinterpret_cast<sockaddr*>(&address), &length);
+        uint16_t port = port_of(address);
+        if (port % 2 != 0 || port == 65534) {
+            ::close(rtp);
+            continue;
+        }
+        int rtcp = socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        set_port(address, static_cast<uint16_t>(port + 1));
+        if (rtcp < 0 || bind(rtcp, reinterpret_cast<sockaddr*>(&address), length) != 0) {
+            if (rtcp >= 0) {
+                ::close(rtcp);
+            }
+            ::close(rtp);
+            continue;
+        }
+        setsockopt(rtp, SOL_SOCKET, SO_SNDBUF, &kSendBufferBytes, sizeof(kSendBufferBytes));
+        loop_.add_fd(rtcp, EPOLLIN, [rtcp](uint32_t) {
+            char report[1500];
+            while (recv(rtcp, report, sizeof(report), MSG_DONTWAIT) >= 0) {
+            }
+        });
+        rtp_fd_ = rtp;
+        rtcp_fd_ = rtcp;
+        rtp_family_ = family;
+        rtp_port_ = port;
+        return true;
+    }
+    return false;
+}
+
+void RtspServer::close() {
+    while (!connections_.empty()) {
+        close_connection(*connections_.back());
+    }
+    for (int fd : listeners_) {
+        loop_.remove_fd(fd);
+        ::close(fd);
+    }
+    listeners_.clear();
+    ports_.clear();
+    if (rtcp_fd_ >= 0) {
+        loop_.remove_fd(rtcp_fd_);
+        ::close(rtcp_fd_);
+        ::close(rtp_fd_);
+        rtp_fd_ = rtcp_fd_ = -1;
+        rtp_port_ = 0;
+    }
+    if (timeout_timer_) {
+        loop_.cancel_timer(timeout_timer_);
+        timeout_timer_ = 0;
+    }
+}
+
+void RtspServer::on_frames(Stream& stream, const EncodedFrame* frames, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        Packet* packet = stream.queue.write_slot();
+        if (!packet) {
+            queue_overflows_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        packet->size = static_cast<uint16_t>(
+            stream.packetizer.packetize(frames[i], packet->data, sizeof(packet->data)));
+        stream.queue.publish();
+        packets_encoded_.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (count > 0 && !wakeup_pending_.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void RtspServer::on_wakeup() {
+    uint64_t count = 0;
+    ssize_t drained = read(wakeup_fd_, &count, sizeof(count));
+    (void)drained;
+    // Cleared before draining, so packets queued from here on wake us again
+    wakeup_pending_.store(false);
+    for (auto& stream : streams_) {
+        while (const Packet* packet = stream->queue.read_slot()) {
+            if (packet->size > 0) {
+                publish(*stream, *packet);
+            }
+            stream->queue.release();
+        }
+    }
+}
+
+void RtspServer::publish(Stream& stream, const Packet& packet) {
+    Packet& slot = stream.history[stream.published % kHistoryPackets];
+    slot.size = packet.size;
+    std::memcpy(slot.data, packet.data, packet.size);
+    ++stream.published;
+    const uint8_t* payload = nullptr;
+    size_t payload_size = 0;
+    parse_rtp_packet(slot.data, slot.size, stream.newest, payload, payload_size);
+
+    send_datagrams(stream, slot);
+    // Backwards, as a connection that fails is swapped out for the last
+    for (size_t i = stream.interleaved_subscribers.size(); i-- > 0;) {
+        flush(*stream.interleaved_subscribers[i]);
+    }
+}
+
+void RtspServer::send_datagrams(Stream& stream, const Packet& packet) {
+    const size_t count = stream.datagram_subscribers.size();
+    if (count == 0) {
+        return;
+    }
+    iovec vector{ const_cast<uint8_t*>(packet.data), packet.size };
+    for (size_t i = 0; i < count; ++i) {
+        Connection* connection = stream.datagram_subscribers[i];
+        messages_[i] = mmsghdr{};
+        messages_[i].msg_hdr.msg_name = &connection->destination;
+        messages_[i].msg_hdr.msg_namelen = connection->destination_length;
+        messages_[i].msg_hdr.msg_iov = &vector;
+        messages_[i].msg_hdr.msg_iovlen = 1;
+    }
+    size_t offset = 0;
+    uint64_t sent = 0;
+    while (offset < count) {
+        unsigned batch = static_cast<unsigned>(std::min<size_t>(count - offset, kMaxMessages));
+        int result = sendmmsg(rtp_fd_, messages_.data() + offset, batch, 0);
+        if (result <= 0) {
+            // Pass over the one the kernel refused and carry on with the rest
+            send_errors_.fetch_add(1, std::memory_order_relaxed);
+            ++offset;
+            continue;
+        }
+        offset += result;
+        sent += result;
+    }
+    packets_sent_.fetch_add(sent, std::memory_order_relaxed);
+    bytes_sent_.fetch_add(sent * packet.size, std::memory_order_relaxed);
+}
+
+void RtspServer::on_accept(int listener) {
+    for (;;) {
+        auto connection = std::make_unique<Connection>();
+        connection->peer_length = sizeof(connection->peer);
+        int fd = accept4(listener, reinterpret_cast<sockaddr*>(&connection->peer), &connection->peer_length,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        if (connections_.size() >= kMaxConnections) {
+            rejected_.fetch_add(1, std::memory_order_relaxed);
+            ::close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &kConnectionSendBufferBytes, sizeof(kConnectionSendBufferBytes));
+        Connection* raw = connection.get();
+        if (!loop_.add_fd(fd, EPOLLIN, [this, raw](uint32_t events) { on_connection_events(*raw, events); })) {
+            ::close(fd);
+            continue;
+        }
+        connection->fd = fd;
+        connection->index = connections_.size();
+        connection->last_request = Clock::now();
+        connections_.push_back(std::move(connection));
+        connection_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RtspServer::on_connection_events(Connection& connection, uint32_t events) {
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        if (!handle_requests(connection)) {
+            return;
+        }
+    }
+    if (events & EPOLLOUT) {
+        flush(connection);
+    }
+}
+
+bool RtspServer::handle_requests(Connection& connection) {
+    char buffer[kReadChunk];
+    for (;;) {
+        ssize_t received = recv(connection.fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (received > 0) {
+            connection.inbox.append(buffer, static_cast<size_t>(received));
+            if (static_cast<size_t>(received) < sizeof(buffer)) {
+                break;
+            }
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        close_connection(connection);
+        return false;
+    }
+
+    std::string& inbox = connection.inbox;
+    size_t offset = 0;
+    while (offset < inbox.size()) {
+        if (inbox[offset] == '$') {
+            // An interleaved frame from the client, RTCP in practice
+            if (inbox.size() - offset < 4) {
+                break;
+            }
+            size_t length = size_t(uint8_t(inbox[offset + 2])) << 8 | uint8_t(inbox[offset + 3]);
+            if (inbox.size() - offset < 4 + length) {
+                break;
+            }
+            offset += 4 + length;
+            connection.last_request = Clock::now();
+            continue;
+        }
+        size_t end = inbox.find("\r\n\r\n", offset);
+        if (end == std::string::npos) {
+            break;
+        }
+
+        Request request;
+        size_t content_length = 0;
+        size_t line_end = inbox.find("\r\n", offset);
+        std::string line = inbox.substr(offset, line_end - offset);
+        size_t first = line.find(' ');
+        size_t second = first == std::string::npos ? first : line.find(' ', first + 1);
+        if (second != std::string::npos) {
+            request.method = line.substr(0, first);
+            request.url = line.substr(first + 1, second - first - 1);
+            request.version = line.substr(second + 1);
+        }
+        for (size_t at = line_end + 2; at < end + 2;) {
+            size_t next = inbox.find("\r\n", at);
+            size_t colon = inbox.find(':', at);
+            if (colon < next) {
+                std::string name = trim(inbox, at, colon);
+                std::string value = trim(inbox, colon + 1, next);
+                if (strcasecmp(name.c_str(), "CSeq") == 0) {
+                    request.cseq = value;
+                } else if (strcasecmp(name.c_str(), "Session") == 0) {
+                    request.session = value.substr(0, value.find(';'));
+                } else if (strcasecmp(name.c_str(), "Transport") == 0) {
+                    request.transport = value;
+                } else if (strcasecmp(name.c_str(), "Content-Length") == 0) {
+                    content_length = std::strtoul(value.c_str(), nullptr, 10);
+                }
+            }
+            at = next + 2;
+        }
+        if (content_length > kMaxRequestBytes) {
+            bad_requests_.fetch_add(1, std::memory_order_relaxed);
+            close_connection(connection);
+            return false;
+        }
+        if (inbox.size() - (end + 4) < content_length) {
+            break;  // The body is still on its way
+        }
+        offset = end + 4 + content_length;
+
+        requests_.fetch_add(1, std::memory_order_relaxed);
+        connection.last_request = Clock::now();
+        handle(connection, request);
+    }
+    inbox.erase(0, offset);
+    if (inbox.size() > kMaxRequestBytes) {
+        bad_requests_.fetch_add(1, std::memory_order_relaxed);
+        close_connection(connection);
+        return false;
+    }
+    return flush(connection);
+}
+
+void RtspServer::handle(Connection& connection, const Request& request) {
+    if (request.method.empty() || request.cseq.empty()) {
+        respond(connection, request, 400);
+        return;
+    }
+    if (request.version.compare(0, 7, "RTSP/1.") != 0) {
+        respond(connection, request, 505);
+        return;
+    }
+    const std::string& method = request.method;
+    if (method == "OPTIONS") {
+        respond(connection, request, 200,
+                "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER, SET_PARAMETER\r\n");
+        return;
+    }
+    if (method == "DESCRIBE") {
+        bool track = false;
+        Stream* stream = find_stream(request.url, track);
+        if (!stream || track) {
+            respond(connection, request, 404);
+            return;
+        }
+        std::string base = request.url;
+        if (base.empty() || base.back() != '/') {
+            base += '/';
+        }
+        respond(connection, request, 200,
+                "Content-Base: " + base + "\r\nContent-Type: application/sdp\r\n",
+                describe(*stream));
+        return;
+    }
+    if (method == "SETUP") {
+        bool track = false;
+        Stream* stream = find_stream(request.url, track);
+        if (!stream) {
+            respond(connection, request, 404);
+            return;
+        }
+        setup(connection, request, *stream);
+        return;
+    }
+    if (method != "PLAY" && method != "PAUSE" && method != "TEARDOWN"
+        && method != "GET_PARAMETER" && method != "SET_PARAMETER") {
+        respond(connection, request, 501);
+        return;
+    }
+
+    // The rest act on the session, if any
+    if (!request.session.empty() && request.session != connection.session) {
+        respond(connection, request, 454);
+        return;
+    }
+    if (method == "PLAY") {
+        play(connection, request);
+    } else if (method == "PAUSE") {
+        if (connection.session.empty()) {
+            respond(connection, request, 454);
+            return;
+        }
+        pause(connection);
+        respond(connection, request, 200);
+    } else if (method == "TEARDOWN") {
+        respond(connection, request, 200);
+        end_session(connection);
+    } else {
+        // Keep-alive
+        respond(connection, request, 200);
+    }
+}
+
+void RtspServer::respond(Connection& connection, const Request& request, int status,
+                         const std::string& headers, const std::string& body) {
+    if (status != 200) {
+        bad_requests_.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::string& out = connection.outbox;
+    out += "RTSP/1.0 ";
+    out += std::to_string(status);
+    out += ' ';
+    out += reason(status);
+    out += "\r\n";
+    if (!request.cseq.empty()) {
+        out += "CSeq: " + request.cseq + "\r\n";
+    }
+    if (!connection.session.empty()) {
+        out += "Session: " + connection.session + ";timeout=" + std::to_string(kSessionTimeoutS) + "\r\n";
+    }
+    out += "Server: chat_client\r\n";
+    out += headers;
+    if (!body.empty()) {
+        out += "Content-Length: " + std::to_string(body.size()) + "\r\n";
+    }
+    out += "\r\n";
+    out += body;
+}
+
+RtspServer::Stream* RtspServer::find_stream(const std::string& url, bool& track) const {
+    std::string path = url_path(url);
+    for (const auto& stream : streams_) {
+        if (path == stream->path) {
+            track = false;
+            return stream.get();
+        }
+        // A control URL under the stream, from the SDP's a=control
+        if (path.size() > stream->path.size() && path.compare(0, stream->path.size(), stream->path) == 0
+            && path[stream->path.size()] == '/') {
+            track = true;
+            return stream.get();
+        }
+    }
+    return nullptr;
+}
+
+std::string RtspServer::describe(const Stream& stream) const {
+    const AudioEncodePipeline& pipeline = *stream.pipeline;
+    std::string clock = std::to_string(stream.clock_rate);
+    std::string sdp;
+    sdp += "v=0\r\n";
+    sdp += "o=- " + std::to_string(stream.packetizer.ssrc()) + " 1 IN IP4 0.0.0.0\r\n";
+    sdp += "s=" + stream.path + "\r\n";
+    sdp += "c=IN IP4 0.0.0.0\r\n";
+    sdp += "t=0 0\r\n";
+    sdp += "a=control:*\r\n";
+    sdp += "a=range:npt=0-\r\n";
+    sdp += "m=audio 0 RTP/AVP " + std::to_string(RtpPacketizer::kAudioPayloadType) + " "
+         + std::to_string(RtpPacketizer::kComfortNoisePayloadType) + "\r\n";
+    if (stream.opus) {
+        sdp += "a=rtpmap:111 opus/48000/2\r\n";
+        sdp += "a=fmtp:111 useinbandfec=1;usedtx=1\r\n";
+    } else {
+        // Not a registered payload format; for peers running this client
+        sdp += "a=rtpmap:111 X-" + std::string(pipeline.codec_name()) + "/" + clock + "\r\n";
+    }
+    sdp += "a=rtpmap:13 CN/" + clock + "\r\n";
+    sdp += "a=ptime:" + std::to_string(pipeline.frame_samples() * 1000 / pipeline.sample_rate()) + "\r\n";
+    sdp += "a=control:trackID=0\r\n";
+    return sdp;
+}
+
+void RtspServer::setup(Connection& connection, const Request& request, Stream& stream) {
+    if (!connection.session.empty()) {
+        if (request.session != connection.session) {
+            respond(connection, request, 454);
+            return;
+        }
+        if (connection.stream != &stream) {
+            // One stream per connection; aggregating them is not supported
+            respond(connection, request, 459);
+            return;
+        }
+    }
+    if (connection.playing) {
+        respond(connection, request, 455);
+        return;
+    }
+
+    // The first transport offered that we can do
+    bool chosen = false;
+    size_t begin = 0;
+    while (!chosen && begin <= request.transport.size()) {
+        size_t end = request.transport.find(',', begin);
+        if (end == std::string::npos) {
+            end = request.transport.size();
+        }
+        std::string spec = trim(request.transport, begin, end);
+        begin = end + 1;
+        unsigned first = 0;
+        unsigned second = 0;
+        if (spec.compare(0, 11, "RTP/AVP/TCP") == 0) {
+            if (!port_range(spec, "interleaved", first, second)) {
+                first = 0;
+                second = 1;
+            }
+            if (first > 255 || second > 255) {
+                continue;
+            }
+            connection.interleaved = true;
+            connection.channel = static_cast<uint8_t>(first);
+            connection.client_ports[0] = first;
+            connection.client_ports[1] = second;
+            chosen = true;
+        } else if ((spec == "RTP/AVP" || spec.compare(0, 8, "RTP/AVP;") == 0 || spec.compare(0, 11, "RTP/AVP/UDP") == 0)
+                   && spec.find("multicast") == std::string::npos
+                   && port_range(spec, "client_port", first, second)
+                   && rtp_fd_ >= 0) {
+            if (connection.peer.ss_family != rtp_family_) {
+                continue;  // A client of a listener on the other family
+            }
+            connection.interleaved = false;
+            connection.destination = connection.peer;
+            connection.destination_length = connection.peer_length;
+            set_port(connection.destination, static_cast<uint16_t>(first));
+            connection.client_ports[0] = first;
+            connection.client_ports[1] = second;
+            chosen = true;
+        }
+    }
+    if (!chosen) {
+        respond(connection, request, 461);
+        return;
+    }
+
+    if (connection.session.empty()) {
+        char id[17];
+        std::snprintf(id, sizeof(id), "%016llx", static_cast<unsigned long long>(session_base_ + next_session_++));
+        connection.session = id;
+    }
+    connection.stream = &stream;
+
+    char ssrc[9];
+    std::snprintf(ssrc, sizeof(ssrc), "%08X", stream.packetizer.ssrc());
+    std::string transport = "Transport: ";
+    if (connection.interleaved) {
+        transport += "RTP/AVP/TCP;unicast;interleaved=" + std::to_string(connection.client_ports[0]) + "-"
+                   + std::to_string(connection.client_ports[1]);
+    } else {
+        transport += "RTP/AVP;unicast;client_port=" + std::to_string(connection.client_ports[0]) + "-"
+                   + std::to_string(connection.client_ports[1]) + ";server_port=" + std::to_string(rtp_port_)
+                   + "-" + std::to_string(rtp_port_ + 1);
+    }
+    transport += ";ssrc=";
+    transport += ssrc;
+    transport += "\r\n";
+    respond(connection, request, 200, transport);
+}
+
+void RtspServer::play(Connection& connection, const Request& request) {
+    if (connection.session.empty()) {
+        respond(connection, request, 454);
+        return;
+    }
+    Stream& stream = *connection.stream;
+    std::string headers = "Range: npt=0.000-\r\n";
+    if (stream.published > 0) {
+        // Where the client's first packet will be
+        headers += "RTP-Info: url=" + request.url + ";seq=" + std::to_string(uint16_t(stream.newest.sequence + 1))
+                 + ";rtptime=" + std::to_string(uint32_t(stream.newest.timestamp + stream.frame_ticks)) + "\r\n";
+    }
+    respond(connection, request, 200, headers);
+    if (connection.playing) {
+        return;
+    }
+    connection.playing = true;
+    playing_.fetch_add(1, std::memory_order_relaxed);
+    if (connection.interleaved) {
+        connection.cursor = stream.published;
+        stream.interleaved_subscribers.push_back(&connection);
+    } else {
+        stream.datagram_subscribers.push_back(&connection);
+        if (messages_.size() < stream.datagram_subscribers.size()) {
+            messages_.resize(stream.datagram_subscribers.size());
+        }
+    }
+}
+
+void RtspServer::pause(Connection& connection) {
+    if (!connection.playing) {
+        return;
+    }
+    connection.playing = false;
+    playing_.fetch_sub(1, std::memory_order_relaxed);
+    auto& subscribers = connection.interleaved ? connection.stream->interleaved_subscribers
+                                               : connection.stream->datagram_subscribers;
+    auto found = std::find(subscribers.begin(), subscribers.end(), &connection);
+    if (found != subscribers.end()) {
+        *found = subscribers.back();
+        subscribers.pop_back();
+    }
+}
+
+void RtspServer::end_session(Connection& connection) {
+    pause(connection);
+    connection.session.clear();
+    connection.stream = nullptr;
+}
+
+bool RtspServer::flush(Connection& connection) {
+    // Responses and any partly written frame first
+    while (connection.outbox_sent < connection.outbox.size()) {
+        ssize_t sent = ::send(connection.fd, connection.outbox.data() + connection.outbox_sent,
+                              connection.outbox.size() - connection.outbox_sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                update_interest(connection, true);
+                return true;
+            }
+            close_connection(connection);
+            return false;
+        }
+        connection.outbox_sent += static_cast<size_t>(sent);
+    }
+    connection.outbox.clear();
+    connection.outbox_sent = 0;
+
+    if (!connection.playing || !connection.interleaved) {
+        update_interest(connection, false);
+        return true;
+    }
+    Stream& stream = *connection.stream;
+    if (stream.published - connection.cursor > kHistoryPackets) {
+        // Too slow to keep up; rejoin at the newest packet
+        uint64_t live = stream.published - 1;
+        packets_skipped_.fetch_add(live - connection.cursor, std::memory_order_relaxed);
+        connection.cursor = live;
+    }
+    while (connection.cursor < stream.published) {
+        uint8_t prefixes[kWriteBatch][4];
+        iovec vectors[2 * kWriteBatch];
+        size_t frames = 0;
+        size_t total = 0;
+        for (uint64_t next = connection.cursor; next < stream.published && frames < kWriteBatch; ++next, ++frames) {
+            const Packet& packet = stream.history[next % kHistoryPackets];
+            prefixes[frames][0] = '$';
+            prefixes[frames][1] = connection.channel;
+            prefixes[frames][2] = static_cast<uint8_t>(packet.size >> 8);
+            prefixes[frames][3] = static_cast<uint8_t>(packet.size);
+            vectors[2 * frames] = { prefixes[frames], 4 };
+            vectors[2 * frames + 1] = { const_cast<uint8_t*>(packet.data), packet.size };
+            total += 4 + packet.size;
+        }
+        msghdr message{};
+        message.msg_iov = vectors;
+        message.msg_iovlen = 2 * frames;
+        ssize_t sent = sendmsg(connection.fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                update_interest(connection, true);
+                return true;
+            }
+            close_connection(connection);
+            return false;
+        }
+        // Whole frames are done with; the rest of a partial one is copied
+        // out, as its history slot may be reused before the socket drains
+        size_t left = static_cast<size_t>(sent);
+        for (size_t i = 0; i < frames && left > 0; ++i) {
+            const iovec* parts = &vectors[2 * i];
+            if (left < parts[0].iov_len + parts[1].iov_len) {
+                for (size_t part = 0; part < 2; ++part) {
+                    size_t skip = std::min(left, parts[part].iov_len);
+                    connection.outbox.append(static_cast<const char*>(parts[part].iov_base) + skip,
+                                             parts[part].iov_len - skip);
+                    left -= skip;
+                }
+            } else {
+                left -= parts[0].iov_len + parts[1].iov_len;
+            }
+            ++connection.cursor;
+            packets_sent_.fetch_add(1, std::memory_order_relaxed);
+            bytes_sent_.fetch_add(parts[1].iov_len, std::memory_order_relaxed);
+        }
+        if (static_cast<size_t>(sent) < total) {
+            update_interest(connection, true);
+            return true;
+        }
+    }
+    update_interest(connection, false);
+    return true;
+}
+
+void RtspServer::update_interest(Connection& connection, bool want_write) {
+    if (connection.want_write != want_write) {
+        connection.want_write = want_write;
+        loop_.modify_fd(connection.fd, want_write ? EPOLLIN | EPOLLOUT : EPOLLIN);
+    }
+}
+
+void RtspServer::close_connection(Connection& connection) {
+    end_session(connection);
+    loop_.remove_fd(connection.fd);
+    ::close(connection.fd);
+    connection.fd = -1;
+    connection_count_.fetch_sub(1, std::memory_order_relaxed);
+
+    size_t index = connection.index;
+    if (index + 1 != connections_.size()) {
+        std::swap(connections_[index], connections_.back());
+        connections_[index]->index = index;
+    }
+    connections_.pop_back();  // Destroys connection
+}
+
+void RtspServer::expire_sessions() {
+    const Clock::time_point now = Clock::now();
+    const auto timeout = std::chrono::seconds(kSessionTimeoutS);
+    // Backwards, as closing swaps the last connection into the gap
+    for (size_t i = connections_.size(); i-- > 0;) {
+        Connection& connection = *connections_[i];
+        bool streaming = connection.playing && connection.interleaved;
+        if (!streaming && now - connection.last_request > timeout) {
+            timeouts_.fetch_add(1, std::memory_order_relaxed);
+            close_connection(connection);
+        }
+    }
+}
+
+RtspServer::Stats RtspServer::get_stats() const {
+    Stats stats;
+    stats.connections = connection_count_.load(std::memory_order_relaxed);
+    stats.playing = playing_.load(std::memory_order_relaxed);
+    stats.requests = requests_.load(std::memory_order_relaxed);
+    stats.bad_requests = bad_requests_.load(std::memory_order_relaxed);
+    stats.rejected = rejected_.load(std::memory_order_relaxed);
+    stats.timeouts = timeouts_.load(std::memory_order_relaxed);
+    stats.packets_encoded = packets_encoded_.load(std::memory_order_relaxed);
+    stats.packets_sent = packets_sent_.load(std::memory_order_relaxed);
+    stats.bytes_sent = bytes_sent_.load(std::memory_order_relaxed);
+    stats.send_errors = send_errors_.load(std::memory_order_relaxed);
+    stats.packets_skipped = packets_skipped_.load(std::memory_order_relaxed);
+    stats.queue_overflows = queue_overflows_.load(std::memory_order_relaxed);
+    return stats;
+}
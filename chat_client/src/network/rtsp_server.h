@@ -0,0 +1,153 @@
+#pragma once
+
+#include "rtp.h"
+#include "../audio/audio_codec.h"
+#include "../utils/spsc_ring_buffer.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+
+class AudioEncodePipeline;
+class EventLoop;
+struct EncodedFrame;
+
+// One stream as configured under config/device_streams.yaml's rtsp protocols
+struct RtspMount {
+    std::string path;  // "/mic/default"
+    uint16_t port = 8554;
+    CodecSettings codec;
+};
+
+// In-process RTSP server (RFC 2326) for live audio, on an EventLoop.
+//
+// Each stream is encoded once, by its own AudioEncodePipeline fed from the
+// engine, and every packet is packetized once into the stream's history on
+// the loop thread. Subscribers all see the same packets, SSRC and sequence
+// numbers included, so fanning out copies nothing: UDP subscribers get a
+// packet through one sendmmsg() call pointing every message at the same
+// buffer, and TCP interleaved ones are just cursors into the history,
+// written with sendmsg() as their sockets drain. Their kernel send buffers
+// are kept small, so a TCP subscriber that stalls holds up no more than
+// that; one that falls more than kHistoryPackets behind skips ahead to live.
+//
+// A session belongs to the connection that set it up and ends with it,
+// or after kSessionTimeoutS without a request (UDP sessions; TCP ones
+// carry their own traffic). UDP packets only go to the address of the
+// connection's peer, never to a destination the client names.
+//
+// Everything runs on the loop thread except the pipelines, which hand
+// packets over through a wait-free ring and wake the loop through an
+// eventfd. Set the server up before the loop runs or on its thread, and
+// take the streams' consumers out of the engine before destroying it.
+class RtspServer {
+public:
+    static constexpr size_t kHistoryPackets = 256;    // About 5 s of 20 ms frames
+    static constexpr size_t kMaxConnections = 4096;
+    static constexpr size_t kMaxRequestBytes = 8192;
+    static constexpr unsigned kSessionTimeoutS = 60;
+
+    struct Stats {
+        uint64_t connections = 0;      // Open now
+        uint64_t playing = 0;          // Subscribers receiving now
+        uint64_t requests = 0;
+        uint64_t bad_requests = 0;     // Answered with an error
+        uint64_t rejected = 0;         // Connections refused over kMaxConnections
+        uint64_t timeouts = 0;         // Sessions ended for lack of requests
+        uint64_t packets_encoded = 0;  // Once per stream
+        uint64_t packets_sent = 0;     // Once per subscriber
+        uint64_t bytes_sent = 0;
+        uint64_t send_errors = 0;
+        uint64_t packets_skipped = 0;  // Passed over by slow TCP subscribers
+        uint64_t queue_overflows = 0;  // Dropped between a pipeline and the loop
+    };
+
+    explicit RtspServer(EventLoop& loop);
+    ~RtspServer();
+
+    RtspServer(const RtspServer&) = delete;
+    RtspServer& operator=(const RtspServer&) = delete;
+
+    // Encodes a stream with settings and serves it at path on every port.
+    // Register the returned pipeline's consumer with the engine at its
+    // sample_rate(); null if the codec cannot be set up or the path is taken.
+    AudioEncodePipeline* add_stream(const std::string& path, const CodecSettings& settings);
+    // Accepts connections on host:port (0 picks a free port); once per port
+    bool listen(const std::string& host, uint16_t port);
+    std::vector<uint16_t> ports() const;
+    // Drops every client and stops listening
+    void close();
+
+    // Any thread
+    Stats get_stats() const;
+
+private:
+    struct Packet {
+        uint16_t size = 0;
+        uint8_t data[RtpPacketizer::kMaxPacketBytes];
+    };
+    struct Stream;
+    struct Connection;
+    struct Request;
+
+    // Pipeline threads
+    void on_frames(Stream& stream, const EncodedFrame* frames, size_t count);
+
+    // Loop thread
+    bool open_media_sockets(int family);
+    void on_wakeup();
+    void on_accept(int listener);
+    void on_connection_events(Connection& connection, uint32_t events);
+    // Reads and answers; false if the connection closed and is gone
+    bool handle_requests(Connection& connection);
+    void handle(Connection& connection, const Request& request);
+    void respond(Connection& connection, const Request& request, int status,
+                 const std::string& headers = std::string(), const std::string& body = std::string());
+    void setup(Connection& connection, const Request& request, Stream& stream);
+    void play(Connection& connection, const Request& request);
+    void pause(Connection& connection);
+    void end_session(Connection& connection);
+    Stream* find_stream(const std::string& url, bool& track) const;
+    std::string describe(const Stream& stream) const;
+    void publish(Stream& stream, const Packet& packet);
+    void send_datagrams(Stream& stream, const Packet& packet);
+    // False if the connection failed and is gone
+    bool flush(Connection& connection);
+    void update_interest(Connection& connection, bool want_write);
+    void close_connection(Connection& connection);
+    void expire_sessions();
+
+    EventLoop& loop_;
+    std::vector<std::unique_ptr<Stream>> streams_;
+    std::vector<int> listeners_;
+    std::vector<uint16_t> ports_;
+    std::vector<std::unique_ptr<Connection>> connections_;
+    int wakeup_fd_ = -1;
+    std::atomic<bool> wakeup_pending_{false};
+    int rtp_fd_ = -1;   // Sends every UDP subscriber's packets
+    int rtcp_fd_ = -1;  // Receiver reports, read and dropped
+    int rtp_family_ = AF_UNSPEC;
+    uint16_t rtp_port_ = 0;
+    uint64_t timeout_timer_ = 0;
+    uint64_t session_base_ = 0;  // Random, so ids differ between runs
+    uint64_t next_session_ = 0;
+    // sendmmsg() scratch, grown with the UDP subscriber count
+    std::vector<mmsghdr> messages_;
+
+    std::atomic<uint64_t> connection_count_{0};
+    std::atomic<uint64_t> playing_{0};
+    std::atomic<uint64_t> requests_{0};
+    std::atomic<uint64_t> bad_requests_{0};
+    std::atomic<uint64_t> rejected_{0};
+    std::atomic<uint64_t> timeouts_{0};
+    std::atomic<uint64_t> packets_encoded_{0};
+    std::atomic<uint64_t> packets_sent_{0};
+    std::atomic<uint64_t> bytes_sent_{0};
+    std::atomic<uint64_t> send_errors_{0};
+    std::atomic<uint64_t> packets_skipped_{0};
+    std::atomic<uint64_t> queue_overflows_{0};
+};
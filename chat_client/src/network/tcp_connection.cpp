@@ -0,0 +1,189 @@
+#include "tcp_connection.h"
+#include "event_loop.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr size_t kReadChunk = 16384;
+
+} // namespace
+
+TcpConnection::TcpConnection(EventLoop& loop, DataHandler on_data, StateHandler on_state)
+    : loop_(loop), on_data_(std::move(on_data)), on_state_(std::move(on_state)) {
+}
+
+TcpConnection::~TcpConnection() {
+    if (fd_ >= 0) {
+        loop_.remove_fd(fd_);
+        ::close(fd_);
+    }
+}
+
+bool TcpConnection::connect(const std::string& host, uint16_t port) {
+    close();
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addresses = nullptr;
+    std::string service = std::to_string(port);
+    int error = getaddrinfo(host.c_str(), service.c_str(), &hints, &addresses);
+    if (error != 0) {
+        std::cerr << "Cannot resolve " << host << ": " << gai_strerror(error) << std::endl;
+        return false;
+    }
+
+    for (addrinfo* address = addresses; address; address = address->ai_next) {
+        int fd = socket(address->ai_family, address->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                        address->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if (::connect(fd, address->ai_addr, address->ai_addrlen) == 0 || errno == EINPROGRESS) {
+            fd_ = fd;
+            break;
+        }
+        ::close(fd);
+    }
+    freeaddrinfo(addresses);
+    if (fd_ < 0) {
+        std::cerr << "Cannot connect to " << host << ":" << port << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    // Writable once the connection completes, either way
+    state_ = State::CONNECTING;
+    want_write_ = true;
+    if (!loop_.add_fd(fd_, EPOLLIN | EPOLLOUT, [this](uint32_t events) { on_events(events); })) {
+        ::close(fd_);
+        fd_ = -1;
+        state_ = State::CLOSED;
+        return false;
+    }
+    return true;
+}
+
+void TcpConnection::send(const char* data, size_t size) {
+    if (state_ == State::CLOSED) {
+        return;
+    }
+    outbox_.append(data, size);
+    if (state_ == State::CONNECTED && !want_write_) {
+        flush();
+    }
+}
+
+void TcpConnection::close() {
+    if (fd_ < 0) {
+        return;
+    }
+    loop_.remove_fd(fd_);
+    ::close(fd_);
+    fd_ = -1;
+    state_ = State::CLOSED;
+    outbox_.clear();
+    outbox_sent_ = 0;
+    want_write_ = false;
+}
+
+void TcpConnection::fail() {
+    bool was_open = state_ != State::CLOSED;
+    close();
+    if (was_open && on_state_) {
+        on_state_(false);
+    }
+}
+
+void TcpConnection::on_events(uint32_t events) {
+    if (state_ == State::CONNECTING) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        if ((events & (EPOLLERR | EPOLLHUP))
+            || getsockopt(fd_, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+            fail();
+            return;
+        }
+        if (!(events & EPOLLOUT)) {
+            return;
+        }
+        state_ = State::CONNECTED;
+        if (on_state_) {
+            on_state_(true);
+        }
+        if (state_ != State::CONNECTED) {
+            return; // Closed by the handler
+        }
+        flush();
+        return;
+    }
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        on_readable();
+    }
+    if (state_ == State::CONNECTED && (events & EPOLLOUT)) {
+        flush();
+    }
+}
+
+void TcpConnection::on_readable() {
+    char buffer[kReadChunk];
+    while (fd_ >= 0) {
+        ssize_t received = ::recv(fd_, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            if (on_data_) {
+                on_data_(buffer, static_cast<size_t>(received));
+            }
+            continue;
+        }
+        if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        fail(); // Orderly shutdown by the peer, or an error
+        return;
+    }
+}
+
+void TcpConnection::flush() {
+    while (outbox_sent_ < outbox_.size()) {
+        ssize_t sent = ::send(fd_, outbox_.data() + outbox_sent_, outbox_.size() - outbox_sent_, MSG_NOSIGNAL);
+        if (sent > 0) {
+            outbox_sent_ += static_cast<size_t>(sent);
+            continue;
+        }
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        }
+        fail();
+        return;
+    }
+    if (outbox_sent_ == outbox_.size()) {
+        outbox_.clear();
+        outbox_sent_ = 0;
+    }
+    update_interest();
+}
+
+void TcpConnection::update_interest() {
+    bool want_write = !outbox_.empty();
+    if (want_write != want_write_) {
+        want_write_ = want_write;
+        loop_.modify_fd(fd_, EPOLLIN | (want_write ? EPOLLOUT : 0u));
+    }
+}
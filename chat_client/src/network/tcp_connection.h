@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+class EventLoop;
+
+// Non-blocking TCP client socket driven by an EventLoop, with Nagle off
+// for low latency. Everything runs on the loop thread. Handlers may call
+// send() and close() but must not destroy the connection; post that.
+class TcpConnection {
+public:
+    using DataHandler = std::function<void(const char* data, size_t size)>;
+    // true once connected, false when the connection fails or closes
+    using StateHandler = std::function<void(bool connected)>;
+
+    TcpConnection(EventLoop& loop, DataHandler on_data, StateHandler on_state);
+    ~TcpConnection();
+
+    TcpConnection(const TcpConnection&) = delete;
+    TcpConnection& operator=(const TcpConnection&) = delete;
+
+    // Starts connecting and returns at once. Host names are resolved
+    // synchronously, so prefer numeric addresses on the loop thread.
+    bool connect(const std::string& host, uint16_t port);
+    // Written straight away when the socket allows, else queued until it
+    // drains; data sent while connecting goes out once connected
+    void send(const char* data, size_t size);
+    void close();
+
+    bool connected() const { return state_ == State::CONNECTED; }
+    size_t queued_bytes() const { return outbox_.size() - outbox_sent_; }
+
+private:
+    enum class State { CLOSED, CONNECTING, CONNECTED };
+
+    void on_events(uint32_t events);
+    void on_readable();
+    void flush();
+    void update_interest();
+    void fail();
+
+    EventLoop& loop_;
+    DataHandler on_data_;
+    StateHandler on_state_;
+    int fd_ = -1;
+    State state_ = State::CLOSED;
+    std::string outbox_;
+    size_t outbox_sent_ = 0;   // Bytes of outbox_ already written
+    bool want_write_ = false;  // EPOLLOUT registered
+};
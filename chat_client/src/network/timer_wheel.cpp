@@ -0,0 +1,81 @@
+#include "timer_wheel.h"
+
+#include <algorithm>
+
+TimerWheel::TimerWheel(size_t slots) : slots_(std::max<size_t>(slots, 1)) {
+}
+
+TimerWheel::TimerId TimerWheel::add(uint64_t delay, Task task, uint64_t interval) {
+    TimerId id = next_id_++;
+    Timer& timer = timers_[id];
+    timer.interval = interval;
+    timer.task = std::move(task);
+    schedule(id, timer, delay);
+    return id;
+}
+
+void TimerWheel::schedule(TimerId id, Timer& timer, uint64_t delay) {
+    delay = std::max<uint64_t>(delay, 1);
+    timer.rounds = (delay - 1) / slots_.size();
+    slots_[(now_ + delay) % slots_.size()].push_back(id);
+}
+
+void TimerWheel::cancel(TimerId id) {
+    timers_.erase(id);
+}
+
+void TimerWheel::advance(uint64_t now) {
+    while (now_ < now) {
+        ++now_;
+        std::vector<TimerId>& slot = slots_[now_ % slots_.size()];
+        if (slot.empty()) {
+            continue;
+        }
+
+        // Collect first: tasks may add timers to this very slot
+        due_.clear();
+        size_t kept = 0;
+        for (TimerId id : slot) {
+            auto it = timers_.find(id);
+            if (it == timers_.end()) {
+                continue; // Cancelled
+            }
+            if (it->second.rounds > 0) {
+                --it->second.rounds;
+                slot[kept++] = id;
+            } else {
+                due_.push_back(id);
+            }
+        }
+        slot.resize(kept);
+
+        for (TimerId id : due_) {
+            auto it = timers_.find(id);
+            if (it == timers_.end()) {
+                continue; // Cancelled by an earlier task
+            }
+            if (it->second.interval == 0) {
+                Task task = std::move(it->second.task);
+                timers_.erase(it);
+                task();
+            } else {
+                schedule(id, it->second, it->second.interval);
+                // Copied, as the task may cancel its own timer
+                Task task = it->second.task;
+                task();
+            }
+        }
+    }
+}
+
+uint64_t TimerWheel::ticks_to_next() const {
+    if (timers_.empty()) {
+        return 0;
+    }
+    for (uint64_t ahead = 1; ahead <= slots_.size(); ++ahead) {
+        if (!slots_[(now_ + ahead) % slots_.size()].empty()) {
+            return ahead;
+        }
+    }
+    return slots_.size();
+}
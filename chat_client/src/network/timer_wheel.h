@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// Hashed timing wheel with a fixed tick.
+//
+// A timer due in d ticks goes into slot (now + d) % slots with
+// d / slots full turns still to wait, so adding and cancelling are O(1) and
+// advancing costs one slot per elapsed tick. Cancelled timers are dropped
+// from their slot when it next comes round. Time is whatever tick count the
+// owner passes to advance(); the wheel never reads a clock.
+class TimerWheel {
+public:
+    using TimerId = uint64_t;
+    using Task = std::function<void()>;
+
+    explicit TimerWheel(size_t slots = 1024);
+
+    // Fires after delay ticks (at least one), then every interval ticks if
+    // interval is non-zero. Returns an id for cancel(), never 0.
+    TimerId add(uint64_t delay, Task task, uint64_t interval = 0);
+    // Safe from a timer's own task; a no-op for unknown or finished timers
+    void cancel(TimerId id);
+
+    // Runs every timer due up to and including tick now
+    void advance(uint64_t now);
+
+    // Ticks from the last advance() until the earliest slot holding a
+    // timer, looking at most one turn ahead; 0 when the wheel is empty
+    uint64_t ticks_to_next() const;
+
+    uint64_t now() const { return now_; }
+    size_t size() const { return timers_.size(); }
+    bool empty() const { return timers_.empty(); }
+
+private:
+    struct Timer {
+        uint64_t rounds;   // Full turns left before it is due
+        uint64_t interval;
+        Task task;
+    };
+
+    void schedule(TimerId id, Timer& timer, uint64_t delay);
+
+    std::vector<std::vector<TimerId>> slots_;
+    std::unordered_map<TimerId, Timer> timers_;
+    std::vector<TimerId> due_;  // Reused by advance()
+    uint64_t now_ = 0;
+    TimerId next_id_ = 1;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Bounded lock-free multi-producer/single-consumer queue.
+//
+// Each slot carries a sequence number telling producers and the consumer
+// whose turn it is (D. Vyukov's bounded queue). Producers claim a slot with
+// one compare-and-swap on the tail and never wait for each other beyond
+// that; the consumer needs no atomic read-modify-write at all. Storage is
+// allocated up front. try_push() fails instead of blocking when the queue
+// is full, so producers see back-pressure immediately.
+template <typename T>
+class MpscQueue {
+public:
+    explicit MpscQueue(size_t capacity)
+        : capacity_(round_up_pow2(capacity < 2 ? 2 : capacity)),
+          mask_(capacity_ - 1),
+          cells_(new Cell[capacity_]) {
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Any thread. Moves from value only on success.
+    bool try_push(T&& value) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[tail & mask_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t lag = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(tail);
+            if (lag == 0) {
+                if (tail_.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (lag < 0) {
+                return false; // Full: the consumer has not freed this cell yet
+            } else {
+                tail = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only. False when empty, or when the next producer has
+    // claimed its slot but not yet filled it.
+    bool try_pop(T& out) {
+        Cell& cell = cells_[head_ & mask_];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (sequence != head_ + 1) {
+            return false;
+        }
+        out = std::move(cell.value);
+        cell.sequence.store(head_ + capacity_, std::memory_order_release);
+        ++head_;
+        head_published_.store(head_, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Approximate when called concurrently with either side.
+    size_t size() const {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_published_.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    static size_t round_up_pow2(size_t v) {
+        size_t p = 1;
+        while (p < v) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<Cell[]> cells_;
+
+    // Consumer-owned; published only for size()
+    alignas(kCacheLine) size_t head_ = 0;
+    std::atomic<size_t> head_published_{0};
+
+    // Claimed by producers
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+};
@@ -0,0 +1,113 @@
+#include "rt_alloc_trap.h"
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+namespace {
+
+std::atomic<uint64_t> g_violations{0};
+std::atomic<RtAllocAction> g_action{RtAllocAction::ABORT};
+
+} // namespace
+
+void rt_alloc_trap_set_action(RtAllocAction action) {
+    g_action.store(action);
+}
+
+uint64_t rt_alloc_violations() {
+    return g_violations.load();
+}
+
+#ifndef CHAT_RT_MALLOC_TRAP
+
+bool rt_alloc_trap_enabled() {
+    return false;
+}
+
+#else
+
+bool rt_alloc_trap_enabled() {
+    return true;
+}
+
+thread_local bool rt_alloc_scope_active = false;
+
+// glibc's own entry points, so the replacements below can forward to them
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+void* __libc_memalign(size_t alignment, size_t size);
+}
+
+namespace {
+
+void check(const char* function) {
+    if (!rt_alloc_scope_active) {
+        return;
+    }
+    g_violations.fetch_add(1, std::memory_order_relaxed);
+    if (g_action.load(std::memory_order_relaxed) == RtAllocAction::ABORT) {
+        // write(2) only: anything buffered could allocate again
+        static const char message[] = "RT malloc trap: heap call on the audio thread: ";
+        ssize_t ignored = write(STDERR_FILENO, message, sizeof(message) - 1);
+        ignored = write(STDERR_FILENO, function, std::strlen(function));
+        ignored = write(STDERR_FILENO, "\n", 1);
+        (void)ignored;
+        std::abort();
+    }
+}
+
+} // namespace
+
+extern "C" {
+
+void* malloc(size_t size) {
+    check("malloc");
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    check("calloc");
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    check("realloc");
+    return __libc_realloc(ptr, size);
+}
+
+void free(void* ptr) {
+    if (ptr) {
+        check("free");
+    }
+    __libc_free(ptr);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    check("memalign");
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    check("aligned_alloc");
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size) {
+    check("posix_memalign");
+    void* ptr = __libc_memalign(alignment, size);
+    if (!ptr) {
+        return ENOMEM;
+    }
+    *result = ptr;
+    return 0;
+}
+
+} // extern "C"
+
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+// Debug aid for the real-time audio path. Built with CHAT_RT_MALLOC_TRAP
+// (cmake -DRT_MALLOC_TRAP=ON, make RT_MALLOC_TRAP=1), malloc, calloc,
+// realloc, free and the aligned variants are interposed, and any call made
+// while an RtAllocScope is alive on the calling thread is a violation.
+// AudioEngine::process_block opens a scope, which covers every processor
+// and capture consumer publish. Without the macro the scope compiles to
+// nothing and no allocator function is replaced.
+//
+// Not compatible with sanitizers that replace malloc themselves.
+
+enum class RtAllocAction {
+    ABORT,  // Print the offending call and abort (default)
+    COUNT   // Only count, for tests that provoke violations on purpose
+};
+
+bool rt_alloc_trap_enabled();
+void rt_alloc_trap_set_action(RtAllocAction action);
+uint64_t rt_alloc_violations();
+
+#ifdef CHAT_RT_MALLOC_TRAP
+
+extern thread_local bool rt_alloc_scope_active;
+
+class RtAllocScope {
+public:
+    RtAllocScope() : previous_(rt_alloc_scope_active) { rt_alloc_scope_active = true; }
+    ~RtAllocScope() { rt_alloc_scope_active = previous_; }
+
+    RtAllocScope(const RtAllocScope&) = delete;
+    RtAllocScope& operator=(const RtAllocScope&) = delete;
+
+private:
+    bool previous_;
+};
+
+#else
+
+class RtAllocScope {
+public:
+    RtAllocScope() {}
+};
+
+#endif
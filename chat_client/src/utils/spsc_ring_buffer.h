@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+// Wait-free single-producer/single-consumer ring buffer.
+//
+// All storage is allocated in the constructor; pushing and popping never
+// allocate, lock or make system calls, so the producer side is safe to use
+// from the real-time audio thread. Large elements can be filled and read in
+// place through write_slot()/publish() and read_slot()/release() instead of
+// being copied through a temporary.
+template <typename T>
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t capacity)
+        : capacity_(round_up_pow2(capacity < 2 ? 2 : capacity)),
+          mask_(capacity_ - 1),
+          slots_(new T[capacity_]) {
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    // Producer: returns the next free slot, or nullptr if the ring is full.
+    T* write_slot() {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - cached_head_ >= capacity_) {
+            cached_head_ = head_.load(std::memory_order_acquire);
+            if (tail - cached_head_ >= capacity_) {
+                return nullptr;
+            }
+        }
+        return &slots_[tail & mask_];
+    }
+
+    // Producer: makes the slot returned by write_slot() visible to the consumer.
+    void publish() {
+        tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_push(const T& item) {
+        T* slot = write_slot();
+        if (!slot) {
+            return false;
+        }
+        *slot = item;
+        publish();
+        return true;
+    }
+
+    // Consumer: returns the oldest published slot, or nullptr if empty.
+    const T* read_slot() {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (head == cached_tail_) {
+            cached_tail_ = tail_.load(std::memory_order_acquire);
+            if (head == cached_tail_) {
+                return nullptr;
+            }
+        }
+        return &slots_[head & mask_];
+    }
+
+    // Consumer: hands the slot returned by read_slot() back to the producer.
+    void release() {
+        head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool try_pop(T& out) {
+        const T* slot = read_slot();
+        if (!slot) {
+            return false;
+        }
+        out = *slot;
+        release();
+        return true;
+    }
+
+    // Approximate when called concurrently with the other side.
+    size_t size() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire);
+    }
+
+    bool empty() const { return size() == 0; }
+    size_t capacity() const { return capacity_; }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    static size_t round_up_pow2(size_t v) {
+        size_t p = 1;
+        while (p < v) {
+            p <<= 1;
+        }
+        return p;
+    }
+
+    const size_t capacity_;
+    const size_t mask_;
+    std::unique_ptr<T[]> slots_;
+
+    // Consumer-owned index plus the consumer's cached view of the tail.
+    alignas(kCacheLine) std::atomic<size_t> head_{0};
+    size_t cached_tail_ = 0;
+
+    // Producer-owned index plus the producer's cached view of the head.
+    alignas(kCacheLine) std::atomic<size_t> tail_{0};
+    size_t cached_head_ = 0;
+};
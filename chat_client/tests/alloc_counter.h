@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+// Counts heap allocations for the tests and benchmarks that must not make
+// any. Replaces the global operator new, so include it from the one file
+// of each test binary. utils/rt_alloc_trap does this for the audio
+// callback, but only in the CHAT_RT_MALLOC_TRAP build; these checks run in
+// every build.
+
+inline thread_local bool alloc_counting = false;
+inline thread_local uint64_t alloc_count = 0;
+
+void* operator new(std::size_t size) {
+    if (alloc_counting) {
+        ++alloc_count;
+    }
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+// Adds the allocations made on this thread while alive to count
+class CountAllocations {
+public:
+    explicit CountAllocations(uint64_t& count) : count_(count), start_(alloc_count) { alloc_counting = true; }
+    ~CountAllocations() {
+        alloc_counting = false;
+        count_ += alloc_count - start_;
+    }
+
+    CountAllocations(const CountAllocations&) = delete;
+    CountAllocations& operator=(const CountAllocations&) = delete;
+
+private:
+    uint64_t& count_;
+    uint64_t start_;
+};
@@ -0,0 +1,307 @@
+// Audio callback micro-benchmark.
+//
+// Opens the null device at each of the sample rates we ship with and drives
+// AudioEngine::process_block with the same gain/volume callback the GUI
+// installs and one capture consumer attached, across the buffer sizes.
+// Reports ns/frame, callback time
+// percentiles and heap allocations per callback, writes the results as JSON
+// and fails when a configuration's median callback time or allocation count
+// regresses against the stored baseline. Times are only compared when the
+// baseline was recorded on the same CPU with the same DSP kernels; on any
+// other host they are reported, and only allocations are gated.
+//
+// Usage: audio_bench [--json out.json] [--baseline baseline.json]
+//                    [--tolerance 3.0] [--update-baseline]
+
+#include "../../src/audio/audio_engine.h"
+#include "../../src/audio/capture_consumer.h"
+#include "../../src/dsp/dsp_kernels.h"
+#include "../alloc_counter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/utsname.h>
+#include <vector>
+
+struct BenchResult {
+    unsigned frames = 0;
+    unsigned sample_rate = 0;
+    double ns_per_frame = 0.0;
+    double p50_ns = 0.0;
+    double p99_ns = 0.0;
+    double p999_ns = 0.0;
+    double budget_ns = 0.0;
+    double allocations_per_callback = 0.0;
+};
+
+static double percentile(std::vector<double>& sorted, double p) {
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+static BenchResult run_config(unsigned frames, unsigned sample_rate) {
+    // Opened but not started: the callbacks below come from this thread, with
+    // the voice processing, meters and consumers configured for the rate
+    AudioEngine engine;
+    if (!engine.initialize(AudioEngine::Backend::NULL_DEVICE) || !engine.open_device(0, sample_rate)) {
+        std::cerr << "Cannot open the null device at " << sample_rate << " Hz" << std::endl;
+        std::exit(1);
+    }
+
+    // Same work as the AudioControls callback
+    const DspKernels* dsp = &dsp_kernels();
+    engine.set_audio_callback([dsp](const float* input, float* output, unsigned int n) {
+        dsp->mono_to_stereo(input, output, n, 0.8f);
+    });
+
+    CaptureConsumer consumer("bench", nullptr, 256);
+    consumer.start();
+    engine.add_capture_consumer(&consumer);
+
+    std::vector<float> input(frames), output(frames * 2);
+    for (unsigned i = 0; i < frames; ++i) {
+        input[i] = 0.5f * std::sin(2.0f * 3.14159265f * 440.0f * i / sample_rate);
+    }
+
+    // Enough callbacks for stable p99.9 without making ctest slow
+    const unsigned callbacks = std::max(2000u, 4000000u / frames);
+    std::vector<double> times;
+    times.reserve(callbacks);
+
+    for (unsigned i = 0; i < 100; ++i) {
+        engine.process_block(input.data(), output.data(), frames);
+    }
+
+    uint64_t allocations = 0;
+    for (unsigned i = 0; i < callbacks; ++i) {
+        std::chrono::steady_clock::time_point start, end;
+        {
+            CountAllocations counting(allocations);
+            start = std::chrono::steady_clock::now();
+            engine.process_block(input.data(), output.data(), frames);
+            end = std::chrono::steady_clock::now();
+        }
+        times.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+    }
+
+    engine.remove_capture_consumer(&consumer);
+    consumer.stop();
+
+    BenchResult result;
+    result.frames = frames;
+    result.sample_rate = sample_rate;
+    result.allocations_per_callback = static_cast<double>(allocations) / callbacks;
+    result.budget_ns = 1e9 * frames / sample_rate;
+
+    double total = 0.0;
+    for (double t : times) {
+        total += t;
+    }
+    result.ns_per_frame = total / callbacks / frames;
+
+    std::sort(times.begin(), times.end());
+    result.p50_ns = percentile(times, 0.50);
+    result.p99_ns = percentile(times, 0.99);
+    result.p999_ns = percentile(times, 0.999);
+    return result;
+}
+
+// The machine and CPU model, which the timings only hold for
+static std::string host_name() {
+    std::string host;
+    utsname system;
+    if (uname(&system) == 0) {
+        host = system.machine;
+    }
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        size_t colon = line.find(':');
+        if (line.compare(0, 10, "model name") == 0 && colon != std::string::npos) {
+            host += line.substr(colon + 1);
+            break;
+        }
+    }
+    for (char& c : host) {
+        if (c == '"' || c == '\\') {
+            c = ' ';
+        }
+    }
+    return host;
+}
+
+static std::string to_json(const std::vector<BenchResult>& results) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3);
+    out << "{\n  \"kernels\": \"" << dsp_kernels().name << "\",\n  \"host\": \"" << host_name()
+        << "\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchResult& r = results[i];
+        out << "    {\"frames\": " << r.frames
+            << ", \"sample_rate\": " << r.sample_rate
+            << ", \"ns_per_frame\": " << r.ns_per_frame
+            << ", \"p50_ns\": " << r.p50_ns
+            << ", \"p99_ns\": " << r.p99_ns
+            << ", \"p999_ns\": " << r.p999_ns
+            << ", \"budget_ns\": " << r.budget_ns
+            << ", \"allocations_per_callback\": " << r.allocations_per_callback
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+// The baseline is written by this program with one result object per line,
+// so a line-oriented field lookup is all the parsing it needs.
+static bool json_number(const std::string& line, const std::string& key, double& value) {
+    std::string needle = "\"" + key + "\": ";
+    size_t pos = line.find(needle);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    value = std::strtod(line.c_str() + pos + needle.size(), nullptr);
+    return true;
+}
+
+static bool json_string(const std::string& line, const std::string& key, std::string& value) {
+    std::string needle = "\"" + key + "\": \"";
+    size_t pos = line.find(needle);
+    if (pos == std::string::npos) {
+        return false;
+    }
+    pos += needle.size();
+    value = line.substr(pos, line.find('"', pos) - pos);
+    return true;
+}
+
+struct Baseline {
+    std::string kernels;
+    std::string host;
+    std::vector<BenchResult> results;
+};
+
+static Baseline load_baseline(const std::string& path) {
+    Baseline baseline;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        json_string(line, "kernels", baseline.kernels);
+        json_string(line, "host", baseline.host);
+        double frames, rate, p50, allocations = 0.0;
+        if (json_number(line, "frames", frames) && json_number(line, "sample_rate", rate) &&
+            json_number(line, "p50_ns", p50)) {
+            json_number(line, "allocations_per_callback", allocations);
+            BenchResult r;
+            r.frames = static_cast<unsigned>(frames);
+            r.sample_rate = static_cast<unsigned>(rate);
+            r.p50_ns = p50;
+            r.allocations_per_callback = allocations;
+            baseline.results.push_back(r);
+        }
+    }
+    return baseline;
+}
+
+int main(int argc, char** argv) {
+    std::string json_path;
+    std::string baseline_path;
+    double tolerance = 3.0;
+    bool update_baseline = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json" && i + 1 < argc) {
+            json_path = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = std::atof(argv[++i]);
+        } else if (arg == "--update-baseline") {
+            update_baseline = true;
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 2;
+        }
+    }
+
+    std::cout << "Running audio callback benchmark (" << dsp_kernels().name << " kernels)..." << std::endl;
+    std::cout << std::setw(6) << "frames" << std::setw(8) << "rate"
+              << std::setw(10) << "ns/frame" << std::setw(10) << "p50"
+              << std::setw(10) << "p99" << std::setw(10) << "p99.9"
+              << std::setw(8) << "load%" << std::setw(8) << "allocs" << std::endl;
+
+    std::vector<BenchResult> results;
+    for (unsigned sample_rate : { 16000u, 44100u, 48000u }) {
+        for (unsigned frames : { 64u, 128u, 256u, 512u, 1024u }) {
+            BenchResult r = run_config(frames, sample_rate);
+            results.push_back(r);
+            std::cout << std::fixed << std::setprecision(2)
+                      << std::setw(6) << r.frames << std::setw(8) << r.sample_rate
+                      << std::setw(10) << r.ns_per_frame << std::setw(10) << r.p50_ns
+                      << std::setw(10) << r.p99_ns << std::setw(10) << r.p999_ns
+                      << std::setw(8) << 100.0 * r.p999_ns / r.budget_ns
+                      << std::setw(8) << r.allocations_per_callback << std::endl;
+        }
+    }
+
+    std::string json = to_json(results);
+    if (!json_path.empty()) {
+        std::ofstream(json_path) << json;
+    }
+
+    if (baseline_path.empty()) {
+        return 0;
+    }
+
+    if (update_baseline) {
+        std::ofstream(baseline_path) << json;
+        std::cout << "Baseline written to " << baseline_path << std::endl;
+        return 0;
+    }
+
+    Baseline baseline = load_baseline(baseline_path);
+    if (baseline.results.empty()) {
+        std::cerr << "No baseline results in " << baseline_path << std::endl;
+        return 1;
+    }
+    // Another CPU, or the scalar kernels on this one, is no regression
+    const bool compare_times = baseline.kernels == dsp_kernels().name && baseline.host == host_name();
+    if (!compare_times) {
+        std::cout << "Baseline is from " << baseline.kernels << " kernels on " << baseline.host
+                  << "; times not compared" << std::endl;
+    }
+
+    int regressions = 0;
+    for (const BenchResult& base : baseline.results) {
+        for (const BenchResult& r : results) {
+            if (r.frames != base.frames || r.sample_rate != base.sample_rate) {
+                continue;
+            }
+            // The median is gated rather than the mean, which a single
+            // preempted callback can skew on a busy machine
+            if (compare_times && r.p50_ns > base.p50_ns * tolerance) {
+                std::cerr << "REGRESSION " << r.frames << "@" << r.sample_rate << ": p50 "
+                          << r.p50_ns << " ns vs baseline " << base.p50_ns << std::endl;
+                ++regressions;
+            }
+            if (r.allocations_per_callback > base.allocations_per_callback) {
+                std::cerr << "REGRESSION " << r.frames << "@" << r.sample_rate << ": "
+                          << r.allocations_per_callback << " allocations/callback vs baseline "
+                          << base.allocations_per_callback << std::endl;
+                ++regressions;
+            }
+        }
+    }
+
+    std::cout << (regressions ? "Benchmark regressed" : "Benchmark within baseline") << std::endl;
+    return regressions ? 1 : 0;
+}
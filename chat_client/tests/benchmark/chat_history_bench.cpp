@@ -0,0 +1,152 @@
+// Chat history append cost as the history grows.
+//
+// Appends 1M formatted messages through ChatHistory into a display window,
+// as ChatWindow does, and measures ns per message for each block of 100k.
+// For comparison, measures the old path, which appended to one growing
+// buffer and counted its lines on every message to scroll to the end.
+// Also measures scrolling back a chunk at a time through paged-out history.
+//
+// Fails if the last blocks cost more than kMaxGrowth times the first ones,
+// or if resident memory is not bounded by the configured chunk budget.
+//
+// Usage: chat_history_bench
+
+#include "../../src/core/chat_history.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+constexpr size_t kMessages = 1000000;
+constexpr size_t kBlock = 100000;
+constexpr double kMaxGrowth = 2.0;
+
+using Clock = std::chrono::steady_clock;
+
+// Keeps the old path's line counts from being optimised away
+volatile size_t line_count_sink = 0;
+
+// Stands in for Fl_Text_Buffer; holds only the window
+class StringDisplay : public ChatHistory::Display {
+public:
+    void append(std::string_view text) override { text_.append(text.data(), text.size()); }
+    void prepend(std::string_view text) override { text_.insert(0, text.data(), text.size()); }
+    void remove_front(size_t bytes) override { text_.erase(0, bytes); }
+    void remove_back(size_t bytes) override { text_.erase(text_.size() - bytes); }
+    size_t size() const { return text_.size(); }
+
+private:
+    std::string text_;
+};
+
+void format(std::string& out, size_t i) {
+    out.assign("[12:34:56] user");
+    out += std::to_string(i % 50);
+    out += ": message number ";
+    out += std::to_string(i);
+    out += " with some ordinary chat text\n";
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+// Append plus count_lines(0, length) per message, at a given history size
+double old_path_ns(size_t history) {
+    std::string buffer;
+    std::string line;
+    for (size_t i = 0; i < history; ++i) {
+        format(line, i);
+        buffer += line;
+    }
+    constexpr size_t kAppends = 200;
+    size_t lines = 0;
+    auto start = Clock::now();
+    for (size_t i = 0; i < kAppends; ++i) {
+        format(line, history + i);
+        buffer += line;
+        lines += static_cast<size_t>(std::count(buffer.begin(), buffer.end(), '\n'));
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    line_count_sink = lines;
+    return elapsed.count() / kAppends;
+}
+
+} // namespace
+
+int main() {
+    std::cout << "Running chat history benchmark..." << std::endl;
+    int failures = 0;
+
+    ChatHistory::Options options;
+    ChatHistory history(options);
+    StringDisplay display;
+    history.attach(&display);
+
+    std::string line;
+    std::vector<double> block_ns;
+    size_t largest_chunk = 0;
+    size_t window_peak = 0;
+    std::cout << std::setw(12) << "messages" << std::setw(14) << "ns/message" << std::setw(16)
+              << "resident KiB" << std::setw(14) << "window KiB" << std::endl;
+    for (size_t block = 0; block < kMessages / kBlock; ++block) {
+        auto start = Clock::now();
+        for (size_t i = block * kBlock; i < (block + 1) * kBlock; ++i) {
+            format(line, i);
+            history.append(line);
+            window_peak = std::max(window_peak, display.size());
+        }
+        std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+        block_ns.push_back(elapsed.count() / kBlock);
+        largest_chunk = std::max(largest_chunk, line.size() * options.chunk_messages);
+
+        ChatHistory::Stats stats = history.get_stats();
+        std::cout << std::setw(12) << (block + 1) * kBlock << std::fixed << std::setprecision(1)
+                  << std::setw(14) << block_ns.back() << std::setw(16) << stats.resident_bytes / 1024.0
+                  << std::setw(14) << display.size() / 1024.0 << std::endl;
+    }
+
+    double first = median(std::vector<double>(block_ns.begin(), block_ns.begin() + 3));
+    double last = median(std::vector<double>(block_ns.end() - 3, block_ns.end()));
+    std::cout << "Growth over 1M messages: " << std::setprecision(2) << last / first << "x" << std::endl;
+    if (last / first > kMaxGrowth) {
+        std::cerr << "  append cost grows with history" << std::endl;
+        ++failures;
+    }
+
+    ChatHistory::Stats stats = history.get_stats();
+    size_t resident_limit = (options.resident_chunks + 1) * largest_chunk;
+    size_t window_limit = (options.window_chunks + 1) * largest_chunk;
+    if (stats.resident_bytes > resident_limit || window_peak > window_limit) {
+        std::cerr << "  history memory not bounded" << std::endl;
+        ++failures;
+    }
+    std::cout << "Paged out " << stats.paged_out_chunks << " of " << stats.chunks << " chunks; "
+              << stats.resident_bytes / 1024 << " KiB resident, window peak " << window_peak / 1024
+              << " KiB" << std::endl;
+
+    // Scroll back through paged-out history
+    constexpr int kPages = 200;
+    auto start = Clock::now();
+    for (int i = 0; i < kPages; ++i) {
+        history.page_back();
+    }
+    std::chrono::duration<double, std::micro> paging = Clock::now() - start;
+    std::cout << "Scroll-back: " << std::setprecision(1) << paging.count() / kPages << " us per "
+              << options.chunk_messages << "-message chunk" << std::endl;
+
+    std::cout << "Old path (append + count_lines per message):" << std::endl;
+    for (size_t size : { size_t(1000), size_t(10000), size_t(100000) }) {
+        std::cout << std::setw(12) << size << std::setw(14) << old_path_ns(size) << " ns/message" << std::endl;
+    }
+
+    std::cout << (failures ? "Chat history benchmark failed" : "Chat history benchmark passed") << std::endl;
+    return failures ? 1 : 0;
+}
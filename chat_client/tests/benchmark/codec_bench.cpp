@@ -0,0 +1,107 @@
+// Speech codec throughput.
+//
+// For each audio quality preset, encodes and decodes 10 s of a voiced
+// speech stand-in on one thread, and through AudioEncodePipeline::process
+// (framing, silence detection and batching included). Reports encoded
+// frames per second on one core, how many real-time streams that is, and
+// the bitrate actually produced.
+//
+// Fails if any preset encodes fewer than kMinStreamsPerCore real-time
+// streams on one core.
+//
+// Usage: codec_bench
+
+#include "../../src/audio/audio_codec.h"
+#include "../../src/audio/codec_pipeline.h"
+#include "../test_signals.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr double kSeconds = 10.0;
+constexpr double kMinStreamsPerCore = 20.0;
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+} // namespace
+
+int main() {
+    std::cout << "Running codec benchmark..." << std::endl;
+    int failures = 0;
+
+    std::cout << std::left << std::setw(8) << "preset" << std::setw(8) << "codec" << std::right
+              << std::setw(8) << "Hz" << std::setw(10) << "kbit/s" << std::setw(14) << "enc frames/s"
+              << std::setw(14) << "dec frames/s" << std::setw(14) << "pipe frames/s" << std::setw(10)
+              << "streams" << std::endl;
+    for (const char* name : { "low", "medium", "high" }) {
+        CodecSettings settings;
+        CodecSettings::preset(name, settings);
+        std::unique_ptr<AudioEncoder> encoder = make_audio_encoder(settings);
+        std::unique_ptr<AudioDecoder> decoder = make_audio_decoder(settings);
+        if (!encoder || !decoder) {
+            std::cerr << "  " << name << ": codec not available" << std::endl;
+            ++failures;
+            continue;
+        }
+        std::vector<float> input = speech(encoder->sample_rate(), kSeconds);
+        size_t frame = encoder->frame_samples();
+        size_t frames = input.size() / frame;
+
+        std::vector<uint8_t> packets(frames * AudioEncoder::kMaxPacketBytes);
+        std::vector<size_t> sizes(frames);
+        size_t bytes = 0;
+        auto start = Clock::now();
+        for (size_t i = 0; i < frames; ++i) {
+            sizes[i] = encoder->encode(input.data() + i * frame, packets.data() + i * AudioEncoder::kMaxPacketBytes,
+                                       AudioEncoder::kMaxPacketBytes);
+            bytes += sizes[i];
+        }
+        double encode_fps = frames / seconds_since(start);
+
+        std::vector<float> output(frame);
+        start = Clock::now();
+        for (size_t i = 0; i < frames; ++i) {
+            decoder->decode(packets.data() + i * AudioEncoder::kMaxPacketBytes, sizes[i], output.data());
+        }
+        double decode_fps = frames / seconds_since(start);
+
+        // Through the pipeline in 256-frame callbacks, as the engine sends
+        size_t sent = 0;
+        AudioEncodePipeline pipeline(settings, [&sent](const EncodedFrame*, size_t count) { sent += count; });
+        AudioBlock block;
+        block.sample_rate = pipeline.sample_rate();
+        start = Clock::now();
+        for (size_t offset = 0; offset < input.size(); offset += block.frames) {
+            block.frames = static_cast<unsigned>(std::min<size_t>(256, input.size() - offset));
+            std::copy(input.begin() + static_cast<std::ptrdiff_t>(offset),
+                      input.begin() + static_cast<std::ptrdiff_t>(offset + block.frames), block.samples);
+            pipeline.process(block);
+        }
+        double pipeline_fps = sent / seconds_since(start);
+
+        double streams = std::min(encode_fps, pipeline_fps) * settings.frame_ms / 1000.0;
+        std::cout << std::left << std::setw(8) << name << std::setw(8) << encoder->name() << std::right
+                  << std::setw(8) << encoder->sample_rate() << std::fixed << std::setprecision(1)
+                  << std::setw(10) << bytes * 8 / kSeconds / 1000.0 << std::setprecision(0) << std::setw(14)
+                  << encode_fps << std::setw(14) << decode_fps << std::setw(14) << pipeline_fps << std::setw(10)
+                  << streams << std::endl;
+        if (streams < kMinStreamsPerCore) {
+            std::cerr << "  " << name << ": " << streams << " real-time streams per core, under "
+                      << kMinStreamsPerCore << std::endl;
+            ++failures;
+        }
+    }
+
+    std::cout << (failures ? "Codec benchmark failed" : "Codec benchmark passed") << std::endl;
+    return failures ? 1 : 0;
+}
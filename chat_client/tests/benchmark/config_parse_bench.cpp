@@ -0,0 +1,149 @@
+// Typed config loading on large files.
+//
+// Generates a device_streams.yaml with thousands of devices, each with its
+// RTSP, WebRTC and HLS entries, comments and quoted strings as in the
+// shipped file, and parses it with DeviceStreamsConfig::parse. Reports
+// throughput and time per device.
+//
+// Then reads every device's RTSP port and bitrate, as the application does
+// when it sets the servers up, from the parsed structs and, for
+// comparison, through ConfigManager's string map and stoi, the way the
+// settings were read before.
+//
+// Fails if parsing is slower than kMinMBPerS.
+//
+// Usage: config_parse_bench [devices]
+
+#include "../../src/core/device_streams.h"
+#include "../../src/core/config_manager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr unsigned kDefaultDevices = 20000;
+constexpr int kRuns = 5;
+constexpr double kMinMBPerS = 50.0;
+
+using Clock = std::chrono::steady_clock;
+
+std::string make_config(unsigned devices) {
+    std::string text =
+        "# Generated for config_parse_bench\n"
+        "server:\n"
+        "  host: 0.0.0.0  # Listen on all interfaces\n"
+        "  web_admin_port: 8080\n"
+        "protocols:\n"
+        "  rtsp:\n"
+        "    enabled: true\n"
+        "    default_port_range: [8554, 8654]\n"
+        "    transport: [\"tcp\", \"udp\"]\n"
+        "    path_format: \"/stream/{device_id}\"\n"
+        "  hls:\n"
+        "    enabled: true\n"
+        "    segment_duration: 4\n"
+        "    playlist_size: 5\n"
+        "audio_devices:\n";
+    for (unsigned i = 0; i < devices; ++i) {
+        std::string id = std::to_string(i);
+        text += "  - id: \"mic_" + id + "\"\n"
+                "    name: \"Microphone " + id + "\"\n"
+                "    type: \"" + (i % 2 ? "output" : "input") + "\"\n"
+                "    system_id: \"hw:" + id + "\"\n"
+                "    protocols:\n"
+                "      - type: \"rtsp\"\n"
+                "        port: " + std::to_string(8554 + i % 100) + "\n"
+                "        path: \"/mic/" + id + "\"\n"
+                "        enabled: true\n"
+                "        codec: \"opus\"\n"
+                "        bitrate: " + std::to_string(64000 + (i % 4) * 16000) + "  # Per device\n"
+                "      - type: \"webrtc\"\n"
+                "        port: " + std::to_string(8700 + i % 100) + "\n"
+                "        enabled: true\n"
+                "      - type: \"hls\"\n"
+                "        port: " + std::to_string(8900 + i % 100) + "\n"
+                "        enabled: false\n"
+                "\n";
+    }
+    return text;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned devices = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : kDefaultDevices;
+    std::cout << "Running config parse benchmark (" << devices << " devices)..." << std::endl;
+
+    std::string text = make_config(devices);
+    double megabytes = text.size() / 1048576.0;
+
+    // Best of kRuns, each into a fresh config as at startup
+    double best = 1e9;
+    DeviceStreamsConfig config;
+    for (int run = 0; run < kRuns; ++run) {
+        DeviceStreamsConfig parsed;
+        std::string error;
+        auto start = Clock::now();
+        if (!DeviceStreamsConfig::parse(text, parsed, error)) {
+            std::cerr << "  parse failed: " << error << std::endl;
+            return 1;
+        }
+        best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+        config = std::move(parsed);
+    }
+    if (config.audio_devices.size() != devices) {
+        std::cerr << "  parsed " << config.audio_devices.size() << " devices" << std::endl;
+        return 1;
+    }
+    double rate = megabytes / best;
+
+    // The same two settings a device, from fields and from a string map
+    ConfigManager strings;
+    for (unsigned i = 0; i < devices; ++i) {
+        const DeviceProtocolConfig& rtsp = config.audio_devices[i].protocols[0];
+        std::string prefix = "audio_devices." + std::to_string(i) + ".protocols.0.";
+        strings.set_int(prefix + "port", rtsp.port);
+        strings.set_int(prefix + "bitrate", static_cast<int>(rtsp.bitrate));
+    }
+    uint64_t field_sum = 0;
+    auto start = Clock::now();
+    for (const DeviceConfig& device : config.audio_devices) {
+        if (const DeviceProtocolConfig* rtsp = device.enabled_protocol(StreamProtocol::RTSP)) {
+            field_sum += rtsp->port + rtsp->bitrate;
+        }
+    }
+    double field_s = std::chrono::duration<double>(Clock::now() - start).count();
+    uint64_t map_sum = 0;
+    start = Clock::now();
+    for (unsigned i = 0; i < devices; ++i) {
+        std::string prefix = "audio_devices." + std::to_string(i) + ".protocols.0.";
+        map_sum += static_cast<uint64_t>(strings.get_int(prefix + "port") + strings.get_int(prefix + "bitrate"));
+    }
+    double map_s = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "  document:           " << megabytes << " MB, " << devices * 3 << " protocol entries" << std::endl
+              << "  parse:              " << best * 1e3 << " ms (" << rate << " MB/s, "
+              << std::setprecision(0) << best * 1e9 / devices << " ns a device)" << std::endl
+              << std::setprecision(2)
+              << "  settings read:      " << field_s * 1e9 / devices << " ns a device from fields, "
+              << map_s * 1e9 / devices << " ns from a string map" << std::endl;
+
+    int result = 0;
+    if (field_sum != map_sum) {
+        std::cerr << "  the two reads disagree" << std::endl;
+        result = 1;
+    }
+    if (rate < kMinMBPerS) {
+        std::cerr << "  " << rate << " MB/s, under " << kMinMBPerS << std::endl;
+        result = 1;
+    }
+    std::cout << (result ? "Config parse benchmark failed" : "Config parse benchmark passed") << std::endl;
+    return result;
+}
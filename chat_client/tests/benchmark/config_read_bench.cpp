@@ -0,0 +1,165 @@
+// Settings reads while the configuration reloads.
+//
+// Reader threads, standing in for the audio callback and the network loop,
+// read one typed setting and one string setting per read while a writer
+// reloads the files back to back. Each read goes through ConfigStore's
+// Reader, and for comparison through a shared_ptr behind a mutex, the
+// usual way to swap a config under readers. Reports the mean and the
+// slowest batch of kBatch reads, in ns a read.
+//
+// Fails if a store read averages over kMaxMeanNs.
+//
+// Usage: config_read_bench [readers]
+
+#include "../../src/core/config_store.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+constexpr int kDefaultReaders = 2;
+constexpr int kBatches = 2000;
+constexpr int kBatch = 1000;
+constexpr double kMaxMeanNs = 200.0;
+
+using Clock = std::chrono::steady_clock;
+
+struct Result {
+    double mean_ns = 0.0;
+    double worst_ns = 0.0;
+};
+
+// Times kBatches batches of read() on each of readers threads
+template <typename MakeRead>
+Result run_readers(int readers, MakeRead make_read) {
+    std::vector<Result> results(static_cast<size_t>(readers));
+    std::vector<std::thread> threads;
+    std::atomic<uint64_t> sink{0};
+    for (int r = 0; r < readers; ++r) {
+        threads.emplace_back([&, r] {
+            auto read = make_read();
+            uint64_t sum = 0;
+            double total = 0.0;
+            double worst = 0.0;
+            for (int b = 0; b < kBatches; ++b) {
+                auto start = Clock::now();
+                for (int i = 0; i < kBatch; ++i) {
+                    sum += read();
+                }
+                double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / kBatch;
+                total += ns;
+                worst = std::max(worst, ns);
+            }
+            results[static_cast<size_t>(r)] = { total / kBatches, worst };
+            sink += sum;
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    Result result;
+    for (const Result& each : results) {
+        result.mean_ns += each.mean_ns / readers;
+        result.worst_ns = std::max(result.worst_ns, each.worst_ns);
+    }
+    return result;
+}
+
+void write_file(const std::string& path, const std::string& text) {
+    std::ofstream file(path, std::ios::trunc);
+    file << text;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int readers = argc > 1 ? std::max(1, std::atoi(argv[1])) : kDefaultReaders;
+    std::cout << "Running config read benchmark (" << readers << " readers)..." << std::endl;
+
+    char dir[] = "/tmp/config_read_bench_XXXXXX";
+    if (!mkdtemp(dir)) {
+        std::cerr << "  no scratch directory" << std::endl;
+        return 1;
+    }
+    const std::string settings = std::string(dir) + "/default.json";
+    const std::string streams = std::string(dir) + "/device_streams.yaml";
+    auto write_version = [&](int n) {
+        write_file(settings, "{\"voice\": {\"quality\": \"high\", \"local_port\": " + std::to_string(5000 + n) + "}}\n");
+        write_file(streams, "protocols:\n  hls:\n    playlist_size: " + std::to_string(n) + "\n");
+    };
+    write_version(1);
+
+    ConfigStore store;
+    if (!store.load(settings, streams)) {
+        return 1;
+    }
+    auto shared = std::make_shared<const ConfigSnapshot>();
+    std::mutex shared_mutex;
+
+    // Reloads, and swaps the mutex-guarded copy, until the readers finish
+    std::atomic<bool> done{false};
+    std::atomic<int> swaps{0};
+    std::thread writer([&] {
+        auto reader = store.make_reader();
+        for (int n = 2; !done.load(); ++n) {
+            write_version(n);
+            store.reload();
+            auto copy = std::make_shared<ConfigSnapshot>(*reader->read());
+            std::lock_guard<std::mutex> lock(shared_mutex);
+            shared = std::move(copy);
+            ++swaps;
+        }
+    });
+
+    Result store_reads = run_readers(readers, [&store] {
+        return [reader = std::shared_ptr<ConfigStore::Reader>(store.make_reader())] {
+            ConfigStore::Snapshot config = reader->read();
+            return config->streams.protocols.hls.playlist_size + config->settings.values().size();
+        };
+    });
+    int store_swaps = swaps.exchange(0);
+    Result mutex_reads = run_readers(readers, [&] {
+        return [&] {
+            std::shared_ptr<const ConfigSnapshot> config;
+            {
+                std::lock_guard<std::mutex> lock(shared_mutex);
+                config = shared;
+            }
+            return config->streams.protocols.hls.playlist_size + config->settings.values().size();
+        };
+    });
+    done = true;
+    writer.join();
+    ConfigStore::Stats stats = store.get_stats();
+    std::remove(settings.c_str());
+    std::remove(streams.c_str());
+    rmdir(dir);
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "  reloads:            " << stats.reloads << " (" << store_swaps << " during store reads), "
+              << stats.freed << " snapshots freed" << std::endl
+              << "  store read:         " << store_reads.mean_ns << " ns mean, " << store_reads.worst_ns
+              << " ns worst batch" << std::endl
+              << "  mutex + shared_ptr: " << mutex_reads.mean_ns << " ns mean, " << mutex_reads.worst_ns
+              << " ns worst batch" << std::endl;
+
+    int result = 0;
+    if (store_reads.mean_ns > kMaxMeanNs) {
+        std::cerr << "  " << store_reads.mean_ns << " ns a read, over " << kMaxMeanNs << std::endl;
+        result = 1;
+    }
+    std::cout << (result ? "Config read benchmark failed" : "Config read benchmark passed") << std::endl;
+    return result;
+}
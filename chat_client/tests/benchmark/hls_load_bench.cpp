@@ -0,0 +1,271 @@
+// HLS origin under load.
+//
+// Serves one live stream from HlsServer, cut into 1 s segments, to
+// thousands of local pollers on keep-alive connections, fed a 20 ms frame
+// of tone every 20 ms for the run. Each poller asks for the playlist again
+// as soon as it has it, and fetches each new segment the playlist lists,
+// so the server is never idle. Reports requests per second, the server's
+// publish latency (last frame of a segment handed over to the segment in
+// the playlist) and how long after that the pollers saw it.
+//
+// Fails if a request fails, the server manages fewer than kMinRequestsPerS,
+// or a segment took longer than kMaxPublishMs to publish.
+//
+// Usage: hls_load_bench [pollers] [seconds]
+
+#include "../../src/network/hls_server.h"
+#include "../../src/network/event_loop.h"
+#include "../../src/audio/codec_pipeline.h"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr unsigned kDefaultPollers = 2000;
+constexpr double kDefaultSeconds = 5.0;
+constexpr unsigned kClientThreads = 2;
+constexpr double kMinRequestsPerS = 20000;
+constexpr double kMaxPublishMs = 20;  // One frame
+const std::string kPlaylist = "/hls/default_mic/index.m3u8";
+
+using Clock = std::chrono::steady_clock;
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// When each segment's last frame was handed to the pipeline
+std::vector<std::atomic<int64_t>> finished_ns(4096);
+
+struct Poller {
+    int fd = -1;
+    std::string buffer;
+    int64_t newest = -1;         // Newest segment seen in a playlist
+    bool fetching = false;       // A segment, rather than the playlist
+    uint64_t requests = 0;
+    uint64_t failures = 0;
+    double seen_ms_total = 0.0;  // Segment finished to listed, as seen here
+    double seen_ms_max = 0.0;
+    uint64_t seen = 0;
+};
+
+void send_request(Poller& poller) {
+    std::string request = "GET ";
+    request += poller.fetching ? "/hls/default_mic/seg" + std::to_string(poller.newest) + ".m4s" : kPlaylist;
+    request += " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    if (send(poller.fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+        ++poller.failures;
+    }
+}
+
+// Takes whole responses off the buffer and sends the next request
+void on_readable(Poller& poller) {
+    char chunk[65536];
+    for (;;) {
+        ssize_t received = recv(poller.fd, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received <= 0) {
+            if (received == 0) {
+                ++poller.failures;
+            }
+            break;
+        }
+        poller.buffer.append(chunk, static_cast<size_t>(received));
+    }
+    for (;;) {
+        size_t end = poller.buffer.find("\r\n\r\n");
+        if (end == std::string::npos) {
+            return;
+        }
+        size_t at = poller.buffer.find("Content-Length: ");
+        size_t length = at < end ? std::strtoul(poller.buffer.c_str() + at + 16, nullptr, 10) : 0;
+        if (poller.buffer.size() < end + 4 + length) {
+            return;
+        }
+        if (poller.buffer.compare(0, 12, "HTTP/1.1 200") != 0) {
+            ++poller.failures;
+        }
+        ++poller.requests;
+        if (!poller.fetching) {
+            // The last segment listed
+            size_t name = poller.buffer.rfind("seg", end + 4 + length);
+            if (name != std::string::npos && name > end) {
+                int64_t newest = std::strtoll(poller.buffer.c_str() + name + 3, nullptr, 10);
+                if (newest > poller.newest) {
+                    int64_t finished = finished_ns[newest % finished_ns.size()].load(std::memory_order_acquire);
+                    if (finished > 0) {
+                        double ms = (now_ns() - finished) * 1e-6;
+                        poller.seen_ms_total += ms;
+                        poller.seen_ms_max = std::max(poller.seen_ms_max, ms);
+                        ++poller.seen;
+                    }
+                    poller.newest = newest;
+                    poller.fetching = true;
+                }
+            }
+        } else {
+            poller.fetching = false;
+        }
+        poller.buffer.erase(0, end + 4 + length);
+        send_request(poller);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned pollers = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : kDefaultPollers;
+    double seconds = argc > 2 ? std::atof(argv[2]) : kDefaultSeconds;
+    std::cout << "Running HLS load benchmark (" << pollers << " pollers, " << seconds << " s)..." << std::endl;
+
+    // Two descriptors a poller, counting the server's end
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    EventLoop loop;
+    HlsSettings hls;
+    hls.segment_ms = 1000;
+    HlsServer server(loop, hls);
+    CodecSettings settings;
+    CodecSettings::preset("high", settings);
+    settings.dtx = false;
+    AudioEncodePipeline* stream = server.add_stream(kPlaylist, settings);
+    if (!stream || !server.listen("127.0.0.1", 0)) {
+        std::cerr << "Cannot start the server" << std::endl;
+        return 1;
+    }
+    std::thread loop_thread([&loop] { loop.run(); });
+
+    std::vector<Poller> all(pollers);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server.port());
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    unsigned connected = 0;
+    for (Poller& poller : all) {
+        poller.fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (connect(poller.fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+            ++connected;
+        }
+    }
+
+    std::atomic<bool> running{true};
+    std::vector<std::thread> clients;
+    for (unsigned t = 0; t < kClientThreads; ++t) {
+        clients.emplace_back([&, t] {
+            int epoll = epoll_create1(0);
+            for (size_t i = t; i < all.size(); i += kClientThreads) {
+                epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.ptr = &all[i];
+                epoll_ctl(epoll, EPOLL_CTL_ADD, all[i].fd, &event);
+                send_request(all[i]);
+            }
+            epoll_event events[256];
+            while (running.load(std::memory_order_relaxed)) {
+                int ready = epoll_wait(epoll, events, 256, 50);
+                for (int i = 0; i < ready; ++i) {
+                    on_readable(*static_cast<Poller*>(events[i].data.ptr));
+                }
+            }
+            close(epoll);
+        });
+    }
+
+    // A frame every frame time, as the engine would deliver it
+    auto block = std::make_unique<AudioBlock>();
+    block->sample_rate = stream->sample_rate();
+    block->frames = stream->frame_samples();
+    const unsigned frames = static_cast<unsigned>(seconds * 1000 / settings.frame_ms);
+    const unsigned frames_per_segment = hls.segment_ms / settings.frame_ms;
+    uint64_t sample = 0;
+    HlsServer::Stats before = server.get_stats();
+    auto start = Clock::now();
+    for (unsigned frame = 0; frame < frames; ++frame) {
+        for (unsigned i = 0; i < block->frames; ++i, ++sample) {
+            block->samples[i] = 0.3f * static_cast<float>(std::sin(2 * kPi * 440.0 * sample / block->sample_rate));
+        }
+        block->sequence++;
+        if (frame % frames_per_segment == frames_per_segment - 1) {
+            finished_ns[(frame / frames_per_segment) % finished_ns.size()].store(now_ns(), std::memory_order_release);
+        }
+        stream->process(*block);
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(settings.frame_ms * (frame + 1)));
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    HlsServer::Stats stats = server.get_stats();
+    running = false;
+    for (std::thread& client : clients) {
+        client.join();
+    }
+
+    uint64_t requests = stats.requests - before.requests;
+    uint64_t failures = 0;
+    uint64_t seen = 0;
+    double seen_total = 0.0;
+    double seen_max = 0.0;
+    for (Poller& poller : all) {
+        failures += poller.failures;
+        seen += poller.seen;
+        seen_total += poller.seen_ms_total;
+        seen_max = std::max(seen_max, poller.seen_ms_max);
+    }
+    double rate = requests / elapsed;
+    double publish_avg = stats.segments_published ? stats.publish_ns_total * 1e-6 / stats.segments_published : 0.0;
+    double publish_max = stats.publish_ns_max * 1e-6;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "  pollers:            " << connected << " of " << pollers << " connected, "
+              << stats.connections << " open at the server" << std::endl
+              << "  requests:           " << requests << " (" << rate << "/s), "
+              << stats.segment_requests << " for segments, " << stats.bytes_sent / 1048576.0 << " MB sent" << std::endl
+              << std::setprecision(3)
+              << "  publish latency:    " << publish_avg << " ms average, " << publish_max << " ms max over "
+              << stats.segments_published << " segments" << std::endl
+              << "  seen by pollers:    " << (seen ? seen_total / seen : 0.0) << " ms average, " << seen_max
+              << " ms max after the last frame" << std::endl
+              << "  failures:           " << failures << ", evicted " << stats.evicted << ", overflows "
+              << stats.queue_overflows << std::endl;
+
+    int result = 0;
+    if (connected < pollers || failures > 0) {
+        std::cerr << "  " << pollers - connected << " pollers could not connect, " << failures
+                  << " requests failed" << std::endl;
+        result = 1;
+    }
+    if (rate < kMinRequestsPerS) {
+        std::cerr << "  " << rate << " requests/s, under " << kMinRequestsPerS << std::endl;
+        result = 1;
+    }
+    if (stats.segments_published == 0 || publish_max > kMaxPublishMs) {
+        std::cerr << "  publishing took up to " << publish_max << " ms, over " << kMaxPublishMs << std::endl;
+        result = 1;
+    }
+
+    for (Poller& poller : all) {
+        close(poller.fd);
+    }
+    loop.stop();
+    loop_thread.join();
+
+    std::cout << (result ? "HLS load benchmark failed" : "HLS load benchmark passed") << std::endl;
+    return result;
+}
@@ -0,0 +1,169 @@
+// Sample-rate converter quality and throughput.
+//
+// For each conversion the engine uses (device rate to the 16 kHz speech and
+// 48 kHz codec consumers, and 44.1 kHz devices to 48 kHz) and each
+// Resampler mode, measures:
+//   - SNR of a 1 kHz tone against the ideal resampled tone
+//   - alias rejection: output level of a tone between the output Nyquist
+//     rate and the input Nyquist rate (downsampling only)
+//   - throughput as ns per output sample and times faster than real time
+//
+// Fails if POLYPHASE drops below the quality floor or is not clearly faster
+// than computing the same windowed-sinc filter per sample.
+//
+// Usage: resampler_bench
+
+#include "../../src/dsp/resampler.h"
+#include "../../src/dsp/dsp_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kMinPolyphaseSnr = 60.0;        // dB
+constexpr double kMaxPolyphaseAlias = -70.0;     // dB
+constexpr double kMinSpeedupOverSinc = 5.0;
+
+struct Conversion {
+    unsigned input_rate;
+    unsigned output_rate;
+};
+
+const Conversion kConversions[] = {
+    { 48000, 16000 },
+    { 44100, 16000 },
+    { 44100, 48000 },
+    { 16000, 48000 },
+};
+
+const char* quality_name(Resampler::Quality quality) {
+    switch (quality) {
+        case Resampler::Quality::LINEAR:    return "linear";
+        case Resampler::Quality::SINC:      return "sinc";
+        case Resampler::Quality::POLYPHASE: return "polyphase";
+    }
+    return "?";
+}
+
+std::vector<float> tone(unsigned rate, double frequency, size_t frames) {
+    std::vector<float> samples(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        samples[i] = static_cast<float>(0.5 * std::sin(2.0 * kPi * frequency * i / rate));
+    }
+    return samples;
+}
+
+// Streams the input through in 256-frame callbacks, as the engine does
+std::vector<float> run(Resampler& resampler, const std::vector<float>& input) {
+    constexpr size_t kCallback = 256;
+    std::vector<float> output(resampler.max_output_frames(input.size()));
+    size_t produced = 0;
+    for (size_t offset = 0; offset < input.size(); offset += kCallback) {
+        size_t frames = std::min(kCallback, input.size() - offset);
+        produced += resampler.process(input.data() + offset, frames, output.data() + produced);
+    }
+    output.resize(produced);
+    return output;
+}
+
+double snr_db(const Conversion& c, Resampler::Quality quality) {
+    Resampler resampler(c.input_rate, c.output_rate, quality);
+    std::vector<float> output = run(resampler, tone(c.input_rate, 1000.0, c.input_rate));
+
+    // Skip the edges, where the filter sees the implicit silence
+    double signal = 0.0;
+    double error = 0.0;
+    for (size_t k = c.output_rate / 10; k + c.output_rate / 10 < output.size(); ++k) {
+        double expected = 0.5 * std::sin(2.0 * kPi * 1000.0 * k / c.output_rate);
+        signal += expected * expected;
+        error += (output[k] - expected) * (output[k] - expected);
+    }
+    return 10.0 * std::log10(signal / std::max(error, 1e-30));
+}
+
+// Level of a tone at 1.5x the output Nyquist rate, which the output cannot
+// represent and should be filtered out entirely
+double alias_db(const Conversion& c, Resampler::Quality quality) {
+    double frequency = 0.75 * c.output_rate;
+    Resampler resampler(c.input_rate, c.output_rate, quality);
+    std::vector<float> output = run(resampler, tone(c.input_rate, frequency, c.input_rate));
+
+    double energy = 0.0;
+    size_t counted = 0;
+    for (size_t k = output.size() / 4; k < output.size(); ++k) {
+        energy += output[k] * output[k];
+        ++counted;
+    }
+    return 10.0 * std::log10(std::max(energy / counted, 1e-30) / 0.125); // Relative to the input tone
+}
+
+double ns_per_output_sample(const Conversion& c, Resampler::Quality quality) {
+    Resampler resampler(c.input_rate, c.output_rate, quality);
+    std::vector<float> input = tone(c.input_rate, 1000.0, c.input_rate);
+    // Sinc is orders of magnitude slower; a shorter run is just as stable
+    int repeats = quality == Resampler::Quality::SINC ? 1 : 20;
+
+    size_t produced = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < repeats; ++i) {
+        produced += run(resampler, input).size();
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / produced;
+}
+
+} // namespace
+
+int main() {
+    std::cout << "Running resampler benchmark (" << dsp_kernels().name << " kernels)..." << std::endl;
+    std::cout << std::setw(14) << "conversion" << std::setw(11) << "mode"
+              << std::setw(10) << "snr dB" << std::setw(10) << "alias dB"
+              << std::setw(12) << "ns/sample" << std::setw(12) << "x realtime" << std::endl;
+
+    int failures = 0;
+    for (const Conversion& c : kConversions) {
+        double sinc_ns = 0.0;
+        for (auto quality : { Resampler::Quality::LINEAR, Resampler::Quality::SINC,
+                              Resampler::Quality::POLYPHASE }) {
+            double snr = snr_db(c, quality);
+            bool downsampling = c.output_rate < c.input_rate;
+            double alias = downsampling ? alias_db(c, quality) : 0.0;
+            double ns = ns_per_output_sample(c, quality);
+            double realtime = 1e9 / (ns * c.output_rate);
+
+            std::cout << std::setw(6) << c.input_rate << "->" << std::setw(6) << c.output_rate
+                      << std::setw(11) << quality_name(quality) << std::fixed << std::setprecision(1)
+                      << std::setw(10) << snr;
+            if (downsampling) {
+                std::cout << std::setw(10) << alias;
+            } else {
+                std::cout << std::setw(10) << "-";
+            }
+            std::cout << std::setw(12) << std::setprecision(2) << ns
+                      << std::setw(12) << std::setprecision(0) << realtime << std::endl;
+
+            if (quality == Resampler::Quality::SINC) {
+                sinc_ns = ns;
+            }
+            if (quality == Resampler::Quality::POLYPHASE) {
+                if (snr < kMinPolyphaseSnr || (downsampling && alias > kMaxPolyphaseAlias)) {
+                    std::cerr << "  polyphase quality below floor" << std::endl;
+                    ++failures;
+                }
+                if (sinc_ns / ns < kMinSpeedupOverSinc) {
+                    std::cerr << "  polyphase only " << sinc_ns / ns << "x faster than sinc" << std::endl;
+                    ++failures;
+                }
+            }
+        }
+    }
+
+    std::cout << (failures ? "Resampler benchmark failed" : "Resampler benchmark passed") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,290 @@
+// RTSP fan-out under load.
+//
+// Serves one live stream from RtspServer to hundreds of local clients,
+// half of them over UDP and half interleaved on their RTSP connections,
+// and feeds it a 20 ms frame of tone every 20 ms for the run. A receiver
+// thread counts what each client gets through epoll. Reports how long the
+// clients took to set up, the packets delivered, and the CPU time of the
+// server's loop thread per subscriber next to the one encode they share.
+//
+// Fails if any client misses more than kMaxLoss of its packets, or the
+// loop thread spends more than kMaxCpuPerSubscriber of a core on each.
+//
+// Usage: rtsp_load_bench [clients] [seconds]
+
+#include "../../src/network/rtsp_server.h"
+#include "../../src/network/event_loop.h"
+#include "../../src/audio/codec_pipeline.h"
+
+#include <algorithm>
+#include <atomic>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+constexpr unsigned kDefaultClients = 400;
+constexpr double kDefaultSeconds = 5.0;
+constexpr double kMaxLoss = 0.01;
+constexpr double kMaxCpuPerSubscriber = 0.001;  // 0.1% of a core
+
+using Clock = std::chrono::steady_clock;
+
+double thread_cpu_seconds(pthread_t thread) {
+    clockid_t clock;
+    timespec now{};
+    if (pthread_getcpuclockid(thread, &clock) != 0 || clock_gettime(clock, &now) != 0) {
+        return 0.0;
+    }
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+struct Subscriber {
+    int control = -1;  // The RTSP connection
+    int media = -1;    // UDP socket, or the control one for interleaved
+    bool interleaved = false;
+    std::string buffer;  // Interleaved bytes not yet framed
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+};
+
+bool exchange(int fd, const std::string& request, std::string& response) {
+    if (send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+        return false;
+    }
+    response.clear();
+    char chunk[2048];
+    while (response.find("\r\n\r\n") == std::string::npos) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        response.append(chunk, static_cast<size_t>(received));
+    }
+    size_t length = 0;
+    size_t at = response.find("Content-Length: ");
+    if (at != std::string::npos) {
+        length = std::strtoul(response.c_str() + at + 16, nullptr, 10);
+    }
+    while (response.size() < response.find("\r\n\r\n") + 4 + length) {
+        ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        response.append(chunk, static_cast<size_t>(received));
+    }
+    return response.compare(0, 15, "RTSP/1.0 200 OK") == 0;
+}
+
+// DESCRIBE, SETUP and PLAY, as a player would
+bool subscribe(Subscriber& subscriber, uint16_t port, bool interleaved) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    subscriber.control = socket(AF_INET, SOCK_STREAM, 0);
+    address.sin_port = htons(port);
+    if (connect(subscriber.control, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        return false;
+    }
+    std::string url = "rtsp://127.0.0.1:" + std::to_string(port) + "/mic/default";
+    std::string transport;
+    subscriber.interleaved = interleaved;
+    if (interleaved) {
+        subscriber.media = subscriber.control;
+        transport = "RTP/AVP/TCP;unicast;interleaved=0-1";
+    } else {
+        subscriber.media = socket(AF_INET, SOCK_DGRAM, 0);
+        int buffer = 1 << 20;
+        setsockopt(subscriber.media, SOL_SOCKET, SO_RCVBUF, &buffer, sizeof(buffer));
+        address.sin_port = 0;
+        socklen_t length = sizeof(address);
+        if (bind(subscriber.media, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || getsockname(subscriber.media, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            return false;
+        }
+        unsigned media_port = ntohs(address.sin_port);
+        transport = "RTP/AVP;unicast;client_port=" + std::to_string(media_port) + "-" + std::to_string(media_port + 1);
+    }
+    std::string response;
+    if (!exchange(subscriber.control, "DESCRIBE " + url + " RTSP/1.0\r\nCSeq: 1\r\n\r\n", response)
+        || !exchange(subscriber.control, "SETUP " + url + "/trackID=0 RTSP/1.0\r\nCSeq: 2\r\nTransport: "
+                                             + transport + "\r\n\r\n", response)) {
+        return false;
+    }
+    size_t at = response.find("Session: ");
+    std::string session = response.substr(at + 9, response.find_first_of(";\r", at + 9) - at - 9);
+    return exchange(subscriber.control, "PLAY " + url + " RTSP/1.0\r\nCSeq: 3\r\nSession: " + session
+                                            + "\r\n\r\n", response);
+}
+
+void drain(Subscriber& subscriber) {
+    char chunk[16384];
+    for (;;) {
+        ssize_t received = recv(subscriber.media, chunk, sizeof(chunk), MSG_DONTWAIT);
+        if (received <= 0) {
+            return;
+        }
+        if (!subscriber.interleaved) {
+            subscriber.packets++;
+            subscriber.bytes += static_cast<uint64_t>(received);
+            continue;
+        }
+        subscriber.buffer.append(chunk, static_cast<size_t>(received));
+        size_t offset = 0;
+        while (subscriber.buffer.size() - offset >= 4 && subscriber.buffer[offset] == '$') {
+            size_t length = size_t(uint8_t(subscriber.buffer[offset + 2])) << 8 | uint8_t(subscriber.buffer[offset + 3]);
+            if (subscriber.buffer.size() - offset < 4 + length) {
+                break;
+            }
+            subscriber.packets++;
+            subscriber.bytes += length;
+            offset += 4 + length;
+        }
+        subscriber.buffer.erase(0, offset);
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    unsigned clients = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : kDefaultClients;
+    double seconds = argc > 2 ? std::atof(argv[2]) : kDefaultSeconds;
+    std::cout << "Running RTSP load benchmark (" << clients << " clients, " << seconds << " s)..." << std::endl;
+
+    // Three descriptors a client, counting the server's end
+    rlimit limit{};
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    EventLoop loop;
+    RtspServer server(loop);
+    CodecSettings settings;
+    CodecSettings::preset("high", settings);
+    settings.dtx = false;
+    AudioEncodePipeline* stream = server.add_stream("/mic/default", settings);
+    if (!stream || !server.listen("127.0.0.1", 0)) {
+        std::cerr << "Cannot start the server" << std::endl;
+        return 1;
+    }
+    uint16_t port = server.ports()[0];
+    std::thread loop_thread([&loop] { loop.run(); });
+
+    std::vector<Subscriber> subscribers(clients);
+    auto start = Clock::now();
+    unsigned subscribed = 0;
+    for (unsigned i = 0; i < clients; ++i) {
+        subscribed += subscribe(subscribers[i], port, i % 2 == 1);
+    }
+    double setup_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    int epoll = epoll_create1(0);
+    for (Subscriber& subscriber : subscribers) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.ptr = &subscriber;
+        epoll_ctl(epoll, EPOLL_CTL_ADD, subscriber.media, &event);
+    }
+    std::atomic<bool> receiving{true};
+    std::thread receiver([&] {
+        epoll_event events[256];
+        while (receiving) {
+            int ready = epoll_wait(epoll, events, 256, 50);
+            for (int i = 0; i < ready; ++i) {
+                drain(*static_cast<Subscriber*>(events[i].data.ptr));
+            }
+        }
+    });
+
+    // A frame every frame time, as the engine would deliver it
+    auto block = std::make_unique<AudioBlock>();
+    block->sample_rate = stream->sample_rate();
+    block->frames = stream->frame_samples();
+    const unsigned frames = static_cast<unsigned>(seconds * 1000 / settings.frame_ms);
+    uint64_t sample = 0;
+    double loop_cpu_before = thread_cpu_seconds(loop_thread.native_handle());
+    start = Clock::now();
+    for (unsigned frame = 0; frame < frames; ++frame) {
+        for (unsigned i = 0; i < block->frames; ++i, ++sample) {
+            block->samples[i] = 0.3f * static_cast<float>(std::sin(2 * kPi * 440.0 * sample / block->sample_rate));
+        }
+        block->sequence++;
+        stream->process(*block);
+        std::this_thread::sleep_until(start + std::chrono::milliseconds(settings.frame_ms * (frame + 1)));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    double loop_cpu = thread_cpu_seconds(loop_thread.native_handle()) - loop_cpu_before;
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    receiving = false;
+    receiver.join();
+
+    RtspServer::Stats stats = server.get_stats();
+    AudioEncodePipeline::Stats encode = stream->get_stats();
+    uint64_t received = 0;
+    uint64_t worst = frames;
+    for (Subscriber& subscriber : subscribers) {
+        received += subscriber.packets;
+        worst = std::min(worst, subscriber.packets);
+    }
+    double per_subscriber = loop_cpu / elapsed / std::max(1u, subscribed);
+
+    std::cout << std::fixed << std::setprecision(1)
+              << "  subscribers:        " << subscribed << " of " << clients << " set up in "
+              << setup_seconds * 1000 << " ms" << std::endl
+              << "  packets:            " << stats.packets_encoded << " encoded, " << stats.packets_sent
+              << " sent, " << received << " received (" << std::setprecision(2)
+              << 100.0 * received / std::max<uint64_t>(1, uint64_t(frames) * clients) << "%), worst client "
+              << worst << " of " << frames << std::endl
+              << "  encode (once):      " << std::setprecision(3) << 100.0 * encode.encode_ns * 1e-9 / elapsed
+              << "% of a core" << std::endl
+              << "  loop thread:        " << 100.0 * loop_cpu / elapsed << "% of a core" << std::endl
+              << "  per subscriber:     " << std::setprecision(2) << per_subscriber * 1e6 << " us/s ("
+              << std::setprecision(4) << 100.0 * per_subscriber << "% of a core)" << std::endl
+              << "  send errors:        " << stats.send_errors << ", skipped " << stats.packets_skipped << std::endl;
+
+    int failures = 0;
+    if (subscribed < clients) {
+        std::cerr << "  " << clients - subscribed << " clients could not subscribe" << std::endl;
+        ++failures;
+    }
+    if (worst < frames * (1.0 - kMaxLoss)) {
+        std::cerr << "  a client received " << worst << " of " << frames << " packets" << std::endl;
+        ++failures;
+    }
+    if (per_subscriber > kMaxCpuPerSubscriber) {
+        std::cerr << "  " << 100.0 * per_subscriber << "% of a core per subscriber, over "
+                  << 100.0 * kMaxCpuPerSubscriber << "%" << std::endl;
+        ++failures;
+    }
+
+    for (Subscriber& subscriber : subscribers) {
+        if (subscriber.media >= 0 && subscriber.media != subscriber.control) {
+            close(subscriber.media);
+        }
+        if (subscriber.control >= 0) {
+            close(subscriber.control);
+        }
+    }
+    close(epoll);
+    loop.stop();
+    loop_thread.join();
+
+    std::cout << (failures ? "RTSP load benchmark failed" : "RTSP load benchmark passed") << std::endl;
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,135 @@
+// Time to first frame of the real client.
+//
+// Starts the built chat_client a few times with --startup-trace and
+// --exit-after-startup, so each run quits once its window has been drawn
+// and audio is ready, and reads back the Chrome trace it writes. Reports
+// the median time to the first frame and to audio ready, each phase's
+// median, and what the phases would add up to if they ran one after another.
+//
+// Needs a display; without one it says so and passes. Run from the
+// directory holding config/ and data/, as the client is.
+//
+// Fails if a run fails or writes no trace, or if the median first frame
+// takes over 250 ms.
+//
+// Usage: startup_bench [path/to/chat_client]
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr int kRuns = 5;
+constexpr double kMaxFirstFrameMs = 250.0;
+const char* const kTracePath = "startup_bench_trace.json";
+
+struct Run {
+    double first_frame_ms = -1.0;
+    double audio_ready_ms = -1.0;
+    std::map<std::string, double> phase_ms;
+};
+
+bool json_field(const std::string& line, const std::string& key, std::string& value) {
+    std::string quoted = "\"" + key + "\":";
+    size_t at = line.find(quoted);
+    if (at == std::string::npos) {
+        return false;
+    }
+    at += quoted.size();
+    if (line[at] == '"') {
+        size_t end = line.find('"', at + 1);
+        value = line.substr(at + 1, end - at - 1);
+    } else {
+        value = line.substr(at, line.find_first_of(",}", at) - at);
+    }
+    return true;
+}
+
+// The client writes one event a line
+bool read_trace(const std::string& path, Run& run) {
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        std::string name, phase, ts, dur;
+        if (!json_field(line, "name", name) || !json_field(line, "ph", phase) || !json_field(line, "ts", ts)) {
+            continue;
+        }
+        if (phase == "i" && name == "first_frame") {
+            run.first_frame_ms = std::stod(ts) / 1000.0;
+        } else if (phase == "i" && name == "audio_ready") {
+            run.audio_ready_ms = std::stod(ts) / 1000.0;
+        } else if (phase == "X" && json_field(line, "dur", dur)) {
+            run.phase_ms[name] += std::stod(dur) / 1000.0;
+        }
+    }
+    return run.first_frame_ms >= 0 && run.audio_ready_ms >= 0;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::cout << "Running startup benchmark..." << std::endl;
+    const std::string client = argc > 1 ? argv[1] : "bin/chat_client";
+    if (!std::getenv("DISPLAY") && !std::getenv("WAYLAND_DISPLAY")) {
+        std::cout << "No display, skipping startup benchmark." << std::endl;
+        return 0;
+    }
+
+    std::vector<Run> runs;
+    const std::string command = "\"" + client + "\" --startup-trace=" + kTracePath +
+                                " --exit-after-startup > /dev/null 2>&1";
+    for (int i = 0; i < kRuns; ++i) {
+        std::remove(kTracePath);
+        Run run;
+        if (std::system(command.c_str()) != 0 || !read_trace(kTracePath, run)) {
+            std::cerr << "  " << client << " failed or wrote no trace" << std::endl;
+            std::cout << "Startup benchmark failed" << std::endl;
+            return 1;
+        }
+        runs.push_back(run);
+    }
+    std::remove(kTracePath);
+
+    std::vector<double> first_frame, audio_ready;
+    std::map<std::string, std::vector<double>> phases;
+    for (const Run& run : runs) {
+        first_frame.push_back(run.first_frame_ms);
+        audio_ready.push_back(run.audio_ready_ms);
+        for (const auto& phase : run.phase_ms) {
+            phases[phase.first].push_back(phase.second);
+        }
+    }
+
+    std::cout << std::fixed << std::setprecision(1);
+    double serial = 0.0;
+    for (const auto& phase : phases) {
+        double ms = median(phase.second);
+        std::cout << std::setw(20) << phase.first << std::setw(10) << ms << " ms" << std::endl;
+        // Waits overlap the phases they wait for
+        if (phase.first.find(".wait") == std::string::npos) {
+            serial += ms;
+        }
+    }
+    const double first_frame_ms = median(first_frame);
+    std::cout << "First frame after " << first_frame_ms << " ms, audio ready after " << median(audio_ready)
+              << " ms; the phases one after another take " << serial << " ms" << std::endl;
+
+    bool failed = first_frame_ms > kMaxFirstFrameMs;
+    if (failed) {
+        std::cerr << "  first frame over " << kMaxFirstFrameMs << " ms" << std::endl;
+    }
+    std::cout << (failed ? "Startup benchmark failed" : "Startup benchmark passed") << std::endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+// CPU cost of the scope tab's waveform and spectrogram data.
+//
+// Feeds two hours of 16 kHz audio into a WaveformPyramid, as the scope
+// consumer does, and a minute into a Spectrogram, and measures each as a
+// share of one core in real time. Then, with the whole two hours retained,
+// measures what the widgets read at 60 fps: the few new columns of a live
+// view, and a full 800-column redraw at every zoom from 1 frame a pixel to
+// the whole history, as while dragging or zooming.
+//
+// FLTK's own drawing and blits are not included; they cost the same per
+// column whatever the history holds.
+//
+// Fails if feeding plus the live view at 60 fps takes over 2% of a core, if
+// a full redraw at any zoom takes over 1 ms, or if the two hours take over
+// 32 MB.
+//
+// Usage: waveform_bench
+
+#include "../../src/audio/waveform_pyramid.h"
+#include "../../src/dsp/spectrogram.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+
+constexpr unsigned kRate = 16000;
+constexpr double kHours = 2.0;
+constexpr double kFps = 60.0;
+constexpr size_t kColumns = 800;
+constexpr double kPixelsPerSecond = 100.0;  // Live view, one spectrogram column each
+constexpr double kMaxCoreShare = 0.02;
+constexpr double kMaxRedrawMs = 1.0;
+constexpr size_t kMaxBytes = size_t(32) << 20;
+
+using Clock = std::chrono::steady_clock;
+
+// Speech-like enough for min/max: noise under a slow envelope
+class Source {
+public:
+    void fill(float* out, size_t frames) {
+        for (size_t i = 0; i < frames; ++i, ++n_) {
+            state_ = state_ * 1664525u + 1013904223u;
+            float noise = static_cast<float>(static_cast<int32_t>(state_)) / 2147483648.0f;
+            float envelope = (n_ / 4000) % 3 ? 0.5f : 0.02f;
+            out[i] = noise * envelope;
+        }
+    }
+
+private:
+    uint32_t state_ = 1;
+    uint64_t n_ = 0;
+};
+
+} // namespace
+
+int main() {
+    std::cout << "Running waveform benchmark..." << std::endl;
+    int failures = 0;
+
+    WaveformPyramid pyramid;
+    Source source;
+    std::vector<float> block(1024);
+    const size_t blocks = static_cast<size_t>(kHours * 3600 * kRate / block.size());
+    std::chrono::duration<double> feeding{0};
+    for (size_t n = 0; n < blocks; ++n) {
+        source.fill(block.data(), block.size());
+        auto start = Clock::now();
+        pyramid.append(block.data(), block.size());
+        feeding += Clock::now() - start;
+    }
+    const double audio_seconds = static_cast<double>(pyramid.total_frames()) / kRate;
+    const double pyramid_share = feeding.count() / audio_seconds;
+
+    Spectrogram spectrogram;
+    std::chrono::duration<double> analysing{0};
+    for (size_t n = 0; n < 60 * kRate / block.size(); ++n) {
+        source.fill(block.data(), block.size());
+        auto start = Clock::now();
+        spectrogram.push(block.data(), block.size());
+        analysing += Clock::now() - start;
+    }
+    const double spectrogram_share = analysing.count() / 60.0;
+
+    std::cout << std::fixed << std::setprecision(3)
+              << "Feeding: pyramid " << pyramid_share * 100 << "% of a core, spectrogram "
+              << spectrogram_share * 100 << "%" << std::endl;
+    std::cout << std::setprecision(1) << kHours << " h retained in "
+              << pyramid.memory_bytes() / 1048576.0 << " MB" << std::endl;
+    if (pyramid.memory_bytes() > kMaxBytes) {
+        std::cerr << "  history takes too much memory" << std::endl;
+        ++failures;
+    }
+
+    // A live view at 60 fps: each frame reads the columns that arrived since
+    // the last, of the waveform and of the spectrogram
+    const double fpp = kRate / kPixelsPerSecond;
+    const int frames = 6000;
+    std::vector<WaveformPyramid::Column> columns(kColumns);
+    std::vector<uint8_t> levels(kColumns * spectrogram.bins());
+    const int64_t newest = static_cast<int64_t>(pyramid.total_frames() / fpp);
+    auto start = Clock::now();
+    double column = static_cast<double>(newest - 10000);
+    for (int frame = 0; frame < frames; ++frame) {
+        int64_t from = static_cast<int64_t>(column);
+        column += kPixelsPerSecond / kFps;
+        int fresh = static_cast<int>(static_cast<int64_t>(column) - from);
+        pyramid.envelope(static_cast<int64_t>(from * fpp), fpp, columns.data(), fresh);
+        spectrogram.read_columns(spectrogram.columns() - fresh, fresh, levels.data());
+    }
+    std::chrono::duration<double> live = Clock::now() - start;
+    const double live_share = live.count() / frames * kFps;
+    const double total_share = pyramid_share + spectrogram_share + live_share;
+    std::cout << std::setprecision(3) << "Live view at " << kFps << " fps: " << live_share * 100
+              << "% of a core; with feeding " << total_share * 100 << "%" << std::endl;
+    if (total_share > kMaxCoreShare) {
+        std::cerr << "  over " << kMaxCoreShare * 100 << "% of a core" << std::endl;
+        ++failures;
+    }
+
+    // Full redraws, newest history at the right edge
+    std::cout << std::setw(16) << "frames/pixel" << std::setw(14) << "view" << std::setw(12) << "us"
+              << std::setw(14) << "reads/col" << std::endl;
+    const double total = static_cast<double>(pyramid.total_frames());
+    for (double zoom = 1.0; zoom <= total / kColumns * 2; zoom *= 4) {
+        constexpr int kRepeats = 50;
+        size_t reads = 0;
+        auto redraw_start = Clock::now();
+        for (int i = 0; i < kRepeats; ++i) {
+            reads = pyramid.envelope(static_cast<int64_t>(total - zoom * kColumns), zoom,
+                                     columns.data(), kColumns);
+        }
+        std::chrono::duration<double, std::micro> redraw = Clock::now() - redraw_start;
+        double us = redraw.count() / kRepeats;
+        std::cout << std::setw(16) << std::setprecision(0) << zoom << std::setw(12) << std::setprecision(1)
+                  << zoom * kColumns / kRate << " s" << std::setw(12) << us << std::setw(14)
+                  << static_cast<double>(reads) / kColumns << std::endl;
+        if (us > kMaxRedrawMs * 1000) {
+            std::cerr << "  full redraw too slow" << std::endl;
+            ++failures;
+        }
+    }
+
+    std::cout << (failures ? "Waveform benchmark failed" : "Waveform benchmark passed") << std::endl;
+    return failures ? 1 : 0;
+}
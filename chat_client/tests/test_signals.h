@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Voiced speech stand-in: a gliding pitch with falling harmonics and a
+// syllable-rate envelope
+inline std::vector<float> speech(unsigned rate, double seconds) {
+    std::vector<float> out(static_cast<size_t>(rate * seconds));
+    double phase = 0.0;
+    for (size_t i = 0; i < out.size(); ++i) {
+        double t = double(i) / rate;
+        double pitch = 140.0 + 30.0 * std::sin(2 * M_PI * 0.7 * t);
+        phase += 2 * M_PI * pitch / rate;
+        double value = 0.0;
+        for (int h = 1; h <= 8; ++h) {
+            value += std::sin(h * phase) / h;
+        }
+        double envelope = 0.6 + 0.4 * std::sin(2 * M_PI * 4.0 * t);
+        out[i] = static_cast<float>(0.2 * envelope * value);
+    }
+    return out;
+}
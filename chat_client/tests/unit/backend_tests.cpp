@@ -0,0 +1,168 @@
+#include "../../src/audio/audio_engine.h"
+#include "../../src/audio/file_backend.h"
+#include "../../src/audio/wav_file.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+static bool wait_until_finished(AudioEngine& engine, double timeout_seconds) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(timeout_seconds);
+    while (engine.is_stream_active()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// Ten seconds of audio through the null backend should finish in a
+// fraction of that when not paced.
+static void test_null_freerun() {
+    AudioEngine engine;
+    AudioEngine::BackendOptions options;
+    options.pacing = AudioEngine::BackendOptions::Pacing::FREERUN;
+    options.max_frames = 48000 * 10;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE, options));
+    assert(engine.get_devices().size() == 1);
+
+    uint64_t frames = 0;
+    engine.set_audio_callback([&frames](const float*, float* output, unsigned int n) {
+        frames += n;
+        output[0] = 0.0f;
+    });
+
+    assert(engine.open_device(0, 48000));
+    auto start = std::chrono::steady_clock::now();
+    engine.start_stream();
+    assert(wait_until_finished(engine, 5.0));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    engine.stop_stream();
+
+    assert(frames == options.max_frames);
+    AudioEngine::Stats stats = engine.get_stats();
+    assert(stats.backend == AudioEngine::Backend::NULL_DEVICE);
+    assert(stats.sample_rate == 48000);
+    assert(stats.frames_per_buffer == 256);
+    assert(stats.callbacks == (options.max_frames + 255) / 256);
+    assert(engine.get_host_apis().empty());
+    std::cout << "Null backend free-running: 10 s of audio in " << elapsed.count() << " s" << std::endl;
+}
+
+static void test_null_realtime() {
+    AudioEngine engine;
+    AudioEngine::BackendOptions options;
+    options.max_frames = 48000 / 5; // 200 ms
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE, options));
+    assert(engine.open_device(0, 48000));
+
+    auto start = std::chrono::steady_clock::now();
+    engine.start_stream();
+    assert(wait_until_finished(engine, 5.0));
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    engine.stop_stream();
+
+    // The last buffer's sleep is skipped, so allow one buffer of slack
+    assert(elapsed.count() >= 0.19);
+    std::cout << "Null backend real-time: 200 ms of audio in " << elapsed.count() << " s" << std::endl;
+}
+
+// File in, file out: output must be the input through the user callback,
+// sample for sample.
+static void test_file_roundtrip() {
+    const std::string input_path = "backend_test_input.wav";
+    const std::string output_path = "backend_test_output.wav";
+    constexpr unsigned kSampleRate = 16000;
+    constexpr size_t kFrames = 16000 + 123; // Not a multiple of the buffer size
+
+    std::vector<float> tone(kFrames);
+    for (size_t i = 0; i < kFrames; ++i) {
+        tone[i] = 0.5f * std::sin(2.0f * 3.14159265f * 440.0f * i / kSampleRate);
+    }
+    {
+        WavWriter writer;
+        assert(writer.open(input_path, kSampleRate, 1));
+        assert(writer.write(tone.data(), tone.size()));
+    }
+
+    AudioEngine engine;
+    AudioEngine::BackendOptions options;
+    options.pacing = AudioEngine::BackendOptions::Pacing::FREERUN;
+    options.input_path = input_path;
+    options.output_path = output_path;
+    assert(engine.initialize(AudioEngine::Backend::WAV_FILE, options));
+    engine.set_audio_callback([](const float* input, float* output, unsigned int n) {
+        for (unsigned int i = 0; i < n; ++i) {
+            output[2 * i] = input[i] * 0.5f;
+            output[2 * i + 1] = -input[i];
+        }
+    });
+
+    assert(engine.open_device(0, kSampleRate));
+    engine.start_stream();
+    assert(wait_until_finished(engine, 5.0));
+    engine.stop_stream();
+
+    // Read back as mono: (0.5x - x) / 2 = -0.25x
+    WavData result;
+    assert(read_wav_mono(output_path, result));
+    assert(result.sample_rate == kSampleRate);
+    assert(result.samples.size() >= kFrames);
+    for (size_t i = 0; i < kFrames; ++i) {
+        assert(std::fabs(result.samples[i] + 0.25f * tone[i]) < 1e-6f);
+    }
+
+    std::remove(input_path.c_str());
+    std::remove(output_path.c_str());
+    std::cout << "File backend round trip: OK (" << result.samples.size() << " frames)" << std::endl;
+}
+
+// A backend destroyed while streaming stops its thread before the members
+// the thread uses go, and still finishes its output file.
+static void test_destroy_while_running() {
+    const std::string output_path = "backend_test_destroyed.wav";
+    AudioEngine engine;
+    AudioEngine::BackendOptions options;
+    options.pacing = AudioEngine::BackendOptions::Pacing::FREERUN;
+    options.output_path = output_path;
+    AudioEngine::StreamConfig config;
+    config.sample_rate = 16000;
+
+    for (int i = 0; i < 20; ++i) {
+        {
+            NullBackend backend(engine, options);
+            assert(backend.open(config));
+            assert(backend.start());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        {
+            FileBackend backend(engine, options);
+            assert(backend.open(config));
+            assert(backend.start());
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        WavData result;
+        assert(read_wav_mono(output_path, result));
+        assert(result.sample_rate == config.sample_rate);
+        assert(!result.samples.empty());
+    }
+
+    std::remove(output_path.c_str());
+    std::cout << "Destroyed while running: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running audio backend tests..." << std::endl;
+
+    test_null_freerun();
+    test_null_realtime();
+    test_file_roundtrip();
+    test_destroy_while_running();
+
+    std::cout << "Audio backend tests completed" << std::endl;
+    return 0;
+}
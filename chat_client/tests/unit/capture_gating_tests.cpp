@@ -0,0 +1,366 @@
+#include "../../src/audio/audio_engine.h"
+#include "../../src/audio/capture_consumer.h"
+#include "../../src/dsp/voice_processor.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const double kPi = 3.14159265358979;
+static const unsigned kRate = 48000;
+static const unsigned kCallback = 256;
+
+// Voiced sound: harmonics of a 140 Hz pitch shaped by two formants
+static float voiced(size_t n) {
+    double t = static_cast<double>(n) / kRate;
+    double sum = 0.0;
+    for (int h = 1; h <= 25; ++h) {
+        double f = h * 140.0;
+        double amplitude = std::exp(-std::pow((f - 500.0) / 300.0, 2))
+                         + 0.6 * std::exp(-std::pow((f - 1500.0) / 400.0, 2));
+        sum += amplitude * std::sin(2.0 * kPi * f * t + h);
+    }
+    return static_cast<float>(0.05 * sum);
+}
+
+// 2 s of room noise, 1 s of speech with a 200 ms pause, 2 s of noise
+static std::vector<float> conversation() {
+    std::mt19937 rng(5);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    std::vector<float> capture(kRate * 5 / kCallback * kCallback);
+    for (size_t n = 0; n < capture.size(); ++n) {
+        double t = static_cast<double>(n) / kRate;
+        bool talking = (t >= 2.0 && t < 2.4) || (t >= 2.6 && t < 3.0);
+        capture[n] = 1e-4f * gauss(rng) + (talking ? voiced(n) : 0.0f);
+    }
+    return capture;
+}
+
+// Everything a consumer was handed, in order
+struct Recording {
+    std::mutex mutex;
+    std::vector<float> samples;
+    std::vector<AudioBlock> headers;  // samples[] not kept
+
+    CaptureConsumer::Handler handler() {
+        return [this](const AudioBlock& block) {
+            std::lock_guard<std::mutex> lock(mutex);
+            samples.insert(samples.end(), block.samples, block.samples + block.frames);
+            headers.push_back(block);
+        };
+    }
+
+    size_t count(bool AudioBlock::*flag) const {
+        size_t n = 0;
+        for (const AudioBlock& block : headers) {
+            n += block.*flag ? 1 : 0;
+        }
+        return n;
+    }
+};
+
+// Pauses now and then so the level consumer's 64-block ring keeps up
+static void run(AudioEngine& engine, const std::vector<float>& capture) {
+    std::vector<float> output(2 * kCallback);
+    for (size_t offset = 0; offset + kCallback <= capture.size(); offset += kCallback) {
+        engine.process_block(&capture[offset], output.data(), kCallback);
+        if (offset % (16 * kCallback) == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+}
+
+// Gated consumers get one talk spurt, pre-roll first and contiguous with
+// the live audio, with dtx blocks around it; the level metering still sees
+// every callback.
+static void test_gated_delivery() {
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    AudioEngine::GatingOptions options;
+    options.enabled = true;
+    engine.set_capture_gating(options);
+    assert(engine.voice_processor().enabled(VoiceProcessor::Stage::VOICE_ACTIVITY));
+    assert(engine.open_device(0, kRate));
+
+    std::atomic<size_t> level_blocks{0};
+    engine.set_level_callback([&level_blocks](float, float) { level_blocks.fetch_add(1); });
+    Recording recording;
+    CaptureConsumer consumer("network", recording.handler(), 4096);
+    consumer.start();
+    engine.add_capture_consumer(&consumer);
+
+    std::vector<float> capture = conversation();
+    run(engine, capture);
+    consumer.stop();
+    engine.remove_capture_consumer(&consumer);
+    engine.set_level_callback(nullptr);
+
+    assert(level_blocks.load() == capture.size() / kCallback);
+    assert(recording.count(&AudioBlock::segment_start) == 1);
+    assert(recording.count(&AudioBlock::dtx) >= 8);
+    for (const AudioBlock& block : recording.headers) {
+        assert(block.dtx ? block.frames == 0 && !block.speech : block.speech);
+        assert(!block.dtx || (block.comfort_noise_level > 0.5e-4f && block.comfort_noise_level < 2e-4f));
+    }
+
+    // Speech, hangover and pre-roll, nothing like the whole five seconds
+    double seconds = static_cast<double>(recording.samples.size()) / kRate;
+    assert(seconds > 1.2 && seconds < 1.7);
+
+    // With detection alone the capture is only delayed, so the spurt is one
+    // unbroken slice of the input
+    const size_t latency = engine.voice_processor().latency_frames();
+    size_t start = 0;
+    while (start + latency < capture.size() && capture[start] != recording.samples[0]) {
+        ++start;
+    }
+    for (size_t i = 0; i < recording.samples.size(); ++i) {
+        assert(recording.samples[i] == capture[start + i]);
+    }
+    double lead_ms = 1000.0 * (kRate * 2 - static_cast<double>(start)) / kRate;
+    assert(lead_ms > 100.0 && lead_ms <= 150.0);
+
+    AudioEngine::GatingStats stats = engine.get_gating_stats();
+    assert(stats.segments == 1);
+    assert(stats.speech_frames == recording.samples.size());
+    // What is still in the pre-roll was neither sent nor withheld
+    assert(stats.speech_frames + stats.silence_frames + kRate * 150 / 1000 == capture.size());
+    assert(stats.silence_fraction > 0.6);
+    std::cout << "Gated delivery: OK (" << seconds << " s of 5 s delivered, " << lead_ms
+              << " ms pre-roll, " << recording.count(&AudioBlock::dtx) << " dtx blocks)" << std::endl;
+}
+
+// Durations set once the device is open, as a settings reload does, apply
+// from the next callback
+static void test_durations_while_open() {
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    AudioEngine::GatingOptions options;
+    options.enabled = true;
+    engine.set_capture_gating(options);
+    assert(engine.open_device(0, kRate));
+    options.hangover_ms = 100;
+    options.preroll_ms = 50;
+    engine.set_capture_gating(options);
+    assert(engine.capture_gating().hangover_ms == 100 && engine.capture_gating().preroll_ms == 50);
+
+    Recording recording;
+    CaptureConsumer consumer("network", recording.handler(), 4096);
+    consumer.start();
+    engine.add_capture_consumer(&consumer);
+    std::vector<float> capture = conversation();
+    run(engine, capture);
+    consumer.stop();
+    engine.remove_capture_consumer(&consumer);
+
+    const size_t latency = engine.voice_processor().latency_frames();
+    size_t start = 0;
+    while (start + latency < capture.size() && capture[start] != recording.samples[0]) {
+        ++start;
+    }
+    double lead_ms = 1000.0 * (kRate * 2 - static_cast<double>(start)) / kRate;
+    assert(lead_ms > 0.0 && lead_ms <= 50.0);
+    double seconds = static_cast<double>(recording.samples.size()) / kRate;
+    assert(seconds > 1.0 && seconds < 1.3);
+
+    // Longer than was set aside at open is cut short
+    options.preroll_ms = 5000;
+    engine.set_capture_gating(options);
+    assert(engine.capture_gating().preroll_ms == AudioEngine::kMaxPrerollMs);
+    std::cout << "Durations while open: OK (" << seconds << " s delivered, " << lead_ms
+              << " ms pre-roll)" << std::endl;
+}
+
+// A resampled gated consumer gets its spurt and dtx blocks at its own rate,
+// and the savings are accounted per consumer
+static void test_resampled_consumer_and_savings() {
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    AudioEngine::GatingOptions options;
+    options.enabled = true;
+    engine.set_capture_gating(options);
+    assert(engine.open_device(0, kRate));
+
+    Recording recording;
+    volatile float sink = 0.0f;
+    CaptureConsumer consumer("stt", [&recording, &sink](const AudioBlock& block) {
+        // Stands in for feature extraction
+        for (int pass = 0; pass < 50; ++pass) {
+            for (unsigned i = 0; i < block.frames; ++i) {
+                sink = sink + block.samples[i] * block.samples[i];
+            }
+        }
+        recording.handler()(block);
+    }, 4096);
+    consumer.start();
+    engine.add_capture_consumer(&consumer, 16000);
+
+    run(engine, conversation());
+    consumer.stop();
+
+    for (const AudioBlock& block : recording.headers) {
+        assert(block.sample_rate == 16000);
+    }
+    assert(recording.count(&AudioBlock::segment_start) == 1);
+    double seconds = static_cast<double>(recording.samples.size()) / 16000;
+    assert(seconds > 1.2 && seconds < 1.7);
+
+    AudioEngine::GatingStats stats = engine.get_gating_stats();
+    assert(consumer.withheld_frames() > 16000 * 3);
+    assert(stats.bytes_saved == consumer.withheld_frames() * sizeof(float));
+    assert(stats.engine_cpu_saved > 0.0);
+    assert(stats.consumer_cpu_saved > stats.engine_cpu_saved);
+    engine.remove_capture_consumer(&consumer);
+    std::cout << "Resampled consumer and savings: OK (" << stats.bytes_saved / 1024 << " KiB, engine "
+              << stats.engine_cpu_saved * 1e3 << " ms, consumer " << stats.consumer_cpu_saved * 1e3
+              << " ms saved)" << std::endl;
+}
+
+// Without gating every block goes out, marked speech, with no dtx
+static void test_ungated() {
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    assert(engine.open_device(0, kRate));
+    assert(!engine.capture_gating().enabled);
+
+    Recording recording;
+    CaptureConsumer consumer("recorder", recording.handler(), 4096);
+    consumer.start();
+    engine.add_capture_consumer(&consumer);
+    std::vector<float> capture = conversation();
+    run(engine, capture);
+    consumer.stop();
+    engine.remove_capture_consumer(&consumer);
+
+    assert(recording.samples == capture);
+    assert(recording.count(&AudioBlock::speech) == recording.headers.size());
+    assert(recording.count(&AudioBlock::dtx) == 0);
+    assert(recording.count(&AudioBlock::segment_start) == 0);
+    assert(engine.get_gating_stats().speech_frames == 0);
+    std::cout << "Ungated delivery: OK" << std::endl;
+}
+
+// Playback consumers get the output mixed down, every callback of it,
+// while capture gating holds back the silence
+static void test_playback_consumer() {
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    assert(engine.open_device(0, kRate));
+    AudioEngine::GatingOptions gating;
+    gating.enabled = true;
+    engine.set_capture_gating(gating);
+    std::vector<float> capture = conversation();
+    // What the graph is handed, after voice processing
+    auto processed = std::make_shared<std::vector<float>>();
+    processed->reserve(capture.size());
+    engine.set_audio_callback([processed](const float* input, float* output, unsigned int frames) {
+        for (unsigned int i = 0; i < frames; ++i) {
+            output[2 * i] = input[i];
+            output[2 * i + 1] = 0.5f * input[i];
+            processed->push_back(input[i]);
+        }
+    });
+
+    Recording played;
+    CaptureConsumer player("player", played.handler(), 4096);
+    player.start();
+    assert(engine.add_playback_consumer(&player));
+    Recording captured;
+    CaptureConsumer capturer("capturer", captured.handler(), 4096);
+    capturer.start();
+    engine.add_capture_consumer(&capturer);
+    run(engine, capture);
+    player.stop();
+    capturer.stop();
+    engine.remove_capture_consumer(&player);
+    engine.remove_capture_consumer(&capturer);
+
+    assert(played.samples.size() == capture.size());
+    for (size_t i = 0; i < capture.size(); ++i) {
+        assert(std::fabs(played.samples[i] - 0.75f * (*processed)[i]) < 1e-6f);
+    }
+    assert(played.count(&AudioBlock::dtx) == 0);
+    assert(captured.samples.size() < capture.size() / 2);
+    std::cout << "Playback consumer: OK" << std::endl;
+}
+
+// Far end stand-in: a constant added to both channels
+struct FarEnd : AudioProcessor {
+    void process(const float*, float* output, unsigned int frames) override {
+        for (unsigned int i = 0; i < 2 * frames; ++i) {
+            output[i] += 0.25f;
+        }
+    }
+};
+
+// Gain and mutes reach what the consumers are sent and the playback
+// source as well as the monitored input
+static void test_mute_and_volume() {
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    assert(engine.open_device(0, kRate));
+    FarEnd far_end;
+    engine.set_playback_source(&far_end);
+    Recording captured;
+    CaptureConsumer capturer("capturer", captured.handler(), 4096);
+    capturer.start();
+    engine.add_capture_consumer(&capturer);
+
+    std::vector<float> capture = conversation();
+    capture.resize(96 * kCallback);
+    // Plays capture through with the settings given; returns the output
+    auto play = [&](float gain, bool input_muted, float volume, bool output_muted) {
+        engine.set_input_gain(gain);
+        engine.set_input_muted(input_muted);
+        engine.set_output_volume(volume);
+        engine.set_output_muted(output_muted);
+        std::vector<float> output(2 * capture.size());
+        for (size_t offset = 0; offset + kCallback <= capture.size(); offset += kCallback) {
+            engine.process_block(&capture[offset], &output[2 * offset], kCallback);
+            if (offset % (16 * kCallback) == 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            }
+        }
+        return output;
+    };
+    std::vector<float> normal = play(0.5f, false, 0.5f, false);
+    std::vector<float> muted_in = play(0.5f, true, 1.0f, false);
+    std::vector<float> muted_out = play(1.0f, false, 0.5f, true);
+    capturer.stop();
+    engine.remove_capture_consumer(&capturer);
+    engine.set_playback_source(nullptr);
+
+    const size_t n = capture.size();
+    assert(captured.samples.size() == 3 * n);
+    for (size_t i = 0; i < n; ++i) {
+        assert(std::fabs(captured.samples[i] - 0.5f * capture[i]) < 1e-6f);
+        assert(captured.samples[n + i] == 0.0f);
+        assert(std::fabs(captured.samples[2 * n + i] - capture[i]) < 1e-6f);
+        for (size_t c = 0; c < 2; ++c) {
+            assert(std::fabs(normal[2 * i + c] - 0.5f * (0.5f * capture[i] + 0.25f)) < 1e-6f);
+            assert(muted_in[2 * i + c] == 0.25f);  // The far end still plays
+            assert(muted_out[2 * i + c] == 0.0f);
+        }
+    }
+    std::cout << "Mute and volume: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running capture gating tests..." << std::endl;
+
+    test_gated_delivery();
+    test_durations_while_open();
+    test_resampled_consumer_and_savings();
+    test_ungated();
+    test_playback_consumer();
+    test_mute_and_volume();
+
+    std::cout << "Capture gating tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,166 @@
+#include "../../src/core/chat_history.h"
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <string_view>
+
+// The text widget as a plain string
+class StringDisplay : public ChatHistory::Display {
+public:
+    void append(std::string_view text) override { text_.append(text.data(), text.size()); }
+    void prepend(std::string_view text) override { text_.insert(0, text.data(), text.size()); }
+    void remove_front(size_t bytes) override {
+        assert(bytes <= text_.size());
+        text_.erase(0, bytes);
+    }
+    void remove_back(size_t bytes) override {
+        assert(bytes <= text_.size());
+        text_.erase(text_.size() - bytes);
+    }
+
+    const std::string& text() const { return text_; }
+
+private:
+    std::string text_;
+};
+
+static std::string line(size_t i) {
+    return "[12:00:00] user" + std::to_string(i % 7) + ": message " + std::to_string(i) + "\n";
+}
+
+// What the display should hold: the chunks of the window, in order
+static std::string window_text(ChatHistory& history) {
+    ChatHistory::Stats stats = history.get_stats();
+    std::string text;
+    for (size_t i = stats.window_first; i <= stats.window_last; ++i) {
+        text += history.chunk_text(i);
+    }
+    return text;
+}
+
+static void fill(ChatHistory& history, size_t from, size_t to) {
+    for (size_t i = from; i < to; ++i) {
+        history.append(line(i));
+    }
+}
+
+// While live, the display gets every message and is trimmed to the window
+static void test_live_window() {
+    ChatHistory::Options options;
+    options.chunk_messages = 10;
+    options.resident_chunks = 4;
+    options.window_chunks = 3;
+    ChatHistory history(options);
+    StringDisplay display;
+    history.attach(&display);
+
+    fill(history, 0, 95);
+    ChatHistory::Stats stats = history.get_stats();
+    assert(stats.messages == 95 && stats.lines == 95 && stats.chunks == 10);
+    assert(history.live());
+    assert(stats.window_first == 7 && stats.window_last == 9);
+    assert(display.text() == window_text(history));
+    assert(display.text().rfind(line(70), 0) == 0); // Starts at chunk 7
+    std::cout << "Live window: OK" << std::endl;
+}
+
+// Old chunks are paged out, memory stays bounded, and paging back reads
+// them in again with the same text
+static void test_page_out_and_back() {
+    ChatHistory::Options options;
+    options.chunk_messages = 10;
+    options.resident_chunks = 4;
+    options.window_chunks = 3;
+    ChatHistory history(options);
+    StringDisplay display;
+    history.attach(&display);
+    fill(history, 0, 200);
+
+    ChatHistory::Stats stats = history.get_stats();
+    assert(stats.chunks == 20);
+    assert(stats.paged_out_chunks == 15 && stats.resident_chunks == 5);
+    size_t chunk_bytes = 0;
+    for (size_t i = 190; i < 200; ++i) {
+        chunk_bytes += line(i).size();
+    }
+    assert(stats.resident_bytes <= 5 * chunk_bytes);
+
+    std::string expected_first;
+    for (size_t i = 0; i < 10; ++i) {
+        expected_first += line(i);
+    }
+    assert(history.chunk_text(0) == expected_first);
+
+    // Back to the oldest chunk, a chunk at a time
+    size_t pages = 0;
+    while (history.page_back()) {
+        ++pages;
+        assert(display.text() == window_text(history));
+    }
+    assert(pages == 17 && history.at_oldest() && !history.live());
+    assert(display.text().rfind(expected_first, 0) == 0);
+    assert(history.get_stats().page_ins > 0);
+
+    // New messages are stored but not shown while scrolled back
+    std::string before = display.text();
+    fill(history, 200, 215);
+    assert(display.text() == before);
+    assert(!history.live());
+
+    // Forward to the tail makes the window live again
+    while (history.page_forward()) {
+        assert(display.text() == window_text(history));
+    }
+    assert(history.live());
+    fill(history, 215, 220);
+    assert(display.text() == window_text(history));
+    assert(display.text().find(line(219)) != std::string::npos);
+    std::cout << "Page out and back: OK (" << stats.paged_out_chunks << " chunks paged out)" << std::endl;
+}
+
+// Jumping to the latest replaces the window with the newest chunks
+static void test_jump_to_latest() {
+    ChatHistory::Options options;
+    options.chunk_messages = 8;
+    options.resident_chunks = 2;
+    options.window_chunks = 4;
+    ChatHistory history(options);
+    StringDisplay display;
+    history.attach(&display);
+    fill(history, 0, 100);
+    for (int i = 0; i < 6; ++i) {
+        history.page_back();
+    }
+    fill(history, 100, 130);
+    history.jump_to_latest();
+    assert(history.live());
+    assert(display.text() == window_text(history));
+    assert(history.get_stats().window_last == history.chunk_count() - 1);
+
+    // Attaching late shows the newest window straight away
+    StringDisplay late;
+    history.attach(&late);
+    assert(late.text() == window_text(history));
+    std::cout << "Jump to latest: OK" << std::endl;
+}
+
+// A message with embedded newlines counts all of its lines
+static void test_multiline_messages() {
+    ChatHistory history;
+    history.append("[12:00:00] bot: one\ntwo\nthree\n");
+    history.append("[12:00:01] bot: four\n");
+    assert(history.message_count() == 2 && history.line_count() == 4);
+    std::cout << "Multi-line messages: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running chat history tests..." << std::endl;
+
+    test_live_window();
+    test_page_out_and_back();
+    test_jump_to_latest();
+    test_multiline_messages();
+
+    std::cout << "Chat history tests completed" << std::endl;
+    return 0;
+}
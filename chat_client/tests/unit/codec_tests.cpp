@@ -0,0 +1,247 @@
+#include "../../src/audio/audio_codec.h"
+#include "../../src/audio/codec_pipeline.h"
+#include "../alloc_counter.h"
+#include "../test_signals.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Best SNR in dB over lags up to max_lag, as codecs may delay the signal
+static double snr_db(const std::vector<float>& reference, const std::vector<float>& decoded, size_t max_lag) {
+    double best = -100.0;
+    for (size_t lag = 0; lag <= max_lag; ++lag) {
+        double signal = 0.0;
+        double noise = 0.0;
+        for (size_t i = 0; i + lag < decoded.size() && i < reference.size(); ++i) {
+            double error = decoded[i + lag] - reference[i];
+            signal += double(reference[i]) * reference[i];
+            noise += error * error;
+        }
+        best = std::max(best, 10.0 * std::log10(signal / std::max(noise, 1e-20)));
+    }
+    return best;
+}
+
+struct Encoded {
+    std::vector<std::vector<uint8_t>> packets;
+    size_t bytes = 0;
+};
+
+static Encoded encode_all(AudioEncoder& encoder, const std::vector<float>& pcm) {
+    Encoded encoded;
+    uint8_t packet[AudioEncoder::kMaxPacketBytes];
+    size_t frame = encoder.frame_samples();
+    for (size_t offset = 0; offset + frame <= pcm.size(); offset += frame) {
+        size_t size = encoder.encode(pcm.data() + offset, packet, sizeof(packet));
+        assert(size > 0);
+        encoded.packets.emplace_back(packet, packet + size);
+        encoded.bytes += size;
+    }
+    return encoded;
+}
+
+// Decodes with every lost_every'th packet lost (0 for none), recovering
+// it from the next packet's FEC if use_fec
+static std::vector<float> decode_all(AudioDecoder& decoder, const Encoded& encoded, size_t lost_every,
+                                     bool use_fec) {
+    size_t frame = decoder.frame_samples();
+    std::vector<float> out(encoded.packets.size() * frame);
+    for (size_t i = 0; i < encoded.packets.size(); ++i) {
+        float* pcm = out.data() + i * frame;
+        const std::vector<uint8_t>& packet = encoded.packets[i];
+        bool lost = lost_every && i % lost_every == lost_every - 1;
+        if (lost) {
+            if (use_fec && i + 1 < encoded.packets.size()) {
+                const std::vector<uint8_t>& next = encoded.packets[i + 1];
+                assert(decoder.decode_fec(next.data(), next.size(), pcm) == frame);
+            } else {
+                assert(decoder.decode(nullptr, 0, pcm) == frame);
+            }
+        } else {
+            assert(decoder.decode(packet.data(), packet.size(), pcm) == frame);
+        }
+    }
+    return out;
+}
+
+static void test_presets() {
+    CodecSettings settings;
+    assert(CodecSettings::preset("low", settings));
+    assert(settings.bitrate == 64000 && settings.sample_rate == 16000 && settings.dtx && settings.fec);
+    assert(CodecSettings::preset("high", settings));
+    assert(settings.bitrate == 128000 && settings.sample_rate == 48000);
+    assert(!CodecSettings::preset("ultra", settings));
+    assert(settings.bitrate == 128000);
+    std::cout << "Presets: OK" << std::endl;
+}
+
+// Speech through each preset comes back clean and within its bitrate
+static void test_round_trip() {
+    for (const char* name : { "low", "medium", "high" }) {
+        CodecSettings settings;
+        assert(CodecSettings::preset(name, settings));
+        std::unique_ptr<AudioEncoder> encoder = make_audio_encoder(settings);
+        std::unique_ptr<AudioDecoder> decoder = make_audio_decoder(settings);
+        assert(encoder && decoder);
+        assert(encoder->sample_rate() == decoder->sample_rate());
+        assert(encoder->frame_samples() == encoder->sample_rate() / 50);
+
+        std::vector<float> input = speech(encoder->sample_rate(), 2.0);
+        Encoded encoded = encode_all(*encoder, input);
+        std::vector<float> output = decode_all(*decoder, encoded, 0, false);
+        double snr = snr_db(input, output, encoder->sample_rate() / 100);
+        double kbps = encoded.bytes * 8.0 / 2.0 / 1000.0;
+        std::cout << "  " << name << ": " << encoder->name() << " at " << encoder->sample_rate() << " Hz, "
+                  << kbps << " kbit/s, SNR " << snr << " dB" << std::endl;
+        assert(snr > 15.0);
+        assert(kbps * 1000.0 <= settings.bitrate * 1.1);
+    }
+    std::cout << "Round trip: OK" << std::endl;
+}
+
+// A packet lost now and then is rebuilt from the next packet's FEC better
+// than it is concealed without
+static void test_loss() {
+    CodecSettings settings;
+    assert(CodecSettings::preset("low", settings));
+    settings.expected_loss_percent = 15;
+    std::unique_ptr<AudioEncoder> encoder = make_audio_encoder(settings);
+    std::vector<float> input = speech(encoder->sample_rate(), 2.0);
+    Encoded encoded = encode_all(*encoder, input);
+    size_t max_lag = encoder->sample_rate() / 100;
+
+    std::unique_ptr<AudioDecoder> concealing = make_audio_decoder(settings);
+    double concealed = snr_db(input, decode_all(*concealing, encoded, 7, false), max_lag);
+    std::unique_ptr<AudioDecoder> correcting = make_audio_decoder(settings);
+    double corrected = snr_db(input, decode_all(*correcting, encoded, 7, true), max_lag);
+    std::cout << "  1 in 7 lost: concealed " << concealed << " dB, with FEC " << corrected << " dB" << std::endl;
+#ifdef HAVE_OPUS
+    // Opus spends only part of its bitrate on FEC, and conceals well
+    assert(corrected >= concealed);
+#else
+    assert(corrected > concealed + 3.0);
+#endif
+    std::cout << "Loss: OK" << std::endl;
+}
+
+// Blocks published from another thread come out as 20 ms frames in
+// order; silence becomes comfort noise frames and the next speech starts
+// a segment
+static void test_pipeline() {
+    CodecSettings settings;
+    assert(CodecSettings::preset("low", settings));
+    std::mutex mutex;
+    std::vector<EncodedFrame> frames;
+    size_t batches = 0;
+    AudioEncodePipeline pipeline(settings, [&](const EncodedFrame* batch, size_t count) {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++batches;
+        for (size_t i = 0; i < count; ++i) {
+            frames.push_back(batch[i]);
+            frames.back().data = nullptr;  // Only valid during the call
+        }
+    });
+    assert(pipeline.valid());
+    unsigned rate = pipeline.sample_rate();
+    unsigned frame = pipeline.frame_samples();
+
+    // One second of speech, one of silence, one of speech, in 256-frame
+    // callbacks
+    std::vector<float> voice = speech(rate, 1.0);
+    std::vector<float> signal = voice;
+    signal.resize(2 * voice.size(), 0.0f);
+    signal.insert(signal.end(), voice.begin(), voice.end());
+    pipeline.start();
+    for (size_t offset = 0; offset < signal.size(); offset += 256) {
+        unsigned count = static_cast<unsigned>(std::min<size_t>(256, signal.size() - offset));
+        while (!pipeline.consumer()->publish(signal.data() + offset, count, rate, 0.0f, 0.0f)) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    while (pipeline.consumer()->delivered() < pipeline.consumer()->published()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    pipeline.stop();
+
+    AudioEncodePipeline::Stats stats = pipeline.get_stats();
+    size_t total_frames = signal.size() / frame;
+    assert(stats.frames + stats.skipped_frames == total_frames);
+    assert(stats.skipped_frames == rate / frame);  // The silent second
+    // One as silence starts, then one every kComfortNoiseFrames
+    assert(stats.dtx_frames == 1 + (rate / frame - 1) / AudioEncodePipeline::kComfortNoiseFrames);
+    assert(frames.size() == stats.frames + stats.dtx_frames);
+    assert(batches < frames.size());
+
+    size_t segments = 0;
+    for (size_t i = 0; i < frames.size(); ++i) {
+        assert(frames[i].sequence == i);
+        if (i > 0) {
+            assert(frames[i].timestamp > frames[i - 1].timestamp || frames[i - 1].dtx);
+            assert(frames[i].timestamp % frame == 0);
+        }
+        if (frames[i].segment_start) {
+            ++segments;
+            assert(i == 0 || frames[i - 1].dtx);
+        }
+    }
+    assert(segments == 2);
+    std::cout << "Pipeline: OK (" << stats.frames << " frames, " << stats.dtx_frames << " comfort noise, "
+              << batches << " batches)" << std::endl;
+}
+
+// Once running, framing and encoding allocate nothing
+static void test_steady_state_allocations() {
+    for (const char* name : { "low", "high" }) {
+        CodecSettings settings;
+        assert(CodecSettings::preset(name, settings));
+        size_t sent = 0;
+        AudioEncodePipeline pipeline(settings, [&sent](const EncodedFrame*, size_t count) { sent += count; });
+        std::vector<float> voice = speech(pipeline.sample_rate(), 1.0);
+        AudioBlock block;
+        size_t offset = 0;
+        auto next_block = [&] {
+            block.frames = 441;  // Not a divisor of any frame size
+            block.sample_rate = pipeline.sample_rate();
+            for (unsigned i = 0; i < block.frames; ++i) {
+                block.samples[i] = voice[(offset + i) % voice.size()];
+            }
+            offset += block.frames;
+        };
+        for (int i = 0; i < 50; ++i) {
+            next_block();
+            pipeline.process(block);
+        }
+        uint64_t allocations = 0;
+        {
+            CountAllocations counting(allocations);
+            for (int i = 0; i < 2000; ++i) {
+                next_block();
+                pipeline.process(block);
+            }
+        }
+        assert(sent > 0);
+        assert(allocations == 0);
+    }
+    std::cout << "Steady state allocations: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running codec tests..." << std::endl;
+
+    test_presets();
+    test_round_trip();
+    test_loss();
+    test_pipeline();
+    test_steady_state_allocations();
+
+    std::cout << "Codec tests completed" << std::endl;
+    return 0;
+}
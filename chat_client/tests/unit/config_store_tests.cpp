@@ -0,0 +1,376 @@
+#include "../../src/core/config_store.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace {
+
+// A scratch directory with a settings file and a device streams file
+struct ConfigFiles {
+    std::string dir;
+    std::string settings;
+    std::string streams;
+
+    ConfigFiles() {
+        char path[] = "/tmp/config_store_test_XXXXXX";
+        assert(mkdtemp(path));
+        dir = path;
+        settings = dir + "/default.json";
+        streams = dir + "/device_streams.yaml";
+    }
+    ~ConfigFiles() {
+        std::remove(settings.c_str());
+        std::remove(streams.c_str());
+        std::remove((dir + "/saved.tmp").c_str());
+        rmdir(dir.c_str());
+    }
+
+    void write_settings(const std::string& text) const { write(settings, text); }
+    void write_streams(const std::string& text) const { write(streams, text); }
+    // As editors save: a new file renamed over the old
+    void replace_streams(const std::string& text) const {
+        std::string temp = dir + "/saved.tmp";
+        write(temp, text);
+        assert(std::rename(temp.c_str(), streams.c_str()) == 0);
+    }
+
+    static void write(const std::string& path, const std::string& text) {
+        std::ofstream file(path, std::ios::trunc);
+        file << text;
+    }
+};
+
+std::string settings_text(bool noise_suppression, int inbox_capacity) {
+    return std::string("{\"audio\": {\"enable_noise_suppression\": ") + (noise_suppression ? "true" : "false")
+        + ", \"gating_hangover_ms\": 300},\n \"chat\": {\"inbox_capacity\": " + std::to_string(inbox_capacity)
+        + "}}\n";
+}
+
+std::string streams_text(unsigned playlist_size, unsigned port) {
+    return "protocols:\n"
+           "  hls:\n"
+           "    playlist_size: " + std::to_string(playlist_size) + "\n"
+           "audio_devices:\n"
+           "  - id: mic\n"
+           "    protocols:\n"
+           "      - type: rtsp\n"
+           "        port: " + std::to_string(port) + "\n"
+           "        enabled: true\n";
+}
+
+// Waits for the watcher to publish version, up to two seconds
+bool wait_for_version(const ConfigStore& store, uint64_t version) {
+    for (int i = 0; i < 200; ++i) {
+        if (store.get_stats().version >= version) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+} // namespace
+
+void test_load() {
+    std::cout << "Testing load..." << std::endl;
+    ConfigFiles files;
+    files.write_settings(settings_text(true, 100));
+    files.write_streams(streams_text(5, 8554));
+
+    ConfigStore store;
+    assert(store.load(files.settings, files.streams));
+    auto reader = store.make_reader();
+    assert(reader);
+    {
+        ConfigStore::Snapshot config = reader->read();
+        assert(config->version == 1);
+        assert(config->streams_loaded);
+        assert(config->settings.get_bool("audio.enable_noise_suppression"));
+        assert(config->settings.get_int("chat.inbox_capacity") == 100);
+        assert(config->streams.protocols.hls.playlist_size == 5);
+        assert(config->streams.audio_devices.size() == 1);
+    }
+
+    // A missing streams file leaves no devices, and the settings stand
+    ConfigFiles bare;
+    bare.write_settings(settings_text(false, 1));
+    ConfigStore partial;
+    assert(partial.load(bare.settings, bare.streams));
+    auto partial_reader = partial.make_reader();
+    assert(!partial_reader->read()->streams_loaded);
+    assert(partial_reader->read()->streams.audio_devices.empty());
+
+    // Missing settings do not load
+    ConfigStore empty;
+    assert(!empty.load(files.dir + "/missing.json", files.streams));
+
+    // Readers are limited, and their slots reused
+    std::vector<std::unique_ptr<ConfigStore::Reader>> readers;
+    while (auto extra = store.make_reader()) {
+        readers.push_back(std::move(extra));
+    }
+    assert(readers.size() == ConfigStore::kMaxReaders - 1);
+    readers.pop_back();
+    assert(store.make_reader());
+    std::cout << "Load: OK" << std::endl;
+}
+
+void test_changed_keys() {
+    std::cout << "Testing changed keys..." << std::endl;
+    ConfigSnapshot before;
+    ConfigSnapshot after;
+    before.settings.set_int("chat.inbox_capacity", 100);
+    before.settings.set_bool("audio.enable_noise_suppression", true);
+    before.settings.set_string("voice.quality", "low");
+    after.settings.set_int("chat.inbox_capacity", 200);
+    after.settings.set_bool("audio.enable_noise_suppression", true);
+    after.settings.set_bool("voice.enabled", true);
+    std::string error;
+    assert(DeviceStreamsConfig::parse(streams_text(5, 8554), before.streams, error));
+    assert(DeviceStreamsConfig::parse(streams_text(6, 8555), after.streams, error));
+
+    std::vector<std::string> changed = ConfigStore::changed_keys(before, after);
+    std::vector<std::string> expected = {
+        "chat.inbox_capacity",
+        "voice.enabled",
+        "voice.quality",
+        "device_streams.audio_devices.0.protocols.0.port",
+        "device_streams.protocols.hls.playlist_size",
+    };
+    assert(changed == expected);
+    assert(ConfigStore::changed_keys(after, after).empty());
+
+    // A device added or removed changes the list as a whole
+    after.streams.audio_devices.push_back(after.streams.audio_devices[0]);
+    after.settings = before.settings;
+    before.streams.protocols.hls.playlist_size = 6;
+    changed = ConfigStore::changed_keys(before, after);
+    assert(changed == std::vector<std::string>{ "device_streams.audio_devices" });
+    std::cout << "Changed keys: OK" << std::endl;
+}
+
+void test_reload() {
+    std::cout << "Testing reload..." << std::endl;
+    ConfigFiles files;
+    files.write_settings(settings_text(true, 100));
+    files.write_streams(streams_text(5, 8554));
+    ConfigStore store;
+    assert(store.load(files.settings, files.streams));
+
+    std::vector<std::string> audio_keys;
+    std::vector<std::string> device_keys;
+    std::vector<std::string> all_keys;
+    uint64_t audio_version = 0;
+    store.subscribe({ "audio" }, [&](const ConfigSnapshot& config, const std::vector<std::string>& changed) {
+        audio_keys = changed;
+        audio_version = config.version;
+    });
+    // Under the list's entries: told when the entry changes, or the list
+    store.subscribe({ "device_streams.audio_devices.0.protocols" },
+                    [&](const ConfigSnapshot&, const std::vector<std::string>& changed) { device_keys = changed; });
+    uint64_t all = store.subscribe({ "" }, [&](const ConfigSnapshot&, const std::vector<std::string>& changed) {
+        all_keys = changed;
+    });
+
+    // Only the listeners whose keys changed hear, and only of those keys
+    files.write_settings(settings_text(false, 100));
+    assert(store.reload());
+    assert(audio_keys == std::vector<std::string>{ "audio.enable_noise_suppression" });
+    assert(audio_version == 2);
+    assert(device_keys.empty());
+    assert(all_keys == audio_keys);
+
+    audio_keys.clear();
+    files.write_streams(streams_text(5, 9000));
+    assert(store.reload());
+    assert(audio_keys.empty());
+    assert(device_keys == std::vector<std::string>{ "device_streams.audio_devices.0.protocols.0.port" });
+
+    // Nothing changed: nothing published, no one told
+    device_keys.clear();
+    all_keys.clear();
+    files.write_streams(streams_text(5, 9000) + "# Saved again\n");
+    assert(store.reload());
+    assert(all_keys.empty() && device_keys.empty());
+    assert(store.get_stats().version == 3);
+    assert(store.get_stats().unchanged == 1);
+
+    // A broken file is not taken: the last good snapshot stays
+    auto reader = store.make_reader();
+    files.write_streams("protocols:\n  hls:\n    playlist_size: many\n");
+    assert(!store.reload());
+    files.write_streams(streams_text(5, 9000));
+    files.write_settings("{\"audio\": ");
+    assert(!store.reload());
+    assert(reader->read()->version == 3);
+    assert(reader->read()->settings.get_int("chat.inbox_capacity") == 100);
+    assert(reader->read()->streams.audio_devices[0].protocols[0].port == 9000);
+    assert(store.get_stats().failed == 2);
+
+    // Unsubscribed listeners are not called again
+    store.unsubscribe(all);
+    files.write_settings(settings_text(false, 200));
+    assert(store.reload());
+    assert(all_keys.empty());
+    assert(store.get_stats().reloads == 3);
+    std::cout << "Reload: OK" << std::endl;
+}
+
+void test_reclamation() {
+    std::cout << "Testing reclamation..." << std::endl;
+    ConfigFiles files;
+    files.write_settings(settings_text(true, 1));
+    files.write_streams(streams_text(5, 8554));
+    ConfigStore store;
+    assert(store.load(files.settings, files.streams));
+    auto reader = store.make_reader();
+
+    {
+        ConfigStore::Snapshot held = reader->read();
+        files.write_settings(settings_text(true, 2));
+        assert(store.reload());
+        files.write_settings(settings_text(true, 3));
+        assert(store.reload());
+        // Both old snapshots may still be in use, the first by this reader
+        assert(store.get_stats().held == 2);
+        assert(held->version == 1);
+        assert(held->settings.get_int("chat.inbox_capacity") == 1);
+        {
+            // Nested: the newest, kept with the outer one
+            ConfigStore::Snapshot inner = reader->read();
+            assert(inner->version == 3);
+        }
+        assert(held->settings.get_int("chat.inbox_capacity") == 1);
+        ConfigStore::Snapshot moved = std::move(held);
+        assert(moved->version == 1);
+    }
+
+    // Freed at the next publication once no reader holds them
+    files.write_settings(settings_text(true, 4));
+    assert(store.reload());
+    ConfigStore::Stats stats = store.get_stats();
+    assert(stats.held == 0);
+    assert(stats.freed == 3);
+    std::cout << "Reclamation: OK" << std::endl;
+}
+
+void test_watch() {
+    std::cout << "Testing file watching..." << std::endl;
+    ConfigFiles files;
+    files.write_settings(settings_text(true, 1));
+    files.write_streams(streams_text(5, 8554));
+    ConfigStore store;
+    assert(store.load(files.settings, files.streams));
+    std::atomic<int> notified{0};
+    store.subscribe({ "" }, [&](const ConfigSnapshot&, const std::vector<std::string>&) { ++notified; });
+    assert(store.watch());
+    auto reader = store.make_reader();
+
+    // Written in place
+    files.write_settings(settings_text(true, 2));
+    assert(wait_for_version(store, 2));
+    assert(reader->read()->settings.get_int("chat.inbox_capacity") == 2);
+
+    // Renamed over
+    files.replace_streams(streams_text(7, 8554));
+    assert(wait_for_version(store, 3));
+    assert(reader->read()->streams.protocols.hls.playlist_size == 7);
+
+    // Other files in the directory are not looked at
+    ConfigFiles::write(files.dir + "/saved.tmp", "unrelated");
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * ConfigStore::kSettleMs));
+    ConfigStore::Stats stats = store.get_stats();
+    assert(stats.version == 3 && stats.unchanged == 0 && stats.failed == 0);
+
+    // A broken save is skipped; the fixed one that follows is taken
+    files.write_streams("protocols: [\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * ConfigStore::kSettleMs));
+    assert(store.get_stats().version == 3);
+    files.write_streams(streams_text(8, 8554));
+    assert(wait_for_version(store, 4));
+    assert(reader->read()->streams.protocols.hls.playlist_size == 8);
+    assert(notified == 3);
+
+    store.stop_watching();
+    files.write_settings(settings_text(true, 5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(3 * ConfigStore::kSettleMs));
+    assert(store.get_stats().version == 4);
+    std::cout << "File watching: OK" << std::endl;
+}
+
+// Readers on several threads while a writer reloads as fast as it can:
+// every snapshot read is whole, its two files from the same reload, and
+// versions never go back
+void test_concurrent_readers() {
+    std::cout << "Testing concurrent readers..." << std::endl;
+    constexpr int kReloads = 300;
+    constexpr int kReaders = 4;
+    ConfigFiles files;
+    files.write_settings(settings_text(true, 0));
+    files.write_streams(streams_text(0, 8554));
+    ConfigStore store;
+    assert(store.load(files.settings, files.streams));
+
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> reads{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < kReaders; ++i) {
+        readers.emplace_back([&store, &done, &reads, i] {
+            auto reader = store.make_reader();
+            assert(reader);
+            uint64_t last_version = 0;
+            while (!done.load(std::memory_order_relaxed)) {
+                ConfigStore::Snapshot config = reader->read();
+                assert(config->version >= last_version);
+                last_version = config->version;
+                unsigned settings_n = static_cast<unsigned>(config->settings.get_int("chat.inbox_capacity"));
+                assert(settings_n == config->streams.protocols.hls.playlist_size);
+                if (i == 0) {
+                    // Holds its snapshot across reloads
+                    std::this_thread::sleep_for(std::chrono::microseconds(200));
+                    assert(config->settings.get_int("chat.inbox_capacity") == static_cast<int>(settings_n));
+                }
+                reads.fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+
+    // Both files are rewritten before each reload, so each snapshot pairs them
+    for (int n = 1; n <= kReloads; ++n) {
+        files.write_settings(settings_text(true, n));
+        files.write_streams(streams_text(static_cast<unsigned>(n), 8554));
+        assert(store.reload());
+    }
+    done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    ConfigStore::Stats stats = store.get_stats();
+    assert(stats.version == kReloads + 1);
+    assert(stats.freed + stats.held == kReloads);
+    std::cout << "  " << reads.load() << " reads, " << stats.freed << " snapshots freed while reading" << std::endl;
+    std::cout << "Concurrent readers: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running config store tests..." << std::endl;
+
+    test_load();
+    test_changed_keys();
+    test_reload();
+    test_reclamation();
+    test_watch();
+    test_concurrent_readers();
+
+    std::cout << "Config store tests completed" << std::endl;
+    return 0;
+}
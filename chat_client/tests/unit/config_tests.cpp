@@ -0,0 +1,299 @@
+#include "../../src/core/device_streams.h"
+#include "../../src/core/config_schema.h"
+#include "../../src/core/config_manager.h"
+#include <iostream>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Run from the project root, as ctest and make test do
+const char* kShippedConfig = "config/device_streams.yaml";
+const char* kShippedSettings = "data/config/default.json";
+
+bool parse(const std::string& text, DeviceStreamsConfig& config, std::string& error,
+           std::vector<std::string>* unknown_keys = nullptr) {
+    return DeviceStreamsConfig::parse(text, config, error, unknown_keys);
+}
+
+// The error for text, which must not parse
+std::string error_for(const std::string& text) {
+    DeviceStreamsConfig config;
+    std::string error;
+    assert(!parse(text, config, error));
+    return error;
+}
+
+} // namespace
+
+void test_shipped_file() {
+    std::cout << "Testing the shipped file..." << std::endl;
+    std::ifstream file(kShippedConfig);
+    assert(file.is_open());
+    std::ostringstream text;
+    text << file.rdbuf();
+
+    DeviceStreamsConfig config;
+    std::string error;
+    std::vector<std::string> unknown_keys;
+    assert(parse(text.str(), config, error, &unknown_keys));
+    assert(unknown_keys.empty());
+
+    assert(config.server.host == "0.0.0.0");
+    assert(config.server.web_admin_port == 8080);
+    assert(config.protocols.rtsp.enabled);
+    assert(config.protocols.rtsp.default_port_range.first == 8554);
+    assert(config.protocols.rtsp.default_port_range.last == 8654);
+    assert((config.protocols.rtsp.transport == std::vector<std::string>{ "tcp", "udp" }));
+    assert(config.protocols.webrtc.ice_servers.size() == 1);
+    assert(config.protocols.webrtc.ice_servers[0].urls[0] == "stun:stun.l.google.com:19302");
+    assert(config.protocols.hls.segment_duration == 4);
+    assert(config.protocols.hls.playlist_size == 5);
+    assert(config.protocols.hls.http_port == 8080);
+    assert(!config.protocols.podcast.enabled);
+
+    assert(config.audio_devices.size() == 2);
+    const DeviceConfig& mic = config.audio_devices[0];
+    assert(mic.id == "default_mic" && mic.type == DeviceDirection::INPUT);
+    assert(mic.protocols.size() == 3);
+    const DeviceProtocolConfig* rtsp = mic.enabled_protocol(StreamProtocol::RTSP);
+    assert(rtsp && rtsp->port == 8554 && rtsp->path == "/mic/default");
+    assert(rtsp->codec == "opus" && rtsp->bitrate == 128000);
+    assert(mic.enabled_protocol(StreamProtocol::HLS) == nullptr);
+    assert(config.audio_devices[1].type == DeviceDirection::OUTPUT);
+    assert(config.audio_devices[1].enabled_protocol(StreamProtocol::RTSP)->port == 8555);
+
+    assert(config.video_devices.size() == 1);
+    assert(config.video_devices[0].protocols[0].framerate == 30);
+    assert(config.video_devices[0].protocols[2].path == "/hls/camera/index.m3u8");
+
+    assert(config.quality_presets.audio.low.sample_rate == 16000);
+    assert(config.quality_presets.audio.high.bitrate == 128000 && !config.quality_presets.audio.high.fec);
+    assert(config.quality_presets.video.high.resolution == "1080p");
+    assert((config.integrations.recording.formats == std::vector<std::string>{ "mp4", "mp3", "ogg" }));
+    assert(config.integrations.streaming_platforms.size() == 2);
+    assert(config.integrations.streaming_platforms[0].stream_key == "${YOUTUBE_STREAM_KEY}");
+    std::cout << "Shipped file: OK" << std::endl;
+}
+
+void test_defaults() {
+    std::cout << "Testing defaults..." << std::endl;
+    DeviceStreamsConfig config;
+    std::string error;
+    assert(parse("protocols:\n"
+                 "  hls:\n"
+                 "    playlist_size: 8\n"
+                 "  rtsp:\n"
+                 "server:\n",
+                 config, error));
+    assert(config.protocols.hls.playlist_size == 8);
+    assert(config.protocols.hls.segment_duration == 4);
+    assert(config.protocols.rtsp.default_port_range.first == 8554);
+    assert(config.server.host == "0.0.0.0");
+    assert(config.audio_devices.empty());
+    assert(config.quality_presets.audio.medium.sample_rate == 44100);
+
+    assert(parse("", config, error));
+    assert(parse("# Nothing but comments\n\n   \n", config, error));
+    std::cout << "Defaults: OK" << std::endl;
+}
+
+void test_syntax() {
+    std::cout << "Testing syntax..." << std::endl;
+    DeviceStreamsConfig config;
+    std::string error;
+    assert(parse("---\r\n"
+                 "server:   # trailing comment\r\n"
+                 "  host: \"10.0.0.1\"  # quoted\r\n"
+                 "  web_admin_port: 9090\r\n"
+                 "protocols:\n"
+                 "  rtsp:\n"
+                 "    transport: [ 'udp' ,\"tcp\" ]\n"
+                 "    path_format: \"/s/{device_id} #1\"\n"
+                 "    latency: it's low\n"
+                 "    config_file: 'a ''quoted'' name'\n"
+                 "    server_binary: \"tab\\there\\\\\"\n"
+                 "  webrtc:\n"
+                 "    ice_servers:\n"
+                 "    - urls:\n"
+                 "      - \"stun:a:1\"\n"
+                 "      - stun:b:2\n"
+                 "    -\n"
+                 "      urls: []\n"
+                 "    signaling_port: ~\n"
+                 "audio_devices:\n"
+                 "- id: mic\n"
+                 "  protocols:\n"
+                 "  - type: rtsp\n"
+                 "    port: 7000\n"
+                 "  - type: hls\n"
+                 "    enabled: yes\n"
+                 "- id: speaker\n"
+                 "  type: output\n"
+                 "...\n"
+                 "ignored: [\n",
+                 config, error));
+    assert(config.server.host == "10.0.0.1" && config.server.web_admin_port == 9090);
+    assert((config.protocols.rtsp.transport == std::vector<std::string>{ "udp", "tcp" }));
+    assert(config.protocols.rtsp.path_format == "/s/{device_id} #1");
+    assert(config.protocols.rtsp.latency == "it's low");
+    assert(config.protocols.rtsp.config_file == "a 'quoted' name");
+    assert(config.protocols.rtsp.server_binary == "tab\there\\");
+    assert(config.protocols.webrtc.ice_servers.size() == 2);
+    assert((config.protocols.webrtc.ice_servers[0].urls == std::vector<std::string>{ "stun:a:1", "stun:b:2" }));
+    assert(config.protocols.webrtc.ice_servers[1].urls.empty());
+    assert(config.protocols.webrtc.signaling_port == 8833);
+    assert(config.audio_devices.size() == 2);
+    assert(config.audio_devices[0].protocols.size() == 2);
+    assert(config.audio_devices[0].protocols[0].port == 7000);
+    assert(config.audio_devices[0].enabled_protocol(StreamProtocol::HLS));
+    assert(config.audio_devices[1].id == "speaker" && config.audio_devices[1].type == DeviceDirection::OUTPUT);
+
+    // A sequence given again replaces the defaults and what came before
+    assert(parse("protocols:\n  rtsp:\n    transport: [udp]\n", config, error));
+    assert((config.protocols.rtsp.transport == std::vector<std::string>{ "udp" }));
+    std::cout << "Syntax: OK" << std::endl;
+}
+
+void test_errors() {
+    std::cout << "Testing errors..." << std::endl;
+    assert(error_for("server:\n  web_admin_port: http\n") == "line 2: expected a port number, got http");
+    assert(error_for("server:\n  web_admin_port: 70000\n").find("line 2: expected a port number") == 0);
+    assert(error_for("protocols:\n  hls:\n    playlist_size: -1\n").find("line 3: expected an unsigned") == 0);
+    assert(error_for("server:\n  discovery_enabled: maybe\n").find("line 2: expected a boolean") == 0);
+    assert(error_for("audio_devices:\n  - type: sideways\n").find("line 2: expected input or output") == 0);
+    assert(error_for("protocols:\n  rtsp:\n    default_port_range: [1, 2, 3]\n")
+           == "line 3: more items than the sequence holds");
+    assert(error_for("protocols:\n  rtsp:\n    default_port_range: 8554\n").find("line 3: expected a port range") == 0);
+    assert(error_for("protocols:\n  rtsp:\n    transport: [tcp, [udp]]\n").find("line 3: nested") == 0);
+    assert(error_for("server:\n  host: \"open\n") == "line 2: unterminated quoted scalar");
+    assert(error_for("server:\n  host: \"bad \\q\"\n").find("line 2: unknown escape") == 0);
+    assert(error_for("server:\n\thost: a\n") == "line 2: tabs are not allowed in indentation");
+    assert(error_for("server:\n    host: a\n  web_admin_port: 1\n").find("line 3: indentation") == 0);
+    assert(error_for("server:\n  - host\n") == "line 2: expected a key, not a sequence item");
+    assert(error_for("audio_devices:\n  id: mic\n") == "line 2: expected a \"- \" sequence item");
+    assert(error_for("server:\n  host:\n    deeper\n") == "line 3: expected a string on its key's line");
+    assert(error_for("audio_devices:\n- id: mic\n  protocols:\n  - {type: rtsp}\n")
+           == "line 4: flow mappings are not supported");
+    assert(error_for("server: &anchor\n").find("line 1: anchors") == 0);
+    assert(error_for("just text\n") == "line 1: expected \"key: value\"");
+    std::cout << "Errors: OK" << std::endl;
+}
+
+void test_unknown_keys() {
+    std::cout << "Testing unknown keys..." << std::endl;
+    DeviceStreamsConfig config;
+    std::string error;
+    std::vector<std::string> unknown_keys;
+    assert(parse("server:\n"
+                 "  host: a\n"
+                 "  future_option: 1\n"
+                 "  future_block:\n"
+                 "    nested: [1, 2]\n"
+                 "    list:\n"
+                 "    - x: {whatever}\n"
+                 "  web_admin_port: 81\n"
+                 "audio_devices:\n"
+                 "- id: mic\n"
+                 "  extra:\n"
+                 "  - 1\n"
+                 "  name: Mic\n"
+                 "colour: blue\n",
+                 config, error, &unknown_keys));
+    assert((unknown_keys == std::vector<std::string>{ "line 3: future_option", "line 4: future_block",
+                                                       "line 11: extra", "line 14: colour" }));
+    assert(config.server.host == "a" && config.server.web_admin_port == 81);
+    assert(config.audio_devices.size() == 1 && config.audio_devices[0].name == "Mic");
+    std::cout << "Unknown keys: OK" << std::endl;
+}
+
+void test_stream_paths() {
+    std::cout << "Testing stream paths..." << std::endl;
+    DeviceStreamsConfig config;
+    std::string error;
+    assert(parse("protocols:\n"
+                 "  hls:\n"
+                 "    default_port_range: [9100, 9200]\n"
+                 "audio_devices:\n"
+                 "  - id: desk\n"
+                 "    protocols:\n"
+                 "      - type: hls\n"
+                 "        enabled: true\n"
+                 "      - type: rtsp\n"
+                 "        path: /desk\n"
+                 "        port: 8600\n"
+                 "        enabled: false\n",
+                 config, error));
+    const DeviceConfig& desk = config.audio_devices[0];
+    const DeviceProtocolConfig& hls = desk.protocols[0];
+    assert(config.stream_path(desk, hls) == "/hls/desk/index.m3u8");
+    assert(config.stream_port(hls) == 9100);
+    assert(config.stream_path(desk, desk.protocols[1]) == "/desk");
+    assert(config.stream_port(desk.protocols[1]) == 8600);
+    assert(desk.enabled_protocol(StreamProtocol::RTSP) == nullptr);
+    assert(desk.enabled_protocol(StreamProtocol::WEBRTC) == nullptr);
+
+    assert(config.quality_presets.audio.find("low") == &config.quality_presets.audio.low);
+    assert(config.quality_presets.audio.find("ultra") == nullptr);
+    std::cout << "Stream paths: OK" << std::endl;
+}
+
+void test_json_settings() {
+    std::cout << "Testing JSON settings..." << std::endl;
+    ConfigManager shipped;
+    assert(shipped.load_config(kShippedSettings));
+    assert(shipped.get_bool("audio.enable_noise_suppression"));
+    assert(shipped.get_int("audio.sample_rate") == 44100);
+    assert(shipped.get_float("audio.default_volume") > 0.79f);
+    assert(shipped.get_string("chat.default_channel") == "lobby");
+    assert(shipped.get_int("chat.inbox_capacity") == 8192);
+
+    const char* path = "config_test_settings.json";
+    {
+        std::ofstream file(path);
+        file << "{\n  \"a\": {\"b\": {\"c\": -3}, \"list\": [1, \"x]\", [2]], \"none\": null},\n"
+                "  \"text\": \"say \\\"hi\\\"\\u00e9\", \"empty\": {}\n}\n";
+    }
+    ConfigManager config;
+    assert(config.load_config(path));
+    assert(config.get_int("a.b.c") == -3);
+    assert(config.get_string("a.list") == "[1, \"x]\", [2]]");
+    assert(config.get_string("a.none", "default") == "default");
+    assert(config.get_string("text") == "say \"hi\"\xC3\xA9");
+
+    // key=value files still load
+    {
+        std::ofstream file(path);
+        file << "# Comment\nvoice.enabled=true\nvoice.local_port=6000\n";
+    }
+    assert(config.load_config(path));
+    assert(config.get_bool("voice.enabled") && config.get_int("voice.local_port") == 6000);
+    assert(config.get_int("a.b.c", 7) == 7);
+
+    {
+        std::ofstream file(path);
+        file << "{\"audio\": {\"sample_rate\": 44100,}";
+    }
+    assert(!config.load_config(path));
+    std::remove(path);
+    std::cout << "JSON settings: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running config tests..." << std::endl;
+
+    test_shipped_file();
+    test_defaults();
+    test_syntax();
+    test_errors();
+    test_unknown_keys();
+    test_stream_paths();
+    test_json_settings();
+
+    std::cout << "Config tests completed" << std::endl;
+    return 0;
+}
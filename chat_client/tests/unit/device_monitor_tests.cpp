@@ -0,0 +1,204 @@
+#include "../../src/audio/device_monitor.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// Collects what the monitor reports, from its thread
+class Events {
+public:
+    DeviceMonitor::Notify notify() {
+        return [this](const DeviceMonitor::Event& event) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.push_back(event);
+            arrived_.notify_all();
+        };
+    }
+
+    bool wait_for(size_t count, int timeout_ms = 2000) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return arrived_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                                 [this, count] { return events_.size() >= count; });
+    }
+
+    std::vector<DeviceMonitor::Event> take() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::move(events_);
+    }
+
+private:
+    std::mutex mutex_;
+    std::condition_variable arrived_;
+    std::vector<DeviceMonitor::Event> events_;
+};
+
+static bool wait_until(const std::function<bool()>& done, int timeout_ms = 2000) {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+void test_cached_devices() {
+    std::cout << "Testing the cached device table..." << std::endl;
+    AudioEngine engine;
+    assert(engine.get_devices().empty());
+    assert(engine.refresh_devices(true) == AudioEngine::DeviceScan::UNCHANGED);
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+
+    auto devices = engine.get_devices();
+    assert(devices.size() == 1);
+    assert(engine.get_devices().size() == 1);
+    // The same devices again are no change
+    assert(engine.refresh_devices(false) == AudioEngine::DeviceScan::UNCHANGED);
+    assert(engine.refresh_devices(true) == AudioEngine::DeviceScan::UNCHANGED);
+    assert(engine.get_devices()[0].name == devices[0].name);
+    std::cout << "✓ Cached device table passed" << std::endl;
+}
+
+void test_switches() {
+    std::cout << "Testing device switches..." << std::endl;
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    // Not the null device's native rate: a switch keeps the rate the
+    // consumers were set up for
+    assert(engine.open_device(0, 44100));
+    engine.start_stream();
+
+    Events events;
+    DeviceMonitor::Options options;
+    options.watch_path = "no_such_directory";
+    options.poll_ms = 60000;
+    DeviceMonitor monitor(engine, events.notify(), options);
+    assert(monitor.start());
+
+    // While the stream runs, which carries on on the new device
+    monitor.request_switch(0);
+    assert(events.wait_for(1));
+    auto switched = events.take();
+    assert(switched[0].kind == DeviceMonitor::Event::Kind::SWITCHED);
+    assert(switched[0].requested_device == 0 && switched[0].open_device == 0);
+    assert(switched[0].devices.size() == 1);
+    assert(engine.is_stream_active());
+    assert(engine.get_sample_rate() == 44100 && engine.get_stats().sample_rate == 44100);
+    engine.stop_stream();
+
+    monitor.request_switch(0);
+    assert(events.wait_for(1));
+    assert(events.take()[0].kind == DeviceMonitor::Event::Kind::SWITCHED);
+    assert(engine.get_sample_rate() == 44100);
+    monitor.stop();
+
+    DeviceMonitor::Stats stats = monitor.get_stats();
+    assert(stats.switches == 2 && stats.failed_switches == 0);
+    assert(stats.changes == 0);
+
+    // An engine without a backend has nothing to switch to
+    AudioEngine idle;
+    DeviceMonitor failing(idle, events.notify(), options);
+    assert(failing.start());
+    failing.request_switch(1);
+    assert(events.wait_for(1));
+    auto failed = events.take();
+    assert(failed[0].kind == DeviceMonitor::Event::Kind::SWITCH_FAILED);
+    assert(failed[0].requested_device == 1 && failed[0].open_device == -1);
+    assert(failing.get_stats().failed_switches == 1);
+    std::cout << "✓ Device switches passed" << std::endl;
+}
+
+void test_hotplug_scans() {
+    std::cout << "Testing scans on hotplug..." << std::endl;
+    char directory[] = "/tmp/device_monitor_testXXXXXX";
+    assert(mkdtemp(directory));
+    const std::string node = std::string(directory) + "/pcmC1D0c";
+
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    Events events;
+    DeviceMonitor::Options options;
+    options.watch_path = directory;
+    options.settle_ms = 20;
+    options.poll_ms = 60000;
+    DeviceMonitor monitor(engine, events.notify(), options);
+    assert(monitor.start());
+    assert(monitor.get_stats().scans == 0);
+
+    // A card's nodes arriving together make one scan
+    std::ofstream(node).put('x');
+    std::ofstream(node + "p").put('x');
+    assert(wait_until([&monitor] { return monitor.get_stats().scans == 1; }));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(monitor.get_stats().scans == 1);
+
+    std::remove((node + "p").c_str());
+    assert(wait_until([&monitor] { return monitor.get_stats().scans == 2; }));
+
+    // Asked for
+    monitor.request_scan();
+    assert(wait_until([&monitor] { return monitor.get_stats().scans == 3; }));
+
+    monitor.stop();
+    // Nothing the null device reports changes
+    assert(monitor.get_stats().changes == 0);
+    assert(events.take().empty());
+    std::remove(node.c_str());
+    rmdir(directory);
+    std::cout << "✓ Scans on hotplug passed" << std::endl;
+}
+
+void test_polling() {
+    std::cout << "Testing scans without a directory to watch..." << std::endl;
+    const std::string cards = "device_monitor_test_cards";
+    std::ofstream(cards) << " 0 [PCH            ]: HDA-Intel - HDA Intel PCH\n";
+
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE));
+    Events events;
+    DeviceMonitor::Options options;
+    options.watch_path = "no_such_directory";
+    options.poll_ms = 10;
+    options.cards_path = cards;
+    DeviceMonitor monitor(engine, events.notify(), options);
+    assert(monitor.start());
+
+    // The same cards are not scanned for
+    assert(wait_until([&monitor] { return monitor.get_stats().polls >= 5; }));
+    assert(monitor.get_stats().scans == 0);
+
+    std::ofstream(cards, std::ios::app) << " 1 [Headset        ]: USB-Audio - USB Headset\n";
+    assert(wait_until([&monitor] { return monitor.get_stats().scans == 1; }));
+    uint64_t polls = monitor.get_stats().polls;
+    assert(wait_until([&monitor, polls] { return monitor.get_stats().polls >= polls + 5; }));
+    assert(monitor.get_stats().scans == 1);
+
+    monitor.stop();
+    polls = monitor.get_stats().polls;
+    std::this_thread::sleep_for(std::chrono::milliseconds(40));
+    assert(monitor.get_stats().polls == polls);
+    std::remove(cards.c_str());
+    std::cout << "✓ Scans without a directory passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running device monitor tests..." << std::endl;
+
+    test_cached_devices();
+    test_switches();
+    test_hotplug_scans();
+    test_polling();
+
+    std::cout << "Device monitor tests completed" << std::endl;
+    return 0;
+}
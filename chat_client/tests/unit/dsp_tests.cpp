@@ -0,0 +1,117 @@
+#include "../../src/dsp/dsp_kernels.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+static bool close_enough(float a, float b, float rel_tol) {
+    return std::fabs(a - b) <= rel_tol * std::max(1.0f, std::max(std::fabs(a), std::fabs(b)));
+}
+
+// Compare one implementation against the scalar reference on every length
+// from 0 to a bit over a typical callback, so all tail paths are covered.
+static void check_against_reference(const DspKernels& k, const DspKernels& ref) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+    for (size_t n = 0; n <= 1100; ++n) {
+        // Offset by one float so the vector paths see unaligned buffers
+        std::vector<float> in(n + 1), stereo(2 * n + 1);
+        for (auto& v : in) v = dist(rng);
+        for (auto& v : stereo) v = dist(rng);
+        const float* x = in.data() + 1;
+        const float* st = stereo.data() + 1;
+
+        assert(close_enough(k.sum_squares(x, n), ref.sum_squares(x, n), 1e-5f));
+        assert(close_enough(k.stereo_mid_sum_squares(st, n / 2), ref.stereo_mid_sum_squares(st, n / 2), 1e-5f));
+        assert(close_enough(k.dot(x, st, n), ref.dot(x, st, n), 1e-5f));
+        // A maximum is exact whatever the order
+        assert(k.peak(x, n) == ref.peak(x, n));
+        assert(k.peak(st, 2 * n) == ref.peak(st, 2 * n));
+        float lo = 0.0f, hi = 0.0f, ref_lo = 0.0f, ref_hi = 0.0f;
+        k.min_max(x, n, &lo, &hi);
+        ref.min_max(x, n, &ref_lo, &ref_hi);
+        assert(lo == ref_lo && hi == ref_hi);
+
+        std::vector<float> out(2 * n + 1), expected(2 * n + 1);
+        k.gain(x, out.data(), n, 0.75f);
+        ref.gain(x, expected.data(), n, 0.75f);
+        for (size_t i = 0; i < n; ++i) assert(close_enough(out[i], expected[i], 1e-6f));
+
+        k.mono_to_stereo(x, out.data(), n, 1.25f);
+        ref.mono_to_stereo(x, expected.data(), n, 1.25f);
+        for (size_t i = 0; i < 2 * n; ++i) assert(close_enough(out[i], expected[i], 1e-6f));
+
+        std::vector<float> acc(in.begin(), in.end()), acc_ref(in.begin(), in.end());
+        k.mix(st, acc.data(), n, 0.5f);
+        ref.mix(st, acc_ref.data(), n, 0.5f);
+        for (size_t i = 0; i < n; ++i) assert(close_enough(acc[i], acc_ref[i], 1e-6f));
+
+        k.power_spectrum(x, st, out.data(), n);
+        ref.power_spectrum(x, st, expected.data(), n);
+        for (size_t i = 0; i < n; ++i) assert(close_enough(out[i], expected[i], 1e-6f));
+
+        // Butterflies over the four quarters of stereo, in, with twiddles
+        std::vector<float> bf(stereo.begin(), stereo.end()), bf_ref(stereo.begin(), stereo.end());
+        const size_t q = n / 2;
+        k.butterflies(&bf[1], &bf[1 + q], &bf[1 + 2 * q], &bf[1 + 3 * q], x, st, q);
+        ref.butterflies(&bf_ref[1], &bf_ref[1 + q], &bf_ref[1 + 2 * q], &bf_ref[1 + 3 * q], x, st, q);
+        for (size_t i = 0; i < bf.size(); ++i) assert(close_enough(bf[i], bf_ref[i], 1e-5f));
+    }
+}
+
+// Nanoseconds per 256-frame callback for the engine's per-buffer work:
+// input RMS, gain + mono to stereo, output RMS.
+static double time_callback_path(const DspKernels& k) {
+    constexpr size_t kFrames = 256;
+    constexpr int kIterations = 20000;
+    std::vector<float> in(kFrames, 0.25f), out(kFrames * 2);
+    volatile float sink = 0.0f;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int iter = 0; iter < kIterations; ++iter) {
+        float level = dsp_rms(k, in.data(), kFrames);
+        k.mono_to_stereo(in.data(), out.data(), kFrames, 0.8f);
+        level += dsp_stereo_rms(k, out.data(), kFrames);
+        sink = sink + level;
+    }
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / kIterations;
+}
+
+int main() {
+    std::cout << "Running DSP kernel tests..." << std::endl;
+
+    const DspKernels& ref = *dsp_kernels_for(DspKernels::Isa::SCALAR);
+    std::cout << "Dispatched kernels: " << dsp_kernels().name << std::endl;
+    double scalar_ns = time_callback_path(ref);
+
+    for (auto isa : { DspKernels::Isa::SSE2, DspKernels::Isa::AVX2, DspKernels::Isa::NEON }) {
+        const DspKernels* k = dsp_kernels_for(isa);
+        if (!k) {
+            continue;
+        }
+        check_against_reference(*k, ref);
+        double ns = time_callback_path(*k);
+        std::cout << "- " << k->name << ": matches scalar reference, "
+                  << ns << " ns/callback (" << scalar_ns / ns << "x scalar)" << std::endl;
+    }
+
+    // Known values
+    const float ones[5] = { 1.0f, 1.0f, 1.0f, 1.0f, 1.0f };
+    assert(close_enough(dsp_rms(dsp_kernels(), ones, 5), 1.0f, 1e-6f));
+    assert(dsp_rms(dsp_kernels(), ones, 0) == 0.0f);
+    const float signs[9] = { 0.5f, -0.25f, 0.0f, -0.875f, 0.125f, 0.5f, -0.5f, 0.25f, 0.75f };
+    assert(dsp_kernels().peak(signs, 9) == 0.875f);
+    assert(dsp_kernels().peak(signs, 0) == 0.0f);
+    float lo = 1.0f, hi = 1.0f;
+    dsp_kernels().min_max(signs, 9, &lo, &hi);
+    assert(lo == -0.875f && hi == 0.75f);
+    dsp_kernels().min_max(signs, 0, &lo, &hi);
+    assert(lo == 0.0f && hi == 0.0f);
+
+    std::cout << "DSP kernel tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,321 @@
+#include "../../src/network/event_loop.h"
+#include "../../src/network/protocol_manager.h"
+#include "../../src/network/timer_wheel.h"
+#include "../../src/core/config_manager.h"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsed_us(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+static double percentile(std::vector<double> values, double fraction) {
+    std::sort(values.begin(), values.end());
+    return values[static_cast<size_t>(fraction * (values.size() - 1))];
+}
+
+// Blocking TCP echo server on 127.0.0.1, a thread per connection
+class EchoServer {
+public:
+    EchoServer() {
+        listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        assert(listen(listen_fd_, 16) == 0);
+        socklen_t length = sizeof(address);
+        getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length);
+        port_ = ntohs(address.sin_port);
+        acceptor_ = std::thread([this] { accept_loop(); });
+    }
+
+    ~EchoServer() {
+        shutdown(listen_fd_, SHUT_RDWR);
+        close(listen_fd_);
+        acceptor_.join();
+        for (int fd : clients_) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        for (std::thread& thread : echoers_) {
+            thread.join();
+        }
+        for (int fd : clients_) {
+            close(fd);
+        }
+    }
+
+    uint16_t port() const { return port_; }
+
+private:
+    void accept_loop() {
+        while (true) {
+            int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            clients_.push_back(fd);
+            echoers_.emplace_back([fd] {
+                char buffer[4096];
+                ssize_t received;
+                while ((received = read(fd, buffer, sizeof(buffer))) > 0) {
+                    if (write(fd, buffer, static_cast<size_t>(received)) != received) {
+                        return;
+                    }
+                }
+            });
+        }
+    }
+
+    int listen_fd_;
+    uint16_t port_;
+    std::thread acceptor_;
+    std::vector<int> clients_;
+    std::vector<std::thread> echoers_;
+};
+
+// Timers fire in order, once or repeatedly, across several turns of the
+// wheel, and can be cancelled, even by their own task
+static void test_timer_wheel() {
+    TimerWheel wheel(8);
+    std::vector<int> fired;
+    wheel.add(3, [&fired] { fired.push_back(3); });
+    wheel.add(1, [&fired] { fired.push_back(1); });
+    wheel.add(20, [&fired] { fired.push_back(20); }); // Two and a half turns
+    TimerWheel::TimerId cancelled = wheel.add(5, [&fired] { fired.push_back(5); });
+    int repeats = 0;
+    TimerWheel::TimerId repeating = 0;
+    repeating = wheel.add(4, [&] {
+        if (++repeats == 3) {
+            wheel.cancel(repeating);
+        }
+    }, 4);
+    wheel.cancel(cancelled);
+
+    assert(wheel.ticks_to_next() == 1);
+    wheel.advance(2);
+    assert((fired == std::vector<int>{1}));
+    wheel.advance(19);
+    assert((fired == std::vector<int>{1, 3}));
+    assert(repeats == 3); // Ticks 4, 8 and 12
+    wheel.advance(20);
+    assert((fired == std::vector<int>{1, 3, 20}));
+    assert(wheel.empty() && wheel.ticks_to_next() == 0);
+    std::cout << "Timer wheel: OK" << std::endl;
+}
+
+// A task posted from another thread runs well within a millisecond, and a
+// timer fires on time rather than at the next poll
+static void test_dispatch_latency() {
+    EventLoop loop;
+    assert(loop.valid());
+    std::thread thread(&EventLoop::run, &loop);
+
+    std::vector<double> latencies;
+    for (int i = 0; i < 2000; ++i) {
+        std::atomic<bool> done{false};
+        Clock::time_point ran;
+        auto start = Clock::now();
+        loop.post([&] {
+            ran = Clock::now();
+            done.store(true, std::memory_order_release);
+        });
+        while (!done.load(std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(ran - start).count());
+    }
+    double p50 = percentile(latencies, 0.5);
+    double p99 = percentile(latencies, 0.99);
+    assert(p50 < 1000.0);
+
+    std::mutex mutex;
+    std::condition_variable fired;
+    double timer_ms = -1.0;
+    auto start = Clock::now();
+    loop.post([&] {
+        loop.add_timer(5, [&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            timer_ms = elapsed_us(start) / 1000.0;
+            fired.notify_one();
+        });
+    });
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        fired.wait(lock, [&] { return timer_ms >= 0.0; });
+    }
+    assert(timer_ms >= 5.0 && timer_ms < 20.0);
+
+    loop.stop();
+    thread.join();
+    std::cout << "Dispatch latency: OK (post p50 " << p50 << " us, p99 " << p99 << " us; 5 ms timer after "
+              << timer_ms << " ms)" << std::endl;
+}
+
+// Several channels to a local echo server share the one loop thread, and a
+// line round-trips in well under a millisecond
+static void test_echo_round_trip() {
+    EchoServer server;
+    ConfigManager config;
+    ProtocolManager manager;
+    assert(manager.initialize(&config));
+
+    std::mutex mutex;
+    std::condition_variable received;
+    std::vector<std::pair<std::string, std::string>> messages;
+    std::set<std::thread::id> threads;
+    manager.register_message_callback([&](const std::string& channel, const std::string& message) {
+        std::lock_guard<std::mutex> lock(mutex);
+        messages.emplace_back(channel, message);
+        threads.insert(std::this_thread::get_id());
+        received.notify_one();
+    });
+
+    const std::vector<std::string> channels = { "discord", "matrix", "xmpp", "irc" };
+    for (const std::string& channel : channels) {
+        assert(manager.connect_channel(channel, "127.0.0.1", server.port()));
+    }
+
+    auto send_and_wait = [&](const std::string& channel, const std::string& text) {
+        auto start = Clock::now();
+        std::unique_lock<std::mutex> lock(mutex);
+        size_t before = messages.size();
+        lock.unlock();
+        manager.send_message(channel, text);
+        lock.lock();
+        bool ok = received.wait_for(lock, std::chrono::seconds(2), [&] { return messages.size() > before; });
+        assert(ok);
+        return elapsed_us(start);
+    };
+
+    // The first line on each channel may wait for the connection
+    for (const std::string& channel : channels) {
+        send_and_wait(channel, "hello " + channel);
+        assert(messages.back() == std::make_pair(channel, "hello " + channel));
+    }
+    std::vector<double> round_trips;
+    for (int i = 0; i < 500; ++i) {
+        const std::string& channel = channels[i % channels.size()];
+        std::string text = channel + " message " + std::to_string(i);
+        round_trips.push_back(send_and_wait(channel, text));
+        assert(messages.back() == std::make_pair(channel, text));
+    }
+    double p50 = percentile(round_trips, 0.5);
+    double p99 = percentile(round_trips, 0.99);
+    assert(p50 < 1000.0);
+    assert(threads.size() == 1);
+
+    // Without a connection the demo echo still answers
+    send_and_wait("lobby", "ping");
+    assert(messages.back() == std::make_pair(std::string("Echo"), std::string("You said: ping")));
+    manager.shutdown();
+    std::cout << "Echo round trip: OK (" << channels.size() << " channels on one thread, p50 " << p50
+              << " us, p99 " << p99 << " us)" << std::endl;
+}
+
+// Shutdown no longer waits out a sleeping thread
+static void test_instant_shutdown() {
+    EchoServer server;
+    ConfigManager config;
+    ProtocolManager manager;
+    assert(manager.initialize(&config));
+    manager.connect_channel("matrix", "127.0.0.1", server.port());
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    auto start = Clock::now();
+    manager.shutdown();
+    double shutdown_ms = elapsed_us(start) / 1000.0;
+    assert(shutdown_ms < 50.0);
+    assert(!manager.send_message("matrix", "too late"));
+    std::cout << "Instant shutdown: OK (" << shutdown_ms << " ms)" << std::endl;
+}
+
+// The RTSP and HLS stats can be read from any thread while the servers are
+// closed and reopened, and opening from the loop thread is refused rather
+// than waited on for ever
+static void test_servers_from_any_thread() {
+    ConfigManager config;
+    ProtocolManager manager;
+    assert(manager.initialize(&config));
+    std::vector<RtspMount> mounts(1);
+    mounts[0].path = "/mic/default";
+    mounts[0].port = 0;
+    std::vector<HlsMount> hls_mounts(1);
+    hls_mounts[0].path = "/hls/default_mic/index.m3u8";
+    std::vector<AudioEncodePipeline*> pipelines;
+
+    std::atomic<bool> done{false};
+    uint64_t reads = 0;
+    std::thread reader([&] {
+        while (!done) {
+            manager.rtsp_stats();
+            manager.hls_stats();
+            ++reads;
+        }
+    });
+    const int reopens = 50;
+    for (int i = 0; i < reopens; ++i) {
+        assert(manager.open_rtsp("127.0.0.1", mounts, pipelines));
+        assert(pipelines.size() == 1 && pipelines[0]);
+        manager.close_rtsp();
+        assert(manager.open_hls("127.0.0.1", 0, HlsSettings(), hls_mounts, pipelines));
+        assert(pipelines.size() == 1 && pipelines[0]);
+        manager.close_hls();
+    }
+    done = true;
+    reader.join();
+    assert(manager.rtsp_stats().connections == 0);
+    assert(manager.hls_stats().connections == 0);
+
+    // The message callback runs on the loop thread
+    std::mutex mutex;
+    std::condition_variable answered;
+    int opened = -1;
+    int hls_opened = -1;
+    manager.register_message_callback([&](const std::string&, const std::string&) {
+        std::vector<AudioEncodePipeline*> unused;
+        bool ok = manager.open_rtsp("127.0.0.1", mounts, unused);
+        bool hls_ok = manager.open_hls("127.0.0.1", 0, HlsSettings(), hls_mounts, unused);
+        std::lock_guard<std::mutex> lock(mutex);
+        opened = ok ? 1 : 0;
+        hls_opened = hls_ok ? 1 : 0;
+        answered.notify_one();
+    });
+    manager.send_message("lobby", "ping");
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        bool ok = answered.wait_for(lock, std::chrono::seconds(2), [&] { return opened >= 0; });
+        assert(ok);
+    }
+    assert(opened == 0 && hls_opened == 0);
+    manager.shutdown();
+    std::cout << "Servers from any thread: OK (" << reopens << " reopens, " << reads << " stats reads)" << std::endl;
+}
+
+int main() {
+    std::cout << "Running event loop tests..." << std::endl;
+
+    test_timer_wheel();
+    test_dispatch_latency();
+    test_echo_round_trip();
+    test_instant_shutdown();
+    test_servers_from_any_thread();
+
+    std::cout << "Event loop tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include "../../src/core/history_store.h"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+static std::string make_temp_dir() {
+    char path[] = "/tmp/history_store_test_XXXXXX";
+    assert(mkdtemp(path));
+    return path;
+}
+
+static void remove_dir(const std::string& path) {
+    if (DIR* dir = opendir(path.c_str())) {
+        while (dirent* entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                unlink((path + "/" + name).c_str());
+            }
+        }
+        closedir(dir);
+    }
+    rmdir(path.c_str());
+}
+
+static std::string body_for(uint64_t i) {
+    return "message " + std::to_string(i) + std::string(i % 40, 'x');
+}
+
+static HistoryStore::Options small_segments() {
+    HistoryStore::Options options;
+    options.segment_bytes = 4096;
+    options.index_interval = 8;
+    return options;
+}
+
+// Every record read back matches what was appended, in order
+static void check_records(const HistoryStore& store, uint64_t from, uint64_t to) {
+    uint64_t expected = from;
+    store.read(from, SIZE_MAX, [&](const HistoryStore::Record& record) {
+        assert(record.seq == expected);
+        assert(record.time_ms == static_cast<int64_t>(1000 * expected));
+        assert(record.sender == (expected % 2 ? "alice" : "bob"));
+        assert(record.channel == "lobby");
+        assert(record.body == body_for(expected));
+        assert(record.flags == (expected % 3 == 0 ? uint32_t(HistoryStore::SELF) : 0u));
+        ++expected;
+        return true;
+    });
+    assert(expected == to);
+}
+
+static void append_range(HistoryStore& store, uint64_t from, uint64_t to) {
+    for (uint64_t i = from; i < to; ++i) {
+        uint64_t seq = store.append(static_cast<int64_t>(1000 * i), i % 3 == 0 ? uint32_t(HistoryStore::SELF) : 0u,
+                                    i % 2 ? "alice" : "bob", "lobby", body_for(i));
+        assert(seq == i);
+    }
+}
+
+// Records span many segments, read back from any starting point, and time
+// lookups land on the first record at or after the time
+static void test_append_and_read() {
+    std::string dir = make_temp_dir();
+    HistoryStore store;
+    assert(store.open(dir, small_segments()));
+    append_range(store, 1, 1001);
+
+    HistoryStore::Stats stats = store.get_stats();
+    assert(stats.records == 1000 && stats.next_seq == 1001);
+    assert(stats.segments > 10);
+    check_records(store, 1, 1001);
+    check_records(store, 537, 1001);
+
+    size_t visited = store.read(100, 5, [](const HistoryStore::Record&) { return true; });
+    assert(visited == 5);
+    assert(store.seq_at_time(250000) == 250);
+    assert(store.seq_at_time(250001) == 251);
+    assert(store.seq_at_time(0) == 1);
+    assert(store.seq_at_time(2000000) == 1001);
+    store.close();
+    remove_dir(dir);
+    std::cout << "Append and read: OK (" << stats.segments << " segments)" << std::endl;
+}
+
+// Reopening maps the segments and picks up where it left off, and a torn
+// final record is dropped rather than read
+static void test_reopen_and_recovery() {
+    std::string dir = make_temp_dir();
+    {
+        HistoryStore store;
+        assert(store.open(dir, small_segments()));
+        append_range(store, 1, 501);
+    }
+
+    HistoryStore store;
+    assert(store.open(dir, small_segments()));
+    assert(store.next_seq() == 501);
+    check_records(store, 1, 501);
+    append_range(store, 501, 601);
+    store.close();
+
+    // Tear the last record: garbage in the middle of its body
+    std::vector<std::string> segments;
+    DIR* listing = opendir(dir.c_str());
+    while (dirent* entry = readdir(listing)) {
+        std::string name = entry->d_name;
+        if (name.size() > 4 && name.compare(name.size() - 4, 4, ".seg") == 0) {
+            segments.push_back(name);
+        }
+    }
+    closedir(listing);
+    std::sort(segments.begin(), segments.end());
+    std::string last = dir + "/" + segments.back();
+    int fd = open(last.c_str(), O_RDWR);
+    struct stat info {};
+    fstat(fd, &info);
+    assert(pwrite(fd, "#####", 5, info.st_size - 12) == 5);
+    close(fd);
+
+    assert(store.open(dir, small_segments()));
+    HistoryStore::Stats stats = store.get_stats();
+    assert(stats.next_seq == 600 && stats.recovered_bytes > 0);
+    check_records(store, 1, 600);
+    append_range(store, 600, 650);
+    check_records(store, 1, 650);
+    store.close();
+    remove_dir(dir);
+    std::cout << "Reopen and recovery: OK (" << stats.recovered_bytes << " torn bytes dropped)" << std::endl;
+}
+
+// Several threads queue records; all are written, none dropped, and each
+// thread's records keep their order
+static void test_async_writers() {
+    std::string dir = make_temp_dir();
+    HistoryStore::Options options;
+    options.segment_bytes = 1 << 20;
+    options.queue_capacity = 1 << 16;
+    HistoryStore store;
+    assert(store.open(dir, options));
+
+    constexpr int kThreads = 4;
+    constexpr int kPerThread = 10000;
+    std::vector<double> worst_us(kThreads, 0.0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&store, &worst_us, t] {
+            for (int i = 0; i < kPerThread; ++i) {
+                auto start = Clock::now();
+                assert(store.append_async(i, 0, "thread" + std::to_string(t), "lobby", std::to_string(i)));
+                double us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+                worst_us[t] = std::max(worst_us[t], us);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    store.flush();
+
+    HistoryStore::Stats stats = store.get_stats();
+    assert(stats.records == kThreads * kPerThread);
+    assert(stats.written == stats.queued && stats.dropped == 0);
+    std::vector<int> next(kThreads, 0);
+    store.read(1, SIZE_MAX, [&](const HistoryStore::Record& record) {
+        int t = record.sender.back() - '0';
+        assert(std::stoi(std::string(record.body)) == next[t]++);
+        return true;
+    });
+    store.close();
+    remove_dir(dir);
+    std::cout << "Async writers: OK (" << stats.records << " records, slowest append_async "
+              << *std::max_element(worst_us.begin(), worst_us.end()) << " us)" << std::endl;
+}
+
+// Compaction drops expired segments, rewrites the one straddling the
+// cutoff, and the result survives a reopen
+static void test_compaction() {
+    std::string dir = make_temp_dir();
+    HistoryStore store;
+    assert(store.open(dir, small_segments()));
+    append_range(store, 1, 1001); // Times 1 s to 1000 s
+
+    HistoryStore::CompactionPolicy policy;
+    policy.max_age_ms = 500 * 1000;
+    HistoryStore::CompactionResult result = store.compact(policy, 1000 * 1000 + 500);
+    assert(result.segments_removed > 0 && result.segments_rewritten == 1);
+    assert(result.records_removed == 500);
+    assert(store.first_seq() == 501);
+    check_records(store, 501, 1001);
+    uint64_t first_read = 0;
+    store.read(1, 1, [&first_read](const HistoryStore::Record& record) {
+        first_read = record.seq; // Reads from before the start begin at it
+        return true;
+    });
+    assert(first_read == 501);
+
+    // Compacting again removes nothing more
+    result = store.compact(policy, 1000 * 1000 + 500);
+    assert(result.records_removed == 0);
+
+    // A byte budget drops the oldest segments and never the active one
+    HistoryStore::CompactionPolicy budget;
+    budget.max_bytes = 8192;
+    result = store.compact(budget, 0);
+    HistoryStore::Stats stats = store.get_stats();
+    assert(result.segments_removed > 0 && stats.bytes <= 8192 + 4096);
+    uint64_t first = store.first_seq();
+    store.close();
+
+    assert(store.open(dir, small_segments()));
+    assert(store.first_seq() == first && store.next_seq() == 1001);
+    check_records(store, first, 1001);
+    store.compact_async(policy, 2000 * 1000);
+    store.flush();
+    assert(store.get_stats().segments == 1);
+    store.close();
+    remove_dir(dir);
+    std::cout << "Compaction: OK" << std::endl;
+}
+
+// Opening a large store reads the sparse index instead of every record
+static void test_fast_open() {
+    std::string dir = make_temp_dir();
+    constexpr uint64_t kRecords = 200000;
+    {
+        HistoryStore store;
+        assert(store.open(dir));
+        for (uint64_t i = 1; i <= kRecords; ++i) {
+            store.append(static_cast<int64_t>(i), 0, "alice", "lobby", body_for(i));
+        }
+    }
+    auto start = Clock::now();
+    HistoryStore store;
+    assert(store.open(dir));
+    double open_ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    HistoryStore::Stats stats = store.get_stats();
+    assert(stats.records == kRecords);
+
+    // Rendering the last screenful of scroll-back
+    start = Clock::now();
+    size_t bytes = 0;
+    store.read(kRecords - 50, 50, [&bytes](const HistoryStore::Record& record) {
+        bytes += record.body.size();
+        return true;
+    });
+    double read_us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    assert(bytes > 0);
+    assert(open_ms < 100.0);
+    store.close();
+    remove_dir(dir);
+    std::cout << "Fast open: OK (" << kRecords << " records in " << stats.segments << " segments opened in "
+              << open_ms << " ms; last 50 read in " << read_us << " us)" << std::endl;
+}
+
+int main() {
+    std::cout << "Running history store tests..." << std::endl;
+
+    test_append_and_read();
+    test_reopen_and_recovery();
+    test_async_writers();
+    test_compaction();
+    test_fast_open();
+
+    std::cout << "History store tests completed" << std::endl;
+    return 0;
+}
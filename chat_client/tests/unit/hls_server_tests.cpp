@@ -0,0 +1,493 @@
+#include "../../src/network/hls_server.h"
+#include "../../src/network/hls_segmenter.h"
+#include "../../src/network/event_loop.h"
+#include "../../src/audio/codec_pipeline.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+uint32_t read_u32(const std::string& data, size_t at) {
+    return uint32_t(uint8_t(data[at])) << 24 | uint32_t(uint8_t(data[at + 1])) << 16
+         | uint32_t(uint8_t(data[at + 2])) << 8 | uint8_t(data[at + 3]);
+}
+
+uint64_t read_u64(const std::string& data, size_t at) {
+    return uint64_t(read_u32(data, at)) << 32 | read_u32(data, at + 4);
+}
+
+// The box of this type among those in [begin, end): its offset, or npos
+size_t find_box(const std::string& data, size_t begin, size_t end, const char* type) {
+    while (begin + 8 <= end) {
+        uint32_t size = read_u32(data, begin);
+        assert(size >= 8 && begin + size <= end);
+        if (data.compare(begin + 4, 4, type) == 0) {
+            return begin;
+        }
+        begin += size;
+    }
+    return std::string::npos;
+}
+
+// Follows a path of box types from the top level; the last box's offset
+size_t find_path(const std::string& data, std::initializer_list<const char*> path) {
+    size_t begin = 0;
+    size_t end = data.size();
+    size_t box = std::string::npos;
+    for (const char* type : path) {
+        box = find_box(data, begin, end, type);
+        assert(box != std::string::npos);
+        end = box + read_u32(data, box);
+        begin = box + 8;
+    }
+    return box;
+}
+
+std::string read_segment(const HlsSegmenter& segmenter, uint64_t sequence) {
+    HlsSegmenter::Segment segment;
+    assert(segmenter.segment(sequence, segment));
+    assert(segment.sequence == sequence);
+    std::string data(segment.size, '\0');
+    assert(pread(segmenter.fd(), &data[0], data.size(), segment.offset) == static_cast<ssize_t>(data.size()));
+    return data;
+}
+
+CodecSettings test_codec() {
+    CodecSettings settings;
+    CodecSettings::preset("high", settings);
+    settings.dtx = false;
+    return settings;
+}
+
+unsigned frame_samples_of(const CodecSettings& settings) {
+    return static_cast<unsigned>(make_audio_encoder(settings)->frame_samples());
+}
+
+// Frame n of a recognisable test stream
+std::string test_frame(unsigned n) {
+    return std::string(10 + n % 7, static_cast<char>(n & 0xFF));
+}
+
+struct Response {
+    int status = 0;
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+// A blocking HTTP/1.1 client on 127.0.0.1
+class Client {
+public:
+    explicit Client(uint16_t port, int receive_buffer = 0) {
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (receive_buffer) {
+            setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        }
+        timeval timeout{ 2, 0 };
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    }
+
+    ~Client() { close(fd_); }
+
+    int fd() const { return fd_; }
+
+    void send_raw(const std::string& text) {
+        assert(::send(fd_, text.data(), text.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(text.size()));
+    }
+
+    Response get(const std::string& target, const std::string& method = "GET", const std::string& headers = "") {
+        send_raw(method + " " + target + " HTTP/1.1\r\nHost: localhost\r\n" + headers + "\r\n");
+        return read_response(method == "HEAD");
+    }
+
+    Response read_response(bool head_only = false) {
+        for (;;) {
+            size_t end = buffer_.find("\r\n\r\n");
+            if (end != std::string::npos) {
+                Response response;
+                std::string head = buffer_.substr(0, end + 2);
+                assert(head.compare(0, 9, "HTTP/1.1 ") == 0);
+                response.status = std::stoi(head.substr(9, 3));
+                for (size_t at = head.find("\r\n") + 2; at < head.size();) {
+                    size_t next = head.find("\r\n", at);
+                    size_t colon = head.find(':', at);
+                    std::string name = head.substr(at, colon - at);
+                    for (char& c : name) {
+                        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                    }
+                    response.headers[name] = head.substr(colon + 2, next - colon - 2);
+                    at = next + 2;
+                }
+                size_t length = head_only ? 0 : std::stoul(response.headers["content-length"]);
+                if (buffer_.size() >= end + 4 + length) {
+                    response.body = buffer_.substr(end + 4, length);
+                    buffer_.erase(0, end + 4 + length);
+                    return response;
+                }
+            }
+            assert(receive());
+        }
+    }
+
+    // True if the server closes the connection before sending anything more
+    bool closed() {
+        char byte;
+        return buffer_.empty() && recv(fd_, &byte, 1, 0) <= 0;
+    }
+
+    // Reads up to count bytes; how many arrived before the connection ended
+    size_t read_bytes(size_t count) {
+        size_t total = buffer_.size();
+        buffer_.clear();
+        char chunk[4096];
+        while (total < count) {
+            ssize_t received = recv(fd_, chunk, sizeof(chunk), 0);
+            if (received <= 0) {
+                break;
+            }
+            total += static_cast<size_t>(received);
+        }
+        return total;
+    }
+
+private:
+    bool receive() {
+        char chunk[4096];
+        ssize_t received = recv(fd_, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer_.append(chunk, static_cast<size_t>(received));
+        return true;
+    }
+
+    int fd_ = -1;
+    std::string buffer_;
+};
+
+// The server on its own loop thread, with a microphone stream
+class Fixture {
+public:
+    explicit Fixture(const HlsSettings& settings) {
+        server = std::make_unique<HlsServer>(loop, settings);
+        mic = server->add_stream("/hls/default_mic/index.m3u8", test_codec());
+        assert(mic);
+        assert(server->listen("127.0.0.1", 0));
+        port = server->port();
+        thread = std::thread([this] { loop.run(); });
+    }
+
+    ~Fixture() {
+        loop.stop();
+        thread.join();
+        server.reset();
+    }
+
+    // Encodes frames of a tone, as the engine would feed them, and waits
+    // for the segments they finish
+    void feed(unsigned frames, uint64_t segments) {
+        auto block = std::make_unique<AudioBlock>();
+        block->sample_rate = mic->sample_rate();
+        block->frames = mic->frame_samples();
+        for (unsigned frame = 0; frame < frames; ++frame) {
+            for (unsigned i = 0; i < block->frames; ++i) {
+                block->samples[i] = 0.3f * static_cast<float>(std::sin(2 * kPi * 440.0 * (phase_++) / block->sample_rate));
+            }
+            block->sequence++;
+            mic->process(*block);
+            if (frame % 32 == 31) {
+                // Real time is 640 ms; this leaves the loop time to drain the queue
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+        auto deadline = Clock::now() + std::chrono::seconds(2);
+        while (server->get_stats().segments_published < segments) {
+            assert(Clock::now() < deadline);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    EventLoop loop;
+    std::unique_ptr<HlsServer> server;
+    AudioEncodePipeline* mic = nullptr;
+    uint16_t port = 0;
+    std::thread thread;
+
+private:
+    uint64_t phase_ = 0;
+};
+
+} // namespace
+
+void test_init_segment() {
+    std::cout << "Testing init segment..." << std::endl;
+    CodecSettings codec = test_codec();
+    HlsSegmenter segmenter(codec, HlsSettings{ 200, 3 });
+    assert(segmenter.valid());
+    assert(segmenter.frames_per_segment() == 10);
+
+    const std::string& init = segmenter.init_segment();
+    assert(init.compare(4, 4, "ftyp") == 0);
+    size_t mdhd = find_path(init, { "moov", "trak", "mdia", "mdhd" });
+    bool opus = std::strcmp(segmenter.codec_name(), "opus") == 0;
+    unsigned timescale = read_u32(init, mdhd + 20);
+    assert(timescale == (opus ? 48000u : make_audio_encoder(codec)->sample_rate()));
+    size_t stsd = find_path(init, { "moov", "trak", "mdia", "minf", "stbl", "stsd" });
+    assert(init.compare(stsd + 20, 4, opus ? "Opus" : "xadp") == 0);
+    find_path(init, { "moov", "mvex", "trex" });
+    std::cout << "Init segment: OK (" << init.size() << " bytes, " << segmenter.codec_name() << ")" << std::endl;
+}
+
+void test_segments() {
+    std::cout << "Testing segments..." << std::endl;
+    CodecSettings codec = test_codec();
+    const unsigned samples = frame_samples_of(codec);
+    HlsSegmenter segmenter(codec, HlsSettings{ 200, 3 });
+    assert(segmenter.playlist().find("#EXTINF") == std::string::npos);
+
+    const unsigned frames = 80;  // 8 segments, more than the ring's 6 slots
+    for (unsigned n = 0; n < frames; ++n) {
+        std::string frame = test_frame(n);
+        bool finished = segmenter.add_frame(n * samples, reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+        assert(finished == (n % 10 == 9));
+    }
+    assert(segmenter.next_sequence() == 8);
+    assert(segmenter.oldest_sequence() == 8 - 3 - HlsSegmenter::kSpareSegments);
+    HlsSegmenter::Segment gone;
+    assert(!segmenter.segment(1, gone));
+    assert(!segmenter.segment(8, gone));
+
+    uint64_t frame_ticks = 0;
+    for (uint64_t sequence = segmenter.oldest_sequence(); sequence < 8; ++sequence) {
+        // Reused slots included
+        std::string data = read_segment(segmenter, sequence);
+        size_t mfhd = find_path(data, { "moof", "mfhd" });
+        assert(read_u32(data, mfhd + 12) == sequence + 1);
+        size_t tfhd = find_path(data, { "moof", "traf", "tfhd" });
+        frame_ticks = read_u32(data, tfhd + 16);
+        size_t tfdt = find_path(data, { "moof", "traf", "tfdt" });
+        assert(read_u64(data, tfdt + 12) == sequence * 10 * frame_ticks);
+        size_t trun = find_path(data, { "moof", "traf", "trun" });
+        assert(read_u32(data, trun + 12) == 10);
+        size_t offset = read_u32(data, trun + 16);
+        size_t mdat = find_box(data, 0, data.size(), "mdat");
+        assert(offset == mdat + 8);
+        for (unsigned i = 0; i < 10; ++i) {
+            std::string expected = test_frame(unsigned(sequence) * 10 + i);
+            assert(read_u32(data, trun + 20 + 4 * i) == expected.size());
+            assert(data.compare(offset, expected.size(), expected) == 0);
+            offset += expected.size();
+        }
+        assert(offset == data.size());
+    }
+    assert(frame_ticks > 0);
+
+    std::string playlist = segmenter.playlist();
+    assert(playlist.compare(0, 8, "#EXTM3U\n") == 0);
+    assert(playlist.find("#EXT-X-TARGETDURATION:1\n") != std::string::npos);
+    assert(playlist.find("#EXT-X-MEDIA-SEQUENCE:5\n") != std::string::npos);
+    assert(playlist.find("#EXT-X-MAP:URI=\"init.mp4\"") != std::string::npos);
+    assert(playlist.find("#EXTINF:0.200,\nseg5.m4s\n#EXTINF:0.200,\nseg6.m4s\n#EXTINF:0.200,\nseg7.m4s\n")
+           != std::string::npos);
+    assert(playlist.find("seg4.m4s") == std::string::npos);
+    std::cout << "Segments: OK" << std::endl;
+}
+
+void test_gap_fill() {
+    std::cout << "Testing gap fill..." << std::endl;
+    CodecSettings codec = test_codec();
+    const unsigned samples = frame_samples_of(codec);
+    HlsSegmenter segmenter(codec, HlsSettings{ 200, 3 });
+    std::string frame = test_frame(1);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(frame.data());
+
+    // Two frames missing, then a comfort noise frame with no data
+    assert(!segmenter.add_frame(0, data, frame.size()));
+    assert(!segmenter.add_frame(3 * samples, data, frame.size()));
+    assert(!segmenter.add_frame(4 * samples, nullptr, 0));
+    assert(segmenter.frames_filled() == 2);
+    unsigned finished = 0;
+    for (unsigned n = 5; n < 10; ++n) {
+        finished += segmenter.add_frame(n * samples, data, frame.size());
+    }
+    assert(finished == 1);
+    std::string first = read_segment(segmenter, 0);
+    size_t trun = find_path(first, { "moof", "traf", "trun" });
+    assert(read_u32(first, trun + 12) == 10);
+    uint32_t silence = read_u32(first, trun + 24);
+    assert(silence > 0 && read_u32(first, trun + 28) == silence && read_u32(first, trun + 36) == silence);
+
+    // A gap longer than a segment is passed over, the timeline unbroken
+    for (unsigned n = 100; n < 110; ++n) {
+        finished += segmenter.add_frame(n * samples, data, frame.size());
+    }
+    assert(finished == 2);
+    assert(segmenter.frames_filled() == 2);
+    assert(segmenter.frames_skipped() == 90);
+    std::string second = read_segment(segmenter, 1);
+    size_t tfhd = find_path(second, { "moof", "traf", "tfhd" });
+    size_t tfdt = find_path(second, { "moof", "traf", "tfdt" });
+    assert(read_u64(second, tfdt + 12) == 10ull * read_u32(second, tfhd + 16));
+    std::cout << "Gap fill: OK" << std::endl;
+}
+
+void test_http() {
+    std::cout << "Testing HTTP..." << std::endl;
+    Fixture fixture(HlsSettings{ 200, 3 });
+    Client client(fixture.port);
+
+    // Before any segment the playlist is there, empty
+    Response empty = client.get("/hls/default_mic/index.m3u8");
+    assert(empty.status == 200);
+    assert(empty.body.find("#EXTINF") == std::string::npos);
+
+    fixture.feed(30, 3);
+    Response playlist = client.get("/hls/default_mic/index.m3u8?_HLS_msn=2");
+    assert(playlist.status == 200);
+    assert(playlist.headers["content-type"] == "application/vnd.apple.mpegurl");
+    assert(playlist.headers["cache-control"] == "no-cache");
+    assert(playlist.body.find("#EXT-X-MEDIA-SEQUENCE:0\n") != std::string::npos);
+    assert(playlist.body.find("seg2.m4s") != std::string::npos);
+
+    Response init = client.get("/hls/default_mic/init.mp4");
+    assert(init.status == 200 && init.headers["content-type"] == "audio/mp4");
+    assert(init.body.compare(4, 4, "ftyp") == 0);
+
+    Response segment = client.get("/hls/default_mic/seg1.m4s");
+    assert(segment.status == 200);
+    assert(segment.body.size() == std::stoul(segment.headers["content-length"]));
+    size_t mfhd = find_path(segment.body, { "moof", "mfhd" });
+    assert(read_u32(segment.body, mfhd + 12) == 2);
+    find_box(segment.body, 0, segment.body.size(), "mdat");
+
+    Response head = client.get("/hls/default_mic/seg1.m4s", "HEAD");
+    assert(head.status == 200 && head.body.empty());
+    assert(head.headers["content-length"] == segment.headers["content-length"]);
+
+    // Pipelined requests are answered in order on the one connection
+    client.send_raw("GET /hls/default_mic/seg0.m4s HTTP/1.1\r\n\r\nGET /hls/default_mic/index.m3u8 HTTP/1.1\r\n\r\n");
+    Response first = client.read_response();
+    Response second = client.read_response();
+    assert(first.status == 200 && first.headers["content-type"] == "audio/mp4");
+    assert(second.status == 200 && second.body == playlist.body);
+
+    assert(client.get("/hls/default_mic/seg9.m4s").status == 404);
+    assert(client.get("/hls/default_mic/segment.m4s").status == 404);
+    assert(client.get("/hls/default_speaker/index.m3u8").status == 404);
+    Response post = client.get("/hls/default_mic/index.m3u8", "POST");
+    assert(post.status == 405 && post.headers["allow"] == "GET, HEAD");
+    assert(client.get("/hls/default_mic/index.m3u8").status == 200);
+
+    // Connection: close, HTTP/1.0 and malformed requests end the connection
+    assert(client.get("/hls/default_mic/index.m3u8", "GET", "Connection: close\r\n").status == 200);
+    assert(client.closed());
+    Client old(fixture.port);
+    old.send_raw("GET /hls/default_mic/index.m3u8 HTTP/1.0\r\n\r\n");
+    assert(old.read_response().status == 200);
+    assert(old.closed());
+    Client kept(fixture.port);
+    kept.send_raw("GET /hls/default_mic/index.m3u8 HTTP/1.0\r\nConnection: keep-alive\r\n\r\n");
+    assert(kept.read_response().status == 200);
+    assert(kept.get("/hls/default_mic/init.mp4").status == 200);
+    Client garbage(fixture.port);
+    garbage.send_raw("NONSENSE\r\n\r\n");
+    assert(garbage.read_response().status == 400);
+    assert(garbage.closed());
+    Client flood(fixture.port);
+    flood.send_raw(std::string(HlsServer::kMaxRequestBytes + 1, 'A'));
+    assert(flood.read_response().status == 400);
+    assert(flood.closed());
+
+    HlsServer::Stats stats = fixture.server->get_stats();
+    assert(stats.segments_published == 3);
+    assert(stats.playlist_requests >= 6);
+    assert(stats.not_found == 3);
+    assert(stats.bad_requests == 3);
+    assert(stats.publish_ns_max > 0 && stats.publish_ns_max < 1000000000ull);
+    std::cout << "HTTP: OK (" << stats.requests << " requests)" << std::endl;
+}
+
+void test_many_pollers() {
+    std::cout << "Testing many pollers..." << std::endl;
+    Fixture fixture(HlsSettings{ 200, 3 });
+    fixture.feed(10, 1);
+    std::vector<std::unique_ptr<Client>> clients;
+    for (int i = 0; i < 200; ++i) {
+        clients.push_back(std::make_unique<Client>(fixture.port));
+        clients.back()->send_raw("GET /hls/default_mic/index.m3u8 HTTP/1.1\r\n\r\n");
+    }
+    for (auto& client : clients) {
+        Response response = client->read_response();
+        assert(response.status == 200 && response.body.find("seg0.m4s") != std::string::npos);
+    }
+    fixture.feed(10, 2);
+    for (auto& client : clients) {
+        Response response = client->get("/hls/default_mic/index.m3u8");
+        assert(response.body.find("seg1.m4s") != std::string::npos);
+        assert(client->get("/hls/default_mic/seg1.m4s").status == 200);
+    }
+    HlsServer::Stats stats = fixture.server->get_stats();
+    assert(stats.connections == 200);
+    assert(stats.requests == 600);
+    std::cout << "Many pollers: OK" << std::endl;
+}
+
+void test_slow_reader() {
+    std::cout << "Testing slow reader..." << std::endl;
+    // Long segments, so one is more than the socket buffers hold
+    Fixture fixture(HlsSettings{ 30000, 1 });
+    const unsigned frames = 30 * fixture.mic->sample_rate() / fixture.mic->frame_samples();
+    fixture.feed(frames, 1);
+    Client slow(fixture.port, 4096);
+    slow.send_raw("GET /hls/default_mic/seg0.m4s HTTP/1.1\r\n\r\n");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // Its slot is reused once the ring has gone round
+    const uint64_t ring = 1 + HlsSegmenter::kSpareSegments;
+    fixture.feed(frames * static_cast<unsigned>(ring), 1 + ring);
+    Client fresh(fixture.port);
+    Response current = fresh.get("/hls/default_mic/seg4.m4s");
+    assert(current.status == 200);
+    assert(fresh.get("/hls/default_mic/seg0.m4s").status == 404);
+
+    size_t received = slow.read_bytes(current.body.size() * 2);
+    assert(received < current.body.size());
+    assert(fixture.server->get_stats().evicted == 1);
+    assert(fixture.server->get_stats().queue_overflows == 0);
+    std::cout << "Slow reader: OK (dropped after " << received << " of " << current.body.size() << " bytes)"
+              << std::endl;
+}
+
+int main() {
+    std::cout << "Running HLS server tests..." << std::endl;
+
+    test_init_segment();
+    test_segments();
+    test_gap_fill();
+    test_http();
+    test_many_pollers();
+    test_slow_reader();
+
+    std::cout << "HLS server tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "../../src/audio/level_meter.h"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+static const unsigned kRate = 48000;
+static const unsigned kBlock = 256;
+
+static bool close_enough(double a, double b, double tolerance) {
+    return std::fabs(a - b) <= tolerance;
+}
+
+void test_single_reading() {
+    std::cout << "Testing one reading..." << std::endl;
+    LevelMeter meter;
+    meter.configure(kRate);
+
+    LevelMeter::Reading none = meter.take();
+    assert(none.frames == 0);
+    assert(none.peak == 0.0f && none.rms == 0.0f);
+
+    // Two blocks of 0.5 and one of 0.25 with a 0.9 peak
+    meter.add(0.5f, 0.25f * kBlock, kBlock);
+    meter.add(0.9f, 0.25f * kBlock, kBlock);
+    meter.add(0.25f, 0.0625f * kBlock, kBlock);
+    // Still open: this take() closes it at the next block
+    assert(meter.take().frames == 0);
+    meter.add(0.0f, 0.0f, kBlock);
+    LevelMeter::Reading reading = meter.take();
+    assert(reading.frames == 3 * kBlock);
+    assert(reading.peak == 0.9f);
+    assert(close_enough(reading.rms, std::sqrt((0.25 + 0.25 + 0.0625) / 3.0), 1e-6));
+    assert(reading.peak_hold == 0.9f);
+
+    // With the audio thread stopped, nothing more closes
+    assert(meter.take().frames == 0);
+    assert(meter.take().frames == 0);
+    std::cout << "✓ One reading passed" << std::endl;
+}
+
+void test_spike_between_reads() {
+    std::cout << "Testing a spike between reads..." << std::endl;
+    LevelMeter meter;
+    meter.configure(kRate);
+
+    // The UI reads at 30 Hz, so 6 blocks a read; one spike in the middle.
+    // Each reading holds the blocks between the two reads before it.
+    for (int read = 0; read < 10; ++read) {
+        for (int block = 0; block < 6; ++block) {
+            bool spike = read == 4 && block == 2;
+            meter.add(spike ? 1.0f : 0.01f, 1e-4f * kBlock, kBlock);
+        }
+        LevelMeter::Reading reading = meter.take();
+        if (read == 0) {
+            assert(reading.frames == 0);
+            continue;
+        }
+        assert(reading.frames == 6 * kBlock);
+        if (read == 5) {
+            assert(reading.peak == 1.0f);
+        } else {
+            assert(reading.peak == 0.01f);
+        }
+        // Only the hold remembers it after
+        assert(reading.peak_hold == (read >= 4 ? 1.0f : 0.01f));
+    }
+    std::cout << "✓ Spike between reads passed" << std::endl;
+}
+
+void test_peak_hold() {
+    std::cout << "Testing peak hold..." << std::endl;
+    LevelMeter meter;
+    meter.configure(kRate);
+
+    meter.add(0.5f, 0.0f, kBlock);
+    unsigned int held = kRate * LevelMeter::kHoldMs / 1000;
+    // Quieter blocks up to the end of the hold leave it where it was
+    for (unsigned int frames = kBlock; frames + kBlock < held; frames += kBlock) {
+        meter.add(0.1f, 0.0f, kBlock);
+    }
+    assert(meter.take().peak_hold == 0.5f);
+
+    // Then it falls at kHoldDecayDb a second, down to the signal
+    for (unsigned int frames = 0; frames < kRate / 2; frames += kBlock) {
+        meter.add(0.0f, 0.0f, kBlock);
+    }
+    float fallen = LevelMeter::to_db(meter.take().peak_hold);
+    assert(fallen < LevelMeter::to_db(0.5f) - 0.4f * LevelMeter::kHoldDecayDb);
+    assert(fallen > LevelMeter::to_db(0.5f) - 0.6f * LevelMeter::kHoldDecayDb);
+
+    // A louder peak takes over at once
+    meter.add(0.8f, 0.0f, kBlock);
+    assert(meter.take().peak_hold == 0.8f);
+
+    // configure() drops it
+    meter.configure(kRate);
+    assert(meter.take().peak_hold == 0.0f);
+    std::cout << "✓ Peak hold passed" << std::endl;
+}
+
+void test_to_db() {
+    std::cout << "Testing dB conversion..." << std::endl;
+    assert(LevelMeter::to_db(1.0f) == 0.0f);
+    assert(close_enough(LevelMeter::to_db(0.5f), -6.0206, 1e-3));
+    assert(close_enough(LevelMeter::to_db(0.1f), -20.0, 1e-3));
+    assert(LevelMeter::to_db(0.0f) == LevelMeter::kFloorDb);
+    assert(LevelMeter::to_db(1e-9f) == LevelMeter::kFloorDb);
+    std::cout << "✓ dB conversion passed" << std::endl;
+}
+
+// The audio thread adds blocks while the UI takes readings as fast as it
+// can: every frame is counted once, and the loudest block is seen
+void test_concurrent_reads() {
+    std::cout << "Testing concurrent reads..." << std::endl;
+    LevelMeter meter;
+    meter.configure(kRate);
+
+    const int kBlocks = 200000;
+    std::atomic<bool> done{false};
+    std::thread audio([&] {
+        for (int block = 0; block < kBlocks; ++block) {
+            float peak = block == kBlocks / 2 ? 1.0f : 0.5f;
+            meter.add(peak, 1.0f, kBlock);
+        }
+        done = true;
+    });
+
+    uint64_t frames = 0;
+    double sum_squares = 0.0;
+    float loudest = 0.0f;
+    auto add_reading = [&](const LevelMeter::Reading& reading) {
+        frames += reading.frames;
+        sum_squares += static_cast<double>(reading.rms) * reading.rms * static_cast<double>(reading.frames);
+        loudest = std::max(loudest, reading.peak);
+        if (reading.frames) {
+            assert(reading.peak >= 0.5f);
+        }
+    };
+    int readings = 0;
+    while (!done.load()) {
+        add_reading(meter.take());
+        ++readings;
+    }
+    audio.join();
+    // Close the last window
+    add_reading(meter.take());
+    meter.add(0.0f, 0.0f, 0);
+    add_reading(meter.take());
+
+    assert(frames == static_cast<uint64_t>(kBlocks) * kBlock);
+    assert(close_enough(sum_squares, kBlocks, kBlocks * 1e-4));
+    assert(loudest == 1.0f);
+    std::cout << "  " << readings << " readings" << std::endl;
+    std::cout << "✓ Concurrent reads passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running level meter tests..." << std::endl;
+
+    test_single_reading();
+    test_spike_between_reads();
+    test_peak_hold();
+    test_to_db();
+    test_concurrent_reads();
+
+    std::cout << "Level meter tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,109 @@
+#include "../../src/core/message_formatter.h"
+#include "../../src/core/chat_history.h"
+#include "../alloc_counter.h"
+#include <iostream>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <string_view>
+
+// What the chat window used to build for each message
+static std::string reference(std::time_t time, const std::string& sender, const std::string& text, bool is_self) {
+    std::tm tm = *std::localtime(&time);
+    char time_str[16];
+    std::strftime(time_str, sizeof(time_str), "[%H:%M:%S] ", &tm);
+    return std::string(time_str) + (is_self ? "You" : sender) + ": " + text + "\n";
+}
+
+// Lines match the strftime() format whichever way time moves: within a
+// second, a minute, across minutes and hours, and backwards
+static void test_format() {
+    MessageFormatter formatter;
+    std::time_t start = 1767225600;  // 2026-01-01 00:00:00 UTC
+    std::time_t steps[] = { 0, 0, 1, 59, 60, 61, 119, 3599, 3600, 3601, 30, -86400, 86400 * 180, 7 };
+    for (std::time_t step : steps) {
+        std::time_t time = start + step;
+        assert(formatter.format(time, "alice", "hello", false) == reference(time, "alice", "hello", false));
+    }
+    for (std::time_t time = start; time < start + 7200; time += 13) {
+        assert(formatter.format(time, "bob", "", false) == reference(time, "bob", "", false));
+    }
+    assert(formatter.format(start, "ignored", "mine", true) == reference(start, "", "mine", true));
+    std::cout << "Format: OK" << std::endl;
+}
+
+// A line stays valid until the next one is formatted
+static void test_reuse() {
+    MessageFormatter formatter;
+    std::string_view first = formatter.format(0, "a", "short", false);
+    std::string copy(first);
+    std::string_view second = formatter.format(0, "a", std::string(1000, 'x'), false);
+    assert(second.size() == copy.size() - 5 + 1000);
+    assert(formatter.format(0, "a", "short", false) == copy);
+    std::cout << "Reuse: OK" << std::endl;
+}
+
+// Once warmed up with the longest message, a burst of messages over
+// several hours formats without a single allocation
+static void test_steady_state_allocations() {
+    MessageFormatter formatter;
+    std::string long_text(400, 'x');
+    std::time_t start = std::time(nullptr);
+    formatter.format(start, "someone", long_text, false);
+
+    const std::string senders[] = { "alice", "bob", "a-much-longer-nickname" };
+    const std::string texts[] = { "hi", "how is everyone doing today?", long_text };
+    size_t bytes = 0;
+    uint64_t allocations = 0;
+    {
+        CountAllocations counting(allocations);
+        for (size_t i = 0; i < 200000; ++i) {
+            std::time_t time = start + static_cast<std::time_t>(i / 20);  // 20 messages a second
+            bytes += formatter.format(time, senders[i % 3], texts[i % 3], i % 5 == 0).size();
+        }
+    }
+    assert(bytes > 0);
+    assert(allocations == 0);
+    std::cout << "Steady state allocations: OK (0 over 200000 messages)" << std::endl;
+}
+
+// Into the chat history, allocations come only as chunks start and seal
+static void test_history_allocations() {
+    ChatHistory::Options options;
+    options.chunk_messages = 256;
+    options.resident_chunks = 1000;
+    ChatHistory history(options);
+    MessageFormatter formatter;
+    std::time_t start = std::time(nullptr);
+    // The first chunks size the ones after
+    for (size_t i = 0; i < 4 * options.chunk_messages; ++i) {
+        history.append(formatter.format(start, "alice", "warming up the history", false));
+    }
+
+    constexpr size_t kChunks = 200;
+    uint64_t allocations = 0;
+    {
+        CountAllocations counting(allocations);
+        for (size_t i = 0; i < kChunks * options.chunk_messages; ++i) {
+            history.append(formatter.format(start + static_cast<std::time_t>(i / 20), "alice",
+                                            i % 2 ? "warming up the history" : "ok", false));
+        }
+    }
+    // A reserve and a shrink per chunk, plus the chunk list growing
+    assert(allocations <= 3 * kChunks);
+    std::cout << "History allocations: OK (" << allocations << " over " << kChunks << " chunks)" << std::endl;
+}
+
+int main() {
+    std::cout << "Running message formatter tests..." << std::endl;
+
+    test_format();
+    test_reuse();
+    test_steady_state_allocations();
+    test_history_allocations();
+
+    std::cout << "Message formatter tests completed" << std::endl;
+    return 0;
+}
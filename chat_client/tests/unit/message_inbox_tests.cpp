@@ -0,0 +1,236 @@
+#include "../../src/core/message_inbox.h"
+#include "../../src/utils/mpsc_queue.h"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+// Stands in for the FLTK thread: wake() queues the handler like Fl::awake
+// and run() calls the queued handlers on its own thread
+class FakeUiThread {
+public:
+    explicit FakeUiThread(bool start = true) {
+        if (start) {
+            resume();
+        }
+    }
+
+    ~FakeUiThread() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        ready_.notify_one();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    MessageInbox::Wake waker() {
+        return [this](void (*handler)(void*), void* data) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            handlers_.emplace_back(handler, data);
+            ready_.notify_one();
+            return true;
+        };
+    }
+
+    void resume() {
+        thread_ = std::thread([this] { run(); });
+    }
+
+    size_t handlers_run() const { return handlers_run_.load(); }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            ready_.wait(lock, [this] { return stopping_ || !handlers_.empty(); });
+            if (handlers_.empty()) {
+                return;
+            }
+            auto handler = handlers_.front();
+            handlers_.pop_front();
+            lock.unlock();
+            handler.first(handler.second);
+            handlers_run_.fetch_add(1);
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::pair<void (*)(void*), void*>> handlers_;
+    bool stopping_ = false;
+    std::atomic<size_t> handlers_run_{0};
+    std::thread thread_;
+};
+
+static ChatMessage make_message(int producer, int sequence) {
+    ChatMessage message;
+    message.sender = "producer" + std::to_string(producer);
+    message.text = std::to_string(sequence);
+    return message;
+}
+
+// FIFO order, rejection when full and reuse of slots across many laps
+static void test_mpsc_queue_basics() {
+    MpscQueue<int> queue(5);
+    assert(queue.capacity() == 8);
+    for (int i = 0; i < 8; ++i) {
+        int value = i;
+        assert(queue.try_push(std::move(value)));
+    }
+    int extra = 99;
+    assert(!queue.try_push(std::move(extra)));
+    assert(queue.size() == 8);
+
+    int value = -1;
+    for (int lap = 0; lap < 100; ++lap) {
+        for (int i = 0; i < 8; ++i) {
+            assert(queue.try_pop(value) && value == lap * 8 + i);
+            int next = (lap + 1) * 8 + i;
+            assert(queue.try_push(std::move(next)));
+        }
+    }
+    assert(queue.size() == 8);
+    while (queue.try_pop(value)) {
+    }
+    assert(queue.empty());
+    std::cout << "MPSC queue basics: OK" << std::endl;
+}
+
+// Four threads post 100k messages over one second to a UI thread whose
+// appends and redraws cost time. Nothing is lost or reordered per
+// producer, and the messages arrive in far fewer batches than messages.
+static void test_stress_coalescing() {
+    constexpr int kProducers = 4;
+    constexpr int kPerProducer = 25000;
+    constexpr int kTotal = kProducers * kPerProducer;
+    constexpr int kPerMillisecond = 25; // Per producer: 100k msg/s in all
+
+    std::vector<int> next_expected(kProducers, 0);
+    size_t largest_batch = 0;
+    bool in_order = true;
+    FakeUiThread ui;
+    MessageInbox inbox(8192, [&](std::vector<ChatMessage>& batch) {
+        for (const ChatMessage& message : batch) {
+            int producer = message.sender.back() - '0';
+            in_order &= std::stoi(message.text) == next_expected[producer]++;
+        }
+        largest_batch = std::max(largest_batch, batch.size());
+        // One append and redraw of the chat window
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }, ui.waker());
+
+    auto start = Clock::now();
+    std::vector<std::thread> producers;
+    for (int p = 0; p < kProducers; ++p) {
+        producers.emplace_back([&inbox, p, start] {
+            for (int i = 0; i < kPerProducer; ++i) {
+                if (i % kPerMillisecond == 0) {
+                    std::this_thread::sleep_until(start + std::chrono::milliseconds(i / kPerMillisecond));
+                }
+                while (!inbox.post(make_message(p, i))) {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    double post_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    while (inbox.get_stats().delivered < static_cast<uint64_t>(kTotal)
+           && Clock::now() - start < std::chrono::seconds(10)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    MessageInbox::Stats stats = inbox.get_stats();
+    assert(stats.delivered == static_cast<uint64_t>(kTotal));
+    assert(stats.posted == static_cast<uint64_t>(kTotal));
+    assert(stats.dropped == 0 && stats.depth == 0);
+    assert(in_order);
+    // Coalesced: at most one outstanding wake, and many messages per drain
+    assert(stats.drains <= stats.wakes && stats.wakes <= ui.handlers_run() + 1);
+    assert(stats.drains * 10 < static_cast<uint64_t>(kTotal));
+    std::cout << "Stress coalescing: OK (" << kTotal << " messages from " << kProducers << " threads in "
+              << post_seconds << " s, " << stats.drains << " drains, largest batch " << largest_batch
+              << ", high water " << stats.high_water << ")" << std::endl;
+}
+
+// A stalled UI thread makes post() fail and count drops rather than block
+// or grow; once it catches up the backlog arrives as a single batch
+static void test_back_pressure() {
+    FakeUiThread ui(false);
+    size_t batches = 0;
+    size_t received = 0;
+    MessageInbox inbox(1024, [&](std::vector<ChatMessage>& batch) {
+        ++batches;
+        received += batch.size();
+    }, ui.waker());
+
+    std::atomic<int> rejected{0};
+    std::vector<std::thread> producers;
+    for (int p = 0; p < 4; ++p) {
+        producers.emplace_back([&inbox, &rejected, p] {
+            for (int i = 0; i < 2500; ++i) {
+                if (!inbox.post(make_message(p, i))) {
+                    rejected.fetch_add(1);
+                }
+            }
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+
+    MessageInbox::Stats stats = inbox.get_stats();
+    assert(stats.posted == 1024 && stats.depth == 1024 && stats.high_water == 1024);
+    assert(stats.dropped == 10000 - 1024 && stats.dropped == static_cast<uint64_t>(rejected.load()));
+    assert(stats.wakes == 1);
+    assert(inbox.pressure() == 1.0f);
+
+    ui.resume();
+    while (inbox.get_stats().delivered < 1024) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(batches == 1 && received == 1024);
+    assert(inbox.pressure() == 0.0f);
+    std::cout << "Back pressure: OK (" << stats.dropped << " dropped)" << std::endl;
+}
+
+// A wake that cannot be scheduled is retried by the next post
+static void test_failed_wake() {
+    int attempts = 0;
+    MessageInbox inbox(16, nullptr, [&](void (*)(void*), void*) { return ++attempts > 1; });
+    inbox.post(make_message(0, 0));
+    assert(attempts == 1);
+    inbox.post(make_message(0, 1));
+    assert(attempts == 2);
+    inbox.post(make_message(0, 2));
+    assert(attempts == 2); // Drain now pending
+    assert(inbox.drain() == 3);
+    std::cout << "Failed wake: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running message inbox tests..." << std::endl;
+
+    test_mpsc_queue_basics();
+    test_stress_coalescing();
+    test_back_pressure();
+    test_failed_wake();
+
+    std::cout << "Message inbox tests completed" << std::endl;
+    return 0;
+}
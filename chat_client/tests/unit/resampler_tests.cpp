@@ -0,0 +1,152 @@
+#include "../../src/dsp/resampler.h"
+#include "../../src/audio/audio_engine.h"
+#include "../../src/audio/capture_consumer.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+static const Resampler::Quality kQualities[] = {
+    Resampler::Quality::LINEAR, Resampler::Quality::SINC, Resampler::Quality::POLYPHASE
+};
+
+static std::vector<float> sine(unsigned rate, double frequency, size_t frames) {
+    std::vector<float> samples(frames);
+    for (size_t i = 0; i < frames; ++i) {
+        samples[i] = static_cast<float>(0.5 * std::sin(2.0 * 3.14159265358979 * frequency * i / rate));
+    }
+    return samples;
+}
+
+static std::vector<float> convert(Resampler& resampler, const std::vector<float>& input, size_t chunk) {
+    std::vector<float> output(resampler.max_output_frames(input.size()));
+    size_t produced = 0;
+    for (size_t offset = 0; offset < input.size(); offset += chunk) {
+        size_t frames = std::min(chunk, input.size() - offset);
+        size_t written = resampler.process(input.data() + offset, frames, output.data() + produced);
+        assert(written <= resampler.max_output_frames(frames));
+        produced += written;
+    }
+    output.resize(produced);
+    return output;
+}
+
+// Output must not depend on how the input stream is chopped up, and the
+// number of output frames must track the exact rate ratio.
+static void test_streaming() {
+    const unsigned rates[][2] = { { 48000, 16000 }, { 44100, 48000 }, { 16000, 48000 }, { 48000, 8000 } };
+    for (auto quality : kQualities) {
+        for (const auto& rate : rates) {
+            std::vector<float> input = sine(rate[0], 440.0, rate[0]);
+
+            Resampler whole(rate[0], rate[1], quality);
+            std::vector<float> reference = convert(whole, input, input.size());
+            for (size_t chunk : { 1, 7, 64, 441 }) {
+                Resampler pieces(rate[0], rate[1], quality, 100);
+                assert(convert(pieces, input, chunk) == reference);
+            }
+
+            // One second in, one second out, less the filter's look-ahead
+            size_t look_ahead = quality == Resampler::Quality::LINEAR ? 1 : Resampler::kTaps / 2;
+            size_t expected = rate[1] - look_ahead * rate[1] / rate[0];
+            assert(reference.size() + 2 >= expected && reference.size() <= rate[1]);
+        }
+    }
+    std::cout << "Streaming conversion is chunk-independent: OK" << std::endl;
+}
+
+// DC passes at unity gain and a tone keeps its amplitude and timing.
+static void test_accuracy() {
+    Resampler dc(44100, 48000);
+    std::vector<float> ones(4410, 1.0f);
+    std::vector<float> out = convert(dc, ones, 256);
+    for (size_t i = Resampler::kTaps; i < out.size(); ++i) {
+        assert(std::fabs(out[i] - 1.0f) < 1e-5f);
+    }
+
+    Resampler tone(44100, 48000);
+    std::vector<float> input = sine(44100, 1000.0, 44100);
+    out = convert(tone, input, 256);
+    double error = 0.0;
+    double signal = 0.0;
+    for (size_t k = 4800; k < out.size() - 4800; ++k) {
+        double expected = 0.5 * std::sin(2.0 * 3.14159265358979 * 1000.0 * k / 48000.0);
+        error += (out[k] - expected) * (out[k] - expected);
+        signal += expected * expected;
+    }
+    assert(10.0 * std::log10(signal / error) > 60.0);
+    std::cout << "Unity DC gain and tone accuracy: OK" << std::endl;
+}
+
+// Two consumers at 16 kHz share one conversion; an 8 kHz consumer gets its
+// own and a consumer at the device rate gets the device's blocks.
+static void test_engine_consumers() {
+    AudioEngine engine;
+    AudioEngine::BackendOptions options;
+    options.pacing = AudioEngine::BackendOptions::Pacing::FREERUN;
+    options.max_frames = 48000;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE, options));
+
+    struct Received {
+        std::atomic<uint64_t> frames{0};
+        std::atomic<unsigned> rate{0};
+    };
+    Received received[4];
+    auto handler = [](Received& r) {
+        return [&r](const AudioBlock& block) {
+            r.frames += block.frames;
+            r.rate = block.sample_rate;
+        };
+    };
+    // Free-running delivers the whole second at once; size the rings for it
+    CaptureConsumer whisper_a("16k-a", handler(received[0]), 256);
+    CaptureConsumer whisper_b("16k-b", handler(received[1]), 256);
+    CaptureConsumer narrow("8k", handler(received[2]), 256);
+    CaptureConsumer native("native", handler(received[3]), 256);
+    CaptureConsumer* consumers[] = { &whisper_a, &whisper_b, &narrow, &native };
+    for (CaptureConsumer* consumer : consumers) {
+        consumer->start();
+    }
+    assert(engine.add_capture_consumer(&whisper_a, 16000));
+    assert(engine.add_capture_consumer(&whisper_b, 16000));
+    assert(engine.add_capture_consumer(&narrow, 8000));
+    assert(engine.add_capture_consumer(&native, 48000));
+
+    assert(engine.open_device(0));                  // Native rate
+    assert(engine.get_sample_rate() == 48000);
+    assert(engine.get_stats().rate_converters == 2); // 48 kHz needs none
+    engine.start_stream();
+    while (engine.is_stream_active()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    engine.stop_stream();
+
+    for (CaptureConsumer* consumer : consumers) {
+        engine.remove_capture_consumer(consumer);
+        consumer->stop();
+        assert(consumer->overruns() == 0);
+    }
+    assert(engine.get_stats().rate_converters == 0);
+
+    assert(received[0].rate == 16000 && received[1].rate == 16000);
+    assert(received[2].rate == 8000 && received[3].rate == 48000);
+    assert(received[0].frames == received[1].frames);
+    assert(received[0].frames > 15900 && received[0].frames <= 16000);
+    assert(received[2].frames > 7900 && received[2].frames <= 8000);
+    assert(received[3].frames == 48000);
+    std::cout << "Per-rate shared conversion for capture consumers: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running resampler tests..." << std::endl;
+
+    test_streaming();
+    test_accuracy();
+    test_engine_consumers();
+
+    std::cout << "Resampler tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include "../../src/utils/spsc_ring_buffer.h"
+#include "../../src/audio/capture_consumer.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+static void test_basic_ordering() {
+    SpscRingBuffer<int> ring(5);
+    assert(ring.capacity() == 8);
+    assert(ring.empty());
+
+    for (int i = 0; i < 8; ++i) {
+        assert(ring.try_push(i));
+    }
+    assert(!ring.try_push(8)); // Full
+
+    int value = -1;
+    for (int i = 0; i < 8; ++i) {
+        assert(ring.try_pop(value));
+        assert(value == i);
+    }
+    assert(!ring.try_pop(value));
+    std::cout << "Basic ordering: OK" << std::endl;
+}
+
+// Lossless transfer: the producer retries until there is room.
+static void test_lossless_transfer() {
+    constexpr uint64_t kItems = 2000000;
+    SpscRingBuffer<uint64_t> ring(1024);
+
+    std::thread producer([&ring] {
+        for (uint64_t i = 0; i < kItems; ++i) {
+            while (!ring.try_push(i)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint64_t expected = 0;
+    uint64_t value = 0;
+    while (expected < kItems) {
+        if (ring.try_pop(value)) {
+            assert(value == expected);
+            ++expected;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+    producer.join();
+    std::cout << "Lossless transfer of " << kItems << " items: OK" << std::endl;
+}
+
+// Real-time style transfer: the producer never waits, so a slow consumer
+// shows up as counted overruns and sequence gaps instead of stalls.
+static void test_capture_overruns() {
+    constexpr uint64_t kBlocks = 2000000;
+    constexpr unsigned kFrames = 64;
+
+    std::vector<float> samples(kFrames);
+    for (unsigned i = 0; i < kFrames; ++i) {
+        samples[i] = static_cast<float>(i) / kFrames;
+    }
+
+    uint64_t received = 0;
+    uint64_t gaps = 0;
+    uint64_t last_sequence = 0;
+    bool corrupt = false;
+
+    CaptureConsumer consumer("test", [&](const AudioBlock& block) {
+        if (received > 0 && block.sequence != last_sequence + 1) {
+            gaps += block.sequence - last_sequence - 1;
+        } else if (received == 0) {
+            gaps += block.sequence;
+        }
+        if (block.frames != kFrames || block.samples[kFrames - 1] != samples[kFrames - 1]) {
+            corrupt = true;
+        }
+        last_sequence = block.sequence;
+        ++received;
+    }, 256);
+    consumer.start();
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < kBlocks; ++i) {
+        consumer.publish(samples.data(), kFrames, 48000, 0.5f, 0.25f);
+    }
+    auto end = std::chrono::steady_clock::now();
+    consumer.stop();
+
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    std::cout << "Pushed " << kBlocks << " blocks: " << consumer.published() << " published, "
+              << consumer.overruns() << " overruns, "
+              << elapsed.count() / kBlocks << " ns/block" << std::endl;
+
+    assert(!corrupt);
+    assert(consumer.published() + consumer.overruns() == kBlocks);
+    assert(consumer.delivered() == consumer.published());
+    assert(received == consumer.published());
+    assert(gaps + (kBlocks - 1 - last_sequence) == consumer.overruns());
+    std::cout << "Capture overrun accounting: OK" << std::endl;
+}
+
+// Callbacks larger than a block are split without losing frames.
+static void test_large_callback_split() {
+    constexpr unsigned kFrames = AudioBlock::kMaxFrames * 2 + 100;
+    std::vector<float> samples(kFrames, 1.0f);
+    unsigned frames = 0;
+
+    CaptureConsumer consumer("split", [&](const AudioBlock& block) {
+        frames += block.frames;
+    });
+    consumer.start();
+    assert(consumer.publish(samples.data(), kFrames, 48000, 0.0f, 0.0f));
+    consumer.stop();
+
+    assert(consumer.published() == 3);
+    assert(frames == kFrames);
+    std::cout << "Large callback split: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running ring buffer tests..." << std::endl;
+
+    test_basic_ordering();
+    test_lossless_transfer();
+    test_capture_overruns();
+    test_large_callback_split();
+
+    std::cout << "Ring buffer tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,186 @@
+#include "../../src/audio/audio_engine.h"
+#include "../../src/audio/capture_consumer.h"
+#include "../../src/dsp/voice_processor.h"
+#include "../../src/utils/rt_alloc_trap.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Writes a constant to the left channel and counts its own destruction, so
+// tests can see which graph ran and when it was reclaimed.
+class MarkerProcessor : public AudioProcessor {
+public:
+    MarkerProcessor(float value, std::shared_ptr<std::atomic<int>> destroyed)
+        : value_(value), destroyed_(std::move(destroyed)) {}
+    ~MarkerProcessor() override { destroyed_->fetch_add(1); }
+
+    void process(const float*, float* output, unsigned int frames) override {
+        for (unsigned int i = 0; i < frames; ++i) {
+            output[2 * i] = value_;
+        }
+    }
+
+private:
+    float value_;
+    std::shared_ptr<std::atomic<int>> destroyed_;
+};
+
+static std::unique_ptr<ProcessorGraph> marker_graph(float value, std::shared_ptr<std::atomic<int>> destroyed) {
+    auto graph = std::make_unique<ProcessorGraph>();
+    graph->add(std::make_unique<MarkerProcessor>(value, std::move(destroyed)));
+    return graph;
+}
+
+static AudioEngine::BackendOptions freerun(uint64_t max_frames) {
+    AudioEngine::BackendOptions options;
+    options.pacing = AudioEngine::BackendOptions::Pacing::FREERUN;
+    options.max_frames = max_frames;
+    return options;
+}
+
+static void wait_until_finished(AudioEngine& engine) {
+    while (engine.is_stream_active()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// A multi-stage graph, a capture consumer and the level callback running
+// through the null backend must not touch the heap on the audio thread.
+static void test_no_allocations_on_audio_thread() {
+    rt_alloc_trap_set_action(RtAllocAction::COUNT);
+    uint64_t before = rt_alloc_violations();
+
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE, freerun(48000 * 20)));
+
+    std::vector<float> history(64); // Captured by reference, sized up front
+    auto graph = std::make_unique<ProcessorGraph>();
+    graph->add([](const float* input, float* output, unsigned int frames) {
+        for (unsigned int i = 0; i < frames; ++i) {
+            output[2 * i] = output[2 * i + 1] = input[i] * 0.5f;
+        }
+    });
+    graph->add([&history](const float*, float* output, unsigned int frames) {
+        history[frames % history.size()] = output[0];
+    });
+    engine.set_processor_graph(std::move(graph));
+
+    std::atomic<uint64_t> captured{0};
+    CaptureConsumer consumer("rt-safety", [&captured](const AudioBlock& block) {
+        captured += block.frames;
+    });
+    // A consumer at another rate puts the resampler on the audio thread too
+    CaptureConsumer speech("rt-safety-16k", [&captured](const AudioBlock& block) {
+        captured += block.frames;
+    });
+    consumer.start();
+    speech.start();
+    engine.add_capture_consumer(&consumer);
+    engine.add_capture_consumer(&speech, 16000);
+    engine.set_level_callback([](float, float) {});
+    // The whole voice chain runs on the audio thread as well
+    for (size_t stage = 0; stage < VoiceProcessor::kStageCount; ++stage) {
+        engine.voice_processor().set_enabled(static_cast<VoiceProcessor::Stage>(stage), true);
+    }
+    // and the gate, which on the null device's silence keeps the pre-roll
+    // and sends dtx blocks
+    AudioEngine::GatingOptions gating;
+    gating.enabled = true;
+    engine.set_capture_gating(gating);
+
+    assert(engine.open_device(0, 48000));
+    engine.start_stream();
+    wait_until_finished(engine);
+    engine.stop_stream();
+    engine.remove_capture_consumer(&consumer);
+    engine.remove_capture_consumer(&speech);
+    consumer.stop();
+    speech.stop();
+
+    assert(engine.get_stats().callbacks > 0);
+    assert(engine.voice_processor().stage_stats(VoiceProcessor::Stage::ECHO_CANCELLATION).hops > 0);
+    assert(engine.get_gating_stats().silence_events > 0);
+    assert(rt_alloc_violations() == before);
+    std::cout << "No allocations on the audio thread: OK (" << engine.get_stats().callbacks
+              << " callbacks)" << std::endl;
+}
+
+// The trap itself must fire when a callback allocates.
+static void test_trap_detects_allocation() {
+    rt_alloc_trap_set_action(RtAllocAction::COUNT);
+    uint64_t before = rt_alloc_violations();
+
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE, freerun(256 * 4)));
+    engine.set_audio_callback([](const float*, float*, unsigned int) {
+        void* volatile block = std::malloc(64);
+        std::free(block);
+    });
+    assert(engine.open_device(0, 48000));
+    engine.start_stream();
+    wait_until_finished(engine);
+    engine.stop_stream();
+
+    // One malloc and one free per callback
+    assert(rt_alloc_violations() - before == 8);
+    rt_alloc_trap_set_action(RtAllocAction::ABORT);
+    std::cout << "Allocation in a callback is trapped: OK" << std::endl;
+}
+
+// Swap graphs while the stream runs. Every block must come from exactly one
+// graph, and every retired graph must be destroyed once the stream stops.
+static void test_swap_while_running() {
+    AudioEngine engine;
+    assert(engine.initialize(AudioEngine::Backend::NULL_DEVICE, freerun(0)));
+
+    auto destroyed = std::make_shared<std::atomic<int>>(0);
+    std::atomic<int> torn_blocks{0};
+    std::atomic<uint64_t> blocks{0};
+    engine.set_processor_graph(marker_graph(1.0f, destroyed));
+    assert(engine.open_device(0, 48000));
+
+    constexpr int kSwaps = 2000;
+    engine.start_stream();
+    for (int swap = 0; swap < kSwaps; ++swap) {
+        // A trailing stage checks that the whole block saw one marker value
+        auto graph = marker_graph(static_cast<float>(swap + 2), destroyed);
+        graph->add([&torn_blocks, &blocks](const float*, float* output, unsigned int frames) {
+            for (unsigned int i = 1; i < frames; ++i) {
+                if (output[2 * i] != output[0]) {
+                    torn_blocks++;
+                    break;
+                }
+            }
+            blocks++;
+        });
+        engine.set_processor_graph(std::move(graph));
+        if (swap % 16 == 0) {
+            std::this_thread::yield();
+        }
+    }
+    engine.stop_stream();
+
+    assert(torn_blocks == 0);
+    assert(*destroyed == kSwaps); // All but the last graph
+    engine.set_audio_callback(nullptr);
+    assert(*destroyed == kSwaps + 1);
+    std::cout << "Graph swaps while running: OK (" << kSwaps << " swaps, " << blocks
+              << " checked blocks)" << std::endl;
+}
+
+int main() {
+    std::cout << "Running real-time safety tests..." << std::endl;
+
+    assert(rt_alloc_trap_enabled());
+    test_no_allocations_on_audio_thread();
+    test_trap_detects_allocation();
+    test_swap_while_running();
+
+    std::cout << "Real-time safety tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,492 @@
+#include "../../src/network/rtsp_server.h"
+#include "../../src/network/event_loop.h"
+#include "../../src/audio/codec_pipeline.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+constexpr double kPi = 3.14159265358979323846;
+
+struct Response {
+    int status = 0;
+    std::map<std::string, std::string> headers;
+    std::string body;
+};
+
+// A blocking RTSP client on 127.0.0.1. Interleaved frames that arrive
+// ahead of a response are kept in frames.
+class Client {
+public:
+    // A receive_buffer limits the window the server sees
+    explicit Client(uint16_t port, int receive_buffer = 0) {
+        fd_ = socket(AF_INET, SOCK_STREAM, 0);
+        if (receive_buffer) {
+            setsockopt(fd_, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+        }
+        timeval timeout{ 2, 0 };
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(connect(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        url_ = "rtsp://127.0.0.1:" + std::to_string(port);
+    }
+
+    ~Client() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+
+    int fd() const { return fd_; }
+    const std::string& url() const { return url_; }
+
+    void set_timeout_ms(int timeout_ms) {
+        timeval timeout{ timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    void send_raw(const std::string& text) {
+        assert(::send(fd_, text.data(), text.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(text.size()));
+    }
+
+    Response request(const std::string& method, const std::string& url, const std::string& headers = "") {
+        send_raw(method + " " + url + " RTSP/1.0\r\nCSeq: " + std::to_string(++cseq_) + "\r\n"
+                 + (session_.empty() ? "" : "Session: " + session_ + "\r\n") + headers + "\r\n");
+        Response response = read_response();
+        assert(response.headers["cseq"] == std::to_string(cseq_));
+        auto session = response.headers.find("session");
+        if (session != response.headers.end()) {
+            session_ = session->second.substr(0, session->second.find(';'));
+        }
+        return response;
+    }
+
+    Response read_response() {
+        for (;;) {
+            while (take_frame()) {
+            }
+            size_t end = buffer_.find("\r\n\r\n");
+            if (end != std::string::npos && buffer_[0] != '$') {
+                Response response;
+                std::string head = buffer_.substr(0, end + 2);
+                size_t line_end = head.find("\r\n");
+                response.status = std::stoi(head.substr(9, 3));
+                for (size_t at = line_end + 2; at < head.size();) {
+                    size_t next = head.find("\r\n", at);
+                    size_t colon = head.find(':', at);
+                    std::string name = head.substr(at, colon - at);
+                    for (char& c : name) {
+                        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+                    }
+                    response.headers[name] = head.substr(colon + 2, next - colon - 2);
+                    at = next + 2;
+                }
+                size_t length = 0;
+                if (response.headers.count("content-length")) {
+                    length = std::stoul(response.headers["content-length"]);
+                }
+                if (buffer_.size() >= end + 4 + length) {
+                    response.body = buffer_.substr(end + 4, length);
+                    buffer_.erase(0, end + 4 + length);
+                    return response;
+                }
+            }
+            assert(receive());
+        }
+    }
+
+    // Waits for count interleaved frames in all
+    bool read_frames(size_t count) {
+        while (take_frame()) {
+        }
+        while (frames.size() < count) {
+            if (!receive()) {
+                return false;
+            }
+            while (take_frame()) {
+            }
+        }
+        return true;
+    }
+
+    std::vector<std::string> frames;  // Interleaved packets received, channel byte first
+
+private:
+    bool receive() {
+        char chunk[4096];
+        ssize_t received = recv(fd_, chunk, sizeof(chunk), 0);
+        if (received <= 0) {
+            return false;
+        }
+        buffer_.append(chunk, static_cast<size_t>(received));
+        return true;
+    }
+
+    bool take_frame() {
+        if (buffer_.size() < 4 || buffer_[0] != '$') {
+            return false;
+        }
+        size_t length = size_t(uint8_t(buffer_[2])) << 8 | uint8_t(buffer_[3]);
+        if (buffer_.size() < 4 + length) {
+            return false;
+        }
+        frames.push_back(buffer_.substr(1, 1) + buffer_.substr(4, length));
+        buffer_.erase(0, 4 + length);
+        return true;
+    }
+
+    int fd_ = -1;
+    std::string url_;
+    std::string buffer_;
+    std::string session_;
+    int cseq_ = 0;
+};
+
+// A UDP socket for RTP on 127.0.0.1
+class Receiver {
+public:
+    Receiver() {
+        fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+        timeval timeout{ 2, 0 };
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        assert(bind(fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        socklen_t length = sizeof(address);
+        getsockname(fd_, reinterpret_cast<sockaddr*>(&address), &length);
+        port_ = ntohs(address.sin_port);
+    }
+
+    ~Receiver() { close(fd_); }
+
+    uint16_t port() const { return port_; }
+
+    // The next datagram, empty on timeout
+    std::string receive(int timeout_ms = 2000) {
+        timeval timeout{ timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+        setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char packet[2048];
+        ssize_t received = recv(fd_, packet, sizeof(packet), 0);
+        return received > 0 ? std::string(packet, static_cast<size_t>(received)) : std::string();
+    }
+
+private:
+    int fd_ = -1;
+    uint16_t port_ = 0;
+};
+
+// The server on its own loop thread, with the microphone and speaker mounts
+class Fixture {
+public:
+    Fixture() {
+        CodecSettings settings;
+        CodecSettings::preset("high", settings);
+        settings.dtx = false;
+        server = std::make_unique<RtspServer>(loop);
+        mic = server->add_stream("/mic/default", settings);
+        speaker = server->add_stream("/speaker/default", settings);
+        assert(mic && speaker);
+        assert(server->listen("127.0.0.1", 0));
+        port = server->ports()[0];
+        thread = std::thread([this] { loop.run(); });
+    }
+
+    ~Fixture() {
+        loop.stop();
+        thread.join();
+        server.reset();
+    }
+
+    // Encodes frames of a tone through the stream, as the engine would feed it
+    void feed(AudioEncodePipeline* stream, unsigned frames) {
+        auto block = std::make_unique<AudioBlock>();
+        block->sample_rate = stream->sample_rate();
+        block->frames = stream->frame_samples();
+        for (unsigned frame = 0; frame < frames; ++frame) {
+            for (unsigned i = 0; i < block->frames; ++i) {
+                block->samples[i] = 0.3f * static_cast<float>(std::sin(2 * kPi * 440.0 * (phase_++) / block->sample_rate));
+            }
+            block->sequence++;
+            stream->process(*block);
+        }
+    }
+
+    template<typename F>
+    bool wait_for(F condition) {
+        auto deadline = Clock::now() + std::chrono::seconds(2);
+        while (!condition()) {
+            if (Clock::now() > deadline) {
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    }
+
+    EventLoop loop;
+    std::unique_ptr<RtspServer> server;
+    AudioEncodePipeline* mic = nullptr;
+    AudioEncodePipeline* speaker = nullptr;
+    uint16_t port = 0;
+    std::thread thread;
+
+private:
+    uint64_t phase_ = 0;
+};
+
+RtpHeader header_of(const std::string& packet) {
+    RtpHeader header;
+    const uint8_t* payload = nullptr;
+    size_t size = 0;
+    assert(parse_rtp_packet(reinterpret_cast<const uint8_t*>(packet.data()), packet.size(), header, payload, size));
+    return header;
+}
+
+std::string setup_udp(Client& client, const std::string& path, const Receiver& receiver) {
+    Response response = client.request("SETUP", client.url() + path + "/trackID=0",
+                                       "Transport: RTP/AVP;unicast;client_port=" + std::to_string(receiver.port())
+                                       + "-" + std::to_string(receiver.port() + 1) + "\r\n");
+    assert(response.status == 200);
+    assert(response.headers["transport"].find("server_port=") != std::string::npos);
+    return response.headers["transport"];
+}
+
+} // namespace
+
+static void test_describe() {
+    {
+        EventLoop loop;
+        RtspServer server(loop);
+        CodecSettings settings;
+        assert(server.add_stream("/mic/default", settings));
+        assert(!server.add_stream("/mic/default/", settings));
+    }
+    Fixture fixture;
+    Client client(fixture.port);
+
+    Response options = client.request("OPTIONS", "*");
+    assert(options.status == 200);
+    assert(options.headers["public"].find("DESCRIBE") != std::string::npos);
+
+    Response describe = client.request("DESCRIBE", client.url() + "/mic/default", "Accept: application/sdp\r\n");
+    assert(describe.status == 200);
+    assert(describe.headers["content-type"] == "application/sdp");
+    assert(describe.headers["content-base"] == client.url() + "/mic/default/");
+    assert(describe.body.find("m=audio 0 RTP/AVP 111 13\r\n") != std::string::npos);
+    assert(describe.body.find("a=rtpmap:111 ") != std::string::npos);
+    assert(describe.body.find("a=rtpmap:13 CN/") != std::string::npos);
+    assert(describe.body.find("a=control:trackID=0") != std::string::npos);
+
+    assert(client.request("DESCRIBE", client.url() + "/camera/default").status == 404);
+    assert(client.request("RECORD", client.url() + "/mic/default").status == 501);
+    assert(client.request("PLAY", client.url() + "/mic/default").status == 454);
+
+    // No CSeq, and a request split across writes
+    client.send_raw("OPTIONS * RTSP/1.0\r\n\r\n");
+    assert(client.read_response().status == 400);
+    client.send_raw("OPTIONS * RTSP/1.0\r\nCSe");
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    client.send_raw("q: 77\r\n\r\n");
+    Response split = client.read_response();
+    assert(split.status == 200 && split.headers["cseq"] == "77");
+    std::cout << "Describe: OK" << std::endl;
+}
+
+// Every UDP subscriber gets the same bytes: one encode, one packetization
+static void test_udp_fan_out() {
+    Fixture fixture;
+    constexpr unsigned kFrames = 10;
+    Client first(fixture.port);
+    Client second(fixture.port);
+    Receiver first_rtp;
+    Receiver second_rtp;
+    std::string transport = setup_udp(first, "/mic/default", first_rtp);
+    setup_udp(second, "/mic/default", second_rtp);
+    assert(first.request("PLAY", first.url() + "/mic/default").status == 200);
+    assert(second.request("PLAY", second.url() + "/mic/default").status == 200);
+    assert(fixture.server->get_stats().playing == 2);
+
+    fixture.feed(fixture.mic, kFrames);
+    std::vector<std::string> packets;
+    for (unsigned i = 0; i < kFrames; ++i) {
+        std::string a = first_rtp.receive();
+        std::string b = second_rtp.receive();
+        assert(!a.empty() && a == b);
+        packets.push_back(a);
+    }
+    char ssrc[9];
+    std::snprintf(ssrc, sizeof(ssrc), "%08X", header_of(packets[0]).ssrc);
+    assert(transport.find(std::string("ssrc=") + ssrc) != std::string::npos);
+    for (unsigned i = 1; i < kFrames; ++i) {
+        assert(uint16_t(header_of(packets[i]).sequence - header_of(packets[i - 1]).sequence) == 1);
+        assert(header_of(packets[i]).payload_type == RtpPacketizer::kAudioPayloadType);
+    }
+
+    // RTP-Info now says where the next packet starts; the speaker stream
+    // has its own
+    Response again = second.request("PLAY", second.url() + "/mic/default");
+    std::string info = again.headers["rtp-info"];
+    RtpHeader last = header_of(packets.back());
+    assert(info.find(";seq=" + std::to_string(uint16_t(last.sequence + 1)) + ";") != std::string::npos);
+
+    // Once torn down the first hears nothing more
+    assert(first.request("TEARDOWN", first.url() + "/mic/default").status == 200);
+    assert(fixture.server->get_stats().playing == 1);
+    fixture.feed(fixture.mic, 2);
+    assert(!second_rtp.receive().empty() && !second_rtp.receive().empty());
+    assert(first_rtp.receive(100).empty());
+
+    RtspServer::Stats stats = fixture.server->get_stats();
+    assert(stats.packets_encoded == kFrames + 2);
+    assert(stats.packets_sent == 2 * kFrames + 2);
+    assert(stats.send_errors == 0);
+    std::cout << "UDP fan-out: OK" << std::endl;
+}
+
+static void test_interleaved() {
+    Fixture fixture;
+    Client client(fixture.port);
+    Response setup = client.request("SETUP", client.url() + "/speaker/default/trackID=0",
+                                    "Transport: RTP/AVP/TCP;unicast;interleaved=4-5\r\n");
+    assert(setup.status == 200);
+    assert(setup.headers["transport"].find("interleaved=4-5") != std::string::npos);
+    // One stream per connection
+    assert(client.request("SETUP", client.url() + "/mic/default/trackID=0",
+                          "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n").status == 459);
+    assert(client.request("PLAY", client.url() + "/speaker/default").status == 200);
+
+    fixture.feed(fixture.speaker, 20);
+    fixture.feed(fixture.mic, 5);  // Not subscribed
+    assert(client.read_frames(20));
+    for (size_t i = 0; i < client.frames.size(); ++i) {
+        assert(client.frames[i][0] == 4);
+        RtpHeader header = header_of(client.frames[i].substr(1));
+        if (i > 0) {
+            assert(uint16_t(header.sequence - header_of(client.frames[i - 1].substr(1)).sequence) == 1);
+        }
+    }
+    // Keep-alives and the teardown are answered between frames
+    assert(client.request("GET_PARAMETER", client.url() + "/speaker/default").status == 200);
+    assert(client.request("TEARDOWN", client.url() + "/speaker/default").status == 200);
+    assert(client.frames.size() == 20);
+    assert(fixture.wait_for([&] { return fixture.server->get_stats().playing == 0; }));
+    std::cout << "Interleaved: OK" << std::endl;
+}
+
+// A TCP subscriber that stops reading neither stalls the others nor gets a
+// torn frame: it skips ahead to live when it resumes
+static void test_slow_subscriber() {
+    Fixture fixture;
+    Client slow(fixture.port, 4096);
+    assert(slow.request("SETUP", slow.url() + "/mic/default",
+                        "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n").status == 200);
+    assert(slow.request("PLAY", slow.url() + "/mic/default").status == 200);
+    Client fast(fixture.port);
+    Receiver fast_rtp;
+    setup_udp(fast, "/mic/default", fast_rtp);
+    assert(fast.request("PLAY", fast.url() + "/mic/default").status == 200);
+
+    const unsigned frames = 8 * RtspServer::kHistoryPackets;
+    for (unsigned i = 0; i < frames; i += 16) {
+        fixture.feed(fixture.mic, 16);
+        for (unsigned j = 0; j < 16; ++j) {
+            assert(!fast_rtp.receive().empty());
+        }
+    }
+    assert(fixture.server->get_stats().packets_skipped > 0);
+
+    // Everything the slow one gets is whole and in order, bar the jump
+    slow.set_timeout_ms(300);
+    while (slow.read_frames(slow.frames.size() + 1)) {
+    }
+    uint16_t previous = header_of(slow.frames[0].substr(1)).sequence;
+    size_t jumps = 0;
+    for (size_t i = 1; i < slow.frames.size(); ++i) {
+        uint16_t sequence = header_of(slow.frames[i].substr(1)).sequence;
+        assert(uint16_t(sequence - previous) >= 1);
+        jumps += uint16_t(sequence - previous) != 1;
+        previous = sequence;
+    }
+    assert(jumps > 0);
+    RtspServer::Stats stats = fixture.server->get_stats();
+    assert(slow.frames.size() + stats.packets_skipped == frames);
+    assert(stats.send_errors == 0);
+    std::cout << "Slow subscriber: OK (" << stats.packets_skipped << " skipped)" << std::endl;
+}
+
+static void test_transport_errors() {
+    Fixture fixture;
+    Client client(fixture.port);
+    assert(client.request("SETUP", client.url() + "/mic/default",
+                          "Transport: RTP/AVP;multicast;client_port=5000-5001\r\n").status == 461);
+    assert(client.request("SETUP", client.url() + "/mic/default", "Transport: RTP/SAVP;unicast\r\n").status == 461);
+    // The first transport that works is taken
+    Response setup = client.request("SETUP", client.url() + "/mic/default",
+                                    "Transport: RTP/SAVP;unicast, RTP/AVP/TCP;unicast;interleaved=2-3\r\n");
+    assert(setup.status == 200 && setup.headers["transport"].find("interleaved=2-3") != std::string::npos);
+
+    Client other(fixture.port);
+    other.request("OPTIONS", "*");
+    // Another connection's session is not ours
+    other.send_raw("PLAY " + other.url() + "/mic/default RTSP/1.0\r\nCSeq: 9\r\nSession: "
+                   + setup.headers["session"].substr(0, setup.headers["session"].find(';')) + "\r\n\r\n");
+    assert(other.read_response().status == 454);
+    std::cout << "Transport errors: OK" << std::endl;
+}
+
+static void test_disconnect() {
+    Fixture fixture;
+    {
+        Client client(fixture.port);
+        Receiver rtp;
+        setup_udp(client, "/mic/default", rtp);
+        assert(client.request("PLAY", client.url() + "/mic/default").status == 200);
+        assert(fixture.server->get_stats().connections == 1);
+    }
+    assert(fixture.wait_for([&] {
+        RtspServer::Stats stats = fixture.server->get_stats();
+        return stats.connections == 0 && stats.playing == 0;
+    }));
+    fixture.feed(fixture.mic, 3);
+    assert(fixture.wait_for([&] { return fixture.server->get_stats().packets_encoded == 3; }));
+    assert(fixture.server->get_stats().packets_sent == 0);
+
+    // Oversized requests end the connection
+    Client flood(fixture.port);
+    flood.send_raw(std::string(RtspServer::kMaxRequestBytes + 1, 'A'));
+    char byte;
+    assert(recv(flood.fd(), &byte, 1, 0) == 0);
+    std::cout << "Disconnect: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running RTSP server tests..." << std::endl;
+
+    test_describe();
+    test_udp_fan_out();
+    test_interleaved();
+    test_slow_subscriber();
+    test_transport_errors();
+    test_disconnect();
+
+    std::cout << "RTSP server tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,330 @@
+#include "../../src/core/search_index.h"
+#include "../../src/core/history_store.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <unistd.h>
+
+static std::vector<uint64_t> seqs(const std::vector<SearchIndex::Hit>& hits) {
+    std::vector<uint64_t> result;
+    for (const SearchIndex::Hit& hit : hits) {
+        result.push_back(hit.seq);
+    }
+    return result;
+}
+
+static std::vector<uint64_t> search(const SearchIndex& index, const std::string& text,
+                                    const std::string& channel = "") {
+    SearchIndex::Query query;
+    query.text = text;
+    query.channel = channel;
+    return seqs(index.search(query));
+}
+
+// Words match whole and case-blind, all of them must appear, and the
+// newest messages come first
+static void test_terms() {
+    SearchIndex index;
+    assert(index.add(1, 1000, "lobby", "Hello world"));
+    assert(index.add(2, 2000, "lobby", "the world is round"));
+    assert(index.add(3, 3000, "dev", "HELLO again, world!"));
+    assert(index.add(4, 4000, "dev", "worldwide hello"));
+
+    assert(search(index, "hello") == std::vector<uint64_t>({ 4, 3, 1 }));
+    assert(search(index, "World") == std::vector<uint64_t>({ 3, 2, 1 }));
+    assert(search(index, "hello world") == std::vector<uint64_t>({ 3, 1 }));
+    assert(search(index, "hello missing").empty());
+    assert(search(index, "").empty());
+
+    SearchIndex::Query query;
+    query.text = "hello";
+    query.limit = 2;
+    assert(seqs(index.search(query)) == std::vector<uint64_t>({ 4, 3 }));
+    std::cout << "Terms: OK" << std::endl;
+}
+
+// A quoted phrase needs its words next to each other and in order
+static void test_phrases() {
+    SearchIndex index;
+    index.add(1, 0, "lobby", "the quick brown fox");
+    index.add(2, 0, "lobby", "brown quick fox");
+    index.add(3, 0, "lobby", "quick, brown, and quick brown again");
+    index.add(4, 0, "lobby", "a quick fox that is brown");
+
+    assert(search(index, "\"quick brown\"") == std::vector<uint64_t>({ 3, 1 }));
+    assert(search(index, "\"brown quick fox\"") == std::vector<uint64_t>({ 2 }));
+    assert(search(index, "\"quick brown\" again") == std::vector<uint64_t>({ 3 }));
+    assert(search(index, "\"quick fox\"") == std::vector<uint64_t>({ 4, 2 }));
+    assert(search(index, "\"fox quick\"").empty());
+    std::cout << "Phrases: OK" << std::endl;
+}
+
+// word* matches every word starting with word
+static void test_prefixes() {
+    SearchIndex index;
+    index.add(1, 0, "lobby", "deploy finished");
+    index.add(2, 0, "lobby", "deployment failed");
+    index.add(3, 0, "lobby", "depot closed");
+    index.add(4, 0, "lobby", "redeploy now");
+
+    assert(search(index, "deploy*") == std::vector<uint64_t>({ 2, 1 }));
+    assert(search(index, "dep*") == std::vector<uint64_t>({ 3, 2, 1 }));
+    assert(search(index, "dep* failed") == std::vector<uint64_t>({ 2 }));
+    assert(search(index, "zzz*").empty());
+    assert(search(index, "de*").empty()); // Too short, so the word "de"
+    std::cout << "Prefixes: OK" << std::endl;
+}
+
+// Channel and time filters narrow the matches
+static void test_filters() {
+    SearchIndex index;
+    for (uint64_t seq = 1; seq <= 1000; ++seq) {
+        index.add(seq, static_cast<int64_t>(seq) * 1000, seq % 2 ? "lobby" : "dev", "build " + std::to_string(seq));
+    }
+    std::vector<uint64_t> dev = search(index, "build", "dev");
+    assert(dev.size() == 100 && dev.front() == 1000 && dev.back() == 802);
+    assert(search(index, "build", "nowhere").empty());
+
+    SearchIndex::Query query;
+    query.text = "build";
+    query.channel = "lobby";
+    query.from_ms = 100 * 1000;
+    query.to_ms = 110 * 1000;
+    assert(seqs(index.search(query)) == std::vector<uint64_t>({ 109, 107, 105, 103, 101 }));
+
+    // A channel alone lists its newest messages
+    query.text.clear();
+    query.from_ms = INT64_MIN;
+    query.to_ms = INT64_MAX;
+    query.limit = 3;
+    assert(seqs(index.search(query)) == std::vector<uint64_t>({ 999, 997, 995 }));
+    std::cout << "Filters: OK" << std::endl;
+}
+
+// Only the next message in sequence is taken
+static void test_sequence_order() {
+    SearchIndex index(10);
+    assert(!index.add(9, 0, "lobby", "early"));
+    assert(index.add(10, 0, "lobby", "first"));
+    assert(!index.add(12, 0, "lobby", "skipped"));
+    assert(index.add(11, 0, "lobby", "second"));
+    SearchIndex::Stats stats = index.get_stats();
+    assert(stats.messages == 2 && stats.next_seq == 12 && stats.ignored == 2);
+    assert(search(index, "second") == std::vector<uint64_t>({ 11 }));
+    std::cout << "Sequence order: OK" << std::endl;
+}
+
+// Many messages across many postings blocks give the same answers as
+// scanning every message
+static void test_against_scan() {
+    const char* words[] = { "alpha", "beta", "gamma", "delta", "epsilon", "zeta", "eta", "theta",
+                            "iota", "kappa", "lambda", "mu", "nu", "xi", "omicron", "pi" };
+    constexpr size_t kWords = sizeof(words) / sizeof(words[0]);
+    constexpr uint64_t kMessages = 20000;
+    std::vector<std::vector<size_t>> messages;
+    SearchIndex index;
+    uint32_t state = 12345;
+    auto next = [&state] {
+        state = state * 1103515245u + 12345u;
+        return state >> 8;
+    };
+    for (uint64_t seq = 1; seq <= kMessages; ++seq) {
+        std::vector<size_t> message;
+        std::string text;
+        size_t length = 1 + next() % 6;
+        for (size_t i = 0; i < length; ++i) {
+            // Skewed so some words are common and some rare
+            size_t word = (next() % kWords) * (next() % kWords) / kWords;
+            message.push_back(word);
+            text += words[word];
+            text += ' ';
+        }
+        messages.push_back(message);
+        index.add(seq, static_cast<int64_t>(seq), seq % 3 ? "lobby" : "dev", text);
+    }
+
+    auto contains = [](const std::vector<size_t>& message, size_t word) {
+        for (size_t w : message) {
+            if (w == word) {
+                return true;
+            }
+        }
+        return false;
+    };
+    auto adjacent = [](const std::vector<size_t>& message, size_t a, size_t b) {
+        for (size_t i = 0; i + 1 < message.size(); ++i) {
+            if (message[i] == a && message[i + 1] == b) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    for (size_t a = 0; a < kWords; a += 3) {
+        for (size_t b = 1; b < kWords; b += 4) {
+            std::vector<uint64_t> both;
+            std::vector<uint64_t> phrase;
+            for (uint64_t seq = kMessages; seq >= 1; --seq) {
+                const std::vector<size_t>& message = messages[seq - 1];
+                if (seq % 3 == 0 && contains(message, a) && contains(message, b)) {
+                    both.push_back(seq);
+                }
+                if (adjacent(message, a, b)) {
+                    phrase.push_back(seq);
+                }
+            }
+            SearchIndex::Query query;
+            query.text = std::string(words[a]) + " " + words[b];
+            query.channel = "dev";
+            query.limit = SIZE_MAX;
+            assert(seqs(index.search(query)) == both);
+            query.text = "\"" + std::string(words[a]) + " " + words[b] + "\"";
+            query.channel.clear();
+            assert(seqs(index.search(query)) == phrase);
+        }
+    }
+    SearchIndex::Stats stats = index.get_stats();
+    std::cout << "Against scan: OK (" << stats.postings << " postings in " << stats.posting_bytes
+              << " bytes)" << std::endl;
+}
+
+// Prefixes over many words and merge windows give the same answers as
+// scanning every message, alone and joined with a word
+static void test_prefix_against_scan() {
+    constexpr uint64_t kMessages = 50000;
+    std::vector<std::vector<size_t>> messages;
+    SearchIndex index;
+    uint32_t state = 54321;
+    auto next = [&state] {
+        state = state * 1103515245u + 12345u;
+        return state >> 8;
+    };
+    // word0 .. word299; "word1*" is word1, word10-word19 and word100-word199
+    auto name = [](size_t word) { return "word" + std::to_string(word); };
+    for (uint64_t seq = 1; seq <= kMessages; ++seq) {
+        std::vector<size_t> message;
+        std::string text;
+        size_t length = 1 + next() % 4;
+        for (size_t i = 0; i < length; ++i) {
+            // Skewed so the prefix is dense in places and sparse in others
+            size_t word = (next() % 300) * (next() % 300) / 300;
+            if (seq > 20000 && seq < 35000 && word >= 100 && word < 200) {
+                word += 100;
+            }
+            message.push_back(word);
+            text += name(word);
+            text += ' ';
+        }
+        messages.push_back(message);
+        index.add(seq, static_cast<int64_t>(seq), "lobby", text);
+    }
+
+    auto starts = [&name](size_t word, const std::string& prefix) { return name(word).compare(0, prefix.size(), prefix) == 0; };
+    for (const char* prefix : { "word1", "word25", "word29", "word0" }) {
+        for (size_t other : { size_t(SIZE_MAX), size_t(3), size_t(150), size_t(299) }) {
+            std::vector<uint64_t> expected;
+            for (uint64_t seq = kMessages; seq >= 1; --seq) {
+                bool has_prefix = false;
+                bool has_other = other == SIZE_MAX;
+                for (size_t word : messages[seq - 1]) {
+                    has_prefix = has_prefix || starts(word, prefix);
+                    has_other = has_other || word == other;
+                }
+                if (has_prefix && has_other) {
+                    expected.push_back(seq);
+                }
+            }
+            SearchIndex::Query query;
+            query.text = std::string(prefix) + "*";
+            if (other != SIZE_MAX) {
+                query.text += " " + name(other);
+            }
+            query.limit = SIZE_MAX;
+            assert(seqs(index.search(query)) == expected);
+        }
+    }
+    std::cout << "Prefixes against scan: OK" << std::endl;
+}
+
+// Fed by the store's listener while catching up on what the store already
+// held, the index ends up with every record exactly once
+static void test_catch_up() {
+    char path[] = "/tmp/search_index_test_XXXXXX";
+    assert(mkdtemp(path));
+    std::string dir = path;
+    {
+        HistoryStore store;
+        assert(store.open(dir));
+        for (int i = 0; i < 20000; ++i) {
+            store.append(i, 0, "alice", "lobby", "old message " + std::to_string(i));
+        }
+        SearchIndex index(store.first_seq());
+        store.set_append_listener([&index](const HistoryStore::Record& record) {
+            index.add(record.seq, record.time_ms, record.channel, record.body);
+        });
+
+        std::atomic<bool> cancel{false};
+        std::thread catching_up([&index, &store, &cancel] { index.catch_up(store, cancel); });
+        for (int i = 0; i < 5000; ++i) {
+            assert(store.append_async(20000 + i, 0, "bob", "lobby", "new message " + std::to_string(i)));
+        }
+        store.flush();
+        catching_up.join();
+
+        assert(index.next_seq() == store.next_seq());
+        SearchIndex::Query query;
+        query.text = "message";
+        query.limit = SIZE_MAX;
+        assert(index.search(query).size() == 25000);
+        query.text = "new";
+        assert(index.search(query).size() == 5000);
+        store.set_append_listener(nullptr);
+        store.close();
+    }
+    if (DIR* listing = opendir(dir.c_str())) {
+        while (dirent* entry = readdir(listing)) {
+            std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                unlink((dir + "/" + name).c_str());
+            }
+        }
+        closedir(listing);
+    }
+    rmdir(dir.c_str());
+    std::cout << "Catch up: OK" << std::endl;
+}
+
+static void test_parse() {
+    SearchIndex::Query query = SearchIndex::parse("in:dev deploy* \"build failed\" after:2026-01-02 before:2026-01-03");
+    assert(query.channel == "dev");
+    assert(query.text == "deploy* \"build failed\"");
+    assert(query.to_ms - query.from_ms >= 23 * 3600 * 1000LL && query.to_ms - query.from_ms <= 25 * 3600 * 1000LL);
+
+    query = SearchIndex::parse("after:yesterday hello");
+    assert(query.text == "after:yesterday hello" && query.from_ms == INT64_MIN);
+    std::cout << "Parse: OK" << std::endl;
+}
+
+int main() {
+    std::cout << "Running search index tests..." << std::endl;
+
+    test_terms();
+    test_phrases();
+    test_prefixes();
+    test_filters();
+    test_sequence_order();
+    test_against_scan();
+    test_prefix_against_scan();
+    test_catch_up();
+    test_parse();
+
+    std::cout << "Search index tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "../../src/core/startup_trace.h"
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+static size_t count(const std::string& text, const std::string& what) {
+    size_t n = 0;
+    for (size_t at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+void test_phases_and_marks() {
+    std::cout << "Testing phases and marks..." << std::endl;
+    StartupTrace trace;
+    assert(trace.time_of("window") < 0);
+    {
+        StartupTrace::Phase phase(trace, "window");
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    trace.mark("first_frame");
+
+    auto events = trace.events();
+    assert(events.size() == 2);
+    assert(events[0].name == "window" && !events[0].mark);
+    assert(events[0].end_us - events[0].begin_us >= 5000);
+    assert(events[1].name == "first_frame" && events[1].mark);
+    assert(events[1].begin_us == events[1].end_us);
+    // A phase is known by when it ended
+    assert(trace.time_of("window") == events[0].end_us);
+    assert(trace.time_of("first_frame") >= trace.time_of("window"));
+    std::cout << "✓ Phases and marks passed" << std::endl;
+}
+
+void test_threads() {
+    std::cout << "Testing phases on other threads..." << std::endl;
+    StartupTrace trace;
+    trace.mark("start");
+    std::thread audio([&trace] { StartupTrace::Phase phase(trace, "audio"); });
+    std::thread config([&trace] { StartupTrace::Phase phase(trace, "config"); });
+    audio.join();
+    config.join();
+    trace.mark("done");
+
+    auto events = trace.events();
+    assert(events.size() == 4);
+    // The first thread to record is 1, each other its own number
+    assert(events.front().thread == 1 && events.back().thread == 1);
+    assert(events[1].thread != 1 && events[2].thread != 1 && events[1].thread != events[2].thread);
+    std::cout << "✓ Phases on other threads passed" << std::endl;
+}
+
+void test_chrome_json() {
+    std::cout << "Testing Chrome trace output..." << std::endl;
+    StartupTrace::Clock::time_point origin = StartupTrace::Clock::now();
+    StartupTrace trace(origin);
+    trace.record("config", origin + std::chrono::microseconds(100), origin + std::chrono::microseconds(350));
+    std::thread([&trace] { trace.mark("say \"hi\""); }).join();
+
+    std::string json = trace.chrome_json();
+    assert(json.compare(0, 16, "{\"traceEvents\":[") == 0);
+    assert(json.find("{\"name\":\"config\",\"cat\":\"startup\",\"ph\":\"X\",\"ts\":100,\"dur\":250,\"pid\":1,\"tid\":1}")
+           != std::string::npos);
+    assert(json.find("\"name\":\"say \\\"hi\\\"\",\"cat\":\"startup\",\"ph\":\"i\"") != std::string::npos);
+    assert(count(json, "\"ph\":\"M\"") == 2);
+    assert(json.find("\"args\":{\"name\":\"main\"}") != std::string::npos);
+    // Every event but the last is followed by a comma
+    assert(count(json, "},\n") == 3);
+    assert(json.find("}\n],\"displayTimeUnit\":\"ms\"}") != std::string::npos);
+
+    // An empty trace is still a valid document
+    StartupTrace empty;
+    assert(empty.chrome_json() == "{\"traceEvents\":[\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    const std::string path = "startup_trace_test.json";
+    assert(trace.write_chrome_json(path));
+    std::ifstream file(path);
+    std::stringstream written;
+    written << file.rdbuf();
+    assert(written.str() == json);
+    std::remove(path.c_str());
+    assert(!trace.write_chrome_json("no_such_directory/trace.json"));
+    std::cout << "✓ Chrome trace output passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running startup trace tests..." << std::endl;
+
+    test_phases_and_marks();
+    test_threads();
+    test_chrome_json();
+
+    std::cout << "Startup trace tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,195 @@
+#include "../../src/audio/stream_handover.h"
+#include <iostream>
+#include <cassert>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <map>
+#include <thread>
+#include <vector>
+
+// Two fake output streams on one handover. What is rendered is numbered:
+// left carries 1, right the frame's number, so a frame played at gain g
+// reads back as (g, g * number).
+struct Engine {
+    std::atomic<bool> rendering{false};
+    std::atomic<unsigned> overlapping_renders{0};
+    unsigned long next = 1;
+
+    void render(float* output, unsigned long frames) {
+        if (rendering.exchange(true)) {
+            overlapping_renders.fetch_add(1);
+        }
+        for (unsigned long i = 0; i < frames; ++i, ++next) {
+            output[2 * i] = 1.0f;
+            output[2 * i + 1] = static_cast<float>(next);
+        }
+        rendering.store(false);
+    }
+};
+
+struct FakeStream {
+    StreamHandover::Slot slot;
+    std::vector<float> buffer;
+    std::map<unsigned long, float> gains;   // Of each frame heard
+    std::vector<unsigned long> order;       // Frames heard, in order
+    bool audible = false;                   // In the last callback
+
+    FakeStream(unsigned long frames, unsigned long fade) : buffer(2 * frames) { slot.fade_frames = fade; }
+
+    void callback(StreamHandover& handover, Engine& engine) {
+        const unsigned long frames = buffer.size() / 2;
+        handover.process(slot, buffer.data(), frames, [&](unsigned long offset, unsigned long count) {
+            engine.render(buffer.data() + 2 * offset, count);
+        });
+        audible = false;
+        for (unsigned long i = 0; i < frames; ++i) {
+            float gain = buffer[2 * i];
+            if (gain > 0.0f) {
+                unsigned long number = std::lround(buffer[2 * i + 1] / gain);
+                gains[number] = gain;
+                order.push_back(number);
+                audible = true;
+            }
+        }
+    }
+};
+
+// Every frame is heard once at full level, or in both streams at levels
+// adding up to one, in order
+static void check_crossfade(const FakeStream& from, const FakeStream& to, unsigned long last) {
+    for (unsigned long number = 1; number <= last; ++number) {
+        auto a = from.gains.find(number);
+        auto b = to.gains.find(number);
+        float sum = (a != from.gains.end() ? a->second : 0.0f) + (b != to.gains.end() ? b->second : 0.0f);
+        assert(std::fabs(sum - 1.0f) < 1e-4f);
+    }
+    for (const FakeStream* stream : { &from, &to }) {
+        for (size_t i = 1; i < stream->order.size(); ++i) {
+            assert(stream->order[i] == stream->order[i - 1] + 1);
+        }
+    }
+}
+
+void test_overlap() {
+    std::cout << "Testing the crossfade overlap..." << std::endl;
+    const unsigned long fade = 960;
+    Engine engine;
+    StreamHandover handover;
+    FakeStream from(256, fade);
+    FakeStream to(192, fade);
+    handover.set_owner(&from.slot);
+
+    // Different buffer sizes call back at different times; run both on
+    // one clock, in frames
+    unsigned long from_due = 0, to_due = 0;
+    bool begun = false, overlapped = false;
+    while (to_due < 48000) {
+        if (!begun && from_due >= 4800) {
+            handover.begin(to.slot, 1024);
+            begun = true;
+        }
+        if (from_due <= to_due) {
+            from.callback(handover, engine);
+            from_due += 256;
+        } else {
+            // Heard while the old stream still plays
+            bool from_owns = !handover.handed_over(to.slot);
+            to.callback(handover, engine);
+            to_due += 192;
+            assert(begun || !to.audible);
+            overlapped = overlapped || (to.audible && from_owns);
+        }
+    }
+    assert(handover.handed_over(to.slot));
+    handover.end();
+
+    assert(overlapped);
+    assert(engine.overlapping_renders.load() == 0);
+    // Less what the new stream had still to play when the clock stopped
+    check_crossfade(from, to, engine.next - 1 - 2 * 192);
+    // The old stream faded over exactly the fade
+    unsigned long fading = 0;
+    for (const auto& heard : from.gains) {
+        fading += heard.second < 1.0f ? 1 : 0;
+    }
+    assert(fading == fade - 1);
+    std::cout << "✓ Crossfade overlap passed" << std::endl;
+}
+
+// The old stream stops calling back partway, as an unplugged device does
+void test_forced() {
+    std::cout << "Testing a handover forced when the old stream stops..." << std::endl;
+    Engine engine;
+    StreamHandover handover;
+    FakeStream from(256, 960);
+    FakeStream to(256, 960);
+    handover.set_owner(&from.slot);
+    for (int i = 0; i < 4; ++i) {
+        from.callback(handover, engine);
+    }
+    handover.begin(to.slot, 1024);
+    from.callback(handover, engine);
+    to.callback(handover, engine);
+    assert(!handover.handed_over(to.slot));
+
+    handover.force(to.slot);
+    handover.end();
+    for (int i = 0; i < 8; ++i) {
+        to.callback(handover, engine);
+    }
+    // Whatever was passed over plays first, then the engine carries on
+    const std::vector<unsigned long>& heard = to.order;
+    for (size_t i = 1; i < heard.size(); ++i) {
+        assert(heard[i] == heard[i - 1] + 1);
+    }
+    assert(heard.front() == 4 * 256 + 2 && heard.back() == engine.next - 1);
+    assert(to.gains[heard.back()] == 1.0f);
+    std::cout << "✓ Forced handover passed" << std::endl;
+}
+
+// Real callback threads: the engine is never rendered from two at once
+void test_threads() {
+    std::cout << "Testing a handover between callback threads..." << std::endl;
+    Engine engine;
+    StreamHandover handover;
+    FakeStream from(128, 960);
+    FakeStream to(96, 960);
+    handover.set_owner(&from.slot);
+    std::atomic<bool> running{true};
+    auto run = [&](FakeStream& stream) {
+        while (running.load()) {
+            stream.callback(handover, engine);
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    };
+    std::thread from_thread(run, std::ref(from));
+    std::thread to_thread(run, std::ref(to));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    handover.begin(to.slot, 1024);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (!handover.handed_over(to.slot) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    assert(handover.handed_over(to.slot));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    running.store(false);
+    from_thread.join();
+    to_thread.join();
+    handover.end();
+
+    assert(engine.overlapping_renders.load() == 0);
+    check_crossfade(from, to, engine.next - 1 - 2 * 96);
+    std::cout << "✓ Handover between threads passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running stream handover tests..." << std::endl;
+
+    test_overlap();
+    test_forced();
+    test_threads();
+
+    std::cout << "Stream handover tests completed" << std::endl;
+    return 0;
+}
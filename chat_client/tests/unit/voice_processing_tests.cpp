@@ -0,0 +1,340 @@
+#include "../../src/dsp/fft.h"
+#include "../../src/dsp/echo_canceller.h"
+#include "../../src/dsp/voice_processor.h"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using Stage = VoiceProcessor::Stage;
+
+static const double kPi = 3.14159265358979;
+static const unsigned kRate = 48000;
+
+// Voiced sound: harmonics of a wandering 140 Hz pitch shaped by three
+// formants, in 300 ms syllables with 200 ms pauses
+static float speech_like(size_t n) {
+    double t = static_cast<double>(n) / kRate;
+    if (std::fmod(t, 0.5) >= 0.3) {
+        return 0.0f;
+    }
+    double f0 = 140.0 + 20.0 * std::sin(2.0 * kPi * 2.0 * t);
+    double sum = 0.0;
+    for (int h = 1; h <= 25; ++h) {
+        double f = h * f0;
+        double amplitude = std::exp(-std::pow((f - 500.0) / 300.0, 2))
+                         + 0.6 * std::exp(-std::pow((f - 1500.0) / 400.0, 2))
+                         + 0.3 * std::exp(-std::pow((f - 2500.0) / 500.0, 2));
+        sum += amplitude * std::sin(2.0 * kPi * f0 * h * t + h);
+    }
+    return static_cast<float>(0.05 * sum);
+}
+
+static double power(const std::vector<float>& x, size_t begin, size_t end) {
+    double sum = 0.0;
+    for (size_t i = begin; i < end; ++i) {
+        sum += static_cast<double>(x[i]) * x[i];
+    }
+    return sum / static_cast<double>(end - begin);
+}
+
+static double db(double ratio) {
+    return 10.0 * std::log10(ratio);
+}
+
+// Runs a processor over a whole signal in 256-frame callbacks, with
+// `played` as what went to the speakers in each callback
+static std::vector<float> run(VoiceProcessor& voice, const std::vector<float>& capture,
+                              const std::vector<float>* played = nullptr) {
+    constexpr size_t kCallback = 256;
+    std::vector<float> output(capture.size());
+    std::vector<float> stereo(2 * kCallback, 0.0f);
+    for (size_t offset = 0; offset + kCallback <= capture.size(); offset += kCallback) {
+        if (!voice.process(&capture[offset], &output[offset], kCallback)) {
+            std::copy(&capture[offset], &capture[offset] + kCallback, &output[offset]);
+        }
+        for (size_t i = 0; i < kCallback; ++i) {
+            float sample = played ? (*played)[offset + i] : 0.0f;
+            stereo[2 * i] = stereo[2 * i + 1] = sample;
+        }
+        voice.set_reference(stereo.data(), kCallback);
+    }
+    return output;
+}
+
+static void test_fft() {
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (size_t size : { 4, 16, 128, 1024 }) {
+        RealFft fft(size);
+        std::vector<float> x(size), re(fft.bins()), im(fft.bins()), y(size);
+        for (auto& v : x) v = dist(rng);
+        fft.forward(x.data(), re.data(), im.data());
+        for (size_t k = 0; k < fft.bins(); ++k) {
+            double dft_re = 0.0, dft_im = 0.0;
+            for (size_t n = 0; n < size; ++n) {
+                dft_re += x[n] * std::cos(2.0 * kPi * k * n / size);
+                dft_im -= x[n] * std::sin(2.0 * kPi * k * n / size);
+            }
+            assert(std::fabs(dft_re - re[k]) < 1e-4 && std::fabs(dft_im - im[k]) < 1e-4);
+        }
+        fft.inverse(re.data(), im.data(), y.data());
+        for (size_t n = 0; n < size; ++n) {
+            assert(std::fabs(y[n] - x[n]) < 1e-5f);
+        }
+    }
+    std::cout << "Real FFT matches the DFT and inverts: OK" << std::endl;
+}
+
+// A 30 ms delayed, decaying room response; the canceller should take out
+// most of it within a few seconds, keep the near end through double talk,
+// and not lose the echo path doing so.
+static void test_echo_cancellation() {
+    std::mt19937 rng(3);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    const size_t delay = kRate * 30 / 1000;
+    std::vector<float> room(delay + 2400, 0.0f);
+    for (size_t i = delay; i < room.size(); ++i) {
+        room[i] = 0.05f * gauss(rng) * std::exp(-static_cast<float>(i - delay) / 400.0f);
+    }
+
+    const size_t frames = kRate * 8;
+    std::vector<float> far(frames), echo(frames, 0.0f), near(frames, 0.0f), capture(frames);
+    for (size_t n = 0; n < frames; ++n) {
+        far[n] = n % kRate < kRate * 3 / 4 ? 0.2f * gauss(rng) : 0.0f;
+    }
+    for (size_t n = 0; n < frames; ++n) {
+        double sum = 0.0;
+        for (size_t k = delay; k < room.size() && k <= n; ++k) {
+            sum += room[k] * far[n - k];
+        }
+        echo[n] = static_cast<float>(sum);
+    }
+    // The near end talks over the echo in seconds 5 and 6
+    for (size_t n = 5 * kRate; n < 6 * kRate; ++n) {
+        near[n] = speech_like(n);
+    }
+    for (size_t n = 0; n < frames; ++n) {
+        capture[n] = echo[n] + near[n];
+    }
+
+    VoiceProcessor voice(1024);
+    voice.configure(kRate);
+    voice.set_enabled(Stage::ECHO_CANCELLATION, true);
+    std::vector<float> output = run(voice, capture, &far);
+    const size_t latency = voice.latency_frames();
+
+    // Residual echo: output less the delayed near end
+    auto erle = [&](size_t second) {
+        double residual = 0.0, original = 0.0;
+        for (size_t n = second * kRate; n < (second + 1) * kRate - kRate / 4; ++n) {
+            double r = output[n + latency] - near[n];
+            residual += r * r;
+            original += static_cast<double>(echo[n]) * echo[n];
+        }
+        return db(original / residual);
+    };
+    assert(erle(3) > 25.0);
+    assert(erle(5) > 10.0);   // Double talk
+    assert(erle(7) > 25.0);
+    assert(voice.echo_return_loss_enhancement_db() > 10.0f);
+    std::cout << "Echo cancellation: OK (ERLE " << static_cast<int>(erle(3)) << " dB, "
+              << static_cast<int>(erle(5)) << " dB in double talk)" << std::endl;
+}
+
+static void test_noise_suppression() {
+    std::mt19937 rng(5);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    const size_t frames = kRate * 6;
+    std::vector<float> clean(frames), noisy(frames);
+    for (size_t n = 0; n < frames; ++n) {
+        clean[n] = n > 2 * kRate ? speech_like(n) : 0.0f;
+        noisy[n] = clean[n] + 0.005f * gauss(rng);
+    }
+
+    VoiceProcessor voice(1024);
+    voice.configure(kRate);
+    voice.set_enabled(Stage::NOISE_SUPPRESSION, true);
+    std::vector<float> output = run(voice, noisy);
+    const size_t latency = voice.latency_frames();
+
+    // Noise alone, and speech error before and after
+    double reduction = db(power(noisy, kRate, 2 * kRate) / power(output, kRate + latency, 2 * kRate + latency));
+    double before = 0.0, after = 0.0, speech = 0.0;
+    for (size_t n = 3 * kRate; n + latency < frames; ++n) {
+        speech += clean[n] * clean[n];
+        before += (noisy[n] - clean[n]) * (noisy[n] - clean[n]);
+        after += (output[n + latency] - clean[n]) * (output[n + latency] - clean[n]);
+    }
+    assert(reduction > 12.0);
+    assert(db(speech / after) > db(speech / before) + 2.0);
+    std::cout << "Noise suppression: OK (" << static_cast<int>(reduction) << " dB on noise, SNR "
+              << static_cast<int>(db(speech / before)) << " -> " << static_cast<int>(db(speech / after))
+              << " dB)" << std::endl;
+}
+
+static void test_voice_activity() {
+    std::mt19937 rng(7);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    // Background noise; speech in seconds 2-4, a loud broadband hiss in 5-6
+    const size_t frames = kRate * 7;
+    std::vector<float> capture(frames);
+    for (size_t n = 0; n < frames; ++n) {
+        capture[n] = 0.003f * gauss(rng);
+        if (n >= 2 * kRate && n < 4 * kRate) {
+            capture[n] += speech_like(n);
+        }
+        if (n >= 5 * kRate && n < 6 * kRate) {
+            capture[n] += 0.05f * gauss(rng);
+        }
+    }
+
+    VoiceProcessor voice(1024);
+    voice.configure(kRate);
+    voice.set_enabled(Stage::VOICE_ACTIVITY, true);
+    constexpr size_t kCallback = 256;
+    std::vector<float> output(kCallback), stereo(2 * kCallback, 0.0f);
+    size_t syllables = 0, detected = 0, quiet = 0, false_alarms = 0;
+    for (size_t offset = 0; offset + kCallback <= frames; offset += kCallback) {
+        assert(voice.process(&capture[offset], output.data(), kCallback));
+        voice.set_reference(stereo.data(), kCallback);
+        double t = static_cast<double>(offset) / kRate;
+        bool talking = t >= 2.0 && t < 4.0 && std::fmod(t, 0.5) > 0.05 && std::fmod(t, 0.5) < 0.28;
+        bool silent = (t > 1.0 && t < 2.0) || (t > 5.05 && t < 6.0) || std::fmod(t, 0.5) > 0.35;
+        if (talking) {
+            ++syllables;
+            detected += voice.speech_detected();
+        } else if (silent && (t < 2.0 || t >= 4.05)) {
+            ++quiet;
+            false_alarms += voice.speech_detected();
+        }
+    }
+    assert(detected > syllables * 3 / 4);
+    assert(false_alarms < quiet / 20);
+    std::cout << "Voice activity detection: OK (" << detected << "/" << syllables << " speech, "
+              << false_alarms << "/" << quiet << " false)" << std::endl;
+}
+
+static void test_gain_control() {
+    std::mt19937 rng(9);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    const size_t frames = kRate * 6;
+    std::vector<float> quiet(frames);
+    for (size_t n = 0; n < frames; ++n) {
+        quiet[n] = 0.1f * speech_like(n) + 0.0005f * gauss(rng);
+    }
+
+    VoiceProcessor voice(1024);
+    voice.configure(kRate);
+    voice.set_enabled(Stage::GAIN_CONTROL, true);
+    voice.set_enabled(Stage::VOICE_ACTIVITY, true);
+    std::vector<float> output = run(voice, quiet);
+
+    double level_in = 0.0, level_out = 0.0;
+    size_t count = 0;
+    float peak = 0.0f;
+    for (size_t n = 4 * kRate; n + voice.latency_frames() < frames; ++n) {
+        if (speech_like(n) != 0.0f) {
+            level_in += quiet[n] * quiet[n];
+            float out = output[n + voice.latency_frames()];
+            level_out += out * out;
+            ++count;
+        }
+    }
+    for (float sample : output) {
+        peak = std::max(peak, std::fabs(sample));
+    }
+    double in_dbfs = db(level_in / count);
+    double out_dbfs = db(level_out / count);
+    assert(out_dbfs > in_dbfs + 12.0);
+    assert(out_dbfs > -30.0 && out_dbfs < -15.0);
+    assert(peak <= 0.9f);
+    std::cout << "Automatic gain control: OK (speech " << static_cast<int>(in_dbfs) << " -> "
+              << static_cast<int>(out_dbfs) << " dBFS)" << std::endl;
+}
+
+// With no stage enabled the capture passes through untouched; detection
+// alone delays it by exactly latency_frames() without changing it.
+static void test_passthrough_and_latency() {
+    std::vector<float> capture(256 * 150); // Whole callbacks only
+    for (size_t n = 0; n < capture.size(); ++n) {
+        capture[n] = speech_like(n + kRate / 10);
+    }
+    VoiceProcessor voice(1024);
+    voice.configure(kRate);
+    std::vector<float> output(256);
+    assert(!voice.active());
+    assert(!voice.process(capture.data(), output.data(), 256));
+
+    voice.set_enabled(Stage::VOICE_ACTIVITY, true);
+    assert(voice.latency_frames() <= kRate * 5 / 1000);
+    std::vector<float> delayed = run(voice, capture);
+    for (size_t n = voice.latency_frames(); n < delayed.size(); ++n) {
+        assert(std::fabs(delayed[n] - capture[n - voice.latency_frames()]) < 1e-6f);
+    }
+    std::cout << "Passthrough and fixed latency: OK (" << voice.latency_frames() << " frames)" << std::endl;
+}
+
+// Every stage on at 48 kHz must take well under the 5 ms a 240-frame
+// callback lasts, on one core.
+static void test_budget() {
+    std::mt19937 rng(11);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+    const size_t callback = kRate * 5 / 1000;
+    const size_t frames = kRate * 4;
+    std::vector<float> capture(frames), far(frames);
+    for (size_t n = 0; n < frames; ++n) {
+        far[n] = 0.1f * gauss(rng);
+        capture[n] = speech_like(n) + 0.3f * (n >= 1440 ? far[n - 1440] : 0.0f);
+    }
+
+    VoiceProcessor voice(1024);
+    voice.configure(kRate);
+    for (size_t stage = 0; stage < VoiceProcessor::kStageCount; ++stage) {
+        voice.set_enabled(static_cast<Stage>(stage), true);
+    }
+    std::vector<float> output(callback), stereo(2 * callback);
+    std::vector<double> times_ms;
+    for (size_t offset = 0; offset + callback <= frames; offset += callback) {
+        auto start = std::chrono::steady_clock::now();
+        voice.process(&capture[offset], output.data(), callback);
+        for (size_t i = 0; i < callback; ++i) {
+            stereo[2 * i] = stereo[2 * i + 1] = far[offset + i];
+        }
+        voice.set_reference(stereo.data(), callback);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        times_ms.push_back(elapsed.count());
+    }
+
+    double load = 0.0;
+    for (size_t stage = 0; stage < VoiceProcessor::kStageCount; ++stage) {
+        VoiceProcessor::StageStats stats = voice.stage_stats(static_cast<Stage>(stage));
+        assert(stats.hops > 0 && stats.mean_us > 0.0 && stats.max_us >= stats.mean_us);
+        load += stats.load;
+    }
+    assert(load < 0.5);
+    // A single callback can be preempted; the worst is only reported
+    std::sort(times_ms.begin(), times_ms.end());
+    double p99_ms = times_ms[times_ms.size() * 99 / 100];
+    assert(p99_ms < 5.0);
+    std::cout << "Whole chain within the 5 ms budget: OK (" << load * 100.0 << "% of a core, p99 callback "
+              << p99_ms << " ms, worst " << times_ms.back() << " ms)" << std::endl;
+}
+
+int main() {
+    std::cout << "Running voice processing tests..." << std::endl;
+
+    test_fft();
+    test_echo_cancellation();
+    test_noise_suppression();
+    test_voice_activity();
+    test_gain_control();
+    test_passthrough_and_latency();
+    test_budget();
+
+    std::cout << "Voice processing tests completed" << std::endl;
+    return 0;
+}
@@ -0,0 +1,219 @@
+#include "../../src/audio/waveform_pyramid.h"
+#include "../../src/dsp/spectrogram.h"
+#include <iostream>
+#include <cassert>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+static const unsigned kRate = 16000;
+// One step of the 16-bit entries, plus float rounding
+static const float kQuantum = 1.0f / 32767.0f + 1e-6f;
+
+static std::vector<float> noise(size_t frames, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dist(-0.8f, 0.8f);
+    std::vector<float> samples(frames);
+    for (auto& s : samples) s = dist(rng);
+    return samples;
+}
+
+// Fed in uneven blocks, as a consumer's handler would
+static void feed(WaveformPyramid& pyramid, const std::vector<float>& samples) {
+    size_t offset = 0;
+    for (size_t block = 1; offset < samples.size(); block = block * 7 % 1021 + 1) {
+        size_t frames = std::min(block, samples.size() - offset);
+        pyramid.append(samples.data() + offset, frames);
+        offset += frames;
+    }
+}
+
+void test_envelope_bounds() {
+    std::cout << "Testing envelope bounds..." << std::endl;
+    WaveformPyramid pyramid;
+    std::vector<float> samples = noise(200003, 1);
+    feed(pyramid, samples);
+    assert(pyramid.total_frames() == samples.size());
+    assert(pyramid.first_frame() == 0);
+
+    // Every column holds the exact extremes of its frames; columns on entry
+    // boundaries hold nothing more
+    for (double fpp : { 1.0, 3.0, 40.0, 64.0, 100.0, 256.0, 1000.0, 4096.0, 16384.0 }) {
+        for (int64_t first : { int64_t(0), int64_t(37), int64_t(65536) }) {
+            std::vector<WaveformPyramid::Column> columns(64);
+            pyramid.envelope(first, fpp, columns.data(), columns.size());
+            for (size_t i = 0; i < columns.size(); ++i) {
+                int64_t begin = first + static_cast<int64_t>(std::floor(i * fpp));
+                int64_t end = std::min<int64_t>(first + static_cast<int64_t>(std::floor((i + 1) * fpp)),
+                                                static_cast<int64_t>(samples.size()));
+                if (begin >= end) {
+                    assert(!columns[i].valid);
+                    continue;
+                }
+                auto range = std::minmax_element(samples.begin() + begin, samples.begin() + end);
+                assert(columns[i].valid);
+                assert(columns[i].min <= *range.first + kQuantum);
+                assert(columns[i].max >= *range.second - kQuantum);
+                bool aligned = fpp < WaveformPyramid::kBaseFrames ||
+                               (std::fmod(fpp, 64.0) == 0.0 && first % static_cast<int64_t>(fpp) == 0);
+                if (aligned) {
+                    assert(columns[i].min >= *range.first - kQuantum);
+                    assert(columns[i].max <= *range.second + kQuantum);
+                }
+            }
+        }
+    }
+    std::cout << "✓ Envelope bounds passed" << std::endl;
+}
+
+void test_unmerged_tail() {
+    std::cout << "Testing the newest frames..." << std::endl;
+    WaveformPyramid pyramid;
+    // Not a whole entry at any level; the spike is in the last few frames
+    std::vector<float> samples(1000037, 0.01f);
+    samples[samples.size() - 5] = -0.9f;
+    feed(pyramid, samples);
+
+    for (double fpp : { 16.0, 256.0, 65536.0 }) {
+        int64_t last_column = static_cast<int64_t>(samples.size() / fpp);
+        WaveformPyramid::Column column;
+        pyramid.envelope(static_cast<int64_t>(last_column * fpp), fpp, &column, 1);
+        assert(column.valid);
+        assert(column.min <= -0.9f + kQuantum);
+        assert(column.max >= 0.01f - kQuantum);
+    }
+    // Past the end there is nothing
+    WaveformPyramid::Column after;
+    pyramid.envelope(static_cast<int64_t>(samples.size()), 64.0, &after, 1);
+    assert(!after.valid);
+    std::cout << "✓ Newest frames passed" << std::endl;
+}
+
+void test_cost_per_column() {
+    std::cout << "Testing reads per column..." << std::endl;
+    WaveformPyramid pyramid;
+    // Ten minutes
+    std::vector<float> block(1024);
+    uint32_t state = 1;
+    for (size_t n = 0; n < size_t(600) * kRate / block.size(); ++n) {
+        for (auto& s : block) {
+            state = state * 1664525u + 1013904223u;
+            s = static_cast<float>(static_cast<int32_t>(state)) / 2147483648.0f;
+        }
+        pyramid.append(block.data(), block.size());
+    }
+
+    // The same number of columns over ten seconds or all ten minutes
+    constexpr size_t kColumns = 800;
+    std::vector<WaveformPyramid::Column> columns(kColumns);
+    const double total = static_cast<double>(pyramid.total_frames());
+    for (double span : { 10.0 * kRate, 60.0 * kRate, total }) {
+        double fpp = std::max(1.0, span / kColumns);
+        size_t reads = pyramid.envelope(static_cast<int64_t>(total - span), fpp, columns.data(), kColumns);
+        std::cout << "  " << span / kRate << " s: " << reads << " reads" << std::endl;
+        assert(reads <= kColumns * 2 * WaveformPyramid::kFanOut + 64);
+        assert(std::all_of(columns.begin(), columns.end(), [](const auto& c) { return c.valid; }));
+    }
+    // About 2 bytes a frame / 64 * 4 / 3, and the 30 s of raw samples
+    size_t expected = static_cast<size_t>(total / 64.0 * 4.0 * 4.0 / 3.0) + 30 * kRate * sizeof(float);
+    assert(pyramid.memory_bytes() <= expected + expected / 10);
+    std::cout << "✓ Reads per column passed" << std::endl;
+}
+
+void test_retention() {
+    std::cout << "Testing retention..." << std::endl;
+    WaveformPyramid::Options options;
+    options.max_seconds = 1.0;
+    options.raw_seconds = 0.5;
+    WaveformPyramid pyramid(options);
+    feed(pyramid, noise(5 * kRate, 2));
+    assert(pyramid.total_frames() == 5 * kRate);
+    // Level 0 keeps one second, give or take an entry
+    uint64_t first = pyramid.first_frame();
+    assert(first >= 4 * kRate - WaveformPyramid::kBaseFrames && first <= 4 * kRate + WaveformPyramid::kBaseFrames);
+
+    WaveformPyramid::Column columns[2];
+    pyramid.envelope(0, 1000.0, columns, 2);
+    assert(!columns[0].valid && !columns[1].valid);
+    pyramid.envelope(4 * kRate + 1000, 1000.0, columns, 2);
+    assert(columns[0].valid && columns[1].valid);
+
+    pyramid.clear();
+    assert(pyramid.total_frames() == 0 && pyramid.first_frame() == 0);
+    pyramid.envelope(0, 64.0, columns, 1);
+    assert(!columns[0].valid);
+    std::cout << "✓ Retention passed" << std::endl;
+}
+
+void test_spectrogram_tone() {
+    std::cout << "Testing spectrogram of a tone..." << std::endl;
+    Spectrogram::Options options;
+    Spectrogram spectrogram(options);
+    // 1 kHz at -6 dBFS lands in bin 32 of 512 at 16 kHz
+    std::vector<float> tone(kRate);
+    for (size_t n = 0; n < tone.size(); ++n) {
+        tone[n] = 0.5f * static_cast<float>(std::sin(2.0 * 3.14159265358979 * 1000.0 * n / kRate));
+    }
+    spectrogram.push(tone.data(), tone.size());
+    assert(spectrogram.columns() == kRate / options.hop);
+
+    std::vector<uint8_t> column(spectrogram.bins());
+    assert(spectrogram.read_columns(spectrogram.columns() - 1, 1, column.data()) == 1);
+    size_t loudest = std::max_element(column.begin(), column.end()) - column.begin();
+    assert(loudest == 32);
+    float expected = (-6.02f - Spectrogram::kFloorDb) * 255.0f / -Spectrogram::kFloorDb;
+    assert(std::fabs(column[32] - expected) <= 3.0f);
+    // Well away from the tone only the window's sidelobes are left
+    assert(column[100] < column[32] / 2);
+    assert(column[200] < column[32] / 2);
+    std::cout << "✓ Spectrogram tone passed" << std::endl;
+}
+
+void test_spectrogram_incremental() {
+    std::cout << "Testing spectrogram blocks and history..." << std::endl;
+    Spectrogram::Options options;
+    options.history_columns = 64;
+    Spectrogram whole(options);
+    Spectrogram pieces(options);
+    std::vector<float> samples = noise(3 * kRate + 77, 3);
+    whole.push(samples.data(), samples.size());
+    size_t offset = 0;
+    for (size_t block = 1; offset < samples.size(); block = block * 5 % 997 + 1) {
+        size_t frames = std::min(block, samples.size() - offset);
+        pieces.push(samples.data() + offset, frames);
+        offset += frames;
+    }
+    assert(whole.columns() == pieces.columns());
+    assert(whole.columns() == samples.size() / options.hop);
+
+    // Only the newest history_columns are held
+    const size_t bins = whole.bins();
+    std::vector<uint8_t> a(options.history_columns * bins), b(options.history_columns * bins);
+    assert(whole.read_columns(0, 200, a.data()) == 0);
+    uint64_t oldest = whole.columns() - options.history_columns;
+    assert(whole.read_columns(oldest - 10, 20, a.data()) == 10);
+    assert(whole.read_columns(oldest, options.history_columns, a.data()) == options.history_columns);
+    assert(pieces.read_columns(oldest, options.history_columns, b.data()) == options.history_columns);
+    assert(a == b);
+
+    whole.clear();
+    assert(whole.columns() == 0);
+    assert(whole.read_columns(0, 1, a.data()) == 0);
+    std::cout << "✓ Spectrogram blocks and history passed" << std::endl;
+}
+
+int main() {
+    std::cout << "Running waveform tests..." << std::endl;
+
+    test_envelope_bounds();
+    test_unmerged_tail();
+    test_cost_per_column();
+    test_retention();
+    test_spectrogram_tone();
+    test_spectrogram_incremental();
+
+    std::cout << "Waveform tests completed" << std::endl;
+    return 0;
+}